@@ -176,6 +176,14 @@ function main
   copy_outputs $winnet_root_path "winnet.dll"
   copy_outputs $winutil_root_path "winutil.dll"
 
+  # Optionally also build the modules above combined into a single module
+  if [[ -n "${CPP_BUILD_COMBINED_MODULE+x}" ]]; then
+    local winnative_root_path=${CPP_ROOT_PATH:-"./windows/winnative"}
+
+    build_solution "$winnative_root_path" "winnative.sln"
+    copy_outputs $winnative_root_path "winnative.dll"
+  fi
+
   build_nsis_plugins
 }
 
@@ -9,6 +9,7 @@ use self::system_state::SystemStateWriter;
 
 
 const DNS_STATE_FILENAME: &'static str = "dns-state-backup";
+const WINDNS_SNAPSHOT_FILENAME: &'static str = "windns-snapshot";
 
 /// Errors that can happen when configuring DNS on Windows.
 #[derive(err_derive::Error, Debug)]
@@ -24,6 +25,10 @@ pub enum Error {
     /// Failure to set new DNS servers.
     #[error(display = "Failed to set new DNS servers")]
     Setting,
+
+    /// Failure to restore the original DNS servers.
+    #[error(display = "Failed to restore the original DNS servers")]
+    Restoring,
 }
 
 pub struct DnsMonitor {}
@@ -32,7 +37,21 @@ impl super::DnsMonitorT for DnsMonitor {
     type Error = Error;
 
     fn new(cache_dir: impl AsRef<Path>) -> Result<Self, Error> {
-        unsafe { WinDns_Initialize(Some(log_sink), b"WinDns\0".as_ptr()).into_result()? };
+        let snapshot_path =
+            WideCString::from_os_str(cache_dir.as_ref().join(WINDNS_SNAPSHOT_FILENAME)).unwrap();
+
+        unsafe {
+            WinDns_Initialize(
+                Some(log_sink),
+                b"WinDns\0".as_ptr(),
+                WinDnsBackend::Auto,
+                snapshot_path.as_ptr(),
+            )
+            .into_result()?
+        };
+
+        // Names resolved before the tunnel came up would otherwise be served from the cache.
+        unsafe { WinDns_SetResolverCacheFlush(true) };
 
         let backup_writer = SystemStateWriter::new(
             cache_dir
@@ -81,7 +100,7 @@ impl super::DnsMonitorT for DnsMonitor {
     }
 
     fn reset(&mut self) -> Result<(), Error> {
-        Ok(())
+        unsafe { WinDns_Restore().into_result() }
     }
 }
 
@@ -100,9 +119,25 @@ impl Drop for DnsMonitor {
 }
 
 
+/// Selects how WinDns applies DNS settings.
+#[allow(dead_code)]
+#[repr(u32)]
+#[derive(Clone, Copy, Debug)]
+pub enum WinDnsBackend {
+    /// Use the native backend if supported, otherwise netsh.
+    Auto = 0,
+    /// Spawn netsh.exe for every update.
+    Netsh = 1,
+    /// Use the IP Helper DNS settings API.
+    Native = 2,
+    /// Feed commands to a long-lived netsh.exe process.
+    NetshPersistent = 3,
+}
+
 ffi_error!(InitializationResult, Error::Initialization);
 ffi_error!(DeinitializationResult, Error::Deinitialization);
 ffi_error!(SettingResult, Error::Setting);
+ffi_error!(RestoringResult, Error::Restoring);
 
 
 #[allow(non_snake_case)]
@@ -112,6 +147,8 @@ extern "stdcall" {
     pub fn WinDns_Initialize(
         sink: Option<LogSink>,
         sink_context: *const u8,
+        backend: WinDnsBackend,
+        snapshot_path: *const u16,
     ) -> InitializationResult;
 
     // WinDns_Deinitialize:
@@ -129,4 +166,12 @@ extern "stdcall" {
         v6_ips: *mut *const u16,
         v6_n_ips: u32,
     ) -> SettingResult;
+
+    // Flush the DNS client cache whenever servers are changed.
+    #[link_name = "WinDns_SetResolverCacheFlush"]
+    pub fn WinDns_SetResolverCacheFlush(enabled: bool) -> bool;
+
+    // Restore the original DNS servers on all adapters that have been modified.
+    #[link_name = "WinDns_Restore"]
+    pub fn WinDns_Restore() -> RestoringResult;
 }
@@ -43,6 +43,10 @@ use winapi::{
 const CLASS_NAME: &[u8] = b"S\0T\0A\0T\0I\0C\0\0\0";
 const REQUEST_THREAD_SHUTDOWN: UINT = WM_USER + 1;
 
+/// Connectivity must have been lost for this long before it is reported, so that a flapping
+/// network adapter doesn't cause a stream of offline/online transitions.
+const OFFLINE_CONFIRMATION_DELAY_MS: u32 = 2000;
+
 
 #[derive(err_derive::Error, Debug)]
 pub enum Error {
@@ -197,6 +201,7 @@ impl BroadcastListener {
         if !winnet::WinNet_ActivateConnectivityMonitor(
             Some(Self::connectivity_callback),
             callback_context,
+            OFFLINE_CONFIRMATION_DELAY_MS,
             Some(log_sink),
             b"Connectivity monitor\0".as_ptr(),
         ) {
@@ -221,6 +221,10 @@ impl TunnelStateMachine {
             }
         };
         let firewall = Firewall::new(args).map_err(Error::InitFirewallError)?;
+
+        #[cfg(windows)]
+        crate::winnet::init_route_journal(cache_dir.as_ref());
+
         let dns_monitor = DnsMonitor::new(cache_dir).map_err(Error::InitDnsMonitorError)?;
         let mut shared_values = SharedTunnelStateValues {
             firewall,
@@ -3,9 +3,16 @@ pub use self::api::{WinNet_ActivateConnectivityMonitor, WinNet_DeactivateConnect
 use crate::{logging::windows::log_sink, routing::Node};
 use ipnetwork::IpNetwork;
 use libc::{c_void, wchar_t};
-use std::{ffi::OsString, net::IpAddr, ptr};
+use parking_lot::Mutex;
+use std::{ffi::OsString, net::IpAddr, os::windows::ffi::OsStringExt, path::Path, ptr};
 use widestring::WideCString;
 
+const ROUTE_JOURNAL_FILENAME: &'static str = "winnet-route-journal";
+
+lazy_static::lazy_static! {
+    static ref ROUTE_JOURNAL_PATH: Mutex<Option<WideCString>> = Mutex::new(None);
+}
+
 /// Errors that this module may produce.
 #[derive(err_derive::Error, Debug)]
 pub enum Error {
@@ -90,19 +97,42 @@ pub fn get_tap_interface_ipv6_status() -> Result<bool, Error> {
 
 /// Dynamically determines the alias of the TAP adapter.
 pub fn get_tap_interface_alias() -> Result<OsString, Error> {
-    let mut alias_ptr: *mut wchar_t = ptr::null_mut();
-    let status = unsafe {
-        WinNet_GetTapInterfaceAlias(&mut alias_ptr as *mut _, Some(log_sink), logging_context())
-    };
-
-    if !status {
-        return Err(Error::GetTapAlias);
+    // Interface aliases are at most 256 characters, excluding the terminating null.
+    let mut buffer: Vec<wchar_t> = vec![0; 257];
+
+    loop {
+        let mut buffer_size = buffer.len() as u32;
+        let status = unsafe {
+            WinNet_CopyTapInterfaceAlias(
+                buffer.as_mut_ptr(),
+                &mut buffer_size,
+                Some(log_sink),
+                logging_context(),
+            )
+        };
+
+        match status {
+            // Success
+            0 => {
+                buffer.truncate(buffer_size.saturating_sub(1) as usize);
+                return Ok(OsString::from_wide(&buffer));
+            }
+            // Buffer too small
+            1 if buffer_size as usize > buffer.len() => {
+                buffer.resize(buffer_size as usize, 0);
+            }
+            // Failure
+            2 => return Err(Error::GetTapAlias),
+            // Unexpected value
+            i => {
+                log::error!(
+                    "Unexpected return code from WinNet_CopyTapInterfaceAlias: {}",
+                    i
+                );
+                return Err(Error::GetTapAlias);
+            }
+        }
     }
-
-    let alias = unsafe { WideCString::from_ptr_str(alias_ptr) };
-    unsafe { WinNet_ReleaseString(alias_ptr) };
-
-    Ok(alias.to_os_string())
 }
 
 #[repr(C)]
@@ -266,9 +296,35 @@ impl Drop for WinNetRoute {
     }
 }
 
+/// Records the routes of the routing manager in a journal in `cache_dir`, so they can be
+/// identified if the process exits without deactivating the routing manager. Routes that were
+/// left behind by an earlier process are deleted.
+pub fn init_route_journal(cache_dir: &Path) {
+    let journal_path = WideCString::from_os_str(cache_dir.join(ROUTE_JOURNAL_FILENAME)).unwrap();
+
+    let purged = unsafe {
+        WinNet_PurgeOwnedRoutes(Some(log_sink), logging_context(), journal_path.as_ptr())
+    };
+    if !purged {
+        log::error!("Failed to delete routes left behind by an earlier process");
+    }
+
+    *ROUTE_JOURNAL_PATH.lock() = Some(journal_path);
+}
+
 pub fn activate_routing_manager(routes: &[WinNetRoute]) -> bool {
-    return unsafe { WinNet_ActivateRouteManager(Some(log_sink), logging_context()) }
-        && routing_manager_add_routes(routes);
+    let activated = match &*ROUTE_JOURNAL_PATH.lock() {
+        Some(journal_path) => unsafe {
+            WinNet_ActivateRouteManagerWithJournal(
+                Some(log_sink),
+                logging_context(),
+                journal_path.as_ptr(),
+            )
+        },
+        None => unsafe { WinNet_ActivateRouteManager(Some(log_sink), logging_context()) },
+    };
+
+    activated && routing_manager_apply_routes(routes)
 }
 
 pub struct WinNetCallbackHandle {
@@ -339,10 +395,12 @@ pub fn add_default_route_change_callback<T: 'static>(
     }
 }
 
-pub fn routing_manager_add_routes(routes: &[WinNetRoute]) -> bool {
+/// Replaces the full set of routes. Only the difference is applied to the routing table, so
+/// routes adopted from the journal are kept if they are still wanted.
+pub fn routing_manager_apply_routes(routes: &[WinNetRoute]) -> bool {
     let ptr = routes.as_ptr();
     let length: u32 = routes.len() as u32;
-    unsafe { WinNet_AddRoutes(ptr, length) }
+    unsafe { WinNet_ApplyRouteSet(ptr, length) }
 }
 
 pub fn deactivate_routing_manager() {
@@ -373,8 +431,25 @@ mod api {
         #[link_name = "WinNet_ActivateRouteManager"]
         pub fn WinNet_ActivateRouteManager(sink: Option<LogSink>, sink_context: *const u8) -> bool;
 
-        #[link_name = "WinNet_AddRoutes"]
-        pub fn WinNet_AddRoutes(routes: *const super::WinNetRoute, num_routes: u32) -> bool;
+        #[link_name = "WinNet_ActivateRouteManagerWithJournal"]
+        pub fn WinNet_ActivateRouteManagerWithJournal(
+            sink: Option<LogSink>,
+            sink_context: *const u8,
+            journal_path: *const wchar_t,
+        ) -> bool;
+
+        #[link_name = "WinNet_PurgeOwnedRoutes"]
+        pub fn WinNet_PurgeOwnedRoutes(
+            sink: Option<LogSink>,
+            sink_context: *const u8,
+            journal_path: *const wchar_t,
+        ) -> bool;
+
+        // #[link_name = "WinNet_AddRoutes"]
+        // pub fn WinNet_AddRoutes(routes: *const super::WinNetRoute, num_routes: u32) -> bool;
+
+        #[link_name = "WinNet_ApplyRouteSet"]
+        pub fn WinNet_ApplyRouteSet(routes: *const super::WinNetRoute, num_routes: u32) -> bool;
 
         // #[link_name = "WinNet_AddRoute"]
         // pub fn WinNet_AddRoute(route: *const super::WinNetRoute) -> bool;
@@ -408,6 +483,14 @@ mod api {
             sink_context: *const u8,
         ) -> bool;
 
+        #[link_name = "WinNet_CopyTapInterfaceAlias"]
+        pub fn WinNet_CopyTapInterfaceAlias(
+            buffer: *mut wchar_t,
+            buffer_size: *mut u32,
+            sink: Option<LogSink>,
+            sink_context: *const u8,
+        ) -> u32;
+
         #[link_name = "WinNet_ReleaseString"]
         pub fn WinNet_ReleaseString(string: *mut wchar_t);
 
@@ -415,6 +498,7 @@ mod api {
         pub fn WinNet_ActivateConnectivityMonitor(
             callback: Option<ConnectivityCallback>,
             callbackContext: *mut libc::c_void,
+            offlineConfirmationDelayMs: u32,
             sink: Option<LogSink>,
             sink_context: *const u8,
         ) -> bool;
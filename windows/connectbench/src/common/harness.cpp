@@ -0,0 +1,115 @@
+#include "harness.h"
+#include <libcommon/string.h>
+#include <libcommon/error.h>
+#include <algorithm>
+#include <iostream>
+
+namespace harness
+{
+
+void ParseOptions(int argc, wchar_t *argv[], CommonOptions &options, const OptionHandler &handler)
+{
+	std::vector<std::wstring> arguments(argv + 1, argv + argc);
+
+	for (const auto &pair : common::string::SplitKeyValuePairs(arguments))
+	{
+		const auto key = common::string::Lower(pair.first);
+		const auto &value = pair.second;
+
+		if (0 == key.compare(L"adapter"))
+		{
+			options.adapter = value;
+		}
+		else if (0 == key.compare(L"iterations"))
+		{
+			options.iterations = common::string::LexicalCast<size_t>(value);
+		}
+		else if (0 == key.compare(L"routes"))
+		{
+			options.routes = std::min<size_t>(256, common::string::LexicalCast<size_t>(value));
+		}
+		else if (0 == key.compare(L"dns"))
+		{
+			options.dns = value;
+		}
+		else if (0 == key.compare(L"timeout"))
+		{
+			options.timeout = common::string::LexicalCast<uint32_t>(value);
+		}
+		else if (false == handler(key, value))
+		{
+			THROW_ERROR("Unsupported argument");
+		}
+	}
+
+	if (options.adapter.empty())
+	{
+		THROW_ERROR("An adapter alias is required");
+	}
+}
+
+std::vector<WINNET_ROUTE> GenerateRoutes(size_t count, const WINNET_NODE *node)
+{
+	std::vector<WINNET_ROUTE> routes;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		WINNET_ROUTE route = { 0 };
+
+		route.network.type = WINNET_IP_TYPE_IPV4;
+		route.network.bytes[0] = 198;
+		route.network.bytes[1] = static_cast<uint8_t>(18 + (i / 256));
+		route.network.bytes[2] = static_cast<uint8_t>(i % 256);
+		route.network.prefix = 24;
+		route.node = node;
+
+		routes.push_back(route);
+	}
+
+	return routes;
+}
+
+void __stdcall LogSink(MULLVAD_LOG_LEVEL level, const char *message, void *)
+{
+	if (MULLVAD_LOG_LEVEL_WARNING >= level)
+	{
+		std::cout << message << std::endl;
+	}
+}
+
+bool InitializeModules(uint32_t timeout, WINDNS_BACKEND backend)
+{
+	if (false == WinFw_Initialize(timeout, LogSink, nullptr))
+	{
+		std::wcout << L"Failed to initialize winfw" << std::endl;
+		return false;
+	}
+
+	if (false == WinNet_ActivateRouteManager(LogSink, nullptr))
+	{
+		std::wcout << L"Failed to activate the winnet route manager" << std::endl;
+		WinFw_Deinitialize();
+
+		return false;
+	}
+
+	if (false == WinDns_Initialize(LogSink, nullptr, backend, nullptr))
+	{
+		std::wcout << L"Failed to initialize windns" << std::endl;
+		WinNet_DeactivateRouteManager();
+		WinFw_Deinitialize();
+
+		return false;
+	}
+
+	return true;
+}
+
+void DeinitializeModules()
+{
+	WinDns_Deinitialize();
+	WinNet_DeactivateRouteManager();
+	WinFw_Deinitialize();
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "winfw/winfw.h"
+#include "winnet/winnet.h"
+#include "windns/windns.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+//
+// Setup and argument handling shared by connectbench and soak.
+//
+
+namespace harness
+{
+
+//
+// Options accepted by both tools.
+//
+struct CommonOptions
+{
+	size_t iterations = 0;
+	size_t routes = 2;
+	std::wstring adapter = L"Loopback Pseudo-Interface 1";
+	std::wstring dns = L"10.64.0.1";
+	uint32_t timeout = 0;
+};
+
+//
+// Receives options that are specific to a tool. Returns false if the key is not supported.
+// The key is in lower case.
+//
+using OptionHandler = std::function<bool(const std::wstring &key, const std::wstring &value)>;
+
+//
+// Parse arguments on the form key=value.
+// Throws on unsupported keys, and if no adapter is specified.
+//
+void ParseOptions(int argc, wchar_t *argv[], CommonOptions &options, const OptionHandler &handler);
+
+//
+// Routes are added for networks in the range reserved for benchmarking (RFC 2544),
+// so the adapter does not capture any real traffic.
+//
+std::vector<WINNET_ROUTE> GenerateRoutes(size_t count, const WINNET_NODE *node);
+
+//
+// Prints warnings and errors to stdout.
+//
+void __stdcall LogSink(MULLVAD_LOG_LEVEL level, const char *message, void *context);
+
+//
+// Initialize winfw, activate the winnet route manager and initialize windns.
+// If any of them fails, the error is printed and the others are torn down again.
+//
+bool InitializeModules(uint32_t timeout, WINDNS_BACKEND backend);
+void DeinitializeModules();
+
+}
@@ -0,0 +1,291 @@
+// connectbench.cpp : Replays the native part of connecting and disconnecting, and reports per-step latency.
+//
+
+#include "stdafx.h"
+#include "../common/harness.h"
+#include <libcommon/string.h>
+#include <libcommon/error.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Options : harness::CommonOptions
+{
+	Options()
+	{
+		iterations = 50;
+	}
+
+	WINDNS_BACKEND backend = WINDNS_BACKEND_AUTO;
+};
+
+//
+// Steps are listed in the order they're performed by the daemon.
+//
+enum Step
+{
+	STEP_POLICY_CONNECTING = 0,
+	STEP_ADD_ROUTES,
+	STEP_TOP_METRIC,
+	STEP_SET_DNS,
+	STEP_POLICY_CONNECTED,
+	STEP_DELETE_ROUTES,
+	STEP_RESTORE_DNS,
+	STEP_RESET_POLICY,
+
+	NUM_STEPS
+};
+
+const wchar_t *STEP_NAMES[NUM_STEPS] =
+{
+	L"winfw connecting policy",
+	L"winnet add routes",
+	L"winnet top metric",
+	L"windns set",
+	L"winfw connected policy",
+	L"winnet delete routes",
+	L"windns restore",
+	L"winfw reset",
+};
+
+void PrintUsage()
+{
+	std::wcout << L"Usage: connectbench [key=value ...]" << std::endl
+		<< std::endl
+		<< L"  adapter=alias    Adapter standing in for the tunnel (default \"Loopback Pseudo-Interface 1\")" << std::endl
+		<< L"  iterations=N     Number of connect/disconnect cycles (default 50)" << std::endl
+		<< L"  routes=N         Number of routes added through the adapter (default 2)" << std::endl
+		<< L"  dns=ip           IPv4 DNS server set on the adapter (default 10.64.0.1)" << std::endl
+		<< L"  backend=name     auto|netsh|native|persistent (default auto)" << std::endl
+		<< L"  timeout=N        Firewall transaction lock timeout in seconds (default 0)" << std::endl;
+}
+
+WINDNS_BACKEND ParseBackend(const std::wstring &value)
+{
+	const auto backend = common::string::Lower(value);
+
+	if (0 == backend.compare(L"auto"))
+	{
+		return WINDNS_BACKEND_AUTO;
+	}
+	else if (0 == backend.compare(L"netsh"))
+	{
+		return WINDNS_BACKEND_NETSH;
+	}
+	else if (0 == backend.compare(L"native"))
+	{
+		return WINDNS_BACKEND_NATIVE;
+	}
+	else if (0 == backend.compare(L"persistent"))
+	{
+		return WINDNS_BACKEND_NETSH_PERSISTENT;
+	}
+
+	THROW_ERROR("Unsupported DNS backend");
+}
+
+Options ParseOptions(int argc, wchar_t *argv[])
+{
+	Options options;
+
+	harness::ParseOptions(argc, argv, options, [&options](const std::wstring &key, const std::wstring &value)
+	{
+		if (0 == key.compare(L"backend"))
+		{
+			options.backend = ParseBackend(value);
+			return true;
+		}
+
+		return false;
+	});
+
+	return options;
+}
+
+uint64_t Percentile(const std::vector<uint64_t> &sorted, double percentile)
+{
+	if (sorted.empty())
+	{
+		return 0;
+	}
+
+	const auto index = static_cast<size_t>(percentile * (sorted.size() - 1) + 0.5);
+
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void ReportLine(const wchar_t *name, std::vector<uint64_t> samples)
+{
+	std::sort(samples.begin(), samples.end());
+
+	std::wcout << std::left << std::setw(28) << name << std::right
+		<< std::setw(10) << Percentile(samples, 0.50)
+		<< std::setw(10) << Percentile(samples, 0.99)
+		<< std::setw(10) << (samples.empty() ? 0 : samples.back())
+		<< std::endl;
+}
+
+//
+// Time a single step. Returns false if the step failed.
+//
+bool Measure(std::vector<uint64_t> &samples, std::function<bool()> step)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	const auto status = step();
+
+	const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+
+	if (status)
+	{
+		samples.push_back(static_cast<uint64_t>(latency));
+	}
+
+	return status;
+}
+
+} // anonymous namespace
+
+int wmain(int argc, wchar_t *argv[])
+{
+	Options options;
+
+	try
+	{
+		options = ParseOptions(argc, argv);
+	}
+	catch (std::exception &err)
+	{
+		std::cout << "Error: " << err.what() << std::endl << std::endl;
+		PrintUsage();
+
+		return 1;
+	}
+
+	if (false == harness::InitializeModules(options.timeout, options.backend))
+	{
+		return 1;
+	}
+
+	WinFwSettings settings;
+
+	settings.permitDhcp = true;
+	settings.permitLan = false;
+
+	WinFwRelay relay;
+
+	relay.ip = L"198.19.0.1";
+	relay.port = 1194;
+	relay.protocol = WinFwProtocol::Udp;
+
+	const WINNET_NODE node = { nullptr, options.adapter.c_str() };
+	const auto routes = harness::GenerateRoutes(options.routes, &node);
+
+	const wchar_t *dnsServers[] = { options.dns.c_str() };
+
+	std::vector<uint64_t> samples[NUM_STEPS];
+	std::vector<uint64_t> connectTotals;
+	std::vector<uint64_t> disconnectTotals;
+
+	size_t failures = 0;
+
+	for (size_t iteration = 0; iteration < options.iterations; ++iteration)
+	{
+		const auto connectStart = std::chrono::steady_clock::now();
+
+		auto status = Measure(samples[STEP_POLICY_CONNECTING], [&]()
+		{
+			return WinFw_ApplyPolicyConnecting(settings, relay, nullptr);
+		})
+		&& Measure(samples[STEP_ADD_ROUTES], [&]()
+		{
+			return WinNet_AddRoutes(routes.data(), static_cast<uint32_t>(routes.size()));
+		})
+		&& Measure(samples[STEP_TOP_METRIC], [&]()
+		{
+			return WINNET_ETM_STATUS_FAILURE != WinNet_EnsureTopMetric(options.adapter.c_str(), harness::LogSink, nullptr);
+		})
+		&& Measure(samples[STEP_SET_DNS], [&]()
+		{
+			return WinDns_Set(options.adapter.c_str(), dnsServers, _countof(dnsServers), nullptr, 0);
+		})
+		&& Measure(samples[STEP_POLICY_CONNECTED], [&]()
+		{
+			return WinFw_ApplyPolicyConnected(settings, relay, options.adapter.c_str(), options.dns.c_str(), nullptr);
+		});
+
+		if (status)
+		{
+			connectTotals.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - connectStart).count()));
+		}
+		else
+		{
+			++failures;
+		}
+
+		//
+		// Always disconnect, so a failed cycle does not leave state behind for the next one.
+		//
+		const auto disconnectStart = std::chrono::steady_clock::now();
+
+		const auto routesDeleted = Measure(samples[STEP_DELETE_ROUTES], [&]()
+		{
+			return WinNet_DeleteRoutes(routes.data(), static_cast<uint32_t>(routes.size()));
+		});
+
+		const auto dnsRestored = Measure(samples[STEP_RESTORE_DNS], []()
+		{
+			return WinDns_Restore();
+		});
+
+		const auto policyReset = Measure(samples[STEP_RESET_POLICY], []()
+		{
+			return WinFw_Reset();
+		});
+
+		if (status && routesDeleted && dnsRestored && policyReset)
+		{
+			disconnectTotals.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - disconnectStart).count()));
+		}
+		else if (status)
+		{
+			++failures;
+		}
+	}
+
+	harness::DeinitializeModules();
+
+	std::wcout << std::left << std::setw(28) << L"step (us)" << std::right
+		<< std::setw(10) << L"p50"
+		<< std::setw(10) << L"p99"
+		<< std::setw(10) << L"max"
+		<< std::endl;
+
+	for (size_t step = 0; step < NUM_STEPS; ++step)
+	{
+		ReportLine(STEP_NAMES[step], samples[step]);
+
+		if (STEP_POLICY_CONNECTED == step)
+		{
+			ReportLine(L"= connect", connectTotals);
+		}
+	}
+
+	ReportLine(L"= disconnect", disconnectTotals);
+
+	std::wcout << std::endl
+		<< L"Completed cycles:\t" << disconnectTotals.size() << std::endl
+		<< L"Failed cycles:\t\t" << failures << std::endl;
+
+	return (0 == failures ? 0 : 1);
+}
@@ -0,0 +1,404 @@
+// soak.cpp : Cycles connect and disconnect through winfw, winnet and windns many times,
+// and tracks resources that should not grow from one cycle to the next.
+//
+
+#include "stdafx.h"
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <windows.h>
+#include <psapi.h>
+#include "../common/harness.h"
+#include "libwfp/filterengine.h"
+#include "libwfp/objectenumerator.h"
+#include <libcommon/string.h>
+#include <libcommon/error.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+//
+// Must match the provider in winfw/mullvadguids.cpp
+//
+const GUID MULLVAD_PROVIDER =
+{
+	0x21e1dab8,
+	0xb9db,
+	0x43c0,
+	{ 0xb3, 0x43, 0xeb, 0x93, 0x65, 0xc7, 0xbd, 0xd2 }
+};
+
+struct Options : harness::CommonOptions
+{
+	Options()
+	{
+		iterations = 5000;
+	}
+
+	size_t interval = 100;
+	size_t relays = 16;
+
+	// Growth that is tolerated before a resource is flagged.
+	size_t handleSlack = 16;
+	size_t privateBytesSlack = 1024 * 1024;
+};
+
+//
+// Resources are sampled in the disconnected state, where the count of filters and
+// routes should return to the same value after every cycle.
+//
+enum Resource
+{
+	RESOURCE_HANDLES = 0,
+	RESOURCE_PRIVATE_BYTES,
+	RESOURCE_FILTERS,
+	RESOURCE_ROUTES,
+
+	NUM_RESOURCES
+};
+
+const wchar_t *RESOURCE_NAMES[NUM_RESOURCES] =
+{
+	L"handles",
+	L"private bytes",
+	L"filters",
+	L"routes",
+};
+
+struct Sample
+{
+	size_t iteration;
+	uint64_t values[NUM_RESOURCES];
+};
+
+void PrintUsage()
+{
+	std::wcout << L"Usage: soak [key=value ...]" << std::endl
+		<< std::endl
+		<< L"  adapter=alias    Adapter standing in for the tunnel (default \"Loopback Pseudo-Interface 1\")" << std::endl
+		<< L"  iterations=N     Number of connect/disconnect cycles (default 5000)" << std::endl
+		<< L"  interval=N       Cycles between samples (default 100)" << std::endl
+		<< L"  routes=N         Number of routes added through the adapter (default 2)" << std::endl
+		<< L"  relays=N         Number of distinct relays to cycle through (default 16)" << std::endl
+		<< L"  dns=ip           IPv4 DNS server set on the adapter (default 10.64.0.1)" << std::endl
+		<< L"  timeout=N        Firewall transaction lock timeout in seconds (default 0)" << std::endl
+		<< L"  handleslack=N    Handle growth tolerated before flagging (default 16)" << std::endl
+		<< L"  memoryslack=N    Private bytes growth tolerated before flagging (default 1048576)" << std::endl;
+}
+
+Options ParseOptions(int argc, wchar_t *argv[])
+{
+	Options options;
+
+	harness::ParseOptions(argc, argv, options, [&options](const std::wstring &key, const std::wstring &value)
+	{
+		if (0 == key.compare(L"interval"))
+		{
+			options.interval = std::max<size_t>(1, common::string::LexicalCast<size_t>(value));
+		}
+		else if (0 == key.compare(L"relays"))
+		{
+			options.relays = std::max<size_t>(1, std::min<size_t>(254, common::string::LexicalCast<size_t>(value)));
+		}
+		else if (0 == key.compare(L"handleslack"))
+		{
+			options.handleSlack = common::string::LexicalCast<size_t>(value);
+		}
+		else if (0 == key.compare(L"memoryslack"))
+		{
+			options.privateBytesSlack = common::string::LexicalCast<size_t>(value);
+		}
+		else
+		{
+			return false;
+		}
+
+		return true;
+	});
+
+	return options;
+}
+
+//
+// Relays are taken from the range reserved for benchmarking (RFC 2544),
+// like the routes.
+//
+std::vector<std::wstring> GenerateRelays(size_t count)
+{
+	std::vector<std::wstring> relays;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		relays.push_back(L"198.19.255." + std::to_wstring(i + 1));
+	}
+
+	return relays;
+}
+
+uint64_t CountHandles()
+{
+	DWORD count = 0;
+
+	if (FALSE == GetProcessHandleCount(GetCurrentProcess(), &count))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "GetProcessHandleCount");
+	}
+
+	return count;
+}
+
+uint64_t PrivateBytes()
+{
+	PROCESS_MEMORY_COUNTERS_EX counters = { 0 };
+
+	if (FALSE == GetProcessMemoryInfo(GetCurrentProcess(),
+		reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&counters), sizeof(counters)))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "GetProcessMemoryInfo");
+	}
+
+	return counters.PrivateUsage;
+}
+
+uint64_t CountInstalledFilters()
+{
+	auto engine = wfp::FilterEngine::DynamicSession();
+
+	uint64_t count = 0;
+
+	wfp::ObjectEnumerator::Filters(*engine, [&count](const FWPM_FILTER0 &filter)
+	{
+		if (nullptr != filter.providerKey && MULLVAD_PROVIDER == *filter.providerKey)
+		{
+			++count;
+		}
+
+		return true;
+	});
+
+	return count;
+}
+
+uint64_t CountRoutes()
+{
+	PMIB_IPFORWARD_TABLE2 table;
+
+	const auto status = GetIpForwardTable2(AF_UNSPEC, &table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "GetIpForwardTable2");
+	}
+
+	const uint64_t count = table->NumEntries;
+
+	FreeMibTable(table);
+
+	return count;
+}
+
+Sample TakeSample(size_t iteration)
+{
+	Sample sample;
+
+	sample.iteration = iteration;
+	sample.values[RESOURCE_HANDLES] = CountHandles();
+	sample.values[RESOURCE_PRIVATE_BYTES] = PrivateBytes();
+	sample.values[RESOURCE_FILTERS] = CountInstalledFilters();
+	sample.values[RESOURCE_ROUTES] = CountRoutes();
+
+	return sample;
+}
+
+void PrintSample(const Sample &sample)
+{
+	std::wcout << std::setw(10) << sample.iteration;
+
+	for (size_t resource = 0; resource < NUM_RESOURCES; ++resource)
+	{
+		std::wcout << std::setw(16) << sample.values[resource];
+	}
+
+	std::wcout << std::endl;
+}
+
+//
+// A resource is flagged if it ends up above the first sample by more than the slack,
+// and rose in more intervals than it fell. The second condition keeps a single
+// allocation burst, e.g. a container growing its capacity, from being reported.
+//
+bool IsGrowing(const std::vector<Sample> &samples, Resource resource, uint64_t slack)
+{
+	if (samples.size() < 2)
+	{
+		return false;
+	}
+
+	const auto first = samples.front().values[resource];
+	const auto last = samples.back().values[resource];
+
+	if (last <= first + slack)
+	{
+		return false;
+	}
+
+	size_t rises = 0;
+	size_t falls = 0;
+
+	for (size_t i = 1; i < samples.size(); ++i)
+	{
+		const auto previous = samples[i - 1].values[resource];
+		const auto current = samples[i].values[resource];
+
+		if (current > previous)
+		{
+			++rises;
+		}
+		else if (current < previous)
+		{
+			++falls;
+		}
+	}
+
+	return rises > falls;
+}
+
+} // anonymous namespace
+
+int wmain(int argc, wchar_t *argv[])
+{
+	Options options;
+
+	try
+	{
+		options = ParseOptions(argc, argv);
+	}
+	catch (std::exception &err)
+	{
+		std::cout << "Error: " << err.what() << std::endl << std::endl;
+		PrintUsage();
+
+		return 1;
+	}
+
+	if (false == harness::InitializeModules(options.timeout, WINDNS_BACKEND_AUTO))
+	{
+		return 1;
+	}
+
+	WinFwSettings settings;
+
+	settings.permitDhcp = true;
+	settings.permitLan = false;
+
+	const auto relays = GenerateRelays(options.relays);
+
+	const WINNET_NODE node = { nullptr, options.adapter.c_str() };
+	const auto routes = harness::GenerateRoutes(options.routes, &node);
+
+	const wchar_t *dnsServers[] = { options.dns.c_str() };
+
+	std::vector<Sample> samples;
+	size_t failures = 0;
+
+	std::wcout << std::setw(10) << L"cycle";
+
+	for (size_t resource = 0; resource < NUM_RESOURCES; ++resource)
+	{
+		std::wcout << std::setw(16) << RESOURCE_NAMES[resource];
+	}
+
+	std::wcout << std::endl;
+
+	try
+	{
+		for (size_t iteration = 1; iteration <= options.iterations; ++iteration)
+		{
+			//
+			// Cycling relays makes every connect replace the relay permit,
+			// rather than finding the policy already in place.
+			//
+			WinFwRelay relay;
+
+			relay.ip = relays[iteration % relays.size()].c_str();
+			relay.port = 1194;
+			relay.protocol = WinFwProtocol::Udp;
+
+			const auto status = WinFw_ApplyPolicyConnecting(settings, relay, nullptr)
+				&& WinNet_AddRoutes(routes.data(), static_cast<uint32_t>(routes.size()))
+				&& WinDns_Set(options.adapter.c_str(), dnsServers, _countof(dnsServers), nullptr, 0)
+				&& WinFw_ApplyPolicyConnected(settings, relay, options.adapter.c_str(), options.dns.c_str(), nullptr);
+
+			//
+			// Always disconnect, so a failed cycle does not leave state behind for the next one.
+			//
+			const auto routesDeleted = WinNet_DeleteRoutes(routes.data(), static_cast<uint32_t>(routes.size()));
+			const auto dnsRestored = WinDns_Restore();
+			const auto policyReset = WinFw_Reset();
+
+			if (false == (status && routesDeleted && dnsRestored && policyReset))
+			{
+				++failures;
+			}
+
+			//
+			// The first sample is taken after one interval, so one-time initialization
+			// in each module is not mistaken for growth.
+			//
+			if (0 == iteration % options.interval)
+			{
+				samples.push_back(TakeSample(iteration));
+				PrintSample(samples.back());
+			}
+		}
+	}
+	catch (std::exception &err)
+	{
+		std::cout << "Error: " << err.what() << std::endl;
+		++failures;
+	}
+
+	harness::DeinitializeModules();
+
+	const uint64_t slack[NUM_RESOURCES] =
+	{
+		options.handleSlack,
+		options.privateBytesSlack,
+		0,
+		0,
+	};
+
+	size_t growing = 0;
+
+	std::wcout << std::endl;
+
+	for (size_t resource = 0; resource < NUM_RESOURCES; ++resource)
+	{
+		const auto flagged = IsGrowing(samples, static_cast<Resource>(resource), slack[resource]);
+
+		if (flagged)
+		{
+			++growing;
+		}
+
+		std::wcout << std::left << std::setw(16) << RESOURCE_NAMES[resource] << std::right
+			<< (flagged ? L"GROWING" : L"stable");
+
+		if (false == samples.empty())
+		{
+			std::wcout << L" (" << samples.front().values[resource] << L" -> " << samples.back().values[resource] << L")";
+		}
+
+		std::wcout << std::endl;
+	}
+
+	std::wcout << std::endl
+		<< L"Failed cycles:\t\t" << failures << std::endl;
+
+	return (0 == failures && 0 == growing ? 0 : 1);
+}
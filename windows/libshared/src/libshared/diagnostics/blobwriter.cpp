@@ -0,0 +1,174 @@
+#include "stdafx.h"
+#include "blobwriter.h"
+#include <libshared/performance/counterregistry.h>
+#include <libcommon/error.h>
+#include <cstring>
+
+namespace shared::diagnostics
+{
+
+BlobWriter::BlobWriter(uint8_t *buffer, size_t capacity, MULLVAD_DIAGNOSTICS_MODULE module)
+	: m_buffer(buffer)
+	, m_capacity(capacity)
+	, m_size(sizeof(MULLVAD_DIAGNOSTICS_HEADER))
+	, m_module(module)
+	, m_numRecords(0)
+	, m_droppedRecords(0)
+{
+	if (nullptr == buffer || capacity < sizeof(MULLVAD_DIAGNOSTICS_HEADER))
+	{
+		THROW_ERROR("Diagnostics buffer is too small");
+	}
+}
+
+BlobWriter::Record &BlobWriter::Record::u(uint64_t value)
+{
+	do
+	{
+		auto byte = static_cast<uint8_t>(value & 0x7f);
+
+		value >>= 7;
+
+		if (0 != value)
+		{
+			byte |= 0x80;
+		}
+
+		m_payload.push_back(byte);
+	}
+	while (0 != value);
+
+	return *this;
+}
+
+BlobWriter::Record &BlobWriter::Record::s(const std::string &value)
+{
+	return b(value.data(), value.size());
+}
+
+BlobWriter::Record &BlobWriter::Record::s(const std::wstring &value)
+{
+	if (value.empty())
+	{
+		return u(0);
+	}
+
+	const auto required = WideCharToMultiByte(CP_UTF8, 0, value.data(), static_cast<int>(value.size()),
+		nullptr, 0, nullptr, nullptr);
+
+	std::string converted(static_cast<size_t>(required < 0 ? 0 : required), '\0');
+
+	WideCharToMultiByte(CP_UTF8, 0, value.data(), static_cast<int>(value.size()),
+		converted.data(), required, nullptr, nullptr);
+
+	return s(converted);
+}
+
+BlobWriter::Record &BlobWriter::Record::b(const void *data, size_t size)
+{
+	u(size);
+
+	const auto bytes = reinterpret_cast<const uint8_t *>(data);
+
+	m_payload.insert(m_payload.end(), bytes, bytes + size);
+
+	return *this;
+}
+
+BlobWriter::Record &BlobWriter::Record::g(const GUID &value)
+{
+	const auto bytes = reinterpret_cast<const uint8_t *>(&value);
+
+	m_payload.insert(m_payload.end(), bytes, bytes + sizeof(value));
+
+	return *this;
+}
+
+bool BlobWriter::write(const Record &record)
+{
+	const auto size = sizeof(MULLVAD_DIAGNOSTICS_RECORD) + record.m_payload.size();
+
+	if (size > m_capacity - m_size)
+	{
+		++m_droppedRecords;
+		return false;
+	}
+
+	MULLVAD_DIAGNOSTICS_RECORD header{};
+
+	header.section = static_cast<uint16_t>(record.m_section);
+	header.length = static_cast<uint32_t>(record.m_payload.size());
+
+	memcpy(m_buffer + m_size, &header, sizeof(header));
+	m_size += sizeof(header);
+
+	if (false == record.m_payload.empty())
+	{
+		memcpy(m_buffer + m_size, &record.m_payload[0], record.m_payload.size());
+		m_size += record.m_payload.size();
+	}
+
+	++m_numRecords;
+
+	return true;
+}
+
+void BlobWriter::writeCounters()
+{
+	shared::performance::CounterRegistry::Instance().snapshot(CounterSink, this);
+}
+
+size_t BlobWriter::finish()
+{
+	MULLVAD_DIAGNOSTICS_HEADER header{};
+
+	header.magic = MULLVAD_DIAGNOSTICS_MAGIC;
+	header.version = MULLVAD_DIAGNOSTICS_VERSION;
+	header.module = static_cast<uint16_t>(m_module);
+	header.size = static_cast<uint32_t>(m_size);
+	header.flags = (truncated() ? MULLVAD_DIAGNOSTICS_FLAG_TRUNCATED : 0);
+	header.numRecords = m_numRecords;
+	header.droppedRecords = m_droppedRecords;
+
+	memcpy(m_buffer, &header, sizeof(header));
+
+	return m_size;
+}
+
+//static
+void __stdcall BlobWriter::CounterSink(const MULLVAD_COUNTER *counters, uint32_t numCounters, void *context)
+{
+	auto writer = reinterpret_cast<BlobWriter *>(context);
+
+	for (uint32_t i = 0; i < numCounters; ++i)
+	{
+		const auto &counter = counters[i];
+
+		Record record(MULLVAD_DIAGNOSTICS_SECTION_COUNTER);
+
+		record.s(std::string(counter.name)).u(counter.type).u(counter.value).u(counter.sumUs);
+
+		size_t numBuckets = 0;
+
+		if (MULLVAD_COUNTER_TYPE_HISTOGRAM == counter.type)
+		{
+			numBuckets = MULLVAD_HISTOGRAM_BUCKETS;
+
+			while (0 != numBuckets && 0 == counter.buckets[numBuckets - 1])
+			{
+				--numBuckets;
+			}
+		}
+
+		record.u(numBuckets);
+
+		for (size_t bucket = 0; bucket < numBuckets; ++bucket)
+		{
+			record.u(counter.buckets[bucket]);
+		}
+
+		writer->write(record);
+	}
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "diagnosticsblob.h"
+#include <libshared/performance/countersink.h>
+#include <windows.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace shared::diagnostics
+{
+
+//
+// Writes a diagnostics blob into a caller supplied buffer, in a single pass.
+// See diagnosticsblob.h for the format.
+//
+// The buffer size is a hard cap. Records that don't fit are dropped whole, and
+// the blob is marked as truncated. Smaller records that come later may still fit,
+// so the most important records should be written first.
+//
+class BlobWriter
+{
+public:
+
+	//
+	// Throws if the buffer can't even hold the header.
+	//
+	BlobWriter(uint8_t *buffer, size_t capacity, MULLVAD_DIAGNOSTICS_MODULE module);
+
+	BlobWriter(const BlobWriter &) = delete;
+	BlobWriter &operator=(const BlobWriter &) = delete;
+
+	class Record
+	{
+	public:
+
+		explicit Record(MULLVAD_DIAGNOSTICS_SECTION section)
+			: m_section(section)
+		{
+		}
+
+		Record &u(uint64_t value);
+		Record &s(const std::string &value);
+		Record &s(const std::wstring &value);
+		Record &b(const void *data, size_t size);
+		Record &g(const GUID &value);
+
+	private:
+
+		friend class BlobWriter;
+
+		MULLVAD_DIAGNOSTICS_SECTION m_section;
+		std::vector<uint8_t> m_payload;
+	};
+
+	//
+	// Returns false if the record was dropped.
+	//
+	bool write(const Record &record);
+
+	//
+	// Write a record for each performance counter registered with the module.
+	//
+	void writeCounters();
+
+	//
+	// Completes the header and returns the size of the blob.
+	//
+	size_t finish();
+
+	bool truncated() const
+	{
+		return 0 != m_droppedRecords;
+	}
+
+private:
+
+	static void __stdcall CounterSink(const MULLVAD_COUNTER *counters, uint32_t numCounters, void *context);
+
+	uint8_t *m_buffer;
+	size_t m_capacity;
+	size_t m_size;
+
+	MULLVAD_DIAGNOSTICS_MODULE m_module;
+
+	uint32_t m_numRecords;
+	uint32_t m_droppedRecords;
+};
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+//
+// This file is shared between DLL modules to help define their public interface.
+// It should always be C-compatible.
+//
+// A diagnostics blob is a header followed by records. Each record is a record header
+// followed by 'length' bytes of payload. Records are never split, so a truncated blob
+// is still well-formed, it just lacks the records that didn't fit.
+//
+// Payload fields are encoded in the order documented for each section:
+//
+//   u:      Unsigned LEB128 integer.
+//   s:      UTF-8 string, as a 'u' length followed by that many bytes.
+//   b:      Byte string, as a 'u' length followed by that many bytes.
+//   g:      GUID, 16 bytes in memory order.
+//
+// Readers should skip unknown sections, and ignore trailing fields in known sections.
+//
+
+#include <stdint.h>
+
+#define MULLVAD_DIAGNOSTICS_MAGIC 0x4744564d // "MVDG"
+#define MULLVAD_DIAGNOSTICS_VERSION 1
+
+enum MULLVAD_DIAGNOSTICS_MODULE
+{
+	MULLVAD_DIAGNOSTICS_MODULE_WINFW = 1,
+	MULLVAD_DIAGNOSTICS_MODULE_WINNET = 2,
+	MULLVAD_DIAGNOSTICS_MODULE_WINDNS = 3,
+};
+
+enum MULLVAD_DIAGNOSTICS_FLAG
+{
+	// One or more records were dropped because the buffer was full.
+	MULLVAD_DIAGNOSTICS_FLAG_TRUNCATED = 1,
+};
+
+enum MULLVAD_DIAGNOSTICS_SECTION
+{
+	// s: name, u: MULLVAD_COUNTER_TYPE, u: value, u: sumUs, u: number of buckets, u: buckets...
+	// Trailing empty histogram buckets are omitted.
+	MULLVAD_DIAGNOSTICS_SECTION_COUNTER = 1,
+
+	// winfw. s: last policy key, u: succeeded, u: totalUs, u: prepareUs, u: transactions,
+	// u: lockWaitUs, u: lockAttempts, u: addUs, u: purgeUs, u: commitUs,
+	// u: objects added, u: objects removed.
+	MULLVAD_DIAGNOSTICS_SECTION_FIREWALL_POLICY = 2,
+
+	// winfw. u: filter id, g: layer, g: sublayer, u: action type, u: effective weight,
+	// u: conditions, u: flags.
+	MULLVAD_DIAGNOSTICS_SECTION_FIREWALL_FILTER = 3,
+
+	// winnet. u: family, b: prefix, u: prefix length, u: interface LUID, b: next hop.
+	MULLVAD_DIAGNOSTICS_SECTION_ROUTE = 4,
+
+	// winnet. b: route event, see winnet::routing::RouteEventLog::Event.
+	MULLVAD_DIAGNOSTICS_SECTION_ROUTE_EVENT = 5,
+
+	// winnet. u: interface LUID, u: interface index, u: interface type, s: alias,
+	// u: admin status, u: oper status, u: media connect state, u: MTU.
+	MULLVAD_DIAGNOSTICS_SECTION_ADAPTER = 6,
+
+	// windns. u: interface LUID, u: number of IPv4 servers, b: servers...,
+	// u: number of IPv6 servers, b: servers...
+	MULLVAD_DIAGNOSTICS_SECTION_DNS_SETTINGS = 7,
+};
+
+typedef struct tag_MULLVAD_DIAGNOSTICS_HEADER
+{
+	uint32_t magic;
+	uint16_t version;
+
+	// MULLVAD_DIAGNOSTICS_MODULE.
+	uint16_t module;
+
+	// Size of the blob, including this header.
+	uint32_t size;
+
+	// MULLVAD_DIAGNOSTICS_FLAG values.
+	uint32_t flags;
+
+	// Number of records in the blob, and dropped because they didn't fit.
+	uint32_t numRecords;
+	uint32_t droppedRecords;
+}
+MULLVAD_DIAGNOSTICS_HEADER;
+
+typedef struct tag_MULLVAD_DIAGNOSTICS_RECORD
+{
+	// MULLVAD_DIAGNOSTICS_SECTION.
+	uint16_t section;
+	uint16_t reserved;
+
+	uint32_t length;
+}
+MULLVAD_DIAGNOSTICS_RECORD;
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "logsinkadapter.h"
+#include <libcommon/logging/ilogsink.h>
+#include <memory>
+#include <string>
+
+namespace shared::logging
+{
+
+//
+// Sinks other than LogSinkAdapter are assumed to accept all levels.
+//
+inline bool IsEnabled(const common::logging::ILogSink &logSink, common::logging::LogLevel level)
+{
+	const auto adapter = dynamic_cast<const LogSinkAdapter *>(&logSink);
+
+	return nullptr == adapter || adapter->enabled(level);
+}
+
+//
+// Invoke 'format' to build the message only if the level is enabled.
+// 'format' should return something that converts to std::string.
+//
+template<typename Formatter>
+void LogLazy(common::logging::ILogSink &logSink, common::logging::LogLevel level, Formatter &&format)
+{
+	if (false == IsEnabled(logSink, level))
+	{
+		return;
+	}
+
+	const std::string message = format();
+
+	switch (level)
+	{
+		case common::logging::LogLevel::Error: logSink.error(message.c_str()); break;
+		case common::logging::LogLevel::Warning: logSink.warning(message.c_str()); break;
+		case common::logging::LogLevel::Info: logSink.info(message.c_str()); break;
+		case common::logging::LogLevel::Debug: logSink.debug(message.c_str()); break;
+		case common::logging::LogLevel::Trace: logSink.trace(message.c_str()); break;
+	}
+}
+
+}
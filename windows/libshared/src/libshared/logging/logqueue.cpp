@@ -0,0 +1,282 @@
+#include "stdafx.h"
+#include "logqueue.h"
+#include <libcommon/error.h>
+#include <sstream>
+
+namespace shared::logging
+{
+
+namespace
+{
+
+size_t RoundUpToPowerOfTwo(size_t value)
+{
+	size_t result = 2;
+
+	while (result < value)
+	{
+		result <<= 1;
+	}
+
+	return result;
+}
+
+} // anonymous namespace
+
+LogQueue::LogQueue(Target target, size_t capacity)
+	: m_target(target)
+	, m_mask(RoundUpToPowerOfTwo(capacity) - 1)
+	, m_enqueuePosition(0)
+	, m_dequeuePosition(0)
+	, m_reportedDropped(0)
+	, m_dropped(0)
+	, m_delivered(0)
+	, m_shutdown(false)
+{
+	m_slots = std::make_unique<Slot[]>(m_mask + 1);
+
+	for (size_t i = 0; i <= m_mask; ++i)
+	{
+		m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	m_wakeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+
+	if (nullptr == m_wakeEvent)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Create log queue event");
+	}
+
+	m_thread = std::thread(&LogQueue::thread, this);
+}
+
+LogQueue::~LogQueue()
+{
+	m_shutdown = true;
+	SetEvent(m_wakeEvent);
+
+	m_thread.join();
+
+	CloseHandle(m_wakeEvent);
+}
+
+void LogQueue::push(MULLVAD_LOG_LEVEL level, const char *message, bool wait)
+{
+	size_t ticket;
+
+	if (tryPush(level, message, false, ticket))
+	{
+		SetEvent(m_wakeEvent);
+
+		if (wait)
+		{
+			waitDelivered(ticket);
+		}
+
+		return;
+	}
+
+	if (false == wait)
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	//
+	// The queue is full but the message must not be lost.
+	// Deliver it on this thread, after whatever is currently queued.
+	//
+
+	flush();
+
+	m_target(level, message);
+}
+
+void LogQueue::push(const LogRecord &record, bool wait)
+{
+	const auto encoded = record.encode();
+	const auto message = std::string_view(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+
+	size_t ticket;
+
+	if (tryPush(record.level(), message, true, ticket))
+	{
+		SetEvent(m_wakeEvent);
+
+		if (wait)
+		{
+			waitDelivered(ticket);
+		}
+
+		return;
+	}
+
+	if (false == wait)
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	flush();
+
+	m_target(record.level(), record.render().c_str());
+}
+
+void LogQueue::flush()
+{
+	const auto ticket = m_enqueuePosition.load(std::memory_order_acquire);
+
+	SetEvent(m_wakeEvent);
+
+	waitDelivered(ticket);
+}
+
+uint64_t LogQueue::dropped() const
+{
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+bool LogQueue::tryPush(MULLVAD_LOG_LEVEL level, std::string_view message, bool encoded, size_t &ticket)
+{
+	auto position = m_enqueuePosition.load(std::memory_order_relaxed);
+
+	Slot *slot;
+
+	for (;;)
+	{
+		slot = &m_slots[position & m_mask];
+
+		const auto sequence = slot->sequence.load(std::memory_order_acquire);
+		const auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+		if (0 == difference)
+		{
+			if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (difference < 0)
+		{
+			// Full.
+			return false;
+		}
+		else
+		{
+			position = m_enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->level = level;
+	slot->encoded = encoded;
+	slot->message.assign(message);
+	slot->sequence.store(position + 1, std::memory_order_release);
+
+	ticket = position + 1;
+
+	return true;
+}
+
+bool LogQueue::tryPop(MULLVAD_LOG_LEVEL &level, bool &encoded, std::string &message)
+{
+	auto &slot = m_slots[m_dequeuePosition & m_mask];
+
+	if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+	{
+		return false;
+	}
+
+	level = slot.level;
+	encoded = slot.encoded;
+	message.swap(slot.message);
+
+	slot.sequence.store(m_dequeuePosition + m_mask + 1, std::memory_order_release);
+
+	++m_dequeuePosition;
+
+	return true;
+}
+
+void LogQueue::waitDelivered(size_t ticket)
+{
+	std::unique_lock<std::mutex> lock(m_flushLock);
+
+	m_flushed.wait(lock, [this, ticket]()
+	{
+		return m_delivered.load(std::memory_order_acquire) >= ticket;
+	});
+}
+
+void LogQueue::drain()
+{
+	MULLVAD_LOG_LEVEL level;
+	bool encoded;
+	std::string message;
+
+	while (tryPop(level, encoded, message))
+	{
+		deliver(level, encoded, message);
+
+		m_delivered.store(m_dequeuePosition, std::memory_order_release);
+	}
+
+	const auto dropped = m_dropped.load(std::memory_order_relaxed);
+
+	if (dropped != m_reportedDropped)
+	{
+		std::stringstream ss;
+
+		ss << "Log queue overflowed. Dropped " << (dropped - m_reportedDropped) << " message(s)";
+
+		m_target(MULLVAD_LOG_LEVEL_WARNING, ss.str().c_str());
+
+		m_reportedDropped = dropped;
+	}
+
+	{
+		std::scoped_lock<std::mutex> lock(m_flushLock);
+	}
+
+	m_flushed.notify_all();
+}
+
+void LogQueue::deliver(MULLVAD_LOG_LEVEL level, bool encoded, const std::string &message)
+{
+	if (false == encoded)
+	{
+		m_target(level, message.c_str());
+		return;
+	}
+
+	try
+	{
+		const auto record = LogRecord::Decode(reinterpret_cast<const uint8_t *>(message.data()), message.size());
+
+		m_target(level, record.render().c_str());
+	}
+	catch (const std::exception &err)
+	{
+		m_target(MULLVAD_LOG_LEVEL_ERROR, err.what());
+	}
+}
+
+void LogQueue::thread()
+{
+	for (;;)
+	{
+		WaitForSingleObject(m_wakeEvent, INFINITE);
+
+		drain();
+
+		if (m_shutdown)
+		{
+			//
+			// Producers may still be completing a push that was started before shutdown.
+			//
+			drain();
+			return;
+		}
+	}
+}
+
+}
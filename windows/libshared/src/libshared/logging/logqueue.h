@@ -0,0 +1,111 @@
+#pragma once
+
+#include "logsink.h"
+#include "logrecord.h"
+#include <windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace shared::logging
+{
+
+//
+// Bounded multi-producer single-consumer queue of log messages,
+// with a dedicated thread that delivers them to the target.
+//
+// Producers never wait on each other or on the target. If the queue is full
+// the message is dropped, and the number of dropped messages is reported
+// the next time the queue is drained.
+//
+class LogQueue
+{
+public:
+
+	using Target = std::function<void(MULLVAD_LOG_LEVEL, const char *)>;
+
+	//
+	// 'capacity' is rounded up to a power of two.
+	//
+	LogQueue(Target target, size_t capacity);
+
+	//
+	// Delivers all queued messages before returning.
+	//
+	~LogQueue();
+
+	LogQueue(const LogQueue &) = delete;
+	LogQueue &operator=(const LogQueue &) = delete;
+
+	//
+	// If 'wait' is set, the message is never dropped and the call returns
+	// once the message, and any message queued before it, has been delivered.
+	//
+	void push(MULLVAD_LOG_LEVEL level, const char *message, bool wait);
+
+	//
+	// The record is queued in its encoded form and rendered on the drain thread.
+	//
+	void push(const LogRecord &record, bool wait);
+
+	//
+	// Returns once all messages queued before the call have been delivered.
+	//
+	void flush();
+
+	uint64_t dropped() const;
+
+private:
+
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		MULLVAD_LOG_LEVEL level;
+		bool encoded;
+		std::string message;
+	};
+
+	Target m_target;
+
+	std::unique_ptr<Slot[]> m_slots;
+	size_t m_mask;
+
+	std::atomic<size_t> m_enqueuePosition;
+
+	// Only accessed by the drain thread.
+	size_t m_dequeuePosition;
+	uint64_t m_reportedDropped;
+
+	std::atomic<uint64_t> m_dropped;
+	std::atomic<size_t> m_delivered;
+
+	std::mutex m_flushLock;
+	std::condition_variable m_flushed;
+
+	HANDLE m_wakeEvent;
+	std::atomic<bool> m_shutdown;
+
+	std::thread m_thread;
+
+	//
+	// Returns the ticket of the message, if it was queued.
+	// The message is delivered once m_delivered reaches the ticket.
+	//
+	bool tryPush(MULLVAD_LOG_LEVEL level, std::string_view message, bool encoded, size_t &ticket);
+	bool tryPop(MULLVAD_LOG_LEVEL &level, bool &encoded, std::string &message);
+
+	void deliver(MULLVAD_LOG_LEVEL level, bool encoded, const std::string &message);
+
+	void waitDelivered(size_t ticket);
+
+	void drain();
+	void thread();
+};
+
+}
@@ -0,0 +1,325 @@
+#include "stdafx.h"
+#include "logrecord.h"
+#include <libcommon/error.h>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace shared::logging
+{
+
+namespace
+{
+
+class Writer
+{
+public:
+
+	explicit Writer(std::vector<uint8_t> &buffer)
+		: m_buffer(buffer)
+	{
+	}
+
+	template<typename T>
+	void put(T value)
+	{
+		const auto offset = m_buffer.size();
+		m_buffer.resize(offset + sizeof(T));
+		memcpy(&m_buffer[offset], &value, sizeof(T));
+	}
+
+	void putBytes(const void *data, size_t size)
+	{
+		const auto bytes = reinterpret_cast<const uint8_t *>(data);
+		m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+	}
+
+private:
+
+	std::vector<uint8_t> &m_buffer;
+};
+
+class Reader
+{
+public:
+
+	Reader(const uint8_t *data, size_t size)
+		: m_data(data)
+		, m_remaining(size)
+	{
+	}
+
+	template<typename T>
+	T get()
+	{
+		T value;
+		getBytes(&value, sizeof(T));
+
+		return value;
+	}
+
+	void getBytes(void *target, size_t size)
+	{
+		if (size > m_remaining)
+		{
+			THROW_ERROR("Truncated log record");
+		}
+
+		memcpy(target, m_data, size);
+
+		m_data += size;
+		m_remaining -= size;
+	}
+
+	std::string getString(size_t size)
+	{
+		std::string value(size, '\0');
+
+		if (0 != size)
+		{
+			getBytes(&value[0], size);
+		}
+
+		return value;
+	}
+
+private:
+
+	const uint8_t *m_data;
+	size_t m_remaining;
+};
+
+std::string FormatHex(uint64_t value, int width)
+{
+	char buffer[32];
+	sprintf_s(buffer, "0x%0*llX", width, static_cast<unsigned long long>(value));
+
+	return buffer;
+}
+
+std::string FormatGuid(const GUID &guid)
+{
+	char buffer[64];
+
+	sprintf_s(buffer, "{%08lX-%04hX-%04hX-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+		guid.Data1, guid.Data2, guid.Data3,
+		guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+		guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+
+	return buffer;
+}
+
+} // anonymous namespace
+
+LogRecord::LogRecord(uint32_t eventId, MULLVAD_LOG_LEVEL level)
+	: m_eventId(eventId)
+	, m_level(level)
+{
+}
+
+LogRecord &LogRecord::integer(const char *name, uint64_t value)
+{
+	addField(FieldType::Integer, name).value = value;
+	return *this;
+}
+
+LogRecord &LogRecord::text(const char *name, const std::string &value)
+{
+	addField(FieldType::Text, name).text = value.substr(0, std::numeric_limits<uint16_t>::max());
+	return *this;
+}
+
+LogRecord &LogRecord::luid(const char *name, const NET_LUID &value)
+{
+	addField(FieldType::Luid, name).value = value.Value;
+	return *this;
+}
+
+LogRecord &LogRecord::guid(const char *name, const GUID &value)
+{
+	addField(FieldType::Guid, name).guid = value;
+	return *this;
+}
+
+LogRecord &LogRecord::status(const char *name, DWORD value)
+{
+	addField(FieldType::Status, name).value = value;
+	return *this;
+}
+
+LogRecord &LogRecord::duration(const char *name, std::chrono::microseconds value)
+{
+	addField(FieldType::Duration, name).value = static_cast<uint64_t>(value.count());
+	return *this;
+}
+
+std::vector<uint8_t> LogRecord::encode() const
+{
+	std::vector<uint8_t> buffer;
+	buffer.reserve(8 + (m_fields.size() * 16));
+
+	Writer writer(buffer);
+
+	writer.put<uint8_t>(ENCODING_VERSION);
+	writer.put<uint8_t>(static_cast<uint8_t>(m_level));
+	writer.put<uint32_t>(m_eventId);
+	writer.put<uint16_t>(static_cast<uint16_t>(m_fields.size()));
+
+	for (const auto &field : m_fields)
+	{
+		writer.put<uint8_t>(static_cast<uint8_t>(field.type));
+		writer.put<uint8_t>(static_cast<uint8_t>(field.name.size()));
+		writer.putBytes(field.name.data(), field.name.size());
+
+		switch (field.type)
+		{
+			case FieldType::Integer:
+			case FieldType::Luid:
+			case FieldType::Duration:
+			{
+				writer.put<uint64_t>(field.value);
+				break;
+			}
+			case FieldType::Status:
+			{
+				writer.put<uint32_t>(static_cast<uint32_t>(field.value));
+				break;
+			}
+			case FieldType::Guid:
+			{
+				writer.put<GUID>(field.guid);
+				break;
+			}
+			case FieldType::Text:
+			{
+				writer.put<uint16_t>(static_cast<uint16_t>(field.text.size()));
+				writer.putBytes(field.text.data(), field.text.size());
+				break;
+			}
+		}
+	}
+
+	return buffer;
+}
+
+//static
+LogRecord LogRecord::Decode(const uint8_t *data, size_t size)
+{
+	Reader reader(data, size);
+
+	if (ENCODING_VERSION != reader.get<uint8_t>())
+	{
+		THROW_ERROR("Unsupported log record version");
+	}
+
+	const auto level = static_cast<MULLVAD_LOG_LEVEL>(reader.get<uint8_t>());
+	const auto eventId = reader.get<uint32_t>();
+
+	LogRecord record(eventId, level);
+
+	const auto numFields = reader.get<uint16_t>();
+
+	record.m_fields.reserve(numFields);
+
+	for (uint16_t i = 0; i < numFields; ++i)
+	{
+		Field field{};
+
+		field.type = static_cast<FieldType>(reader.get<uint8_t>());
+		field.name = reader.getString(reader.get<uint8_t>());
+
+		switch (field.type)
+		{
+			case FieldType::Integer:
+			case FieldType::Luid:
+			case FieldType::Duration:
+			{
+				field.value = reader.get<uint64_t>();
+				break;
+			}
+			case FieldType::Status:
+			{
+				field.value = reader.get<uint32_t>();
+				break;
+			}
+			case FieldType::Guid:
+			{
+				field.guid = reader.get<GUID>();
+				break;
+			}
+			case FieldType::Text:
+			{
+				field.text = reader.getString(reader.get<uint16_t>());
+				break;
+			}
+			default:
+			{
+				THROW_ERROR("Invalid field type in log record");
+			}
+		}
+
+		record.m_fields.emplace_back(std::move(field));
+	}
+
+	return record;
+}
+
+std::string LogRecord::render() const
+{
+	std::string rendered("[");
+
+	rendered.append(FormatHex(m_eventId, 8)).append("]");
+
+	for (const auto &field : m_fields)
+	{
+		rendered.append(" ").append(field.name).append("=");
+
+		switch (field.type)
+		{
+			case FieldType::Integer:
+			{
+				rendered.append(std::to_string(field.value));
+				break;
+			}
+			case FieldType::Text:
+			{
+				rendered.append(field.text);
+				break;
+			}
+			case FieldType::Luid:
+			{
+				rendered.append(FormatHex(field.value, 16));
+				break;
+			}
+			case FieldType::Guid:
+			{
+				rendered.append(FormatGuid(field.guid));
+				break;
+			}
+			case FieldType::Status:
+			{
+				rendered.append(FormatHex(field.value, 8));
+				break;
+			}
+			case FieldType::Duration:
+			{
+				rendered.append(std::to_string(field.value)).append("us");
+				break;
+			}
+		}
+	}
+
+	return rendered;
+}
+
+LogRecord::Field &LogRecord::addField(FieldType type, const char *name)
+{
+	Field field{};
+
+	field.type = type;
+	field.name.assign(name, std::min<size_t>(strlen(name), std::numeric_limits<uint8_t>::max()));
+
+	return m_fields.emplace_back(std::move(field));
+}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "logsink.h"
+#include <windows.h>
+#include <ifdef.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace shared::logging
+{
+
+//
+// Log event with an id and typed fields, rather than preformatted text.
+//
+// Records are cheap to build and encode into a compact binary form.
+// Rendering into text is deferred until the record is actually written.
+//
+class LogRecord
+{
+public:
+
+	enum class FieldType : uint8_t
+	{
+		Integer = 1,
+		Text,
+		Luid,
+		Guid,
+		Status,
+		Duration
+	};
+
+	struct Field
+	{
+		FieldType type;
+		std::string name;
+
+		//
+		// Integer, Luid, Status and Duration (in microseconds).
+		//
+		uint64_t value;
+
+		GUID guid;
+		std::string text;
+	};
+
+	LogRecord(uint32_t eventId, MULLVAD_LOG_LEVEL level);
+
+	LogRecord &integer(const char *name, uint64_t value);
+	LogRecord &text(const char *name, const std::string &value);
+	LogRecord &luid(const char *name, const NET_LUID &value);
+	LogRecord &guid(const char *name, const GUID &value);
+	LogRecord &status(const char *name, DWORD value);
+	LogRecord &duration(const char *name, std::chrono::microseconds value);
+
+	uint32_t eventId() const
+	{
+		return m_eventId;
+	}
+
+	MULLVAD_LOG_LEVEL level() const
+	{
+		return m_level;
+	}
+
+	const std::vector<Field> &fields() const
+	{
+		return m_fields;
+	}
+
+	//
+	// Layout (little endian):
+	//
+	// u8 version, u8 level, u32 event id, u16 field count
+	// per field: u8 type, u8 name length, name, payload
+	//
+	// Text payloads are prefixed with a u16 length.
+	//
+	std::vector<uint8_t> encode() const;
+
+	//
+	// Throws if the data is truncated or otherwise malformed.
+	//
+	static LogRecord Decode(const uint8_t *data, size_t size);
+
+	//
+	// E.g. "[0x00000102] luid=0x0006000000000000 status=0x00000005 elapsed=1200us"
+	//
+	std::string render() const;
+
+private:
+
+	static constexpr uint8_t ENCODING_VERSION = 1;
+
+	uint32_t m_eventId;
+	MULLVAD_LOG_LEVEL m_level;
+
+	std::vector<Field> m_fields;
+
+	Field &addField(FieldType type, const char *name);
+};
+
+}
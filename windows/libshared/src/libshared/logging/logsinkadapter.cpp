@@ -5,31 +5,142 @@
 namespace shared::logging
 {
 
-LogSinkAdapter::LogSinkAdapter(MullvadLogSink target, void *context)
-	: LogSink(MakeAdapter(target, context))
+namespace
 {
+
+const size_t QUEUE_CAPACITY = 1024;
+
+} // anonymous namespace
+
+LogSinkAdapter::LogSinkAdapter(MullvadLogSink target, void *context, Mode mode)
+	: LogSinkAdapter(target, context, MakeQueue(target, context, mode))
+{
+}
+
+LogSinkAdapter::LogSinkAdapter(MullvadLogSink target, void *context, std::shared_ptr<LogQueue> queue)
+	: LogSinkAdapter(target, context, queue, std::make_shared<std::atomic<MULLVAD_LOG_LEVEL>>(MULLVAD_LOG_LEVEL_TRACE))
+{
+}
+
+LogSinkAdapter::LogSinkAdapter(MullvadLogSink target, void *context, std::shared_ptr<LogQueue> queue,
+	std::shared_ptr<std::atomic<MULLVAD_LOG_LEVEL>> level)
+	: LogSink(queue ? MakeQueueAdapter(queue, level) : MakeAdapter(target, context, level))
+	, m_target(target)
+	, m_context(context)
+	, m_queue(queue)
+	, m_level(level)
+{
+}
+
+void LogSinkAdapter::flush()
+{
+	if (m_queue)
+	{
+		m_queue->flush();
+	}
+}
+
+uint64_t LogSinkAdapter::droppedMessages() const
+{
+	return (m_queue ? m_queue->dropped() : 0);
+}
+
+void LogSinkAdapter::setLevel(MULLVAD_LOG_LEVEL level)
+{
+	m_level->store(level, std::memory_order_relaxed);
+}
+
+MULLVAD_LOG_LEVEL LogSinkAdapter::level() const
+{
+	return m_level->load(std::memory_order_relaxed);
+}
+
+bool LogSinkAdapter::enabled(common::logging::LogLevel level) const
+{
+	return TranslateLevel(level) <= this->level();
+}
+
+void LogSinkAdapter::log(const LogRecord &record)
+{
+	if (nullptr == m_target || record.level() > level())
+	{
+		return;
+	}
+
+	if (m_queue)
+	{
+		m_queue->push(record, MULLVAD_LOG_LEVEL_ERROR == record.level());
+		return;
+	}
+
+	m_target(record.level(), record.render().c_str(), m_context);
+}
+
+//static
+MULLVAD_LOG_LEVEL LogSinkAdapter::TranslateLevel(common::logging::LogLevel level)
+{
+	const std::optional<MULLVAD_LOG_LEVEL> translatedLevel = common::ValueMapper::TryMap<>(level, {
+		std::make_pair(common::logging::LogLevel::Warning, MULLVAD_LOG_LEVEL_WARNING),
+		std::make_pair(common::logging::LogLevel::Info, MULLVAD_LOG_LEVEL_INFO),
+		std::make_pair(common::logging::LogLevel::Trace, MULLVAD_LOG_LEVEL_TRACE),
+		std::make_pair(common::logging::LogLevel::Debug, MULLVAD_LOG_LEVEL_DEBUG),
+		std::make_pair(common::logging::LogLevel::Error, MULLVAD_LOG_LEVEL_ERROR),
+	});
+
+	return translatedLevel.value_or(MULLVAD_LOG_LEVEL_ERROR);
 }
 
 //static
-common::logging::LogTarget LogSinkAdapter::MakeAdapter(MullvadLogSink target, void *context)
+common::logging::LogTarget LogSinkAdapter::MakeAdapter(MullvadLogSink target, void *context,
+	std::shared_ptr<std::atomic<MULLVAD_LOG_LEVEL>> activeLevel)
 {
-	return [target, context](common::logging::LogLevel level, const char* msg)
+	return [target, context, activeLevel](common::logging::LogLevel level, const char* msg)
 	{
 		if (nullptr == target)
 		{
 			return;
 		}
 
-		const std::optional<MULLVAD_LOG_LEVEL> translatedLevel = common::ValueMapper::TryMap<>(level, {
-			std::make_pair(common::logging::LogLevel::Warning, MULLVAD_LOG_LEVEL_WARNING),
-			std::make_pair(common::logging::LogLevel::Info, MULLVAD_LOG_LEVEL_INFO),
-			std::make_pair(common::logging::LogLevel::Trace, MULLVAD_LOG_LEVEL_TRACE),
-			std::make_pair(common::logging::LogLevel::Debug, MULLVAD_LOG_LEVEL_DEBUG),
-			std::make_pair(common::logging::LogLevel::Error, MULLVAD_LOG_LEVEL_ERROR),
-		});
+		const auto translatedLevel = TranslateLevel(level);
+
+		if (translatedLevel > activeLevel->load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		target(translatedLevel, msg, context);
+	};
+}
+
+//static
+common::logging::LogTarget LogSinkAdapter::MakeQueueAdapter(std::shared_ptr<LogQueue> queue,
+	std::shared_ptr<std::atomic<MULLVAD_LOG_LEVEL>> activeLevel)
+{
+	return [queue, activeLevel](common::logging::LogLevel level, const char* msg)
+	{
+		const auto translatedLevel = TranslateLevel(level);
+
+		if (translatedLevel > activeLevel->load(std::memory_order_relaxed))
+		{
+			return;
+		}
 
-		target(translatedLevel.value_or(MULLVAD_LOG_LEVEL_ERROR), msg, context);
+		queue->push(translatedLevel, msg, MULLVAD_LOG_LEVEL_ERROR == translatedLevel);
 	};
 }
 
+//static
+std::shared_ptr<LogQueue> LogSinkAdapter::MakeQueue(MullvadLogSink target, void *context, Mode mode)
+{
+	if (Mode::Asynchronous != mode || nullptr == target)
+	{
+		return nullptr;
+	}
+
+	return std::make_shared<LogQueue>([target, context](MULLVAD_LOG_LEVEL level, const char *msg)
+	{
+		target(level, msg, context);
+	}, QUEUE_CAPACITY);
+}
+
 }
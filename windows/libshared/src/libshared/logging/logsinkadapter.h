@@ -1,7 +1,11 @@
 #pragma once
 
 #include "logsink.h"
+#include "logqueue.h"
+#include "logrecord.h"
 #include <libcommon/logging/logsink.h>
+#include <atomic>
+#include <memory>
 
 namespace shared::logging
 {
@@ -14,11 +18,68 @@ class LogSinkAdapter : public common::logging::LogSink
 {
 public:
 
-	LogSinkAdapter(MullvadLogSink target, void *context);
+	enum class Mode
+	{
+		// Messages are forwarded on the calling thread.
+		Synchronous,
+
+		// Messages are queued and forwarded on a dedicated thread.
+		// Errors are forwarded before the logging call returns.
+		Asynchronous,
+	};
+
+	LogSinkAdapter(MullvadLogSink target, void *context, Mode mode = Mode::Synchronous);
+
+	//
+	// Returns once all queued messages have been forwarded.
+	// Does nothing in synchronous mode.
+	//
+	void flush();
+
+	//
+	// Number of messages lost because the queue was full.
+	//
+	uint64_t droppedMessages() const;
+
+	//
+	// Messages that are more verbose than the active level are discarded.
+	// All levels are active by default.
+	//
+	void setLevel(MULLVAD_LOG_LEVEL level);
+	MULLVAD_LOG_LEVEL level() const;
+
+	bool enabled(common::logging::LogLevel level) const;
+
+	//
+	// Records are rendered into text only once they pass the level check,
+	// and on the queue thread in asynchronous mode.
+	//
+	void log(const LogRecord &record);
 
 private:
 
-	static common::logging::LogTarget MakeAdapter(MullvadLogSink target, void *context);
+	LogSinkAdapter(MullvadLogSink target, void *context, std::shared_ptr<LogQueue> queue);
+	LogSinkAdapter(MullvadLogSink target, void *context, std::shared_ptr<LogQueue> queue,
+		std::shared_ptr<std::atomic<MULLVAD_LOG_LEVEL>> level);
+
+	MullvadLogSink m_target;
+	void *m_context;
+
+	std::shared_ptr<LogQueue> m_queue;
+
+	//
+	// Shared with the log target, which is owned by the base class.
+	//
+	std::shared_ptr<std::atomic<MULLVAD_LOG_LEVEL>> m_level;
+
+	static MULLVAD_LOG_LEVEL TranslateLevel(common::logging::LogLevel level);
+
+	static common::logging::LogTarget MakeAdapter(MullvadLogSink target, void *context,
+		std::shared_ptr<std::atomic<MULLVAD_LOG_LEVEL>> activeLevel);
+	static common::logging::LogTarget MakeQueueAdapter(std::shared_ptr<LogQueue> queue,
+		std::shared_ptr<std::atomic<MULLVAD_LOG_LEVEL>> activeLevel);
+
+	static std::shared_ptr<LogQueue> MakeQueue(MullvadLogSink target, void *context, Mode mode);
 };
 
 }
@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "ratelimiter.h"
+#include <libshared/performance/counterregistry.h>
+#include <cstdio>
+
+namespace shared::logging
+{
+
+namespace
+{
+
+//
+// FNV-1a.
+//
+uint64_t HashMessage(common::logging::LogLevel level, const char *message)
+{
+	uint64_t hash = 14695981039346656037ULL ^ static_cast<uint64_t>(level);
+
+	for (; '\0' != *message; ++message)
+	{
+		hash ^= static_cast<uint8_t>(*message);
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+void Forward(common::logging::ILogSink &logSink, common::logging::LogLevel level, const char *message)
+{
+	switch (level)
+	{
+		case common::logging::LogLevel::Error: logSink.error(message); break;
+		case common::logging::LogLevel::Warning: logSink.warning(message); break;
+		case common::logging::LogLevel::Info: logSink.info(message); break;
+		case common::logging::LogLevel::Debug: logSink.debug(message); break;
+		case common::logging::LogLevel::Trace: logSink.trace(message); break;
+	}
+}
+
+} // anonymous namespace
+
+RateLimiter::RateLimiter(std::chrono::milliseconds interval)
+	: m_interval(interval)
+	, m_entries{}
+	, m_numEntries(0)
+{
+}
+
+void RateLimiter::log(common::logging::ILogSink &logSink, common::logging::LogLevel level, const char *message)
+{
+	static auto &suppressedCounter = shared::performance::CounterRegistry::Instance().counter("logging.suppressed");
+
+	const auto key = HashMessage(level, message);
+	const auto now = std::chrono::steady_clock::now();
+
+	uint32_t suppressed = 0;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+
+		Entry *entry = nullptr;
+		Entry *oldest = nullptr;
+
+		for (size_t i = 0; i < m_numEntries; ++i)
+		{
+			if (key == m_entries[i].key)
+			{
+				entry = &m_entries[i];
+				break;
+			}
+
+			if (nullptr == oldest || m_entries[i].logged < oldest->logged)
+			{
+				oldest = &m_entries[i];
+			}
+		}
+
+		if (nullptr == entry)
+		{
+			entry = (m_numEntries < MAX_ENTRIES ? &m_entries[m_numEntries++] : oldest);
+			*entry = Entry{ key, now, 0 };
+		}
+		else if (now - entry->logged < m_interval)
+		{
+			++entry->suppressed;
+			suppressedCounter.increment();
+
+			return;
+		}
+		else
+		{
+			suppressed = entry->suppressed;
+
+			entry->logged = now;
+			entry->suppressed = 0;
+		}
+	}
+
+	if (0 != suppressed)
+	{
+		char summary[64];
+
+		sprintf_s(summary, "Suppressed %u repeats of the following message", suppressed);
+
+		Forward(logSink, level, summary);
+	}
+
+	Forward(logSink, level, message);
+}
+
+}
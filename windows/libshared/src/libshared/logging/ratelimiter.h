@@ -0,0 +1,68 @@
+#pragma once
+
+#include <libcommon/logging/ilogsink.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace shared::logging
+{
+
+//
+// Suppresses repeats of the same message while errors are storming.
+//
+// Use one instance per call site, typically a function-local static, so messages
+// are keyed by call site and text.
+//
+// The first occurrence of a message is logged. Repeats within the interval are
+// only counted. The first repeat after the interval is logged again, preceded by
+// a summary of how many repeats were suppressed.
+//
+// Deciding whether to log doesn't allocate, so failing callbacks stay cheap.
+//
+class RateLimiter
+{
+public:
+
+	explicit RateLimiter(std::chrono::milliseconds interval = std::chrono::seconds(10));
+
+	RateLimiter(const RateLimiter &) = delete;
+	RateLimiter &operator=(const RateLimiter &) = delete;
+
+	void log(common::logging::ILogSink &logSink, common::logging::LogLevel level, const char *message);
+
+	void error(common::logging::ILogSink &logSink, const char *message)
+	{
+		log(logSink, common::logging::LogLevel::Error, message);
+	}
+
+	void warning(common::logging::ILogSink &logSink, const char *message)
+	{
+		log(logSink, common::logging::LogLevel::Warning, message);
+	}
+
+private:
+
+	struct Entry
+	{
+		uint64_t key;
+		std::chrono::steady_clock::time_point logged;
+		uint32_t suppressed;
+	};
+
+	//
+	// Distinct messages tracked per call site. The entry that was logged the longest
+	// time ago is replaced when a new message comes along.
+	//
+	static constexpr size_t MAX_ENTRIES = 8;
+
+	const std::chrono::milliseconds m_interval;
+
+	std::mutex m_mutex;
+
+	std::array<Entry, MAX_ENTRIES> m_entries;
+	size_t m_numEntries;
+};
+
+}
@@ -1,33 +1,133 @@
 #include "stdafx.h"
 #include "stdoutlogger.h"
+#include <libcommon/error.h>
 #include <iostream>
 
 namespace shared::logging
 {
 
-void __stdcall StdoutLogger(MULLVAD_LOG_LEVEL level, const char *msg, void*)
+namespace
+{
+
+const char *LevelPrefix(MULLVAD_LOG_LEVEL level)
 {
 	switch (level)
 	{
 		case MULLVAD_LOG_LEVEL_WARNING:
-			std::cout << "Warning: ";
-			break;
+			return "Warning: ";
 		case MULLVAD_LOG_LEVEL_INFO:
-			std::cout << "Info: ";
-			break;
+			return "Info: ";
 		case MULLVAD_LOG_LEVEL_DEBUG:
-			std::cout << "Debug: ";
-			break;
+			return "Debug: ";
 		case MULLVAD_LOG_LEVEL_TRACE:
-			std::cout << "Trace: ";
-			break;
+			return "Trace: ";
 		case MULLVAD_LOG_LEVEL_ERROR:
 		default:
-			std::cout << "Error: ";
+			return "Error: ";
+	}
+}
+
+} // anonymous namespace
+
+void __stdcall StdoutLogger(MULLVAD_LOG_LEVEL level, const char *msg, void*)
+{
+	std::cout << LevelPrefix(level) << msg << std::endl;
+}
+
+BufferedStdoutLogger::BufferedStdoutLogger(size_t capacity)
+	: m_capacity(capacity)
+	, m_output(GetStdHandle(STD_OUTPUT_HANDLE))
+	, m_ownsOutput(false)
+{
+	m_buffer.reserve(m_capacity);
+}
+
+BufferedStdoutLogger::BufferedStdoutLogger(const std::wstring &path, size_t capacity)
+	: m_capacity(capacity)
+	, m_ownsOutput(true)
+{
+	m_output = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (INVALID_HANDLE_VALUE == m_output)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Create log file");
+	}
+
+	m_buffer.reserve(m_capacity);
+}
+
+BufferedStdoutLogger::~BufferedStdoutLogger()
+{
+	flush();
+
+	if (m_ownsOutput)
+	{
+		CloseHandle(m_output);
+	}
+}
+
+void BufferedStdoutLogger::log(MULLVAD_LOG_LEVEL level, const char *msg)
+{
+	std::scoped_lock<std::mutex> lock(m_mutex);
+
+	m_buffer.append(LevelPrefix(level)).append(msg).append("\r\n");
+
+	if (m_buffer.size() >= m_capacity)
+	{
+		write();
+	}
+}
+
+void BufferedStdoutLogger::flush()
+{
+	std::scoped_lock<std::mutex> lock(m_mutex);
+
+	write();
+}
+
+//static
+void __stdcall BufferedStdoutLogger::Sink(MULLVAD_LOG_LEVEL level, const char *msg, void *context)
+{
+	reinterpret_cast<BufferedStdoutLogger *>(context)->log(level, msg);
+}
+
+void BufferedStdoutLogger::write()
+{
+	if (m_buffer.empty())
+	{
+		return;
+	}
+
+	//
+	// Anything std::cout has buffered goes first, to preserve the order of output.
+	//
+	if (false == m_ownsOutput)
+	{
+		std::cout.flush();
+	}
+
+	//
+	// Failed writes are ignored, since there's nowhere to report them.
+	//
+
+	const char *data = m_buffer.data();
+	auto remaining = m_buffer.size();
+
+	while (0 != remaining)
+	{
+		DWORD written = 0;
+
+		if (FALSE == WriteFile(m_output, data, static_cast<DWORD>(remaining), &written, nullptr) || 0 == written)
+		{
 			break;
+		}
+
+		data += written;
+		remaining -= written;
 	}
 
-	std::cout << msg << std::endl;
+	m_buffer.clear();
 }
 
 }
@@ -1,10 +1,63 @@
 #pragma once
 
 #include "logsink.h"
+#include <windows.h>
+#include <mutex>
+#include <string>
 
 namespace shared::logging
 {
 
 void __stdcall StdoutLogger(MULLVAD_LOG_LEVEL level, const char *msg, void *context);
 
+//
+// Alternative to StdoutLogger that collects messages in memory and writes them
+// in large chunks, so logging doesn't distort timings.
+//
+// Messages are written when the buffer fills up, on flush(), and on destruction.
+// Callers should flush outside of any timed section.
+//
+// Use Sink as the log sink, with the instance as the context.
+//
+class BufferedStdoutLogger
+{
+public:
+
+	static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+	//
+	// Writes to stdout.
+	//
+	explicit BufferedStdoutLogger(size_t capacity = DEFAULT_CAPACITY);
+
+	//
+	// Writes to a file instead, which is replaced if it exists.
+	//
+	explicit BufferedStdoutLogger(const std::wstring &path, size_t capacity = DEFAULT_CAPACITY);
+
+	~BufferedStdoutLogger();
+
+	BufferedStdoutLogger(const BufferedStdoutLogger &) = delete;
+	BufferedStdoutLogger &operator=(const BufferedStdoutLogger &) = delete;
+
+	void log(MULLVAD_LOG_LEVEL level, const char *msg);
+
+	void flush();
+
+	static void __stdcall Sink(MULLVAD_LOG_LEVEL level, const char *msg, void *context);
+
+private:
+
+	std::mutex m_mutex;
+
+	std::string m_buffer;
+	size_t m_capacity;
+
+	HANDLE m_output;
+	bool m_ownsOutput;
+
+	// Must be called with the mutex held.
+	void write();
+};
+
 }
@@ -1,11 +1,103 @@
 #include "stdafx.h"
 #include "unwind.h"
-#include "logsinkadapter.h"
-#include <libcommon/error.h>
+#include <exception>
 
 namespace shared::logging
 {
 
+namespace
+{
+
+const size_t MESSAGE_CAPACITY = 1024;
+
+//
+// Guards against exceptions that nest themselves.
+//
+const size_t MAX_NESTING_DEPTH = 16;
+
+//
+// Appends to a fixed buffer, discarding what doesn't fit.
+// The buffer is always terminated.
+//
+class MessageBuffer
+{
+public:
+
+	MessageBuffer(char *buffer, size_t capacity)
+		: m_buffer(buffer)
+		, m_capacity(capacity)
+		, m_length(0)
+	{
+		m_buffer[0] = '\0';
+	}
+
+	void append(const char *text)
+	{
+		while ('\0' != *text && m_length + 1 < m_capacity)
+		{
+			m_buffer[m_length++] = *text++;
+		}
+
+		m_buffer[m_length] = '\0';
+	}
+
+	const char *c_str() const
+	{
+		return m_buffer;
+	}
+
+private:
+
+	char *m_buffer;
+	size_t m_capacity;
+	size_t m_length;
+};
+
+thread_local char t_messageBuffer[MESSAGE_CAPACITY];
+
+void AppendNested(MessageBuffer &message, const std::exception &err, size_t depth)
+{
+	const auto nested = dynamic_cast<const std::nested_exception *>(&err);
+
+	if (nullptr == nested || nullptr == nested->nested_ptr() || depth >= MAX_NESTING_DEPTH)
+	{
+		return;
+	}
+
+	try
+	{
+		std::rethrow_exception(nested->nested_ptr());
+	}
+	catch (const std::exception &inner)
+	{
+		message.append(": ");
+		message.append(inner.what());
+
+		AppendNested(message, inner, depth + 1);
+	}
+	catch (...)
+	{
+		message.append(": Unspecified error");
+	}
+}
+
+//
+// E.g. "Failed to apply routes: Failed to add route: The object already exists."
+// The message is valid until the next call on the same thread.
+//
+const char *FormatUnwound(const std::exception &err)
+{
+	MessageBuffer message(t_messageBuffer, sizeof(t_messageBuffer));
+
+	message.append(err.what());
+
+	AppendNested(message, err, 0);
+
+	return message.c_str();
+}
+
+} // anonymous namespace
+
 void UnwindAndLog(MullvadLogSink logSink, void *logSinkContext, const std::exception &err)
 {
 	if (nullptr == logSink)
@@ -13,9 +105,17 @@ void UnwindAndLog(MullvadLogSink logSink, void *logSinkContext, const std::excep
 		return;
 	}
 
-	auto logger = std::make_shared<LogSinkAdapter>(logSink, logSinkContext);
+	logSink(MULLVAD_LOG_LEVEL_ERROR, FormatUnwound(err), logSinkContext);
+}
 
-	common::error::UnwindException(err, logger);
+void UnwindAndLog(common::logging::ILogSink &logSink, const std::exception &err)
+{
+	logSink.error(FormatUnwound(err));
+}
+
+void UnwindAndLog(common::logging::ILogSink &logSink, const std::exception &err, RateLimiter &limiter)
+{
+	limiter.error(logSink, FormatUnwound(err));
 }
 
 }
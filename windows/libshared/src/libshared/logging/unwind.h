@@ -1,11 +1,29 @@
 #pragma once
 
 #include "logsink.h"
+#include "ratelimiter.h"
+#include <libcommon/logging/ilogsink.h>
 #include <stdexcept>
 
 namespace shared::logging
 {
 
+//
+// Log the exception, along with any nested exceptions, as a single error.
+//
+// The message is formatted into a fixed thread-local buffer, and truncated if it
+// doesn't fit, so nothing is allocated even when errors are frequent.
+//
 void UnwindAndLog(MullvadLogSink logSink, void *logSinkContext, const std::exception &err);
 
+//
+// Same as above, for use with an existing sink, e.g. the one owned by a module.
+//
+void UnwindAndLog(common::logging::ILogSink &logSink, const std::exception &err);
+
+//
+// Same as above, with repeats suppressed by the limiter.
+//
+void UnwindAndLog(common::logging::ILogSink &logSink, const std::exception &err, RateLimiter &limiter);
+
 }
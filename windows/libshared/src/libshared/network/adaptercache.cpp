@@ -0,0 +1,76 @@
+#include "stdafx.h"
+#include "adaptercache.h"
+#include <libcommon/error.h>
+
+namespace shared::network
+{
+
+AdapterSnapshot::AdapterSnapshot(InterfaceUtils::AdapterList &&adapters)
+	: m_adapters(std::move(adapters))
+{
+}
+
+AdapterCache::AdapterCache()
+	: m_bufferSizeHint(0)
+	, m_generation(0)
+	, m_notificationHandle(nullptr)
+{
+	const auto status = NotifyIpInterfaceChange(AF_UNSPEC, InterfaceChangeCallback, this,
+		FALSE, &m_notificationHandle);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Register interface change notification");
+	}
+}
+
+AdapterCache::~AdapterCache()
+{
+	//
+	// Blocks until any in-progress callback has returned.
+	//
+	CancelMibChangeNotify2(m_notificationHandle);
+}
+
+std::shared_ptr<const AdapterSnapshot> AdapterCache::snapshot(ULONG family, ULONG flags)
+{
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	//
+	// Read the generation before listing adapters, so a change that happens
+	// during the listing invalidates the new entry.
+	//
+	const auto generation = m_generation.load(std::memory_order_acquire);
+
+	auto &entry = m_entries[std::make_pair(family, flags)];
+
+	if (entry.snapshot && generation == entry.generation)
+	{
+		return entry.snapshot;
+	}
+
+	entry.snapshot = std::make_shared<const AdapterSnapshot>(
+		InterfaceUtils::GetAllAdapters(family, flags, m_bufferSizeHint));
+	entry.generation = generation;
+
+	return entry.snapshot;
+}
+
+void AdapterCache::invalidate()
+{
+	m_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+uint64_t AdapterCache::generation() const
+{
+	return m_generation.load(std::memory_order_acquire);
+}
+
+//static
+void NETIOAPI_API_ AdapterCache::InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *,
+	MIB_NOTIFICATION_TYPE)
+{
+	reinterpret_cast<AdapterCache *>(context)->invalidate();
+}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "interfaceutils.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace shared::network
+{
+
+//
+// Immutable adapter listing, indexed by alias, LUID and GUID.
+//
+class AdapterSnapshot
+{
+public:
+
+	using NetworkAdapter = InterfaceUtils::NetworkAdapter;
+
+	explicit AdapterSnapshot(InterfaceUtils::AdapterList &&adapters);
+
+	AdapterSnapshot(const AdapterSnapshot &) = delete;
+	AdapterSnapshot &operator=(const AdapterSnapshot &) = delete;
+
+	const InterfaceUtils::AdapterList &adapters() const
+	{
+		return m_adapters;
+	}
+
+	//
+	// Lookups are case insensitive where applicable.
+	// Returns nullptr if there is no matching adapter.
+	//
+	const NetworkAdapter *findByAlias(const std::wstring &alias) const
+	{
+		return m_adapters.findByAlias(alias);
+	}
+
+	const NetworkAdapter *findByLuid(const NET_LUID &luid) const
+	{
+		return m_adapters.findByLuid(luid);
+	}
+
+	const NetworkAdapter *findByGuid(const std::wstring &guid) const
+	{
+		return m_adapters.findByGuid(guid);
+	}
+
+private:
+
+	InterfaceUtils::AdapterList m_adapters;
+};
+
+//
+// Shares adapter listings between callers until an IP interface is
+// added, removed or changes parameters.
+//
+// Renaming an adapter does not generate a notification, so callers that
+// depend on aliases should validate them, or use invalidate().
+//
+class AdapterCache
+{
+public:
+
+	AdapterCache();
+	~AdapterCache();
+
+	AdapterCache(const AdapterCache &) = delete;
+	AdapterCache &operator=(const AdapterCache &) = delete;
+
+	std::shared_ptr<const AdapterSnapshot> snapshot(ULONG family, ULONG flags);
+
+	void invalidate();
+
+	//
+	// Incremented on every invalidation.
+	// Lets callers cache values that are derived from listings.
+	//
+	uint64_t generation() const;
+
+private:
+
+	struct Entry
+	{
+		uint64_t generation;
+		std::shared_ptr<const AdapterSnapshot> snapshot;
+	};
+
+	std::mutex m_lock;
+
+	std::map<std::pair<ULONG, ULONG>, Entry> m_entries;
+	ULONG m_bufferSizeHint;
+
+	std::atomic<uint64_t> m_generation;
+
+	HANDLE m_notificationHandle;
+
+	static void NETIOAPI_API_ InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *row,
+		MIB_NOTIFICATION_TYPE notificationType);
+};
+
+}
@@ -0,0 +1,116 @@
+#include "stdafx.h"
+#include "aliascache.h"
+#include <libshared/performance/counterregistry.h>
+#include <cwctype>
+
+namespace shared::network
+{
+
+namespace
+{
+
+std::wstring MakeKey(const std::wstring &alias)
+{
+	auto key = alias;
+
+	std::transform(key.begin(), key.end(), key.begin(), [](wchar_t c)
+	{
+		return static_cast<wchar_t>(std::towlower(c));
+	});
+
+	return key;
+}
+
+} // anonymous namespace
+
+InterfaceAliasCache::InterfaceAliasCache()
+	: m_entriesGeneration(0)
+	, m_generation(0)
+	, m_notificationHandle(nullptr)
+{
+	//
+	// Without notifications, caching would return stale LUIDs after the
+	// interface is recreated. Then resolve every time instead.
+	//
+	if (NO_ERROR != NotifyIpInterfaceChange(AF_UNSPEC, InterfaceChangeCallback, this,
+		FALSE, &m_notificationHandle))
+	{
+		m_notificationHandle = nullptr;
+	}
+}
+
+InterfaceAliasCache::~InterfaceAliasCache()
+{
+	//
+	// Blocks until any in-progress callback has returned.
+	//
+	if (nullptr != m_notificationHandle)
+	{
+		CancelMibChangeNotify2(m_notificationHandle);
+	}
+}
+
+DWORD InterfaceAliasCache::resolve(const std::wstring &alias, NET_LUID &luid)
+{
+	static auto &hits = shared::performance::CounterRegistry::Instance().counter("network.alias.hits");
+	static auto &misses = shared::performance::CounterRegistry::Instance().counter("network.alias.misses");
+
+	if (nullptr == m_notificationHandle)
+	{
+		misses.increment();
+
+		return ConvertInterfaceAliasToLuid(alias.c_str(), &luid);
+	}
+
+	auto key = MakeKey(alias);
+
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	//
+	// Read the generation before resolving, so a change that happens
+	// while resolving invalidates the new entry.
+	//
+	const auto generation = m_generation.load(std::memory_order_acquire);
+
+	if (generation != m_entriesGeneration)
+	{
+		m_entries.clear();
+		m_entriesGeneration = generation;
+	}
+
+	const auto entry = m_entries.find(key);
+
+	if (m_entries.end() != entry)
+	{
+		hits.increment();
+
+		luid = entry->second;
+
+		return NO_ERROR;
+	}
+
+	misses.increment();
+
+	const auto status = ConvertInterfaceAliasToLuid(alias.c_str(), &luid);
+
+	if (NO_ERROR == status)
+	{
+		m_entries.emplace(std::move(key), luid);
+	}
+
+	return status;
+}
+
+void InterfaceAliasCache::invalidate()
+{
+	m_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+//static
+void NETIOAPI_API_ InterfaceAliasCache::InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *,
+	MIB_NOTIFICATION_TYPE)
+{
+	reinterpret_cast<InterfaceAliasCache *>(context)->invalidate();
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <winsock2.h>
+#include <windows.h>
+#include <ws2def.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace shared::network
+{
+
+//
+// Interface alias to LUID resolution, with results shared until an IP interface
+// is added, removed or changes parameters.
+//
+// There is one cache per module. Renaming an interface does not generate a
+// notification, so callers that rename interfaces should use invalidate().
+// Aliases that can't be resolved are not cached.
+//
+class InterfaceAliasCache
+{
+public:
+
+	static InterfaceAliasCache &Instance()
+	{
+		static InterfaceAliasCache cache;
+
+		return cache;
+	}
+
+	~InterfaceAliasCache();
+
+	InterfaceAliasCache(const InterfaceAliasCache &) = delete;
+	InterfaceAliasCache &operator=(const InterfaceAliasCache &) = delete;
+
+	//
+	// Same contract as ConvertInterfaceAliasToLuid().
+	// Aliases are compared case insensitively.
+	//
+	DWORD resolve(const std::wstring &alias, NET_LUID &luid);
+
+	void invalidate();
+
+private:
+
+	InterfaceAliasCache();
+
+	std::mutex m_lock;
+
+	std::unordered_map<std::wstring, NET_LUID> m_entries;
+	uint64_t m_entriesGeneration;
+
+	std::atomic<uint64_t> m_generation;
+
+	HANDLE m_notificationHandle;
+
+	static void NETIOAPI_API_ InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *row,
+		MIB_NOTIFICATION_TYPE notificationType);
+};
+
+}
@@ -0,0 +1,203 @@
+#include "stdafx.h"
+#include "interfaceidentity.h"
+#include "aliascache.h"
+#include <libshared/performance/counterregistry.h>
+#include <cstring>
+
+namespace shared::network
+{
+
+size_t InterfaceIdentity::GuidHash::operator()(const GUID &guid) const
+{
+	uint64_t halves[2];
+
+	static_assert(sizeof(halves) == sizeof(GUID));
+
+	memcpy(halves, &guid, sizeof(halves));
+
+	return std::hash<uint64_t>()(halves[0] ^ (halves[1] * 0x9E3779B97F4A7C15ull));
+}
+
+InterfaceIdentity::InterfaceIdentity()
+	: m_entriesGeneration(0)
+	, m_generation(0)
+	, m_notificationHandle(nullptr)
+{
+	//
+	// Without notifications, LUIDs of recreated interfaces would be stale.
+	// Then translate every time instead.
+	//
+	if (NO_ERROR != NotifyIpInterfaceChange(AF_UNSPEC, InterfaceChangeCallback, this,
+		FALSE, &m_notificationHandle))
+	{
+		m_notificationHandle = nullptr;
+	}
+}
+
+InterfaceIdentity::~InterfaceIdentity()
+{
+	//
+	// Blocks until any in-progress callback has returned.
+	//
+	if (nullptr != m_notificationHandle)
+	{
+		CancelMibChangeNotify2(m_notificationHandle);
+	}
+}
+
+void InterfaceIdentity::refresh()
+{
+	//
+	// Read the generation before translating, so a change that happens
+	// while translating invalidates the new entry.
+	//
+	const auto generation = m_generation.load(std::memory_order_acquire);
+
+	if (generation != m_entriesGeneration)
+	{
+		m_luidsByGuid.clear();
+		m_guidsByLuid.clear();
+		m_entriesGeneration = generation;
+	}
+}
+
+DWORD InterfaceIdentity::guidToLuid(const GUID &guid, NET_LUID &luid)
+{
+	static auto &hits = shared::performance::CounterRegistry::Instance().counter("network.identity.hits");
+	static auto &misses = shared::performance::CounterRegistry::Instance().counter("network.identity.misses");
+
+	if (nullptr == m_notificationHandle)
+	{
+		misses.increment();
+
+		return ConvertInterfaceGuidToLuid(&guid, &luid);
+	}
+
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	refresh();
+
+	const auto entry = m_luidsByGuid.find(guid);
+
+	if (m_luidsByGuid.end() != entry)
+	{
+		hits.increment();
+
+		luid = entry->second;
+
+		return NO_ERROR;
+	}
+
+	misses.increment();
+
+	const auto status = ConvertInterfaceGuidToLuid(&guid, &luid);
+
+	if (NO_ERROR == status)
+	{
+		m_luidsByGuid.emplace(guid, luid);
+		m_guidsByLuid.emplace(luid.Value, guid);
+	}
+
+	return status;
+}
+
+DWORD InterfaceIdentity::luidToGuid(const NET_LUID &luid, GUID &guid)
+{
+	static auto &hits = shared::performance::CounterRegistry::Instance().counter("network.identity.hits");
+	static auto &misses = shared::performance::CounterRegistry::Instance().counter("network.identity.misses");
+
+	if (nullptr == m_notificationHandle)
+	{
+		misses.increment();
+
+		return ConvertInterfaceLuidToGuid(&luid, &guid);
+	}
+
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	refresh();
+
+	const auto entry = m_guidsByLuid.find(luid.Value);
+
+	if (m_guidsByLuid.end() != entry)
+	{
+		hits.increment();
+
+		guid = entry->second;
+
+		return NO_ERROR;
+	}
+
+	misses.increment();
+
+	const auto status = ConvertInterfaceLuidToGuid(&luid, &guid);
+
+	if (NO_ERROR == status)
+	{
+		m_luidsByGuid.emplace(guid, luid);
+		m_guidsByLuid.emplace(luid.Value, guid);
+	}
+
+	return status;
+}
+
+DWORD InterfaceIdentity::luidToAlias(const NET_LUID &luid, std::wstring &alias)
+{
+	wchar_t buffer[NDIS_IF_MAX_STRING_SIZE + 1];
+
+	const auto status = ConvertInterfaceLuidToAlias(&luid, buffer, _countof(buffer));
+
+	if (NO_ERROR == status)
+	{
+		alias = buffer;
+	}
+
+	return status;
+}
+
+DWORD InterfaceIdentity::aliasToLuid(const std::wstring &alias, NET_LUID &luid)
+{
+	return InterfaceAliasCache::Instance().resolve(alias, luid);
+}
+
+DWORD InterfaceIdentity::guidToAlias(const GUID &guid, std::wstring &alias)
+{
+	NET_LUID luid;
+
+	const auto status = guidToLuid(guid, luid);
+
+	if (NO_ERROR != status)
+	{
+		return status;
+	}
+
+	return luidToAlias(luid, alias);
+}
+
+DWORD InterfaceIdentity::aliasToGuid(const std::wstring &alias, GUID &guid)
+{
+	NET_LUID luid;
+
+	const auto status = aliasToLuid(alias, luid);
+
+	if (NO_ERROR != status)
+	{
+		return status;
+	}
+
+	return luidToGuid(luid, guid);
+}
+
+void InterfaceIdentity::invalidate()
+{
+	m_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+//static
+void NETIOAPI_API_ InterfaceIdentity::InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *,
+	MIB_NOTIFICATION_TYPE)
+{
+	reinterpret_cast<InterfaceIdentity *>(context)->invalidate();
+}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <winsock2.h>
+#include <windows.h>
+#include <ws2def.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace shared::network
+{
+
+//
+// Translation between interface GUIDs, LUIDs and aliases, without listing adapters.
+//
+// The GUID and LUID of an interface don't change while it exists, so translations
+// between them are shared until an IP interface is added, removed or changes
+// parameters. Aliases can change without a notification, so LUID to alias
+// translations are always looked up. Alias to LUID translations are left to
+// InterfaceAliasCache, see the caveats there.
+//
+// All functions have the same contract as the corresponding Convert*() function
+// in netioapi.h.
+//
+class InterfaceIdentity
+{
+public:
+
+	static InterfaceIdentity &Instance()
+	{
+		static InterfaceIdentity identity;
+
+		return identity;
+	}
+
+	~InterfaceIdentity();
+
+	InterfaceIdentity(const InterfaceIdentity &) = delete;
+	InterfaceIdentity &operator=(const InterfaceIdentity &) = delete;
+
+	DWORD guidToLuid(const GUID &guid, NET_LUID &luid);
+	DWORD luidToGuid(const NET_LUID &luid, GUID &guid);
+
+	DWORD luidToAlias(const NET_LUID &luid, std::wstring &alias);
+	DWORD aliasToLuid(const std::wstring &alias, NET_LUID &luid);
+
+	DWORD guidToAlias(const GUID &guid, std::wstring &alias);
+	DWORD aliasToGuid(const std::wstring &alias, GUID &guid);
+
+	void invalidate();
+
+private:
+
+	InterfaceIdentity();
+
+	struct GuidHash
+	{
+		size_t operator()(const GUID &guid) const;
+	};
+
+	std::mutex m_lock;
+
+	std::unordered_map<GUID, NET_LUID, GuidHash> m_luidsByGuid;
+	std::unordered_map<uint64_t, GUID> m_guidsByLuid;
+	uint64_t m_entriesGeneration;
+
+	std::atomic<uint64_t> m_generation;
+
+	HANDLE m_notificationHandle;
+
+	//
+	// Clears the entries if they are outdated. Must hold the lock.
+	//
+	void refresh();
+
+	static void NETIOAPI_API_ InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *row,
+		MIB_NOTIFICATION_TYPE notificationType);
+};
+
+}
@@ -2,49 +2,94 @@
 #include <sstream>
 #include <algorithm>
 #include "interfaceutils.h"
+#include "adaptercache.h"
+#include "interfaceidentity.h"
 #include <libcommon/error.h>
 #include <libcommon/string.h>
+#include <cwctype>
 
 namespace shared::network
 {
 
+namespace
+{
+
+std::wstring FoldCase(const std::wstring &value)
+{
+	auto folded = value;
+
+	std::transform(folded.begin(), folded.end(), folded.begin(), [](wchar_t c)
+	{
+		return static_cast<wchar_t>(std::towlower(c));
+	});
+
+	return folded;
+}
+
+template<typename Key>
+const InterfaceUtils::NetworkAdapter *Lookup(const std::vector<std::pair<Key, size_t>> &index,
+	const Key &key, const std::vector<InterfaceUtils::NetworkAdapter> &adapters)
+{
+	const auto match = std::lower_bound(index.begin(), index.end(), key,
+		[](const std::pair<Key, size_t> &entry, const Key &key)
+	{
+		return entry.first < key;
+	});
+
+	if (index.end() == match || match->first != key)
+	{
+		return nullptr;
+	}
+
+	return &adapters[match->second];
+}
+
+//
+// Look for TAP adapter with alias "Mullvad", then "Mullvad-0", "Mullvad-1", etc.
+//
+const wchar_t *TAP_ALIASES[] =
+{
+	L"Mullvad",
+	L"Mullvad-0",
+	L"Mullvad-1",
+	L"Mullvad-2",
+	L"Mullvad-3",
+	L"Mullvad-4",
+	L"Mullvad-5",
+	L"Mullvad-6",
+	L"Mullvad-7",
+	L"Mullvad-8",
+	L"Mullvad-9",
+};
+
+} // anonymous namespace
+
 InterfaceUtils::NetworkAdapter::NetworkAdapter(
-	const common::network::Nci &nci,
 	const std::shared_ptr<std::vector<uint8_t>> addressesBuffer,
 	const IP_ADAPTER_ADDRESSES &entry
 )
-	: m_addressesBuffer(addressesBuffer)
-	, m_entry(entry)
+	: m_entry(&entry)
+	, m_addressesBuffer(addressesBuffer)
 {
 	m_guid = common::string::ToWide(entry.AdapterName);
 
-	try
-	{
-		//
-		// FIXME:
-		// Work around incorrect alias sometimes
-		// being returned on Windows 8.
-		//
-		// Steps to reproduce:
-		// 1. Install NDIS 6 TAP driver v9.00.00.21.
-		// 2. Update driver to v9.24.2.601.
-		// 3. Rename TAP adapter.
-		//
-		// GetAdaptersAddresses() returns a generic name
-		// for the *first* adapter instead of the correct
-		// one, whereas ConvertInterfaceAliasToLuid() and
-		// ConvertInterfaceLuidToAlias() yield correct values.
-		//
-
-		IID guidObj = { 0 };
-		if (S_OK != IIDFromString(&m_guid[0], &guidObj))
-		{
-			THROW_ERROR("IIDFromString() failed");
-		}
+	//
+	// FIXME:
+	// Work around incorrect alias sometimes
+	// being returned on Windows 8.
+	//
+	// Steps to reproduce:
+	// 1. Install NDIS 6 TAP driver v9.00.00.21.
+	// 2. Update driver to v9.24.2.601.
+	// 3. Rename TAP adapter.
+	//
+	// GetAdaptersAddresses() returns a generic name
+	// for the *first* adapter instead of the correct
+	// one, whereas ConvertInterfaceAliasToLuid() and
+	// ConvertInterfaceLuidToAlias() yield correct values.
+	//
 
-		m_alias = nci.getConnectionName(guidObj);
-	}
-	catch (const std::exception &)
+	if (NO_ERROR != InterfaceIdentity::Instance().luidToAlias(entry.Luid, m_alias))
 	{
 		m_alias = entry.FriendlyName;
 	}
@@ -52,41 +97,109 @@ InterfaceUtils::NetworkAdapter::NetworkAdapter(
 	m_name = entry.Description;
 }
 
+const InterfaceUtils::NetworkAdapter *InterfaceUtils::AdapterList::findByAlias(const std::wstring &alias) const
+{
+	return Lookup(m_aliasIndex, FoldCase(alias), m_adapters);
+}
+
+const InterfaceUtils::NetworkAdapter *InterfaceUtils::AdapterList::findByLuid(const NET_LUID &luid) const
+{
+	return Lookup(m_luidIndex, luid.Value, m_adapters);
+}
+
+const InterfaceUtils::NetworkAdapter *InterfaceUtils::AdapterList::findByGuid(const std::wstring &guid) const
+{
+	const auto match = std::lower_bound(m_adapters.begin(), m_adapters.end(), guid,
+		[](const NetworkAdapter &adapter, const std::wstring &guid)
+	{
+		return _wcsicmp(adapter.guid().c_str(), guid.c_str()) < 0;
+	});
+
+	if (m_adapters.end() == match || 0 != _wcsicmp(match->guid().c_str(), guid.c_str()))
+	{
+		return nullptr;
+	}
+
+	return &*match;
+}
+
+//static
+InterfaceUtils::AdapterList InterfaceUtils::GetAllAdapters(ULONG family, ULONG flags)
+{
+	ULONG bufferSizeHint = 0;
+
+	return GetAllAdapters(family, flags, bufferSizeHint);
+}
+
 //static
-std::set<InterfaceUtils::NetworkAdapter> InterfaceUtils::GetAllAdapters(ULONG family, ULONG flags)
+InterfaceUtils::AdapterList InterfaceUtils::GetAllAdapters(ULONG family, ULONG flags, ULONG &bufferSizeHint)
 {
-	ULONG bufferSize = 0;
+	static const size_t MAX_ATTEMPTS = 5;
 
-	auto status = GetAdaptersAddresses(family, flags, nullptr, nullptr, &bufferSize);
+	auto buffer = std::make_shared<std::vector<uint8_t>>();
+	ULONG bufferSize = bufferSizeHint;
 
-	if (ERROR_BUFFER_OVERFLOW != status)
+	for (size_t attempt = 0; ; ++attempt)
 	{
-		THROW_WINDOWS_ERROR(status, "Probe for adapter listing buffer size");
+		buffer->resize(bufferSize);
+
+		auto addresses = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer->data());
+
+		const auto status = GetAdaptersAddresses(family, flags, nullptr, addresses, &bufferSize);
+
+		if (ERROR_SUCCESS == status)
+		{
+			break;
+		}
+
+		if (ERROR_BUFFER_OVERFLOW != status || MAX_ATTEMPTS == attempt + 1)
+		{
+			THROW_WINDOWS_ERROR(status, "Retrieve adapter listing");
+		}
+
+		//
+		// Leave room for adapters that arrive before the next attempt,
+		// and for future calls that use the hint.
+		//
+		bufferSize *= 2;
 	}
 
-	// Memory is cheap, this avoids a looping construct.
-	bufferSize *= 2;
+	bufferSizeHint = static_cast<ULONG>(buffer->size());
 
-	auto buffer = std::make_shared<std::vector<uint8_t>>(bufferSize);
-	auto addresses = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(&(*buffer)[0]);
+	AdapterList list;
 
-	status = GetAdaptersAddresses(family, flags, nullptr, addresses, &bufferSize);
+	list.m_buffer = buffer;
 
-	if (ERROR_SUCCESS != status)
+	for (auto it = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer->data()); nullptr != it; it = it->Next)
 	{
-		THROW_WINDOWS_ERROR(status, "Retrieve adapter listing");
+		list.m_adapters.emplace_back(NetworkAdapter(buffer, *it));
 	}
 
-	std::set<NetworkAdapter> adapters;
+	std::stable_sort(list.m_adapters.begin(), list.m_adapters.end());
 
-	common::network::Nci nci;
+	//
+	// The listing never reports the same adapter twice, but keep the first
+	// entry, as std::set did, should that ever happen.
+	//
+	list.m_adapters.erase(std::unique(list.m_adapters.begin(), list.m_adapters.end(),
+		[](const NetworkAdapter &lhs, const NetworkAdapter &rhs)
+	{
+		return !(lhs < rhs) && !(rhs < lhs);
+	}), list.m_adapters.end());
+
+	list.m_aliasIndex.reserve(list.m_adapters.size());
+	list.m_luidIndex.reserve(list.m_adapters.size());
 
-	for (auto it = addresses; nullptr != it; it = it->Next)
+	for (size_t i = 0; i < list.m_adapters.size(); ++i)
 	{
-		adapters.emplace(NetworkAdapter(nci, buffer, *it));
+		list.m_aliasIndex.emplace_back(FoldCase(list.m_adapters[i].alias()), i);
+		list.m_luidIndex.emplace_back(list.m_adapters[i].raw().Luid.Value, i);
 	}
 
-	return adapters;
+	std::sort(list.m_aliasIndex.begin(), list.m_aliasIndex.end());
+	std::sort(list.m_luidIndex.begin(), list.m_luidIndex.end());
+
+	return list;
 }
 
 //static
@@ -110,23 +223,35 @@ void InterfaceUtils::AddDeviceIpAddresses(NET_LUID device, const std::vector<SOC
 }
 
 //static
-std::set<InterfaceUtils::NetworkAdapter>
-InterfaceUtils::GetTapAdapters(const std::set<NetworkAdapter>& adapters)
+bool InterfaceUtils::IsTapAdapter(const NetworkAdapter &adapter)
 {
-	std::set<NetworkAdapter> tapAdapters;
+	return IsTapAdapterName(adapter.name());
+}
 
-	for (const auto& adapter : adapters)
-	{
-		static const wchar_t name[] = L"TAP-Windows Adapter V9";
+//static
+bool InterfaceUtils::IsTapAdapterName(const std::wstring &name)
+{
+	static const wchar_t tapName[] = L"TAP-Windows Adapter V9";
 
-		//
-		// Compare partial name, because once you start having more TAP adapters
-		// they're named "TAP-Windows Adapter V9 #2" and so on.
-		//
+	//
+	// Compare partial name, because once you start having more TAP adapters
+	// they're named "TAP-Windows Adapter V9 #2" and so on.
+	//
 
-		if (0 == adapter.name().compare(0, _countof(name) - 1, name))
+	return 0 == name.compare(0, _countof(tapName) - 1, tapName);
+}
+
+//static
+std::vector<InterfaceUtils::NetworkAdapter>
+InterfaceUtils::GetTapAdapters(const AdapterList &adapters)
+{
+	std::vector<NetworkAdapter> tapAdapters;
+
+	for (const auto& adapter : adapters)
+	{
+		if (IsTapAdapter(adapter))
 		{
-			tapAdapters.insert(adapter);
+			tapAdapters.push_back(adapter);
 		}
 	}
 
@@ -137,46 +262,37 @@ InterfaceUtils::GetTapAdapters(const std::set<NetworkAdapter>& adapters)
 std::wstring InterfaceUtils::GetTapInterfaceAlias()
 {
 	//
-	// Look for TAP adapter with alias "Mullvad".
+	// Only the candidate aliases are looked up, instead of listing all adapters.
+	// Renames are not notified, so aliases are resolved without a cache.
 	//
 
-	using shared::network::InterfaceUtils;
-
-	auto adapters = InterfaceUtils::GetTapAdapters(InterfaceUtils::GetAllAdapters(
-		AF_INET,
-		GAA_FLAG_SKIP_UNICAST | GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST
-	));
-
-	auto findByAlias = [](const std::set<InterfaceUtils::NetworkAdapter>& adapters, const std::wstring& alias)
+	for (const auto alias : TAP_ALIASES)
 	{
-		const auto it = std::find_if(adapters.begin(), adapters.end(), [&alias](const InterfaceUtils::NetworkAdapter& candidate)
-		{
-			return 0 == _wcsicmp(candidate.alias().c_str(), alias.c_str());
-		});
+		MIB_IF_ROW2 row = { 0 };
 
-		return it != adapters.end();
-	};
-
-	static const wchar_t baseAlias[] = L"Mullvad";
+		if (NO_ERROR != ConvertInterfaceAliasToLuid(alias, &row.InterfaceLuid)
+			|| NO_ERROR != GetIfEntry2(&row))
+		{
+			continue;
+		}
 
-	if (findByAlias(adapters, baseAlias))
-	{
-		return baseAlias;
+		if (IsTapAdapterName(row.Description))
+		{
+			return alias;
+		}
 	}
 
-	//
-	// Look for TAP adapter with alias "Mullvad-1", "Mullvad-2", etc.
-	//
+	THROW_ERROR("Unable to find TAP adapter");
+}
 
-	for (auto i = 0; i < 10; ++i)
+//static
+std::wstring InterfaceUtils::GetTapInterfaceAlias(const AdapterSnapshot &snapshot)
+{
+	for (const auto alias : TAP_ALIASES)
 	{
-		std::wstringstream ss;
-
-		ss << baseAlias << L"-" << i;
-
-		const auto alias = ss.str();
+		const auto adapter = snapshot.findByAlias(alias);
 
-		if (findByAlias(adapters, alias))
+		if (nullptr != adapter && IsTapAdapter(*adapter))
 		{
 			return alias;
 		}
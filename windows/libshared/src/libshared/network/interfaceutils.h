@@ -1,7 +1,6 @@
 #pragma once
 
 #include <string>
-#include <set>
 #include <vector>
 #include <memory>
 #include <cstdint>
@@ -16,11 +15,11 @@
 #include <netioapi.h>
 // end
 
-#include <libcommon/network/nci.h>
-
 namespace shared::network
 {
 
+class AdapterSnapshot;
+
 class InterfaceUtils
 {
 	InterfaceUtils() = delete;
@@ -43,20 +42,19 @@ public:
 
 		const IP_ADAPTER_ADDRESSES &raw() const
 		{
-			return m_entry;
+			return *m_entry;
 		}
 
 	private:
 
 		NetworkAdapter(
-			const common::network::Nci &nci,
 			const std::shared_ptr<std::vector<uint8_t>> addressesBuffer,
 			const IP_ADAPTER_ADDRESSES &entry
 		);
 
 		friend class InterfaceUtils;
 
-		const IP_ADAPTER_ADDRESSES &m_entry;
+		const IP_ADAPTER_ADDRESSES *m_entry;
 		std::shared_ptr<std::vector<uint8_t>> m_addressesBuffer;
 
 		std::wstring m_guid;
@@ -64,16 +62,78 @@ public:
 		std::wstring m_alias;
 	};
 
-	static std::set<NetworkAdapter> GetAllAdapters(ULONG family, ULONG flags);
+	//
+	// Adapters from a single listing, stored contiguously and sorted by GUID.
+	// The adapters refer into the listing buffer, which is shared by all of them.
+	//
+	// Lookups are binary searches, in secondary indexes for alias and LUID.
+	// Aliases and GUIDs are compared case insensitively.
+	//
+	class AdapterList
+	{
+	public:
+
+		AdapterList() = default;
+
+		using const_iterator = std::vector<NetworkAdapter>::const_iterator;
+
+		const_iterator begin() const { return m_adapters.begin(); }
+		const_iterator end() const { return m_adapters.end(); }
+
+		size_t size() const { return m_adapters.size(); }
+		bool empty() const { return m_adapters.empty(); }
+
+		//
+		// Returns nullptr if there is no matching adapter.
+		//
+		const NetworkAdapter *findByAlias(const std::wstring &alias) const;
+		const NetworkAdapter *findByLuid(const NET_LUID &luid) const;
+		const NetworkAdapter *findByGuid(const std::wstring &guid) const;
+
+	private:
+
+		friend class InterfaceUtils;
+
+		std::shared_ptr<std::vector<uint8_t>> m_buffer;
+
+		std::vector<NetworkAdapter> m_adapters;
+
+		// Case-folded alias, and index into m_adapters.
+		std::vector<std::pair<std::wstring, size_t>> m_aliasIndex;
+
+		std::vector<std::pair<uint64_t, size_t>> m_luidIndex;
+	};
+
+	static AdapterList GetAllAdapters(ULONG family, ULONG flags);
+
+	//
+	// 'bufferSizeHint' is used as the initial buffer size, and is updated
+	// with the size that was eventually used.
+	//
+	static AdapterList GetAllAdapters(ULONG family, ULONG flags, ULONG &bufferSizeHint);
 
 	static void AddDeviceIpAddresses(NET_LUID device, const std::vector<SOCKADDR_INET> &addresses);
 
-	static std::set<NetworkAdapter> GetTapAdapters(const std::set<NetworkAdapter> &adapters);
+	static bool IsTapAdapter(const NetworkAdapter &adapter);
+
+	//
+	// 'name' is the description of the adapter.
+	//
+	static bool IsTapAdapterName(const std::wstring &name);
+
+	static std::vector<NetworkAdapter> GetTapAdapters(const AdapterList &adapters);
 
 	//
 	// Determines alias of primary TAP adapter.
+	// Only the candidate aliases are resolved. Adapters are not listed.
 	//
 	static std::wstring GetTapInterfaceAlias();
+
+	//
+	// Same as above, but using an existing listing of adapters.
+	// The listing does not need to be limited to TAP adapters.
+	//
+	static std::wstring GetTapInterfaceAlias(const AdapterSnapshot &snapshot);
 };
 
 }
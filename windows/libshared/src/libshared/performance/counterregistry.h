@@ -0,0 +1,268 @@
+#pragma once
+
+#include "countersink.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace shared::performance
+{
+
+//
+// Counter that can be incremented concurrently without contention.
+//
+// Increments are spread across cache line sized slots, selected per thread,
+// which are summed when the counter is read.
+//
+class Counter
+{
+public:
+
+	Counter() = default;
+
+	void increment(uint64_t amount = 1)
+	{
+		m_slots[ThreadSlot()].value.fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	uint64_t value() const
+	{
+		uint64_t sum = 0;
+
+		for (const auto &slot : m_slots)
+		{
+			sum += slot.value.load(std::memory_order_relaxed);
+		}
+
+		return sum;
+	}
+
+private:
+
+	Counter(const Counter &) = delete;
+	Counter &operator=(const Counter &) = delete;
+
+	static constexpr size_t NUM_SLOTS = 16;
+
+	struct alignas(64) Slot
+	{
+		std::atomic<uint64_t> value{ 0 };
+	};
+
+	static size_t ThreadSlot()
+	{
+		static std::atomic<size_t> nextSlot{ 0 };
+		thread_local const size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % NUM_SLOTS;
+
+		return slot;
+	}
+
+	std::array<Slot, NUM_SLOTS> m_slots;
+};
+
+//
+// Latency histogram with power of two microsecond buckets.
+// See MULLVAD_COUNTER for the bucket layout.
+//
+class LatencyHistogram
+{
+public:
+
+	LatencyHistogram() = default;
+
+	void record(std::chrono::microseconds duration)
+	{
+		const auto us = static_cast<uint64_t>(duration.count() < 0 ? 0 : duration.count());
+
+		m_buckets[Bucket(us)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_sumUs.fetch_add(us, std::memory_order_relaxed);
+	}
+
+	void read(MULLVAD_COUNTER &counter) const
+	{
+		counter.value = m_count.load(std::memory_order_relaxed);
+		counter.sumUs = m_sumUs.load(std::memory_order_relaxed);
+
+		for (size_t i = 0; i < MULLVAD_HISTOGRAM_BUCKETS; ++i)
+		{
+			counter.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	//
+	// Records the lifetime of the instance.
+	//
+	class ScopedTimer
+	{
+	public:
+
+		explicit ScopedTimer(LatencyHistogram &histogram)
+			: m_histogram(histogram)
+			, m_start(std::chrono::steady_clock::now())
+		{
+		}
+
+		~ScopedTimer()
+		{
+			m_histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - m_start));
+		}
+
+		ScopedTimer(const ScopedTimer &) = delete;
+		ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+	private:
+
+		LatencyHistogram &m_histogram;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+private:
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+	static size_t Bucket(uint64_t us)
+	{
+		size_t bucket = 0;
+
+		while (0 != us && bucket < MULLVAD_HISTOGRAM_BUCKETS - 1)
+		{
+			us >>= 1;
+			++bucket;
+		}
+
+		return bucket;
+	}
+
+	std::array<std::atomic<uint64_t>, MULLVAD_HISTOGRAM_BUCKETS> m_buckets{};
+	std::atomic<uint64_t> m_count{ 0 };
+	std::atomic<uint64_t> m_sumUs{ 0 };
+};
+
+//
+// Counters and histograms registered by a module.
+//
+// There is one registry per module. Registration takes a lock, so callers
+// should keep a reference to the returned instance, e.g. in a function local
+// static. Updating a registered instance never takes a lock.
+//
+class CounterRegistry
+{
+public:
+
+	static CounterRegistry &Instance()
+	{
+		static CounterRegistry registry;
+
+		return registry;
+	}
+
+	//
+	// Returns the existing instance if the name is already registered.
+	//
+	Counter &counter(const char *name)
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+
+		for (auto &entry : m_counters)
+		{
+			if (0 == strcmp(entry.name.c_str(), name))
+			{
+				return entry.counter;
+			}
+		}
+
+		auto &entry = m_counters.emplace_back(name);
+
+		return entry.counter;
+	}
+
+	LatencyHistogram &histogram(const char *name)
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+
+		for (auto &entry : m_histograms)
+		{
+			if (0 == strcmp(entry.name.c_str(), name))
+			{
+				return entry.histogram;
+			}
+		}
+
+		auto &entry = m_histograms.emplace_back(name);
+
+		return entry.histogram;
+	}
+
+	void snapshot(MullvadCounterSink sink, void *context)
+	{
+		std::vector<MULLVAD_COUNTER> counters;
+
+		{
+			std::scoped_lock<std::mutex> lock(m_lock);
+
+			counters.reserve(m_counters.size() + m_histograms.size());
+
+			for (const auto &entry : m_counters)
+			{
+				auto &counter = counters.emplace_back(MakeEntry(entry.name, MULLVAD_COUNTER_TYPE_COUNTER));
+				counter.value = entry.counter.value();
+			}
+
+			for (const auto &entry : m_histograms)
+			{
+				entry.histogram.read(counters.emplace_back(MakeEntry(entry.name, MULLVAD_COUNTER_TYPE_HISTOGRAM)));
+			}
+		}
+
+		sink(counters.empty() ? nullptr : &counters[0], static_cast<uint32_t>(counters.size()), context);
+	}
+
+private:
+
+	CounterRegistry() = default;
+
+	CounterRegistry(const CounterRegistry &) = delete;
+	CounterRegistry &operator=(const CounterRegistry &) = delete;
+
+	static MULLVAD_COUNTER MakeEntry(const std::string &name, MULLVAD_COUNTER_TYPE type)
+	{
+		MULLVAD_COUNTER entry{};
+
+		strncpy_s(entry.name, name.c_str(), _TRUNCATE);
+		entry.type = type;
+
+		return entry;
+	}
+
+	struct CounterEntry
+	{
+		explicit CounterEntry(const char *name) : name(name) {}
+
+		std::string name;
+		Counter counter;
+	};
+
+	struct HistogramEntry
+	{
+		explicit HistogramEntry(const char *name) : name(name) {}
+
+		std::string name;
+		LatencyHistogram histogram;
+	};
+
+	std::mutex m_lock;
+
+	// Deques keep references stable while growing.
+	std::deque<CounterEntry> m_counters;
+	std::deque<HistogramEntry> m_histograms;
+};
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+//
+// This file is shared between DLL modules to help define their public interface.
+// It should always be C-compatible.
+//
+
+#include <stdint.h>
+
+#define MULLVAD_COUNTER_NAME_LENGTH 64
+#define MULLVAD_HISTOGRAM_BUCKETS 16
+
+enum MULLVAD_COUNTER_TYPE
+{
+	MULLVAD_COUNTER_TYPE_COUNTER = 0,
+	MULLVAD_COUNTER_TYPE_HISTOGRAM,
+};
+
+typedef struct tag_MULLVAD_COUNTER
+{
+	// Zero terminated, e.g. "winfw.transaction.commit".
+	char name[MULLVAD_COUNTER_NAME_LENGTH];
+
+	enum MULLVAD_COUNTER_TYPE type;
+
+	// Counter value, or number of samples in a histogram.
+	uint64_t value;
+
+	// Sum of all samples in a histogram, in microseconds.
+	uint64_t sumUs;
+
+	//
+	// Bucket 0 counts samples below 1 us.
+	// Bucket N counts samples in the range [2^(N-1), 2^N) us.
+	// The last bucket also counts all samples above its range.
+	//
+	uint64_t buckets[MULLVAD_HISTOGRAM_BUCKETS];
+}
+MULLVAD_COUNTER;
+
+//
+// Receives a snapshot of all counters registered with a module.
+// The array is only valid for the duration of the call.
+//
+typedef void (__stdcall *MullvadCounterSink)(const MULLVAD_COUNTER *counters, uint32_t numCounters, void *context);
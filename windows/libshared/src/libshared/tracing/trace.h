@@ -0,0 +1,219 @@
+#pragma once
+
+#include <windows.h>
+#include <TraceLoggingProvider.h>
+#include <cstdint>
+
+//
+// TraceLogging provider shared by the native modules.
+//
+// Provider name: "Mullvad.Native"
+// Provider id: {843b6312-3fc2-4f09-a8a4-f1db61b45ddf}
+//
+// Events are only formatted and written while a trace session has enabled the
+// provider, so instrumentation is nearly free otherwise.
+//
+// Each module instantiates the provider once, in a single translation unit:
+//
+//   MULLVAD_DEFINE_TRACE_PROVIDER();
+//
+// The provider is registered on first use and unregistered when the module
+// is unloaded.
+//
+
+TRACELOGGING_DECLARE_PROVIDER(g_mullvadTraceProvider);
+
+#define MULLVAD_DEFINE_TRACE_PROVIDER() \
+	TRACELOGGING_DEFINE_PROVIDER(g_mullvadTraceProvider, "Mullvad.Native", \
+		(0x843b6312, 0x3fc2, 0x4f09, 0xa8, 0xa4, 0xf1, 0xdb, 0x61, 0xb4, 0x5d, 0xdf))
+
+namespace shared::tracing
+{
+
+enum Keyword : uint64_t
+{
+	KeywordFirewall = 0x1,
+	KeywordRouting = 0x2,
+	KeywordNetwork = 0x4,
+	KeywordDns = 0x8,
+	KeywordMonitor = 0x10,
+};
+
+class ProviderRegistration
+{
+public:
+
+	ProviderRegistration()
+	{
+		TraceLoggingRegister(g_mullvadTraceProvider);
+	}
+
+	~ProviderRegistration()
+	{
+		TraceLoggingUnregister(g_mullvadTraceProvider);
+	}
+
+private:
+
+	ProviderRegistration(const ProviderRegistration &) = delete;
+	ProviderRegistration &operator=(const ProviderRegistration &) = delete;
+};
+
+inline TraceLoggingHProvider Provider()
+{
+	static const ProviderRegistration registration;
+
+	return g_mullvadTraceProvider;
+}
+
+inline bool Enabled(uint64_t keyword)
+{
+	return FALSE != TraceLoggingProviderEnabled(Provider(), WINEVENT_LEVEL_VERBOSE, keyword);
+}
+
+//
+// Measures the duration of an operation, but only if tracing for the keyword
+// was enabled when the operation started.
+//
+class Stopwatch
+{
+public:
+
+	explicit Stopwatch(uint64_t keyword)
+		: m_start{ 0 }
+		, m_enabled(Enabled(keyword))
+	{
+		if (m_enabled)
+		{
+			QueryPerformanceCounter(&m_start);
+		}
+	}
+
+	bool enabled() const
+	{
+		return m_enabled;
+	}
+
+	uint64_t elapsedUs() const
+	{
+		if (false == m_enabled)
+		{
+			return 0;
+		}
+
+		LARGE_INTEGER now, frequency;
+
+		QueryPerformanceCounter(&now);
+		QueryPerformanceFrequency(&frequency);
+
+		return static_cast<uint64_t>(((now.QuadPart - m_start.QuadPart) * 1000000) / frequency.QuadPart);
+	}
+
+private:
+
+	LARGE_INTEGER m_start;
+	bool m_enabled;
+};
+
+//
+// Events
+//
+// Each event is a separate function since TraceLogging requires event names
+// to be known at compile time.
+//
+
+inline void PolicyApplied(const Stopwatch &stopwatch, const wchar_t *policy, bool success)
+{
+	if (stopwatch.enabled())
+	{
+		TraceLoggingWrite(Provider(), "PolicyApplied",
+			TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+			TraceLoggingKeyword(KeywordFirewall),
+			TraceLoggingWideString(policy, "Policy"),
+			TraceLoggingBool(success, "Success"),
+			TraceLoggingUInt64(stopwatch.elapsedUs(), "DurationUs"));
+	}
+}
+
+//
+// Transactions are timed by the caller, which already collects statistics.
+//
+inline void TransactionCompleted(bool committed, uint64_t objectsAdded, uint64_t objectsRemoved,
+	uint64_t lockWaitUs, uint64_t lockAttempts, uint64_t commitUs, uint64_t totalUs)
+{
+	TraceLoggingWrite(Provider(), "TransactionCompleted",
+		TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+		TraceLoggingKeyword(KeywordFirewall),
+		TraceLoggingBool(committed, "Committed"),
+		TraceLoggingUInt64(objectsAdded, "ObjectsAdded"),
+		TraceLoggingUInt64(objectsRemoved, "ObjectsRemoved"),
+		TraceLoggingUInt64(lockWaitUs, "LockWaitUs"),
+		TraceLoggingUInt64(lockAttempts, "LockAttempts"),
+		TraceLoggingUInt64(commitUs, "CommitUs"),
+		TraceLoggingUInt64(totalUs, "DurationUs"));
+}
+
+inline void RoutesAdded(const Stopwatch &stopwatch, size_t numRoutes, bool success)
+{
+	if (stopwatch.enabled())
+	{
+		TraceLoggingWrite(Provider(), "RoutesAdded",
+			TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+			TraceLoggingKeyword(KeywordRouting),
+			TraceLoggingUInt32(static_cast<uint32_t>(numRoutes), "NumRoutes"),
+			TraceLoggingBool(success, "Success"),
+			TraceLoggingUInt64(stopwatch.elapsedUs(), "DurationUs"));
+	}
+}
+
+inline void RoutesDeleted(const Stopwatch &stopwatch, size_t numRoutes, bool success)
+{
+	if (stopwatch.enabled())
+	{
+		TraceLoggingWrite(Provider(), "RoutesDeleted",
+			TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+			TraceLoggingKeyword(KeywordRouting),
+			TraceLoggingUInt32(static_cast<uint32_t>(numRoutes), "NumRoutes"),
+			TraceLoggingBool(success, "Success"),
+			TraceLoggingUInt64(stopwatch.elapsedUs(), "DurationUs"));
+	}
+}
+
+inline void AdapterNotification(const Stopwatch &stopwatch, const char *source)
+{
+	if (stopwatch.enabled())
+	{
+		TraceLoggingWrite(Provider(), "AdapterNotification",
+			TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+			TraceLoggingKeyword(KeywordNetwork),
+			TraceLoggingString(source, "Source"),
+			TraceLoggingUInt64(stopwatch.elapsedUs(), "DurationUs"));
+	}
+}
+
+inline void DnsSet(const Stopwatch &stopwatch, size_t numInterfaces, bool success)
+{
+	if (stopwatch.enabled())
+	{
+		TraceLoggingWrite(Provider(), "DnsSet",
+			TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+			TraceLoggingKeyword(KeywordDns),
+			TraceLoggingUInt32(static_cast<uint32_t>(numInterfaces), "NumInterfaces"),
+			TraceLoggingBool(success, "Success"),
+			TraceLoggingUInt64(stopwatch.elapsedUs(), "DurationUs"));
+	}
+}
+
+inline void MonitorCallback(const Stopwatch &stopwatch, const char *monitor)
+{
+	if (stopwatch.enabled())
+	{
+		TraceLoggingWrite(Provider(), "MonitorCallback",
+			TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+			TraceLoggingKeyword(KeywordMonitor),
+			TraceLoggingString(monitor, "Monitor"),
+			TraceLoggingUInt64(stopwatch.elapsedUs(), "DurationUs"));
+	}
+}
+
+}
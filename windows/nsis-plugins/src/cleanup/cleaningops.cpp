@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "cleaningops.h"
+#include "recursivedelete.h"
+#include <log/log.h>
 #include <libcommon/filesystem.h>
 #include <libcommon/fileenumerator.h>
 #include <libcommon/string.h>
@@ -7,9 +9,15 @@
 #include <libcommon/memory.h>
 #include <libcommon/security.h>
 #include <libcommon/process/process.h>
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <utility>
 #include <functional>
+#include <vector>
 #include <processthreadsapi.h>
 
 namespace
@@ -47,12 +55,10 @@ mirrored_range
 	return std::make_pair(begin, lhsBegin);
 }
 
-std::wstring ConstructLocalAppDataPath(const std::wstring &base, const std::wstring &user,
+std::wstring ConstructLocalAppDataPath(const std::wstring &profilePath,
 	const std::pair<std::vector<std::wstring>::iterator, std::vector<std::wstring>::iterator> &tokens)
 {
-	auto path = std::filesystem::path(base);
-
-	path.append(user);
+	auto path = std::filesystem::path(profilePath);
 
 	std::for_each(tokens.first, tokens.second, [&](const std::wstring &token)
 	{
@@ -62,6 +68,203 @@ std::wstring ConstructLocalAppDataPath(const std::wstring &base, const std::wstr
 	return path;
 }
 
+//
+// Deleting directory trees is I/O bound, so a few threads are sufficient.
+//
+const size_t MAX_CLEANUP_THREADS = 4;
+
+//
+// Upper bound on the time spent deleting files belonging to a single user.
+// Profiles on slow or unavailable storage must not stall the uninstaller.
+//
+const ULONGLONG PER_USER_TIMEOUT_MS = 10 * 1000;
+
+bool IsServiceAccountSid(const std::wstring &sid)
+{
+	return 0 == _wcsicmp(sid.c_str(), L"S-1-5-18")
+		|| 0 == _wcsicmp(sid.c_str(), L"S-1-5-19")
+		|| 0 == _wcsicmp(sid.c_str(), L"S-1-5-20");
+}
+
+//
+// Read all profile paths from the ProfileList key in a single pass.
+// Paths for service accounts are excluded.
+//
+std::vector<std::wstring> GetUserProfilePaths()
+{
+	HKEY profileList;
+
+	auto status = RegOpenKeyExW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\ProfileList",
+		0, KEY_READ | KEY_WOW64_64KEY, &profileList);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Open ProfileList registry key");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [profileList]
+	{
+		RegCloseKey(profileList);
+	};
+
+	std::vector<std::wstring> profiles;
+
+	for (DWORD index = 0; ; ++index)
+	{
+		// Maximum length of a key name, including the terminator.
+		wchar_t sid[256];
+		DWORD sidLength = _countof(sid);
+
+		status = RegEnumKeyExW(profileList, index, sid, &sidLength, nullptr, nullptr, nullptr, nullptr);
+
+		if (ERROR_NO_MORE_ITEMS == status)
+		{
+			break;
+		}
+
+		if (ERROR_SUCCESS != status)
+		{
+			THROW_WINDOWS_ERROR(status, "Enumerate user profiles");
+		}
+
+		if (IsServiceAccountSid(sid))
+		{
+			continue;
+		}
+
+		DWORD type;
+		DWORD size = 0;
+
+		status = RegGetValueW(profileList, sid, L"ProfileImagePath",
+			RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ | RRF_NOEXPAND, &type, nullptr, &size);
+
+		if (ERROR_SUCCESS != status || 0 == size)
+		{
+			continue;
+		}
+
+		std::vector<wchar_t> buffer(size / sizeof(wchar_t) + 1);
+
+		status = RegGetValueW(profileList, sid, L"ProfileImagePath",
+			RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ | RRF_NOEXPAND, &type, &buffer[0], &size);
+
+		if (ERROR_SUCCESS != status)
+		{
+			continue;
+		}
+
+		std::wstring path(&buffer[0]);
+
+		if (REG_EXPAND_SZ == type)
+		{
+			const auto expandedLength = ExpandEnvironmentStringsW(path.c_str(), nullptr, 0);
+
+			if (0 == expandedLength)
+			{
+				continue;
+			}
+
+			std::vector<wchar_t> expanded(expandedLength);
+
+			if (0 == ExpandEnvironmentStringsW(path.c_str(), &expanded[0], expandedLength))
+			{
+				continue;
+			}
+
+			path = &expanded[0];
+		}
+
+		profiles.emplace_back(std::move(path));
+	}
+
+	return profiles;
+}
+
+void LogDeletionResult(const std::wstring &description, const DeletionResult &result)
+{
+	std::wstringstream ss;
+
+	ss << description << L": removed "
+		<< result.files << L" file(s), "
+		<< result.directories << L" directory(ies), "
+		<< result.bytes << L" byte(s)";
+
+	if (0 != result.failures)
+	{
+		ss << L", " << result.failures << L" item(s) could not be removed";
+	}
+
+	if (false == result.complete)
+	{
+		ss << L", timed out";
+	}
+
+	PluginLog(ss.str());
+}
+
+//
+// Remove a tree and report the outcome.
+// Throws if anything could not be removed.
+//
+void RemoveAndReport(const std::wstring &description, const std::filesystem::path &target)
+{
+	const auto result = RecursiveDelete(target);
+
+	LogDeletionResult(description, result);
+
+	if (0 != result.failures)
+	{
+		THROW_ERROR("Failed to remove all files and directories");
+	}
+}
+
+//
+// Remove each tree on a small pool of threads.
+// Returns once all threads have completed.
+//
+DeletionResult RemoveTreesConcurrently(const std::vector<std::filesystem::path> &targets)
+{
+	std::atomic<size_t> next(0);
+
+	std::mutex totalMutex;
+	DeletionResult total;
+
+	const auto worker = [&]()
+	{
+		for (size_t index = next++; index < targets.size(); index = next++)
+		{
+			try
+			{
+				const auto result = RecursiveDelete(targets[index], GetTickCount64() + PER_USER_TIMEOUT_MS);
+
+				std::scoped_lock<std::mutex> lock(totalMutex);
+				total += result;
+			}
+			catch (...)
+			{
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+
+	const auto numThreads = std::min(MAX_CLEANUP_THREADS, targets.size());
+
+	for (size_t i = 0; i < numThreads; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	return total;
+}
+
 std::wstring GetSystemUserLocalAppData()
 {
 	common::security::AdjustCurrentProcessTokenPrivilege(L"SeDebugPrivilege");
@@ -113,7 +316,7 @@ void RemoveLogsCacheCurrentUser()
 	const auto localAppData = common::fs::GetKnownFolderPath(FOLDERID_LocalAppData, KF_FLAG_DEFAULT, nullptr);
 	const auto appdir = std::filesystem::path(localAppData).append(L"Mullvad VPN");
 
-	std::filesystem::remove_all(appdir);
+	RemoveAndReport(L"Logs and cache for current user", appdir);
 }
 
 void RemoveLogsCacheOtherUsers()
@@ -155,38 +358,27 @@ void RemoveLogsCacheOtherUsers()
 	}
 
 	auto relativeLocalAppData = std::make_pair(std::next(localAppDataTokens.begin(), equalTokensCount), localAppDataTokens.end());
-	auto currentUser = *homeDirTokens.rbegin();
 
 	//
 	// Find all other users and construct the most plausible path for their
 	// respective "local app data" dirs.
 	//
 
-	auto parentHomeDir = common::fs::GetKnownFolderPath(FOLDERID_UserProfiles, KF_FLAG_DEFAULT, nullptr);
-
-	common::fs::FileEnumerator files(parentHomeDir);
-
-	files.addFilter(std::make_unique<common::fs::FilterDirectories>());
-	files.addFilter(std::make_unique<common::fs::FilterNotRelativeDirs>());
-
-	auto notNamedSet = std::make_unique<common::fs::FilterNotNamedSet>();
-
-	notNamedSet->addObject(std::wstring(currentUser));
-	notNamedSet->addObject(L"All Users"); // Redirects to 'c:\programdata'.
-	notNamedSet->addObject(L"Public"); // Shared documents, not an actual user or user template.
+	std::vector<std::filesystem::path> targets;
 
-	files.addFilter(std::move(notNamedSet));
-
-	WIN32_FIND_DATAW file;
-
-	while (files.next(file))
+	for (const auto &profilePath : GetUserProfilePaths())
 	{
-		const auto userLocalAppData = ConstructLocalAppDataPath(files.getDirectory(), file.cFileName, relativeLocalAppData);
-		const auto target = std::filesystem::path(userLocalAppData).append(L"Mullvad VPN");
+		if (0 == _wcsicmp(profilePath.c_str(), homeDir.c_str()))
+		{
+			continue;
+		}
+
+		const auto userLocalAppData = ConstructLocalAppDataPath(profilePath, relativeLocalAppData);
 
-		std::error_code dummy;
-		std::filesystem::remove_all(target, dummy);
+		targets.emplace_back(std::filesystem::path(userLocalAppData).append(L"Mullvad VPN"));
 	}
+
+	LogDeletionResult(L"Logs and cache for other users", RemoveTreesConcurrently(targets));
 }
 
 void RemoveLogsServiceUser()
@@ -194,7 +386,7 @@ void RemoveLogsServiceUser()
 	const auto programData = common::fs::GetKnownFolderPath(FOLDERID_ProgramData, KF_FLAG_DEFAULT, nullptr);
 	const auto appdir = std::filesystem::path(programData).append(L"Mullvad VPN");
 
-	std::filesystem::remove_all(appdir);
+	RemoveAndReport(L"Logs for service", appdir);
 }
 
 void RemoveCacheServiceUser()
@@ -4,9 +4,23 @@
 #include <libcommon/string.h>
 #include <windows.h>
 #include <nsis/pluginapi.h>
+#include "../pluginruntime.h"
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <vector>
 
+namespace
+{
+
+//
+// Deleting files can stall on a hung file system or a filter driver.
+//
+const std::chrono::milliseconds REMOVE_LOGS_AND_CACHE_TIMEOUT(60 * 1000);
+
+} // anonymous namespace
+
 void __declspec(dllexport) NSISCALL RemoveLogsAndCache
 (
 	HWND hwndParent,
@@ -27,24 +41,50 @@ void __declspec(dllexport) NSISCALL RemoveLogsAndCache
 		cleaningops::RemoveCacheServiceUser,
 	};
 
-	bool success = true;
+	auto success = std::make_shared<std::atomic_bool>(true);
 
 	//
 	// Invoke all functions and take note of any failure.
+	// Functions that haven't started when the deadline passes are skipped.
 	//
-	for (const auto &function : functions)
+	bool completed = false;
+
+	try
 	{
-		try
-		{
-			function();
-		}
-		catch (...)
+		completed = nsis::RunWithDeadline(REMOVE_LOGS_AND_CACHE_TIMEOUT,
+			[functions, success](const std::atomic_bool &cancelled)
 		{
-			success = false;
-		}
+			for (const auto &function : functions)
+			{
+				if (cancelled)
+				{
+					return;
+				}
+
+				try
+				{
+					function();
+				}
+				catch (...)
+				{
+					*success = false;
+				}
+			}
+		});
+	}
+	catch (...)
+	{
+		*success = false;
+		completed = true;
+	}
+
+	if (false == completed)
+	{
+		pushint(NsisStatus::TIMEOUT);
+		return;
 	}
 
-	pushint(success ? NsisStatus::SUCCESS : NsisStatus::GENERAL_ERROR);
+	pushint(*success ? NsisStatus::SUCCESS : NsisStatus::GENERAL_ERROR);
 }
 
 void __declspec(dllexport) NSISCALL RemoveSettings
@@ -0,0 +1,219 @@
+#include "stdafx.h"
+#include "recursivedelete.h"
+#include <libcommon/memory.h>
+#include <atomic>
+
+namespace
+{
+
+//
+// These are only defined by the SDK when targeting Windows 10 1607 or later.
+//
+const FILE_INFO_BY_HANDLE_CLASS FileDispositionInfoExClass = static_cast<FILE_INFO_BY_HANDLE_CLASS>(21);
+
+const DWORD DISPOSITION_FLAG_DELETE = 0x00000001;
+const DWORD DISPOSITION_FLAG_POSIX_SEMANTICS = 0x00000002;
+const DWORD DISPOSITION_FLAG_IGNORE_READONLY_ATTRIBUTE = 0x00000010;
+
+struct DispositionInfoEx
+{
+	DWORD Flags;
+};
+
+//
+// Cleared the first time extended disposition is rejected,
+// which happens on older versions of Windows and on FAT volumes.
+//
+std::atomic<bool> g_posixDeleteSupported = true;
+
+std::wstring ExtendedPath(const std::wstring &path)
+{
+	if (0 == path.compare(0, 4, L"\\\\?\\"))
+	{
+		return path;
+	}
+
+	if (0 == path.compare(0, 2, L"\\\\"))
+	{
+		return std::wstring(L"\\\\?\\UNC\\").append(path, 2, std::wstring::npos);
+	}
+
+	return std::wstring(L"\\\\?\\").append(path);
+}
+
+bool PosixDelete(const std::wstring &path)
+{
+	const auto handle = CreateFileW(path.c_str(), DELETE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+
+	if (INVALID_HANDLE_VALUE == handle)
+	{
+		return false;
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [handle]
+	{
+		CloseHandle(handle);
+	};
+
+	DispositionInfoEx info;
+
+	info.Flags = DISPOSITION_FLAG_DELETE | DISPOSITION_FLAG_POSIX_SEMANTICS | DISPOSITION_FLAG_IGNORE_READONLY_ATTRIBUTE;
+
+	if (FALSE != SetFileInformationByHandle(handle, FileDispositionInfoExClass, &info, sizeof(info)))
+	{
+		return true;
+	}
+
+	const auto error = GetLastError();
+
+	if (ERROR_INVALID_PARAMETER == error
+		|| ERROR_INVALID_FUNCTION == error
+		|| ERROR_NOT_SUPPORTED == error)
+	{
+		g_posixDeleteSupported = false;
+	}
+
+	return false;
+}
+
+bool LegacyDelete(const std::wstring &path, DWORD attributes, bool directory)
+{
+	if (0 != (attributes & FILE_ATTRIBUTE_READONLY))
+	{
+		SetFileAttributesW(path.c_str(), attributes & ~FILE_ATTRIBUTE_READONLY);
+	}
+
+	return FALSE != (directory ? RemoveDirectoryW(path.c_str()) : DeleteFileW(path.c_str()));
+}
+
+bool DeleteEntry(const std::wstring &path, DWORD attributes, bool directory)
+{
+	if (g_posixDeleteSupported && PosixDelete(path))
+	{
+		return true;
+	}
+
+	return LegacyDelete(path, attributes, directory);
+}
+
+void DeleteContents(const std::wstring &directory, ULONGLONG deadline, DeletionResult &result)
+{
+	WIN32_FIND_DATAW data;
+
+	const auto find = FindFirstFileExW(std::wstring(directory).append(L"\\*").c_str(), FindExInfoBasic,
+		&data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+
+	if (INVALID_HANDLE_VALUE == find)
+	{
+		return;
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [find]
+	{
+		FindClose(find);
+	};
+
+	do
+	{
+		if (0 == wcscmp(data.cFileName, L".") || 0 == wcscmp(data.cFileName, L".."))
+		{
+			continue;
+		}
+
+		if (GetTickCount64() >= deadline)
+		{
+			result.complete = false;
+			return;
+		}
+
+		const auto path = std::wstring(directory).append(L"\\").append(data.cFileName);
+
+		const auto isDirectory = (0 != (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY));
+		const auto isReparsePoint = (0 != (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT));
+
+		if (isDirectory && false == isReparsePoint)
+		{
+			DeleteContents(path, deadline, result);
+
+			if (false == result.complete)
+			{
+				return;
+			}
+		}
+
+		if (false == DeleteEntry(path, data.dwFileAttributes, isDirectory))
+		{
+			++result.failures;
+			continue;
+		}
+
+		if (isDirectory)
+		{
+			++result.directories;
+		}
+		else
+		{
+			++result.files;
+			result.bytes += (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		}
+	}
+	while (FALSE != FindNextFileW(find, &data));
+}
+
+} // anonymous namespace
+
+DeletionResult &DeletionResult::operator+=(const DeletionResult &rhs)
+{
+	files += rhs.files;
+	directories += rhs.directories;
+	bytes += rhs.bytes;
+	failures += rhs.failures;
+	complete = complete && rhs.complete;
+
+	return *this;
+}
+
+DeletionResult RecursiveDelete(const std::wstring &root, ULONGLONG deadline)
+{
+	DeletionResult result;
+
+	const auto path = ExtendedPath(root);
+	const auto attributes = GetFileAttributesW(path.c_str());
+
+	if (INVALID_FILE_ATTRIBUTES == attributes)
+	{
+		return result;
+	}
+
+	const auto isDirectory = (0 != (attributes & FILE_ATTRIBUTE_DIRECTORY));
+
+	if (isDirectory && 0 == (attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+	{
+		DeleteContents(path, deadline, result);
+
+		if (false == result.complete)
+		{
+			return result;
+		}
+	}
+
+	if (false == DeleteEntry(path, attributes, isDirectory))
+	{
+		++result.failures;
+	}
+	else if (isDirectory)
+	{
+		++result.directories;
+	}
+	else
+	{
+		++result.files;
+	}
+
+	return result;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <string>
+
+struct DeletionResult
+{
+	uint64_t files = 0;
+	uint64_t directories = 0;
+	uint64_t bytes = 0;
+
+	// Number of files and directories that could not be removed.
+	uint64_t failures = 0;
+
+	// False if the deadline was reached before the tree was fully processed.
+	bool complete = true;
+
+	DeletionResult &operator+=(const DeletionResult &rhs);
+};
+
+//
+// Remove a directory tree, including the root directory.
+//
+// Directories are enumerated with large fetches and without short names.
+// Where the file system supports it, entries are deleted with POSIX semantics,
+// so names disappear immediately even if a file is open elsewhere, and the
+// parent directory can be removed without waiting for pending deletes.
+//
+// Reparse points are removed without being followed.
+// A root that does not exist is not an error.
+//
+DeletionResult RecursiveDelete(const std::wstring &root, ULONGLONG deadline = MAXULONGLONG);
@@ -6,6 +6,7 @@
 #include <libcommon/error.h>
 #include <libcommon/memory.h>
 #include <libcommon/network/nci.h>
+#include <libshared/network/interfaceidentity.h>
 #include <log/log.h>
 
 #include <winsock2.h>
@@ -19,6 +20,7 @@
 #include <algorithm>
 
 #include <setupapi.h>
+#include <newdev.h>
 #include <devguid.h>
 #include <combaseapi.h>
 #include <initguid.h>
@@ -245,13 +247,18 @@ std::optional<std::wstring> GetDeviceRegistryStringProperty(
 	return { buffer.data() };
 }
 
-std::set<Context::NetworkAdapter> GetTapAdapters()
+//
+// Create a device information set for network devices that could be TAP adapters.
+//
+// TAP adapters are root enumerated. Restricting the set to the root enumerator
+// excludes physical and other software adapters without reading any of their
+// properties.
+//
+HDEVINFO CreateTapCandidateInfoSet()
 {
-	std::set<Context::NetworkAdapter> adapters;
-
-	HDEVINFO devInfo = SetupDiGetClassDevs(
+	HDEVINFO devInfo = SetupDiGetClassDevsW(
 		&GUID_DEVCLASS_NET,
-		nullptr,
+		L"ROOT",
 		nullptr,
 		DIGCF_PRESENT
 	);
@@ -261,11 +268,30 @@ std::set<Context::NetworkAdapter> GetTapAdapters()
 		THROW_WINDOWS_ERROR(GetLastError(), "SetupDiGetClassDevs() failed");
 	}
 
-	common::memory::ScopeDestructor scopeDestructor;
-	scopeDestructor += [devInfo]()
+	return devInfo;
+}
+
+struct TapDevice
+{
+	Context::NetworkAdapter adapter;
+	SP_DEVINFO_DATA devInfoData;
+};
+
+//
+// Enumerate TAP adapters in the device information set.
+//
+// The hardware ID is checked before any other property is read.
+// Adapters whose properties can't be read are logged and skipped,
+// but included in 'numSkipped'.
+//
+std::vector<TapDevice> EnumerateTapDevices(HDEVINFO devInfo, size_t *numSkipped = nullptr)
+{
+	std::vector<TapDevice> devices;
+
+	if (nullptr != numSkipped)
 	{
-		SetupDiDestroyDeviceInfoList(devInfo);
-	};
+		*numSkipped = 0;
+	}
 
 	common::network::Nci nci;
 
@@ -307,12 +333,27 @@ std::set<Context::NetworkAdapter> GetTapAdapters()
 			const std::wstring guid = GetNetCfgInstanceId(devInfo, devInfoData);
 			GUID guidObj = common::Guid::FromString(guid);
 
-			adapters.emplace(Context::NetworkAdapter(
-				guid,
-				GetDeviceStringProperty(devInfo, &devInfoData, &DEVPKEY_Device_DriverDesc),
-				nci.getConnectionName(guidObj),
-				GetDeviceInstanceId(devInfo, &devInfoData)
-			));
+			//
+			// Translating through the LUID is much cheaper than going through
+			// the network configuration COM objects. These are only needed
+			// if the interface is not known to the IP stack.
+			//
+			std::wstring alias;
+
+			if (NO_ERROR != shared::network::InterfaceIdentity::Instance().guidToAlias(guidObj, alias))
+			{
+				alias = nci.getConnectionName(guidObj);
+			}
+
+			devices.emplace_back(TapDevice{
+				Context::NetworkAdapter(
+					guid,
+					GetDeviceStringProperty(devInfo, &devInfoData, &DEVPKEY_Device_DriverDesc),
+					alias,
+					GetDeviceInstanceId(devInfo, &devInfoData)
+				),
+				devInfoData
+			});
 		}
 		catch (const std::exception &e)
 		{
@@ -323,9 +364,34 @@ std::set<Context::NetworkAdapter> GetTapAdapters()
 			std::string msg = "Skipping TAP adapter due to exception caught while iterating: ";
 			msg.append(e.what());
 			PluginLog(std::wstring(msg.begin(), msg.end()));
+
+			if (nullptr != numSkipped)
+			{
+				++*numSkipped;
+			}
 		}
 	}
 
+	return devices;
+}
+
+std::set<Context::NetworkAdapter> GetTapAdapters()
+{
+	HDEVINFO devInfo = CreateTapCandidateInfoSet();
+
+	common::memory::ScopeDestructor scopeDestructor;
+	scopeDestructor += [devInfo]()
+	{
+		SetupDiDestroyDeviceInfoList(devInfo);
+	};
+
+	std::set<Context::NetworkAdapter> adapters;
+
+	for (auto &device : EnumerateTapDevices(devInfo))
+	{
+		adapters.emplace(std::move(device.adapter));
+	}
+
 	return adapters;
 }
 
@@ -385,9 +451,65 @@ std::optional<Context::NetworkAdapter> Context::FindMullvadAdapter(const std::se
 	return std::nullopt;
 }
 
+//static
+bool Context::IsMullvadAlias(const std::wstring &alias)
+{
+	static const wchar_t baseAlias[] = L"Mullvad";
+	static const size_t baseLength = _countof(baseAlias) - 1;
+
+	if (alias.size() < baseLength || 0 != _wcsnicmp(alias.c_str(), baseAlias, baseLength))
+	{
+		return false;
+	}
+
+	if (alias.size() == baseLength)
+	{
+		return true;
+	}
+
+	//
+	// Suffix added by Windows when the alias is already taken.
+	//
+	if (alias.size() == baseLength + 1 || L'-' != alias[baseLength])
+	{
+		return false;
+	}
+
+	return std::all_of(alias.begin() + baseLength + 1, alias.end(), [](wchar_t c)
+	{
+		return c >= L'0' && c <= L'9';
+	});
+}
+
+void Context::beginPreflight()
+{
+	if (m_preflightAdapters.valid())
+	{
+		return;
+	}
+
+	m_preflightAdapters = std::async(std::launch::async, GetTapAdapters);
+}
+
 Context::BaselineStatus Context::establishBaseline()
 {
-	m_baseline = GetTapAdapters();
+	//
+	// Enumerate again if the preflight enumeration failed.
+	//
+	std::optional<std::set<NetworkAdapter>> preflightAdapters;
+
+	if (m_preflightAdapters.valid())
+	{
+		try
+		{
+			preflightAdapters = m_preflightAdapters.get();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	m_baseline = preflightAdapters.has_value() ? std::move(preflightAdapters.value()) : GetTapAdapters();
 
 	if (m_baseline.empty())
 	{
@@ -423,7 +545,7 @@ void Context::rollbackTapAliases()
 	}
 }
 
-Context::NetworkAdapter Context::getNewAdapter()
+std::list<Context::NetworkAdapter> Context::addedAdapters() const
 {
 	std::list<NetworkAdapter> added;
 
@@ -435,6 +557,13 @@ Context::NetworkAdapter Context::getNewAdapter()
 		}
 	}
 
+	return added;
+}
+
+Context::NetworkAdapter Context::getNewAdapter()
+{
+	const auto added = addedAdapters();
+
 	if (added.size() == 0)
 	{
 		LogAdapters(L"Enumerable network TAP adapters", m_currentState);
@@ -452,10 +581,73 @@ Context::NetworkAdapter Context::getNewAdapter()
 	return *added.begin();
 }
 
+void Context::beginArrivalMonitoring()
+{
+	m_arrivalMonitor = std::make_unique<DeviceArrivalMonitor>();
+}
+
+Context::NetworkAdapter Context::waitForNewAdapter(std::chrono::milliseconds timeout)
+{
+	if (!m_arrivalMonitor)
+	{
+		THROW_ERROR("Arrival monitoring has not been started");
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	size_t seen = 0;
+
+	for (;;)
+	{
+		const auto arrivals = m_arrivalMonitor->waitForArrival(seen, deadline);
+
+		//
+		// Enumerate once more after timing out, in case the adapter was
+		// not fully configured when its interface arrived.
+		//
+		const auto timedOut = (arrivals == seen);
+
+		seen = arrivals;
+
+		recordCurrentState();
+
+		if (timedOut || false == addedAdapters().empty())
+		{
+			break;
+		}
+	}
+
+	m_arrivalMonitor.reset();
+
+	return getNewAdapter();
+}
+
 //static
 Context::DeletionResult Context::DeleteMullvadAdapter()
 {
-	auto tapAdapters = GetTapAdapters();
+	//
+	// Use a single enumeration for both identifying and removing the adapter.
+	//
+
+	HDEVINFO devInfo = CreateTapCandidateInfoSet();
+
+	common::memory::ScopeDestructor cleanupDevList;
+	cleanupDevList += [&devInfo]()
+	{
+		SetupDiDestroyDeviceInfoList(devInfo);
+	};
+
+	size_t numSkipped = 0;
+
+	auto devices = EnumerateTapDevices(devInfo, &numSkipped);
+
+	std::set<NetworkAdapter> tapAdapters;
+
+	for (const auto &device : devices)
+	{
+		tapAdapters.emplace(device.adapter);
+	}
+
 	std::optional<NetworkAdapter> mullvadAdapter = FindMullvadAdapter(tapAdapters);
 
 	if (!mullvadAdapter.has_value())
@@ -463,67 +655,83 @@ Context::DeletionResult Context::DeleteMullvadAdapter()
 		THROW_ERROR("Mullvad TAP adapter not found");
 	}
 
-	const auto mullvadGuid = mullvadAdapter.value().guid;
+	const auto &mullvadGuid = mullvadAdapter.value().guid;
 
-	HDEVINFO devInfo = SetupDiGetClassDevsW(
-		&GUID_DEVCLASS_NET,
-		nullptr,
-		nullptr,
-		DIGCF_PRESENT
-	);
+	size_t numRemainingAdapters = numSkipped;
 
-	if (INVALID_HANDLE_VALUE == devInfo)
+	for (auto &device : devices)
 	{
-		THROW_WINDOWS_ERROR(GetLastError(), "SetupDiGetClassDevs() failed");
+		if (0 != device.adapter.guid.compare(mullvadGuid))
+		{
+			numRemainingAdapters++;
+			continue;
+		}
+
+		if (FALSE == SetupDiRemoveDevice(
+			devInfo,
+			&device.devInfoData
+		))
+		{
+			THROW_WINDOWS_ERROR(GetLastError(), "Error removing Mullvad TAP device");
+		}
 	}
 
+	return (numRemainingAdapters > 0)
+		? DeletionResult::SOME_REMAINING_TAP_ADAPTERS
+		: DeletionResult::NO_REMAINING_TAP_ADAPTERS;
+}
+
+//static
+Context::BulkDeletionResult Context::DeleteMullvadAdapters()
+{
+	HDEVINFO devInfo = CreateTapCandidateInfoSet();
+
 	common::memory::ScopeDestructor cleanupDevList;
 	cleanupDevList += [&devInfo]()
 	{
 		SetupDiDestroyDeviceInfoList(devInfo);
 	};
 
-	int numRemainingAdapters = 0;
+	size_t numSkipped = 0;
 
-	for (int memberIndex = 0; ; memberIndex++)
-	{
-		SP_DEVINFO_DATA devInfoData = { 0 };
-		devInfoData.cbSize = sizeof(devInfoData);
-		
-		if (FALSE == SetupDiEnumDeviceInfo(devInfo, memberIndex, &devInfoData))
-		{
-			const auto lastError = GetLastError();
+	auto devices = EnumerateTapDevices(devInfo, &numSkipped);
 
-			if (ERROR_NO_MORE_ITEMS == lastError)
-			{
-				break;
-			}
+	std::vector<NetworkAdapter> removed;
+
+	size_t numRemainingAdapters = numSkipped;
+	bool rebootRequired = false;
 
-			THROW_WINDOWS_ERROR(lastError, "Error enumerating network adapters");
+	for (auto &device : devices)
+	{
+		if (false == IsMullvadAlias(device.adapter.alias))
+		{
+			numRemainingAdapters++;
+			continue;
 		}
 
-		const auto hardwareId = GetDeviceRegistryStringProperty(devInfo, &devInfoData, SPDRP_HARDWAREID);
+		//
+		// Unlike SetupDiRemoveDevice, this also removes the device nodes of any children.
+		//
+		BOOL needReboot = FALSE;
 
-		if (hardwareId.has_value()
-			&& wcscmp(TAP_HARDWARE_ID, hardwareId.value().data()) == 0)
+		if (FALSE == DiUninstallDevice(nullptr, devInfo, &device.devInfoData, 0, &needReboot))
 		{
-			if (0 != GetNetCfgInstanceId(devInfo, devInfoData).compare(mullvadGuid))
-			{
-				numRemainingAdapters++;
-				continue;
-			}
-
-			if (FALSE == SetupDiRemoveDevice(
-				devInfo,
-				&devInfoData
-			))
-			{
-				THROW_WINDOWS_ERROR(GetLastError(), "Error removing Mullvad TAP device");
-			}
+			THROW_WINDOWS_ERROR(GetLastError(), "Error removing Mullvad TAP device");
 		}
+
+		rebootRequired = rebootRequired || (FALSE != needReboot);
+
+		removed.emplace_back(std::move(device.adapter));
 	}
 
-	return (numRemainingAdapters > 0)
-		? DeletionResult::SOME_REMAINING_TAP_ADAPTERS
-		: DeletionResult::NO_REMAINING_TAP_ADAPTERS;
+	LogAdapters(L"Removed Mullvad TAP adapters", removed);
+
+	return BulkDeletionResult
+	{
+		(numRemainingAdapters > 0)
+			? DeletionResult::SOME_REMAINING_TAP_ADAPTERS
+			: DeletionResult::NO_REMAINING_TAP_ADAPTERS,
+		removed.size(),
+		rebootRequired
+	};
 }
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "devicearrivalmonitor.h"
+#include <chrono>
+#include <future>
+#include <list>
+#include <memory>
 #include <set>
 #include <string>
 #include <optional>
@@ -40,6 +45,12 @@ public:
 		MULLVAD_ADAPTER_PRESENT
 	};
 
+	//
+	// Enumerate TAP adapters in the background, for use by establishBaseline().
+	// Adapters must not be added or removed in the meantime.
+	//
+	void beginPreflight();
+
 	BaselineStatus establishBaseline();
 
 	void recordCurrentState();
@@ -54,6 +65,23 @@ public:
 	//
 	NetworkAdapter getNewAdapter();
 
+	//
+	// Start listening for network device arrivals.
+	// Call this before installing an adapter, to use waitForNewAdapter().
+	//
+	void beginArrivalMonitoring();
+
+	bool isMonitoringArrivals() const
+	{
+		return static_cast<bool>(m_arrivalMonitor);
+	}
+
+	//
+	// Identify a single new TAP adapter as soon as it has arrived.
+	// Throws if no such adapter has arrived before the timeout.
+	//
+	NetworkAdapter waitForNewAdapter(std::chrono::milliseconds timeout);
+
 	enum class DeletionResult
 	{
 		NO_REMAINING_TAP_ADAPTERS,
@@ -62,10 +90,31 @@ public:
 
 	static DeletionResult DeleteMullvadAdapter();
 
+	struct BulkDeletionResult
+	{
+		DeletionResult remaining;
+		size_t numRemoved;
+		bool rebootRequired;
+	};
+
+	//
+	// Delete all TAP adapters with a Mullvad alias, i.e. "Mullvad" or "Mullvad-<n>",
+	// using a single enumeration. Finding no such adapter is not an error.
+	//
+	static BulkDeletionResult DeleteMullvadAdapters();
+
 private:
 
 	static std::optional<NetworkAdapter> FindMullvadAdapter(const std::set<NetworkAdapter> &tapAdapters);
 
+	static bool IsMullvadAlias(const std::wstring &alias);
+
+	std::list<NetworkAdapter> addedAdapters() const;
+
+	std::future<std::set<NetworkAdapter>> m_preflightAdapters;
+
 	std::set<NetworkAdapter> m_baseline;
 	std::set<NetworkAdapter> m_currentState;
+
+	std::unique_ptr<DeviceArrivalMonitor> m_arrivalMonitor;
 };
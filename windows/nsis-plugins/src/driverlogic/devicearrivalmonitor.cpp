@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "devicearrivalmonitor.h"
+#include <libcommon/error.h>
+
+namespace
+{
+
+//
+// The SDK only declares the notification API when targeting Windows 8 or later.
+//
+
+// GUID_DEVINTERFACE_NET
+const GUID NetDeviceInterfaceClass = { 0xCAC88484, 0x7515, 0x4C03, { 0x82, 0xE6, 0x71, 0xA8, 0x7A, 0xBA, 0xC3, 0x61 } };
+
+const DWORD NOTIFY_FILTER_TYPE_DEVICEINTERFACE = 0;
+const DWORD NOTIFY_ACTION_DEVICEINTERFACEARRIVAL = 0;
+
+// MAX_DEVICE_ID_LEN
+const size_t MAX_DEVICE_ID_LENGTH = 200;
+
+struct CmNotifyFilter
+{
+	DWORD cbSize;
+	DWORD Flags;
+	DWORD FilterType;
+	DWORD Reserved;
+
+	union
+	{
+		struct
+		{
+			GUID ClassGuid;
+		}
+		DeviceInterface;
+
+		struct
+		{
+			HANDLE hTarget;
+		}
+		DeviceHandle;
+
+		struct
+		{
+			WCHAR InstanceId[MAX_DEVICE_ID_LENGTH];
+		}
+		DeviceInstance;
+	}
+	u;
+};
+
+using CmNotifyCallback = DWORD (CALLBACK *)(HANDLE, PVOID, DWORD, PVOID, DWORD);
+using CmRegisterNotification = DWORD (WINAPI *)(CmNotifyFilter *, PVOID, CmNotifyCallback, HANDLE *);
+using CmUnregisterNotification = DWORD (WINAPI *)(HANDLE);
+
+// CR_SUCCESS
+const DWORD CONFIGRET_SUCCESS = 0;
+
+} // anonymous namespace
+
+DeviceArrivalMonitor::DeviceArrivalMonitor()
+	: m_cfgmgr(nullptr)
+	, m_notification(nullptr)
+	, m_arrivals(0)
+{
+	m_cfgmgr = LoadLibraryExW(L"cfgmgr32.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+
+	if (nullptr == m_cfgmgr)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Load cfgmgr32.dll");
+	}
+
+	const auto registerNotification = reinterpret_cast<CmRegisterNotification>(
+		GetProcAddress(m_cfgmgr, "CM_Register_Notification"));
+
+	if (nullptr == registerNotification)
+	{
+		FreeLibrary(m_cfgmgr);
+		THROW_ERROR("Device notifications are not supported on this version of Windows");
+	}
+
+	CmNotifyFilter filter = { 0 };
+
+	filter.cbSize = sizeof(filter);
+	filter.FilterType = NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+	filter.u.DeviceInterface.ClassGuid = NetDeviceInterfaceClass;
+
+	const auto status = registerNotification(&filter, this, &DeviceArrivalMonitor::Callback, &m_notification);
+
+	if (CONFIGRET_SUCCESS != status)
+	{
+		FreeLibrary(m_cfgmgr);
+		THROW_ERROR("Failed to register for device interface notifications");
+	}
+}
+
+DeviceArrivalMonitor::~DeviceArrivalMonitor()
+{
+	//
+	// Unregistering waits for callbacks that are in progress.
+	//
+	const auto unregisterNotification = reinterpret_cast<CmUnregisterNotification>(
+		GetProcAddress(m_cfgmgr, "CM_Unregister_Notification"));
+
+	if (nullptr != unregisterNotification)
+	{
+		unregisterNotification(m_notification);
+	}
+
+	FreeLibrary(m_cfgmgr);
+}
+
+size_t DeviceArrivalMonitor::waitForArrival(size_t seen, std::chrono::steady_clock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_arrival.wait_until(lock, deadline, [this, seen]()
+	{
+		return m_arrivals > seen;
+	});
+
+	return m_arrivals;
+}
+
+//static
+DWORD CALLBACK DeviceArrivalMonitor::Callback(HANDLE, PVOID context, DWORD action, PVOID, DWORD)
+{
+	if (NOTIFY_ACTION_DEVICEINTERFACEARRIVAL != action)
+	{
+		return ERROR_SUCCESS;
+	}
+
+	auto monitor = reinterpret_cast<DeviceArrivalMonitor *>(context);
+
+	{
+		std::scoped_lock<std::mutex> lock(monitor->m_mutex);
+		++monitor->m_arrivals;
+	}
+
+	monitor->m_arrival.notify_all();
+
+	return ERROR_SUCCESS;
+}
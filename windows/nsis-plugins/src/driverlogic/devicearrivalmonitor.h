@@ -0,0 +1,42 @@
+#pragma once
+
+#include <windows.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+//
+// Counts arrivals of network device interfaces.
+//
+// Uses CM_Register_Notification(), which is resolved at runtime since it's
+// only available on Windows 8 and later. Construction throws if the API is
+// not available.
+//
+class DeviceArrivalMonitor
+{
+public:
+
+	DeviceArrivalMonitor();
+	~DeviceArrivalMonitor();
+
+	DeviceArrivalMonitor(const DeviceArrivalMonitor &) = delete;
+	DeviceArrivalMonitor &operator=(const DeviceArrivalMonitor &) = delete;
+
+	//
+	// Wait until more than 'seen' arrivals have been observed, or the deadline passes.
+	// Returns the number of arrivals observed so far.
+	//
+	size_t waitForArrival(size_t seen, std::chrono::steady_clock::time_point deadline);
+
+private:
+
+	static DWORD CALLBACK Callback(HANDLE notification, PVOID context, DWORD action,
+		PVOID eventData, DWORD eventDataSize);
+
+	HMODULE m_cfgmgr;
+	HANDLE m_notification;
+
+	std::mutex m_mutex;
+	std::condition_variable m_arrival;
+	size_t m_arrivals;
+};
@@ -5,47 +5,31 @@
 #include <libcommon/error.h>
 #include <libcommon/valuemapper.h>
 #include <windows.h>
+#include <chrono>
+#include <memory>
 
 // Suppress warnings caused by broken legacy code
 #pragma warning (push)
 #pragma warning (disable: 4005)
 #include <nsis/pluginapi.h>
 #pragma warning (pop)
+#include "../pluginruntime.h"
 
 Context *g_context = nullptr;
 
 namespace
 {
 
-EXTERN_C IMAGE_DOS_HEADER __ImageBase;
-
-void PinDll()
-{
-	//
-	// Apparently NSIS loads and unloads the plugin module for EVERY call it makes to the plugin.
-	// This makes it kind of difficult to maintain state.
-	//
-	// We can work around this by incrementing the module reference count.
-	// When NSIS calls FreeLibrary() the reference count decrements and becomes one.
-	//
-
-	wchar_t self[MAX_PATH];
-
-	if (0 == GetModuleFileNameW((HINSTANCE)&__ImageBase, self, _countof(self)))
-	{
-		THROW_ERROR("Failed to pin plugin module");
-	}
+//
+// Adapters usually arrive before the driver installer exits,
+// but the interface can be published slightly later.
+//
+const std::chrono::milliseconds NEW_ADAPTER_TIMEOUT(10 * 1000);
 
-	//
-	// NSIS sometimes frees a plugin module more times than it loads it.
-	// This hasn't been observed for this particular plugin but let's up the
-	// reference count a bit extra anyway.
-	//
-	for (int i = 0; i < 100; ++i)
-	{
-		LoadLibraryW(self);
-	}
-}
+//
+// Device removal can block indefinitely if the PnP subsystem is stuck.
+//
+const std::chrono::milliseconds REMOVE_ADAPTERS_TIMEOUT(2 * 60 * 1000);
 
 } // anonymous namespace
 
@@ -73,7 +57,7 @@ void __declspec(dllexport) NSISCALL Initialize
 		{
 			g_context = new Context;
 
-			PinDll();
+			nsis::PinDll();
 		}
 
 		pushstring(L"");
@@ -91,6 +75,54 @@ void __declspec(dllexport) NSISCALL Initialize
 	}
 }
 
+//
+// Preflight
+//
+// Call this function early, to have the slow read-only probes run in the background
+// while the installer does other work. The results are picked up by subsequent calls,
+// which otherwise run the probes themselves.
+//
+// Currently, this enumerates the TAP adapters for EstablishBaseline().
+//
+
+void __declspec(dllexport) NSISCALL Preflight
+(
+	HWND hwndParent,
+	int string_size,
+	LPTSTR variables,
+	stack_t **stacktop,
+	extra_parameters *extra,
+	...
+)
+{
+	EXDLL_INIT();
+
+	if (nullptr == g_context)
+	{
+		pushstring(L"Initialize() function was not called or was not successful");
+		pushint(NsisStatus::GENERAL_ERROR);
+		return;
+	}
+
+	try
+	{
+		g_context->beginPreflight();
+
+		pushstring(L"");
+		pushint(NsisStatus::SUCCESS);
+	}
+	catch (std::exception &err)
+	{
+		pushstring(common::string::ToWide(err.what()).c_str());
+		pushint(NsisStatus::GENERAL_ERROR);
+	}
+	catch (...)
+	{
+		pushstring(L"Unspecified error");
+		pushint(NsisStatus::GENERAL_ERROR);
+	}
+}
+
 //
 // EstablishBaseline
 //
@@ -159,7 +191,8 @@ enum class RemoveMullvadTapStatus
 {
 	GENERAL_ERROR = 0,
 	SUCCESS_NO_REMAINING_TAP_ADAPTERS,
-	SUCCESS_SOME_REMAINING_TAP_ADAPTERS
+	SUCCESS_SOME_REMAINING_TAP_ADAPTERS,
+	TIMEOUT
 };
 
 void __declspec(dllexport) NSISCALL RemoveMullvadTap
@@ -210,6 +243,119 @@ void __declspec(dllexport) NSISCALL RemoveMullvadTap
 	}
 }
 
+//
+// RemoveMullvadTaps
+//
+// Deletes all Mullvad TAP adapters, including any left behind by earlier versions.
+// Returns the same status codes as RemoveMullvadTap.
+//
+// If any of the devices can't be removed until the system is restarted,
+// the reboot flag is set. Use IfRebootFlag to check it.
+//
+// If removal doesn't complete in time, TIMEOUT is returned and removal may
+// still be ongoing.
+//
+void __declspec(dllexport) NSISCALL RemoveMullvadTaps
+(
+	HWND hwndParent,
+	int string_size,
+	LPTSTR variables,
+	stack_t **stacktop,
+	extra_parameters *extra,
+	...
+)
+{
+	EXDLL_INIT();
+
+	try
+	{
+		auto deletion = std::make_shared<Context::BulkDeletionResult>();
+
+		const auto completed = nsis::RunWithDeadline(REMOVE_ADAPTERS_TIMEOUT, [deletion](const std::atomic_bool &)
+		{
+			*deletion = Context::DeleteMullvadAdapters();
+		});
+
+		if (false == completed)
+		{
+			pushstring(L"Timed out removing Mullvad TAP adapters");
+			pushint(RemoveMullvadTapStatus::TIMEOUT);
+			return;
+		}
+
+		const auto &result = *deletion;
+
+		if (result.rebootRequired)
+		{
+			extra->exec_flags->reboot_called = 1;
+		}
+
+		pushstring(L"");
+
+		pushint(Context::DeletionResult::NO_REMAINING_TAP_ADAPTERS == result.remaining
+			? RemoveMullvadTapStatus::SUCCESS_NO_REMAINING_TAP_ADAPTERS
+			: RemoveMullvadTapStatus::SUCCESS_SOME_REMAINING_TAP_ADAPTERS);
+	}
+	catch (std::exception &err)
+	{
+		pushstring(common::string::ToWide(err.what()).c_str());
+		pushint(RemoveMullvadTapStatus::GENERAL_ERROR);
+	}
+	catch (...)
+	{
+		pushstring(L"Unspecified error");
+		pushint(RemoveMullvadTapStatus::GENERAL_ERROR);
+	}
+}
+
+//
+// BeginArrivalMonitoring
+//
+// Call this function before installing a TAP adapter, to have
+// IdentifyNewAdapter() wait for the adapter to arrive instead of
+// relying on a single enumeration.
+//
+// Failing is not fatal. IdentifyNewAdapter() then falls back to
+// enumerating once.
+//
+
+void __declspec(dllexport) NSISCALL BeginArrivalMonitoring
+(
+	HWND hwndParent,
+	int string_size,
+	LPTSTR variables,
+	stack_t **stacktop,
+	extra_parameters *extra,
+	...
+)
+{
+	EXDLL_INIT();
+
+	if (nullptr == g_context)
+	{
+		pushstring(L"Initialize() function was not called or was not successful");
+		pushint(NsisStatus::GENERAL_ERROR);
+		return;
+	}
+
+	try
+	{
+		g_context->beginArrivalMonitoring();
+
+		pushstring(L"");
+		pushint(NsisStatus::SUCCESS);
+	}
+	catch (std::exception &err)
+	{
+		pushstring(common::string::ToWide(err.what()).c_str());
+		pushint(NsisStatus::GENERAL_ERROR);
+	}
+	catch (...)
+	{
+		pushstring(L"Unspecified error");
+		pushint(NsisStatus::GENERAL_ERROR);
+	}
+}
 
 //
 // IdentifyNewAdapter
@@ -217,7 +363,8 @@ void __declspec(dllexport) NSISCALL RemoveMullvadTap
 // Call this function after installing a TAP adapter.
 //
 // By comparing with the previously captured baseline we're able to
-// identify the new adapter.
+// identify the new adapter. If arrival monitoring was started, this
+// returns as soon as the new adapter has arrived.
 //
 
 void __declspec(dllexport) NSISCALL IdentifyNewAdapter
@@ -241,9 +388,17 @@ void __declspec(dllexport) NSISCALL IdentifyNewAdapter
 
 	try
 	{
-		g_context->recordCurrentState();
+		auto adapter = [&]()
+		{
+			if (g_context->isMonitoringArrivals())
+			{
+				return g_context->waitForNewAdapter(NEW_ADAPTER_TIMEOUT);
+			}
+
+			g_context->recordCurrentState();
 
-		auto adapter = g_context->getNewAdapter();
+			return g_context->getNewAdapter();
+		}();
 
 		pushstring(adapter.alias.c_str());
 		pushint(NsisStatus::SUCCESS);
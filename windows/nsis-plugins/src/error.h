@@ -8,6 +8,8 @@
 //
 //   GENERAL_ERROR:  Most functions return an error message.
 //   SUCCESS:        Most functions return an empty string.
+//   TIMEOUT:        The operation did not complete in time, and was
+//                   cancelled or abandoned.
 //
 // NOTE: While this is generally true, some functions only
 //       push a status code to the stack.
@@ -17,4 +19,5 @@ enum NsisStatus
 {
 	GENERAL_ERROR = 0,
 	SUCCESS,
+	TIMEOUT,
 };
@@ -1,11 +1,22 @@
 #include "stdafx.h"
 #include <windows.h>
 
+void FlushLog();
+
 BOOL APIENTRY DllMain(HMODULE, DWORD reason, LPVOID)
 {
 	//
 	// Avoid doing work in DllMain since the loader lock is held
 	//
+	// The exception is writing out buffered log messages on process exit.
+	// The plugin is pinned, so this is the last chance to do so, and it only
+	// involves WriteFile() on an open handle.
+	//
+
+	if (DLL_PROCESS_DETACH == reason)
+	{
+		FlushLog();
+	}
 
 	return TRUE;
 }
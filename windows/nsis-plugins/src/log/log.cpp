@@ -7,69 +7,19 @@
 #include <libcommon/error.h>
 #include <windows.h>
 #include <nsis/pluginapi.h>
+#include "../pluginruntime.h"
 #include <string>
 #include <vector>
 #include <memory>
 #include <sstream>
-#include <iomanip>
 #include <filesystem>
+#include <future>
 
 Logger *g_logger = nullptr;
 
 namespace
 {
 
-std::wstring PopString()
-{
-	//
-	// NSIS functions popstring() and popstringn() require that you definitely size the buffer
-	// before popping the string. Let's do it ourselves instead.
-	//
-
-	if (!g_stacktop || !*g_stacktop)
-	{
-		THROW_ERROR("NSIS variable stack is corrupted");
-	}
-
-	stack_t *th = *g_stacktop;
-
-	std::wstring copy(th->text);
-
-	*g_stacktop = th->next;
-	GlobalFree((HGLOBAL)th);
-
-	return copy;
-}
-
-EXTERN_C IMAGE_DOS_HEADER __ImageBase;
-
-void PinDll()
-{
-	//
-	// Apparently NSIS loads and unloads the plugin module for EVERY call it makes to the plugin.
-	// This makes it kind of difficult to maintain state.
-	//
-	// We can work around this by incrementing the module reference count.
-	// When NSIS calls FreeLibrary() the reference count decrements and becomes one.
-	//
-
-	wchar_t self[MAX_PATH];
-
-	if (0 == GetModuleFileNameW((HINSTANCE)&__ImageBase, self, _countof(self)))
-	{
-		THROW_ERROR("Failed to pin plugin module");
-	}
-
-	//
-	// For some reason, NSIS frees this particular DLL more times than it loads it
-	// so we have to up the reference count significantly.
-	//
-	for (int i = 0; i < 100; ++i)
-	{
-		LoadLibraryW(self);
-	}
-}
-
 std::vector<std::wstring> BlockToRows(const std::wstring &textBlock)
 {
 	//
@@ -81,106 +31,71 @@ std::vector<std::wstring> BlockToRows(const std::wstring &textBlock)
 	return common::string::Tokenize(textBlock, L"\r\n");
 }
 
-std::wstring GetWindowsProductName()
-{
-	auto regkey = common::registry::Registry::OpenKey(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion",
-		false, common::registry::RegistryView::Force64);
-
-	return regkey->readString(L"ProductName");
-}
+//
+// The log is attached to problem reports, so it must not grow without bound.
+//
+const uint64_t MAX_LOG_FILE_SIZE = 1024 * 1024;
+const uint32_t NUM_EARLIER_LOG_FILES = 2;
 
-std::wstring GetWindowsVersion()
+struct SystemInfo
 {
-	common::fs::ScopedNativeFileSystem nativeFileSystem;
-
-	const auto systemDir = common::fs::GetKnownFolderPath(FOLDERID_System, 0, nullptr);
-	const auto systemModule = std::filesystem::path(systemDir).append(L"ntoskrnl.exe");
-
-	DWORD dummy;
-
-	const auto versionSize = GetFileVersionInfoSizeW(systemModule.c_str(), &dummy);
-
-	if (0 == versionSize)
-	{
-		THROW_WINDOWS_ERROR(GetLastError(), "GetFileVersionInfoSizeW");
-	}
-
-	std::vector<uint8_t> buf(versionSize);
+	std::wstring productName;
+	std::wstring version;
+};
 
-	auto status = GetFileVersionInfoW(systemModule.c_str(), 0, static_cast<DWORD>(buf.size()), &buf[0]);
+//
+// Collected when the plugin is initialized, on a background thread.
+//
+std::shared_future<SystemInfo> g_systemInfo;
 
-	if (FALSE == status)
-	{
-		THROW_WINDOWS_ERROR(GetLastError(), "GetFileVersionInfoW");
-	}
+std::wstring GetWindowsVersion(common::registry::RegistryKey &regkey)
+{
+	using RtlGetVersionFunc = LONG (WINAPI *)(PRTL_OSVERSIONINFOW);
 
 	//
-	// Get the translation table.
-	// This is required to build the path to the value we're actually after.
+	// Unlike GetVersionEx, this is not subject to compatibility shims.
 	//
+	const auto rtlGetVersion = reinterpret_cast<RtlGetVersionFunc>(
+		GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlGetVersion"));
 
-	struct LANGANDCODEPAGE
+	if (nullptr == rtlGetVersion)
 	{
-		WORD wLanguage;
-		WORD wCodePage;
+		THROW_WINDOWS_ERROR(GetLastError(), "Resolve RtlGetVersion");
 	}
-	*translations = nullptr;
-
-	UINT translationsSize = 0;
 
-	status = VerQueryValueW(&buf[0], L"\\VarFileInfo\\Translation", reinterpret_cast<LPVOID *>(&translations), &translationsSize);
+	RTL_OSVERSIONINFOW info = { sizeof(info) };
 
-	if (FALSE == status)
+	if (0 != rtlGetVersion(&info))
 	{
-		THROW_WINDOWS_ERROR(GetLastError(), "VerQueryValueW");
+		THROW_ERROR("RtlGetVersion");
 	}
 
-	if (translationsSize < sizeof(LANGANDCODEPAGE))
-	{
-		THROW_ERROR("Invalid VERSION_INFO translation table");
-	}
-
-	//
-	// Use primary translation.
-	//
-
 	std::wstringstream ss;
 
-	ss << L"\\StringFileInfo\\"
-		<< std::setw(4) << std::setfill(L'0') << std::hex
-		<< translations[0].wLanguage
-		<< std::setw(4) << std::setfill(L'0') << std::hex
-		<< translations[0].wCodePage
-		<< L"\\ProductVersion";
-
-	const auto productVersionName = ss.str();
-
-	void *productVersion = nullptr;
-	UINT productVersionSize = 0;
+	ss << info.dwMajorVersion << L'.' << info.dwMinorVersion << L'.' << info.dwBuildNumber;
 
-	status = VerQueryValueW(&buf[0], productVersionName.c_str(), &productVersion, &productVersionSize);
-
-	if (FALSE == status)
+	//
+	// The update build revision is only recorded on Windows 10 and later.
+	//
+	try
 	{
-		THROW_WINDOWS_ERROR(GetLastError(), "VerQueryValueW");
+		ss << L'.' << regkey.readUint32(L"UBR");
 	}
-
-	// Size returned is the length in characters.
-	std::wstring version(reinterpret_cast<const wchar_t *>(productVersion), productVersionSize);
-
-	// Chop off trailing terminators.
-	while ((false == version.empty()) && (*version.rbegin() == L'\0'))
+	catch (...)
 	{
-		version.resize(version.size() - 1);
 	}
 
-	if (version.empty())
-	{
-		THROW_ERROR("Invalid version information");
-	}
+	return ss.str();
+}
 
-	return version;
+SystemInfo CollectSystemInfo()
+{
+	auto regkey = common::registry::Registry::OpenKey(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion",
+		false, common::registry::RegistryView::Force64);
+
+	return SystemInfo{ regkey->readString(L"ProductName"), GetWindowsVersion(*regkey) };
 }
+
 } // anonymous namespace
 
 //
@@ -208,7 +123,18 @@ void __declspec(dllexport) NSISCALL Initialize
 
 	try
 	{
-		PinDll();
+		nsis::PinDll();
+
+		if (false == g_systemInfo.valid())
+		{
+			g_systemInfo = std::async(std::launch::async, CollectSystemInfo).share();
+		}
+
+		if (nullptr != g_logger)
+		{
+			delete g_logger;
+			g_logger = nullptr;
+		}
 
 		int target = popint();
 		switch (target)
@@ -237,7 +163,8 @@ void __declspec(dllexport) NSISCALL Initialize
 
 				const auto logfile = decltype(logpath)(logpath).append(L"install.log");
 
-				g_logger = new Logger(std::make_unique<AnsiFileLogSink>(logfile));
+				g_logger = new Logger(std::make_unique<Utf8FileLogSink>(logfile, true, false, true,
+					FileLogSink::Rotation{ MAX_LOG_FILE_SIZE, NUM_EARLIER_LOG_FILES }));
 
 				break;
 
@@ -270,6 +197,33 @@ void __declspec(dllexport) NSISCALL Initialize
 	}
 }
 
+//
+// Deinitialize
+//
+// Writes any buffered messages and closes the log file.
+//
+void __declspec(dllexport) NSISCALL Deinitialize
+(
+	HWND hwndParent,
+	int string_size,
+	LPTSTR variables,
+	stack_t **stacktop,
+	extra_parameters *extra,
+	...
+)
+{
+	EXDLL_INIT();
+
+	try
+	{
+		delete g_logger;
+		g_logger = nullptr;
+	}
+	catch (...)
+	{
+	}
+}
+
 //
 // Log
 //
@@ -289,7 +243,12 @@ void __declspec(dllexport) NSISCALL Log
 
 	try
 	{
-		const auto message = PopString();
+		//
+		// The module is pinned, so the buffer is reused across calls.
+		//
+		static std::wstring message;
+
+		nsis::PopString(message);
 
 		if (g_logger != nullptr)
 		{
@@ -320,8 +279,11 @@ void __declspec(dllexport) NSISCALL LogWithDetails
 
 	try
 	{
-		const auto message = PopString();
-		const auto details = PopString();
+		static std::wstring message;
+		static std::wstring details;
+
+		nsis::PopString(message);
+		nsis::PopString(details);
 
 		if (g_logger != nullptr)
 		{
@@ -357,15 +319,19 @@ void __declspec(dllexport) NSISCALL LogWindowsVersion
 
 	try
 	{
-		const auto productName = GetWindowsProductName();
-		const auto version = GetWindowsVersion();
+		if (false == g_systemInfo.valid())
+		{
+			g_systemInfo = std::async(std::launch::deferred, CollectSystemInfo).share();
+		}
+
+		const auto &info = g_systemInfo.get();
 
 		std::wstringstream ss;
 
 		ss	<< L"Windows version: "
-			<< productName
+			<< info.productName
 			<< L", "
-			<< version;
+			<< info.version;
 
 		g_logger->log(ss.str());
 	}
@@ -384,6 +350,26 @@ void __declspec(dllexport) NSISCALL LogWindowsVersion
 	}
 }
 
+//
+// FlushLog
+//
+// Writes any buffered messages.
+// Used when the process is exiting without the log having been deinitialized.
+//
+void FlushLog()
+{
+	try
+	{
+		if (g_logger != nullptr)
+		{
+			g_logger->flush();
+		}
+	}
+	catch (...)
+	{
+	}
+}
+
 //
 // PluginLog
 //
@@ -2,15 +2,48 @@
 #include "logger.h"
 #include <libcommon/error.h>
 #include <libcommon/string.h>
-#include <sstream>
-#include <iomanip>
+#include <cstring>
+#include <string>
+#include <cwchar>
 
-AnsiFileLogSink::AnsiFileLogSink(const std::wstring &file, bool append, bool flush)
-	: m_flush(flush)
+namespace
+{
+
+//
+// Limits on buffered log data.
+// The buffer is written when it reaches the size limit, or when a message
+// arrives and the buffer is older than the age limit.
+//
+const size_t MAX_BUFFER_SIZE = 64 * 1024;
+const ULONGLONG MAX_BUFFER_AGE_MS = 1000;
+
+} // anonymous namespace
+
+FileLogSink::FileLogSink(const std::wstring &file, bool append, bool flush, bool buffered,
+	const std::optional<Rotation> &rotation)
+	: m_file(file)
+	, m_rotation(rotation)
+	, m_size(0)
+	, m_flush(flush)
+	, m_buffered(buffered)
+	, m_bufferTimestamp(0)
+{
+	open(append);
+
+	//
+	// Start over if the file left by an earlier run is already full.
+	//
+	if (m_rotation.has_value() && m_size >= m_rotation->maxSize)
+	{
+		rotate();
+	}
+}
+
+void FileLogSink::open(bool append)
 {
 	const DWORD creationDisposition = (append ? OPEN_ALWAYS : CREATE_ALWAYS);
 
-	m_logfile = CreateFileW(file.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+	m_logfile = CreateFileW(m_file.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
 		creationDisposition, FILE_ATTRIBUTE_NORMAL, nullptr);
 
 	if (INVALID_HANDLE_VALUE == m_logfile)
@@ -18,33 +51,110 @@ AnsiFileLogSink::AnsiFileLogSink(const std::wstring &file, bool append, bool flu
 		THROW_WINDOWS_ERROR(GetLastError(), "Open/create log file");
 	}
 
+	m_size = 0;
+
 	if (append && ERROR_ALREADY_EXISTS == GetLastError())
 	{
 		LARGE_INTEGER offset = { 0 };
+		LARGE_INTEGER end;
 
-		const auto seekStatus = SetFilePointerEx(m_logfile, offset, nullptr, FILE_END);
+		const auto seekStatus = SetFilePointerEx(m_logfile, offset, &end, FILE_END);
 
 		if (FALSE == seekStatus)
 		{
 			THROW_WINDOWS_ERROR(GetLastError(), "Seek to end offset in existing log file");
 		}
+
+		m_size = static_cast<uint64_t>(end.QuadPart);
 	}
 }
 
-AnsiFileLogSink::~AnsiFileLogSink()
+void FileLogSink::rotate()
 {
 	CloseHandle(m_logfile);
+	m_logfile = INVALID_HANDLE_VALUE;
+
+	//
+	// Shift earlier files by one, which drops the oldest one.
+	// Failing to rename is not fatal, the file is then overwritten instead.
+	//
+	auto numberedFile = [this](uint32_t number)
+	{
+		return std::wstring(m_file).append(L".").append(std::to_wstring(number));
+	};
+
+	if (m_rotation->numFiles > 0)
+	{
+		for (auto number = m_rotation->numFiles - 1; number > 0; --number)
+		{
+			MoveFileExW(numberedFile(number).c_str(), numberedFile(number + 1).c_str(), MOVEFILE_REPLACE_EXISTING);
+		}
+
+		MoveFileExW(m_file.c_str(), numberedFile(1).c_str(), MOVEFILE_REPLACE_EXISTING);
+	}
+
+	open(false);
+}
+
+FileLogSink::~FileLogSink()
+{
+	flush();
+
+	CloseHandle(m_logfile);
+}
+
+void FileLogSink::log(const std::wstring &message)
+{
+	const auto now = GetTickCount64();
+
+	if (m_buffered
+		&& false == m_buffer.empty()
+		&& now - m_bufferTimestamp >= MAX_BUFFER_AGE_MS)
+	{
+		flush();
+	}
+
+	if (m_buffer.empty())
+	{
+		m_bufferTimestamp = now;
+	}
+
+	encode(message, m_buffer);
+
+	m_buffer.append("\xd\xa");
+
+	if (false == m_buffered || m_buffer.size() >= MAX_BUFFER_SIZE)
+	{
+		flush();
+	}
 }
 
-void AnsiFileLogSink::log(const std::wstring &message)
+void FileLogSink::flush()
 {
-	auto ansi = common::string::ToAnsi(message);
+	if (m_buffer.empty())
+	{
+		return;
+	}
 
-	ansi.append("\xd\xa");
+	write(m_buffer);
+
+	m_buffer.clear();
+}
+
+void FileLogSink::write(const std::string &data)
+{
+	if (m_rotation.has_value()
+		&& 0 != m_size
+		&& m_size + data.size() > m_rotation->maxSize)
+	{
+		rotate();
+	}
 
 	DWORD bytesWritten;
 
-	WriteFile(m_logfile, ansi.c_str(), ansi.size(), &bytesWritten, nullptr);
+	WriteFile(m_logfile, data.c_str(), static_cast<DWORD>(data.size()), &bytesWritten, nullptr);
+
+	m_size += bytesWritten;
 
 	if (m_flush)
 	{
@@ -52,62 +162,93 @@ void AnsiFileLogSink::log(const std::wstring &message)
 	}
 }
 
+void AnsiFileLogSink::encode(const std::wstring &message, std::string &buffer)
+{
+	buffer.append(common::string::ToAnsi(message));
+}
+
+void Utf8FileLogSink::encode(const std::wstring &message, std::string &buffer)
+{
+	if (message.empty())
+	{
+		return;
+	}
+
+	const auto messageLength = static_cast<int>(message.size());
+
+	const auto required = WideCharToMultiByte(CP_UTF8, 0, message.c_str(), messageLength,
+		nullptr, 0, nullptr, nullptr);
+
+	if (0 == required)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Determine UTF-8 length of log message");
+	}
+
+	const auto offset = buffer.size();
+
+	buffer.resize(offset + required);
+
+	WideCharToMultiByte(CP_UTF8, 0, message.c_str(), messageLength,
+		&buffer[offset], required, nullptr, nullptr);
+}
+
 void Logger::log(const std::wstring &message)
 {
-	m_logsink->log(Compose(message, Timestamp()));
+	updateTimestamp();
+
+	m_logsink->log(compose(message));
 }
 
 void Logger::log(const std::wstring &message, const std::vector<std::wstring> &details)
 {
-	const auto timestamp = this->Timestamp();
+	updateTimestamp();
 
-	m_logsink->log(Compose(message, timestamp));
+	m_logsink->log(compose(message));
 
 	//
 	// Write details with indentation.
 	//
-	for (const auto detail : details)
+	for (const auto &detail : details)
 	{
-		m_logsink->log(Compose(detail, timestamp, 4));
+		m_logsink->log(compose(detail, 4));
 	}
 }
 
-// static
-std::wstring Logger::Timestamp()
+void Logger::flush()
+{
+	m_logsink->flush();
+}
+
+void Logger::updateTimestamp()
 {
 	SYSTEMTIME time;
 
 	GetLocalTime(&time);
 
-	std::wstringstream ss;
-
-	ss << L'['
-		<< std::right << std::setw(4) << std::setfill(L'0') << time.wYear
-		<< L'-'
-		<< std::right << std::setw(2) << std::setfill(L'0') << time.wMonth
-		<< L'-'
-		<< std::right << std::setw(2) << std::setfill(L'0') << time.wDay
-		<< L' '
-		<< std::right << std::setw(2) << std::setfill(L'0') << time.wHour
-		<< L':'
-		<< std::right << std::setw(2) << std::setfill(L'0') << time.wMinute
-		<< L':'
-		<< std::right << std::setw(2) << std::setfill(L'0') << time.wSecond
-		<< L'.'
-		<< std::right << std::setw(3) << std::setfill(L'0') << time.wMilliseconds
-		<< L']';
-
-	return ss.str();
+	if (false == m_timestamp.empty()
+		&& 0 == memcmp(&time, &m_timestampTime, sizeof(time)))
+	{
+		return;
+	}
+
+	m_timestampTime = time;
+
+	wchar_t formatted[32];
+
+	swprintf_s(formatted, L"[%04u-%02u-%02u %02u:%02u:%02u.%03u]",
+		time.wYear, time.wMonth, time.wDay,
+		time.wHour, time.wMinute, time.wSecond,
+		time.wMilliseconds);
+
+	m_timestamp.assign(formatted);
 }
 
-//static
-std::wstring Logger::Compose(const std::wstring &message, const std::wstring &timestamp, size_t indentation)
+const std::wstring &Logger::compose(const std::wstring &message, size_t indentation)
 {
-	std::wstringstream ss;
-
-	ss << timestamp << L' '
-		<< std::wstring(indentation, L' ')
-		<< message;
+	m_line.assign(m_timestamp);
+	m_line.push_back(L' ');
+	m_line.append(indentation, L' ');
+	m_line.append(message);
 
-	return ss.str();
+	return m_line;
 }
@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <cstdint>
 #include <windows.h>
 
 struct ILogSink
@@ -12,6 +14,11 @@ struct ILogSink
 	}
 
 	virtual void log(const std::wstring &message) = 0;
+
+	//
+	// Write any buffered messages.
+	//
+	virtual void flush() = 0;
 };
 
 class VoidLogSink : public ILogSink
@@ -19,24 +26,103 @@ class VoidLogSink : public ILogSink
 public:
 
 	void log(const std::wstring &message) override {}
+	void flush() override {}
 };
 
-class AnsiFileLogSink : public ILogSink
+//
+// Writes messages to a file, one per line.
+//
+// With 'buffered' set, messages are collected in memory and written when
+// the buffer fills up, when a message arrives after the buffer has aged,
+// or when flush() is called. Destroying the sink also flushes it.
+//
+// With 'rotation' set, the file is renamed once it would grow past the size limit,
+// and a new file is started. Earlier files are named by appending ".1", ".2", etc.
+// The size is tracked as data is written, so checking it costs nothing.
+//
+class FileLogSink : public ILogSink
 {
 public:
 
-	AnsiFileLogSink(const std::wstring &file, bool append = true, bool flush = false);
-	~AnsiFileLogSink();
+	struct Rotation
+	{
+		uint64_t maxSize;
+
+		// Number of earlier files to keep.
+		uint32_t numFiles;
+	};
 
-	AnsiFileLogSink(const AnsiFileLogSink &) = delete;
-	AnsiFileLogSink &operator=(const AnsiFileLogSink &) = delete;
+	~FileLogSink();
+
+	FileLogSink(const FileLogSink &) = delete;
+	FileLogSink &operator=(const FileLogSink &) = delete;
 
 	void log(const std::wstring &message) override;
+	void flush() override;
+
+protected:
+
+	FileLogSink(const std::wstring &file, bool append, bool flush, bool buffered,
+		const std::optional<Rotation> &rotation);
+
+	//
+	// Append the encoded message to 'buffer'.
+	//
+	virtual void encode(const std::wstring &message, std::string &buffer) = 0;
 
 private:
 
+	void write(const std::string &data);
+
+	void open(bool append);
+	void rotate();
+
+	const std::wstring m_file;
+
 	HANDLE m_logfile = INVALID_HANDLE_VALUE;
+
+	std::optional<Rotation> m_rotation;
+	uint64_t m_size;
+
 	bool m_flush;
+
+	bool m_buffered;
+
+	// Retains its capacity, so encoding does not allocate once it has grown.
+	std::string m_buffer;
+
+	// Tick count when the oldest buffered message was added.
+	ULONGLONG m_bufferTimestamp;
+};
+
+class AnsiFileLogSink : public FileLogSink
+{
+public:
+
+	AnsiFileLogSink(const std::wstring &file, bool append = true, bool flush = false, bool buffered = false,
+		const std::optional<Rotation> &rotation = std::nullopt)
+		: FileLogSink(file, append, flush, buffered, rotation)
+	{
+	}
+
+private:
+
+	void encode(const std::wstring &message, std::string &buffer) override;
+};
+
+class Utf8FileLogSink : public FileLogSink
+{
+public:
+
+	Utf8FileLogSink(const std::wstring &file, bool append = true, bool flush = false, bool buffered = false,
+		const std::optional<Rotation> &rotation = std::nullopt)
+		: FileLogSink(file, append, flush, buffered, rotation)
+	{
+	}
+
+private:
+
+	void encode(const std::wstring &message, std::string &buffer) override;
 };
 
 class Logger
@@ -45,6 +131,7 @@ public:
 
 	Logger(std::unique_ptr<ILogSink> &&logsink)
 		: m_logsink(std::move(logsink))
+		, m_timestampTime{ 0 }
 	{
 	}
 
@@ -54,12 +141,24 @@ public:
 	void log(const std::wstring &message);
 	void log(const std::wstring &message, const std::vector<std::wstring> &details);
 
+	void flush();
+
 private:
 
 	std::unique_ptr<ILogSink> m_logsink;
 
-	static std::wstring Timestamp();
+	//
+	// The formatted timestamp is reused for messages logged within the same millisecond.
+	//
+	void updateTimestamp();
+
+	SYSTEMTIME m_timestampTime;
+	std::wstring m_timestamp;
+
+	//
+	// Compose a line in a buffer that is reused between messages.
+	//
+	const std::wstring &compose(const std::wstring &message, size_t indentation = 0);
 
-	static std::wstring Compose(const std::wstring &message, const std::wstring &timestamp,
-		size_t indentation = 0);
+	std::wstring m_line;
 };
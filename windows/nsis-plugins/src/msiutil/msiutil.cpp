@@ -1,65 +1,190 @@
 #include "stdafx.h"
 #include <msi.h>
+#include <msiquery.h>
 #include <windows.h>
 #include <nsis/pluginapi.h>
+#include "../pluginruntime.h"
 #include "../error.h"
 #include <log/log.h>
 #include <libcommon/string.h>
 #include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <thread>
 
 namespace
 {
 
-std::wstring PopString()
+//
+// Control on the NSIS "instfiles" page that displays the current status.
+//
+const int IDC_INSTFILES_STATUS = 1006;
+
+//
+// How often the status text is refreshed while an MSI operation is running.
+//
+const DWORD STATUS_UPDATE_INTERVAL_MS = 100;
+
+//
+// Time allowed for an MSI operation before it's cancelled, and for it to then roll back.
+// If the operation doesn't return after being cancelled, it's abandoned.
+//
+const ULONGLONG MSI_OPERATION_TIMEOUT_MS = 10 * 60 * 1000;
+const ULONGLONG MSI_CANCEL_GRACE_MS = 60 * 1000;
+
+//
+// Tracks the progress bar as described by INSTALLMESSAGE_PROGRESS messages.
+//
+class ProgressTracker
 {
-	//
-	// NSIS functions popstring() and popstringn() require that you definitely size the buffer
-	// before popping the string. Let's do it ourselves instead.
-	//
+public:
 
-	if (!g_stacktop || !*g_stacktop)
+	ProgressTracker()
+		: m_total(0)
+		, m_completed(0)
+		, m_forward(true)
 	{
-		THROW_ERROR("NSIS variable stack is corrupted");
 	}
 
-	stack_t *th = *g_stacktop;
+	void update(LPCWSTR message)
+	{
+		//
+		// Messages are formatted as "1: <type> 2: <value> 3: <value> 4: <value>".
+		//
+		long fields[4] = { 0 };
+
+		if (false == ParseFields(message, fields))
+		{
+			return;
+		}
 
-	std::wstring copy(th->text);
+		const auto value = static_cast<long long>(fields[1]);
 
-	*g_stacktop = th->next;
-	GlobalFree((HGLOBAL)th);
+		switch (fields[0])
+		{
+			case 0:
+			{
+				// Reset the progress bar.
+				m_total = value;
+				m_forward = (0 == fields[2]);
+				m_completed = (m_forward ? 0 : m_total);
+				break;
+			}
+			case 2:
+			{
+				// Increment the progress bar.
+				m_completed += (m_forward ? value : -value);
+				break;
+			}
+			case 3:
+			{
+				// Add to the expected total.
+				m_total += value;
+				break;
+			}
+		}
+	}
 
-	return copy;
-}
+	int percent() const
+	{
+		if (0 >= m_total)
+		{
+			return 0;
+		}
 
-EXTERN_C IMAGE_DOS_HEADER __ImageBase;
+		const auto completed = (m_completed < 0 ? 0 : (m_completed > m_total ? m_total : m_completed));
 
-void PinDll()
-{
-	//
-	// Apparently NSIS loads and unloads the plugin module for EVERY call it makes to the plugin.
-	// This makes it kind of difficult to maintain state.
-	//
-	// We can work around this by incrementing the module reference count.
-	// When NSIS calls FreeLibrary() the reference count decrements and becomes one.
-	//
+		return static_cast<int>((completed * 100) / m_total);
+	}
 
-	wchar_t self[MAX_PATH];
+private:
 
-	if (0 == GetModuleFileNameW((HINSTANCE)&__ImageBase, self, _countof(self)))
+	static bool ParseFields(LPCWSTR message, long fields[4])
 	{
-		THROW_ERROR("Failed to pin plugin module");
+		if (nullptr == message)
+		{
+			return false;
+		}
+
+		bool typePresent = false;
+
+		for (auto current = message; L'\0' != *current; )
+		{
+			wchar_t *end = nullptr;
+
+			const auto index = wcstol(current, &end, 10);
+
+			if (end == current || L':' != *end)
+			{
+				break;
+			}
+
+			current = end + 1;
+
+			const auto value = wcstol(current, &end, 10);
+
+			if (end == current)
+			{
+				break;
+			}
+
+			if (index >= 1 && index <= 4)
+			{
+				fields[index - 1] = value;
+				typePresent = (typePresent || 1 == index);
+			}
+
+			current = end;
+		}
+
+		return typePresent;
 	}
 
-	//
-	// For some reason, NSIS frees this particular DLL more times than it loads it
-	// so we have to up the reference count significantly.
-	//
-	for (int i = 0; i < 100; ++i)
+	long long m_total;
+	long long m_completed;
+	bool m_forward;
+};
+
+//
+// Shared with the worker, which may outlive the caller if the operation is abandoned.
+//
+struct OperationContext
+{
+	OperationContext()
+		: percent(0)
+		, cancel(false)
+		, result(ERROR_SUCCESS)
 	{
-		LoadLibraryW(self);
+		done = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+		if (nullptr == done)
+		{
+			THROW_WINDOWS_ERROR(GetLastError(), "Create event");
+		}
 	}
-}
+
+	~OperationContext()
+	{
+		CloseHandle(done);
+	}
+
+	OperationContext(const OperationContext &) = delete;
+	OperationContext &operator=(const OperationContext &) = delete;
+
+	ProgressTracker progress;
+
+	// Updated on the worker thread and displayed on the UI thread.
+	std::atomic<int> percent;
+
+	std::atomic<bool> cancel;
+
+	// Set by the worker before signalling 'done'.
+	UINT result;
+	HANDLE done;
+};
 
 int WINAPI InstallerHandler(
 	LPVOID context,
@@ -67,11 +192,279 @@ int WINAPI InstallerHandler(
 	LPCWSTR message
 )
 {
+	auto operation = reinterpret_cast<OperationContext *>(context);
+
+	if (operation->cancel)
+	{
+		return IDCANCEL;
+	}
+
+	if (INSTALLMESSAGE_PROGRESS == (type & 0xFF000000))
+	{
+		operation->progress.update(message);
+		operation->percent = operation->progress.percent();
+
+		return 0;
+	}
+
 	PluginLog(message);
 	// return 0 to pass it on to the installer
 	return 0;
 }
 
+HWND FindStatusWindow(HWND hwndParent)
+{
+	if (nullptr == hwndParent)
+	{
+		return nullptr;
+	}
+
+	auto page = FindWindowExW(hwndParent, nullptr, L"#32770", nullptr);
+
+	if (nullptr == page)
+	{
+		return nullptr;
+	}
+
+	return GetDlgItem(page, IDC_INSTFILES_STATUS);
+}
+
+//
+// Run an MSI operation on a worker thread.
+//
+// The calling thread keeps processing window messages so the installer UI
+// stays responsive, and the status text is updated with the progress.
+// If the installer is being shut down, or the operation times out, it's cancelled.
+//
+// Returns ERROR_TIMEOUT if the operation was cancelled because it timed out.
+//
+UINT RunMsiOperation(HWND hwndParent, const std::wstring &msiFile, const std::wstring &commandLine,
+	const std::wstring &description)
+{
+	nsis::PinDll();
+
+	const auto shared = std::make_shared<OperationContext>();
+
+	auto &context = *shared;
+	const auto done = context.done;
+
+	std::thread worker([shared, msiFile, commandLine]
+	{
+		auto &context = *shared;
+
+		MsiSetInternalUI(INSTALLUILEVEL_NONE, nullptr);
+		MsiSetExternalUIW(
+			InstallerHandler,
+			INSTALLLOGMODE_PROGRESS |
+			INSTALLLOGMODE_INFO |
+			INSTALLLOGMODE_WARNING |
+			INSTALLLOGMODE_ERROR |
+			INSTALLLOGMODE_FATALEXIT |
+			INSTALLLOGMODE_OUTOFDISKSPACE |
+			INSTALLLOGMODE_RMFILESINUSE |
+			INSTALLLOGMODE_FILESINUSE,
+			&context
+		);
+
+		context.result = MsiInstallProductW(msiFile.c_str(), commandLine.c_str());
+
+		MsiSetExternalUIW(nullptr, 0, nullptr);
+
+		SetEvent(context.done);
+	});
+
+	const auto statusWindow = FindStatusWindow(hwndParent);
+
+	int displayedPercent = -1;
+
+	bool quit = false;
+	WPARAM quitCode = 0;
+
+	const auto start = GetTickCount64();
+
+	bool timedOut = false;
+	bool abandoned = false;
+
+	for (;;)
+	{
+		const auto status = MsgWaitForMultipleObjects(1, &done, FALSE, STATUS_UPDATE_INTERVAL_MS, QS_ALLINPUT);
+
+		if (WAIT_OBJECT_0 == status)
+		{
+			break;
+		}
+
+		const auto elapsed = GetTickCount64() - start;
+
+		if (elapsed >= MSI_OPERATION_TIMEOUT_MS && false == timedOut)
+		{
+			PluginLog(std::wstring(L"Cancelling MSI operation that timed out: ").append(description));
+
+			timedOut = true;
+			context.cancel = true;
+		}
+
+		if (elapsed >= MSI_OPERATION_TIMEOUT_MS + MSI_CANCEL_GRACE_MS)
+		{
+			PluginLog(std::wstring(L"Abandoning MSI operation that did not respond to cancellation: ").append(description));
+
+			abandoned = true;
+			break;
+		}
+
+		MSG msg;
+
+		while (FALSE != PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE))
+		{
+			if (WM_QUIT == msg.message)
+			{
+				quit = true;
+				quitCode = msg.wParam;
+				context.cancel = true;
+				continue;
+			}
+
+			TranslateMessage(&msg);
+			DispatchMessageW(&msg);
+		}
+
+		if (nullptr != hwndParent && FALSE == IsWindow(hwndParent))
+		{
+			context.cancel = true;
+		}
+
+		const int percent = context.percent;
+
+		if (nullptr != statusWindow && percent != displayedPercent)
+		{
+			displayedPercent = percent;
+
+			std::wstringstream ss;
+			ss << description << L" (" << percent << L"%)";
+
+			SetWindowTextW(statusWindow, ss.str().c_str());
+		}
+	}
+
+	if (abandoned)
+	{
+		worker.detach();
+	}
+	else
+	{
+		worker.join();
+	}
+
+	if (quit)
+	{
+		// Let the NSIS message loop observe the request.
+		PostQuitMessage(static_cast<int>(quitCode));
+	}
+
+	return (timedOut ? static_cast<UINT>(ERROR_TIMEOUT) : context.result);
+}
+
+std::wstring GetPackageProperty(MSIHANDLE database, const wchar_t *name)
+{
+	std::wstringstream ss;
+	ss << L"SELECT `Value` FROM `Property` WHERE `Property`='" << name << L"'";
+
+	MSIHANDLE view = 0;
+
+	if (ERROR_SUCCESS != MsiDatabaseOpenViewW(database, ss.str().c_str(), &view))
+	{
+		THROW_ERROR("Failed to query MSI package properties");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [view]
+	{
+		MsiViewClose(view);
+		MsiCloseHandle(view);
+	};
+
+	if (ERROR_SUCCESS != MsiViewExecute(view, 0))
+	{
+		THROW_ERROR("Failed to query MSI package properties");
+	}
+
+	MSIHANDLE record = 0;
+
+	if (ERROR_SUCCESS != MsiViewFetch(view, &record))
+	{
+		return L"";
+	}
+
+	sd += [record]
+	{
+		MsiCloseHandle(record);
+	};
+
+	wchar_t value[MAX_PATH];
+	DWORD valueSize = _countof(value);
+
+	if (ERROR_SUCCESS != MsiRecordGetStringW(record, 1, value, &valueSize))
+	{
+		return L"";
+	}
+
+	return value;
+}
+
+//
+// Determine whether the product in the package is already installed,
+// at the same version.
+//
+bool PackageProductInstalled(const std::wstring &msiFile)
+{
+	MSIHANDLE database = 0;
+
+	if (ERROR_SUCCESS != MsiOpenDatabaseW(msiFile.c_str(), MSIDBOPEN_READONLY, &database))
+	{
+		THROW_ERROR("Failed to open MSI package");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [database]
+	{
+		MsiCloseHandle(database);
+	};
+
+	const auto productCode = GetPackageProperty(database, L"ProductCode");
+	const auto productVersion = GetPackageProperty(database, L"ProductVersion");
+
+	if (productCode.empty() || productVersion.empty())
+	{
+		return false;
+	}
+
+	if (INSTALLSTATE_DEFAULT != MsiQueryProductStateW(productCode.c_str()))
+	{
+		return false;
+	}
+
+	wchar_t installedVersion[MAX_PATH];
+	DWORD installedVersionSize = _countof(installedVersion);
+
+	if (ERROR_SUCCESS != MsiGetProductInfoW(productCode.c_str(), INSTALLPROPERTY_VERSIONSTRING,
+		installedVersion, &installedVersionSize))
+	{
+		return false;
+	}
+
+	if (productVersion != installedVersion)
+	{
+		return false;
+	}
+
+	PluginLog(std::wstring(L"Product ").append(productCode).append(L" version ")
+		.append(productVersion).append(L" is already installed"));
+
+	return true;
+}
+
 } // anonymous namespace
 
 
@@ -79,8 +472,10 @@ int WINAPI InstallerHandler(
 // SilentInstall "installer.msi"
 //
 // Performs a silent install and logs the results.
+// The install is skipped if the same version of the product is already installed.
 //
 // Return: Empty string and NsisStatus::SUCCESS on success.
+//         NsisStatus::TIMEOUT if the install was cancelled because it took too long.
 //         Otherwise an error string and NsisStatus::GENERAL_ERROR.
 //
 
@@ -98,27 +493,42 @@ void __declspec(dllexport) NSISCALL SilentInstall
 
 	try
 	{
-		const auto msiFile = PopString();
+		const auto msiFile = nsis::PopString();
 
-		MsiSetInternalUI(INSTALLUILEVEL_NONE, nullptr);
-		MsiSetExternalUIW(
-			InstallerHandler,
-			INSTALLLOGMODE_INFO |
-			INSTALLLOGMODE_WARNING |
-			INSTALLLOGMODE_ERROR |
-			INSTALLLOGMODE_FATALEXIT |
-			INSTALLLOGMODE_OUTOFDISKSPACE |
-			INSTALLLOGMODE_RMFILESINUSE |
-			INSTALLLOGMODE_FILESINUSE,
-			nullptr
-		);
+		bool installed = false;
 
-		const auto installResult = MsiInstallProductW(
-			msiFile.c_str(),
+		try
+		{
+			installed = PackageProductInstalled(msiFile);
+		}
+		catch (const std::exception &err)
+		{
+			PluginLog(std::wstring(L"Could not determine whether product is installed: ")
+				.append(common::string::ToWide(err.what())));
+		}
+
+		if (installed)
+		{
+			pushstring(L"");
+			pushint(NsisStatus::SUCCESS);
+			return;
+		}
+
+		const auto installResult = RunMsiOperation(
+			hwndParent,
+			msiFile,
 			L"ACTION=INSTALL "
-			L"REBOOT=ReallySuppress"
+			L"REBOOT=ReallySuppress",
+			std::wstring(L"Installing ").append(std::filesystem::path(msiFile).filename())
 		);
 
+		if (ERROR_TIMEOUT == installResult)
+		{
+			pushstring(L"Install timed out");
+			pushint(NsisStatus::TIMEOUT);
+			return;
+		}
+
 		if (ERROR_SUCCESS != installResult)
 		{
 			std::wstringstream ss;
@@ -149,6 +559,7 @@ void __declspec(dllexport) NSISCALL SilentInstall
 // Performs a silent uninstall and logs the results.
 //
 // Return: Empty string and NsisStatus::SUCCESS on success.
+//         NsisStatus::TIMEOUT if the uninstall was cancelled because it took too long.
 //         Otherwise an error string and NsisStatus::GENERAL_ERROR.
 //
 
@@ -166,27 +577,23 @@ void __declspec(dllexport) NSISCALL SilentUninstall
 
 	try
 	{
-		const auto msiFile = PopString();
+		const auto msiFile = nsis::PopString();
 
-		MsiSetInternalUI(INSTALLUILEVEL_NONE, nullptr);
-		MsiSetExternalUIW(
-			InstallerHandler,
-			INSTALLLOGMODE_INFO |
-			INSTALLLOGMODE_WARNING |
-			INSTALLLOGMODE_ERROR |
-			INSTALLLOGMODE_FATALEXIT |
-			INSTALLLOGMODE_OUTOFDISKSPACE |
-			INSTALLLOGMODE_RMFILESINUSE |
-			INSTALLLOGMODE_FILESINUSE,
-			nullptr
-		);
-
-		const auto installResult = MsiInstallProductW(
-			msiFile.c_str(),
+		const auto installResult = RunMsiOperation(
+			hwndParent,
+			msiFile,
 			L"REMOVE=ALL "
-			L"REBOOT=ReallySuppress"
+			L"REBOOT=ReallySuppress",
+			std::wstring(L"Uninstalling ").append(std::filesystem::path(msiFile).filename())
 		);
 
+		if (ERROR_TIMEOUT == installResult)
+		{
+			pushstring(L"Uninstall timed out");
+			pushint(NsisStatus::TIMEOUT);
+			return;
+		}
+
 		if (ERROR_SUCCESS != installResult)
 		{
 			std::wstringstream ss;
@@ -10,13 +10,16 @@
 #include <libcommon/registry/registrykey.h>
 #include <libcommon/error.h>
 #include <nsis/pluginapi.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 
 // Suppress warnings caused by broken legacy code
 #pragma warning (push)
 #pragma warning (disable: 4005)
 #include <nsis/pluginapi.h>
 #pragma warning (pop)
+#include "../pluginruntime.h"
 
 using namespace common::registry;
 using ValueStringType = RegistryKey::ValueStringType;
@@ -29,59 +32,126 @@ static constexpr size_t messageTimeoutInterval = 5;
 namespace
 {
 
-std::wstring PopString()
+std::wstring ReadPathValue(const RegistryKey &pathKey)
+{
+	// Some applications will replace the PATH value with a regular string;
+	// use this type as a fallback.
+	try
+	{
+		return pathKey.readString(pathValName, ValueStringType::ExpandableString);
+	}
+	catch (const std::exception &)
+	{
+		return pathKey.readString(pathValName, ValueStringType::RegularString);
+	}
+}
+
+struct PathEdit
+{
+	enum class Operation
+	{
+		Add,
+		Remove
+	};
+
+	Operation operation;
+	std::wstring path;
+};
+
+//
+// Apply all edits to the PATH value with a single read and write.
+// Edits are applied in order.
+//
+// Returns whether the PATH value was updated.
+//
+bool ApplyPathEdits(const std::vector<PathEdit> &edits)
 {
+	auto pathRegKey = Registry::OpenKey(
+		HKEY_LOCAL_MACHINE,
+		pathKeyName,
+		true,
+		RegistryView::Force64
+	);
+
+	const auto path = ReadPathValue(*pathRegKey);
+
+	auto pathTokens = common::string::Tokenize(path, L";");
+
 	//
-	// NSIS functions popstring() and popstringn() require that you definitely size the buffer
-	// before popping the string. Let's do it ourselves instead.
+	// Lower case copies of the tokens, to avoid converting
+	// every token for each comparison.
 	//
+	std::vector<std::wstring> lowerTokens;
+	lowerTokens.reserve(pathTokens.size() + edits.size());
 
-	if (!g_stacktop || !*g_stacktop)
+	for (const auto &token : pathTokens)
 	{
-		THROW_ERROR("NSIS variable stack is corrupted");
+		lowerTokens.push_back(Lower(token));
 	}
 
-	stack_t *th = *g_stacktop;
+	bool updatedPath = false;
 
-	std::wstring copy(th->text);
+	for (const auto &edit : edits)
+	{
+		const auto lowerPath = Lower(edit.path);
+		const auto match = std::find(lowerTokens.begin(), lowerTokens.end(), lowerPath);
 
-	*g_stacktop = th->next;
-	GlobalFree((HGLOBAL)th);
+		if (PathEdit::Operation::Add == edit.operation)
+		{
+			if (lowerTokens.end() == match)
+			{
+				pathTokens.push_back(edit.path);
+				lowerTokens.push_back(lowerPath);
+				updatedPath = true;
+			}
+		}
+		else if (lowerTokens.end() != match)
+		{
+			pathTokens.erase(pathTokens.begin() + std::distance(lowerTokens.begin(), match));
+			lowerTokens.erase(match);
+			updatedPath = true;
+		}
+	}
 
-	return copy;
+	if (updatedPath)
+	{
+		pathRegKey->writeValue(pathValName, common::string::Join(pathTokens, L";"), ValueStringType::ExpandableString);
+		pathRegKey->flush();
+	}
+
+	return updatedPath;
 }
 
-std::vector<std::wstring>::const_iterator FindSysPath(const std::vector<std::wstring> &pathTokens, const std::wstring &path)
+//
+// Notify top-level windows that the environment changed.
+//
+// The timeout applies to each window, and hung windows are skipped, so a
+// misbehaving application cannot stall the installer. A timeout is not an
+// error since the change has already been persisted.
+//
+void BroadcastEnvironmentChange()
 {
-	const std::wstring lowerPath = Lower(path);
+	DWORD_PTR result;
 
-	return std::find_if(
-		pathTokens.begin(),
-		pathTokens.end(),
-		[&lowerPath](const std::wstring &elem)
+	const auto status = SendMessageTimeoutW(HWND_BROADCAST, WM_SETTINGCHANGE, 0,
+		(LPARAM)L"Environment", SMTO_ABORTIFHUNG, messageTimeoutInterval, &result);
+
+	if (0 == status)
+	{
+		const auto error = GetLastError();
+
+		if (ERROR_SUCCESS != error && ERROR_TIMEOUT != error)
 		{
-			return Lower(elem).compare(lowerPath) == 0;
+			THROW_WINDOWS_ERROR(error, "SendMessageTimeoutW");
 		}
-	);
-}
-
-bool SysPathExists(const std::wstring &allPaths, const std::wstring &pathToFind)
-{
-	auto pathTokens = common::string::Tokenize(allPaths, L";");
-	return FindSysPath(pathTokens, pathToFind) != pathTokens.end();
+	}
 }
 
-std::wstring ReadPathValue(const RegistryKey &pathKey)
+void UpdateSysEnvPath(const std::vector<PathEdit> &edits)
 {
-	// Some applications will replace the PATH value with a regular string;
-	// use this type as a fallback.
-	try
+	if (ApplyPathEdits(edits))
 	{
-		return pathKey.readString(pathValName, ValueStringType::ExpandableString);
-	}
-	catch (const std::exception &)
-	{
-		return pathKey.readString(pathValName, ValueStringType::RegularString);
+		BroadcastEnvironmentChange();
 	}
 }
 
@@ -112,50 +182,7 @@ void __declspec(dllexport) NSISCALL AddSysEnvPath
 
 	try
 	{
-		{
-			const auto pathToAppend = PopString();
-			auto pathRegKey = Registry::OpenKey(
-				HKEY_LOCAL_MACHINE,
-				pathKeyName,
-				true,
-				RegistryView::Force64
-			);
-			std::wstring path = ReadPathValue(*pathRegKey);
-
-			if (SysPathExists(path, pathToAppend))
-			{
-				pushstring(L"");
-				pushint(NsisStatus::SUCCESS);
-				return;
-			}
-
-			if (!path.empty())
-			{
-				path.append(L";");
-			}
-			path.append(pathToAppend);
-
-			pathRegKey->writeValue(pathValName, path, ValueStringType::ExpandableString);
-			pathRegKey->flush();
-		}
-
-		DWORD result;
-
-		auto status = SendMessageTimeoutA(HWND_BROADCAST, WM_SETTINGCHANGE,	0,
-			(LPARAM)"Environment", SMTO_ABORTIFHUNG, messageTimeoutInterval, &result);
-
-		if (0 == status)
-		{
-			THROW_WINDOWS_ERROR(GetLastError(), "SendMessageTimeoutA");
-		}
-
-		status = SendMessageTimeoutW(HWND_BROADCAST, WM_SETTINGCHANGE, 0,
-			(LPARAM)L"Environment", SMTO_ABORTIFHUNG, messageTimeoutInterval, &result);
-
-		if (0 == status)
-		{
-			THROW_WINDOWS_ERROR(GetLastError(), "SendMessageTimeoutW");
-		}
+		UpdateSysEnvPath({ PathEdit{ PathEdit::Operation::Add, nsis::PopString() } });
 
 		pushstring(L"");
 		pushint(NsisStatus::SUCCESS);
@@ -197,52 +224,73 @@ void __declspec(dllexport) NSISCALL RemoveSysEnvPath
 
 	try
 	{
-		const auto pathToRemove = PopString();
+		UpdateSysEnvPath({ PathEdit{ PathEdit::Operation::Remove, nsis::PopString() } });
 
-		bool updatedPath = false;
+		pushstring(L"");
+		pushint(NsisStatus::SUCCESS);
+	}
+	catch (const std::exception &err)
+	{
+		pushstring(common::string::ToWide(err.what()).c_str());
+		pushint(NsisStatus::GENERAL_ERROR);
+	}
+	catch (...)
+	{
+		pushstring(L"Unspecified error");
+		pushint(NsisStatus::GENERAL_ERROR);
+	}
+}
 
-		{
-			auto pathRegKey = Registry::OpenKey(
-				HKEY_LOCAL_MACHINE,
-				pathKeyName,
-				true,
-				RegistryView::Force64
-			);
-			std::wstring path = ReadPathValue(*pathRegKey);
-
-			// remove value if it exists in PATH
-			auto pathTokens = common::string::Tokenize(path, L";");
-			auto match = FindSysPath(pathTokens, pathToRemove);
-			if (match != pathTokens.end())
-			{
-				pathTokens.erase(match);
-				path = common::string::Join(pathTokens, L";");
-				pathRegKey->writeValue(pathValName, path, ValueStringType::ExpandableString);
-				updatedPath = true;
-			}
-		}
+//
+// EditSysEnvPath count "edit" ...
+//
+// Applies several edits to the system PATH environment variable
+// and notifies other applications once.
+//
+// Each edit is a path prefixed with "+" to add it, or "-" to remove it.
+// Adding a path that exists, or removing one that doesn't, does nothing.
+//
+// Example usage:
+//
+// EditSysEnvPath 2 "+C:\path\to\new" "-C:\path\to\old"
+//
 
-		if (updatedPath)
-		{
-			DWORD result;
+void __declspec(dllexport) NSISCALL EditSysEnvPath
+(
+	HWND hwndParent,
+	int string_size,
+	LPTSTR variables,
+	stack_t **stacktop,
+	extra_parameters *extra,
+	...
+)
+{
+	EXDLL_INIT();
 
-			auto status = SendMessageTimeoutA(HWND_BROADCAST, WM_SETTINGCHANGE, 0,
-				(LPARAM)"Environment", SMTO_ABORTIFHUNG, messageTimeoutInterval, &result);
+	try
+	{
+		const auto count = common::string::LexicalCast<size_t>(nsis::PopString());
 
-			if (0 == status)
-			{
-				THROW_WINDOWS_ERROR(GetLastError(), "SendMessageTimeoutA");
-			}
+		std::vector<PathEdit> edits;
+		edits.reserve(count);
 
-			status = SendMessageTimeoutW(HWND_BROADCAST, WM_SETTINGCHANGE, 0,
-				(LPARAM)L"Environment", SMTO_ABORTIFHUNG, messageTimeoutInterval, &result);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto edit = nsis::PopString();
 
-			if (0 == status)
+			if (edit.size() < 2 || (L'+' != edit[0] && L'-' != edit[0]))
 			{
-				THROW_WINDOWS_ERROR(GetLastError(), "SendMessageTimeoutW");
+				THROW_ERROR("Invalid PATH edit. Expected \"+path\" or \"-path\"");
 			}
+
+			edits.push_back(PathEdit{
+				L'+' == edit[0] ? PathEdit::Operation::Add : PathEdit::Operation::Remove,
+				edit.substr(1)
+			});
 		}
 
+		UpdateSysEnvPath(edits);
+
 		pushstring(L"");
 		pushint(NsisStatus::SUCCESS);
 	}
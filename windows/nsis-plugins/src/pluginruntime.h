@@ -0,0 +1,139 @@
+#pragma once
+
+//
+// Helpers shared by all NSIS plugins.
+//
+// Include after <nsis/pluginapi.h>.
+//
+
+#include <libcommon/error.h>
+#include <windows.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace nsis
+{
+
+//
+// NSIS functions popstring() and popstringn() require that you definitely size the buffer
+// before popping the string. Let's do it ourselves instead.
+//
+// The string is assigned to the caller's buffer, so a buffer that is kept
+// around is reused across calls.
+//
+inline void PopString(std::wstring &buffer)
+{
+	if (!g_stacktop || !*g_stacktop)
+	{
+		THROW_ERROR("NSIS variable stack is corrupted");
+	}
+
+	stack_t *th = *g_stacktop;
+
+	buffer.assign(th->text);
+
+	*g_stacktop = th->next;
+	GlobalFree((HGLOBAL)th);
+}
+
+inline std::wstring PopString()
+{
+	std::wstring value;
+
+	PopString(value);
+
+	return value;
+}
+
+//
+// Apparently NSIS loads and unloads the plugin module for EVERY call it makes to the plugin.
+// This makes it kind of difficult to maintain state.
+//
+// NSIS also sometimes frees a plugin module more times than it loads it, so
+// rather than incrementing the reference count, the module is pinned for the
+// lifetime of the process.
+//
+inline void PinDll()
+{
+	HMODULE self = nullptr;
+
+	if (FALSE == GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+		reinterpret_cast<LPCWSTR>(&PinDll), &self))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Failed to pin plugin module");
+	}
+}
+
+//
+// Run an operation on a worker thread, but stop waiting for it after 'timeout'.
+// Returns false if the operation did not complete in time. Exceptions thrown by
+// the operation are rethrown.
+//
+// On timeout, the flag passed to the operation is set, and the worker is abandoned.
+// An abandoned operation keeps running until it returns, so it must own everything
+// it uses. The module is pinned, so the code remains loaded.
+//
+using CancellableOperation = std::function<void(const std::atomic_bool &cancelled)>;
+
+inline bool RunWithDeadline(std::chrono::milliseconds timeout, CancellableOperation operation)
+{
+	PinDll();
+
+	struct State
+	{
+		std::mutex mutex;
+		std::condition_variable completed;
+		bool done = false;
+		std::exception_ptr error;
+		std::atomic_bool cancelled = false;
+	};
+
+	auto state = std::make_shared<State>();
+
+	std::thread([state, operation = std::move(operation)]()
+	{
+		std::exception_ptr error;
+
+		try
+		{
+			operation(state->cancelled);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		{
+			std::scoped_lock<std::mutex> lock(state->mutex);
+
+			state->error = error;
+			state->done = true;
+		}
+
+		state->completed.notify_all();
+	}).detach();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+
+	if (false == state->completed.wait_for(lock, timeout, [&state]() { return state->done; }))
+	{
+		state->cancelled = true;
+		return false;
+	}
+
+	if (state->error)
+	{
+		std::rethrow_exception(state->error);
+	}
+
+	return true;
+}
+
+}
@@ -3,34 +3,157 @@
 #include <windows.h>
 #include <libcommon/string.h>
 #include <libcommon/error.h>
+#include <libcommon/memory.h>
 #include <libcommon/registry/registry.h>
 #include <libcommon/registry/registrypath.h>
 #include <nsis/pluginapi.h>
+#include "../pluginruntime.h"
+#include <ktmw32.h>
 #include <string>
 
 namespace
 {
 
-std::wstring PopString()
+const REGSAM VIEW = KEY_WOW64_64KEY;
+
+//
+// Both subkeys are below the same parent key.
+//
+bool SameParent(HKEY sourceRoot, const std::wstring &source, HKEY destinationRoot, const std::wstring &destination)
+{
+	if (sourceRoot != destinationRoot)
+	{
+		return false;
+	}
+
+	const auto sourceSeparator = source.find_last_of(L'\\');
+	const auto destinationSeparator = destination.find_last_of(L'\\');
+
+	if (std::wstring::npos == sourceSeparator || sourceSeparator != destinationSeparator)
+	{
+		return false;
+	}
+
+	return 0 == _wcsnicmp(source.c_str(), destination.c_str(), sourceSeparator);
+}
+
+bool TryRenameKey(HANDLE transaction, HKEY root, const std::wstring &source, const std::wstring &destination)
+{
+	const auto separator = source.find_last_of(L'\\');
+
+	HKEY parent;
+
+	if (ERROR_SUCCESS != RegOpenKeyTransactedW(root, source.substr(0, separator).c_str(), 0,
+		KEY_WRITE | VIEW, &parent, transaction, nullptr))
+	{
+		return false;
+	}
+
+	const auto status = RegRenameKey(parent, source.substr(separator + 1).c_str(),
+		destination.substr(separator + 1).c_str());
+
+	RegCloseKey(parent);
+
+	return ERROR_SUCCESS == status;
+}
+
+void CopyAndDeleteTree(HANDLE transaction, HKEY sourceRoot, const std::wstring &source,
+	HKEY destinationRoot, const std::wstring &destination)
 {
+	common::memory::ScopeDestructor sd;
+
+	HKEY sourceKey;
+
+	auto status = RegOpenKeyTransactedW(sourceRoot, source.c_str(), 0, KEY_READ | DELETE | VIEW,
+		&sourceKey, transaction, nullptr);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Open source registry key");
+	}
+
+	sd += [sourceKey]()
+	{
+		RegCloseKey(sourceKey);
+	};
+
+	HKEY destinationKey;
+
+	status = RegCreateKeyTransactedW(destinationRoot, destination.c_str(), 0, nullptr, REG_OPTION_NON_VOLATILE,
+		KEY_ALL_ACCESS | VIEW, nullptr, &destinationKey, nullptr, transaction, nullptr);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Create destination registry key");
+	}
+
+	sd += [destinationKey]()
+	{
+		RegCloseKey(destinationKey);
+	};
+
+	status = RegCopyTreeW(sourceKey, nullptr, destinationKey);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Copy registry tree");
+	}
+
 	//
-	// NSIS functions popstring() and popstringn() require that you definitely size the buffer
-	// before popping the string. Let's do it ourselves instead.
+	// This only deletes the values and subkeys, so delete the key itself afterwards.
 	//
+	status = RegDeleteTreeW(sourceKey, nullptr);
 
-	if (!g_stacktop || !*g_stacktop)
+	if (ERROR_SUCCESS != status)
 	{
-		THROW_ERROR("NSIS variable stack is corrupted");
+		THROW_WINDOWS_ERROR(status, "Delete source registry tree");
 	}
 
-	stack_t *th = *g_stacktop;
+	status = RegDeleteKeyTransactedW(sourceRoot, source.c_str(), VIEW, 0, transaction, nullptr);
 
-	std::wstring copy(th->text);
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Delete source registry key");
+	}
+}
 
-	*g_stacktop = th->next;
-	GlobalFree((HGLOBAL)th);
+//
+// Move the tree in a kernel transaction, so it's never half moved.
+// Keys that share a parent are renamed, rather than copied.
+//
+// Returns false if transactions are unavailable.
+//
+bool MoveKeyTransacted(HKEY sourceRoot, const std::wstring &source, HKEY destinationRoot, const std::wstring &destination)
+{
+	const auto transaction = CreateTransaction(nullptr, nullptr, 0, 0, 0, 0, nullptr);
+
+	if (INVALID_HANDLE_VALUE == transaction)
+	{
+		return false;
+	}
+
+	//
+	// Closing the transaction without committing it rolls it back.
+	//
+	common::memory::ScopeDestructor sd;
+
+	sd += [transaction]()
+	{
+		CloseHandle(transaction);
+	};
+
+	if (false == SameParent(sourceRoot, source, destinationRoot, destination)
+		|| false == TryRenameKey(transaction, sourceRoot, source, destination))
+	{
+		CopyAndDeleteTree(transaction, sourceRoot, source, destinationRoot, destination);
+	}
+
+	if (FALSE == CommitTransaction(transaction))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Commit registry transaction");
+	}
 
-	return copy;
+	return true;
 }
 
 } // anonymous namespace
@@ -38,7 +161,9 @@ std::wstring PopString()
 //
 // MoveKey "source" "destination"
 //
-// Moves a registry key.
+// Moves a registry key, along with its values and subkeys.
+// Unless kernel transactions are unavailable, the move either completes
+// or leaves both keys as they were.
 //
 // Example usage:
 //
@@ -59,14 +184,18 @@ void __declspec(dllexport) NSISCALL MoveKey
 
 	try
 	{
-		const auto source = PopString();
-		const auto destination = PopString();
+		const auto source = nsis::PopString();
+		const auto destination = nsis::PopString();
 
 		auto typedSource = common::registry::RegistryPath(source);
 		auto typedDestination = common::registry::RegistryPath(destination);
 
-		common::registry::Registry::MoveKey(typedSource.key(), typedSource.subkey(), typedDestination.key(),
-			typedDestination.subkey(), common::registry::RegistryView::Force64);
+		if (false == MoveKeyTransacted(typedSource.key(), typedSource.subkey(), typedDestination.key(),
+			typedDestination.subkey()))
+		{
+			common::registry::Registry::MoveKey(typedSource.key(), typedSource.subkey(), typedDestination.key(),
+				typedDestination.subkey(), common::registry::RegistryView::Force64);
+		}
 
 		pushstring(L"");
 		pushint(NsisStatus::SUCCESS);
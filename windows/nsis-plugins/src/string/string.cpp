@@ -9,32 +9,7 @@
 #include <nsis/pluginapi.h>
 #pragma warning (pop)
 
-namespace
-{
-
-std::wstring PopString()
-{
-	//
-	// NSIS functions popstring() and popstringn() require that you definitely size the buffer
-	// before popping the string. Let's do it ourselves instead.
-	//
-
-	if (!g_stacktop || !*g_stacktop)
-	{
-		THROW_ERROR("NSIS variable stack is corrupted");
-	}
-
-	stack_t *th = *g_stacktop;
-
-	std::wstring copy(th->text);
-
-	*g_stacktop = th->next;
-	GlobalFree((HGLOBAL)th);
-
-	return copy;
-}
-
-} // anonymous namespace
+#include "../pluginruntime.h"
 
 //
 // Find "string" "substring" begin_offset
@@ -57,8 +32,8 @@ void __declspec(dllexport) NSISCALL Find
 
 	try
 	{
-		const auto searchString = PopString();
-		const auto substring = PopString();
+		const auto searchString = nsis::PopString();
+		const auto substring = nsis::PopString();
 		const auto offset = popint();
 		const auto position = searchString.find(substring, offset);
 
@@ -137,7 +137,9 @@ void __declspec(dllexport) NSISCALL PromoteTrayIcon
 
 		auto regkey = common::registry::Registry::OpenKey(HKEY_CURRENT_USER, keyName, true);
 
-		TrayParser parser(regkey->readBinaryBlob(valueName));
+		auto blob = regkey->readBinaryBlob(valueName);
+
+		TrayParser parser(blob);
 
 		TrayJuggler juggler(parser);
 
@@ -151,7 +153,7 @@ void __declspec(dllexport) NSISCALL PromoteTrayIcon
 			}
 			else
 			{
-				juggler.promoteRecord(mullvadRecord);
+				juggler.promoteRecord(*mullvadRecord);
 			}
 		}
 		else
@@ -5,16 +5,6 @@
 namespace
 {
 
-template<typename T>
-void AppendBuffer(std::vector<uint8_t> &buffer, const T &t)
-{
-	const auto prevSize = buffer.size();
-
-	buffer.resize(prevSize + sizeof(T));
-
-	memcpy(&buffer[prevSize], &t, sizeof(T));
-}
-
 inline wchar_t rot13(wchar_t c)
 {
 	if (c >= L'A' && c <= L'Z')
@@ -33,29 +23,40 @@ inline wchar_t rot13(wchar_t c)
 
 } // anonymous namespace
 
-TrayJuggler::TrayJuggler(const TrayParser &parser)
+TrayJuggler::TrayJuggler(TrayParser &parser)
+	: m_parser(parser)
 {
-	m_header = parser.getHeader();
-
-	for (const auto &record : parser.getRecords())
-	{
-		m_records.push_back(std::make_shared<ICON_STREAMS_RECORD>(record));
-	}
 }
 
-std::shared_ptr<ICON_STREAMS_RECORD> TrayJuggler::findRecord(const std::wstring &path) const
+ICON_STREAMS_RECORD *TrayJuggler::findRecord(const std::wstring &path)
 {
-	for (const auto &record : m_records)
+	//
+	// The encoding is its own inverse, so encode the search string once instead.
+	//
+	std::wstring encodedPath(path);
+
+	std::transform(encodedPath.begin(), encodedPath.end(), encodedPath.begin(), rot13);
+
+	for (size_t i = 0; i < m_parser.getNumberRecords(); ++i)
 	{
-		const auto appPath = DecodeString(record->ApplicationPath, sizeof(record->ApplicationPath));
+		auto &record = m_parser.getRecord(i);
 
-		if (nullptr != wcsstr(appPath.c_str(), path.c_str()))
+		const auto begin = record.ApplicationPath;
+		const auto end = std::find(begin, begin + _countof(record.ApplicationPath), uint16_t(0));
+
+		const auto match = std::search(begin, end, encodedPath.begin(), encodedPath.end(),
+			[](uint16_t lhs, wchar_t rhs)
+		{
+			return lhs == static_cast<uint16_t>(rhs);
+		});
+
+		if (end != match || encodedPath.empty())
 		{
-			return record;
+			return &record;
 		}
 	}
 
-	return std::shared_ptr<ICON_STREAMS_RECORD>();
+	return nullptr;
 }
 
 uint32_t TrayJuggler::getNextFreeOrdinal(TraySearchGroup searchGroup) const
@@ -64,16 +65,16 @@ uint32_t TrayJuggler::getNextFreeOrdinal(TraySearchGroup searchGroup) const
 
 	bool noMatchingRecord = true;
 
-	enumerateRecords([&](std::shared_ptr<ICON_STREAMS_RECORD> record)
+	enumerateRecords([&](const ICON_STREAMS_RECORD &record)
 	{
-		if ((TraySearchGroup::Visible == searchGroup && ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS == record->Visibility)
-			|| (TraySearchGroup::Hidden == searchGroup) && ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS != record->Visibility)
+		if ((TraySearchGroup::Visible == searchGroup && ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS == record.Visibility)
+			|| (TraySearchGroup::Hidden == searchGroup) && ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS != record.Visibility)
 		{
 			noMatchingRecord = false;
 
-			if (record->Ordinal > highestOrdinal)
+			if (record.Ordinal > highestOrdinal)
 			{
-				highestOrdinal = record->Ordinal;
+				highestOrdinal = record.Ordinal;
 			}
 		}
 
@@ -90,29 +91,29 @@ void TrayJuggler::injectRecord(const ICON_STREAMS_RECORD &record)
 
 	GetSystemTime(&time);
 
-	auto newRecord = std::make_shared<ICON_STREAMS_RECORD>(record);
+	ICON_STREAMS_RECORD newRecord(record);
 
 	{
-		newRecord->Visibility = ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS;
+		newRecord.Visibility = ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS;
 
-		newRecord->YearCreated = time.wYear;
-		newRecord->MonthCreated = time.wMonth;
+		newRecord.YearCreated = time.wYear;
+		newRecord.MonthCreated = time.wMonth;
 
 		// TODO: Meaning of this bool?
-		newRecord->u7 = 0;
+		newRecord.u7 = 0;
 
-		newRecord->ImagelistId = 0xFFFFFFFF;
+		newRecord.ImagelistId = 0xFFFFFFFF;
 
 		FILETIME fileTime;
 
 		SystemTimeToFileTime(&time, &fileTime);
 
-		newRecord->Time1 = fileTime;
+		newRecord.Time1 = fileTime;
 
-		newRecord->Time2.dwHighDateTime = 0;
-		newRecord->Time2.dwLowDateTime = 0;
+		newRecord.Time2.dwHighDateTime = 0;
+		newRecord.Time2.dwLowDateTime = 0;
 
-		newRecord->Ordinal = getNextFreeOrdinal(TraySearchGroup::Visible);
+		newRecord.Ordinal = getNextFreeOrdinal(TraySearchGroup::Visible);
 	}
 
 	//
@@ -129,19 +130,19 @@ void TrayJuggler::injectRecord(const ICON_STREAMS_RECORD &record)
 	// Insert new record at the end.
 	//
 
-	m_records.push_back(newRecord);
+	m_parser.appendRecord(newRecord);
 }
 
-void TrayJuggler::promoteRecord(std::shared_ptr<ICON_STREAMS_RECORD> record)
+void TrayJuggler::promoteRecord(ICON_STREAMS_RECORD &record)
 {
-	if (ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS == record->Visibility)
+	if (ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS == record.Visibility)
 	{
 		// Abort if the icon is already visible.
 		return;
 	}
 
-	record->Visibility = ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS;
-	record->Ordinal = getNextFreeOrdinal(TraySearchGroup::Visible);
+	record.Visibility = ICON_STREAMS_VISIBILITY::SHOW_ICON_AND_NOTIFICATIONS;
+	record.Ordinal = getNextFreeOrdinal(TraySearchGroup::Visible);
 
 	SYSTEMTIME time;
 
@@ -151,14 +152,14 @@ void TrayJuggler::promoteRecord(std::shared_ptr<ICON_STREAMS_RECORD> record)
 
 	SystemTimeToFileTime(&time, &fileTime);
 
-	record->Time1 = fileTime;
+	record.Time1 = fileTime;
 }
 
-bool TrayJuggler::enumerateRecords(std::function<bool(std::shared_ptr<ICON_STREAMS_RECORD> record)> callback) const
+bool TrayJuggler::enumerateRecords(std::function<bool(const ICON_STREAMS_RECORD &record)> callback) const
 {
-	for (auto record : m_records)
+	for (size_t i = 0; i < m_parser.getNumberRecords(); ++i)
 	{
-		if (false == callback(record))
+		if (false == callback(m_parser.getRecord(i)))
 		{
 			return false;
 		}
@@ -167,30 +168,9 @@ bool TrayJuggler::enumerateRecords(std::function<bool(std::shared_ptr<ICON_STREA
 	return true;
 }
 
-std::vector<uint8_t> TrayJuggler::pack() const
+const std::vector<uint8_t> &TrayJuggler::pack() const
 {
-	std::vector<uint8_t> blob;
-
-	const auto requiredSize = (m_records.size() * sizeof(ICON_STREAMS_RECORD))
-		+ sizeof(ICON_STREAMS_HEADER);
-
-	blob.reserve(requiredSize);
-
-	// Use original header as a template.
-	ICON_STREAMS_HEADER header = m_header;
-
-	header.HeaderSize = sizeof(header);
-	header.NumberRecords = static_cast<uint32_t>(m_records.size());
-	header.OffsetFirstRecord = sizeof(header);
-
-	AppendBuffer(blob, header);
-
-	for (const auto record : m_records)
-	{
-		AppendBuffer(blob, *record);
-	}
-
-	return blob;
+	return m_parser.getBlob();
 }
 
 //static
@@ -4,19 +4,25 @@
 #include "trayparser.h"
 #include <cstdint>
 #include <vector>
-#include <memory>
 #include <string>
 #include <functional>
-#include <list>
 
+//
+// Operates on the records of an IconStreams blob in place.
+//
+// Returned record pointers are invalidated by injectRecord().
+//
 class TrayJuggler
 {
 public:
 
-	TrayJuggler(const TrayParser &parser);
+	TrayJuggler(TrayParser &parser);
 
+	//
 	// Find record based on substring present in record's application path.
-	std::shared_ptr<ICON_STREAMS_RECORD> findRecord(const std::wstring &path) const;
+	// Records are searched as stored, without decoding or copying them.
+	//
+	ICON_STREAMS_RECORD *findRecord(const std::wstring &path);
 
 	enum class TraySearchGroup
 	{
@@ -36,23 +42,20 @@ public:
 	// Update and promote existing record.
 	// The icon will be displayed in the rightmost position.
 	//
-	void promoteRecord(std::shared_ptr<ICON_STREAMS_RECORD> record);
+	void promoteRecord(ICON_STREAMS_RECORD &record);
 	
-	bool enumerateRecords(std::function<bool(std::shared_ptr<ICON_STREAMS_RECORD> record)> callback) const;
+	bool enumerateRecords(std::function<bool(const ICON_STREAMS_RECORD &record)> callback) const;
 
-	// Generate a valid stream including header.
-	std::vector<uint8_t> pack() const;
+	//
+	// Get the updated stream including header.
+	// All updates have already been applied to the original blob, so this
+	// does not involve a copy.
+	//
+	const std::vector<uint8_t> &pack() const;
 
 	static std::wstring DecodeString(const uint16_t *encoded, size_t bufferSize);
 
 private:
 
-	//
-	// This is the original header.
-	// We keep it around to be able to preserve the values for
-	// the unknown fields.
-	//
-	ICON_STREAMS_HEADER m_header;
-
-	std::list<std::shared_ptr<ICON_STREAMS_RECORD> > m_records;
+	TrayParser &m_parser;
 };
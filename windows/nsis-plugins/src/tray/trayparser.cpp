@@ -1,9 +1,9 @@
 #include "stdafx.h"
 #include "trayparser.h"
 #include <libcommon/error.h>
-#include <algorithm>
 
-TrayParser::TrayParser(const std::vector<uint8_t> &blob)
+TrayParser::TrayParser(std::vector<uint8_t> &blob)
+	: m_blob(blob)
 {
 	if (blob.size() < sizeof(ICON_STREAMS_HEADER))
 	{
@@ -17,10 +17,13 @@ TrayParser::TrayParser(const std::vector<uint8_t> &blob)
 		THROW_ERROR("Invalid icon streams header - size mismatch");
 	}
 
-	memcpy(&m_header, header, sizeof(ICON_STREAMS_HEADER));
-
 	if (0 == header->NumberRecords)
 	{
+		//
+		// Records will be appended immediately after the header.
+		//
+		mutableHeader().OffsetFirstRecord = static_cast<uint32_t>(blob.size());
+
 		return;
 	}
 
@@ -49,25 +52,52 @@ TrayParser::TrayParser(const std::vector<uint8_t> &blob)
 	{
 		THROW_ERROR("Invalid icon streams - size mismatch");
 	}
+}
 
-	//
-	// Size checks out.
-	//
+const ICON_STREAMS_HEADER &TrayParser::getHeader() const
+{
+	return *reinterpret_cast<const ICON_STREAMS_HEADER *>(&m_blob[0]);
+}
 
-	m_records.reserve(header->NumberRecords);
+size_t TrayParser::getNumberRecords() const
+{
+	return getHeader().NumberRecords;
+}
 
-	auto begin = reinterpret_cast<const ICON_STREAMS_RECORD *>(&blob[0] + header->OffsetFirstRecord);
-	auto end = reinterpret_cast<const ICON_STREAMS_RECORD *>(&blob[0] + blob.size());
+ICON_STREAMS_RECORD &TrayParser::getRecord(size_t index)
+{
+	const auto offset = getHeader().OffsetFirstRecord + (index * sizeof(ICON_STREAMS_RECORD));
 
-	std::copy(begin, end, std::back_inserter(m_records));
+	return *reinterpret_cast<ICON_STREAMS_RECORD *>(&m_blob[offset]);
 }
 
-const ICON_STREAMS_HEADER &TrayParser::getHeader() const
+const ICON_STREAMS_RECORD &TrayParser::getRecord(size_t index) const
+{
+	const auto offset = getHeader().OffsetFirstRecord + (index * sizeof(ICON_STREAMS_RECORD));
+
+	return *reinterpret_cast<const ICON_STREAMS_RECORD *>(&m_blob[offset]);
+}
+
+size_t TrayParser::appendRecord(const ICON_STREAMS_RECORD &record)
+{
+	const auto index = getNumberRecords();
+	const auto offset = m_blob.size();
+
+	m_blob.resize(offset + sizeof(ICON_STREAMS_RECORD));
+
+	memcpy(&m_blob[offset], &record, sizeof(ICON_STREAMS_RECORD));
+
+	++mutableHeader().NumberRecords;
+
+	return index;
+}
+
+const std::vector<uint8_t> &TrayParser::getBlob() const
 {
-	return m_header;
+	return m_blob;
 }
 
-const std::vector<ICON_STREAMS_RECORD> &TrayParser::getRecords() const
+ICON_STREAMS_HEADER &TrayParser::mutableHeader()
 {
-	return m_records;
+	return *reinterpret_cast<ICON_STREAMS_HEADER *>(&m_blob[0]);
 }
@@ -3,20 +3,40 @@
 #include "iconstreams.h"
 #include <cstdint>
 #include <vector>
-#include <memory>
 
+//
+// View over an IconStreams blob.
+//
+// The blob is validated once and then accessed in place. Records are not
+// copied out of the buffer, and updates made through the view are applied
+// directly to the blob.
+//
+// References to records are invalidated when a record is appended.
+//
 class TrayParser
 {
 public:
 
-	TrayParser(const std::vector<uint8_t> &blob);
+	TrayParser(std::vector<uint8_t> &blob);
 
 	const ICON_STREAMS_HEADER &getHeader() const;
 
-	const std::vector<ICON_STREAMS_RECORD> &getRecords() const;
+	size_t getNumberRecords() const;
+
+	ICON_STREAMS_RECORD &getRecord(size_t index);
+	const ICON_STREAMS_RECORD &getRecord(size_t index) const;
+
+	//
+	// Append record at the end of the blob and update the header.
+	// Returns the index of the new record.
+	//
+	size_t appendRecord(const ICON_STREAMS_RECORD &record);
+
+	const std::vector<uint8_t> &getBlob() const;
 
 private:
 
-	ICON_STREAMS_HEADER m_header;
-	std::vector<ICON_STREAMS_RECORD> m_records;
+	ICON_STREAMS_HEADER &mutableHeader();
+
+	std::vector<uint8_t> &m_blob;
 };
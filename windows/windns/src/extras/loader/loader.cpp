@@ -6,31 +6,196 @@
 #include <iostream>
 #include <conio.h>
 #include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <memory>
 #include <windows.h>
 
-int main()
+namespace
 {
-	common::trace::Trace::RegisterSink(new common::trace::ConsoleTraceSink);
 
-	std::wcout << L"WinDns_Initialize: " << std::boolalpha << WinDns_Initialize(shared::logging::StdoutLogger, nullptr) << std::endl;
+const wchar_t *g_Ipv4Servers[] =
+{
+	L"8.8.8.8",
+	L"8.8.4.4"
+};
 
-	const wchar_t *servers[] =
-	{
-		L"8.8.8.8",
-		L"8.8.4.4"
-	};
+const wchar_t *g_Ipv6Servers[] =
+{
+	L"2001:4860:4860::8888",
+	L"2001:4860:4860::8844"
+};
 
-	const wchar_t *v6Servers[] =
+//
+// Forward only errors, so they're not drowned out during benchmarks.
+// The context is a BufferedStdoutLogger, which is flushed between measurements.
+//
+void __stdcall ErrorLogger(MULLVAD_LOG_LEVEL level, const char *msg, void *context)
+{
+	if (MULLVAD_LOG_LEVEL_ERROR == level)
 	{
-		L"2001:4860:4860::8888",
-		L"2001:4860:4860::8844"
-	};
+		shared::logging::BufferedStdoutLogger::Sink(level, msg, context);
+	}
+}
+
+void SmokeTest(const std::wstring &alias)
+{
+	std::wcout << L"WinDns_Initialize: " << std::boolalpha
+		<< WinDns_Initialize(shared::logging::StdoutLogger, nullptr, WINDNS_BACKEND_AUTO, nullptr) << std::endl;
 
-	auto status = WinDns_Set(L"Wi-Fi", servers, _countof(servers), v6Servers, _countof(v6Servers));
+	auto status = WinDns_Set(alias.c_str(), g_Ipv4Servers, _countof(g_Ipv4Servers),
+		g_Ipv6Servers, _countof(g_Ipv6Servers));
 
 	std::wcout << L"WinDns_Set: " << std::boolalpha << status << std::endl;
 
 	std::wcout << L"WinDns_Deinitialize: " << std::boolalpha << WinDns_Deinitialize() << std::endl;
+}
+
+double Percentile(const std::vector<double> &sorted, double percentile)
+{
+	const auto index = static_cast<size_t>((percentile / 100.0) * (sorted.size() - 1) + 0.5);
+
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void PrintLatencies(const wchar_t *operation, std::vector<double> &samples)
+{
+	if (samples.empty())
+	{
+		std::wcout << L"  " << operation << L": no samples" << std::endl;
+		return;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	std::wcout << L"  " << operation
+		<< L": p50 " << Percentile(samples, 50)
+		<< L" ms, p90 " << Percentile(samples, 90)
+		<< L" ms, p99 " << Percentile(samples, 99)
+		<< L" ms, max " << samples.back()
+		<< L" ms" << std::endl;
+}
+
+template<typename T>
+bool Measure(std::vector<double> &samples, T &&operation)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	const auto status = operation();
+
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (status)
+	{
+		samples.push_back(elapsed.count());
+	}
+
+	return status;
+}
+
+//
+// Alternate between static servers and DHCP so every call updates the adapter.
+//
+void Benchmark(const std::wstring &alias, uint32_t iterations, WINDNS_BACKEND backend, const wchar_t *backendName,
+	shared::logging::BufferedStdoutLogger &logger)
+{
+	std::wcout << backendName << L":" << std::endl;
+
+	if (false == WinDns_Initialize(ErrorLogger, &logger, backend, nullptr))
+	{
+		logger.flush();
+		std::wcout << L"  Not available" << std::endl;
+		return;
+	}
+
+	std::vector<double> setLatencies;
+	std::vector<double> revertLatencies;
+	uint32_t failures = 0;
+
+	for (uint32_t i = 0; i < iterations; ++i)
+	{
+		if (false == Measure(setLatencies, [&]()
+		{
+			return WinDns_Set(alias.c_str(), g_Ipv4Servers, _countof(g_Ipv4Servers),
+				g_Ipv6Servers, _countof(g_Ipv6Servers));
+		}))
+		{
+			++failures;
+		}
+
+		if (false == Measure(revertLatencies, [&]()
+		{
+			return WinDns_Set(alias.c_str(), nullptr, 0, nullptr, 0);
+		}))
+		{
+			++failures;
+		}
+
+		logger.flush();
+	}
+
+	PrintLatencies(L"Set", setLatencies);
+	PrintLatencies(L"Revert", revertLatencies);
+
+	if (0 != failures)
+	{
+		std::wcout << L"  Failed operations: " << failures << std::endl;
+	}
+
+	WinDns_Deinitialize();
+
+	logger.flush();
+}
+
+} // anonymous namespace
+
+//
+// Usage:
+//
+// loader [alias]                    Set DNS servers on the adapter once.
+// loader <alias> <iterations>       Benchmark all backends. Original settings are restored afterwards.
+// loader <alias> <iterations> <log> Same as above, with errors written to a file rather than the console.
+//
+int wmain(int argc, wchar_t *argv[])
+{
+	common::trace::Trace::RegisterSink(new common::trace::ConsoleTraceSink);
+
+	const std::wstring alias = (argc > 1 ? argv[1] : L"Wi-Fi");
+
+	if (argc < 3)
+	{
+		SmokeTest(alias);
+		return 0;
+	}
+
+	const auto iterations = static_cast<uint32_t>(_wtoi(argv[2]));
+
+	if (0 == iterations)
+	{
+		std::wcerr << L"Invalid number of iterations" << std::endl;
+		return 1;
+	}
+
+	std::unique_ptr<shared::logging::BufferedStdoutLogger> logger;
+
+	try
+	{
+		logger = (argc > 3
+			? std::make_unique<shared::logging::BufferedStdoutLogger>(argv[3])
+			: std::make_unique<shared::logging::BufferedStdoutLogger>());
+	}
+	catch (const std::exception &err)
+	{
+		std::cout << "Error: " << err.what() << std::endl;
+		return 1;
+	}
+
+	std::wcout << L"Benchmarking " << iterations << L" iterations on \"" << alias << L"\"" << std::endl;
+
+	Benchmark(alias, iterations, WINDNS_BACKEND_NETSH, L"netsh", *logger);
+	Benchmark(alias, iterations, WINDNS_BACKEND_NETSH_PERSISTENT, L"netsh (persistent)", *logger);
+	Benchmark(alias, iterations, WINDNS_BACKEND_NATIVE, L"native", *logger);
 
 	return 0;
 }
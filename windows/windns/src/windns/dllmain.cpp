@@ -1,5 +1,8 @@
 #include "stdafx.h"
 #include <windows.h>
+#include <libshared/tracing/trace.h>
+
+MULLVAD_DEFINE_TRACE_PROVIDER();
 
 BOOL APIENTRY DllMain(HMODULE, DWORD, LPVOID)
 {
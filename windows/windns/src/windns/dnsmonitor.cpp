@@ -0,0 +1,158 @@
+#include "stdafx.h"
+#include "dnsmonitor.h"
+#include "interfacekey.h"
+#include <libcommon/error.h>
+#include <libshared/tracing/trace.h>
+#include <sstream>
+#include <string>
+
+DnsMonitor::DnsMonitor(NET_LUID luid, ChangeSinkType changeSink)
+	: m_changeSink(changeSink)
+	, m_shutdownEvent(nullptr)
+{
+	try
+	{
+		openKeys(luid);
+
+		m_shutdownEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+		if (nullptr == m_shutdownEvent)
+		{
+			THROW_WINDOWS_ERROR(GetLastError(), "Create shutdown event for DNS monitor");
+		}
+
+		m_thread = std::thread(&DnsMonitor::thread, this);
+	}
+	catch (...)
+	{
+		if (nullptr != m_shutdownEvent)
+		{
+			CloseHandle(m_shutdownEvent);
+		}
+
+		closeKeys();
+
+		throw;
+	}
+}
+
+DnsMonitor::~DnsMonitor()
+{
+	SetEvent(m_shutdownEvent);
+
+	m_thread.join();
+
+	CloseHandle(m_shutdownEvent);
+
+	closeKeys();
+}
+
+void DnsMonitor::openKeys(NET_LUID luid)
+{
+	for (const auto family : { AF_INET, AF_INET6 })
+	{
+		const auto path = InterfaceKeyPath(luid, static_cast<ADDRESS_FAMILY>(family));
+
+		HKEY key;
+
+		const auto status = RegOpenKeyExW(HKEY_LOCAL_MACHINE, path.c_str(), 0, KEY_NOTIFY, &key);
+
+		//
+		// The key for a family is missing if the family is not bound to the interface.
+		//
+		if (ERROR_FILE_NOT_FOUND == status)
+		{
+			continue;
+		}
+
+		if (ERROR_SUCCESS != status)
+		{
+			THROW_WINDOWS_ERROR(status, "Open interface registry key");
+		}
+
+		const auto event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+
+		if (nullptr == event)
+		{
+			const auto error = GetLastError();
+
+			RegCloseKey(key);
+
+			THROW_WINDOWS_ERROR(error, "Create registry notification event");
+		}
+
+		m_keys.emplace_back(WatchedKey{ key, event });
+	}
+
+	if (m_keys.empty())
+	{
+		THROW_ERROR("Interface has no TCP/IP configuration in the registry");
+	}
+}
+
+void DnsMonitor::closeKeys()
+{
+	for (const auto &watched : m_keys)
+	{
+		RegCloseKey(watched.key);
+		CloseHandle(watched.event);
+	}
+
+	m_keys.clear();
+}
+
+//static
+bool DnsMonitor::Arm(const WatchedKey &watched)
+{
+	return ERROR_SUCCESS == RegNotifyChangeKeyValue(watched.key, FALSE,
+		REG_NOTIFY_CHANGE_LAST_SET, watched.event, TRUE);
+}
+
+void DnsMonitor::thread()
+{
+	//
+	// Registry notifications are registered from this thread, since on older
+	// systems they are cancelled when the registering thread exits.
+	//
+
+	std::vector<HANDLE> events{ m_shutdownEvent };
+
+	for (const auto &watched : m_keys)
+	{
+		if (false == Arm(watched))
+		{
+			return;
+		}
+
+		events.push_back(watched.event);
+	}
+
+	for (;;)
+	{
+		const auto status = WaitForMultipleObjects(static_cast<DWORD>(events.size()), &events[0], FALSE, INFINITE);
+
+		if (WAIT_OBJECT_0 == status || WAIT_FAILED == status)
+		{
+			return;
+		}
+
+		const auto index = status - WAIT_OBJECT_0 - 1;
+
+		if (index >= m_keys.size() || false == Arm(m_keys[index]))
+		{
+			return;
+		}
+
+		const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordMonitor);
+
+		try
+		{
+			m_changeSink();
+		}
+		catch (...)
+		{
+		}
+
+		shared::tracing::MonitorCallback(stopwatch, "DnsMonitor");
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <functional>
+#include <thread>
+#include <vector>
+
+//
+// Signals changes to the TCP/IP configuration of an interface.
+//
+// Both static and DHCP provided name servers are stored under the interface
+// key for each family, so watching these keys catches every change of the
+// effective servers. It also catches unrelated changes, so it's up to the
+// client to determine whether anything of interest did change.
+//
+class DnsMonitor
+{
+public:
+
+	using ChangeSinkType = std::function<void()>;
+
+	DnsMonitor(NET_LUID luid, ChangeSinkType changeSink);
+	~DnsMonitor();
+
+	DnsMonitor(const DnsMonitor &) = delete;
+	DnsMonitor &operator=(const DnsMonitor &) = delete;
+
+private:
+
+	struct WatchedKey
+	{
+		HKEY key;
+		HANDLE event;
+	};
+
+	ChangeSinkType m_changeSink;
+
+	std::vector<WatchedKey> m_keys;
+	HANDLE m_shutdownEvent;
+
+	std::thread m_thread;
+
+	void openKeys(NET_LUID luid);
+	void closeKeys();
+
+	void thread();
+
+	static bool Arm(const WatchedKey &key);
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//
+// Backend that applies name server settings to an interface.
+//
+// The timeout is advisory and only honored by backends that perform
+// the operation out-of-process.
+//
+struct IDnsConfig
+{
+	virtual ~IDnsConfig() = 0
+	{
+	}
+
+	virtual void setIpv4StaticDns(uint32_t interfaceIndex,
+		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0) = 0;
+
+	virtual void setIpv4DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0) = 0;
+
+	virtual void setIpv6StaticDns(uint32_t interfaceIndex,
+		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0) = 0;
+
+	virtual void setIpv6DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0) = 0;
+};
@@ -0,0 +1,109 @@
+#include "stdafx.h"
+#include "interfacekey.h"
+#include <libcommon/error.h>
+#include <objbase.h>
+#include <sstream>
+
+std::vector<std::wstring> SplitNameServers(const std::wstring &nameServers)
+{
+	std::vector<std::wstring> servers;
+
+	std::wstring current;
+
+	for (const auto c : nameServers)
+	{
+		if (L',' == c || L' ' == c)
+		{
+			if (false == current.empty())
+			{
+				servers.emplace_back(std::move(current));
+				current.clear();
+			}
+
+			continue;
+		}
+
+		current.push_back(c);
+	}
+
+	if (false == current.empty())
+	{
+		servers.emplace_back(std::move(current));
+	}
+
+	return servers;
+}
+
+std::wstring InterfaceKeyPath(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	GUID guid;
+
+	const auto status = ConvertInterfaceLuidToGuid(&luid, &guid);
+
+	if (NO_ERROR != status)
+	{
+		std::stringstream ss;
+
+		ss << "Could not resolve GUID of interface with LUID 0x" << std::hex << luid.Value;
+
+		THROW_WINDOWS_ERROR(status, ss.str().c_str());
+	}
+
+	wchar_t guidString[64];
+
+	if (0 == StringFromGUID2(guid, guidString, _countof(guidString)))
+	{
+		THROW_ERROR("Failed to format interface GUID");
+	}
+
+	const auto parent = (AF_INET == family
+		? L"SYSTEM\\CurrentControlSet\\Services\\Tcpip\\Parameters\\Interfaces\\"
+		: L"SYSTEM\\CurrentControlSet\\Services\\Tcpip6\\Parameters\\Interfaces\\");
+
+	return std::wstring(parent).append(guidString);
+}
+
+std::optional<std::vector<std::wstring>> ReadNameServers(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	const auto path = InterfaceKeyPath(luid, family);
+
+	HKEY key;
+
+	auto status = RegOpenKeyExW(HKEY_LOCAL_MACHINE, path.c_str(), 0, KEY_QUERY_VALUE, &key);
+
+	if (ERROR_FILE_NOT_FOUND == status)
+	{
+		return std::nullopt;
+	}
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Open interface registry key");
+	}
+
+	DWORD size = 0;
+
+	status = RegGetValueW(key, nullptr, L"NameServer", RRF_RT_REG_SZ, nullptr, nullptr, &size);
+
+	if (ERROR_FILE_NOT_FOUND == status)
+	{
+		RegCloseKey(key);
+		return std::vector<std::wstring>();
+	}
+
+	std::vector<wchar_t> buffer((size / sizeof(wchar_t)) + 1, L'\0');
+
+	if (ERROR_SUCCESS == status)
+	{
+		status = RegGetValueW(key, nullptr, L"NameServer", RRF_RT_REG_SZ, nullptr, &buffer[0], &size);
+	}
+
+	RegCloseKey(key);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Read name servers of interface");
+	}
+
+	return SplitNameServers(&buffer[0]);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+//
+// Path, relative to HKLM, of the key that holds the TCP/IP configuration
+// of an interface for a specific family.
+//
+std::wstring InterfaceKeyPath(NET_LUID luid, ADDRESS_FAMILY family);
+
+//
+// Servers in a 'NameServer' value are separated by commas or spaces.
+//
+std::vector<std::wstring> SplitNameServers(const std::wstring &nameServers);
+
+//
+// Servers configured on the interface for the family, as stored in its 'NameServer' value.
+// Returns nothing if the family is not bound to the interface. An empty list means the
+// servers are provided by DHCP.
+//
+std::optional<std::vector<std::wstring>> ReadNameServers(NET_LUID luid, ADDRESS_FAMILY family);
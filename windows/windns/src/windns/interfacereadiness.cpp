@@ -0,0 +1,141 @@
+#include "stdafx.h"
+#include "interfacereadiness.h"
+#include <libcommon/memory.h>
+#include <libshared/network/aliascache.h>
+#include <libshared/performance/counterregistry.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace
+{
+
+struct InterfaceChanges
+{
+	std::mutex lock;
+	std::condition_variable changed;
+	uint64_t generation;
+};
+
+void NETIOAPI_API_ InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *, MIB_NOTIFICATION_TYPE)
+{
+	auto changes = reinterpret_cast<InterfaceChanges *>(context);
+
+	{
+		std::scoped_lock<std::mutex> lock(changes->lock);
+		++changes->generation;
+	}
+
+	changes->changed.notify_all();
+}
+
+bool HasIpInterface(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	MIB_IPINTERFACE_ROW iface;
+
+	InitializeIpInterfaceEntry(&iface);
+
+	iface.InterfaceLuid = luid;
+	iface.Family = family;
+
+	return NO_ERROR == GetIpInterfaceEntry(&iface);
+}
+
+bool InterfaceReady(NET_LUID luid, bool ipv4, bool ipv6)
+{
+	NET_IFINDEX index;
+
+	return NO_ERROR == ConvertInterfaceLuidToIndex(&luid, &index)
+		&& (false == ipv4 || HasIpInterface(luid, AF_INET))
+		&& (false == ipv6 || HasIpInterface(luid, AF_INET6));
+}
+
+bool WaitUntil(const std::function<bool()> &ready, std::chrono::milliseconds timeout)
+{
+	static auto &waits = shared::performance::CounterRegistry::Instance().counter("windns.interface.waits");
+	static auto &timeouts = shared::performance::CounterRegistry::Instance().counter("windns.interface.timeouts");
+
+	if (ready())
+	{
+		return true;
+	}
+
+	waits.increment();
+
+	InterfaceChanges changes;
+
+	changes.generation = 0;
+
+	HANDLE notificationHandle;
+
+	if (NO_ERROR != NotifyIpInterfaceChange(AF_UNSPEC, InterfaceChangeCallback, &changes,
+		FALSE, &notificationHandle))
+	{
+		return ready();
+	}
+
+	//
+	// Cancelling waits for callbacks that are in progress,
+	// so the lock must have been released by then.
+	//
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [notificationHandle]()
+	{
+		CancelMibChangeNotify2(notificationHandle);
+	};
+
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	std::unique_lock<std::mutex> lock(changes.lock);
+
+	for (;;)
+	{
+		//
+		// Changes that happen while evaluating are not missed,
+		// since the generation is read before.
+		//
+
+		const auto generation = changes.generation;
+
+		lock.unlock();
+
+		const auto isReady = ready();
+
+		lock.lock();
+
+		if (isReady)
+		{
+			return true;
+		}
+
+		if (false == changes.changed.wait_until(lock, deadline, [&]() { return generation != changes.generation; }))
+		{
+			timeouts.increment();
+
+			return false;
+		}
+	}
+}
+
+} // anonymous namespace
+
+bool WaitForInterface(NET_LUID luid, bool ipv4, bool ipv6, std::chrono::milliseconds timeout)
+{
+	return WaitUntil([&]()
+	{
+		return InterfaceReady(luid, ipv4, ipv6);
+	}, timeout);
+}
+
+bool WaitForInterface(const std::wstring &alias, bool ipv4, bool ipv6, std::chrono::milliseconds timeout)
+{
+	return WaitUntil([&]()
+	{
+		NET_LUID luid;
+
+		return NO_ERROR == shared::network::InterfaceAliasCache::Instance().resolve(alias, luid)
+			&& InterfaceReady(luid, ipv4, ipv6);
+	}, timeout);
+}
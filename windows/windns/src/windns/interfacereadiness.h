@@ -0,0 +1,28 @@
+#pragma once
+
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <chrono>
+#include <string>
+
+//
+// Waits for an interface to be ready to be configured.
+//
+// An interface is ready once it has an interface index, and an IP interface for
+// each of the requested families. Interfaces that were just created may take a
+// moment to get there, which would otherwise make the configuration fail.
+//
+// Readiness is evaluated again each time an IP interface changes, so there is no
+// polling. Ready interfaces are not waited for at all.
+//
+// Returns false if the interface wasn't ready before the timeout.
+//
+bool WaitForInterface(NET_LUID luid, bool ipv4, bool ipv6, std::chrono::milliseconds timeout);
+
+//
+// Also waits for the alias to resolve, if no interface has it yet.
+//
+bool WaitForInterface(const std::wstring &alias, bool ipv4, bool ipv6, std::chrono::milliseconds timeout);
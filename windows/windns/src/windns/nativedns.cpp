@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "nativedns.h"
+#include <libcommon/error.h>
+#include <sstream>
+
+namespace
+{
+
+GUID ConvertInterfaceIndexToGuid(uint32_t interfaceIndex)
+{
+	NET_LUID luid;
+
+	auto status = ConvertInterfaceIndexToLuid(interfaceIndex, &luid);
+
+	if (NO_ERROR != status)
+	{
+		std::stringstream ss;
+
+		ss << "Could not resolve LUID of interface with index " << interfaceIndex;
+
+		THROW_WINDOWS_ERROR(status, ss.str().c_str());
+	}
+
+	GUID guid;
+
+	status = ConvertInterfaceLuidToGuid(&luid, &guid);
+
+	if (NO_ERROR != status)
+	{
+		std::stringstream ss;
+
+		ss << "Could not resolve GUID of interface with LUID 0x" << std::hex << luid.Value;
+
+		THROW_WINDOWS_ERROR(status, ss.str().c_str());
+	}
+
+	return guid;
+}
+
+std::wstring JoinNameServers(const std::vector<std::wstring> &nameServers)
+{
+	if (nameServers.empty())
+	{
+		THROW_ERROR("Invalid list of name servers (zero length list)");
+	}
+
+	std::wstring joined;
+
+	for (const auto &server : nameServers)
+	{
+		if (false == joined.empty())
+		{
+			joined.push_back(L',');
+		}
+
+		joined.append(server);
+	}
+
+	return joined;
+}
+
+} // anonymous namespace
+
+NativeDns::NativeDns(std::shared_ptr<common::logging::ILogSink> logSink)
+	: m_logSink(logSink)
+	, m_setInterfaceDnsSettings(ResolveSetInterfaceDnsSettings())
+{
+	if (nullptr == m_setInterfaceDnsSettings)
+	{
+		THROW_ERROR("The DNS settings API is not available on this system");
+	}
+}
+
+void NativeDns::setIpv4StaticDns(uint32_t interfaceIndex,
+	const std::vector<std::wstring> &nameServers, uint32_t)
+{
+	setNameServers(interfaceIndex, false, JoinNameServers(nameServers));
+}
+
+void NativeDns::setIpv4DhcpDns(uint32_t interfaceIndex, uint32_t)
+{
+	//
+	// An empty list of static name servers reverts to using DHCP provided servers.
+	//
+	setNameServers(interfaceIndex, false, L"");
+}
+
+void NativeDns::setIpv6StaticDns(uint32_t interfaceIndex,
+	const std::vector<std::wstring> &nameServers, uint32_t)
+{
+	setNameServers(interfaceIndex, true, JoinNameServers(nameServers));
+}
+
+void NativeDns::setIpv6DhcpDns(uint32_t interfaceIndex, uint32_t)
+{
+	setNameServers(interfaceIndex, true, L"");
+}
+
+//static
+bool NativeDns::IsSupported()
+{
+	return nullptr != ResolveSetInterfaceDnsSettings();
+}
+
+//static
+NativeDns::SetInterfaceDnsSettingsFunc NativeDns::ResolveSetInterfaceDnsSettings()
+{
+	//
+	// iphlpapi is linked statically so the module is always loaded.
+	//
+	const auto iphlpapi = GetModuleHandleW(L"iphlpapi.dll");
+
+	if (nullptr == iphlpapi)
+	{
+		return nullptr;
+	}
+
+	return reinterpret_cast<SetInterfaceDnsSettingsFunc>(GetProcAddress(iphlpapi, "SetInterfaceDnsSettings"));
+}
+
+void NativeDns::setNameServers(uint32_t interfaceIndex, bool ipv6, const std::wstring &nameServers)
+{
+	const auto guid = ConvertInterfaceIndexToGuid(interfaceIndex);
+
+	InterfaceSettings settings = { 0 };
+
+	settings.Version = INTERFACE_SETTINGS_VERSION1;
+	settings.Flags = SETTING_NAMESERVER | (ipv6 ? SETTING_IPV6 : 0);
+	settings.NameServer = const_cast<wchar_t *>(nameServers.c_str());
+
+	const auto status = m_setInterfaceDnsSettings(guid, &settings);
+
+	if (NO_ERROR != status)
+	{
+		std::stringstream ss;
+
+		ss << "Failed to set " << (ipv6 ? "IPv6" : "IPv4")
+			<< " name servers on interface with index " << interfaceIndex;
+
+		THROW_WINDOWS_ERROR(status, ss.str().c_str());
+	}
+}
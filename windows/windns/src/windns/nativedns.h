@@ -0,0 +1,72 @@
+#pragma once
+
+#include "idnsconfig.h"
+#include <libcommon/logging/ilogsink.h>
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <memory>
+
+//
+// Applies name server settings through the IP Helper DNS settings API.
+//
+// The DNS client is notified by the API itself, so there is no need to
+// restart or poke the resolver after an update.
+//
+// SetInterfaceDnsSettings() is only available on Windows 10 2004 and later,
+// and is therefore resolved at runtime. Construction fails if it's missing.
+//
+class NativeDns : public IDnsConfig
+{
+public:
+
+	NativeDns(std::shared_ptr<common::logging::ILogSink> logSink);
+
+	void setIpv4StaticDns(uint32_t interfaceIndex,
+		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0) override;
+
+	void setIpv4DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0) override;
+
+	void setIpv6StaticDns(uint32_t interfaceIndex,
+		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0) override;
+
+	void setIpv6DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0) override;
+
+	static bool IsSupported();
+
+private:
+
+	//
+	// DNS_INTERFACE_SETTINGS and related definitions are only available in the SDK
+	// when targeting Windows 10 2004 or later, so they are declared here.
+	//
+	struct InterfaceSettings
+	{
+		ULONG Version;
+		ULONG64 Flags;
+		PWSTR Domain;
+		PWSTR NameServer;
+		PWSTR SearchList;
+		ULONG RegistrationEnabled;
+		ULONG RegisterAdapterName;
+		ULONG EnableLLMNR;
+		ULONG QueryAdapterName;
+		PWSTR ProfileNameServer;
+	};
+
+	static constexpr ULONG INTERFACE_SETTINGS_VERSION1 = 0x0001;
+
+	static constexpr ULONG64 SETTING_IPV6 = 0x0001;
+	static constexpr ULONG64 SETTING_NAMESERVER = 0x0002;
+
+	using SetInterfaceDnsSettingsFunc = DWORD (WINAPI *)(GUID, const InterfaceSettings *);
+
+	std::shared_ptr<common::logging::ILogSink> m_logSink;
+	SetInterfaceDnsSettingsFunc m_setInterfaceDnsSettings;
+
+	static SetInterfaceDnsSettingsFunc ResolveSetInterfaceDnsSettings();
+
+	void setNameServers(uint32_t interfaceIndex, bool ipv6, const std::wstring &nameServers);
+};
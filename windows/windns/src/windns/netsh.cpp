@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "netsh.h"
+#include "netshworker.h"
 #include <libcommon/string.h>
 #include <libcommon/error.h>
 #include <libcommon/filesystem.h>
@@ -31,13 +32,61 @@ __declspec(noreturn) void ThrowWithDetails(std::string &&error, common::process:
 	THROW_ERROR(msg.c_str());
 }
 
+//
+// The timeout applies to a complete operation, which may involve several invocations.
+//
+class Deadline
+{
+public:
+
+	Deadline(uint32_t timeout)
+		: m_expiry(GetTickCount64() + (0 == timeout ? DEFAULT_TIMEOUT_MILLISECONDS : timeout))
+	{
+	}
+
+	uint32_t remaining() const
+	{
+		const auto now = GetTickCount64();
+
+		if (now >= m_expiry)
+		{
+			THROW_ERROR("'netsh' operation did not complete in a timely manner");
+		}
+
+		return static_cast<uint32_t>(m_expiry - now);
+	}
+
+	static constexpr uint32_t DEFAULT_TIMEOUT_MILLISECONDS = 10000;
+
+private:
+
+	ULONGLONG m_expiry;
+};
+
 } // anonymous namespace
 
-NetSh::NetSh(std::shared_ptr<common::logging::ILogSink> logSink)
+NetSh::NetSh(std::shared_ptr<common::logging::ILogSink> logSink, bool persistent)
 	: m_logSink(logSink)
 {
 	const auto system32 = common::fs::GetKnownFolderPath(FOLDERID_System, 0, nullptr);
 	m_netShPath = std::filesystem::path(system32).append(L"netsh.exe");
+
+	if (persistent)
+	{
+		try
+		{
+			m_worker = std::make_unique<NetShWorker>(m_netShPath);
+		}
+		catch (const std::exception &err)
+		{
+			const auto msg = std::string("Failed to start 'netsh' worker: ").append(err.what());
+			m_logSink->info(msg.c_str());
+		}
+	}
+}
+
+NetSh::~NetSh()
+{
 }
 
 void NetSh::setIpv4StaticDns(uint32_t interfaceIndex,
@@ -57,6 +106,8 @@ void NetSh::setIpv4StaticDns(uint32_t interfaceIndex,
 		THROW_ERROR("Invalid list of name servers (zero length list)");
 	}
 
+	const Deadline deadline(timeout);
+
 	{
 		std::wstringstream ss;
 
@@ -66,9 +117,7 @@ void NetSh::setIpv4StaticDns(uint32_t interfaceIndex,
 			<< nameServers[0]
 			<< L" validate=no";
 
-		auto netsh = common::process::ApplicationRunner::StartWithoutConsole(m_netShPath, ss.str());
-
-		validateShellOut(*netsh, timeout);
+		execute(ss.str(), deadline.remaining());
 	}
 
 	//
@@ -87,9 +136,7 @@ void NetSh::setIpv4StaticDns(uint32_t interfaceIndex,
 			<< i + 1
 			<< L" validate=no";
 
-		auto netsh = common::process::ApplicationRunner::StartWithoutConsole(m_netShPath, ss.str());
-
-		validateShellOut(*netsh, timeout);
+		execute(ss.str(), deadline.remaining());
 	}
 }
 
@@ -107,9 +154,7 @@ void NetSh::setIpv4DhcpDns(uint32_t interfaceIndex, uint32_t timeout)
 		<< interfaceIndex
 		<< L" source=dhcp";
 
-	auto netsh = common::process::ApplicationRunner::StartWithoutConsole(m_netShPath, ss.str());
-
-	validateShellOut(*netsh, timeout);
+	execute(ss.str(), timeout);
 }
 
 void NetSh::setIpv6StaticDns(uint32_t interfaceIndex,
@@ -129,6 +174,8 @@ void NetSh::setIpv6StaticDns(uint32_t interfaceIndex,
 		THROW_ERROR("Invalid list of name servers (zero length list)");
 	}
 
+	const Deadline deadline(timeout);
+
 	{
 		std::wstringstream ss;
 
@@ -138,9 +185,7 @@ void NetSh::setIpv6StaticDns(uint32_t interfaceIndex,
 			<< nameServers[0]
 			<< L" validate=no";
 
-		auto netsh = common::process::ApplicationRunner::StartWithoutConsole(m_netShPath, ss.str());
-
-		validateShellOut(*netsh, timeout);
+		execute(ss.str(), deadline.remaining());
 	}
 
 	//
@@ -159,9 +204,7 @@ void NetSh::setIpv6StaticDns(uint32_t interfaceIndex,
 			<< i + 1
 			<< L" validate=no";
 
-		auto netsh = common::process::ApplicationRunner::StartWithoutConsole(m_netShPath, ss.str());
-
-		validateShellOut(*netsh, timeout);
+		execute(ss.str(), deadline.remaining());
 	}
 }
 
@@ -179,14 +222,48 @@ void NetSh::setIpv6DhcpDns(uint32_t interfaceIndex, uint32_t timeout)
 		<< interfaceIndex
 		<< L" source=dhcp";
 
-	auto netsh = common::process::ApplicationRunner::StartWithoutConsole(m_netShPath, ss.str());
+	execute(ss.str(), timeout);
+}
+
+void NetSh::execute(const std::wstring &arguments, uint32_t timeout)
+{
+	const Deadline deadline(timeout);
+
+	{
+		std::scoped_lock<std::mutex> lock(m_workerLock);
+
+		if (m_worker)
+		{
+			try
+			{
+				m_worker->execute(arguments, deadline.remaining());
+				return;
+			}
+			catch (const NetShWorker::WorkerError &err)
+			{
+				//
+				// The command may or may not have been applied.
+				// Repeat it using a dedicated process, which is safe since all commands are idempotent.
+				//
+
+				const auto msg = std::string("'netsh' worker failed, reverting to one-shot invocations: ")
+					.append(err.what());
+
+				m_logSink->info(msg.c_str());
+
+				m_worker.reset();
+			}
+		}
+	}
+
+	auto netsh = common::process::ApplicationRunner::StartWithoutConsole(m_netShPath, arguments);
 
-	validateShellOut(*netsh, timeout);
+	validateShellOut(*netsh, deadline.remaining());
 }
 
 void NetSh::validateShellOut(common::process::ApplicationRunner &netsh, uint32_t timeout)
 {
-	const uint32_t actualTimeout = (0 == timeout ? 10000 : timeout);
+	const uint32_t actualTimeout = (0 == timeout ? Deadline::DEFAULT_TIMEOUT_MILLISECONDS : timeout);
 
 	const auto startTime = GetTickCount64();
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "idnsconfig.h"
 #include <libcommon/logging/ilogsink.h>
 #include <libcommon/process/applicationrunner.h>
 #include <string>
@@ -7,27 +8,39 @@
 #include <cstdint>
 #include <stdexcept>
 #include <memory>
+#include <mutex>
 
-class NetSh
+class NetShWorker;
+
+class NetSh : public IDnsConfig
 {
 public:
 
-	NetSh(std::shared_ptr<common::logging::ILogSink> logSink);
+	//
+	// A persistent instance feeds commands to a single long-lived netsh process
+	// and falls back to one process per command if that process fails.
+	//
+	NetSh(std::shared_ptr<common::logging::ILogSink> logSink, bool persistent = false);
+	~NetSh();
 
 	void setIpv4StaticDns(uint32_t interfaceIndex,
-		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0);
+		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0) override;
 
-	void setIpv4DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0);
+	void setIpv4DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0) override;
 
 	void setIpv6StaticDns(uint32_t interfaceIndex,
-		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0);
+		const std::vector<std::wstring> &nameServers, uint32_t timeout = 0) override;
 
-	void setIpv6DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0);
+	void setIpv6DhcpDns(uint32_t interfaceIndex, uint32_t timeout = 0) override;
 
 private:
 
 	std::shared_ptr<common::logging::ILogSink> m_logSink;
 	std::wstring m_netShPath;
 
+	std::mutex m_workerLock;
+	std::unique_ptr<NetShWorker> m_worker;
+
+	void execute(const std::wstring &arguments, uint32_t timeout);
 	void validateShellOut(common::process::ApplicationRunner &netsh, uint32_t timeout);
 };
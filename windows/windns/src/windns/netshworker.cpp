@@ -0,0 +1,161 @@
+#include "stdafx.h"
+#include "netshworker.h"
+#include <libcommon/string.h>
+#include <libcommon/error.h>
+#include <sstream>
+
+namespace
+{
+
+//
+// Remove prompts, acknowledgements and blank lines.
+// Whatever remains is an error message.
+//
+std::string StripBenignOutput(const std::string &output)
+{
+	std::stringstream in(output);
+	std::string line;
+	std::string remainder;
+
+	while (std::getline(in, line))
+	{
+		while (0 == line.compare(0, 6, "netsh>"))
+		{
+			line.erase(0, line.find('>') + 1);
+		}
+
+		const auto first = line.find_first_not_of(" \t\r");
+
+		if (std::string::npos == first)
+		{
+			continue;
+		}
+
+		const auto last = line.find_last_not_of(" \t\r");
+		const auto trimmed = line.substr(first, last - first + 1);
+
+		if (0 == trimmed.compare("Ok."))
+		{
+			continue;
+		}
+
+		if (false == remainder.empty())
+		{
+			remainder.append(" ");
+		}
+
+		remainder.append(trimmed);
+	}
+
+	return remainder;
+}
+
+} // anonymous namespace
+
+NetShWorker::NetShWorker(const std::wstring &netShPath)
+	: m_process(common::process::ApplicationRunner::StartWithoutConsole(netShPath, L""))
+	, m_sequence(0)
+{
+}
+
+NetShWorker::~NetShWorker()
+{
+	if (m_process)
+	{
+		m_process->write("exit\r\n");
+
+		DWORD returnCode;
+
+		m_process->join(returnCode, 1000);
+	}
+}
+
+void NetShWorker::execute(const std::wstring &command, uint32_t timeout)
+{
+	if (!m_process)
+	{
+		throw WorkerError("The 'netsh' worker has been shut down");
+	}
+
+	std::stringstream ss;
+
+	ss << "windns-marker-" << ++m_sequence;
+
+	const auto marker = ss.str();
+
+	const auto request = common::string::ToAnsi(command).append("\r\n")
+		.append(marker).append("\r\n");
+
+	if (false == m_process->write(request))
+	{
+		m_process.reset();
+		throw WorkerError("Failed to send command to 'netsh' worker");
+	}
+
+	const auto errors = StripBenignOutput(collect(marker, timeout));
+
+	if (false == errors.empty())
+	{
+		const auto msg = std::string("'netsh' failed the requested operation: ").append(errors);
+
+		THROW_ERROR(msg.c_str());
+	}
+}
+
+std::string NetShWorker::collect(const std::string &marker, uint32_t timeout)
+{
+	static const size_t MAX_CHARS = 2048;
+	static const uint32_t POLL_MILLISECONDS = 50;
+
+	const auto expiry = GetTickCount64() + timeout;
+
+	for (;;)
+	{
+		const auto markerOffset = m_pending.find(marker);
+
+		if (std::string::npos != markerOffset)
+		{
+			//
+			// Discard the remainder of the line that carries the marker,
+			// which is netsh complaining about an unknown command.
+			//
+
+			auto output = m_pending.substr(0, m_pending.rfind('\n', markerOffset) + 1);
+
+			const auto lineEnd = m_pending.find('\n', markerOffset);
+
+			if (std::string::npos == lineEnd)
+			{
+				m_pending.clear();
+			}
+			else
+			{
+				m_pending.erase(0, lineEnd + 1);
+			}
+
+			return output;
+		}
+
+		if (GetTickCount64() >= expiry)
+		{
+			m_process.reset();
+			throw WorkerError("'netsh' worker did not complete in a timely manner");
+		}
+
+		std::string chunk;
+
+		if (m_process->read(chunk, MAX_CHARS, POLL_MILLISECONDS))
+		{
+			m_pending.append(chunk);
+			continue;
+		}
+
+		DWORD returnCode;
+
+		if (m_process->join(returnCode, 0))
+		{
+			m_process.reset();
+			throw WorkerError("'netsh' worker exited unexpectedly");
+		}
+	}
+}
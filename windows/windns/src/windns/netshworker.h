@@ -0,0 +1,55 @@
+#pragma once
+
+#include <libcommon/process/applicationrunner.h>
+#include <stdexcept>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+//
+// Long-lived interactive netsh process that is fed commands over stdin.
+//
+// Command boundaries are detected by following each command with a marker
+// that netsh rejects as an unknown command, and scanning the output for
+// the marker. Anything else in the output, other than prompts and
+// acknowledgements, indicates that the command failed.
+//
+class NetShWorker
+{
+public:
+
+	//
+	// Thrown when the worker is unable to deliver a result.
+	// The worker is unusable after this and should be discarded.
+	//
+	class WorkerError : public std::runtime_error
+	{
+	public:
+
+		WorkerError(const char *message)
+			: std::runtime_error(message)
+		{
+		}
+	};
+
+	NetShWorker(const std::wstring &netShPath);
+	~NetShWorker();
+
+	NetShWorker(const NetShWorker &) = delete;
+	NetShWorker &operator=(const NetShWorker &) = delete;
+
+	//
+	// Throws WorkerError if the process fails, and std::runtime_error
+	// if netsh rejects the command.
+	//
+	void execute(const std::wstring &command, uint32_t timeout);
+
+private:
+
+	std::unique_ptr<common::process::ApplicationRunner> m_process;
+	uint64_t m_sequence;
+
+	std::string m_pending;
+
+	std::string collect(const std::string &marker, uint32_t timeout);
+};
@@ -0,0 +1,46 @@
+#include "stdafx.h"
+#include "resolvercache.h"
+#include <libcommon/error.h>
+
+namespace
+{
+
+//
+// DnsFlushResolverCache() is exported by dnsapi.dll but not declared in any SDK header.
+//
+using DnsFlushResolverCacheFunc = BOOL (WINAPI *)();
+
+DnsFlushResolverCacheFunc ResolveDnsFlushResolverCache()
+{
+	const auto dnsapi = LoadLibraryExW(L"dnsapi.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+
+	if (nullptr == dnsapi)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Load dnsapi.dll");
+	}
+
+	//
+	// The module is intentionally never unloaded.
+	//
+
+	const auto func = reinterpret_cast<DnsFlushResolverCacheFunc>(GetProcAddress(dnsapi, "DnsFlushResolverCache"));
+
+	if (nullptr == func)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Resolve DnsFlushResolverCache");
+	}
+
+	return func;
+}
+
+} // anonymous namespace
+
+void FlushResolverCache()
+{
+	static const auto flush = ResolveDnsFlushResolverCache();
+
+	if (FALSE == flush())
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Flush DNS resolver cache");
+	}
+}
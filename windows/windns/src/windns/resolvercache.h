@@ -0,0 +1,9 @@
+#pragma once
+
+//
+// Flush all entries from the DNS client cache.
+//
+// Entries resolved through servers that are no longer configured
+// would otherwise linger until their TTL expires.
+//
+void FlushResolverCache();
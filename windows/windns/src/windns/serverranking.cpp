@@ -0,0 +1,281 @@
+#include "stdafx.h"
+#include "serverranking.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libshared/performance/counterregistry.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <optional>
+
+namespace
+{
+
+const uint16_t DNS_PORT = 53;
+
+const DWORD PROBE_TIMEOUT_MS = 500;
+const uint32_t PROBE_ATTEMPTS = 2;
+
+//
+// Differences below this are considered jitter, so they don't reorder servers.
+//
+const auto RANKING_GRANULARITY = std::chrono::milliseconds(5);
+
+std::atomic<uint16_t> g_NextQueryId = static_cast<uint16_t>(GetTickCount());
+
+using Query = std::array<uint8_t, 17>;
+
+//
+// Standard query, with recursion desired, for NS records of the root zone.
+//
+Query MakeQuery(uint16_t id)
+{
+	return Query
+	{
+		static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id),
+		0x01, 0x00,	// flags
+		0x00, 0x01,	// QDCOUNT
+		0x00, 0x00,	// ANCOUNT
+		0x00, 0x00,	// NSCOUNT
+		0x00, 0x00,	// ARCOUNT
+		0x00,		// QNAME: root
+		0x00, 0x02,	// QTYPE: NS
+		0x00, 0x01	// QCLASS: IN
+	};
+}
+
+bool IsAnswer(const uint8_t *response, int length, uint16_t id)
+{
+	return length >= 12
+		&& response[0] == static_cast<uint8_t>(id >> 8)
+		&& response[1] == static_cast<uint8_t>(id)
+		&& 0 != (response[2] & 0x80);
+}
+
+int AddressLength(const SOCKADDR_INET &address)
+{
+	return (AF_INET == address.si_family ? sizeof(SOCKADDR_IN) : sizeof(SOCKADDR_IN6));
+}
+
+//
+// Round-trip time of the fastest answer, if any.
+//
+std::optional<std::chrono::microseconds> Probe(SOCKADDR_INET server)
+{
+	static auto &probes = shared::performance::CounterRegistry::Instance().counter("windns.rank.probes");
+
+	const auto s = socket(server.si_family, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (INVALID_SOCKET == s)
+	{
+		THROW_WINDOWS_ERROR(WSAGetLastError(), "Create socket for DNS probe");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [s]()
+	{
+		closesocket(s);
+	};
+
+	if (AF_INET == server.si_family)
+	{
+		server.Ipv4.sin_port = htons(DNS_PORT);
+	}
+	else
+	{
+		server.Ipv6.sin6_port = htons(DNS_PORT);
+	}
+
+	//
+	// Connecting the socket discards datagrams from other sources.
+	//
+	if (SOCKET_ERROR == connect(s, reinterpret_cast<const sockaddr *>(&server), AddressLength(server)))
+	{
+		THROW_WINDOWS_ERROR(WSAGetLastError(), "Connect socket for DNS probe");
+	}
+
+	std::optional<std::chrono::microseconds> fastest;
+
+	for (uint32_t attempt = 0; attempt < PROBE_ATTEMPTS; ++attempt)
+	{
+		const auto id = g_NextQueryId++;
+		const auto query = MakeQuery(id);
+
+		probes.increment();
+
+		const auto start = std::chrono::steady_clock::now();
+		const auto deadline = start + std::chrono::milliseconds(PROBE_TIMEOUT_MS);
+
+		if (SOCKET_ERROR == send(s, reinterpret_cast<const char *>(query.data()), static_cast<int>(query.size()), 0))
+		{
+			continue;
+		}
+
+		for (;;)
+		{
+			const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now());
+
+			if (remaining.count() <= 0)
+			{
+				break;
+			}
+
+			const auto timeout = static_cast<DWORD>(remaining.count());
+
+			setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&timeout), sizeof(timeout));
+
+			std::array<uint8_t, 512> response;
+
+			const auto received = recv(s, reinterpret_cast<char *>(response.data()), static_cast<int>(response.size()), 0);
+
+			if (SOCKET_ERROR == received)
+			{
+				//
+				// Oversized answers still count as answers.
+				//
+				if (WSAEMSGSIZE != WSAGetLastError())
+				{
+					break;
+				}
+			}
+			else if (false == IsAnswer(response.data(), received, id))
+			{
+				continue;
+			}
+
+			const auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start);
+
+			if (false == fastest.has_value() || rtt < fastest.value())
+			{
+				fastest = rtt;
+			}
+
+			break;
+		}
+	}
+
+	return fastest;
+}
+
+} // anonymous namespace
+
+ServerRanking::ServerRanking(std::chrono::milliseconds interval, RerankSinkType rerankSink)
+	: m_interval(interval)
+	, m_rerankSink(rerankSink)
+	, m_shutdown(false)
+{
+	m_thread = std::thread(&ServerRanking::thread, this);
+}
+
+ServerRanking::~ServerRanking()
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+
+	m_shutdownSignal.notify_all();
+
+	m_thread.join();
+}
+
+//static
+std::vector<size_t> ServerRanking::Rank(const std::vector<SOCKADDR_INET> &servers)
+{
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("windns.rank");
+
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	WSADATA data;
+
+	const auto status = WSAStartup(MAKEWORD(2, 2), &data);
+
+	if (0 != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Initialize Winsock");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += []()
+	{
+		WSACleanup();
+	};
+
+	std::vector<std::future<std::optional<std::chrono::microseconds>>> probes;
+
+	for (const auto &server : servers)
+	{
+		probes.emplace_back(std::async(std::launch::async, Probe, server));
+	}
+
+	//
+	// Failing to probe a server is treated like an unanswered probe.
+	//
+
+	std::vector<std::chrono::microseconds::rep> buckets;
+
+	const auto unanswered = std::numeric_limits<std::chrono::microseconds::rep>::max();
+
+	for (auto &probe : probes)
+	{
+		auto bucket = unanswered;
+
+		try
+		{
+			const auto rtt = probe.get();
+
+			if (rtt.has_value())
+			{
+				bucket = rtt.value().count()
+					/ std::chrono::duration_cast<std::chrono::microseconds>(RANKING_GRANULARITY).count();
+			}
+		}
+		catch (...)
+		{
+		}
+
+		buckets.push_back(bucket);
+	}
+
+	std::vector<size_t> order(servers.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	std::stable_sort(order.begin(), order.end(), [&buckets](size_t lhs, size_t rhs)
+	{
+		return buckets[lhs] < buckets[rhs];
+	});
+
+	return order;
+}
+
+void ServerRanking::thread()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;)
+	{
+		if (m_shutdownSignal.wait_for(lock, m_interval, [this]() { return m_shutdown; }))
+		{
+			return;
+		}
+
+		lock.unlock();
+
+		try
+		{
+			m_rerankSink();
+		}
+		catch (...)
+		{
+		}
+
+		lock.lock();
+	}
+}
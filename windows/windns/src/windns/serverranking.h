@@ -0,0 +1,59 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Orders DNS servers on how quickly they answer.
+//
+// Each server is sent a small query, for the name servers of the root zone, and the
+// round-trip time of the fastest answer is used. Any answer counts, so servers that
+// refuse recursion still rank on their latency.
+//
+// Probes are sent through whichever route is active for the server, i.e. on the same
+// path that the resolver would use.
+//
+// Instances re-rank periodically, by invoking the sink on a background thread.
+//
+class ServerRanking
+{
+public:
+
+	using RerankSinkType = std::function<void()>;
+
+	ServerRanking(std::chrono::milliseconds interval, RerankSinkType rerankSink);
+	~ServerRanking();
+
+	ServerRanking(const ServerRanking &) = delete;
+	ServerRanking &operator=(const ServerRanking &) = delete;
+
+	//
+	// Returns indices into 'servers', fastest server first.
+	//
+	// Servers that don't answer are placed last. Servers that are about as fast,
+	// or that don't answer, keep their relative order.
+	//
+	// All servers are probed concurrently, so this completes within one probe timeout
+	// per attempt.
+	//
+	static std::vector<size_t> Rank(const std::vector<SOCKADDR_INET> &servers);
+
+private:
+
+	const std::chrono::milliseconds m_interval;
+	RerankSinkType m_rerankSink;
+
+	std::mutex m_mutex;
+	std::condition_variable m_shutdownSignal;
+	bool m_shutdown;
+
+	std::thread m_thread;
+
+	void thread();
+};
@@ -0,0 +1,274 @@
+#include "stdafx.h"
+#include "snapshot.h"
+#include "interfacekey.h"
+#include <libcommon/error.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+
+//
+// Each line in the persisted snapshot has the following format:
+//
+// <luid> <family> <server>,<server>,...
+//
+// Where family is one of "ipv4" or "ipv6", and the list of servers is
+// replaced by "dhcp" if the servers are provided by DHCP.
+//
+
+const wchar_t DHCP_TOKEN[] = L"dhcp";
+
+std::wstring JoinNameServers(const std::vector<std::wstring> &servers)
+{
+	if (servers.empty())
+	{
+		return DHCP_TOKEN;
+	}
+
+	std::wstring joined;
+
+	for (const auto &server : servers)
+	{
+		if (false == joined.empty())
+		{
+			joined.push_back(L',');
+		}
+
+		joined.append(server);
+	}
+
+	return joined;
+}
+
+bool InterfaceExists(NET_LUID luid)
+{
+	NET_IFINDEX index;
+
+	const auto status = ConvertInterfaceLuidToIndex(&luid, &index);
+
+	return NO_ERROR == status;
+}
+
+} // anonymous namespace
+
+DnsSnapshot::DnsSnapshot(const std::wstring &path, std::shared_ptr<common::logging::ILogSink> logSink)
+	: m_path(path)
+	, m_logSink(logSink)
+{
+	load();
+}
+
+void DnsSnapshot::capture(NET_LUID luid)
+{
+	const auto existing = std::find_if(m_interfaces.begin(), m_interfaces.end(), [&luid](const InterfaceConfig &config)
+	{
+		return config.luid.Value == luid.Value;
+	});
+
+	if (m_interfaces.end() != existing)
+	{
+		return;
+	}
+
+	m_interfaces.emplace_back(InterfaceConfig
+	{
+		luid,
+		ReadNameServers(luid, AF_INET),
+		ReadNameServers(luid, AF_INET6)
+	});
+
+	persist();
+}
+
+bool DnsSnapshot::empty() const
+{
+	return m_interfaces.empty();
+}
+
+bool DnsSnapshot::restore(IDnsConfig &dnsConfig, std::vector<NET_LUID> &restored)
+{
+	bool success = true;
+
+	for (auto it = m_interfaces.begin(); it != m_interfaces.end(); /* no increment */)
+	{
+		try
+		{
+			//
+			// The interface may have been removed since it was captured.
+			// There is nothing to restore in this case.
+			//
+			if (InterfaceExists(it->luid))
+			{
+				RestoreInterface(dnsConfig, *it);
+			}
+
+			restored.push_back(it->luid);
+			it = m_interfaces.erase(it);
+		}
+		catch (const std::exception &err)
+		{
+			std::stringstream ss;
+
+			ss << "Failed to restore DNS settings on interface with LUID 0x" << std::hex << it->luid.Value
+				<< ": " << err.what();
+
+			m_logSink->error(ss.str().c_str());
+
+			success = false;
+			++it;
+		}
+	}
+
+	persist();
+
+	return success;
+}
+
+//static
+void DnsSnapshot::RestoreInterface(IDnsConfig &dnsConfig, const InterfaceConfig &config)
+{
+	NET_IFINDEX index;
+
+	const auto status = ConvertInterfaceLuidToIndex(&config.luid, &index);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Resolve interface index");
+	}
+
+	if (config.ipv4.has_value())
+	{
+		if (config.ipv4->empty())
+		{
+			dnsConfig.setIpv4DhcpDns(index);
+		}
+		else
+		{
+			dnsConfig.setIpv4StaticDns(index, *config.ipv4);
+		}
+	}
+
+	if (config.ipv6.has_value())
+	{
+		if (config.ipv6->empty())
+		{
+			dnsConfig.setIpv6DhcpDns(index);
+		}
+		else
+		{
+			dnsConfig.setIpv6StaticDns(index, *config.ipv6);
+		}
+	}
+}
+
+void DnsSnapshot::load()
+{
+	if (m_path.empty())
+	{
+		return;
+	}
+
+	std::wifstream file(m_path);
+
+	if (false == file.is_open())
+	{
+		return;
+	}
+
+	std::wstring line;
+
+	while (std::getline(file, line))
+	{
+		std::wstringstream ss(line);
+
+		ULONG64 luidValue;
+		std::wstring family;
+		std::wstring servers;
+
+		if (false == static_cast<bool>(ss >> luidValue >> family >> servers))
+		{
+			m_logSink->error("Ignoring malformed entry in DNS snapshot");
+			continue;
+		}
+
+		auto existing = std::find_if(m_interfaces.begin(), m_interfaces.end(), [luidValue](const InterfaceConfig &config)
+		{
+			return config.luid.Value == luidValue;
+		});
+
+		if (m_interfaces.end() == existing)
+		{
+			NET_LUID luid;
+			luid.Value = luidValue;
+
+			m_interfaces.emplace_back(InterfaceConfig{ luid, std::nullopt, std::nullopt });
+
+			existing = std::prev(m_interfaces.end());
+		}
+
+		auto parsed = (0 == servers.compare(DHCP_TOKEN) ? std::vector<std::wstring>() : SplitNameServers(servers));
+
+		if (0 == family.compare(L"ipv4"))
+		{
+			existing->ipv4 = std::move(parsed);
+		}
+		else if (0 == family.compare(L"ipv6"))
+		{
+			existing->ipv6 = std::move(parsed);
+		}
+		else
+		{
+			m_logSink->error("Ignoring malformed entry in DNS snapshot");
+		}
+	}
+}
+
+void DnsSnapshot::persist()
+{
+	if (m_path.empty())
+	{
+		return;
+	}
+
+	if (m_interfaces.empty())
+	{
+		DeleteFileW(m_path.c_str());
+		return;
+	}
+
+	const auto temporaryPath = std::wstring(m_path).append(L".tmp");
+
+	{
+		std::wofstream file(temporaryPath, std::ios::trunc);
+
+		if (false == file.is_open())
+		{
+			THROW_ERROR("Failed to open DNS snapshot file for writing");
+		}
+
+		for (const auto &config : m_interfaces)
+		{
+			if (config.ipv4.has_value())
+			{
+				file << config.luid.Value << L" ipv4 " << JoinNameServers(*config.ipv4) << std::endl;
+			}
+
+			if (config.ipv6.has_value())
+			{
+				file << config.luid.Value << L" ipv6 " << JoinNameServers(*config.ipv6) << std::endl;
+			}
+		}
+
+		if (file.fail())
+		{
+			THROW_ERROR("Failed to write DNS snapshot");
+		}
+	}
+
+	if (FALSE == MoveFileExW(temporaryPath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Failed to replace DNS snapshot");
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "idnsconfig.h"
+#include <libcommon/logging/ilogsink.h>
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+//
+// Original DNS configuration of interfaces that have been modified.
+//
+// An interface is captured the first time it's modified, and is dropped
+// once its configuration has been restored. The snapshot is persisted
+// on every change so it survives a crash.
+//
+class DnsSnapshot
+{
+public:
+
+	//
+	// Loads any snapshot that was left behind at 'path'.
+	// An empty path disables persistence.
+	//
+	DnsSnapshot(const std::wstring &path, std::shared_ptr<common::logging::ILogSink> logSink);
+
+	void capture(NET_LUID luid);
+
+	bool empty() const;
+
+	//
+	// Restore all interfaces in the snapshot.
+	// Returns false if any interface could not be restored. These are kept.
+	//
+	bool restore(IDnsConfig &dnsConfig, std::vector<NET_LUID> &restored);
+
+private:
+
+	//
+	// A missing family is not bound to the interface.
+	// An empty list of servers means the servers are provided by DHCP.
+	//
+	struct InterfaceConfig
+	{
+		NET_LUID luid;
+		std::optional<std::vector<std::wstring>> ipv4;
+		std::optional<std::vector<std::wstring>> ipv6;
+	};
+
+	std::wstring m_path;
+	std::shared_ptr<common::logging::ILogSink> m_logSink;
+
+	std::vector<InterfaceConfig> m_interfaces;
+
+	static void RestoreInterface(IDnsConfig &dnsConfig, const InterfaceConfig &config);
+
+	void load();
+	void persist();
+};
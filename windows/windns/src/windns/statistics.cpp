@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "statistics.h"
+#include <libcommon/error.h>
+#include <algorithm>
+
+Statistics::Statistics()
+{
+	reset();
+}
+
+void Statistics::increment(Counter counter)
+{
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	switch (counter)
+	{
+		case Counter::SetRequests: ++m_statistics.setRequests; break;
+		case Counter::SkippedCached: ++m_statistics.skippedCached; break;
+		case Counter::SkippedUpToDate: ++m_statistics.skippedUpToDate; break;
+		case Counter::Applied: ++m_statistics.applied; break;
+		case Counter::Failed: ++m_statistics.failed; break;
+		case Counter::CacheFlushes: ++m_statistics.cacheFlushes; break;
+		case Counter::CacheFlushFailures: ++m_statistics.cacheFlushFailures; break;
+	}
+}
+
+void Statistics::record(Operation operation, std::chrono::microseconds duration)
+{
+	const auto micros = static_cast<uint64_t>(duration.count());
+
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	auto &entry = timing(operation);
+
+	++entry.count;
+	entry.totalMicroseconds += micros;
+	entry.maxMicroseconds = std::max(entry.maxMicroseconds, micros);
+	entry.lastMicroseconds = micros;
+}
+
+WINDNS_STATISTICS Statistics::snapshot(bool reset)
+{
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	const auto statistics = m_statistics;
+
+	if (reset)
+	{
+		m_statistics = WINDNS_STATISTICS{ 0 };
+	}
+
+	return statistics;
+}
+
+void Statistics::reset()
+{
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	m_statistics = WINDNS_STATISTICS{ 0 };
+}
+
+WINDNS_TIMING &Statistics::timing(Operation operation)
+{
+	switch (operation)
+	{
+		case Operation::AdapterLookup: return m_statistics.adapterLookup;
+		case Operation::Verification: return m_statistics.verification;
+		case Operation::Ipv4Apply: return m_statistics.ipv4Apply;
+		case Operation::Ipv6Apply: return m_statistics.ipv6Apply;
+		case Operation::CacheFlush: return m_statistics.cacheFlush;
+	}
+
+	THROW_ERROR("Invalid operation");
+}
+
+Statistics::ScopedTimer::ScopedTimer(Statistics &statistics, Operation operation)
+	: m_statistics(statistics)
+	, m_operation(operation)
+	, m_start(std::chrono::steady_clock::now())
+{
+}
+
+Statistics::ScopedTimer::~ScopedTimer()
+{
+	m_statistics.record(m_operation, std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_start));
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "windns.h"
+#include <chrono>
+#include <mutex>
+
+//
+// Counters and timings for WinDns operations.
+// All members are safe to use concurrently.
+//
+class Statistics
+{
+public:
+
+	enum class Counter
+	{
+		SetRequests,
+		SkippedCached,
+		SkippedUpToDate,
+		Applied,
+		Failed,
+		CacheFlushes,
+		CacheFlushFailures,
+	};
+
+	enum class Operation
+	{
+		AdapterLookup,
+		Verification,
+		Ipv4Apply,
+		Ipv6Apply,
+		CacheFlush,
+	};
+
+	Statistics();
+
+	void increment(Counter counter);
+	void record(Operation operation, std::chrono::microseconds duration);
+
+	//
+	// Optionally reset atomically with taking the snapshot.
+	//
+	WINDNS_STATISTICS snapshot(bool reset = false);
+	void reset();
+
+	//
+	// Records the lifetime of the instance against an operation.
+	//
+	class ScopedTimer
+	{
+	public:
+
+		ScopedTimer(Statistics &statistics, Operation operation);
+		~ScopedTimer();
+
+		ScopedTimer(const ScopedTimer &) = delete;
+		ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+	private:
+
+		Statistics &m_statistics;
+		Operation m_operation;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+private:
+
+	std::mutex m_lock;
+	WINDNS_STATISTICS m_statistics;
+
+	WINDNS_TIMING &timing(Operation operation);
+};
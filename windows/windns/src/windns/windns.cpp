@@ -1,14 +1,33 @@
 #include "stdafx.h"
-#include <libcommon/guid.h>
 #include <libcommon/string.h>
 #include <libcommon/error.h>
-#include <libshared/network/interfaceutils.h>
 #include <libcommon/logging/ilogsink.h>
+#include <libcommon/memory.h>
+#include <libshared/diagnostics/blobwriter.h>
 #include <libshared/logging/logsinkadapter.h>
+#include <libshared/network/aliascache.h>
+#include <libshared/performance/counterregistry.h>
+#include <libshared/tracing/trace.h>
 #include "windns.h"
 #include "confineoperation.h"
 #include "netsh.h"
+#include "nativedns.h"
+#include "dnsmonitor.h"
+#include "statistics.h"
+#include "snapshot.h"
+#include "resolvercache.h"
+#include "serverranking.h"
+#include "interfacekey.h"
+#include "interfacereadiness.h"
 #include <memory>
+#include <unordered_map>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <optional>
+#include <chrono>
+#include <functional>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -31,7 +50,7 @@ namespace
 {
 
 std::shared_ptr<common::logging::ILogSink> g_LogSink;
-std::shared_ptr<NetSh> g_NetSh;
+std::shared_ptr<IDnsConfig> g_DnsConfig;
 
 std::vector<std::wstring> MakeStringArray(const wchar_t **strings, uint32_t numStrings)
 {
@@ -45,11 +64,11 @@ std::vector<std::wstring> MakeStringArray(const wchar_t **strings, uint32_t numS
 	return v;
 }
 
-uint32_t ConvertInterfaceAliasToIndex(const std::wstring &interfaceAlias)
+NET_LUID ResolveInterfaceLuid(const std::wstring &interfaceAlias)
 {
 	NET_LUID luid;
 
-	if (NO_ERROR != ConvertInterfaceAliasToLuid(interfaceAlias.c_str(), &luid))
+	if (NO_ERROR != shared::network::InterfaceAliasCache::Instance().resolve(interfaceAlias, luid))
 	{
 		const auto err = std::wstring(L"Could not resolve LUID of interface: \"")
 			.append(interfaceAlias).append(L"\"");
@@ -57,16 +76,20 @@ uint32_t ConvertInterfaceAliasToIndex(const std::wstring &interfaceAlias)
 		THROW_ERROR(common::string::ToAnsi(err).c_str());
 	}
 
+	return luid;
+}
+
+uint32_t ResolveInterfaceIndex(NET_LUID luid)
+{
 	NET_IFINDEX index;
 
 	if (NO_ERROR != ConvertInterfaceLuidToIndex(&luid, &index))
 	{
-		std::wstringstream ss;
+		std::stringstream ss;
 
-		ss << L"Could not resolve index of interface: \"" << interfaceAlias << L"\""
-			<< L"with LUID: 0x" << std::hex << luid.Value;
+		ss << "Could not resolve index of interface with LUID: 0x" << std::hex << luid.Value;
 
-		THROW_ERROR(common::string::ToAnsi(ss.str()).c_str());
+		THROW_ERROR(ss.str().c_str());
 	}
 
 	return static_cast<uint32_t>(index);
@@ -78,52 +101,202 @@ struct AdapterDnsAddresses
 	std::vector<IN6_ADDR> ipv6;
 };
 
+struct InterfaceRequest
+{
+	NET_LUID luid;
+
+	// E.g. 'adapter with alias "Ethernet"', for use in log messages.
+	std::string description;
+
+	// Empty lists mean the servers are provided by DHCP.
+	std::vector<std::wstring> ipv4Servers;
+	std::vector<std::wstring> ipv6Servers;
+
+	AdapterDnsAddresses wanted;
+};
+
+//
+// Servers most recently applied to each interface, keyed on LUID.
+// An interface is evicted while settings are being applied to it, and
+// remains evicted if this fails.
+//
+std::unordered_map<ULONG64, AdapterDnsAddresses> g_AppliedSettings;
+std::mutex g_AppliedSettingsLock;
+
+std::unique_ptr<DnsMonitor> g_DnsMonitor;
+
+Statistics g_Statistics;
+
+std::unique_ptr<DnsSnapshot> g_Snapshot;
+
+std::atomic<bool> g_FlushResolverCache = false;
+
+//
+// Set requests slower than this are reported in detail. Zero disables the check.
+//
+std::atomic<uint32_t> g_SetBudgetMs = 0;
+
+using Phase = std::pair<const char *, std::chrono::steady_clock::time_point>;
+
 //
-// Use name when finding the adapter to be more resilient over time.
-// The adapter structure that is returned has two fields for interface index.
-// If IPv4 is enabled, 'IfIndex' will be set. Otherwise set to 0.
-// If IPv6 is enabled, 'Ipv6IfIndex' will be set. Otherwise set to 0.
-// If both IPv4 and IPv6 is enabled, then both fields will be set, and have the same value.
+// Log a single warning with the time spent in each phase, if the budget was exceeded.
+// Each phase lasts from the end of the previous phase, or from 'started'.
 //
-AdapterDnsAddresses GetAdapterDnsAddresses(const std::wstring &adapterAlias)
+void CheckSetBudget(const char *operation, std::chrono::steady_clock::time_point started,
+	const std::vector<Phase> &phases, const std::string &details)
 {
-	using shared::network::InterfaceUtils;
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
 
-	const auto adapters = InterfaceUtils::GetAllAdapters(
-		AF_UNSPEC,
-		GAA_FLAG_SKIP_UNICAST | GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST
-	);
+	const auto budget = std::chrono::milliseconds(g_SetBudgetMs.load());
+	const auto finished = (phases.empty() ? started : phases.back().second);
 
-	for (const auto adapter : adapters)
+	if (0 == budget.count() || finished - started <= budget)
 	{
-		const auto guidObj = common::Guid::FromString(adapter.guid());
+		return;
+	}
+
+	std::stringstream ss;
 
-		if (0 != _wcsicmp(adapter.alias().c_str(), adapterAlias.c_str()))
+	ss << operation << " exceeded latency budget of " << budget.count() << " ms"
+		<< ": total " << duration_cast<microseconds>(finished - started).count() << " us (";
+
+	auto previous = started;
+
+	for (const auto &phase : phases)
+	{
+		if (previous != started)
 		{
-			continue;
+			ss << ", ";
 		}
 
-		AdapterDnsAddresses out;
+		ss << phase.first << ": " << duration_cast<microseconds>(phase.second - previous).count() << " us";
+
+		previous = phase.second;
+	}
+
+	ss << "), " << details;
+
+	g_LogSink->warning(ss.str().c_str());
+}
+
+//
+// Operations on different interfaces run concurrently, while operations on the same
+// interface are serialized. Such operations hold the apply lock shared, and then the
+// lock of the interface. Restoring the snapshot affects all interfaces, so it holds
+// the apply lock exclusively.
+//
+std::shared_mutex g_ApplyLock;
+
+std::unordered_map<ULONG64, std::mutex> g_InterfaceLocks;
+std::mutex g_InterfaceLocksLock;
+
+class InterfaceOperation
+{
+public:
+
+	explicit InterfaceOperation(NET_LUID luid)
+		: m_applyLock(g_ApplyLock)
+		, m_interfaceLock(InterfaceLock(luid))
+	{
+	}
+
+	InterfaceOperation(const InterfaceOperation &) = delete;
+	InterfaceOperation &operator=(const InterfaceOperation &) = delete;
+
+private:
+
+	static std::mutex &InterfaceLock(NET_LUID luid)
+	{
+		std::scoped_lock<std::mutex> lock(g_InterfaceLocksLock);
+
+		//
+		// Nodes are never erased, so the reference stays valid.
+		//
+		return g_InterfaceLocks[luid.Value];
+	}
+
+	std::shared_lock<std::shared_mutex> m_applyLock;
+	std::unique_lock<std::mutex> m_interfaceLock;
+};
+
+//
+// Captures of original settings may happen concurrently.
+//
+std::mutex g_SnapshotLock;
+
+std::atomic<bool> g_RankServers = false;
+
+//
+// Requests with more than one server for a family, in the order they were given.
+// These are re-ranked periodically.
+//
+std::unordered_map<ULONG64, InterfaceRequest> g_RankedRequests;
+std::mutex g_RankedRequestsLock;
+
+std::unique_ptr<ServerRanking> g_ServerRanking;
+std::mutex g_ServerRankingLock;
+
+//
+// How long to wait for an interface that was just created to become ready,
+// before trying to configure it anyway.
+//
+const auto INTERFACE_READY_TIMEOUT = std::chrono::seconds(5);
+
+bool HasServers(const wchar_t **servers, uint32_t numServers)
+{
+	return nullptr != servers && 0 != numServers;
+}
+
+template<typename Address>
+std::vector<Address> ParseNameServers(ADDRESS_FAMILY family, const std::optional<std::vector<std::wstring>> &servers)
+{
+	std::vector<Address> out;
+
+	if (false == servers.has_value())
+	{
+		return out;
+	}
+
+	for (const auto &server : servers.value())
+	{
+		Address converted;
 
-		for (auto server = adapter.raw().FirstDnsServerAddress; nullptr != server; server = server->Next)
+		if (1 != InetPtonW(family, server.c_str(), &converted))
 		{
-			if (AF_INET == server->Address.lpSockaddr->sa_family)
-			{
-				out.ipv4.push_back(((const SOCKADDR_IN*)server->Address.lpSockaddr)->sin_addr);
-			}
-			else if (AF_INET6 == server->Address.lpSockaddr->sa_family)
-			{
-				out.ipv6.push_back(((const SOCKADDR_IN6_LH*)server->Address.lpSockaddr)->sin6_addr);
-			}
+			THROW_ERROR("Failed to parse configured name server");
 		}
 
-		return out;
+		out.push_back(converted);
 	}
 
-	const auto msg = std::string("Could not find interface with alias: ")
-		.append(common::string::ToAnsi(adapterAlias));
+	return out;
+}
+
+//
+// Servers that are configured on the interface, as opposed to provided by DHCP.
+// This only reads the registry key of the interface, for each family, rather than
+// enumerating all adapters.
+//
+AdapterDnsAddresses GetAdapterDnsAddresses(NET_LUID luid)
+{
+	const auto ipv4 = ReadNameServers(luid, AF_INET);
+	const auto ipv6 = ReadNameServers(luid, AF_INET6);
+
+	if (false == ipv4.has_value() && false == ipv6.has_value())
+	{
+		std::stringstream ss;
+
+		ss << "Could not find interface with LUID: 0x" << std::hex << luid.Value;
+
+		THROW_ERROR(ss.str().c_str());
+	}
 
-	THROW_ERROR(msg.c_str());
+	return AdapterDnsAddresses
+	{
+		ParseNameServers<IN_ADDR>(AF_INET, ipv4),
+		ParseNameServers<IN6_ADDR>(AF_INET6, ipv6)
+	};
 }
 
 AdapterDnsAddresses ConvertAddresses(
@@ -174,85 +347,145 @@ bool Equal(const AdapterDnsAddresses &lhs, const AdapterDnsAddresses &rhs)
 		&& lhs.ipv6 == rhs.ipv6;
 }
 
-} // anonymous namespace
-
-WINDNS_LINKAGE
-bool
-WINDNS_API
-WinDns_Initialize(
-	MullvadLogSink logSink,
-	void *logSinkContext
-)
+std::shared_ptr<IDnsConfig> CreateDnsConfig(WINDNS_BACKEND backend, std::shared_ptr<common::logging::ILogSink> logSink)
 {
-	if (g_LogSink)
+	switch (backend)
 	{
-		return false;
-	}
+		case WINDNS_BACKEND_AUTO:
+		{
+			if (NativeDns::IsSupported())
+			{
+				return std::make_shared<NativeDns>(logSink);
+			}
 
-	try
-	{
-		g_LogSink = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext);
+			logSink->info("Native DNS configuration is not supported. Falling back to netsh");
 
-		try
+			return std::make_shared<NetSh>(logSink);
+		}
+		case WINDNS_BACKEND_NETSH:
 		{
-			g_NetSh = std::make_shared<NetSh>(g_LogSink);
+			return std::make_shared<NetSh>(logSink);
 		}
-		catch (...)
+		case WINDNS_BACKEND_NATIVE:
 		{
-			g_LogSink.reset();
-			throw;
+			return std::make_shared<NativeDns>(logSink);
 		}
-
-		return true;
-	}
-	catch (const std::exception &err)
-	{
-		if (nullptr != logSink)
+		case WINDNS_BACKEND_NETSH_PERSISTENT:
 		{
-			const auto msg = std::string("Failed to initialize WinDns: ").append(err.what());
-			logSink(MULLVAD_LOG_LEVEL_ERROR, msg.c_str(), logSinkContext);
+			return std::make_shared<NetSh>(logSink, true);
 		}
-
-		return false;
-	}
-	catch (...)
-	{
-		if (nullptr != logSink)
+		default:
 		{
-			const std::string msg("Failed to initialize WinDns: Unspecified error");
-			logSink(MULLVAD_LOG_LEVEL_ERROR, msg.c_str(), logSinkContext);
+			THROW_ERROR("Invalid DNS backend");
 		}
+	}
+}
 
-		return false;
+void FlushResolverCacheIfEnabled()
+{
+	if (false == g_FlushResolverCache)
+	{
+		return;
 	}
+
+	const auto status = ConfineOperation("Flush DNS resolver cache", g_LogSink, []()
+	{
+		Statistics::ScopedTimer timer(g_Statistics, Statistics::Operation::CacheFlush);
+		FlushResolverCache();
+	});
+
+	g_Statistics.increment(status ? Statistics::Counter::CacheFlushes : Statistics::Counter::CacheFlushFailures);
 }
 
-WINDNS_LINKAGE
-bool
-WINDNS_API
-WinDns_Deinitialize(
-)
+bool RestoreSnapshot()
 {
-	g_NetSh.reset();
-	g_LogSink.reset();
+	std::unique_lock<std::shared_mutex> applyLock(g_ApplyLock);
 
-	return true;
+	if (g_Snapshot->empty())
+	{
+		return true;
+	}
+
+	return ConfineOperation("Restore original DNS settings", g_LogSink, [&]()
+	{
+		std::vector<NET_LUID> restored;
+
+		const auto status = g_Snapshot->restore(*g_DnsConfig, restored);
+
+		{
+			std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock, g_RankedRequestsLock);
+
+			for (const auto &luid : restored)
+			{
+				g_AppliedSettings.erase(luid.Value);
+				g_RankedRequests.erase(luid.Value);
+			}
+		}
+
+		if (false == restored.empty())
+		{
+			FlushResolverCacheIfEnabled();
+		}
+
+		if (false == status)
+		{
+			THROW_ERROR("Some adapters could not be restored");
+		}
+	});
 }
 
-WINDNS_LINKAGE
-bool
-WINDNS_API
-WinDns_Set(
-	const wchar_t *interfaceAlias,
+InterfaceRequest MakeInterfaceRequest(
+	NET_LUID luid,
+	std::string &&description,
 	const wchar_t **ipv4Servers,
 	uint32_t numIpv4Servers,
 	const wchar_t **ipv6Servers,
 	uint32_t numIpv6Servers
 )
 {
-	if (nullptr == g_LogSink)
+	InterfaceRequest request;
+
+	request.luid = luid;
+	request.description = std::move(description);
+
+	if (nullptr != ipv4Servers)
 	{
-		return false;
+		request.ipv4Servers = MakeStringArray(ipv4Servers, numIpv4Servers);
+	}
+
+	if (nullptr != ipv6Servers)
+	{
+		request.ipv6Servers = MakeStringArray(ipv6Servers, numIpv6Servers);
+	}
+
+	request.wanted = ConvertAddresses(ipv4Servers, numIpv4Servers, ipv6Servers, numIpv6Servers);
+
+	return request;
+}
+
+//
+// 'getActiveSettings' is only invoked if the request cannot be dismissed
+// based on what was applied most recently.
+//
+// 'modified' is set if an attempt was made to update the adapter, whether or not it succeeded.
+//
+bool ApplyInterfaceSettings(const InterfaceRequest &request, std::function<AdapterDnsAddresses()> getActiveSettings,
+	bool &modified)
+{
+	//
+	// Skip the update if these exact settings were the last ones applied.
+	//
+
+	{
+		std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock);
+
+		const auto cached = g_AppliedSettings.find(request.luid.Value);
+
+		if (g_AppliedSettings.end() != cached && Equal(cached->second, request.wanted))
+		{
+			g_Statistics.increment(Statistics::Counter::SkippedCached);
+			return true;
+		}
 	}
 
 	//
@@ -262,18 +495,22 @@ WinDns_Set(
 
 	try
 	{
-		const auto activeSettings = GetAdapterDnsAddresses(interfaceAlias);
-		const auto wantedSetting = ConvertAddresses(ipv4Servers, numIpv4Servers, ipv6Servers, numIpv6Servers);
+		const auto activeSettings = getActiveSettings();
 
-		if (Equal(activeSettings, wantedSetting))
+		if (Equal(activeSettings, request.wanted))
 		{
+			g_Statistics.increment(Statistics::Counter::SkippedUpToDate);
+
 			std::stringstream ss;
 
-			ss << "DNS settings on adapter with alias \"" << common::string::ToAnsi(interfaceAlias)
-				<< "\" are up-to-date";
+			ss << "DNS settings on " << request.description << " are up-to-date";
 
 			g_LogSink->info(ss.str().c_str());
 
+			std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock);
+
+			g_AppliedSettings[request.luid.Value] = request.wanted;
+
 			return true;
 		}
 	}
@@ -281,8 +518,7 @@ WinDns_Set(
 	{
 		std::stringstream ss;
 
-		ss << "Failed to evaluate DNS settings on adapter with alias \""
-			<< common::string::ToAnsi(interfaceAlias) << "\": " << ex.what();
+		ss << "Failed to evaluate DNS settings on " << request.description << ": " << ex.what();
 
 		g_LogSink->info(ss.str().c_str());
 	}
@@ -290,8 +526,7 @@ WinDns_Set(
 	{
 		std::stringstream ss;
 
-		ss << "Failed to evaluate DNS settings on adapter with alias \""
-			<< common::string::ToAnsi(interfaceAlias) << "\": Unspecified failure";
+		ss << "Failed to evaluate DNS settings on " << request.description << ": Unspecified failure";
 
 		g_LogSink->info(ss.str().c_str());
 	}
@@ -299,32 +534,937 @@ WinDns_Set(
 	//
 	// Apply specified settings.
 	//
+	// The families are independent so update them concurrently, within a shared deadline.
+	//
 
-	const auto operation = std::string("Apply DNS settings on adapter with alias \"")
-		.append(common::string::ToAnsi(interfaceAlias)).append("\"");
+	const auto adapter = std::string(" on ").append(request.description);
 
-	return ConfineOperation(operation.c_str(), g_LogSink, [&]()
 	{
-		const auto interfaceIndex = ConvertInterfaceAliasToIndex(interfaceAlias);
+		//
+		// Prevent the monitor from mistaking intermediate states for drift.
+		//
 
-		if (nullptr != ipv4Servers && 0 != numIpv4Servers)
-		{
-			g_NetSh->setIpv4StaticDns(interfaceIndex, MakeStringArray(ipv4Servers, numIpv4Servers));
-		}
-		else
+		std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock);
+
+		g_AppliedSettings.erase(request.luid.Value);
+	}
+
+	//
+	// Failing to capture the original settings is not a reason to leave the
+	// adapter using the wrong servers. The failure is logged.
+	//
+	ConfineOperation(std::string("Capture original DNS settings").append(adapter).c_str(), g_LogSink, [&]()
+	{
+		std::scoped_lock<std::mutex> lock(g_SnapshotLock);
+
+		g_Snapshot->capture(request.luid);
+	});
+
+	uint32_t interfaceIndex;
+
+	if (false == ConfineOperation(std::string("Resolve interface").append(adapter).c_str(), g_LogSink, [&]()
+	{
+		interfaceIndex = ResolveInterfaceIndex(request.luid);
+	}))
+	{
+		g_Statistics.increment(Statistics::Counter::Failed);
+		return false;
+	}
+
+	static const uint32_t APPLY_TIMEOUT_MILLISECONDS = 10000;
+
+	modified = true;
+
+	const auto applyStart = std::chrono::steady_clock::now();
+
+	auto ipv4Status = std::async(std::launch::async, [&]()
+	{
+		return ConfineOperation(std::string("Apply IPv4 DNS settings").append(adapter).c_str(), g_LogSink, [&]()
 		{
-			// This is required to clear any current settings.
-			g_NetSh->setIpv4DhcpDns(interfaceIndex);
-		}
+			Statistics::ScopedTimer timer(g_Statistics, Statistics::Operation::Ipv4Apply);
+
+			if (false == request.ipv4Servers.empty())
+			{
+				g_DnsConfig->setIpv4StaticDns(interfaceIndex, request.ipv4Servers, APPLY_TIMEOUT_MILLISECONDS);
+			}
+			else
+			{
+				// This is required to clear any current settings.
+				g_DnsConfig->setIpv4DhcpDns(interfaceIndex, APPLY_TIMEOUT_MILLISECONDS);
+			}
+		});
+	});
+
+	const auto ipv6Status = ConfineOperation(std::string("Apply IPv6 DNS settings").append(adapter).c_str(), g_LogSink, [&]()
+	{
+		Statistics::ScopedTimer timer(g_Statistics, Statistics::Operation::Ipv6Apply);
 
-		if (nullptr != ipv6Servers && 0 != numIpv6Servers)
+		if (false == request.ipv6Servers.empty())
 		{
-			g_NetSh->setIpv6StaticDns(interfaceIndex, MakeStringArray(ipv6Servers, numIpv6Servers));
+			g_DnsConfig->setIpv6StaticDns(interfaceIndex, request.ipv6Servers, APPLY_TIMEOUT_MILLISECONDS);
 		}
 		else
 		{
 			// This is required to clear any current settings.
-			g_NetSh->setIpv6DhcpDns(interfaceIndex);
+			g_DnsConfig->setIpv6DhcpDns(interfaceIndex, APPLY_TIMEOUT_MILLISECONDS);
 		}
 	});
+
+	const auto status = ipv4Status.get() && ipv6Status;
+
+	if (false == status)
+	{
+		g_Statistics.increment(Statistics::Counter::Failed);
+		return false;
+	}
+
+	g_Statistics.increment(Statistics::Counter::Applied);
+
+	{
+		const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - applyStart);
+
+		std::stringstream ss;
+
+		ss << "Applied DNS settings" << adapter << " in " << elapsed.count() << " ms";
+
+		g_LogSink->info(ss.str().c_str());
+	}
+
+	std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock);
+
+	g_AppliedSettings[request.luid.Value] = request.wanted;
+
+	return true;
+}
+
+bool NeedsRanking(const InterfaceRequest &request)
+{
+	return request.wanted.ipv4.size() > 1
+		|| request.wanted.ipv6.size() > 1;
+}
+
+template<typename T>
+std::vector<T> Reorder(const std::vector<T> &items, const std::vector<size_t> &order)
+{
+	std::vector<T> reordered;
+	reordered.reserve(items.size());
+
+	for (const auto index : order)
+	{
+		reordered.push_back(items[index]);
+	}
+
+	return reordered;
+}
+
+//
+// Returns the request with the servers of each family ordered on latency.
+//
+InterfaceRequest RankRequest(const InterfaceRequest &request)
+{
+	//
+	// Probe servers of both families in one go, then separate the families.
+	//
+
+	std::vector<SOCKADDR_INET> servers;
+
+	for (const auto &address : request.wanted.ipv4)
+	{
+		SOCKADDR_INET server = { 0 };
+
+		server.Ipv4.sin_family = AF_INET;
+		server.Ipv4.sin_addr = address;
+
+		servers.push_back(server);
+	}
+
+	for (const auto &address : request.wanted.ipv6)
+	{
+		SOCKADDR_INET server = { 0 };
+
+		server.Ipv6.sin6_family = AF_INET6;
+		server.Ipv6.sin6_addr = address;
+
+		servers.push_back(server);
+	}
+
+	const auto numIpv4 = request.wanted.ipv4.size();
+
+	std::vector<size_t> ipv4Order;
+	std::vector<size_t> ipv6Order;
+
+	for (const auto index : ServerRanking::Rank(servers))
+	{
+		if (index < numIpv4)
+		{
+			ipv4Order.push_back(index);
+		}
+		else
+		{
+			ipv6Order.push_back(index - numIpv4);
+		}
+	}
+
+	auto ranked = request;
+
+	ranked.ipv4Servers = Reorder(request.ipv4Servers, ipv4Order);
+	ranked.ipv6Servers = Reorder(request.ipv6Servers, ipv6Order);
+	ranked.wanted.ipv4 = Reorder(request.wanted.ipv4, ipv4Order);
+	ranked.wanted.ipv6 = Reorder(request.wanted.ipv6, ipv6Order);
+
+	if (false == Equal(ranked.wanted, request.wanted))
+	{
+		static auto &reordered = shared::performance::CounterRegistry::Instance().counter("windns.rank.reordered");
+
+		reordered.increment();
+
+		std::stringstream ss;
+
+		ss << "Reordered DNS servers for " << request.description << " on latency";
+
+		g_LogSink->info(ss.str().c_str());
+	}
+
+	return ranked;
+}
+
+//
+// Ranks the servers of a request, if enabled, and remembers the request for re-ranking.
+// The order is left as is if ranking fails. Must be called as part of an InterfaceOperation.
+//
+void RankRequestIfEnabled(InterfaceRequest &request)
+{
+	{
+		std::scoped_lock<std::mutex> lock(g_RankedRequestsLock);
+
+		if (false == g_RankServers || false == NeedsRanking(request))
+		{
+			g_RankedRequests.erase(request.luid.Value);
+			return;
+		}
+
+		g_RankedRequests[request.luid.Value] = request;
+	}
+
+	const auto operation = std::string("Rank DNS servers for ").append(request.description);
+
+	ConfineOperation(operation.c_str(), g_LogSink, [&request]()
+	{
+		request = RankRequest(request);
+	});
+}
+
+//
+// Invoked periodically while ranking is enabled.
+//
+void RerankRequests()
+{
+	std::vector<InterfaceRequest> requests;
+
+	{
+		std::scoped_lock<std::mutex> lock(g_RankedRequestsLock);
+
+		for (const auto &entry : g_RankedRequests)
+		{
+			requests.push_back(entry.second);
+		}
+	}
+
+	bool modified = false;
+
+	for (const auto &request : requests)
+	{
+		//
+		// Don't hold up other requests while probing.
+		//
+
+		InterfaceRequest ranked;
+
+		const auto operation = std::string("Rank DNS servers for ").append(request.description);
+
+		if (false == ConfineOperation(operation.c_str(), g_LogSink, [&]()
+		{
+			ranked = RankRequest(request);
+		}))
+		{
+			continue;
+		}
+
+		const InterfaceOperation interfaceOperation(request.luid);
+
+		//
+		// Skip the interface if it was reconfigured or restored in the meantime.
+		//
+
+		{
+			std::scoped_lock<std::mutex> rankedLock(g_RankedRequestsLock);
+
+			const auto current = g_RankedRequests.find(request.luid.Value);
+
+			if (g_RankedRequests.end() == current || false == Equal(current->second.wanted, request.wanted))
+			{
+				continue;
+			}
+		}
+
+		{
+			std::scoped_lock<std::mutex> appliedLock(g_AppliedSettingsLock);
+
+			const auto applied = g_AppliedSettings.find(request.luid.Value);
+
+			if (g_AppliedSettings.end() != applied && Equal(applied->second, ranked.wanted))
+			{
+				continue;
+			}
+		}
+
+		ApplyInterfaceSettings(ranked, [&ranked]()
+		{
+			return GetAdapterDnsAddresses(ranked.luid);
+		}, modified);
+	}
+
+	if (modified)
+	{
+		FlushResolverCacheIfEnabled();
+	}
+}
+
+} // anonymous namespace
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_Initialize(
+	MullvadLogSink logSink,
+	void *logSinkContext,
+	WINDNS_BACKEND backend,
+	const wchar_t *snapshotPath
+)
+{
+	if (g_LogSink)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_LogSink = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext);
+		g_Statistics.reset();
+
+		try
+		{
+			g_DnsConfig = CreateDnsConfig(backend, g_LogSink);
+			g_Snapshot = std::make_unique<DnsSnapshot>(nullptr == snapshotPath ? L"" : snapshotPath, g_LogSink);
+		}
+		catch (...)
+		{
+			g_DnsConfig.reset();
+			g_LogSink.reset();
+			throw;
+		}
+
+		if (false == g_Snapshot->empty())
+		{
+			g_LogSink->info("Restoring DNS settings left behind by a previous session");
+
+			RestoreSnapshot();
+		}
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		if (nullptr != logSink)
+		{
+			const auto msg = std::string("Failed to initialize WinDns: ").append(err.what());
+			logSink(MULLVAD_LOG_LEVEL_ERROR, msg.c_str(), logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		if (nullptr != logSink)
+		{
+			const std::string msg("Failed to initialize WinDns: Unspecified error");
+			logSink(MULLVAD_LOG_LEVEL_ERROR, msg.c_str(), logSinkContext);
+		}
+
+		return false;
+	}
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_Deinitialize(
+)
+{
+	if (nullptr == g_LogSink)
+	{
+		return true;
+	}
+
+	g_DnsMonitor.reset();
+
+	{
+		std::scoped_lock<std::mutex> lock(g_ServerRankingLock);
+
+		g_ServerRanking.reset();
+		g_RankServers = false;
+	}
+
+	const auto status = RestoreSnapshot();
+
+	{
+		std::scoped_lock<std::mutex> lock(g_RankedRequestsLock);
+
+		g_RankedRequests.clear();
+	}
+
+	g_Snapshot.reset();
+	g_AppliedSettings.clear();
+	g_DnsConfig.reset();
+	g_LogSink.reset();
+
+	return status;
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_Restore(
+)
+{
+	if (nullptr == g_LogSink)
+	{
+		return false;
+	}
+
+	return RestoreSnapshot();
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_Set(
+	const wchar_t *interfaceAlias,
+	const wchar_t **ipv4Servers,
+	uint32_t numIpv4Servers,
+	const wchar_t **ipv6Servers,
+	uint32_t numIpv6Servers
+)
+{
+	if (nullptr == g_LogSink)
+	{
+		return false;
+	}
+
+	g_Statistics.increment(Statistics::Counter::SetRequests);
+
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("windns.set");
+
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordDns);
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	bool succeeded = false;
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&]()
+	{
+		shared::tracing::DnsSet(stopwatch, 1, succeeded);
+	};
+
+	const auto started = std::chrono::steady_clock::now();
+	std::vector<Phase> phases;
+
+	const auto description = std::string("adapter with alias \"")
+		.append(common::string::ToAnsi(interfaceAlias)).append("\"");
+
+	InterfaceRequest request;
+
+	{
+		const auto operation = std::string("Evaluate DNS settings for ").append(description);
+
+		const auto status = ConfineOperation(operation.c_str(), g_LogSink, [&]()
+		{
+			Statistics::ScopedTimer timer(g_Statistics, Statistics::Operation::AdapterLookup);
+
+			if (false == WaitForInterface(interfaceAlias, HasServers(ipv4Servers, numIpv4Servers),
+				HasServers(ipv6Servers, numIpv6Servers), INTERFACE_READY_TIMEOUT))
+			{
+				g_LogSink->warning(std::string("Gave up waiting for ").append(description)
+					.append(" to become ready").c_str());
+			}
+
+			request = MakeInterfaceRequest(ResolveInterfaceLuid(interfaceAlias), std::string(description),
+				ipv4Servers, numIpv4Servers, ipv6Servers, numIpv6Servers);
+		});
+
+		if (false == status)
+		{
+			g_Statistics.increment(Statistics::Counter::Failed);
+			return false;
+		}
+	}
+
+	phases.emplace_back("lookup", std::chrono::steady_clock::now());
+
+	const InterfaceOperation interfaceOperation(request.luid);
+
+	phases.emplace_back("lock wait", std::chrono::steady_clock::now());
+
+	RankRequestIfEnabled(request);
+
+	phases.emplace_back("ranking", std::chrono::steady_clock::now());
+
+	bool modified = false;
+
+	const auto status = ApplyInterfaceSettings(request, [&request]()
+	{
+		Statistics::ScopedTimer timer(g_Statistics, Statistics::Operation::Verification);
+		return GetAdapterDnsAddresses(request.luid);
+	}, modified);
+
+	phases.emplace_back("apply", std::chrono::steady_clock::now());
+
+	if (modified)
+	{
+		FlushResolverCacheIfEnabled();
+	}
+
+	phases.emplace_back("flush", std::chrono::steady_clock::now());
+
+	succeeded = status;
+
+	std::stringstream details;
+
+	details << "interface: " << description
+		<< ", IPv4 servers: " << numIpv4Servers
+		<< ", IPv6 servers: " << numIpv6Servers
+		<< ", modified: " << (modified ? "yes" : "no")
+		<< ", succeeded: " << (status ? "yes" : "no");
+
+	CheckSetBudget("DNS set", started, phases, details.str());
+
+	return status;
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetBatch(
+	const WINDNS_INTERFACE_SETTINGS *settings,
+	uint32_t numSettings
+)
+{
+	if (nullptr == g_LogSink || (nullptr == settings && 0 != numSettings))
+	{
+		return false;
+	}
+
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("windns.setbatch");
+
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordDns);
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	bool status = true;
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&]()
+	{
+		shared::tracing::DnsSet(stopwatch, numSettings, status);
+	};
+
+	const auto started = std::chrono::steady_clock::now();
+	std::vector<Phase> phases;
+
+	std::vector<InterfaceRequest> requests;
+
+	for (uint32_t i = 0; i < numSettings; ++i)
+	{
+		g_Statistics.increment(Statistics::Counter::SetRequests);
+
+		const auto &entry = settings[i];
+
+		NET_LUID luid;
+		luid.Value = entry.interfaceLuid;
+
+		std::stringstream ss;
+
+		ss << "adapter with LUID 0x" << std::hex << luid.Value;
+
+		const auto operation = std::string("Evaluate DNS settings for ").append(ss.str());
+
+		const auto converted = ConfineOperation(operation.c_str(), g_LogSink, [&]()
+		{
+			Statistics::ScopedTimer timer(g_Statistics, Statistics::Operation::AdapterLookup);
+
+			if (false == WaitForInterface(luid, HasServers(entry.ipv4Servers, entry.numIpv4Servers),
+				HasServers(entry.ipv6Servers, entry.numIpv6Servers), INTERFACE_READY_TIMEOUT))
+			{
+				g_LogSink->warning(std::string("Gave up waiting for ").append(ss.str())
+					.append(" to become ready").c_str());
+			}
+
+			requests.emplace_back(MakeInterfaceRequest(luid, ss.str(), entry.ipv4Servers, entry.numIpv4Servers,
+				entry.ipv6Servers, entry.numIpv6Servers));
+		});
+
+		if (false == converted)
+		{
+			g_Statistics.increment(Statistics::Counter::Failed);
+			status = false;
+		}
+	}
+
+	//
+	// Interfaces are configured concurrently. Requests for the same interface
+	// are applied in the order they were given.
+	//
+
+	phases.emplace_back("lookup", std::chrono::steady_clock::now());
+
+	std::unordered_map<ULONG64, std::vector<InterfaceRequest *>> interfaces;
+
+	for (auto &request : requests)
+	{
+		interfaces[request.luid.Value].push_back(&request);
+	}
+
+	struct Outcome
+	{
+		bool applied;
+		bool modified;
+	};
+
+	std::vector<std::future<Outcome>> outcomes;
+
+	for (const auto &entry : interfaces)
+	{
+		outcomes.emplace_back(std::async(std::launch::async, [&interfaceRequests = entry.second]()
+		{
+			Outcome outcome{ true, false };
+
+			const InterfaceOperation interfaceOperation(interfaceRequests.front()->luid);
+
+			for (auto request : interfaceRequests)
+			{
+				RankRequestIfEnabled(*request);
+
+				const auto applied = ApplyInterfaceSettings(*request, [request]()
+				{
+					Statistics::ScopedTimer timer(g_Statistics, Statistics::Operation::Verification);
+					return GetAdapterDnsAddresses(request->luid);
+				}, outcome.modified);
+
+				outcome.applied = outcome.applied && applied;
+			}
+
+			return outcome;
+		}));
+	}
+
+	bool modified = false;
+
+	for (auto &outcome : outcomes)
+	{
+		const auto result = outcome.get();
+
+		status = status && result.applied;
+		modified = modified || result.modified;
+	}
+
+	phases.emplace_back("apply", std::chrono::steady_clock::now());
+
+	if (modified)
+	{
+		FlushResolverCacheIfEnabled();
+	}
+
+	phases.emplace_back("flush", std::chrono::steady_clock::now());
+
+	std::stringstream details;
+
+	details << "requests: " << numSettings
+		<< ", interfaces: " << interfaces.size()
+		<< ", modified: " << (modified ? "yes" : "no")
+		<< ", succeeded: " << (status ? "yes" : "no");
+
+	CheckSetBudget("DNS batch set", started, phases, details.str());
+
+	return status;
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetResolverCacheFlush(
+	bool enabled
+)
+{
+	g_FlushResolverCache = enabled;
+
+	return true;
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetLatencyBudget(
+	uint32_t setMs
+)
+{
+	g_SetBudgetMs = setMs;
+
+	return true;
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetServerRanking(
+	bool enabled,
+	uint32_t rerankIntervalMs
+)
+{
+	if (nullptr == g_LogSink)
+	{
+		return false;
+	}
+
+	std::scoped_lock<std::mutex> lock(g_ServerRankingLock);
+
+	//
+	// Wait for any re-ranking in progress before changing anything.
+	//
+	g_ServerRanking.reset();
+
+	g_RankServers = enabled;
+
+	if (false == enabled)
+	{
+		std::scoped_lock<std::mutex> rankedLock(g_RankedRequestsLock);
+
+		g_RankedRequests.clear();
+
+		return true;
+	}
+
+	if (0 == rerankIntervalMs)
+	{
+		return true;
+	}
+
+	return ConfineOperation("Schedule re-ranking of DNS servers", g_LogSink, [rerankIntervalMs]()
+	{
+		g_ServerRanking = std::make_unique<ServerRanking>(std::chrono::milliseconds(rerankIntervalMs), RerankRequests);
+	});
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_Monitor(
+	const wchar_t *interfaceAlias,
+	WinDnsConfigDriftCallback callback,
+	void *context
+)
+{
+	if (nullptr == g_LogSink)
+	{
+		return false;
+	}
+
+	g_DnsMonitor.reset();
+
+	if (nullptr == callback)
+	{
+		return true;
+	}
+
+	const auto operation = std::string("Monitor DNS settings on adapter with alias \"")
+		.append(common::string::ToAnsi(interfaceAlias)).append("\"");
+
+	return ConfineOperation(operation.c_str(), g_LogSink, [&]()
+	{
+		const auto luid = ResolveInterfaceLuid(interfaceAlias);
+
+		//
+		// Last drifted state that was reported.
+		// Shared with the monitor thread but never accessed concurrently.
+		//
+		auto reported = std::make_shared<std::optional<AdapterDnsAddresses>>();
+
+		g_DnsMonitor = std::make_unique<DnsMonitor>(luid, [luid, callback, context, reported]()
+		{
+			AdapterDnsAddresses expected;
+
+			{
+				std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock);
+
+				const auto applied = g_AppliedSettings.find(luid.Value);
+
+				if (g_AppliedSettings.end() == applied)
+				{
+					return;
+				}
+
+				expected = applied->second;
+			}
+
+			//
+			// Nothing to enforce if the adapter was set to use DHCP.
+			//
+			if (expected.ipv4.empty() && expected.ipv6.empty())
+			{
+				return;
+			}
+
+			const auto active = GetAdapterDnsAddresses(luid);
+
+			if (Equal(active, expected))
+			{
+				reported->reset();
+				return;
+			}
+
+			if (reported->has_value() && Equal(reported->value(), active))
+			{
+				return;
+			}
+
+			*reported = active;
+
+			//
+			// The applied settings are no longer in effect, so drop them from the cache.
+			// Otherwise WinDns_Set would skip reapplying the same settings.
+			// Leave them if they were replaced in the meantime.
+			//
+			{
+				std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock);
+
+				const auto applied = g_AppliedSettings.find(luid.Value);
+
+				if (g_AppliedSettings.end() != applied && Equal(applied->second, expected))
+				{
+					g_AppliedSettings.erase(applied);
+				}
+			}
+
+			callback(context);
+		});
+	});
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_GetStatistics(
+	WINDNS_STATISTICS *statistics,
+	bool reset
+)
+{
+	if (nullptr == g_LogSink || nullptr == statistics)
+	{
+		return false;
+	}
+
+	*statistics = g_Statistics.snapshot(reset);
+
+	return true;
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_GetPerformanceCounters(
+	MullvadCounterSink sink,
+	void *context
+)
+{
+	if (nullptr == sink)
+	{
+		return false;
+	}
+
+	try
+	{
+		shared::performance::CounterRegistry::Instance().snapshot(sink, context);
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_CollectNativeDiagnostics(
+	uint8_t *buffer,
+	uint32_t *size
+)
+{
+	if (nullptr == buffer || nullptr == size)
+	{
+		return false;
+	}
+
+	try
+	{
+		using Record = shared::diagnostics::BlobWriter::Record;
+
+		shared::diagnostics::BlobWriter writer(buffer, *size, MULLVAD_DIAGNOSTICS_MODULE_WINDNS);
+
+		{
+			std::scoped_lock<std::mutex> lock(g_AppliedSettingsLock);
+
+			for (const auto &applied : g_AppliedSettings)
+			{
+				Record record(MULLVAD_DIAGNOSTICS_SECTION_DNS_SETTINGS);
+
+				record.u(applied.first).u(applied.second.ipv4.size());
+
+				for (const auto &server : applied.second.ipv4)
+				{
+					record.b(&server, sizeof(server));
+				}
+
+				record.u(applied.second.ipv6.size());
+
+				for (const auto &server : applied.second.ipv6)
+				{
+					record.b(&server, sizeof(server));
+				}
+
+				writer.write(record);
+			}
+		}
+
+		writer.writeCounters();
+
+		*size = static_cast<uint32_t>(writer.finish());
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		if (nullptr != g_LogSink)
+		{
+			g_LogSink->error(err.what());
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <libshared/logging/logsink.h>
+#include <libshared/performance/countersink.h>
 #include <stdint.h>
 
 //
@@ -15,29 +16,62 @@
 
 #define WINDNS_API __stdcall
 
+enum WINDNS_BACKEND
+{
+	// Use the native backend if supported by the system, otherwise netsh.
+	WINDNS_BACKEND_AUTO = 0,
+
+	// Spawn netsh.exe for every update.
+	WINDNS_BACKEND_NETSH = 1,
+
+	// Use the IP Helper DNS settings API. Requires Windows 10 2004 or later.
+	WINDNS_BACKEND_NATIVE = 2,
+
+	// Feed commands to a long-lived netsh.exe process.
+	// Reverts to WINDNS_BACKEND_NETSH if the process fails.
+	WINDNS_BACKEND_NETSH_PERSISTENT = 3,
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Functions
 ///////////////////////////////////////////////////////////////////////////////
 
+//
+// Between WinDns_Initialize() and WinDns_Deinitialize(), functions may be called
+// from any number of threads. Calls that configure different adapters run in
+// parallel, while calls for the same adapter take turns. WinDns_Restore() waits
+// for calls that are in progress, and holds off new ones until it's done.
+//
+
 //
 // WinDns_Initialize:
 //
 // Call this function once at startup, to acquire resources etc.
 // The error callback is OPTIONAL.
 //
+// 'backend' selects how settings are applied. Initialization fails if
+// WINDNS_BACKEND_NATIVE is requested but not supported.
+//
+// 'snapshotPath' is OPTIONAL and names a file where the original settings of
+// modified adapters are kept. If a snapshot is left behind from a previous
+// session, e.g. because of a crash, the settings in it are restored here.
+//
 extern "C"
 WINDNS_LINKAGE
 bool
 WINDNS_API
 WinDns_Initialize(
 	MullvadLogSink logSink,
-	void *logSinkContext
+	void *logSinkContext,
+	WINDNS_BACKEND backend,
+	const wchar_t *snapshotPath
 );
 
 //
 // WinDns_Deinitialize:
 //
 // Call this function once before unloading WINDNS or exiting the process.
+// Any adapters that have been modified are restored.
 //
 extern "C"
 WINDNS_LINKAGE
@@ -51,6 +85,9 @@ WinDns_Deinitialize(
 //
 // Configure DNS servers on given adapter.
 //
+// An adapter that was just created is given a few seconds to appear
+// and be bound to the families that servers are given for.
+//
 extern "C"
 WINDNS_LINKAGE
 bool
@@ -62,3 +99,220 @@ WinDns_Set(
 	const wchar_t **ipv6Servers,
 	uint32_t numIpv6Servers
 );
+
+typedef struct tag_WINDNS_INTERFACE_SETTINGS
+{
+	uint64_t interfaceLuid;
+
+	// A null or empty list of servers reverts the family to using DHCP.
+	const wchar_t **ipv4Servers;
+	uint32_t numIpv4Servers;
+	const wchar_t **ipv6Servers;
+	uint32_t numIpv6Servers;
+}
+WINDNS_INTERFACE_SETTINGS;
+
+//
+// WinDns_SetBatch:
+//
+// Configure DNS servers on several adapters.
+// Only the adapters in the batch are read, never all adapters on the system.
+// The adapters are configured in parallel.
+//
+// Every entry is processed even if some fail. Returns true if all entries succeed.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetBatch(
+	const WINDNS_INTERFACE_SETTINGS *settings,
+	uint32_t numSettings
+);
+
+//
+// WinDns_Restore:
+//
+// Restore the original settings on all adapters that have been modified
+// using WinDns_Set.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_Restore(
+);
+
+//
+// WinDns_Monitor:
+//
+// Watch an adapter for changes made by other parties, i.e. DHCP or other software,
+// after settings have been applied using WinDns_Set.
+//
+// The callback is invoked only when the effective servers no longer match
+// the servers most recently applied. It's invoked once per distinct drifted state.
+//
+// The expected response is to call WinDns_Set again, with the same settings.
+// The drifted settings are no longer considered applied, so they are reapplied
+// rather than skipped as unchanged.
+//
+// Only one adapter can be monitored at a time. Calling this function replaces
+// any previous monitor. Pass a null callback to stop monitoring.
+//
+typedef void (WINDNS_API *WinDnsConfigDriftCallback)(void *context);
+
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_Monitor(
+	const wchar_t *interfaceAlias,
+	WinDnsConfigDriftCallback callback,
+	void *context
+);
+
+typedef struct tag_WINDNS_TIMING
+{
+	uint32_t count;
+	uint64_t totalMicroseconds;
+	uint64_t maxMicroseconds;
+	uint64_t lastMicroseconds;
+}
+WINDNS_TIMING;
+
+typedef struct tag_WINDNS_STATISTICS
+{
+	// Calls to WinDns_Set.
+	uint32_t setRequests;
+
+	// Calls that returned early because the same servers were applied most recently.
+	uint32_t skippedCached;
+
+	// Calls that returned early because the adapter already had the requested servers.
+	uint32_t skippedUpToDate;
+
+	// Calls that updated the adapter.
+	uint32_t applied;
+
+	// Calls that failed at any stage.
+	uint32_t failed;
+
+	// Resolver cache flushes that were completed and that failed, respectively.
+	uint32_t cacheFlushes;
+	uint32_t cacheFlushFailures;
+
+	// Resolving the interface and parsing the requested servers.
+	WINDNS_TIMING adapterLookup;
+
+	// Reading the servers currently in effect on the adapter.
+	WINDNS_TIMING verification;
+
+	// Applying settings, per family.
+	WINDNS_TIMING ipv4Apply;
+	WINDNS_TIMING ipv6Apply;
+
+	// Flushing the resolver cache.
+	WINDNS_TIMING cacheFlush;
+}
+WINDNS_STATISTICS;
+
+//
+// WinDns_SetResolverCacheFlush:
+//
+// Enable or disable flushing the DNS client cache whenever servers are
+// changed by WinDns_Set, WinDns_SetBatch or WinDns_Restore.
+// Batches are flushed once. Disabled by default.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetResolverCacheFlush(
+	bool enabled
+);
+
+//
+// WinDns_SetLatencyBudget:
+//
+// Log a single detailed warning whenever WinDns_Set or WinDns_SetBatch takes
+// longer than `setMs`. The warning breaks down where the time was spent.
+// Zero disables the check, which is the default.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetLatencyBudget(
+	uint32_t setMs
+);
+
+//
+// WinDns_SetServerRanking:
+//
+// Enable or disable ordering DNS servers on latency. Disabled by default.
+//
+// When enabled, WinDns_Set and WinDns_SetBatch probe the servers of any family
+// that is given more than one server, using a small DNS query, and apply them
+// fastest first. Servers that don't answer are placed last.
+//
+// If 'rerankIntervalMs' is not zero, the servers are probed again at that interval
+// and adapters are updated if the order has changed.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_SetServerRanking(
+	bool enabled,
+	uint32_t rerankIntervalMs
+);
+
+//
+// WinDns_GetStatistics:
+//
+// Retrieve statistics accumulated since WinDns_Initialize, or since the
+// last call that specified 'reset'.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_GetStatistics(
+	WINDNS_STATISTICS *statistics,
+	bool reset
+);
+
+//
+// WinDns_GetPerformanceCounters:
+//
+// Invoke the sink once with a snapshot of all performance counters
+// registered by windns.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_GetPerformanceCounters(
+	MullvadCounterSink sink,
+	void *context
+);
+
+//
+// WinDns_CollectNativeDiagnostics:
+//
+// Write the DNS state into 'buffer', as a compact binary blob for problem reports.
+// See libshared/diagnostics/diagnosticsblob.h for the format.
+//
+// The blob includes the servers most recently applied to each interface and all
+// performance counters. Specify the size of 'buffer' in 'size'. The size is a hard
+// cap: records that don't fit are left out, and the blob is marked as truncated.
+// On return, 'size' holds the size of the blob.
+//
+extern "C"
+WINDNS_LINKAGE
+bool
+WINDNS_API
+WinDns_CollectNativeDiagnostics(
+	uint8_t *buffer,
+	uint32_t *size
+);
@@ -0,0 +1,460 @@
+// benchmark.cpp : Replays scripted policy transitions and reports apply latency,
+// or the cost of classifying traffic under each policy.
+//
+
+#include "stdafx.h"
+#include "traffic.h"
+#include "winfw/winfw.h"
+#include "libwfp/filterengine.h"
+#include "libwfp/objectenumerator.h"
+#include <libcommon/string.h>
+#include <libcommon/error.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+//
+// Must match the provider in winfw/mullvadguids.cpp
+//
+const GUID MULLVAD_PROVIDER =
+{
+	0x21e1dab8,
+	0xb9db,
+	0x43c0,
+	{ 0xb3, 0x43, 0xeb, 0x93, 0x65, 0xc7, 0xbd, 0xd2 }
+};
+
+struct Options
+{
+	size_t iterations = 100;
+	size_t relays = 1;
+	size_t pingableHosts = 1;
+	uint32_t timeout = 0;
+	std::vector<std::wstring> script = { L"connecting", L"connected", L"blocked" };
+	std::wstring tunnel;
+	bool permitLan = false;
+	bool permitDhcp = true;
+
+	bool traffic = false;
+	traffic::Load load = { 2000, 100000, std::nullopt, 9 };
+};
+
+struct Sample
+{
+	uint64_t latencyUs;
+	uint64_t objectsAdded;
+	uint64_t objectsRemoved;
+};
+
+void PrintUsage()
+{
+	std::wcout << L"Usage: benchmark [key=value ...]" << std::endl
+		<< std::endl
+		<< L"  iterations=N     Number of times to replay the script (default 100)" << std::endl
+		<< L"  relays=N         Number of distinct relays to cycle through (default 1)" << std::endl
+		<< L"  hosts=N          Number of pingable hosts when connecting (default 1)" << std::endl
+		<< L"  script=a,b,...   Sequence of connecting/connected/blocked (default connecting,connected,blocked)" << std::endl
+		<< L"  tunnel=alias     Tunnel interface alias, required for 'connected'" << std::endl
+		<< L"  lan=yes|no       Permit LAN (default no)" << std::endl
+		<< L"  dhcp=yes|no      Permit DHCP (default yes)" << std::endl
+		<< L"  timeout=N        Transaction lock timeout in seconds (default 0)" << std::endl
+		<< std::endl
+		<< L"  traffic=yes|no   Measure traffic under each policy in the script, rather than apply latency (default no)" << std::endl
+		<< L"  connects=N       TCP connections made per measurement (default 2000)" << std::endl
+		<< L"  packets=N        UDP packets sent per measurement (default 100000)" << std::endl
+		<< L"  lanhost=ip       Host on the local network to also send traffic to" << std::endl
+		<< L"  lanport=N        Port on the LAN host (default 9)" << std::endl;
+}
+
+Options ParseOptions(int argc, wchar_t *argv[])
+{
+	std::vector<std::wstring> arguments(argv + 1, argv + argc);
+
+	Options options;
+
+	for (const auto &pair : common::string::SplitKeyValuePairs(arguments))
+	{
+		const auto key = common::string::Lower(pair.first);
+		const auto &value = pair.second;
+
+		if (0 == key.compare(L"iterations"))
+		{
+			options.iterations = common::string::LexicalCast<size_t>(value);
+		}
+		else if (0 == key.compare(L"relays"))
+		{
+			options.relays = std::max<size_t>(1, common::string::LexicalCast<size_t>(value));
+		}
+		else if (0 == key.compare(L"hosts"))
+		{
+			options.pingableHosts = common::string::LexicalCast<size_t>(value);
+		}
+		else if (0 == key.compare(L"script"))
+		{
+			options.script = common::string::Tokenize(value, L",");
+		}
+		else if (0 == key.compare(L"tunnel"))
+		{
+			options.tunnel = value;
+		}
+		else if (0 == key.compare(L"lan"))
+		{
+			options.permitLan = (0 == _wcsicmp(value.c_str(), L"yes"));
+		}
+		else if (0 == key.compare(L"dhcp"))
+		{
+			options.permitDhcp = (0 == _wcsicmp(value.c_str(), L"yes"));
+		}
+		else if (0 == key.compare(L"timeout"))
+		{
+			options.timeout = common::string::LexicalCast<uint32_t>(value);
+		}
+		else if (0 == key.compare(L"traffic"))
+		{
+			options.traffic = (0 == _wcsicmp(value.c_str(), L"yes"));
+		}
+		else if (0 == key.compare(L"connects"))
+		{
+			options.load.connects = common::string::LexicalCast<size_t>(value);
+		}
+		else if (0 == key.compare(L"packets"))
+		{
+			options.load.packets = common::string::LexicalCast<size_t>(value);
+		}
+		else if (0 == key.compare(L"lanhost"))
+		{
+			options.load.lanHost = value;
+		}
+		else if (0 == key.compare(L"lanport"))
+		{
+			options.load.lanPort = common::string::LexicalCast<uint16_t>(value);
+		}
+		else
+		{
+			THROW_ERROR("Unsupported argument");
+		}
+	}
+
+	for (const auto &step : options.script)
+	{
+		if (0 == _wcsicmp(step.c_str(), L"connected") && options.tunnel.empty())
+		{
+			THROW_ERROR("The 'connected' policy requires a tunnel interface alias");
+		}
+	}
+
+	return options;
+}
+
+//
+// Addresses are taken from the range reserved for benchmarking (RFC 2544).
+//
+std::vector<std::wstring> GenerateAddresses(const std::wstring &prefix, size_t count)
+{
+	std::vector<std::wstring> addresses;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::wstringstream ss;
+		ss << prefix << ((i / 254) % 256) << L'.' << ((i % 254) + 1);
+
+		addresses.push_back(ss.str());
+	}
+
+	return addresses;
+}
+
+size_t CountInstalledFilters()
+{
+	auto engine = wfp::FilterEngine::DynamicSession();
+
+	size_t count = 0;
+
+	wfp::ObjectEnumerator::Filters(*engine, [&count](const FWPM_FILTER0 &filter)
+	{
+		if (nullptr != filter.providerKey && MULLVAD_PROVIDER == *filter.providerKey)
+		{
+			++count;
+		}
+
+		return true;
+	});
+
+	return count;
+}
+
+uint64_t Percentile(std::vector<uint64_t> sorted, double percentile)
+{
+	if (sorted.empty())
+	{
+		return 0;
+	}
+
+	const auto index = static_cast<size_t>(percentile * (sorted.size() - 1) + 0.5);
+
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void Report(const std::wstring &policy, const std::vector<Sample> &samples)
+{
+	std::vector<uint64_t> latencies;
+
+	uint64_t added = 0;
+	uint64_t removed = 0;
+
+	for (const auto &sample : samples)
+	{
+		latencies.push_back(sample.latencyUs);
+
+		added += sample.objectsAdded;
+		removed += sample.objectsRemoved;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	std::wcout << policy << L":" << std::endl
+		<< L"  samples:\t\t" << samples.size() << std::endl
+		<< L"  p50:\t\t\t" << Percentile(latencies, 0.50) << L" us" << std::endl
+		<< L"  p99:\t\t\t" << Percentile(latencies, 0.99) << L" us" << std::endl
+		<< L"  max:\t\t\t" << (latencies.empty() ? 0 : latencies.back()) << L" us" << std::endl
+		<< L"  objects added:\t" << (samples.empty() ? 0 : added / samples.size()) << L" (mean)" << std::endl
+		<< L"  objects removed:\t" << (samples.empty() ? 0 : removed / samples.size()) << L" (mean)" << std::endl;
+}
+
+void ReportRate(const wchar_t *name, const traffic::Rate &rate, const traffic::Rate *baseline)
+{
+	std::wcout << L"  " << name << L":\t" << static_cast<uint64_t>(rate.rate) << L"/s";
+
+	if (nullptr != baseline && baseline->rate > 0)
+	{
+		std::wcout << L" (" << std::showpos << static_cast<int64_t>((rate.rate / baseline->rate - 1) * 100)
+			<< std::noshowpos << L"% vs baseline)";
+	}
+
+	std::wcout << L", " << rate.failed << L" failed" << std::endl;
+}
+
+void ReportTraffic(const std::wstring &policy, const traffic::Result &result, const traffic::Result *baseline)
+{
+	std::wcout << policy << L":" << std::endl;
+
+	ReportRate(L"loopback tcp connects", result.loopbackConnects, (nullptr == baseline ? nullptr : &baseline->loopbackConnects));
+	ReportRate(L"loopback udp packets", result.loopbackPackets, (nullptr == baseline ? nullptr : &baseline->loopbackPackets));
+
+	if (result.lanConnects.has_value())
+	{
+		ReportRate(L"lan tcp connects", result.lanConnects.value(), (nullptr == baseline ? nullptr : &baseline->lanConnects.value()));
+		ReportRate(L"lan udp packets", result.lanPackets.value(), (nullptr == baseline ? nullptr : &baseline->lanPackets.value()));
+	}
+}
+
+void WINFW_API LogSink(MULLVAD_LOG_LEVEL level, const char *message, void *)
+{
+	if (MULLVAD_LOG_LEVEL_WARNING >= level)
+	{
+		std::cout << message << std::endl;
+	}
+}
+
+//
+// Throws if the policy is not known.
+//
+bool ApplyPolicy(const std::wstring &policy, const WinFwSettings &settings, const WinFwRelay &relay,
+	const std::vector<const wchar_t *> &hosts, const Options &options)
+{
+	if (0 == _wcsicmp(policy.c_str(), L"connecting"))
+	{
+		PingableHosts pingableHosts;
+
+		pingableHosts.tunnelInterfaceAlias = nullptr;
+		pingableHosts.hosts = const_cast<const wchar_t **>(hosts.data());
+		pingableHosts.numHosts = hosts.size();
+
+		return WinFw_ApplyPolicyConnecting(settings, relay, (hosts.empty() ? nullptr : &pingableHosts));
+	}
+	else if (0 == _wcsicmp(policy.c_str(), L"connected"))
+	{
+		return WinFw_ApplyPolicyConnected(settings, relay, options.tunnel.c_str(), L"10.64.0.1", nullptr);
+	}
+	else if (0 == _wcsicmp(policy.c_str(), L"blocked"))
+	{
+		return WinFw_ApplyPolicyBlocked(settings);
+	}
+
+	THROW_ERROR("Unknown policy in script");
+}
+
+//
+// Measure the traffic load with no policy, and then once under each distinct
+// policy in the script.
+//
+int BenchmarkTraffic(const Options &options, const WinFwSettings &settings, const WinFwRelay &relay,
+	const std::vector<const wchar_t *> &hosts)
+{
+	if (false == WinFw_Reset())
+	{
+		std::wcout << L"Failed to reset policy" << std::endl;
+		return 1;
+	}
+
+	const auto baseline = traffic::Drive(options.load);
+
+	ReportTraffic(L"baseline", baseline, nullptr);
+
+	std::set<std::wstring> measured;
+	size_t failures = 0;
+
+	for (const auto &step : options.script)
+	{
+		const auto policy = common::string::Lower(step);
+
+		if (false == measured.insert(policy).second)
+		{
+			continue;
+		}
+
+		if (false == ApplyPolicy(policy, settings, relay, hosts, options))
+		{
+			++failures;
+			continue;
+		}
+
+		std::wcout << std::endl;
+
+		ReportTraffic(policy, traffic::Drive(options.load), &baseline);
+	}
+
+	std::wcout << std::endl
+		<< L"Failed transitions:\t" << failures << std::endl
+		<< L"Filters installed after last transition:\t" << CountInstalledFilters() << std::endl;
+
+	return (0 == failures ? 0 : 1);
+}
+
+} // anonymous namespace
+
+int wmain(int argc, wchar_t *argv[])
+{
+	Options options;
+
+	try
+	{
+		options = ParseOptions(argc, argv);
+	}
+	catch (std::exception &err)
+	{
+		std::cout << "Error: " << err.what() << std::endl << std::endl;
+		PrintUsage();
+
+		return 1;
+	}
+
+	const auto relays = GenerateAddresses(L"198.18.", options.relays);
+	const auto hosts = GenerateAddresses(L"198.19.", options.pingableHosts);
+
+	std::vector<const wchar_t *> hostPointers;
+
+	for (const auto &host : hosts)
+	{
+		hostPointers.push_back(host.c_str());
+	}
+
+	WinFwSettings settings;
+
+	settings.permitDhcp = options.permitDhcp;
+	settings.permitLan = options.permitLan;
+
+	if (false == WinFw_Initialize(options.timeout, LogSink, nullptr))
+	{
+		std::wcout << L"Failed to initialize winfw" << std::endl;
+		return 1;
+	}
+
+	std::map<std::wstring, std::vector<Sample> > samples;
+	size_t failures = 0;
+	size_t step = 0;
+
+	try
+	{
+		if (options.traffic)
+		{
+			WinFwRelay relay;
+
+			relay.ip = relays.front().c_str();
+			relay.port = 1194;
+			relay.protocol = WinFwProtocol::Udp;
+
+			const auto status = BenchmarkTraffic(options, settings, relay, hostPointers);
+
+			WinFw_Deinitialize();
+
+			return status;
+		}
+
+		for (size_t iteration = 0; iteration < options.iterations; ++iteration)
+		{
+			for (const auto &policy : options.script)
+			{
+				WinFwRelay relay;
+
+				relay.ip = relays[step++ % relays.size()].c_str();
+				relay.port = 1194;
+				relay.protocol = WinFwProtocol::Udp;
+
+				const auto start = std::chrono::steady_clock::now();
+
+				const auto status = ApplyPolicy(policy, settings, relay, hostPointers, options);
+
+				const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now() - start).count();
+
+				if (false == status)
+				{
+					++failures;
+					continue;
+				}
+
+				WinFwStatistics statistics;
+
+				if (false == WinFw_GetStatistics(&statistics))
+				{
+					statistics.last.objectsAdded = 0;
+					statistics.last.objectsRemoved = 0;
+				}
+
+				samples[common::string::Lower(policy)].push_back(Sample{ static_cast<uint64_t>(latency),
+					statistics.last.objectsAdded, statistics.last.objectsRemoved });
+			}
+		}
+	}
+	catch (std::exception &err)
+	{
+		std::cout << "Error: " << err.what() << std::endl;
+		WinFw_Deinitialize();
+
+		return 1;
+	}
+
+	const auto installedFilters = CountInstalledFilters();
+
+	WinFw_Deinitialize();
+
+	for (const auto &policy : samples)
+	{
+		Report(policy.first, policy.second);
+	}
+
+	std::wcout << std::endl
+		<< L"Failed transitions:\t" << failures << std::endl
+		<< L"Filters installed after last transition:\t" << installedFilters << std::endl;
+
+	return (0 == failures ? 0 : 1);
+}
@@ -0,0 +1,396 @@
+#include "stdafx.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "traffic.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace traffic
+{
+
+namespace
+{
+
+const char PACKET_PAYLOAD[64] = { 0 };
+
+//
+// Don't wait for an unresponsive LAN host for longer than this.
+//
+const long LAN_CONNECT_TIMEOUT_MS = 1000;
+
+class Socket
+{
+public:
+
+	Socket(int family, int type, int protocol)
+		: m_socket(socket(family, type, protocol))
+	{
+		if (INVALID_SOCKET == m_socket)
+		{
+			THROW_WINDOWS_ERROR(WSAGetLastError(), "Create socket");
+		}
+	}
+
+	~Socket()
+	{
+		close();
+	}
+
+	Socket(const Socket &) = delete;
+	Socket &operator=(const Socket &) = delete;
+
+	SOCKET get() const
+	{
+		return m_socket;
+	}
+
+	//
+	// Reset the connection on close, so closed connections are not left in TIME_WAIT.
+	//
+	void abortOnClose()
+	{
+		linger l;
+
+		l.l_onoff = 1;
+		l.l_linger = 0;
+
+		setsockopt(m_socket, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char *>(&l), sizeof(l));
+	}
+
+	void close()
+	{
+		if (INVALID_SOCKET != m_socket)
+		{
+			closesocket(m_socket);
+			m_socket = INVALID_SOCKET;
+		}
+	}
+
+private:
+
+	SOCKET m_socket;
+};
+
+double PerSecond(size_t count, std::chrono::steady_clock::duration elapsed)
+{
+	const auto seconds = std::chrono::duration<double>(elapsed).count();
+
+	return (seconds > 0 ? count / seconds : 0);
+}
+
+sockaddr_in LoopbackAddress()
+{
+	sockaddr_in address = { 0 };
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	return address;
+}
+
+sockaddr_in BoundAddress(const Socket &s)
+{
+	sockaddr_in address;
+	int addressLength = sizeof(address);
+
+	if (SOCKET_ERROR == getsockname(s.get(), reinterpret_cast<sockaddr *>(&address), &addressLength))
+	{
+		THROW_WINDOWS_ERROR(WSAGetLastError(), "Query socket address");
+	}
+
+	return address;
+}
+
+void Bind(const Socket &s, const sockaddr_in &address)
+{
+	if (SOCKET_ERROR == bind(s.get(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)))
+	{
+		THROW_WINDOWS_ERROR(WSAGetLastError(), "Bind socket");
+	}
+}
+
+Rate LoopbackConnects(size_t count)
+{
+	Socket listener(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	Bind(listener, LoopbackAddress());
+
+	if (SOCKET_ERROR == listen(listener.get(), SOMAXCONN))
+	{
+		THROW_WINDOWS_ERROR(WSAGetLastError(), "Listen on socket");
+	}
+
+	const auto address = BoundAddress(listener);
+
+	//
+	// Accepting stops when the listener is closed.
+	//
+	std::thread acceptor([listening = listener.get()]()
+	{
+		for (;;)
+		{
+			const auto client = accept(listening, nullptr, nullptr);
+
+			if (INVALID_SOCKET == client)
+			{
+				break;
+			}
+
+			closesocket(client);
+		}
+	});
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&listener, &acceptor]()
+	{
+		listener.close();
+		acceptor.join();
+	};
+
+	Rate result = { 0 };
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		Socket client(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+		client.abortOnClose();
+
+		if (SOCKET_ERROR == connect(client.get(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)))
+		{
+			++result.failed;
+			continue;
+		}
+
+		++result.completed;
+	}
+
+	result.rate = PerSecond(result.completed, std::chrono::steady_clock::now() - start);
+
+	return result;
+}
+
+Rate LoopbackPackets(size_t count)
+{
+	Socket receiver(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	Bind(receiver, LoopbackAddress());
+
+	DWORD timeout = 500;
+	setsockopt(receiver.get(), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&timeout), sizeof(timeout));
+
+	int bufferSize = 4 * 1024 * 1024;
+	setsockopt(receiver.get(), SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&bufferSize), sizeof(bufferSize));
+
+	const auto address = BoundAddress(receiver);
+
+	std::atomic<size_t> received = 0;
+	std::chrono::steady_clock::time_point lastReceived;
+
+	//
+	// Receiving stops once the sender has gone quiet.
+	//
+	std::thread counter([&]()
+	{
+		char buffer[sizeof(PACKET_PAYLOAD)];
+
+		while (SOCKET_ERROR != recv(receiver.get(), buffer, sizeof(buffer), 0))
+		{
+			lastReceived = std::chrono::steady_clock::now();
+
+			if (++received == count)
+			{
+				break;
+			}
+		}
+	});
+
+	Socket sender(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		sendto(sender.get(), PACKET_PAYLOAD, sizeof(PACKET_PAYLOAD), 0,
+			reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+	}
+
+	counter.join();
+
+	Rate result;
+
+	result.completed = received;
+	result.failed = count - received;
+	result.rate = (0 == received ? 0 : PerSecond(received, lastReceived - start));
+
+	return result;
+}
+
+SOCKADDR_INET ParseLanAddress(const std::wstring &host, uint16_t port)
+{
+	SOCKADDR_INET address = { 0 };
+
+	if (1 == InetPtonW(AF_INET, host.c_str(), &address.Ipv4.sin_addr))
+	{
+		address.Ipv4.sin_family = AF_INET;
+		address.Ipv4.sin_port = htons(port);
+	}
+	else if (1 == InetPtonW(AF_INET6, host.c_str(), &address.Ipv6.sin6_addr))
+	{
+		address.Ipv6.sin6_family = AF_INET6;
+		address.Ipv6.sin6_port = htons(port);
+	}
+	else
+	{
+		THROW_ERROR("Invalid LAN host address");
+	}
+
+	return address;
+}
+
+int AddressLength(const SOCKADDR_INET &address)
+{
+	return (AF_INET == address.si_family ? sizeof(address.Ipv4) : sizeof(address.Ipv6));
+}
+
+//
+// True if the host accepted or refused the connection.
+//
+bool LanConnect(const SOCKADDR_INET &address)
+{
+	Socket client(address.si_family, SOCK_STREAM, IPPROTO_TCP);
+
+	client.abortOnClose();
+
+	u_long nonBlocking = 1;
+	ioctlsocket(client.get(), FIONBIO, &nonBlocking);
+
+	if (SOCKET_ERROR != connect(client.get(), reinterpret_cast<const sockaddr *>(&address), AddressLength(address)))
+	{
+		return true;
+	}
+
+	const auto error = WSAGetLastError();
+
+	if (WSAEWOULDBLOCK != error)
+	{
+		return WSAECONNREFUSED == error;
+	}
+
+	fd_set writable;
+	fd_set failed;
+
+	FD_ZERO(&writable);
+	FD_ZERO(&failed);
+	FD_SET(client.get(), &writable);
+	FD_SET(client.get(), &failed);
+
+	timeval timeout = { 0, LAN_CONNECT_TIMEOUT_MS * 1000 };
+
+	if (1 > select(0, nullptr, &writable, &failed, &timeout))
+	{
+		return false;
+	}
+
+	if (0 != FD_ISSET(client.get(), &writable))
+	{
+		return true;
+	}
+
+	int connectError = 0;
+	int errorLength = sizeof(connectError);
+
+	getsockopt(client.get(), SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&connectError), &errorLength);
+
+	return WSAECONNREFUSED == connectError;
+}
+
+Rate LanConnects(const SOCKADDR_INET &address, size_t count)
+{
+	Rate result = { 0 };
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (LanConnect(address))
+		{
+			++result.completed;
+		}
+		else
+		{
+			++result.failed;
+		}
+	}
+
+	result.rate = PerSecond(result.completed, std::chrono::steady_clock::now() - start);
+
+	return result;
+}
+
+Rate LanPackets(const SOCKADDR_INET &address, size_t count)
+{
+	Socket sender(address.si_family, SOCK_DGRAM, IPPROTO_UDP);
+
+	Rate result = { 0 };
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (SOCKET_ERROR == sendto(sender.get(), PACKET_PAYLOAD, sizeof(PACKET_PAYLOAD), 0,
+			reinterpret_cast<const sockaddr *>(&address), AddressLength(address)))
+		{
+			++result.failed;
+		}
+		else
+		{
+			++result.completed;
+		}
+	}
+
+	result.rate = PerSecond(result.completed, std::chrono::steady_clock::now() - start);
+
+	return result;
+}
+
+} // anonymous namespace
+
+Result Drive(const Load &load)
+{
+	WSADATA data;
+
+	if (0 != WSAStartup(MAKEWORD(2, 2), &data))
+	{
+		THROW_ERROR("Failed to initialize Winsock");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += []()
+	{
+		WSACleanup();
+	};
+
+	Result result;
+
+	result.loopbackConnects = LoopbackConnects(load.connects);
+	result.loopbackPackets = LoopbackPackets(load.packets);
+
+	if (load.lanHost.has_value())
+	{
+		const auto address = ParseLanAddress(load.lanHost.value(), load.lanPort);
+
+		result.lanConnects = LanConnects(address, load.connects);
+		result.lanPackets = LanPackets(address, load.packets);
+	}
+
+	return result;
+}
+
+}
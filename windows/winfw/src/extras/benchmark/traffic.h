@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace traffic
+{
+
+//
+// A fixed amount of work, so that runs under different policies are comparable.
+//
+struct Load
+{
+	size_t connects;
+	size_t packets;
+
+	// Address of a host on the local network, or nothing to skip LAN traffic.
+	std::optional<std::wstring> lanHost;
+	uint16_t lanPort;
+};
+
+struct Rate
+{
+	// Operations per second.
+	double rate;
+
+	size_t completed;
+	size_t failed;
+};
+
+struct Result
+{
+	Rate loopbackConnects;
+	Rate loopbackPackets;
+
+	std::optional<Rate> lanConnects;
+	std::optional<Rate> lanPackets;
+};
+
+//
+// Drive the load and measure how fast it completes.
+//
+// Loopback TCP connections are made to a local listener, and loopback UDP packets
+// are sent to a local socket and counted as they are received. LAN connections
+// count as completed when they are either accepted or refused by the host, since
+// both require the filters to classify the connection. LAN packets are sent to
+// the host and counted as they are sent.
+//
+Result Drive(const Load &load);
+
+}
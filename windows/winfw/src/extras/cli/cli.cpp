@@ -7,6 +7,7 @@
 #include "modules/imodule.h"
 #include "modules/list.h"
 #include "modules/monitor.h"
+#include "modules/snapshot.h"
 #include "modules/winfw.h"
 #include "libcommon/string.h"
 #include <iostream>
@@ -33,6 +34,9 @@ void InitializeModules()
 	auto monitor = std::make_unique<modules::Monitor>(OutputConsole);
 	g_modules.insert(std::make_pair(common::string::Lower(monitor->name()), std::move(monitor)));
 
+	auto snapshot = std::make_unique<modules::Snapshot>(OutputConsole);
+	g_modules.insert(std::make_pair(common::string::Lower(snapshot->name()), std::move(snapshot)));
+
 	auto winfw = std::make_unique<modules::WinFw>(OutputConsole);
 	g_modules.insert(std::make_pair(common::string::Lower(winfw->name()), std::move(winfw)));
 }
@@ -0,0 +1,90 @@
+#include "stdafx.h"
+#include "filterreport.h"
+#include "cli/filterengineprovider.h"
+#include "cli/inlineformatter.h"
+#include "cli/propertydecorator.h"
+#include "cli/propertylist.h"
+#include "winfw/winfw.h"
+#include <libcommon/error.h>
+#include <vector>
+
+namespace commands::list
+{
+
+FilterReport::FilterReport(MessageSink messageSink)
+	: m_messageSink(messageSink)
+{
+}
+
+std::wstring FilterReport::name()
+{
+	return L"filterreport";
+
+}
+
+std::wstring FilterReport::description()
+{
+	return L"Provides Mullvad filter and condition counts per layer and sublayer.";
+}
+
+void FilterReport::handleRequest(const std::vector<std::wstring> &arguments)
+{
+	if (false == arguments.empty())
+	{
+		THROW_ERROR("Unsupported argument(s). Cannot complete request.");
+	}
+
+	std::vector<WinFwFilterLayerReport> entries;
+	uint32_t numEntries = 0;
+
+	for (;;)
+	{
+		entries.resize(numEntries);
+
+		const auto status = WinFw_GetFilterReport(entries.data(), &numEntries);
+
+		if (WINFW_REPORT_STATUS_SUCCESS == status)
+		{
+			entries.resize(numEntries);
+			break;
+		}
+
+		if (WINFW_REPORT_STATUS_BUFFER_TOO_SMALL != status)
+		{
+			THROW_ERROR("Failed to retrieve filter report");
+		}
+	}
+
+	PrettyPrintOptions options;
+
+	options.indent = 2;
+	options.useSeparator = true;
+
+	PropertyDecorator decorator(FilterEngineProvider::Instance().get());
+	InlineFormatter f;
+
+	uint32_t totalFilters = 0;
+	uint32_t totalConditions = 0;
+
+	for (const auto &entry : entries)
+	{
+		m_messageSink(L"Layer");
+
+		PropertyList props;
+
+		props.add(L"layer", decorator.LayerDecoration(entry.layer));
+		props.add(L"sublayer", decorator.SublayerDecoration(entry.sublayer));
+		props.add(L"filters", (f << entry.numFilters).str());
+		props.add(L"conditions", (f << entry.numConditions).str());
+		props.add(L"max conditions per filter", (f << entry.maxConditions).str());
+
+		PrettyPrintProperties(m_messageSink, options, props);
+
+		totalFilters += entry.numFilters;
+		totalConditions += entry.numConditions;
+	}
+
+	m_messageSink((f << L"Total: " << totalFilters << L" filter(s), " << totalConditions << L" condition(s)").str());
+}
+
+}
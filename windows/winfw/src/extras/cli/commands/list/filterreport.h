@@ -0,0 +1,25 @@
+#pragma once
+
+#include "cli/commands/icommand.h"
+#include "cli/util.h"
+
+namespace commands::list
+{
+
+class FilterReport : public ICommand
+{
+public:
+
+	FilterReport(MessageSink messageSink);
+
+	std::wstring name() override;
+	std::wstring description() override;
+
+	void handleRequest(const std::vector<std::wstring> &arguments) override;
+
+private:
+
+	MessageSink m_messageSink;
+};
+
+}
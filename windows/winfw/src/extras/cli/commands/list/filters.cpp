@@ -2,13 +2,169 @@
 #include "filters.h"
 #include "cli/objectproperties.h"
 #include "cli/filterengineprovider.h"
+#include "cli/inlineformatter.h"
 #include "cli/propertydecorator.h"
-#include "libwfp/objectenumerator.h"
+#include "cli/orderedformatter.h"
 #include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libcommon/string.h>
+#include <fwpmu.h>
+#include <objbase.h>
+#include <functional>
+#include <memory>
+#include <optional>
 
 namespace commands::list
 {
 
+namespace
+{
+
+//
+// Number of filters retrieved from BFE per enumeration call.
+// This bounds memory use regardless of the number of filters in the system.
+//
+const UINT32 ENUM_CHUNK_SIZE = 100;
+
+GUID ParseGuid(const std::wstring &value)
+{
+	GUID guid;
+
+	if (NOERROR != CLSIDFromString(value.c_str(), &guid))
+	{
+		THROW_ERROR("Invalid GUID argument. Expected format: {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}");
+	}
+
+	return guid;
+}
+
+std::optional<GUID> OptionalGuidArgument(const common::string::KeyValuePairs &arguments, const std::wstring &key)
+{
+	const auto arg = arguments.find(key);
+
+	if (arguments.end() == arg)
+	{
+		return std::nullopt;
+	}
+
+	return ParseGuid(arg->second);
+}
+
+size_t OptionalNumericArgument(const common::string::KeyValuePairs &arguments, const std::wstring &key, size_t defaultValue)
+{
+	const auto arg = arguments.find(key);
+
+	if (arguments.end() == arg)
+	{
+		return defaultValue;
+	}
+
+	return common::string::LexicalCast<size_t>(arg->second);
+}
+
+//
+// Fields in machine readable output are tab separated and one filter is
+// printed per line, so neither can occur inside a field.
+//
+std::wstring SanitizeField(const wchar_t *value)
+{
+	if (nullptr == value)
+	{
+		return L"";
+	}
+
+	std::wstring field(value);
+
+	for (auto &c : field)
+	{
+		if (L'\t' == c || L'\r' == c || L'\n' == c)
+		{
+			c = L' ';
+		}
+	}
+
+	return field;
+}
+
+std::wstring ActionName(FWP_ACTION_TYPE action)
+{
+	switch (action)
+	{
+		case FWP_ACTION_BLOCK: return L"block";
+		case FWP_ACTION_PERMIT: return L"permit";
+		case FWP_ACTION_CALLOUT_TERMINATING: return L"callout terminating";
+		case FWP_ACTION_CALLOUT_INSPECTION: return L"callout inspection";
+		case FWP_ACTION_CALLOUT_UNKNOWN: return L"callout unknown";
+		default: return L"unknown";
+	}
+}
+
+//
+// Enumerate filters in chunks, invoking the callback once per filter.
+//
+// The callback receives the chunk that holds the filter. Keeping a reference keeps
+// the chunk alive. The number of chunks in memory is bounded by the consumer.
+//
+using FilterChunk = std::shared_ptr<FWPM_FILTER0 *>;
+
+void EnumerateFilters(wfp::FilterEngine &engine, const FWPM_FILTER_ENUM_TEMPLATE0 *enumTemplate,
+	std::function<bool(const FWPM_FILTER0 &, const FilterChunk &)> callback)
+{
+	HANDLE enumHandle = INVALID_HANDLE_VALUE;
+
+	auto status = FwpmFilterCreateEnumHandle0(engine.session(), enumTemplate, &enumHandle);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Create filter enumeration handle");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&engine, enumHandle]
+	{
+		FwpmFilterDestroyEnumHandle0(engine.session(), enumHandle);
+	};
+
+	for (;;)
+	{
+		FWPM_FILTER0 **filters = nullptr;
+		UINT32 numReturned = 0;
+
+		status = FwpmFilterEnum0(engine.session(), enumHandle, ENUM_CHUNK_SIZE, &filters, &numReturned);
+
+		if (ERROR_SUCCESS != status)
+		{
+			THROW_WINDOWS_ERROR(status, "Enumerate filters");
+		}
+
+		if (0 == numReturned)
+		{
+			return;
+		}
+
+		const FilterChunk chunk(filters, [](FWPM_FILTER0 **filters)
+		{
+			FwpmFreeMemory0(reinterpret_cast<void **>(&filters));
+		});
+
+		for (UINT32 i = 0; i < numReturned; ++i)
+		{
+			if (false == callback(*filters[i], chunk))
+			{
+				return;
+			}
+		}
+
+		if (numReturned < ENUM_CHUNK_SIZE)
+		{
+			return;
+		}
+	}
+}
+
+} // anonymous namespace
+
 Filters::Filters(MessageSink messageSink)
 	: m_messageSink(messageSink)
 {
@@ -22,31 +178,161 @@ std::wstring Filters::name()
 
 std::wstring Filters::description()
 {
-	return L"Provides a listing of all filters in the system.";
+	return L"Provides a listing of all filters in the system.\n"
+		L"Optional arguments: provider=<guid> layer=<guid> sublayer=<guid> page=<n> pagesize=<n> format=<pretty|tsv>";
 }
 
 void Filters::handleRequest(const std::vector<std::wstring> &arguments)
 {
-	if (false == arguments.empty())
+	const auto keyvalue = common::string::SplitKeyValuePairs(arguments);
+
+	if (keyvalue.size() != arguments.size())
 	{
 		THROW_ERROR("Unsupported argument(s). Cannot complete request.");
 	}
 
+	for (const auto &[key, value] : keyvalue)
+	{
+		if (key != L"provider" && key != L"layer" && key != L"sublayer"
+			&& key != L"page" && key != L"pagesize" && key != L"format")
+		{
+			THROW_ERROR("Unsupported argument(s). Cannot complete request.");
+		}
+	}
+
+	const auto provider = OptionalGuidArgument(keyvalue, L"provider");
+	const auto layer = OptionalGuidArgument(keyvalue, L"layer");
+	const auto sublayer = OptionalGuidArgument(keyvalue, L"sublayer");
+
+	const auto page = OptionalNumericArgument(keyvalue, L"page", 1);
+	const auto pageSize = OptionalNumericArgument(keyvalue, L"pagesize", 0);
+
+	if (0 == page)
+	{
+		THROW_ERROR("Invalid page number. Pages are numbered starting at 1.");
+	}
+
+	const auto format = keyvalue.find(L"format");
+	const auto machineReadable = (keyvalue.end() != format && 0 == _wcsicmp(format->second.c_str(), L"tsv"));
+
+	if (keyvalue.end() != format && false == machineReadable && 0 != _wcsicmp(format->second.c_str(), L"pretty"))
+	{
+		THROW_ERROR("Invalid format. Cannot complete request.");
+	}
+
+	//
+	// BFE only accepts an enumeration template with a layer selected.
+	// Without one, the provider is matched here instead.
+	//
+	FWPM_FILTER_ENUM_TEMPLATE0 enumTemplate = { 0 };
+	const FWPM_FILTER_ENUM_TEMPLATE0 *selectedTemplate = nullptr;
+
+	GUID providerKey = { 0 };
+
+	if (layer.has_value())
+	{
+		enumTemplate.layerKey = layer.value();
+		enumTemplate.enumType = FWP_FILTER_ENUM_OVERLAPPING;
+		enumTemplate.actionMask = 0xFFFFFFFF;
+
+		if (provider.has_value())
+		{
+			providerKey = provider.value();
+			enumTemplate.providerKey = &providerKey;
+		}
+
+		selectedTemplate = &enumTemplate;
+	}
+
+	const auto matchProvider = (provider.has_value() && nullptr == selectedTemplate);
+
+	const size_t first = (page - 1) * pageSize;
+	size_t index = 0;
+	size_t printed = 0;
+
 	PrettyPrintOptions options;
 
 	options.indent = 2;
 	options.useSeparator = true;
 
 	PropertyDecorator decorator(FilterEngineProvider::Instance().get());
+	SynchronizedPropertyDecorator sharedDecorator(decorator);
+
+	InlineFormatter f;
+
+	if (machineReadable)
+	{
+		m_messageSink(L"filter id\tkey\tname\tprovider key\tlayer key\tsublayer key\taction\tnum conditions");
+	}
 
-	wfp::ObjectEnumerator::Filters(*FilterEngineProvider::Instance().get(), [&](const FWPM_FILTER0 &filter)
+	//
+	// Filters are enumerated and selected on this thread, and formatted in parallel.
+	// The output is written in enumeration order.
+	//
+	OrderedFormatter formatter(m_messageSink);
+
+	EnumerateFilters(*FilterEngineProvider::Instance().get(), selectedTemplate, [&](const FWPM_FILTER0 &filter, const FilterChunk &chunk)
 	{
-		m_messageSink(L"Filter");
+		if (matchProvider && (nullptr == filter.providerKey || provider.value() != *filter.providerKey))
+		{
+			return true;
+		}
+
+		if (sublayer.has_value() && sublayer.value() != filter.subLayerKey)
+		{
+			return true;
+		}
+
+		if (index++ < first)
+		{
+			return true;
+		}
+
+		const auto filterPtr = &filter;
+
+		if (machineReadable)
+		{
+			formatter.submit([filterPtr, chunk]()
+			{
+				const auto &filter = *filterPtr;
+
+				return (InlineFormatter() << filter.filterId
+					<< L'\t' << common::string::FormatGuid(filter.filterKey)
+					<< L'\t' << SanitizeField(filter.displayData.name)
+					<< L'\t' << (nullptr == filter.providerKey ? L"" : common::string::FormatGuid(*filter.providerKey))
+					<< L'\t' << common::string::FormatGuid(filter.layerKey)
+					<< L'\t' << common::string::FormatGuid(filter.subLayerKey)
+					<< L'\t' << ActionName(filter.action.type)
+					<< L'\t' << filter.numFilterConditions
+					<< L'\n').str();
+			});
+		}
+		else
+		{
+			formatter.submit([filterPtr, chunk, &options, &sharedDecorator]()
+			{
+				std::wstring block(L"Filter\n");
 
-		PrettyPrintProperties(m_messageSink, options, FilterProperties(filter, &decorator));
+				PrettyPrintProperties([&block](const std::wstring &line)
+				{
+					block.append(line).append(1, L'\n');
+				}, options, FilterProperties(*filterPtr, &sharedDecorator));
 
-		return true;
+				return block;
+			});
+		}
+
+		++printed;
+
+		return (0 == pageSize || printed < pageSize);
 	});
+
+	formatter.finish();
+
+	if (0 != pageSize && false == machineReadable)
+	{
+		m_messageSink((f << L"Page " << page << L": " << printed << L" filter(s)").str());
+	}
 }
 
 }
@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "m_decode.h"
+#include "cli/eventcapture.h"
+#include "cli/objectproperties.h"
+#include "cli/propertydecorator.h"
+#include "cli/filterengineprovider.h"
+#include "cli/inlineformatter.h"
+#include <libcommon/error.h>
+#include <libcommon/string.h>
+
+namespace commands::monitor
+{
+
+Decode::Decode(MessageSink messageSink)
+	: m_messageSink(messageSink)
+{
+}
+
+std::wstring Decode::name()
+{
+	return L"decode";
+}
+
+std::wstring Decode::description()
+{
+	return L"Print events captured by the events monitor. Arguments: path=<file>";
+}
+
+void Decode::handleRequest(const std::vector<std::wstring> &arguments)
+{
+	const auto keyvalue = common::string::SplitKeyValuePairs(arguments);
+
+	if (1 != keyvalue.size())
+	{
+		THROW_ERROR("Unsupported argument(s). Cannot complete request.");
+	}
+
+	PrettyPrintOptions options;
+
+	options.indent = 2;
+	options.useSeparator = true;
+
+	PropertyDecorator decorator(FilterEngineProvider::Instance().get());
+
+	const auto summary = eventcapture::Decode(GetArgumentValue(keyvalue, L"path"), [&](const FWPM_NET_EVENT1 &event)
+	{
+		m_messageSink(L"Event");
+
+		PrettyPrintProperties(m_messageSink, options, EventProperties(event, &decorator));
+	});
+
+	InlineFormatter f;
+
+	m_messageSink((f << L"Decoded " << (summary.numWritten - summary.numOverwritten) << L" event(s). "
+		<< summary.numOverwritten << L" event(s) were overwritten and "
+		<< summary.numLost << L" event(s) were lost during capture.").str());
+}
+
+}
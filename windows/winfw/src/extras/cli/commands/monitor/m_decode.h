@@ -0,0 +1,31 @@
+#pragma once
+
+#include "cli/commands/icommand.h"
+#include "cli/util.h"
+
+namespace commands::monitor
+{
+
+//
+// Pretty-prints events captured with "monitor events capture=<file>".
+//
+// Filter and layer names are resolved against the current state of BFE,
+// so filters that have been removed since the capture are shown without names.
+//
+class Decode : public ICommand
+{
+public:
+
+	Decode(MessageSink messageSink);
+
+	std::wstring name() override;
+	std::wstring description() override;
+
+	void handleRequest(const std::vector<std::wstring> &arguments) override;
+
+private:
+
+	MessageSink m_messageSink;
+};
+
+}
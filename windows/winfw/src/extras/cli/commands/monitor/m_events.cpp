@@ -3,10 +3,22 @@
 #include "cli/objectproperties.h"
 #include "cli/propertydecorator.h"
 #include "cli/filterengineprovider.h"
+#include "cli/inlineformatter.h"
 #include "libwfp/objectmonitor.h"
 #include <libcommon/error.h>
+#include <libcommon/string.h>
 #include <conio.h>
 
+namespace
+{
+
+//
+// 32 MiB worth of records.
+//
+const uint32_t DEFAULT_CAPTURE_RECORDS = 65536;
+
+} // anonymous namespace
+
 namespace commands::monitor
 {
 
@@ -23,19 +35,41 @@ std::wstring Events::name()
 
 std::wstring Events::description()
 {
-	return L"Provides monitoring of drop/allow events.";
+	return L"Provides monitoring of drop/allow events. Arguments: [capture=<file> [records=<n>]]";
 }
 
 void Events::handleRequest(const std::vector<std::wstring> &arguments)
 {
-	if (false == arguments.empty())
+	const auto keyvalue = common::string::SplitKeyValuePairs(arguments);
+
+	const auto capture = keyvalue.find(L"capture");
+	const auto records = keyvalue.find(L"records");
+
+	const size_t numCaptureArguments = (keyvalue.end() != capture ? 1 : 0) + (keyvalue.end() != records ? 1 : 0);
+
+	if (keyvalue.size() != numCaptureArguments
+		|| (keyvalue.end() == capture && keyvalue.end() != records))
 	{
 		THROW_ERROR("Unsupported argument(s). Cannot complete request.");
 	}
 
+	if (keyvalue.end() != capture)
+	{
+		const auto capacity = (keyvalue.end() != records
+			? common::string::LexicalCast<uint32_t>(records->second)
+			: DEFAULT_CAPTURE_RECORDS);
+
+		m_capture = std::make_unique<eventcapture::Writer>(capture->second, capacity);
+	}
+	else
+	{
+		m_decorator = std::make_unique<PropertyDecorator>(FilterEngineProvider::Instance().get());
+	}
+
 	wfp::ObjectMonitor objectMonitor(FilterEngineProvider::Instance().get());
 
-	objectMonitor.monitorEvents(std::bind(&Events::eventCallback, this, std::placeholders::_1));
+	objectMonitor.monitorEvents(std::bind((m_capture ? &Events::captureCallback : &Events::eventCallback),
+		this, std::placeholders::_1));
 
 	m_messageSink(L"Successfully enabled monitor. Press any key to abort monitoring.");
 
@@ -50,6 +84,20 @@ void Events::handleRequest(const std::vector<std::wstring> &arguments)
 	_getwch();
 
 	objectMonitor.monitorEventsStop();
+
+	m_decorator.reset();
+
+	if (m_capture)
+	{
+		auto capture = std::move(m_capture);
+
+		const auto summary = capture->stop();
+
+		InlineFormatter f;
+
+		m_messageSink((f << L"Captured " << summary.numWritten << L" event(s), lost "
+			<< summary.numLost << L" event(s).").str());
+	}
 }
 
 void Events::eventCallback(const FWPM_NET_EVENT1 &event)
@@ -61,9 +109,12 @@ void Events::eventCallback(const FWPM_NET_EVENT1 &event)
 	options.indent = 2;
 	options.useSeparator = true;
 
-	PropertyDecorator decorator(FilterEngineProvider::Instance().get());
+	PrettyPrintProperties(m_messageSink, options, EventProperties(event, m_decorator.get()));
+}
 
-	PrettyPrintProperties(m_messageSink, options, EventProperties(event, &decorator));
+void Events::captureCallback(const FWPM_NET_EVENT1 &event)
+{
+	m_capture->add(event);
 }
 
 }
@@ -2,11 +2,17 @@
 
 #include "cli/commands/icommand.h"
 #include "cli/util.h"
+#include "cli/propertydecorator.h"
+#include "cli/eventcapture.h"
 #include <memory>
 
 namespace commands::monitor
 {
 
+//
+// Prints events as they arrive, or captures them to a file for "monitor decode",
+// which keeps up with bursts that the console can't.
+//
 class Events : public ICommand
 {
 public:
@@ -22,7 +28,15 @@ private:
 
 	MessageSink m_messageSink;
 
+	//
+	// Shared by all events in a monitoring session, so names are resolved once.
+	//
+	std::unique_ptr<PropertyDecorator> m_decorator;
+
+	std::unique_ptr<eventcapture::Writer> m_capture;
+
 	void eventCallback(const FWPM_NET_EVENT1 &event);
+	void captureCallback(const FWPM_NET_EVENT1 &event);
 };
 
 }
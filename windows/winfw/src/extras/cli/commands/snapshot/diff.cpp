@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "diff.h"
+#include "cli/wfpsnapshot.h"
+#include "cli/filterengineprovider.h"
+#include "cli/propertydecorator.h"
+#include "cli/inlineformatter.h"
+#include <libcommon/error.h>
+#include <libcommon/string.h>
+
+namespace commands::snapshot
+{
+
+namespace
+{
+
+std::wstring ObjectTypeName(wfpsnapshot::ObjectType type)
+{
+	switch (type)
+	{
+		case wfpsnapshot::ObjectType::Provider: return L"Provider";
+		case wfpsnapshot::ObjectType::Sublayer: return L"Sublayer";
+		case wfpsnapshot::ObjectType::Filter: return L"Filter";
+		default: return L"Unknown";
+	}
+}
+
+std::wstring ChangedFields(uint32_t fields)
+{
+	std::vector<std::pair<UINT32, std::wstring> > definitions =
+	{
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_FLAGS), L"flags"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_PROVIDER), L"provider"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_LAYER), L"layer"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_SUBLAYER), L"sublayer"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_WEIGHT), L"weight"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_ACTION), L"action"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_CONDITIONS), L"conditions"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_OTHER), L"display data"),
+		std::make_pair(UINT32(wfpsnapshot::CHANGED_REINSTALLED), L"reinstalled")
+	};
+
+	return common::string::FormatFlags(definitions, fields);
+}
+
+} // anonymous namespace
+
+Diff::Diff(MessageSink messageSink)
+	: m_messageSink(messageSink)
+{
+}
+
+std::wstring Diff::name()
+{
+	return L"diff";
+}
+
+std::wstring Diff::description()
+{
+	return L"Compare two snapshots, or a snapshot with the current state if \"to\" is omitted. "
+		L"Arguments: from=<file> [to=<file>]";
+}
+
+void Diff::handleRequest(const std::vector<std::wstring> &arguments)
+{
+	const auto keyvalue = common::string::SplitKeyValuePairs(arguments);
+
+	if (keyvalue.empty() || keyvalue.size() > 2)
+	{
+		THROW_ERROR("Unsupported argument(s). Cannot complete request.");
+	}
+
+	const auto from = wfpsnapshot::Load(GetArgumentValue(keyvalue, L"from"));
+
+	const auto to = (keyvalue.end() == keyvalue.find(L"to")
+		? wfpsnapshot::Capture(*FilterEngineProvider::Instance().get())
+		: wfpsnapshot::Load(GetArgumentValue(keyvalue, L"to")));
+
+	const auto changes = wfpsnapshot::Diff(from, to);
+
+	PropertyDecorator decorator(FilterEngineProvider::Instance().get());
+
+	size_t numAdded = 0;
+	size_t numRemoved = 0;
+
+	for (const auto &change : changes)
+	{
+		const auto &record = change.record;
+
+		InlineFormatter f;
+
+		switch (change.type)
+		{
+			case wfpsnapshot::ChangeType::Added: f << L"+ "; ++numAdded; break;
+			case wfpsnapshot::ChangeType::Removed: f << L"- "; ++numRemoved; break;
+			default: f << L"~ "; break;
+		}
+
+		f << ObjectTypeName(record.type) << L" " << common::string::FormatGuid(record.key);
+
+		if (wfpsnapshot::ObjectType::Filter == record.type)
+		{
+			f << L" " << decorator.LayerDecoration(record.layerKey);
+		}
+		else if (wfpsnapshot::ObjectType::Sublayer == record.type)
+		{
+			f << L" " << decorator.SublayerDecoration(record.key);
+		}
+
+		if (wfpsnapshot::ChangeType::Modified == change.type)
+		{
+			f << L" changed: " << ChangedFields(change.fields);
+		}
+
+		m_messageSink(f.str());
+	}
+
+	InlineFormatter f;
+
+	m_messageSink((f << numAdded << L" added, " << numRemoved << L" removed, "
+		<< (changes.size() - numAdded - numRemoved) << L" modified object(s).").str());
+}
+
+}
@@ -0,0 +1,45 @@
+#include "stdafx.h"
+#include "save.h"
+#include "cli/wfpsnapshot.h"
+#include "cli/filterengineprovider.h"
+#include "cli/inlineformatter.h"
+#include <libcommon/error.h>
+#include <libcommon/string.h>
+
+namespace commands::snapshot
+{
+
+Save::Save(MessageSink messageSink)
+	: m_messageSink(messageSink)
+{
+}
+
+std::wstring Save::name()
+{
+	return L"save";
+}
+
+std::wstring Save::description()
+{
+	return L"Save a snapshot of all Mullvad filters, sublayers and providers. Arguments: path=<file>";
+}
+
+void Save::handleRequest(const std::vector<std::wstring> &arguments)
+{
+	const auto keyvalue = common::string::SplitKeyValuePairs(arguments);
+
+	if (1 != keyvalue.size())
+	{
+		THROW_ERROR("Unsupported argument(s). Cannot complete request.");
+	}
+
+	const auto snapshot = wfpsnapshot::Capture(*FilterEngineProvider::Instance().get());
+
+	wfpsnapshot::Save(GetArgumentValue(keyvalue, L"path"), snapshot);
+
+	InlineFormatter f;
+
+	m_messageSink((f << L"Saved " << snapshot.records.size() << L" object(s).").str());
+}
+
+}
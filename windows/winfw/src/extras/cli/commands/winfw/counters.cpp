@@ -0,0 +1,116 @@
+#include "stdafx.h"
+#include "counters.h"
+#include "cli/inlineformatter.h"
+#include "cli/propertylist.h"
+#include "winfw/winfw.h"
+#include <libcommon/error.h>
+#include <functional>
+#include <vector>
+
+namespace commands::winfw
+{
+
+Counters::Counters(MessageSink messageSink)
+	: m_messageSink(messageSink)
+{
+	m_dispatcher.addSubcommand
+	(
+		L"start",
+		std::bind(&Counters::processStart, this)
+	);
+
+	m_dispatcher.addSubcommand
+	(
+		L"stop",
+		std::bind(&Counters::processStop, this)
+	);
+
+	m_dispatcher.addSubcommand
+	(
+		L"show",
+		std::bind(&Counters::processShow, this)
+	);
+}
+
+std::wstring Counters::name()
+{
+	return L"counters";
+}
+
+std::wstring Counters::description()
+{
+	return L"Count drops per rule. Subcommands: start, stop, show";
+}
+
+void Counters::handleRequest(const std::vector<std::wstring> &arguments)
+{
+	if (arguments.empty())
+	{
+		THROW_ERROR("Missing subcommand. Cannot complete request.");
+	}
+
+	auto subcommand = arguments[0];
+
+	auto actualArguments(arguments);
+	actualArguments.erase(actualArguments.begin());
+
+	m_dispatcher.dispatch(subcommand, actualArguments);
+}
+
+void Counters::processStart()
+{
+	m_messageSink((WinFw_StartRuleCounters()
+		? L"Started counting drops."
+		: L"Failed to start counting drops. Is winfw initialized?"));
+}
+
+void Counters::processStop()
+{
+	m_messageSink((WinFw_StopRuleCounters()
+		? L"Stopped counting drops."
+		: L"Failed to stop counting drops."));
+}
+
+void Counters::processShow()
+{
+	std::vector<WinFwRuleCounter> entries;
+	uint32_t numEntries = 0;
+	uint64_t numUnattributed = 0;
+
+	for (;;)
+	{
+		entries.resize(numEntries);
+
+		const auto status = WinFw_GetRuleCounters(entries.data(), &numEntries, &numUnattributed);
+
+		if (WINFW_REPORT_STATUS_SUCCESS == status)
+		{
+			entries.resize(numEntries);
+			break;
+		}
+
+		if (WINFW_REPORT_STATUS_BUFFER_TOO_SMALL != status)
+		{
+			THROW_ERROR("Failed to retrieve rule counters");
+		}
+	}
+
+	PrettyPrintOptions options;
+
+	options.indent = 2;
+	options.useSeparator = false;
+
+	PropertyList props;
+	InlineFormatter f;
+
+	for (const auto &entry : entries)
+	{
+		props.add(common::string::FormatGuid(entry.filterKey), (f << entry.numDropped).str());
+	}
+
+	PrettyPrintProperties(m_messageSink, options, props);
+
+	m_messageSink((f << L"Unattributed: " << numUnattributed).str());
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "cli/commands/icommand.h"
+#include "cli/util.h"
+#include "cli/subcommanddispatcher.h"
+#include "libcommon/string.h"
+
+namespace commands::winfw
+{
+
+//
+// Start, stop and show the per-rule drop counters.
+//
+class Counters : public ICommand
+{
+public:
+
+	Counters(MessageSink messageSink);
+
+	std::wstring name() override;
+	std::wstring description() override;
+
+	void handleRequest(const std::vector<std::wstring> &arguments) override;
+
+private:
+
+	MessageSink m_messageSink;
+	SubcommandDispatcher m_dispatcher;
+
+	void processStart();
+	void processStop();
+	void processShow();
+};
+
+}
@@ -3,7 +3,11 @@
 #include <libcommon/string.h>
 #include <libcommon/error.h>
 #include "winfw/winfw.h"
+#include "cli/inlineformatter.h"
+#include <algorithm>
+#include <chrono>
 #include <functional>
+#include <vector>
 
 namespace commands::winfw
 {
@@ -37,6 +41,18 @@ WinFwRelay CreateRelay(const wchar_t *ip, const std::wstring &port, const std::w
 	return r;
 }
 
+uint64_t ObjectsTouched()
+{
+	WinFwStatistics statistics;
+
+	if (false == WinFw_GetStatistics(&statistics))
+	{
+		return 0;
+	}
+
+	return statistics.accumulated.objectsAdded + statistics.accumulated.objectsRemoved;
+}
+
 } // namespace detail
 
 Policy::Policy(MessageSink messageSink)
@@ -74,7 +90,7 @@ std::wstring Policy::name()
 
 std::wstring Policy::description()
 {
-	return L"Activate and reset policies.";
+	return L"Activate and reset policies. Specify repeat=<n> to time repeated applies of a policy.";
 }
 
 void Policy::handleRequest(const std::vector<std::wstring> &arguments)
@@ -109,16 +125,15 @@ void Policy::processConnecting(const KeyValuePairs &arguments)
 		GetArgumentValue(arguments, L"protocol")
 	);
 
-	auto success = WinFw_ApplyPolicyConnecting
-	(
-		settings,
-		relay,
-		nullptr
-	);
-
-	m_messageSink((success
-		? L"Successfully applied policy."
-		: L"Failed to apply policy."));
+	timedApply(arguments, [&]()
+	{
+		return WinFw_ApplyPolicyConnecting
+		(
+			settings,
+			relay,
+			nullptr
+		);
+	});
 }
 
 void Policy::processConnected(const KeyValuePairs &arguments)
@@ -138,18 +153,20 @@ void Policy::processConnected(const KeyValuePairs &arguments)
 		GetArgumentValue(arguments, L"protocol")
 	);
 
-	auto success = WinFw_ApplyPolicyConnected
-	(
-		settings,
-		relay,
-		GetArgumentValue(arguments, L"tunnel").c_str(),
-		GetArgumentValue(arguments, L"dns").c_str(),
-		nullptr
-	);
+	const auto tunnel = GetArgumentValue(arguments, L"tunnel");
+	const auto dns = GetArgumentValue(arguments, L"dns");
 
-	m_messageSink((success
-		? L"Successfully applied policy."
-		: L"Failed to apply policy."));
+	timedApply(arguments, [&]()
+	{
+		return WinFw_ApplyPolicyConnected
+		(
+			settings,
+			relay,
+			tunnel.c_str(),
+			dns.c_str(),
+			nullptr
+		);
+	});
 }
 
 void Policy::processBlocked(const KeyValuePairs &arguments)
@@ -160,11 +177,10 @@ void Policy::processBlocked(const KeyValuePairs &arguments)
 		GetArgumentValue(arguments, L"lan")
 	);
 
-	auto success = WinFw_ApplyPolicyBlocked(settings);
-
-	m_messageSink((success
-		? L"Successfully applied policy."
-		: L"Failed to apply policy."));
+	timedApply(arguments, [&]()
+	{
+		return WinFw_ApplyPolicyBlocked(settings);
+	});
 }
 
 void Policy::processReset()
@@ -176,4 +192,75 @@ void Policy::processReset()
 		: L"Failed to reset policy."));
 }
 
+void Policy::timedApply(const KeyValuePairs &arguments, std::function<bool()> apply)
+{
+	size_t repeat = 1;
+
+	if (const auto r = arguments.find(L"repeat"); arguments.end() != r)
+	{
+		repeat = common::string::LexicalCast<size_t>(r->second);
+
+		if (0 == repeat)
+		{
+			THROW_ERROR("Invalid repeat count. Cannot complete request.");
+		}
+	}
+
+	std::vector<std::chrono::microseconds> durations;
+	std::vector<uint64_t> objectsTouched;
+
+	durations.reserve(repeat);
+	objectsTouched.reserve(repeat);
+
+	for (size_t i = 0; i < repeat; ++i)
+	{
+		const auto objectsBefore = detail::ObjectsTouched();
+		const auto start = std::chrono::steady_clock::now();
+
+		const auto success = apply();
+
+		durations.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start));
+		objectsTouched.push_back(detail::ObjectsTouched() - objectsBefore);
+
+		if (false == success)
+		{
+			m_messageSink((InlineFormatter() << L"Failed to apply policy (attempt " << (i + 1) << L").").str());
+			return;
+		}
+	}
+
+	InlineFormatter f;
+
+	if (1 == repeat)
+	{
+		m_messageSink((f << L"Successfully applied policy in " << durations.front().count() << L" us, "
+			<< objectsTouched.front() << L" object(s) added or removed.").str());
+
+		return;
+	}
+
+	auto sorted(durations);
+	std::sort(sorted.begin(), sorted.end());
+
+	const auto [minObjects, maxObjects] = std::minmax_element(objectsTouched.begin(), objectsTouched.end());
+
+	m_messageSink((f << L"Successfully applied policy " << repeat << L" times.").str());
+
+	PropertyList props;
+
+	props.add(L"min", (f << sorted.front().count() << L" us").str());
+	props.add(L"median", (f << sorted[sorted.size() / 2].count() << L" us").str());
+	props.add(L"max", (f << sorted.back().count() << L" us").str());
+	props.add(L"first", (f << durations.front().count() << L" us, " << objectsTouched.front() << L" object(s)").str());
+	props.add(L"objects per apply", (f << *minObjects << L" - " << *maxObjects).str());
+
+	PrettyPrintOptions options;
+
+	options.indent = 2;
+	options.useSeparator = true;
+
+	PrettyPrintProperties(m_messageSink, options, props);
+}
+
 }
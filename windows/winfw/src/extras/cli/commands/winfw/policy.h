@@ -4,6 +4,7 @@
 #include "cli/util.h"
 #include "cli/subcommanddispatcher.h"
 #include "libcommon/string.h"
+#include <functional>
 
 namespace commands::winfw
 {
@@ -30,6 +31,12 @@ private:
 	void processConnected(const KeyValuePairs &arguments);
 	void processBlocked(const KeyValuePairs &arguments);
 	void processReset();
+
+	//
+	// Apply the policy 'repeat' times, if specified, and report how long it took
+	// and how many objects were added or removed.
+	//
+	void timedApply(const KeyValuePairs &arguments, std::function<bool()> apply);
 };
 
 }
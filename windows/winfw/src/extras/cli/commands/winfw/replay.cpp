@@ -0,0 +1,395 @@
+#include "stdafx.h"
+#include "replay.h"
+#include <libcommon/string.h>
+#include <libcommon/error.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+using policyrecording::Call;
+
+namespace commands::winfw
+{
+
+namespace detail
+{
+
+const wchar_t *CallName(Call call)
+{
+	switch (call)
+	{
+		case Call::Initialize: return L"Initialize";
+		case Call::InitializeBlocked: return L"InitializeBlocked";
+		case Call::InitializeHybrid: return L"InitializeHybrid";
+		case Call::InitializeDeferred: return L"InitializeDeferred";
+		case Call::InitializeFromHandover: return L"InitializeFromHandover";
+		case Call::Deinitialize: return L"Deinitialize";
+		case Call::DeinitializeWithCleanupPolicy: return L"DeinitializeWithCleanupPolicy";
+		case Call::ApplyPolicyConnecting: return L"ApplyPolicyConnecting";
+		case Call::ApplyPolicyConnected: return L"ApplyPolicyConnected";
+		case Call::StagePolicyConnected: return L"StagePolicyConnected";
+		case Call::ApplyPolicyConnectedMultiDns: return L"ApplyPolicyConnectedMultiDns";
+		case Call::StagePolicyConnectedMultiDns: return L"StagePolicyConnectedMultiDns";
+		case Call::ApplyPolicyRelaySwitch: return L"ApplyPolicyRelaySwitch";
+		case Call::ApplyPolicyBlocked: return L"ApplyPolicyBlocked";
+		case Call::SetExcludedApps: return L"SetExcludedApps";
+		case Call::Reset: return L"Reset";
+		default:
+		{
+			THROW_ERROR("Unknown call in recording");
+		}
+	}
+}
+
+const wchar_t *OptionalString(const std::optional<std::wstring> &value)
+{
+	return value.has_value() ? value->c_str() : nullptr;
+}
+
+struct CallStatistics
+{
+	size_t count = 0;
+	uint64_t recordedUs = 0;
+	uint64_t replayedUs = 0;
+	uint64_t recordedMaxUs = 0;
+	uint64_t replayedMaxUs = 0;
+};
+
+} // namespace detail
+
+Replay::Replay(MessageSink messageSink)
+	: m_messageSink(messageSink)
+{
+}
+
+std::wstring Replay::name()
+{
+	return L"replay";
+}
+
+std::wstring Replay::description()
+{
+	return L"Replay a recording made with WinFw_StartRecording(). Arguments: path=<file> [tunnel=<alias>] [pace=yes|no]";
+}
+
+void Replay::handleRequest(const std::vector<std::wstring> &arguments)
+{
+	const auto keyvalue = common::string::SplitKeyValuePairs(arguments);
+
+	const auto records = LoadRecording(GetArgumentValue(keyvalue, L"path"));
+
+	//
+	// The tunnel alias on the recording machine is usually not present here.
+	//
+	std::optional<std::wstring> tunnelAlias;
+
+	if (const auto tunnel = keyvalue.find(L"tunnel"); keyvalue.end() != tunnel)
+	{
+		tunnelAlias = tunnel->second;
+	}
+
+	const auto pace = keyvalue.find(L"pace");
+	const bool paced = (keyvalue.end() != pace && 0 == _wcsicmp(pace->second.c_str(), L"yes"));
+
+	//
+	// Recordings may start after initialization.
+	//
+
+	const bool initialized = (false == records.empty()
+		&& (Call::Initialize == records.front().header.call
+			|| Call::InitializeBlocked == records.front().header.call
+			|| Call::InitializeHybrid == records.front().header.call
+			|| Call::InitializeDeferred == records.front().header.call
+			|| Call::InitializeFromHandover == records.front().header.call));
+
+	if (false == initialized && false == WinFw_Initialize(0, &Replay::ErrorForwarder, this))
+	{
+		THROW_ERROR("Failed to initialize winfw");
+	}
+
+	std::map<Call, detail::CallStatistics> statistics;
+	size_t mismatches = 0;
+
+	const auto origin = std::chrono::steady_clock::now();
+
+	for (const auto &record : records)
+	{
+		if (paced)
+		{
+			std::this_thread::sleep_until(origin + std::chrono::microseconds(record.header.offsetUs));
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+
+		const auto status = replayCall(record, tunnelAlias);
+
+		const auto durationUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count());
+
+		if ((0 != (record.header.flags & policyrecording::RECORD_FLAG_SUCCESS)) != status)
+		{
+			std::wstringstream ss;
+
+			ss << detail::CallName(record.header.call) << L" at " << record.header.offsetUs << L" us "
+				<< (status ? L"succeeded" : L"failed") << L" when replayed, but not when recorded.";
+
+			m_messageSink(ss.str());
+
+			++mismatches;
+		}
+
+		auto &s = statistics[record.header.call];
+
+		++s.count;
+		s.recordedUs += record.header.durationUs;
+		s.replayedUs += durationUs;
+		s.recordedMaxUs = std::max(s.recordedMaxUs, record.header.durationUs);
+		s.replayedMaxUs = std::max(s.replayedMaxUs, durationUs);
+	}
+
+	for (const auto &[call, s] : statistics)
+	{
+		std::wstringstream ss;
+
+		ss << detail::CallName(call) << L": " << s.count << L" call(s), mean "
+			<< (s.replayedUs / s.count) << L" us (recorded " << (s.recordedUs / s.count) << L" us), max "
+			<< s.replayedMaxUs << L" us (recorded " << s.recordedMaxUs << L" us)";
+
+		m_messageSink(ss.str());
+	}
+
+	std::wstringstream ss;
+
+	ss << L"Replayed " << records.size() << L" call(s). " << mismatches << L" result mismatch(es).";
+
+	m_messageSink(ss.str());
+}
+
+//
+// A trailing record that is incomplete is ignored.
+//
+//static
+std::vector<Replay::Record> Replay::LoadRecording(const std::wstring &path)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	if (false == file.is_open())
+	{
+		THROW_ERROR("Failed to open recording");
+	}
+
+	policyrecording::FileHeader header;
+
+	if (false == file.read(reinterpret_cast<char *>(&header), sizeof(header)).good()
+		|| policyrecording::FILE_MAGIC != header.magic)
+	{
+		THROW_ERROR("Not a policy recording");
+	}
+
+	if (policyrecording::FILE_VERSION != header.version)
+	{
+		THROW_ERROR("Unsupported recording version");
+	}
+
+	std::vector<Record> records;
+
+	for (;;)
+	{
+		Record record;
+
+		if (false == file.read(reinterpret_cast<char *>(&record.header), sizeof(record.header)).good())
+		{
+			break;
+		}
+
+		record.arguments.resize(record.header.argumentsSize);
+
+		if (0 != record.header.argumentsSize
+			&& false == file.read(reinterpret_cast<char *>(record.arguments.data()), record.arguments.size()).good())
+		{
+			break;
+		}
+
+		records.push_back(std::move(record));
+	}
+
+	return records;
+}
+
+//
+// Asynchronous calls are replayed synchronously.
+//
+bool Replay::replayCall(const Record &record, const std::optional<std::wstring> &tunnelAlias)
+{
+	policyrecording::Reader arguments(record.arguments.data(), record.arguments.size());
+
+	auto alias = [&tunnelAlias](const std::optional<std::wstring> &recorded)
+	{
+		return (tunnelAlias.has_value() ? tunnelAlias : recorded);
+	};
+
+	switch (record.header.call)
+	{
+		//
+		// The handover state isn't recorded, so this is replayed as a plain initialization.
+		//
+		case Call::InitializeFromHandover:
+		case Call::Initialize:
+		{
+			return WinFw_Initialize(arguments.u32(), &Replay::ErrorForwarder, this);
+		}
+		case Call::InitializeDeferred:
+		{
+			return WinFw_InitializeDeferred(arguments.u32(), &Replay::ErrorForwarder, this);
+		}
+		case Call::InitializeBlocked:
+		{
+			const auto timeout = arguments.u32();
+			return WinFw_InitializeBlocked(timeout, arguments.settings(), &Replay::ErrorForwarder, this);
+		}
+		case Call::InitializeHybrid:
+		{
+			const auto timeout = arguments.u32();
+			return WinFw_InitializeHybrid(timeout, arguments.settings(), &Replay::ErrorForwarder, this);
+		}
+		case Call::Deinitialize:
+		{
+			return WinFw_Deinitialize();
+		}
+		case Call::DeinitializeWithCleanupPolicy:
+		{
+			return WinFw_DeinitializeWithCleanupPolicy(static_cast<WINFW_CLEANUP_POLICY>(arguments.u8()));
+		}
+		case Call::ApplyPolicyConnecting:
+		{
+			const auto settings = arguments.settings();
+
+			std::vector<std::optional<std::wstring>> relayIps;
+			std::vector<WinFwRelay> relays(arguments.u32());
+
+			relayIps.reserve(relays.size());
+
+			for (auto &relay : relays)
+			{
+				relay.ip = detail::OptionalString(relayIps.emplace_back(arguments.string()));
+				relay.port = arguments.u16();
+				relay.protocol = static_cast<WinFwProtocol>(arguments.u8());
+			}
+
+			if (0 == arguments.u8())
+			{
+				return WinFw_ApplyPolicyConnectingMultiRelay(settings, relays.data(), relays.size(), nullptr);
+			}
+
+			const auto pingableAlias = alias(arguments.string());
+
+			std::vector<std::wstring> hosts(arguments.u32());
+			std::vector<const wchar_t *> hostPointers;
+
+			for (auto &host : hosts)
+			{
+				host = arguments.string().value_or(L"");
+				hostPointers.push_back(host.c_str());
+			}
+
+			PingableHosts pingableHosts;
+
+			pingableHosts.tunnelInterfaceAlias = detail::OptionalString(pingableAlias);
+			pingableHosts.hosts = hostPointers.data();
+			pingableHosts.numHosts = hostPointers.size();
+
+			return WinFw_ApplyPolicyConnectingMultiRelay(settings, relays.data(), relays.size(), &pingableHosts);
+		}
+		case Call::ApplyPolicyConnected:
+		case Call::StagePolicyConnected:
+		{
+			const auto settings = arguments.settings();
+			const auto relayIp = arguments.string();
+
+			WinFwRelay relay;
+
+			relay.ip = detail::OptionalString(relayIp);
+			relay.port = arguments.u16();
+			relay.protocol = static_cast<WinFwProtocol>(arguments.u8());
+
+			const auto tunnel = alias(arguments.string());
+			const auto v4DnsHost = arguments.string();
+			const auto v6DnsHost = arguments.string();
+
+			const auto apply = (Call::ApplyPolicyConnected == record.header.call
+				? WinFw_ApplyPolicyConnected : WinFw_StagePolicyConnected);
+
+			return apply(settings, relay, detail::OptionalString(tunnel),
+				detail::OptionalString(v4DnsHost), detail::OptionalString(v6DnsHost));
+		}
+		case Call::ApplyPolicyConnectedMultiDns:
+		case Call::StagePolicyConnectedMultiDns:
+		{
+			const auto settings = arguments.settings();
+			const auto relay = arguments.endpoint();
+			const auto tunnel = alias(arguments.string());
+
+			std::vector<WinFwIp> dnsHosts(arguments.u32());
+
+			for (auto &dnsHost : dnsHosts)
+			{
+				dnsHost = arguments.ip();
+			}
+
+			const auto apply = (Call::ApplyPolicyConnectedMultiDns == record.header.call
+				? WinFw_ApplyPolicyConnectedMultiDns : WinFw_StagePolicyConnectedMultiDns);
+
+			return apply(settings, relay, detail::OptionalString(tunnel), dnsHosts.data(), dnsHosts.size());
+		}
+		case Call::ApplyPolicyRelaySwitch:
+		{
+			const auto relayIp = arguments.string();
+
+			WinFwRelay relay;
+
+			relay.ip = detail::OptionalString(relayIp);
+			relay.port = arguments.u16();
+			relay.protocol = static_cast<WinFwProtocol>(arguments.u8());
+
+			return WinFw_ApplyPolicyRelaySwitch(relay);
+		}
+		case Call::ApplyPolicyBlocked:
+		{
+			return WinFw_ApplyPolicyBlocked(arguments.settings());
+		}
+		case Call::SetExcludedApps:
+		{
+			std::vector<std::wstring> paths(arguments.u32());
+			std::vector<const wchar_t *> pathPointers;
+
+			for (auto &path : paths)
+			{
+				path = arguments.string().value_or(L"");
+				pathPointers.push_back(path.c_str());
+			}
+
+			return WinFw_SetExcludedApps(pathPointers.data(), pathPointers.size());
+		}
+		case Call::Reset:
+		{
+			return WinFw_Reset();
+		}
+		default:
+		{
+			THROW_ERROR("Unknown call in recording");
+		}
+	}
+}
+
+//static
+void WINFW_API Replay::ErrorForwarder(MULLVAD_LOG_LEVEL, const char *errorMessage, void *context)
+{
+	auto thiz = reinterpret_cast<Replay *>(context);
+
+	thiz->m_messageSink(common::string::ToWide(errorMessage));
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "cli/commands/icommand.h"
+#include "cli/util.h"
+#include "winfw/winfw.h"
+#include "winfw/policyrecording.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace commands::winfw
+{
+
+//
+// Replays a recording made with WinFw_StartRecording(), and compares the
+// duration and result of each call with the recorded ones.
+//
+class Replay : public ICommand
+{
+public:
+
+	Replay(MessageSink messageSink);
+
+	std::wstring name() override;
+	std::wstring description() override;
+
+	void handleRequest(const std::vector<std::wstring> &arguments) override;
+
+private:
+
+	MessageSink m_messageSink;
+
+	struct Record
+	{
+		policyrecording::RecordHeader header;
+		std::vector<uint8_t> arguments;
+	};
+
+	static std::vector<Record> LoadRecording(const std::wstring &path);
+
+	bool replayCall(const Record &record, const std::optional<std::wstring> &tunnelAlias);
+
+	static void WINFW_API ErrorForwarder(MULLVAD_LOG_LEVEL level, const char *errorMessage, void *context);
+};
+
+}
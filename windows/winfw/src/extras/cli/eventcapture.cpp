@@ -0,0 +1,381 @@
+#include "stdafx.h"
+#include "eventcapture.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <algorithm>
+#include <cstring>
+
+namespace eventcapture
+{
+
+namespace detail
+{
+
+//
+// Upper bound on the number of records waiting to be written.
+//
+const size_t MAX_QUEUED_RECORDS = 4096;
+
+Record MakeRecord(const FWPM_NET_EVENT1 &event)
+{
+	Record record;
+
+	memset(&record, 0, sizeof(record));
+
+	const auto &header = event.header;
+
+	record.timeStamp = header.timeStamp;
+	record.flags = (header.flags & ~FWPM_NET_EVENT_FLAG_USER_ID_SET);
+	record.type = event.type;
+	record.ipVersion = header.ipVersion;
+	record.scopeId = header.scopeId;
+	record.localPort = header.localPort;
+	record.remotePort = header.remotePort;
+	record.ipProtocol = header.ipProtocol;
+
+	if (FWP_IP_VERSION_V4 == header.ipVersion)
+	{
+		memcpy(record.localAddr, &header.localAddrV4, sizeof(header.localAddrV4));
+		memcpy(record.remoteAddr, &header.remoteAddrV4, sizeof(header.remoteAddrV4));
+	}
+	else
+	{
+		memcpy(record.localAddr, header.localAddrV6.byteArray16, sizeof(record.localAddr));
+		memcpy(record.remoteAddr, header.remoteAddrV6.byteArray16, sizeof(record.remoteAddr));
+	}
+
+	if (0 != (header.flags & FWPM_NET_EVENT_FLAG_APP_ID_SET)
+		&& nullptr != header.appId.data)
+	{
+		const auto length = std::min<size_t>(header.appId.size / sizeof(wchar_t), MAX_APP_ID_CHARS);
+
+		memcpy(record.appId, header.appId.data, length * sizeof(wchar_t));
+		record.appIdLength = static_cast<UINT16>(length);
+	}
+
+	if (FWPM_NET_EVENT_TYPE_CLASSIFY_DROP == event.type
+		&& nullptr != event.classifyDrop)
+	{
+		const auto &drop = *event.classifyDrop;
+
+		record.filterId = drop.filterId;
+		record.layerId = drop.layerId;
+		record.reauthReason = drop.reauthReason;
+		record.originalProfile = drop.originalProfile;
+		record.currentProfile = drop.currentProfile;
+		record.msFwpDirection = drop.msFwpDirection;
+		record.isLoopback = (drop.isLoopback ? 1 : 0);
+	}
+
+	return record;
+}
+
+void ReadAt(HANDLE file, uint64_t offset, void *data, size_t size)
+{
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(offset);
+
+	if (FALSE == SetFilePointerEx(file, position, nullptr, FILE_BEGIN))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Seek in capture file");
+	}
+
+	DWORD bytesRead;
+
+	if (FALSE == ReadFile(file, data, static_cast<DWORD>(size), &bytesRead, nullptr)
+		|| bytesRead != size)
+	{
+		THROW_ERROR("Truncated capture file");
+	}
+}
+
+} // namespace detail
+
+Writer::Writer(const std::wstring &path, uint32_t capacity)
+	: m_capacity(capacity)
+	, m_stop(false)
+	, m_numWritten(0)
+	, m_numLost(0)
+{
+	if (0 == capacity)
+	{
+		THROW_ERROR("Invalid capture capacity");
+	}
+
+	m_file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (INVALID_HANDLE_VALUE == m_file)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Create capture file");
+	}
+
+	try
+	{
+		writeHeader(0, 0);
+	}
+	catch (...)
+	{
+		CloseHandle(m_file);
+		throw;
+	}
+
+	m_queue.reserve(detail::MAX_QUEUED_RECORDS);
+
+	m_thread = std::thread(&Writer::thread, this);
+}
+
+Writer::~Writer()
+{
+	try
+	{
+		stop();
+	}
+	catch (...)
+	{
+	}
+
+	CloseHandle(m_file);
+}
+
+void Writer::add(const FWPM_NET_EVENT1 &event)
+{
+	const auto record = detail::MakeRecord(event);
+
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+
+		if (m_stop || m_queue.size() >= detail::MAX_QUEUED_RECORDS)
+		{
+			++m_numLost;
+			return;
+		}
+
+		m_queue.push_back(record);
+	}
+
+	m_wakeup.notify_one();
+}
+
+Writer::Summary Writer::stop()
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_wakeup.notify_all();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	if (m_error)
+	{
+		std::rethrow_exception(m_error);
+	}
+
+	return Summary{ m_numWritten, m_numLost };
+}
+
+void Writer::thread()
+{
+	std::vector<Record> records;
+
+	records.reserve(detail::MAX_QUEUED_RECORDS);
+
+	for (;;)
+	{
+		uint64_t sequence;
+		uint64_t numLost;
+		bool stopping;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_wakeup.wait(lock, [this]() { return m_stop || false == m_queue.empty(); });
+
+			records.swap(m_queue);
+
+			sequence = m_numWritten;
+			numLost = m_numLost;
+			stopping = m_stop;
+		}
+
+		try
+		{
+			write(records, sequence);
+			writeHeader(sequence + records.size(), numLost);
+		}
+		catch (...)
+		{
+			std::scoped_lock<std::mutex> lock(m_mutex);
+
+			m_error = std::current_exception();
+			m_numLost += records.size();
+
+			//
+			// Events that arrive from now on are counted as lost.
+			//
+			m_stop = true;
+			m_queue.clear();
+
+			return;
+		}
+
+		{
+			std::scoped_lock<std::mutex> lock(m_mutex);
+			m_numWritten += records.size();
+		}
+
+		records.clear();
+
+		if (stopping)
+		{
+			//
+			// Events aren't queued once stopping, so the queue is already drained.
+			//
+			return;
+		}
+	}
+}
+
+void Writer::write(const std::vector<Record> &records, uint64_t sequence)
+{
+	size_t offset = 0;
+
+	//
+	// Write contiguous runs, splitting where the ring wraps around.
+	//
+	while (offset < records.size())
+	{
+		const auto slot = (sequence + offset) % m_capacity;
+		const auto run = std::min<uint64_t>(records.size() - offset, m_capacity - slot);
+
+		writeAt(sizeof(FileHeader) + slot * sizeof(Record), &records[offset],
+			static_cast<size_t>(run) * sizeof(Record));
+
+		offset += static_cast<size_t>(run);
+	}
+}
+
+void Writer::writeHeader(uint64_t numWritten, uint64_t numLost)
+{
+	FileHeader header;
+
+	header.magic = FILE_MAGIC;
+	header.version = FILE_VERSION;
+	header.recordSize = sizeof(Record);
+	header.capacity = m_capacity;
+	header.numWritten = numWritten;
+	header.numLost = numLost;
+
+	writeAt(0, &header, sizeof(header));
+}
+
+void Writer::writeAt(uint64_t offset, const void *data, size_t size)
+{
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(offset);
+
+	if (FALSE == SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Seek in capture file");
+	}
+
+	DWORD bytesWritten;
+
+	if (FALSE == WriteFile(m_file, data, static_cast<DWORD>(size), &bytesWritten, nullptr)
+		|| bytesWritten != size)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Write to capture file");
+	}
+}
+
+DecodeSummary Decode(const std::wstring &path, DecodeSink sink)
+{
+	const auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (INVALID_HANDLE_VALUE == file)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Open capture file");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [file]()
+	{
+		CloseHandle(file);
+	};
+
+	FileHeader header;
+
+	detail::ReadAt(file, 0, &header, sizeof(header));
+
+	if (FILE_MAGIC != header.magic
+		|| FILE_VERSION != header.version
+		|| sizeof(Record) != header.recordSize
+		|| 0 == header.capacity)
+	{
+		THROW_ERROR("Unsupported capture file");
+	}
+
+	const auto numRecords = std::min<uint64_t>(header.numWritten, header.capacity);
+	const auto first = header.numWritten - numRecords;
+
+	for (uint64_t sequence = first; sequence < header.numWritten; ++sequence)
+	{
+		Record record;
+
+		detail::ReadAt(file, sizeof(FileHeader) + (sequence % header.capacity) * sizeof(Record),
+			&record, sizeof(record));
+
+		FWPM_NET_EVENT1 event = { 0 };
+		FWPM_NET_EVENT_CLASSIFY_DROP1 drop = { 0 };
+
+		event.header.timeStamp = record.timeStamp;
+		event.header.flags = record.flags;
+		event.header.ipVersion = static_cast<FWP_IP_VERSION>(record.ipVersion);
+		event.header.ipProtocol = record.ipProtocol;
+		event.header.localPort = record.localPort;
+		event.header.remotePort = record.remotePort;
+		event.header.scopeId = record.scopeId;
+
+		if (FWP_IP_VERSION_V4 == event.header.ipVersion)
+		{
+			memcpy(&event.header.localAddrV4, record.localAddr, sizeof(event.header.localAddrV4));
+			memcpy(&event.header.remoteAddrV4, record.remoteAddr, sizeof(event.header.remoteAddrV4));
+		}
+		else
+		{
+			memcpy(event.header.localAddrV6.byteArray16, record.localAddr, sizeof(record.localAddr));
+			memcpy(event.header.remoteAddrV6.byteArray16, record.remoteAddr, sizeof(record.remoteAddr));
+		}
+
+		event.header.appId.data = reinterpret_cast<UINT8 *>(record.appId);
+		event.header.appId.size = std::min<UINT32>(record.appIdLength, static_cast<UINT32>(MAX_APP_ID_CHARS)) * sizeof(wchar_t);
+
+		event.type = static_cast<FWPM_NET_EVENT_TYPE>(record.type);
+
+		if (FWPM_NET_EVENT_TYPE_CLASSIFY_DROP == event.type)
+		{
+			drop.filterId = record.filterId;
+			drop.layerId = record.layerId;
+			drop.reauthReason = record.reauthReason;
+			drop.originalProfile = record.originalProfile;
+			drop.currentProfile = record.currentProfile;
+			drop.msFwpDirection = record.msFwpDirection;
+			drop.isLoopback = (0 != record.isLoopback);
+
+			event.classifyDrop = &drop;
+		}
+
+		sink(event);
+	}
+
+	return DecodeSummary{ header.capacity, header.numWritten, header.numLost, first };
+}
+
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <windows.h>
+#include <fwpmu.h>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Capture of net events to a binary ring file, to be decoded later.
+//
+// Events are reduced to fixed-size records on the callback thread, and written
+// to the file on a separate thread. Once the file is full, the oldest records
+// are overwritten. Records that can't be queued because the writer is falling
+// behind are only counted.
+//
+// User SIDs are not captured. Application ids longer than a record can hold
+// are truncated.
+//
+namespace eventcapture
+{
+
+const uint32_t FILE_MAGIC = 0x43454657; // "WFEC"
+const uint32_t FILE_VERSION = 1;
+
+struct FileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t capacity;
+
+	// Number of records written since the capture started.
+	uint64_t numWritten;
+
+	// Number of events that were discarded before they were written.
+	uint64_t numLost;
+};
+
+// Sized so that a record is 512 bytes.
+const size_t MAX_APP_ID_CHARS = 211;
+
+struct Record
+{
+	FILETIME timeStamp;
+	UINT32 flags;
+	UINT32 type;
+	UINT32 ipVersion;
+	UINT32 scopeId;
+	UINT8 localAddr[16];
+	UINT8 remoteAddr[16];
+	UINT16 localPort;
+	UINT16 remotePort;
+	UINT8 ipProtocol;
+	UINT8 isLoopback;
+
+	// Only valid for classify drops.
+	UINT16 layerId;
+	UINT64 filterId;
+	UINT32 msFwpDirection;
+	UINT32 reauthReason;
+	UINT32 originalProfile;
+	UINT32 currentProfile;
+
+	UINT16 appIdLength;
+	wchar_t appId[MAX_APP_ID_CHARS];
+};
+
+static_assert(512 == sizeof(Record));
+
+class Writer
+{
+public:
+
+	Writer(const std::wstring &path, uint32_t capacity);
+
+	//
+	// Stops accepting events and waits for queued records to be written.
+	//
+	~Writer();
+
+	Writer(const Writer &) = delete;
+	Writer &operator=(const Writer &) = delete;
+
+	//
+	// Safe to call from the event callback.
+	//
+	void add(const FWPM_NET_EVENT1 &event);
+
+	struct Summary
+	{
+		uint64_t numWritten;
+		uint64_t numLost;
+	};
+
+	//
+	// Flushes queued records. Rethrows the error that stopped the writer, if any.
+	//
+	Summary stop();
+
+private:
+
+	HANDLE m_file;
+	const uint32_t m_capacity;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	bool m_stop;
+
+	std::vector<Record> m_queue;
+	uint64_t m_numWritten;
+	uint64_t m_numLost;
+
+	std::exception_ptr m_error;
+
+	std::thread m_thread;
+
+	void thread();
+
+	void write(const std::vector<Record> &records, uint64_t sequence);
+	void writeHeader(uint64_t numWritten, uint64_t numLost);
+	void writeAt(uint64_t offset, const void *data, size_t size);
+};
+
+struct DecodeSummary
+{
+	uint32_t capacity;
+	uint64_t numWritten;
+	uint64_t numLost;
+
+	// Records that were overwritten before the capture ended.
+	uint64_t numOverwritten;
+};
+
+using DecodeSink = std::function<void(const FWPM_NET_EVENT1 &event)>;
+
+//
+// Reconstruct the captured events, oldest first.
+//
+DecodeSummary Decode(const std::wstring &path, DecodeSink sink);
+
+}
@@ -6,6 +6,7 @@
 #include "cli/commands/list/providers.h"
 #include "cli/commands/list/events.h"
 #include "cli/commands/list/filters.h"
+#include "cli/commands/list/filterreport.h"
 #include "cli/commands/list/layers.h"
 #include "cli/commands/list/providercontexts.h"
 #include "cli/commands/list/sublayers.h"
@@ -24,6 +25,7 @@ public:
 		addCommand(std::make_unique<commands::list::Providers>(messageSink));
 		addCommand(std::make_unique<commands::list::Events>(messageSink));
 		addCommand(std::make_unique<commands::list::Filters>(messageSink));
+		addCommand(std::make_unique<commands::list::FilterReport>(messageSink));
 		addCommand(std::make_unique<commands::list::Layers>(messageSink));
 		addCommand(std::make_unique<commands::list::ProviderContexts>(messageSink));
 		addCommand(std::make_unique<commands::list::Sublayers>(messageSink));
@@ -3,6 +3,7 @@
 #include "module.h"
 #include "cli/util.h"
 #include "cli/commands/monitor/m_events.h"
+#include "cli/commands/monitor/m_decode.h"
 
 namespace modules
 {
@@ -15,6 +16,7 @@ public:
 		: Module(L"monitor", L"Real-time monitoring of events and object creation/deletion in WFP.")
 	{
 		addCommand(std::make_unique<commands::monitor::Events>(messageSink));
+		addCommand(std::make_unique<commands::monitor::Decode>(messageSink));
 	}
 };
 
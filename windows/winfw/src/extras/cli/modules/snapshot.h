@@ -0,0 +1,23 @@
+#pragma once
+
+#include "module.h"
+#include "cli/util.h"
+#include "cli/commands/snapshot/save.h"
+#include "cli/commands/snapshot/diff.h"
+
+namespace modules
+{
+
+class Snapshot : public Module
+{
+public:
+
+	Snapshot(MessageSink messageSink)
+		: Module(L"snapshot", L"Save and compare the state of Mullvad objects in WFP.")
+	{
+		addCommand(std::make_unique<commands::snapshot::Save>(messageSink));
+		addCommand(std::make_unique<commands::snapshot::Diff>(messageSink));
+	}
+};
+
+}
@@ -5,6 +5,8 @@
 #include "cli/commands/winfw/init.h"
 #include "cli/commands/winfw/deinit.h"
 #include "cli/commands/winfw/policy.h"
+#include "cli/commands/winfw/replay.h"
+#include "cli/commands/winfw/counters.h"
 
 namespace modules
 {
@@ -19,6 +21,8 @@ public:
 		addCommand(std::make_unique<commands::winfw::Init>(messageSink));
 		addCommand(std::make_unique<commands::winfw::Deinit>(messageSink));
 		addCommand(std::make_unique<commands::winfw::Policy>(messageSink));
+		addCommand(std::make_unique<commands::winfw::Replay>(messageSink));
+		addCommand(std::make_unique<commands::winfw::Counters>(messageSink));
 	}
 };
 
@@ -0,0 +1,178 @@
+#include "stdafx.h"
+#include "orderedformatter.h"
+#include <algorithm>
+
+namespace
+{
+
+//
+// Output is passed to the sink once this much has been buffered.
+//
+const size_t OUTPUT_BLOCK_SIZE = 64 * 1024;
+
+} // anonymous namespace
+
+OrderedFormatter::OrderedFormatter(MessageSink messageSink, size_t numThreads, size_t maxPending)
+	: m_messageSink(messageSink)
+	, m_maxPending(std::max<size_t>(maxPending, 1))
+	, m_nextSubmitted(0)
+	, m_nextWritten(0)
+	, m_stop(false)
+{
+	if (0 == numThreads)
+	{
+		numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
+	for (size_t i = 0; i < numThreads; ++i)
+	{
+		m_threads.emplace_back(&OrderedFormatter::worker, this);
+	}
+}
+
+OrderedFormatter::~OrderedFormatter()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+
+		m_progress.wait(lock, [this]()
+		{
+			return m_nextWritten == m_nextSubmitted;
+		});
+
+		m_stop = true;
+	}
+
+	m_jobAvailable.notify_all();
+
+	for (auto &thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void OrderedFormatter::submit(Job job)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_progress.wait(lock, [this]()
+	{
+		return m_nextSubmitted - m_nextWritten < m_maxPending;
+	});
+
+	m_jobs.emplace_back(m_nextSubmitted++, std::move(job));
+
+	lock.unlock();
+
+	m_jobAvailable.notify_one();
+}
+
+void OrderedFormatter::finish()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_progress.wait(lock, [this]()
+	{
+		return m_nextWritten == m_nextSubmitted;
+	});
+
+	flushOutput();
+
+	if (m_error)
+	{
+		auto error = m_error;
+		m_error = nullptr;
+
+		std::rethrow_exception(error);
+	}
+}
+
+void OrderedFormatter::worker()
+{
+	for (;;)
+	{
+		std::pair<uint64_t, Job> job;
+
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+
+			m_jobAvailable.wait(lock, [this]()
+			{
+				return m_stop || false == m_jobs.empty();
+			});
+
+			if (m_jobs.empty())
+			{
+				return;
+			}
+
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		std::wstring result;
+		std::exception_ptr error;
+
+		try
+		{
+			result = job.second();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		{
+			std::scoped_lock<std::mutex> lock(m_lock);
+
+			if (error && !m_error)
+			{
+				m_error = error;
+			}
+
+			m_results.emplace(job.first, std::move(result));
+
+			writeReady();
+		}
+
+		m_progress.notify_all();
+	}
+}
+
+void OrderedFormatter::writeReady()
+{
+	for (auto next = m_results.begin();
+		m_results.end() != next && next->first == m_nextWritten;
+		next = m_results.begin())
+	{
+		m_output.append(next->second);
+
+		m_results.erase(next);
+		++m_nextWritten;
+
+		if (m_output.size() >= OUTPUT_BLOCK_SIZE)
+		{
+			flushOutput();
+		}
+	}
+}
+
+void OrderedFormatter::flushOutput()
+{
+	if (m_output.empty())
+	{
+		return;
+	}
+
+	//
+	// The sink terminates each message with a newline.
+	//
+	if (L'\n' == m_output.back())
+	{
+		m_output.pop_back();
+	}
+
+	m_messageSink(m_output);
+
+	m_output.clear();
+}
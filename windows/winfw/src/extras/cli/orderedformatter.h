@@ -0,0 +1,86 @@
+#pragma once
+
+#include "util.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Formats items on a pool of worker threads, and writes the results to a
+// message sink in the order they were submitted.
+//
+// Output is buffered, and passed to the sink in large blocks rather than one
+// line at a time. Each result should hold complete lines, separated by '\n'.
+//
+// The number of items that are queued or formatted, but not yet written, is
+// bounded. submit() blocks while the limit is reached.
+//
+class OrderedFormatter
+{
+public:
+
+	using Job = std::function<std::wstring()>;
+
+	//
+	// Specify 0 threads to use one per logical processor.
+	//
+	OrderedFormatter(MessageSink messageSink, size_t numThreads = 0, size_t maxPending = 1000);
+
+	//
+	// Waits for submitted items to be written.
+	//
+	~OrderedFormatter();
+
+	void submit(Job job);
+
+	//
+	// Wait for all submitted items to be formatted, and flush the output.
+	// Rethrows the first exception thrown by a job, if any.
+	//
+	void finish();
+
+private:
+
+	OrderedFormatter(const OrderedFormatter &) = delete;
+	OrderedFormatter &operator=(const OrderedFormatter &) = delete;
+
+	void worker();
+
+	//
+	// Write the results that are next in order. Must hold the lock.
+	//
+	void writeReady();
+
+	void flushOutput();
+
+	MessageSink m_messageSink;
+
+	const size_t m_maxPending;
+
+	std::mutex m_lock;
+	std::condition_variable m_jobAvailable;
+	std::condition_variable m_progress;
+
+	std::deque<std::pair<uint64_t, Job>> m_jobs;
+
+	// Formatted results that can't be written until earlier ones are.
+	std::map<uint64_t, std::wstring> m_results;
+
+	uint64_t m_nextSubmitted;
+	uint64_t m_nextWritten;
+
+	std::wstring m_output;
+
+	std::exception_ptr m_error;
+
+	bool m_stop;
+
+	std::vector<std::thread> m_threads;
+};
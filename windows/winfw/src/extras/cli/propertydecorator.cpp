@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "propertydecorator.h"
+#include "libwfp/objectenumerator.h"
 #include "libwfp/objectexplorer.h"
 #include "libcommon/string.h"
 #include "inlineformatter.h"
@@ -23,11 +24,21 @@ std::wstring Format(const wchar_t *in_name, const wchar_t *in_desc)
 
 PropertyDecorator::PropertyDecorator(std::shared_ptr<wfp::FilterEngine> engine)
 	: m_engine(engine)
+	, m_layersLoaded(false)
+	, m_providersLoaded(false)
+	, m_sublayersLoaded(false)
 {
 }
 
 std::wstring PropertyDecorator::FilterDecoration(UINT64 id)
 {
+	const auto cached = m_filters.find(id);
+
+	if (m_filters.end() != cached)
+	{
+		return cached->second;
+	}
+
 	std::wstring brief = L"[n/a]";
 
 	wfp::ObjectExplorer::GetFilter(*m_engine, id, [&brief](const FWPM_FILTER0 &filter)
@@ -36,16 +47,34 @@ std::wstring PropertyDecorator::FilterDecoration(UINT64 id)
 		return true;
 	});
 
+	//
+	// Filter IDs are not reused, so a missing filter can be remembered as well.
+	//
+	m_filters.emplace(id, brief);
+
 	return brief;
 }
 
 std::wstring PropertyDecorator::LayerDecoration(UINT16 id)
 {
+	loadLayers();
+
+	const auto cached = m_layersById.find(id);
+
+	if (m_layersById.end() != cached)
+	{
+		return cached->second;
+	}
+
 	std::wstring brief = L"[n/a]";
 
-	wfp::ObjectExplorer::GetLayer(*m_engine, id, [&brief](const FWPM_LAYER0 &layer)
+	wfp::ObjectExplorer::GetLayer(*m_engine, id, [&](const FWPM_LAYER0 &layer)
 	{
 		brief = detail::Format(layer.displayData.name, layer.displayData.description);
+
+		m_layersById.emplace(id, brief);
+		m_layersByKey.emplace(layer.layerKey, brief);
+
 		return true;
 	});
 
@@ -54,11 +83,24 @@ std::wstring PropertyDecorator::LayerDecoration(UINT16 id)
 
 std::wstring PropertyDecorator::LayerDecoration(const GUID &key)
 {
+	loadLayers();
+
+	const auto cached = m_layersByKey.find(key);
+
+	if (m_layersByKey.end() != cached)
+	{
+		return cached->second;
+	}
+
 	std::wstring brief = L"[n/a]";
 
-	wfp::ObjectExplorer::GetLayer(*m_engine, key, [&brief](const FWPM_LAYER0 &layer)
+	wfp::ObjectExplorer::GetLayer(*m_engine, key, [&](const FWPM_LAYER0 &layer)
 	{
 		brief = detail::Format(layer.displayData.name, layer.displayData.description);
+
+		m_layersById.emplace(layer.layerId, brief);
+		m_layersByKey.emplace(key, brief);
+
 		return true;
 	});
 
@@ -67,11 +109,22 @@ std::wstring PropertyDecorator::LayerDecoration(const GUID &key)
 
 std::wstring PropertyDecorator::ProviderDecoration(const GUID &key)
 {
+	loadProviders();
+
+	const auto cached = m_providers.find(key);
+
+	if (m_providers.end() != cached)
+	{
+		return cached->second;
+	}
+
 	std::wstring brief = L"[n/a]";
 
-	wfp::ObjectExplorer::GetProvider(*m_engine, key, [&brief](const FWPM_PROVIDER0 &provider)
+	wfp::ObjectExplorer::GetProvider(*m_engine, key, [&](const FWPM_PROVIDER0 &provider)
 	{
 		brief = detail::Format(provider.displayData.name, provider.displayData.description);
+		m_providers.emplace(key, brief);
+
 		return true;
 	});
 
@@ -80,13 +133,80 @@ std::wstring PropertyDecorator::ProviderDecoration(const GUID &key)
 
 std::wstring PropertyDecorator::SublayerDecoration(const GUID &key)
 {
+	loadSublayers();
+
+	const auto cached = m_sublayers.find(key);
+
+	if (m_sublayers.end() != cached)
+	{
+		return cached->second;
+	}
+
 	std::wstring brief = L"[n/a]";
 
-	wfp::ObjectExplorer::GetSublayer(*m_engine, key, [&brief](const FWPM_SUBLAYER0 &sublayer)
+	wfp::ObjectExplorer::GetSublayer(*m_engine, key, [&](const FWPM_SUBLAYER0 &sublayer)
 	{
 		brief = detail::Format(sublayer.displayData.name, sublayer.displayData.description);
+		m_sublayers.emplace(key, brief);
+
 		return true;
 	});
 
 	return brief;
 }
+
+void PropertyDecorator::loadLayers()
+{
+	if (m_layersLoaded)
+	{
+		return;
+	}
+
+	m_layersLoaded = true;
+
+	wfp::ObjectEnumerator::Layers(*m_engine, [this](const FWPM_LAYER0 &layer)
+	{
+		auto brief = detail::Format(layer.displayData.name, layer.displayData.description);
+
+		m_layersById.emplace(layer.layerId, brief);
+		m_layersByKey.emplace(layer.layerKey, std::move(brief));
+
+		return true;
+	});
+}
+
+void PropertyDecorator::loadProviders()
+{
+	if (m_providersLoaded)
+	{
+		return;
+	}
+
+	m_providersLoaded = true;
+
+	wfp::ObjectEnumerator::Providers(*m_engine, [this](const FWPM_PROVIDER0 &provider)
+	{
+		m_providers.emplace(provider.providerKey,
+			detail::Format(provider.displayData.name, provider.displayData.description));
+
+		return true;
+	});
+}
+
+void PropertyDecorator::loadSublayers()
+{
+	if (m_sublayersLoaded)
+	{
+		return;
+	}
+
+	m_sublayersLoaded = true;
+
+	wfp::ObjectEnumerator::Sublayers(*m_engine, [this](const FWPM_SUBLAYER0 &sublayer)
+	{
+		m_sublayers.emplace(sublayer.subLayerKey,
+			detail::Format(sublayer.displayData.name, sublayer.displayData.description));
+
+		return true;
+	});
+}
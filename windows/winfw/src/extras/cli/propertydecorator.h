@@ -2,8 +2,20 @@
 
 #include "ipropertydecorator.h"
 #include "libwfp/filterengine.h"
+#include <cstring>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
+//
+// Decorations are cached for the lifetime of the instance.
+//
+// Layers, providers and sublayers are loaded with a single enumeration the first
+// time each type is needed. Objects added after that are looked up individually.
+// Filters are too numerous to load in bulk, so they are looked up and cached one
+// at a time.
+//
 class PropertyDecorator : public IPropertyDecorator
 {
 public:
@@ -23,5 +35,81 @@ public:
 
 private:
 
+	struct GuidLess
+	{
+		bool operator()(const GUID &lhs, const GUID &rhs) const
+		{
+			return memcmp(&lhs, &rhs, sizeof(GUID)) < 0;
+		}
+	};
+
+	using GuidCache = std::map<GUID, std::wstring, GuidLess>;
+
+	void loadLayers();
+	void loadProviders();
+	void loadSublayers();
+
 	std::shared_ptr<wfp::FilterEngine> m_engine;
+
+	bool m_layersLoaded;
+	std::unordered_map<UINT16, std::wstring> m_layersById;
+	GuidCache m_layersByKey;
+
+	bool m_providersLoaded;
+	GuidCache m_providers;
+
+	bool m_sublayersLoaded;
+	GuidCache m_sublayers;
+
+	std::unordered_map<UINT64, std::wstring> m_filters;
+};
+
+//
+// Serializes access to another decorator, so it can be shared between threads.
+// Decorations are cached by the inner decorator, so the lock is held briefly
+// once the caches are warm.
+//
+class SynchronizedPropertyDecorator : public IPropertyDecorator
+{
+public:
+
+	SynchronizedPropertyDecorator(IPropertyDecorator &inner)
+		: m_inner(inner)
+	{
+	}
+
+	std::wstring FilterDecoration(UINT64 id) override
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		return m_inner.FilterDecoration(id);
+	}
+
+	std::wstring LayerDecoration(UINT16 id) override
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		return m_inner.LayerDecoration(id);
+	}
+
+	std::wstring LayerDecoration(const GUID &key) override
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		return m_inner.LayerDecoration(key);
+	}
+
+	std::wstring ProviderDecoration(const GUID &key) override
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		return m_inner.ProviderDecoration(key);
+	}
+
+	std::wstring SublayerDecoration(const GUID &key) override
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		return m_inner.SublayerDecoration(key);
+	}
+
+private:
+
+	IPropertyDecorator &m_inner;
+	std::mutex m_lock;
 };
@@ -0,0 +1,366 @@
+#include "stdafx.h"
+#include "wfpsnapshot.h"
+#include "winfw/filtercontent.h"
+#include "winfw/mullvadguids.h"
+#include "libwfp/objectenumerator.h"
+#include <libcommon/error.h>
+#include <algorithm>
+#include <cstring>
+
+namespace wfpsnapshot
+{
+
+namespace
+{
+
+bool IsMullvadProvider(const GUID &key)
+{
+	return 0 != IsEqualGUID(key, MullvadGuids::Provider())
+		|| 0 != IsEqualGUID(key, MullvadGuids::ProviderPersistent());
+}
+
+bool IsMullvadProvider(const GUID *key)
+{
+	return nullptr != key && IsMullvadProvider(*key);
+}
+
+bool GuidLess(const GUID &lhs, const GUID &rhs)
+{
+	return memcmp(&lhs, &rhs, sizeof(GUID)) < 0;
+}
+
+bool RecordLess(const Record &lhs, const Record &rhs)
+{
+	if (lhs.type != rhs.type)
+	{
+		return lhs.type < rhs.type;
+	}
+
+	return GuidLess(lhs.key, rhs.key);
+}
+
+void AppendDisplayData(FilterContent::Buffer &buffer, const FWPM_DISPLAY_DATA0 &displayData)
+{
+	for (const auto str : { displayData.name, displayData.description })
+	{
+		if (nullptr != str)
+		{
+			const auto bytes = reinterpret_cast<const uint8_t *>(str);
+			buffer.insert(buffer.end(), bytes, bytes + wcslen(str) * sizeof(wchar_t));
+		}
+
+		buffer.push_back(0);
+	}
+}
+
+uint64_t ConditionsHash(const FWPM_FILTER0 &filter)
+{
+	//
+	// Serialize a filter that only has conditions so changes to other
+	// properties don't leak into the hash.
+	//
+	FWPM_FILTER0 conditions = { 0 };
+
+	conditions.numFilterConditions = filter.numFilterConditions;
+	conditions.filterCondition = filter.filterCondition;
+
+	return FilterContent::Hash(FilterContent::Serialize(conditions));
+}
+
+Record FilterRecord(const FWPM_FILTER0 &filter)
+{
+	Record record = { };
+
+	record.type = ObjectType::Filter;
+	record.flags = filter.flags;
+	record.key = filter.filterKey;
+	record.providerKey = *filter.providerKey;
+	record.layerKey = filter.layerKey;
+	record.subLayerKey = filter.subLayerKey;
+	record.filterId = filter.filterId;
+	record.effectiveWeight = (FWP_UINT64 == filter.effectiveWeight.type ? *filter.effectiveWeight.uint64 : 0);
+	record.actionType = filter.action.type;
+	record.numConditions = filter.numFilterConditions;
+	record.conditionsHash = ConditionsHash(filter);
+	record.contentHash = FilterContent::Hash(FilterContent::Serialize(filter));
+
+	return record;
+}
+
+Record SublayerRecord(const FWPM_SUBLAYER0 &sublayer)
+{
+	Record record = { };
+
+	record.type = ObjectType::Sublayer;
+	record.flags = sublayer.flags;
+	record.key = sublayer.subLayerKey;
+	record.providerKey = *sublayer.providerKey;
+	record.effectiveWeight = sublayer.weight;
+
+	FilterContent::Buffer content;
+	AppendDisplayData(content, sublayer.displayData);
+
+	record.contentHash = FilterContent::Hash(content);
+
+	return record;
+}
+
+Record ProviderRecord(const FWPM_PROVIDER0 &provider)
+{
+	Record record = { };
+
+	record.type = ObjectType::Provider;
+	record.flags = provider.flags;
+	record.key = provider.providerKey;
+	record.providerKey = provider.providerKey;
+
+	FilterContent::Buffer content;
+	AppendDisplayData(content, provider.displayData);
+
+	if (nullptr != provider.serviceName)
+	{
+		const auto bytes = reinterpret_cast<const uint8_t *>(provider.serviceName);
+		content.insert(content.end(), bytes, bytes + wcslen(provider.serviceName) * sizeof(wchar_t));
+	}
+
+	record.contentHash = FilterContent::Hash(content);
+
+	return record;
+}
+
+uint32_t CompareRecords(const Record &from, const Record &to)
+{
+	uint32_t fields = 0;
+
+	if (from.flags != to.flags)
+	{
+		fields |= CHANGED_FLAGS;
+	}
+
+	if (0 == IsEqualGUID(from.providerKey, to.providerKey))
+	{
+		fields |= CHANGED_PROVIDER;
+	}
+
+	if (0 == IsEqualGUID(from.layerKey, to.layerKey))
+	{
+		fields |= CHANGED_LAYER;
+	}
+
+	if (0 == IsEqualGUID(from.subLayerKey, to.subLayerKey))
+	{
+		fields |= CHANGED_SUBLAYER;
+	}
+
+	if (from.effectiveWeight != to.effectiveWeight)
+	{
+		fields |= CHANGED_WEIGHT;
+	}
+
+	if (from.actionType != to.actionType)
+	{
+		fields |= CHANGED_ACTION;
+	}
+
+	if (from.numConditions != to.numConditions
+		|| from.conditionsHash != to.conditionsHash)
+	{
+		fields |= CHANGED_CONDITIONS;
+	}
+
+	if (0 == fields && from.contentHash != to.contentHash)
+	{
+		fields |= CHANGED_OTHER;
+	}
+
+	if (0 == fields && from.filterId != to.filterId)
+	{
+		fields |= CHANGED_REINSTALLED;
+	}
+
+	return fields;
+}
+
+class File
+{
+public:
+
+	File(const std::wstring &path, DWORD access, DWORD disposition)
+	{
+		m_handle = CreateFileW(path.c_str(), access, FILE_SHARE_READ, nullptr,
+			disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (INVALID_HANDLE_VALUE == m_handle)
+		{
+			THROW_WINDOWS_ERROR(GetLastError(), "Open snapshot file");
+		}
+	}
+
+	~File()
+	{
+		CloseHandle(m_handle);
+	}
+
+	File(const File &) = delete;
+	File &operator=(const File &) = delete;
+
+	void read(void *data, size_t size)
+	{
+		DWORD bytesRead;
+
+		if (FALSE == ReadFile(m_handle, data, static_cast<DWORD>(size), &bytesRead, nullptr)
+			|| bytesRead != size)
+		{
+			THROW_ERROR("Truncated snapshot file");
+		}
+	}
+
+	void write(const void *data, size_t size)
+	{
+		DWORD bytesWritten;
+
+		if (FALSE == WriteFile(m_handle, data, static_cast<DWORD>(size), &bytesWritten, nullptr)
+			|| bytesWritten != size)
+		{
+			THROW_WINDOWS_ERROR(GetLastError(), "Write to snapshot file");
+		}
+	}
+
+private:
+
+	HANDLE m_handle;
+};
+
+} // anonymous namespace
+
+Snapshot Capture(wfp::FilterEngine &engine)
+{
+	Snapshot snapshot;
+
+	GetSystemTimeAsFileTime(&snapshot.timeStamp);
+
+	wfp::ObjectEnumerator::Providers(engine, [&](const FWPM_PROVIDER0 &provider)
+	{
+		if (IsMullvadProvider(provider.providerKey))
+		{
+			snapshot.records.push_back(ProviderRecord(provider));
+		}
+
+		return true;
+	});
+
+	wfp::ObjectEnumerator::Sublayers(engine, [&](const FWPM_SUBLAYER0 &sublayer)
+	{
+		if (IsMullvadProvider(sublayer.providerKey))
+		{
+			snapshot.records.push_back(SublayerRecord(sublayer));
+		}
+
+		return true;
+	});
+
+	wfp::ObjectEnumerator::Filters(engine, [&](const FWPM_FILTER0 &filter)
+	{
+		if (IsMullvadProvider(filter.providerKey))
+		{
+			snapshot.records.push_back(FilterRecord(filter));
+		}
+
+		return true;
+	});
+
+	std::sort(snapshot.records.begin(), snapshot.records.end(), RecordLess);
+
+	return snapshot;
+}
+
+void Save(const std::wstring &path, const Snapshot &snapshot)
+{
+	File file(path, GENERIC_WRITE, CREATE_ALWAYS);
+
+	FileHeader header;
+
+	header.magic = FILE_MAGIC;
+	header.version = FILE_VERSION;
+	header.recordSize = sizeof(Record);
+	header.numRecords = static_cast<uint32_t>(snapshot.records.size());
+	header.timeStamp = snapshot.timeStamp;
+
+	file.write(&header, sizeof(header));
+
+	if (false == snapshot.records.empty())
+	{
+		file.write(snapshot.records.data(), snapshot.records.size() * sizeof(Record));
+	}
+}
+
+Snapshot Load(const std::wstring &path)
+{
+	File file(path, GENERIC_READ, OPEN_EXISTING);
+
+	FileHeader header;
+
+	file.read(&header, sizeof(header));
+
+	if (FILE_MAGIC != header.magic
+		|| FILE_VERSION != header.version
+		|| sizeof(Record) != header.recordSize)
+	{
+		THROW_ERROR("Unsupported snapshot file");
+	}
+
+	Snapshot snapshot;
+
+	snapshot.timeStamp = header.timeStamp;
+	snapshot.records.resize(header.numRecords);
+
+	if (0 != header.numRecords)
+	{
+		file.read(snapshot.records.data(), snapshot.records.size() * sizeof(Record));
+	}
+
+	if (false == std::is_sorted(snapshot.records.begin(), snapshot.records.end(), RecordLess))
+	{
+		THROW_ERROR("Corrupt snapshot file");
+	}
+
+	return snapshot;
+}
+
+std::vector<Change> Diff(const Snapshot &from, const Snapshot &to)
+{
+	std::vector<Change> changes;
+
+	auto f = from.records.begin();
+	auto t = to.records.begin();
+
+	while (f != from.records.end() || t != to.records.end())
+	{
+		if (t == to.records.end() || (f != from.records.end() && RecordLess(*f, *t)))
+		{
+			changes.push_back(Change{ ChangeType::Removed, *f, 0 });
+			++f;
+		}
+		else if (f == from.records.end() || RecordLess(*t, *f))
+		{
+			changes.push_back(Change{ ChangeType::Added, *t, 0 });
+			++t;
+		}
+		else
+		{
+			const auto fields = CompareRecords(*f, *t);
+
+			if (0 != fields)
+			{
+				changes.push_back(Change{ ChangeType::Modified, *t, fields });
+			}
+
+			++f;
+			++t;
+		}
+	}
+
+	return changes;
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "libwfp/filterengine.h"
+#include <windows.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Compact record of the WFP objects owned by Mullvad, for comparing the state of
+// the firewall at two points in time.
+//
+// Only providers, sublayers and filters that are registered under one of the
+// Mullvad providers are captured. Names and condition values are not stored;
+// filter conditions are reduced to a hash, so two snapshots can tell that a
+// filter changed but not how its conditions differ.
+//
+namespace wfpsnapshot
+{
+
+const uint32_t FILE_MAGIC = 0x53535746; // "FWSS"
+const uint32_t FILE_VERSION = 1;
+
+struct FileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t numRecords;
+	FILETIME timeStamp;
+};
+
+enum class ObjectType : uint32_t
+{
+	Provider = 0,
+	Sublayer = 1,
+	Filter = 2,
+};
+
+struct Record
+{
+	ObjectType type;
+	UINT32 flags;
+	GUID key;
+
+	// Owning provider for sublayers and filters.
+	GUID providerKey;
+
+	// Only valid for filters.
+	GUID layerKey;
+	GUID subLayerKey;
+	UINT64 filterId;
+	UINT64 effectiveWeight;
+	UINT32 actionType;
+	UINT32 numConditions;
+	UINT64 conditionsHash;
+
+	// Hash of the complete definition, including display data.
+	UINT64 contentHash;
+};
+
+static_assert(112 == sizeof(Record));
+
+struct Snapshot
+{
+	FILETIME timeStamp;
+
+	// Ordered by type, then key.
+	std::vector<Record> records;
+};
+
+Snapshot Capture(wfp::FilterEngine &engine);
+
+void Save(const std::wstring &path, const Snapshot &snapshot);
+Snapshot Load(const std::wstring &path);
+
+enum class ChangeType
+{
+	Added,
+	Removed,
+	Modified,
+};
+
+enum ChangedField : uint32_t
+{
+	CHANGED_FLAGS = 0x01,
+	CHANGED_PROVIDER = 0x02,
+	CHANGED_LAYER = 0x04,
+	CHANGED_SUBLAYER = 0x08,
+	CHANGED_WEIGHT = 0x10,
+	CHANGED_ACTION = 0x20,
+	CHANGED_CONDITIONS = 0x40,
+
+	// Something other than the above, e.g. the name or description.
+	CHANGED_OTHER = 0x80,
+
+	// Content is identical but the object was deleted and added again.
+	CHANGED_REINSTALLED = 0x100,
+};
+
+struct Change
+{
+	ChangeType type;
+
+	// The record in the second snapshot, or in the first for removed objects.
+	Record record;
+
+	// Combination of ChangedField values, only set for modifications.
+	uint32_t fields;
+};
+
+//
+// Structural diff between two snapshots.
+// Changes are ordered by type, then key.
+//
+std::vector<Change> Diff(const Snapshot &from, const Snapshot &to);
+
+}
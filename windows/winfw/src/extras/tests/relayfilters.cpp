@@ -0,0 +1,153 @@
+#include "stdafx.h"
+#include <winfw/rules/permitvpnrelay.h>
+#include <winfw/preparedfilters.h>
+#include <winfw/mullvadguids.h>
+#include <libwfp/ipaddress.h>
+#include <stdexcept>
+#include <vector>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using Relay = rules::PermitVpnRelay::Relay;
+using Protocol = rules::PermitVpnRelay::Protocol;
+
+
+namespace
+{
+
+wfp::IpAddress Ipv4(uint8_t last)
+{
+	return wfp::IpAddress(wfp::IpAddress::Literal{ 185, 65, 134, last });
+}
+
+wfp::IpAddress Ipv6(uint16_t last)
+{
+	return wfp::IpAddress(wfp::IpAddress::Literal6{ 0x2a03, 0x1b20, 0x5, 0xf011, 0, 0, 0, last });
+}
+
+std::vector<GUID> FilterKeys(const std::vector<Relay> &relays)
+{
+	rules::PermitVpnRelay rule(relays);
+	PreparedFilters prepared;
+
+	Assert::IsTrue(rule.apply(prepared));
+
+	std::vector<GUID> keys;
+
+	for (const auto filter : prepared.filters())
+	{
+		keys.push_back(filter->id());
+	}
+
+	return keys;
+}
+
+//
+// Every key must be registered, or the filter cannot be installed,
+// and unique within the rule, or the filters replace each other.
+//
+void AssertInstallableKeys(const std::vector<GUID> &keys)
+{
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		Assert::IsFalse(MullvadGuids::NullKey() == keys[i]);
+		Assert::IsTrue(MullvadGuids::Registry().contains(keys[i]));
+
+		for (size_t j = i + 1; j < keys.size(); ++j)
+		{
+			Assert::IsFalse(keys[i] == keys[j]);
+		}
+	}
+}
+
+} // anonymous namespace
+
+TEST_CLASS(RelayFilters)
+{
+public:
+
+	TEST_METHOD(SinglePortAndProtocolUsesOneFilterPerFamily)
+	{
+		const auto keys = FilterKeys(
+		{
+			Relay{ Ipv4(1), 1194, Protocol::Udp },
+			Relay{ Ipv4(2), 1194, Protocol::Udp },
+			Relay{ Ipv6(1), 1194, Protocol::Udp },
+		});
+
+		Assert::AreEqual(size_t(2), keys.size());
+		Assert::IsTrue(MullvadGuids::FilterPermitVpnRelay_Ipv4() == keys[0]);
+		Assert::IsTrue(MullvadGuids::FilterPermitVpnRelay_Ipv6() == keys[1]);
+	}
+
+	TEST_METHOD(MixedPortsAndProtocolsUseRegisteredKeys)
+	{
+		const std::vector<Relay> relays =
+		{
+			Relay{ Ipv4(1), 1194, Protocol::Udp },
+			Relay{ Ipv4(2), 443, Protocol::Tcp },
+			Relay{ Ipv4(3), 1194, Protocol::Tcp },
+			Relay{ Ipv4(4), 1194, Protocol::Udp },
+			Relay{ Ipv6(1), 51820, Protocol::Udp },
+			Relay{ Ipv6(2), 443, Protocol::Tcp },
+		};
+
+		const auto keys = FilterKeys(relays);
+
+		Assert::AreEqual(size_t(5), keys.size());
+		AssertInstallableKeys(keys);
+
+		//
+		// Keys are derived from the relays, so a reapplied policy reuses the installed filters.
+		//
+		Assert::IsTrue(keys == FilterKeys(relays));
+	}
+
+	//
+	// A relay switch permits the connected relay and the new relay in the same rule.
+	//
+	TEST_METHOD(SwitchToRelayWithDifferentPortAndProtocol)
+	{
+		const Relay connected{ Ipv4(1), 1194, Protocol::Udp };
+		const Relay next{ Ipv4(2), 443, Protocol::Tcp };
+
+		rules::PermitVpnRelay connectedRule({ connected });
+		rules::PermitVpnRelay switchRule({ connected, next });
+
+		PreparedFilters connectedFilters;
+		PreparedFilters switchFilters;
+
+		Assert::IsTrue(connectedRule.apply(connectedFilters));
+		Assert::IsTrue(switchRule.apply(switchFilters));
+
+		Assert::AreEqual(size_t(1), connectedFilters.filters().size());
+		Assert::AreEqual(size_t(2), switchFilters.filters().size());
+
+		AssertInstallableKeys({ switchFilters.filters()[0]->id(), switchFilters.filters()[1]->id() });
+
+		//
+		// The filter for the connected relay is identical in both rules,
+		// so it's left in place during the switch.
+		//
+		const auto before = connectedFilters.filters()[0];
+		const auto after = switchFilters.filters()[0];
+
+		Assert::IsTrue(before->id() == after->id());
+		Assert::IsTrue(before->content() == after->content());
+	}
+
+	TEST_METHOD(TooManyPortsAndProtocolsThrows)
+	{
+		std::vector<Relay> relays;
+
+		for (uint16_t port = 0; port <= MullvadGuids::MaxVpnRelayGroups; ++port)
+		{
+			relays.push_back(Relay{ Ipv4(1), static_cast<uint16_t>(1194 + port), Protocol::Udp });
+		}
+
+		Assert::ExpectException<std::exception>([&relays]()
+		{
+			rules::PermitVpnRelay rule(relays);
+		});
+	}
+};
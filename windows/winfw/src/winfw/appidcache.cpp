@@ -0,0 +1,124 @@
+#include "stdafx.h"
+#include "appidcache.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libcommon/string.h>
+#include <fwpmu.h>
+
+namespace
+{
+
+//
+// Excluded applications are configured by the user and change rarely.
+// This only guards against unbounded growth.
+//
+const size_t MAX_CACHED_APP_IDS = 256;
+
+bool IsMissingFileError(DWORD error)
+{
+	return ERROR_FILE_NOT_FOUND == error
+		|| ERROR_PATH_NOT_FOUND == error
+		|| ERROR_INVALID_NAME == error;
+}
+
+} // anonymous namespace
+
+std::shared_ptr<const AppIdCache::AppId> AppIdCache::get(const std::wstring &path)
+{
+	FileIdentity identity;
+
+	if (false == GetFileIdentity(path, identity))
+	{
+		return nullptr;
+	}
+
+	const auto key = common::string::Lower(path);
+
+	const auto cached = m_entries.find(key);
+
+	if (m_entries.end() != cached)
+	{
+		if (cached->second.identity == identity)
+		{
+			return cached->second.appId;
+		}
+
+		m_entries.erase(cached);
+	}
+
+	auto appId = Resolve(path);
+
+	if (m_entries.size() >= MAX_CACHED_APP_IDS)
+	{
+		m_entries.clear();
+	}
+
+	m_entries.emplace(key, Entry{ identity, appId });
+
+	return appId;
+}
+
+void AppIdCache::clear()
+{
+	m_entries.clear();
+}
+
+//static
+bool AppIdCache::GetFileIdentity(const std::wstring &path, FileIdentity &identity)
+{
+	auto file = CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+
+	if (INVALID_HANDLE_VALUE == file)
+	{
+		const auto error = GetLastError();
+
+		if (IsMissingFileError(error))
+		{
+			return false;
+		}
+
+		THROW_WINDOWS_ERROR(error, "Open application file");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [file]
+	{
+		CloseHandle(file);
+	};
+
+	BY_HANDLE_FILE_INFORMATION info;
+
+	if (FALSE == GetFileInformationByHandle(file, &info))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Query application file identity");
+	}
+
+	identity.volumeSerialNumber = info.dwVolumeSerialNumber;
+	identity.fileIndex = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+
+	return true;
+}
+
+//static
+std::shared_ptr<const AppIdCache::AppId> AppIdCache::Resolve(const std::wstring &path)
+{
+	FWP_BYTE_BLOB *blob = nullptr;
+
+	const auto status = FwpmGetAppIdFromFileName0(path.c_str(), &blob);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Resolve application identifier");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&blob]
+	{
+		FwpmFreeMemory0(reinterpret_cast<void **>(&blob));
+	};
+
+	return std::make_shared<const AppId>(blob->data, blob->data + blob->size);
+}
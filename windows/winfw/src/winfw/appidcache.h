@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//
+// Cache of WFP application identifiers.
+//
+// Resolving an application identifier through FwpmGetAppIdFromFileName0() is
+// comparatively expensive. Identifiers are cached by path, and revalidated
+// using the file identity, so a path that is made to refer to a different
+// file is resolved again.
+//
+class AppIdCache
+{
+public:
+
+	using AppId = std::vector<uint8_t>;
+
+	AppIdCache() = default;
+
+	//
+	// Returns nullptr if the file does not exist.
+	//
+	std::shared_ptr<const AppId> get(const std::wstring &path);
+
+	void clear();
+
+private:
+
+	AppIdCache(const AppIdCache &) = delete;
+	AppIdCache &operator=(const AppIdCache &) = delete;
+
+	struct FileIdentity
+	{
+		uint32_t volumeSerialNumber;
+		uint64_t fileIndex;
+
+		bool operator==(const FileIdentity &rhs) const
+		{
+			return volumeSerialNumber == rhs.volumeSerialNumber
+				&& fileIndex == rhs.fileIndex;
+		}
+	};
+
+	static bool GetFileIdentity(const std::wstring &path, FileIdentity &identity);
+
+	static std::shared_ptr<const AppId> Resolve(const std::wstring &path);
+
+	struct Entry
+	{
+		FileIdentity identity;
+		std::shared_ptr<const AppId> appId;
+	};
+
+	// Indexed by lower case path.
+	std::unordered_map<std::wstring, Entry> m_entries;
+};
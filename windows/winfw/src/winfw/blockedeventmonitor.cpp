@@ -0,0 +1,277 @@
+#include "stdafx.h"
+#include "blockedeventmonitor.h"
+#include "mullvadguids.h"
+#include "libwfp/objectexplorer.h"
+#include <libcommon/string.h>
+#include <libshared/tracing/trace.h>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+
+//
+// Upper bound on the number of distinct entries in a single batch.
+//
+const size_t MAX_AGGREGATE_ENTRIES = 256;
+
+std::wstring ApplicationFromEvent(const FWPM_NET_EVENT_HEADER1 &header)
+{
+	if (0 == (header.flags & FWPM_NET_EVENT_FLAG_APP_ID_SET)
+		|| nullptr == header.appId.data)
+	{
+		return L"";
+	}
+
+	auto begin = reinterpret_cast<const wchar_t *>(header.appId.data);
+	auto end = begin + (header.appId.size / sizeof(wchar_t));
+
+	std::wstring application(begin, end);
+
+	while (false == application.empty() && L'\0' == application.back())
+	{
+		application.pop_back();
+	}
+
+	return application;
+}
+
+std::wstring FormatRemoteAddress(FWP_IP_VERSION ipVersion, const std::array<uint8_t, 16> &address)
+{
+	switch (ipVersion)
+	{
+		case FWP_IP_VERSION_V4:
+		{
+			uint32_t v4;
+			memcpy(&v4, address.data(), sizeof(v4));
+
+			return common::string::FormatIpv4(v4);
+		}
+		case FWP_IP_VERSION_V6:
+		{
+			return common::string::FormatIpv6(address.data());
+		}
+		default:
+		{
+			return L"";
+		}
+	}
+}
+
+} // anonymous namespace
+
+bool BlockedEventMonitor::Key::operator<(const Key &rhs) const
+{
+	return std::tie(filterId, ipVersion, remoteAddress, application)
+		< std::tie(rhs.filterId, rhs.ipVersion, rhs.remoteAddress, rhs.application);
+}
+
+BlockedEventMonitor::BlockedEventMonitor(uint32_t timeout, std::chrono::milliseconds window, Sink sink)
+	: m_engine(wfp::FilterEngine::StandardSession(timeout))
+	, m_window(window)
+	, m_sink(sink)
+	, m_stop(false)
+	, m_overflowed(0)
+{
+	m_thread = std::thread(&BlockedEventMonitor::thread, this);
+
+	try
+	{
+		m_monitor = std::make_unique<wfp::ObjectMonitor>(m_engine);
+		m_monitor->monitorEvents(std::bind(&BlockedEventMonitor::eventCallback, this, std::placeholders::_1));
+	}
+	catch (...)
+	{
+		{
+			std::scoped_lock<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		m_wakeup.notify_all();
+		m_thread.join();
+
+		throw;
+	}
+}
+
+BlockedEventMonitor::~BlockedEventMonitor()
+{
+	//
+	// Unsubscribing waits for callbacks that are in progress.
+	//
+	m_monitor->monitorEventsStop();
+
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_wakeup.notify_all();
+	m_thread.join();
+}
+
+void BlockedEventMonitor::eventCallback(const FWPM_NET_EVENT1 &event)
+{
+	if (FWPM_NET_EVENT_TYPE_CLASSIFY_DROP != event.type
+		|| nullptr == event.classifyDrop)
+	{
+		return;
+	}
+
+	Key key;
+
+	key.application = ApplicationFromEvent(event.header);
+	key.ipVersion = FWP_IP_VERSION_NONE;
+	key.remoteAddress.fill(0);
+	key.filterId = event.classifyDrop->filterId;
+
+	if (0 != (event.header.flags & FWPM_NET_EVENT_FLAG_IP_VERSION_SET)
+		&& 0 != (event.header.flags & FWPM_NET_EVENT_FLAG_REMOTE_ADDR_SET))
+	{
+		key.ipVersion = event.header.ipVersion;
+
+		if (FWP_IP_VERSION_V4 == key.ipVersion)
+		{
+			memcpy(key.remoteAddress.data(), &event.header.remoteAddrV4, sizeof(event.header.remoteAddrV4));
+		}
+		else
+		{
+			memcpy(key.remoteAddress.data(), event.header.remoteAddrV6.byteArray16, key.remoteAddress.size());
+		}
+	}
+
+	std::scoped_lock<std::mutex> lock(m_mutex);
+
+	const auto ownership = m_filterOwnership.find(key.filterId);
+
+	if (m_filterOwnership.end() != ownership && false == ownership->second)
+	{
+		return;
+	}
+
+	const auto entry = m_aggregate.find(key);
+
+	if (m_aggregate.end() != entry)
+	{
+		++entry->second;
+		return;
+	}
+
+	if (m_aggregate.size() >= MAX_AGGREGATE_ENTRIES)
+	{
+		++m_overflowed;
+		return;
+	}
+
+	m_aggregate.emplace(std::move(key), 1);
+}
+
+void BlockedEventMonitor::thread()
+{
+	for (;;)
+	{
+		Aggregate aggregate;
+		uint32_t overflowed;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			if (m_wakeup.wait_for(lock, m_window, [this]() { return m_stop; }))
+			{
+				return;
+			}
+
+			aggregate.swap(m_aggregate);
+
+			overflowed = m_overflowed;
+			m_overflowed = 0;
+		}
+
+		if (aggregate.empty() && 0 == overflowed)
+		{
+			continue;
+		}
+
+		try
+		{
+			deliver(aggregate, overflowed);
+		}
+		catch (...)
+		{
+		}
+	}
+}
+
+void BlockedEventMonitor::deliver(const Aggregate &aggregate, uint32_t numOverflowed)
+{
+	std::vector<std::wstring> remoteAddresses;
+	std::vector<WinFwBlockedEvent> events;
+
+	remoteAddresses.reserve(aggregate.size());
+	events.reserve(aggregate.size());
+
+	for (const auto &[key, count] : aggregate)
+	{
+		if (false == isMullvadFilter(key.filterId))
+		{
+			continue;
+		}
+
+		remoteAddresses.emplace_back(FormatRemoteAddress(key.ipVersion, key.remoteAddress));
+
+		WinFwBlockedEvent event;
+
+		event.application = (key.application.empty() ? nullptr : key.application.c_str());
+		event.remoteAddress = (remoteAddresses.back().empty() ? nullptr : remoteAddresses.back().c_str());
+		event.filterId = key.filterId;
+		event.count = count;
+
+		events.push_back(event);
+	}
+
+	if (events.empty() && 0 == numOverflowed)
+	{
+		return;
+	}
+
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordMonitor);
+
+	m_sink(events.data(), static_cast<uint32_t>(events.size()), numOverflowed);
+
+	shared::tracing::MonitorCallback(stopwatch, "BlockedEventMonitor");
+}
+
+bool BlockedEventMonitor::isMullvadFilter(UINT64 filterId)
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+
+		const auto ownership = m_filterOwnership.find(filterId);
+
+		if (m_filterOwnership.end() != ownership)
+		{
+			return ownership->second;
+		}
+	}
+
+	bool owned = false;
+
+	const auto found = wfp::ObjectExplorer::GetFilter(*m_engine, filterId, [&owned](const FWPM_FILTER0 &filter)
+	{
+		owned = (nullptr != filter.providerKey && MullvadGuids::Provider() == *filter.providerKey);
+		return true;
+	});
+
+	//
+	// A filter that can't be found was most likely removed after the event was
+	// generated. Don't remember the result, since this is expected to be rare.
+	//
+	if (found)
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+		m_filterOwnership[filterId] = owned;
+	}
+
+	return owned;
+}
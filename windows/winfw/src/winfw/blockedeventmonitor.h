@@ -0,0 +1,89 @@
+#pragma once
+
+#include "winfw.h"
+#include "libwfp/filterengine.h"
+#include "libwfp/objectmonitor.h"
+#include <fwpmu.h>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+//
+// Monitors packets dropped by BFE and forwards those dropped by Mullvad filters.
+//
+// Events are aggregated per (application, remote address, filter) over a window,
+// and a single batch is delivered when the window elapses. The number of distinct
+// entries per window is bounded. Events that cannot be aggregated because the
+// window is full are only counted.
+//
+// Events still pending when the monitor is destroyed are discarded.
+//
+class BlockedEventMonitor
+{
+public:
+
+	using Sink = std::function<void(const WinFwBlockedEvent *events, uint32_t numEvents, uint32_t numOverflowed)>;
+
+	BlockedEventMonitor(uint32_t timeout, std::chrono::milliseconds window, Sink sink);
+	~BlockedEventMonitor();
+
+private:
+
+	BlockedEventMonitor(const BlockedEventMonitor &) = delete;
+	BlockedEventMonitor &operator=(const BlockedEventMonitor &) = delete;
+
+	struct Key
+	{
+		std::wstring application;
+
+		FWP_IP_VERSION ipVersion;
+		std::array<uint8_t, 16> remoteAddress;
+
+		UINT64 filterId;
+
+		bool operator<(const Key &rhs) const;
+	};
+
+	using Aggregate = std::map<Key, uint32_t>;
+
+	void eventCallback(const FWPM_NET_EVENT1 &event);
+
+	void thread();
+
+	void deliver(const Aggregate &aggregate, uint32_t numOverflowed);
+
+	//
+	// Determine whether the filter belongs to Mullvad.
+	// Results are cached, since filter IDs are not reused while BFE is running.
+	//
+	bool isMullvadFilter(UINT64 filterId);
+
+	std::shared_ptr<wfp::FilterEngine> m_engine;
+
+	std::chrono::milliseconds m_window;
+	Sink m_sink;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	bool m_stop;
+
+	Aggregate m_aggregate;
+	uint32_t m_overflowed;
+
+	//
+	// Updated on the delivery thread, so events matching foreign filters can be
+	// discarded in the callback without occupying space in the aggregate.
+	//
+	std::unordered_map<UINT64, bool> m_filterOwnership;
+
+	std::thread m_thread;
+
+	std::unique_ptr<wfp::ObjectMonitor> m_monitor;
+};
@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "compiledfilter.h"
+#include "filtermetadata.h"
+#include <libcommon/error.h>
+#include <cstring>
+#include <cwchar>
+
+namespace
+{
+
+template<typename T>
+T *StoredAs(void *data)
+{
+	return reinterpret_cast<T *>(data);
+}
+
+} // anonymous namespace
+
+CompiledFilter::CompiledFilter(const wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder,
+	std::shared_ptr<ConditionPool> conditionPool)
+	: m_conditionPool(std::move(conditionPool))
+	, m_content(FilterContent::Serialize(filterBuilder, conditionBuilder))
+	, m_contentHash(FilterContent::Hash(m_content))
+{
+	memset(&m_filter, 0, sizeof(m_filter));
+
+	conditionBuilder.build([&](FWPM_FILTER_CONDITION0 *conditions, size_t numConditions)
+	{
+		return filterBuilder.build([&](FWPM_FILTER0 &filter)
+		{
+			m_filter = filter;
+
+			m_filter.displayData.name = internString(filter.displayData.name);
+			m_filter.displayData.description = internString(filter.displayData.description);
+
+			if (nullptr != filter.providerKey)
+			{
+				m_filter.providerKey = StoredAs<GUID>(store(filter.providerKey, sizeof(GUID)));
+			}
+
+			if (nullptr != filter.providerData.data)
+			{
+				m_filter.providerData.data = StoredAs<UINT8>(store(filter.providerData.data, filter.providerData.size));
+			}
+
+			copyValue(m_filter.weight);
+
+			m_filter.numFilterConditions = static_cast<UINT32>(numConditions);
+			m_filter.filterCondition = nullptr;
+
+			if (0 != numConditions)
+			{
+				m_filter.filterCondition = StoredAs<FWPM_FILTER_CONDITION0>(
+					store(conditions, numConditions * sizeof(FWPM_FILTER_CONDITION0)));
+
+				for (size_t i = 0; i < numConditions; ++i)
+				{
+					copyConditionValue(m_filter.filterCondition[i].conditionValue);
+				}
+			}
+
+			return true;
+		});
+	});
+}
+
+void *CompiledFilter::store(const void *data, size_t size)
+{
+	auto block = std::make_unique<uint8_t[]>(0 == size ? 1 : size);
+
+	memcpy(block.get(), data, size);
+
+	m_storage.emplace_back(std::move(block));
+
+	return m_storage.back().get();
+}
+
+void *CompiledFilter::storeShared(const void *data, size_t size)
+{
+	if (!m_conditionPool)
+	{
+		return store(data, size);
+	}
+
+	return m_conditionPool->intern(data, size);
+}
+
+wchar_t *CompiledFilter::storeString(const wchar_t *str)
+{
+	if (nullptr == str)
+	{
+		return nullptr;
+	}
+
+	return StoredAs<wchar_t>(storeShared(str, (wcslen(str) + 1) * sizeof(wchar_t)));
+}
+
+//
+// BFE doesn't modify the display data, so filters can share the interned strings.
+//
+//static
+wchar_t *CompiledFilter::internString(const wchar_t *str)
+{
+	if (nullptr == str)
+	{
+		return nullptr;
+	}
+
+	return const_cast<wchar_t *>(FilterMetadata::Intern(str));
+}
+
+FWP_BYTE_BLOB *CompiledFilter::storeBlob(const FWP_BYTE_BLOB *blob)
+{
+	if (nullptr == blob)
+	{
+		return nullptr;
+	}
+
+	//
+	// Start from zeroes, so identical blobs are also identical in the padding.
+	//
+
+	FWP_BYTE_BLOB stored;
+
+	memset(&stored, 0, sizeof(stored));
+
+	stored.size = blob->size;
+	stored.data = StoredAs<UINT8>(storeShared(blob->data, blob->size));
+
+	return StoredAs<FWP_BYTE_BLOB>(storeShared(&stored, sizeof(stored)));
+}
+
+//
+// Values are shallow copies of what the builders produced.
+// Relocate anything that is held by pointer into local storage.
+//
+
+void CompiledFilter::copyValue(FWP_VALUE0 &value)
+{
+	switch (value.type)
+	{
+		case FWP_EMPTY:
+		case FWP_UINT8:
+		case FWP_UINT16:
+		case FWP_UINT32:
+		case FWP_INT8:
+		case FWP_INT16:
+		case FWP_INT32:
+		case FWP_FLOAT:
+		{
+			break;
+		}
+		case FWP_UINT64: value.uint64 = StoredAs<UINT64>(store(value.uint64, sizeof(UINT64))); break;
+		case FWP_INT64: value.int64 = StoredAs<INT64>(store(value.int64, sizeof(INT64))); break;
+		case FWP_DOUBLE: value.double64 = StoredAs<double>(store(value.double64, sizeof(double))); break;
+		default:
+		{
+			THROW_ERROR("Unsupported value type in filter definition");
+		}
+	}
+}
+
+void CompiledFilter::copyConditionValue(FWP_CONDITION_VALUE0 &value)
+{
+	switch (value.type)
+	{
+		case FWP_EMPTY:
+		case FWP_UINT8:
+		case FWP_UINT16:
+		case FWP_UINT32:
+		case FWP_INT8:
+		case FWP_INT16:
+		case FWP_INT32:
+		case FWP_FLOAT:
+		{
+			break;
+		}
+		case FWP_UINT64: value.uint64 = StoredAs<UINT64>(storeShared(value.uint64, sizeof(UINT64))); break;
+		case FWP_INT64: value.int64 = StoredAs<INT64>(storeShared(value.int64, sizeof(INT64))); break;
+		case FWP_DOUBLE: value.double64 = StoredAs<double>(storeShared(value.double64, sizeof(double))); break;
+		case FWP_BYTE_ARRAY16_TYPE:
+		{
+			value.byteArray16 = StoredAs<FWP_BYTE_ARRAY16>(storeShared(value.byteArray16, sizeof(FWP_BYTE_ARRAY16)));
+			break;
+		}
+		case FWP_BYTE_ARRAY6_TYPE:
+		{
+			value.byteArray6 = StoredAs<FWP_BYTE_ARRAY6>(storeShared(value.byteArray6, sizeof(FWP_BYTE_ARRAY6)));
+			break;
+		}
+		case FWP_BYTE_BLOB_TYPE: value.byteBlob = storeBlob(value.byteBlob); break;
+		case FWP_SECURITY_DESCRIPTOR_TYPE: value.sd = storeBlob(value.sd); break;
+		case FWP_TOKEN_ACCESS_INFORMATION_TYPE: value.tokenAccessInformation = storeBlob(value.tokenAccessInformation); break;
+		case FWP_UNICODE_STRING_TYPE: value.unicodeString = storeString(value.unicodeString); break;
+		case FWP_SID:
+		{
+			value.sid = StoredAs<SID>(storeShared(value.sid, GetLengthSid(value.sid)));
+			break;
+		}
+		case FWP_V4_ADDR_MASK:
+		{
+			value.v4AddrMask = StoredAs<FWP_V4_ADDR_AND_MASK>(storeShared(value.v4AddrMask, sizeof(FWP_V4_ADDR_AND_MASK)));
+			break;
+		}
+		case FWP_V6_ADDR_MASK:
+		{
+			value.v6AddrMask = StoredAs<FWP_V6_ADDR_AND_MASK>(storeShared(value.v6AddrMask, sizeof(FWP_V6_ADDR_AND_MASK)));
+			break;
+		}
+		case FWP_RANGE_TYPE:
+		{
+			value.rangeValue = StoredAs<FWP_RANGE0>(store(value.rangeValue, sizeof(FWP_RANGE0)));
+			copyValue(value.rangeValue->valueLow);
+			copyValue(value.rangeValue->valueHigh);
+			break;
+		}
+		default:
+		{
+			THROW_ERROR("Unsupported condition value type in filter definition");
+		}
+	}
+}
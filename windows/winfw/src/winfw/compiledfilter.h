@@ -0,0 +1,85 @@
+#pragma once
+
+#include "conditionpool.h"
+#include "filtercontent.h"
+#include "libwfp/filterbuilder.h"
+#include "libwfp/iconditionbuilder.h"
+#include "libwfp/iidentifiable.h"
+#include <windows.h>
+#include <fwpmu.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//
+// Fully marshalled filter definition, with conditions, that can be handed
+// to BFE any number of times without involving the builders.
+//
+class CompiledFilter : public wfp::IIdentifiable
+{
+public:
+
+	//
+	// Condition values that are held by pointer are stored in 'conditionPool', if one
+	// is provided, and shared with other filters compiled with the same pool.
+	//
+	CompiledFilter(const wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder,
+		std::shared_ptr<ConditionPool> conditionPool = nullptr);
+
+	CompiledFilter(CompiledFilter &&) = default;
+	CompiledFilter &operator=(CompiledFilter &&) = default;
+
+	const GUID &id() const override
+	{
+		return m_filter.filterKey;
+	}
+
+	const FWPM_FILTER0 &filter() const
+	{
+		return m_filter;
+	}
+
+	const FilterContent::Buffer &content() const
+	{
+		return m_content;
+	}
+
+	uint64_t contentHash() const
+	{
+		return m_contentHash;
+	}
+
+private:
+
+	CompiledFilter(const CompiledFilter &) = delete;
+	CompiledFilter &operator=(const CompiledFilter &) = delete;
+
+	void *store(const void *data, size_t size);
+
+	// Store in the condition pool, if there is one.
+	void *storeShared(const void *data, size_t size);
+
+	wchar_t *storeString(const wchar_t *str);
+	static wchar_t *internString(const wchar_t *str);
+	FWP_BYTE_BLOB *storeBlob(const FWP_BYTE_BLOB *blob);
+
+	void copyValue(FWP_VALUE0 &value);
+	void copyConditionValue(FWP_CONDITION_VALUE0 &value);
+
+	FWPM_FILTER0 m_filter;
+
+	//
+	// Backing storage for everything 'm_filter' points to, except the name and
+	// description, which are interned.
+	// Individual allocations never move, so the filter remains valid after a move.
+	//
+	std::vector<std::unique_ptr<uint8_t[]> > m_storage;
+
+	//
+	// Backing storage for shared condition values.
+	//
+	std::shared_ptr<ConditionPool> m_conditionPool;
+
+	FilterContent::Buffer m_content;
+	uint64_t m_contentHash;
+};
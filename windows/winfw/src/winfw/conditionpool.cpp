@@ -0,0 +1,30 @@
+#include "stdafx.h"
+#include "conditionpool.h"
+#include <libshared/performance/counterregistry.h>
+#include <cstring>
+
+void *ConditionPool::intern(const void *data, size_t size)
+{
+	static auto &reusedCounter = shared::performance::CounterRegistry::Instance().counter("winfw.conditions.reused");
+
+	const auto found = m_values.find(std::string_view(reinterpret_cast<const char *>(data), size));
+
+	if (m_values.end() != found)
+	{
+		++m_reused;
+		reusedCounter.increment();
+
+		return found->second;
+	}
+
+	auto block = std::make_unique<uint64_t[]>(0 == size ? 1 : (size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+
+	memcpy(block.get(), data, size);
+
+	auto stored = block.get();
+
+	m_storage.emplace_back(std::move(block));
+	m_values.emplace(std::string_view(reinterpret_cast<const char *>(stored), size), stored);
+
+	return stored;
+}
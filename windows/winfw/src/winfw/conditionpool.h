@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+//
+// Condition payloads shared by the filters that are compiled together.
+//
+// Many rules in a policy use identical condition values, e.g. the tunnel interface,
+// loopback, or the addresses of the relay. Values that a condition holds by pointer
+// are stored once per pool, and every filter that uses the same bytes points at
+// that copy. BFE only reads condition values, so sharing them is safe.
+//
+// Not thread safe. Stored values never move, and live as long as the pool.
+//
+class ConditionPool
+{
+public:
+
+	ConditionPool() = default;
+
+	ConditionPool(const ConditionPool &) = delete;
+	ConditionPool &operator=(const ConditionPool &) = delete;
+
+	//
+	// Returns a copy of the bytes that is suitably aligned for any condition value.
+	//
+	void *intern(const void *data, size_t size);
+
+	// Number of distinct values stored.
+	size_t size() const
+	{
+		return m_values.size();
+	}
+
+	// Number of times a stored value was handed out again.
+	size_t reused() const
+	{
+		return m_reused;
+	}
+
+private:
+
+	//
+	// Keys refer to the stored copies.
+	//
+	std::unordered_map<std::string_view, void *> m_values;
+	std::vector<std::unique_ptr<uint64_t[]> > m_storage;
+
+	size_t m_reused = 0;
+};
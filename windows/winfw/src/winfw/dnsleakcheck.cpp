@@ -0,0 +1,378 @@
+#include "stdafx.h"
+#include "dnsleakcheck.h"
+#include <libcommon/error.h>
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <ws2tcpip.h>
+#include <iphlpapi.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+
+namespace
+{
+
+constexpr uint16_t DNS_PORT = 53;
+
+class WinsockScope
+{
+public:
+
+	WinsockScope()
+	{
+		WSADATA data;
+
+		if (0 != WSAStartup(MAKEWORD(2, 2), &data))
+		{
+			THROW_ERROR("Failed to initialize Winsock");
+		}
+	}
+
+	~WinsockScope()
+	{
+		WSACleanup();
+	}
+
+	WinsockScope(const WinsockScope &) = delete;
+	WinsockScope &operator=(const WinsockScope &) = delete;
+};
+
+struct Probe
+{
+	WinFwDnsProbe result;
+	SOCKET socket;
+	uint16_t queryId;
+};
+
+//
+// Query for the NS records of the root zone.
+// Any resolver can answer it, and the answer is small.
+//
+std::vector<uint8_t> BuildQuery(uint16_t id)
+{
+	return std::vector<uint8_t>
+	{
+		static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id & 0xFF),
+		0x01, 0x00,	// Recursion desired
+		0x00, 0x01,	// QDCOUNT
+		0x00, 0x00,	// ANCOUNT
+		0x00, 0x00,	// NSCOUNT
+		0x00, 0x00,	// ARCOUNT
+		0x00,		// Root
+		0x00, 0x02,	// QTYPE NS
+		0x00, 0x01	// QCLASS IN
+	};
+}
+
+WinFwIp ConvertSockaddr(const SOCKADDR *address)
+{
+	WinFwIp ip = { 0 };
+
+	if (AF_INET == address->sa_family)
+	{
+		ip.family = Ipv4;
+		memcpy(ip.bytes, &reinterpret_cast<const SOCKADDR_IN *>(address)->sin_addr, 4);
+	}
+	else
+	{
+		ip.family = Ipv6;
+		memcpy(ip.bytes, &reinterpret_cast<const SOCKADDR_IN6 *>(address)->sin6_addr, 16);
+	}
+
+	return ip;
+}
+
+SOCKADDR_INET ResolverSockaddr(const WinFwIp &resolver)
+{
+	SOCKADDR_INET address = { 0 };
+
+	if (Ipv4 == resolver.family)
+	{
+		address.Ipv4.sin_family = AF_INET;
+		address.Ipv4.sin_port = htons(DNS_PORT);
+		memcpy(&address.Ipv4.sin_addr, resolver.bytes, 4);
+	}
+	else
+	{
+		address.Ipv6.sin6_family = AF_INET6;
+		address.Ipv6.sin6_port = htons(DNS_PORT);
+		memcpy(&address.Ipv6.sin6_addr, resolver.bytes, 16);
+	}
+
+	return address;
+}
+
+std::vector<uint8_t> GetAdapters()
+{
+	const ULONG flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER;
+
+	ULONG bufferSize = 16 * 1024;
+	std::vector<uint8_t> buffer;
+
+	for (;;)
+	{
+		buffer.resize(bufferSize);
+
+		const auto status = GetAdaptersAddresses(AF_UNSPEC, flags, nullptr,
+			reinterpret_cast<IP_ADAPTER_ADDRESSES *>(buffer.data()), &bufferSize);
+
+		if (ERROR_SUCCESS == status)
+		{
+			return buffer;
+		}
+
+		if (ERROR_NO_DATA == status)
+		{
+			return std::vector<uint8_t>();
+		}
+
+		if (ERROR_BUFFER_OVERFLOW != status)
+		{
+			THROW_ERROR("Failed to enumerate network adapters");
+		}
+	}
+}
+
+//
+// Pin the socket to the interface, so the query isn't routed through
+// the tunnel even if the source address would allow it.
+//
+void PinToInterface(SOCKET s, int family, ULONG interfaceIndex)
+{
+	if (AF_INET == family)
+	{
+		// IPv4 expects the index in network byte order.
+		const DWORD index = htonl(interfaceIndex);
+
+		setsockopt(s, IPPROTO_IP, IP_UNICAST_IF, reinterpret_cast<const char *>(&index), sizeof(index));
+	}
+	else
+	{
+		const DWORD index = interfaceIndex;
+
+		setsockopt(s, IPPROTO_IPV6, IPV6_UNICAST_IF, reinterpret_cast<const char *>(&index), sizeof(index));
+	}
+}
+
+void SendQuery(Probe &probe, const IP_ADAPTER_ADDRESSES &adapter, const SOCKET_ADDRESS &sourceAddress,
+	const WinFwIp &resolver)
+{
+	const auto source = sourceAddress.lpSockaddr;
+	const int sourceLength = sourceAddress.iSockaddrLength;
+
+	const int family = source->sa_family;
+
+	probe.socket = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (INVALID_SOCKET == probe.socket)
+	{
+		probe.result.result = WINFW_DNS_PROBE_RESULT_ERROR;
+		return;
+	}
+
+	u_long nonBlocking = 1;
+	ioctlsocket(probe.socket, FIONBIO, &nonBlocking);
+
+	PinToInterface(probe.socket, family, AF_INET == family ? adapter.IfIndex : adapter.Ipv6IfIndex);
+
+	SOCKADDR_STORAGE local = { 0 };
+	memcpy(&local, source, std::min<size_t>(sourceLength, sizeof(local)));
+
+	if (AF_INET == family)
+	{
+		reinterpret_cast<SOCKADDR_IN *>(&local)->sin_port = 0;
+	}
+	else
+	{
+		reinterpret_cast<SOCKADDR_IN6 *>(&local)->sin6_port = 0;
+	}
+
+	if (SOCKET_ERROR == bind(probe.socket, reinterpret_cast<const SOCKADDR *>(&local), sourceLength))
+	{
+		probe.result.result = WINFW_DNS_PROBE_RESULT_ERROR;
+		return;
+	}
+
+	const auto query = BuildQuery(probe.queryId);
+	const auto destination = ResolverSockaddr(resolver);
+
+	const auto status = sendto(probe.socket, reinterpret_cast<const char *>(query.data()),
+		static_cast<int>(query.size()), 0, reinterpret_cast<const SOCKADDR *>(&destination),
+		AF_INET == family ? sizeof(SOCKADDR_IN) : sizeof(SOCKADDR_IN6));
+
+	if (SOCKET_ERROR != status)
+	{
+		probe.result.result = WINFW_DNS_PROBE_RESULT_NO_RESPONSE;
+		return;
+	}
+
+	//
+	// WFP rejects the send synchronously when the connect layer blocks it.
+	//
+	probe.result.result = (WSAEACCES == WSAGetLastError()
+		? WINFW_DNS_PROBE_RESULT_BLOCKED
+		: WINFW_DNS_PROBE_RESULT_ERROR);
+}
+
+void AwaitResponses(std::vector<Probe> &probes, std::chrono::milliseconds timeout)
+{
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	for (;;)
+	{
+		std::vector<WSAPOLLFD> fds;
+		std::vector<Probe *> pending;
+
+		for (auto &probe : probes)
+		{
+			if (WINFW_DNS_PROBE_RESULT_NO_RESPONSE == probe.result.result)
+			{
+				fds.push_back(WSAPOLLFD{ probe.socket, POLLRDNORM, 0 });
+				pending.push_back(&probe);
+			}
+		}
+
+		const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+			deadline - std::chrono::steady_clock::now());
+
+		if (fds.empty() || remaining.count() <= 0)
+		{
+			return;
+		}
+
+		const auto ready = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), static_cast<INT>(remaining.count()));
+
+		if (ready <= 0)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < fds.size(); ++i)
+		{
+			if (0 == fds[i].revents)
+			{
+				continue;
+			}
+
+			uint8_t response[512];
+
+			const auto received = recv(fds[i].fd, reinterpret_cast<char *>(response), sizeof(response), 0);
+
+			if (SOCKET_ERROR == received)
+			{
+				//
+				// E.g. an ICMP port unreachable. The query left the host all the same.
+				//
+				pending[i]->result.result = (WSAECONNRESET == WSAGetLastError()
+					? WINFW_DNS_PROBE_RESULT_RESPONSE
+					: WINFW_DNS_PROBE_RESULT_ERROR);
+
+				continue;
+			}
+
+			if (received >= 2
+				&& pending[i]->queryId == static_cast<uint16_t>((response[0] << 8) | response[1]))
+			{
+				pending[i]->result.result = WINFW_DNS_PROBE_RESULT_RESPONSE;
+			}
+		}
+	}
+}
+
+} // anonymous namespace
+
+struct DnsLeakCheck::Target
+{
+	// Both point into 'm_adapters'.
+	const IP_ADAPTER_ADDRESSES *adapter;
+	const IP_ADAPTER_UNICAST_ADDRESS *source;
+
+	WinFwIp resolver;
+};
+
+DnsLeakCheck::DnsLeakCheck(const NET_LUID &tunnelLuid, const std::vector<WinFwIp> &resolvers)
+	: m_adapters(GetAdapters())
+{
+	for (auto adapter = reinterpret_cast<const IP_ADAPTER_ADDRESSES *>(m_adapters.empty() ? nullptr : m_adapters.data());
+		nullptr != adapter;
+		adapter = adapter->Next)
+	{
+		if (adapter->Luid.Value == tunnelLuid.Value
+			|| IF_TYPE_SOFTWARE_LOOPBACK == adapter->IfType
+			|| IfOperStatusUp != adapter->OperStatus)
+		{
+			continue;
+		}
+
+		for (auto unicast = adapter->FirstUnicastAddress; nullptr != unicast; unicast = unicast->Next)
+		{
+			if (IpDadStatePreferred != unicast->DadState)
+			{
+				continue;
+			}
+
+			const auto sourceFamily = (AF_INET == unicast->Address.lpSockaddr->sa_family ? Ipv4 : Ipv6);
+
+			for (const auto &resolver : resolvers)
+			{
+				if (resolver.family == sourceFamily)
+				{
+					m_targets.push_back(Target{ adapter, unicast, resolver });
+				}
+			}
+		}
+	}
+}
+
+DnsLeakCheck::~DnsLeakCheck()
+{
+}
+
+size_t DnsLeakCheck::size() const
+{
+	return m_targets.size();
+}
+
+std::vector<WinFwDnsProbe> DnsLeakCheck::run(std::chrono::milliseconds timeout)
+{
+	const WinsockScope winsock;
+
+	std::vector<Probe> probes;
+	probes.reserve(m_targets.size());
+
+	std::random_device device;
+	std::uniform_int_distribution<uint32_t> distribution(0, 0xFFFF);
+
+	for (const auto &target : m_targets)
+	{
+		Probe probe;
+
+		probe.result.interfaceLuid = target.adapter->Luid.Value;
+		probe.result.source = ConvertSockaddr(target.source->Address.lpSockaddr);
+		probe.result.resolver = target.resolver;
+		probe.socket = INVALID_SOCKET;
+		probe.queryId = static_cast<uint16_t>(distribution(device));
+
+		SendQuery(probe, *target.adapter, target.source->Address, target.resolver);
+
+		probes.push_back(probe);
+	}
+
+	AwaitResponses(probes, timeout);
+
+	std::vector<WinFwDnsProbe> results;
+	results.reserve(probes.size());
+
+	for (const auto &probe : probes)
+	{
+		if (INVALID_SOCKET != probe.socket)
+		{
+			closesocket(probe.socket);
+		}
+
+		results.push_back(probe.result);
+	}
+
+	return results;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "winfw.h"
+#include <windows.h>
+#include <ifdef.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+//
+// Sends a DNS query to each resolver, from every address of every interface
+// that is up, except the tunnel and loopback interfaces. Under the connected
+// policy, none of the queries should be answered.
+//
+// All queries are sent at once and answers are awaited for a single timeout,
+// so the check takes no longer than the timeout.
+//
+class DnsLeakCheck
+{
+public:
+
+	//
+	// Select the interface addresses and resolvers to probe. Nothing is sent yet.
+	//
+	DnsLeakCheck(const NET_LUID &tunnelLuid, const std::vector<WinFwIp> &resolvers);
+	~DnsLeakCheck();
+
+	DnsLeakCheck(const DnsLeakCheck &) = delete;
+	DnsLeakCheck &operator=(const DnsLeakCheck &) = delete;
+
+	//
+	// Number of queries that run() sends, and returns results for.
+	//
+	size_t size() const;
+
+	std::vector<WinFwDnsProbe> run(std::chrono::milliseconds timeout);
+
+private:
+
+	struct Target;
+
+	std::vector<uint8_t> m_adapters;
+	std::vector<Target> m_targets;
+};
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "filtercontent.h"
+#include <libcommon/error.h>
+#include <cwchar>
+
+namespace
+{
+
+void Append(FilterContent::Buffer &buffer, const void *data, size_t size)
+{
+	const auto bytes = reinterpret_cast<const uint8_t *>(data);
+
+	buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+template<typename T>
+void AppendPod(FilterContent::Buffer &buffer, const T &value)
+{
+	Append(buffer, &value, sizeof(value));
+}
+
+void AppendString(FilterContent::Buffer &buffer, const wchar_t *str)
+{
+	if (nullptr == str)
+	{
+		AppendPod(buffer, size_t(0));
+		return;
+	}
+
+	const auto length = wcslen(str);
+
+	AppendPod(buffer, length);
+	Append(buffer, str, length * sizeof(wchar_t));
+}
+
+void AppendBlob(FilterContent::Buffer &buffer, const FWP_BYTE_BLOB *blob)
+{
+	if (nullptr == blob)
+	{
+		AppendPod(buffer, UINT32(0));
+		return;
+	}
+
+	AppendPod(buffer, blob->size);
+	Append(buffer, blob->data, blob->size);
+}
+
+//
+// FWP_VALUE0 and FWP_CONDITION_VALUE0 share most of their union members.
+//
+template<typename T>
+bool AppendCommonValue(FilterContent::Buffer &buffer, const T &value)
+{
+	switch (value.type)
+	{
+		case FWP_EMPTY: break;
+		case FWP_UINT8: AppendPod(buffer, value.uint8); break;
+		case FWP_UINT16: AppendPod(buffer, value.uint16); break;
+		case FWP_UINT32: AppendPod(buffer, value.uint32); break;
+		case FWP_UINT64: AppendPod(buffer, *value.uint64); break;
+		case FWP_INT8: AppendPod(buffer, value.int8); break;
+		case FWP_INT16: AppendPod(buffer, value.int16); break;
+		case FWP_INT32: AppendPod(buffer, value.int32); break;
+		case FWP_INT64: AppendPod(buffer, *value.int64); break;
+		case FWP_FLOAT: AppendPod(buffer, value.float32); break;
+		case FWP_DOUBLE: AppendPod(buffer, *value.double64); break;
+		case FWP_BYTE_ARRAY16_TYPE: AppendPod(buffer, *value.byteArray16); break;
+		case FWP_BYTE_ARRAY6_TYPE: AppendPod(buffer, *value.byteArray6); break;
+		case FWP_BYTE_BLOB_TYPE: AppendBlob(buffer, value.byteBlob); break;
+		case FWP_SECURITY_DESCRIPTOR_TYPE: AppendBlob(buffer, value.sd); break;
+		case FWP_TOKEN_ACCESS_INFORMATION_TYPE: AppendBlob(buffer, value.tokenAccessInformation); break;
+		case FWP_UNICODE_STRING_TYPE: AppendString(buffer, value.unicodeString); break;
+		case FWP_SID:
+		{
+			Append(buffer, value.sid, GetLengthSid(value.sid));
+			break;
+		}
+		default:
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void AppendValue(FilterContent::Buffer &buffer, const FWP_VALUE0 &value)
+{
+	AppendPod(buffer, value.type);
+
+	if (false == AppendCommonValue(buffer, value))
+	{
+		THROW_ERROR("Unsupported value type in filter definition");
+	}
+}
+
+void AppendConditionValue(FilterContent::Buffer &buffer, const FWP_CONDITION_VALUE0 &value)
+{
+	AppendPod(buffer, value.type);
+
+	if (AppendCommonValue(buffer, value))
+	{
+		return;
+	}
+
+	switch (value.type)
+	{
+		case FWP_V4_ADDR_MASK:
+		{
+			AppendPod(buffer, *value.v4AddrMask);
+			break;
+		}
+		case FWP_V6_ADDR_MASK:
+		{
+			AppendPod(buffer, *value.v6AddrMask);
+			break;
+		}
+		case FWP_RANGE_TYPE:
+		{
+			AppendValue(buffer, value.rangeValue->valueLow);
+			AppendValue(buffer, value.rangeValue->valueHigh);
+			break;
+		}
+		default:
+		{
+			THROW_ERROR("Unsupported condition value type in filter definition");
+		}
+	}
+}
+
+void AppendFilter(FilterContent::Buffer &buffer, const FWPM_FILTER0 &filter,
+	const FWPM_FILTER_CONDITION0 *conditions, size_t numConditions)
+{
+	AppendPod(buffer, filter.filterKey);
+	AppendString(buffer, filter.displayData.name);
+	AppendString(buffer, filter.displayData.description);
+	AppendPod(buffer, filter.flags);
+	AppendPod(buffer, nullptr == filter.providerKey ? GUID{ 0 } : *filter.providerKey);
+	AppendPod(buffer, filter.layerKey);
+	AppendPod(buffer, filter.subLayerKey);
+	AppendValue(buffer, filter.weight);
+	AppendPod(buffer, filter.action.type);
+	AppendPod(buffer, filter.action.filterType);
+
+	AppendPod(buffer, numConditions);
+
+	for (size_t i = 0; i < numConditions; ++i)
+	{
+		AppendPod(buffer, conditions[i].fieldKey);
+		AppendPod(buffer, conditions[i].matchType);
+		AppendConditionValue(buffer, conditions[i].conditionValue);
+	}
+}
+
+} // anonymous namespace
+
+//static
+FilterContent::Buffer FilterContent::Serialize(const wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder)
+{
+	Buffer buffer;
+
+	conditionBuilder.build([&](FWPM_FILTER_CONDITION0 *conditions, size_t numConditions)
+	{
+		return filterBuilder.build([&](FWPM_FILTER0 &filter)
+		{
+			AppendFilter(buffer, filter, conditions, numConditions);
+			return true;
+		});
+	});
+
+	return buffer;
+}
+
+//static
+FilterContent::Buffer FilterContent::Serialize(const FWPM_FILTER0 &filter)
+{
+	Buffer buffer;
+
+	AppendFilter(buffer, filter, filter.filterCondition, filter.numFilterConditions);
+
+	return buffer;
+}
+
+//static
+uint64_t FilterContent::Hash(const Buffer &content)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (const auto byte : content)
+	{
+		hash ^= byte;
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "libwfp/filterbuilder.h"
+#include "libwfp/iconditionbuilder.h"
+#include <windows.h>
+#include <fwpmu.h>
+#include <cstdint>
+#include <vector>
+
+//
+// Flattens a filter definition, including all conditions, into a byte sequence.
+//
+// Two filters with equal content are functionally identical, which makes it
+// possible to leave an installed filter in place rather than replacing it.
+//
+class FilterContent
+{
+public:
+
+	FilterContent() = delete;
+
+	using Buffer = std::vector<uint8_t>;
+
+	static Buffer Serialize(const wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder);
+
+	//
+	// Serialize a filter that is already installed in BFE.
+	//
+	static Buffer Serialize(const FWPM_FILTER0 &filter);
+
+	//
+	// 64-bit FNV-1a hash of serialized content.
+	// Equal content yields equal hashes, across processes and versions.
+	//
+	static uint64_t Hash(const Buffer &content);
+};
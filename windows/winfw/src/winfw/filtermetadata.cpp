@@ -0,0 +1,74 @@
+#include "stdafx.h"
+#include "filtermetadata.h"
+#include <libshared/performance/counterregistry.h>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace
+{
+
+class StringPool
+{
+public:
+
+	const wchar_t *intern(std::wstring_view text)
+	{
+		{
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+			const auto it = m_strings.find(text);
+
+			if (m_strings.end() != it)
+			{
+				return it->second.get();
+			}
+		}
+
+		static auto &interned = shared::performance::CounterRegistry::Instance().counter("winfw.metadata.interned");
+
+		std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+		const auto it = m_strings.find(text);
+
+		if (m_strings.end() != it)
+		{
+			return it->second.get();
+		}
+
+		auto stored = std::make_unique<wchar_t[]>(text.size() + 1);
+
+		memcpy(stored.get(), text.data(), text.size() * sizeof(wchar_t));
+		stored[text.size()] = L'\0';
+
+		//
+		// The key views the stored string, which never moves.
+		//
+		const std::wstring_view key(stored.get(), text.size());
+
+		interned.increment();
+
+		return m_strings.emplace(key, std::move(stored)).first->second.get();
+	}
+
+private:
+
+	std::shared_mutex m_mutex;
+	std::unordered_map<std::wstring_view, std::unique_ptr<wchar_t[]> > m_strings;
+};
+
+StringPool &Pool()
+{
+	static StringPool pool;
+	return pool;
+}
+
+} // anonymous namespace
+
+//static
+const wchar_t *FilterMetadata::Intern(std::wstring_view text)
+{
+	return Pool().intern(text);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string_view>
+
+//
+// Interned filter names and descriptions.
+//
+// Rules give their filters the same few names and descriptions on every apply.
+// Each distinct string is stored once, in read-only storage that lives as long as
+// the process, and marshalled filters point at it rather than carrying copies.
+//
+// Only intern strings that come from a bounded set, such as the literals in rules.
+//
+class FilterMetadata
+{
+public:
+
+	//
+	// Returns a terminated string that remains valid for the lifetime of the process.
+	// Lookups of strings that are already interned don't allocate.
+	//
+	static const wchar_t *Intern(std::wstring_view text);
+
+private:
+
+	FilterMetadata() = delete;
+};
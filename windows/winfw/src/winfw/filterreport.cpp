@@ -0,0 +1,89 @@
+#include "stdafx.h"
+#include "filterreport.h"
+#include "mullvadguids.h"
+#include "libwfp/objectenumerator.h"
+#include <cstring>
+#include <map>
+#include <utility>
+
+namespace
+{
+
+bool OwnedByMullvad(const GUID *providerKey)
+{
+	return nullptr != providerKey
+		&& (MullvadGuids::Provider() == *providerKey || MullvadGuids::ProviderPersistent() == *providerKey);
+}
+
+struct GuidLess
+{
+	bool operator()(const GUID &lhs, const GUID &rhs) const
+	{
+		return memcmp(&lhs, &rhs, sizeof(GUID)) < 0;
+	}
+};
+
+struct KeyLess
+{
+	bool operator()(const std::pair<GUID, GUID> &lhs, const std::pair<GUID, GUID> &rhs) const
+	{
+		GuidLess less;
+
+		if (less(lhs.first, rhs.first))
+		{
+			return true;
+		}
+
+		if (less(rhs.first, lhs.first))
+		{
+			return false;
+		}
+
+		return less(lhs.second, rhs.second);
+	}
+};
+
+} // anonymous namespace
+
+//static
+std::vector<WinFwFilterLayerReport> FilterReport::Collect(wfp::FilterEngine &engine)
+{
+	std::map<std::pair<GUID, GUID>, WinFwFilterLayerReport, KeyLess> entries;
+
+	wfp::ObjectEnumerator::Filters(engine, [&](const FWPM_FILTER0 &filter)
+	{
+		if (false == OwnedByMullvad(filter.providerKey))
+		{
+			return true;
+		}
+
+		auto &entry = entries[std::make_pair(filter.layerKey, filter.subLayerKey)];
+
+		if (0 == entry.numFilters)
+		{
+			entry.layer = filter.layerKey;
+			entry.sublayer = filter.subLayerKey;
+		}
+
+		++entry.numFilters;
+		entry.numConditions += filter.numFilterConditions;
+
+		if (filter.numFilterConditions > entry.maxConditions)
+		{
+			entry.maxConditions = filter.numFilterConditions;
+		}
+
+		return true;
+	});
+
+	std::vector<WinFwFilterLayerReport> report;
+
+	report.reserve(entries.size());
+
+	for (const auto &entry : entries)
+	{
+		report.push_back(entry.second);
+	}
+
+	return report;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "winfw.h"
+#include "libwfp/filterengine.h"
+#include <vector>
+
+//
+// Aggregate the filters owned by Mullvad by layer and sublayer.
+//
+// Every filter in a layer may be evaluated for each classification in that layer.
+// The filter and condition counts give an idea of where classification cost is spent.
+//
+class FilterReport
+{
+public:
+
+	FilterReport() = delete;
+
+	//
+	// Entries are sorted by layer and sublayer.
+	//
+	static std::vector<WinFwFilterLayerReport> Collect(wfp::FilterEngine &engine);
+};
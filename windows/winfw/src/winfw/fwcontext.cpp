@@ -1,14 +1,17 @@
 #include "stdafx.h"
 #include "fwcontext.h"
+#include "mullvadguids.h"
 #include "mullvadobjects.h"
 #include "objectpurger.h"
+#include "persistentblock.h"
+#include "preparedfilters.h"
+#include "sessionpool.h"
 #include "rules/blockall.h"
 #include "rules/ifirewallrule.h"
-#include "rules/permitdhcp.h"
-#include "rules/permitndp.h"
-#include "rules/permitdhcpserver.h"
+#include "rules/permitexcludedapps.h"
 #include "rules/permitlan.h"
 #include "rules/permitlanservice.h"
+#include "rules/permitlocalbootstrap.h"
 #include "rules/permitloopback.h"
 #include "rules/permittunneldns.h"
 #include "rules/permitvpnrelay.h"
@@ -17,8 +20,14 @@
 #include "rules/permitping.h"
 #include <libwfp/transaction.h>
 #include <libwfp/filterengine.h>
+#include <libwfp/objectexplorer.h>
 #include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libshared/performance/counterregistry.h>
+#include <libshared/tracing/trace.h>
+#include <chrono>
 #include <functional>
+#include <sstream>
 #include <utility>
 
 namespace
@@ -37,85 +46,1036 @@ rules::PermitVpnRelay::Protocol TranslateProtocol(WinFwProtocol protocol)
 	};
 }
 
-void AppendSettingsRules(FwContext::Ruleset &ruleset, const WinFwSettings &settings)
+template<typename T, typename... Args>
+std::shared_ptr<rules::IFirewallRule> Compiled(RuleCache &cache, const std::wstring &key, Args&&... args)
 {
-	if (settings.permitDhcp)
+	return cache.get(key, [&]()
 	{
-		ruleset.emplace_back(std::make_unique<rules::PermitDhcp>());
-		ruleset.emplace_back(std::make_unique<rules::PermitNdp>());
+		return std::make_unique<T>(std::forward<Args>(args)...);
+	});
+}
+
+void Accumulate(WinFwTransactionStatistics &target, const WinFwTransactionStatistics &source)
+{
+	target.lockWaitUs += source.lockWaitUs;
+	target.lockAttempts += source.lockAttempts;
+	target.addUs += source.addUs;
+	target.purgeUs += source.purgeUs;
+	target.commitUs += source.commitUs;
+	target.totalUs += source.totalUs;
+	target.objectsAdded += source.objectsAdded;
+	target.objectsRemoved += source.objectsRemoved;
+}
+
+WinFwTransactionStatistics Difference(const WinFwTransactionStatistics &after, const WinFwTransactionStatistics &before)
+{
+	WinFwTransactionStatistics difference;
+
+	difference.lockWaitUs = after.lockWaitUs - before.lockWaitUs;
+	difference.lockAttempts = after.lockAttempts - before.lockAttempts;
+	difference.addUs = after.addUs - before.addUs;
+	difference.purgeUs = after.purgeUs - before.purgeUs;
+	difference.commitUs = after.commitUs - before.commitUs;
+	difference.totalUs = after.totalUs - before.totalUs;
+	difference.objectsAdded = after.objectsAdded - before.objectsAdded;
+	difference.objectsRemoved = after.objectsRemoved - before.objectsRemoved;
+
+	return difference;
+}
+
+std::wstring HostKey(const wfp::IpAddress &host)
+{
+	std::wstringstream ss;
+
+	if (wfp::IpAddress::Type::Ipv4 == host.type())
+	{
+		ss << host.addr();
+	}
+	else
+	{
+		ss << std::hex;
+
+		for (auto b : host.addr6().byteArray16)
+		{
+			ss << L':' << static_cast<int>(b);
+		}
+	}
+
+	return ss.str();
+}
+
+void AppendSettingsRules(FwContext::Ruleset &ruleset, RuleCache &cache, const WinFwSettings &settings)
+{
+	//
+	// DHCP client traffic is permitted with 'permitDhcp', and DHCPv4 server traffic with 'permitLan'.
+	//
+	if (settings.permitDhcp || settings.permitLan)
+	{
+		const auto key = std::wstring(L"PermitLocalBootstrap")
+			.append(settings.permitDhcp ? L"_Client" : L"")
+			.append(settings.permitLan ? L"_Server" : L"");
+
+		ruleset.emplace_back(Compiled<rules::PermitLocalBootstrap>(cache, key,
+			settings.permitDhcp, settings.permitLan));
 	}
 
 	if (settings.permitLan)
 	{
-		ruleset.emplace_back(std::make_unique<rules::PermitLan>());
-		ruleset.emplace_back(std::make_unique<rules::PermitLanService>());
-		ruleset.emplace_back(rules::PermitDhcpServer::WithExtent(rules::PermitDhcpServer::Extent::IPv4Only));
+		ruleset.emplace_back(Compiled<rules::PermitLan>(cache, L"PermitLan"));
+		ruleset.emplace_back(Compiled<rules::PermitLanService>(cache, L"PermitLanService"));
+	}
+}
+
+void AppendNetBlockedRules(FwContext::Ruleset &ruleset, RuleCache &cache)
+{
+	ruleset.emplace_back(Compiled<rules::BlockAll>(cache, L"BlockAll"));
+	ruleset.emplace_back(Compiled<rules::PermitLoopback>(cache, L"PermitLoopback"));
+}
+
+FwContext::Relay ConvertRelay(const WinFwRelay &relay)
+{
+	return FwContext::Relay{ wfp::IpAddress(relay.ip), relay.port, TranslateProtocol(relay.protocol) };
+}
+
+std::vector<FwContext::Relay> ConvertRelays(const std::vector<WinFwRelay> &relays)
+{
+	std::vector<FwContext::Relay> converted;
+
+	for (const auto &relay : relays)
+	{
+		converted.push_back(ConvertRelay(relay));
+	}
+
+	return converted;
+}
+
+void AppendRelayRuleKey(std::wstringstream &key, const FwContext::Relay &relay)
+{
+	key << L':' << HostKey(relay.ip) << L':' << relay.port << L':' << static_cast<int>(relay.protocol);
+}
+
+std::shared_ptr<rules::IFirewallRule> CompiledRelayRule(RuleCache &cache, const std::vector<FwContext::Relay> &relays)
+{
+	std::wstringstream key;
+
+	key << L"PermitVpnRelay";
+
+	for (const auto &relay : relays)
+	{
+		AppendRelayRuleKey(key, relay);
+	}
+
+	return cache.get(key.str(), [&relays]()
+	{
+		return std::make_unique<rules::PermitVpnRelay>(relays);
+	});
+}
+
+//
+// Policy keys describe all inputs to a policy.
+// Two policies with the same key are identical.
+//
+
+void AppendSettingsKey(std::wstringstream &key, const WinFwSettings &settings)
+{
+	key << settings.permitDhcp << L':' << settings.permitLan;
+}
+
+void AppendRelayKey(std::wstringstream &key, const WinFwRelay &relay)
+{
+	key << L':' << relay.ip << L':' << relay.port << L':' << relay.protocol;
+}
+
+std::wstring ConnectingPolicyKey
+(
+	const WinFwSettings &settings,
+	const std::vector<WinFwRelay> &relays,
+	const std::optional<FwContext::PingableHosts> &pingableHosts,
+	const std::optional<rules::TunnelInterface> &pingableTunnel
+)
+{
+	std::wstringstream key;
+
+	key << L"Connecting:";
+
+	AppendSettingsKey(key, settings);
+
+	for (const auto &relay : relays)
+	{
+		AppendRelayKey(key, relay);
+	}
+
+	if (pingableHosts.has_value())
+	{
+		key << L":PingableHosts:" << (pingableTunnel.has_value() ? pingableTunnel->key() : L"");
+
+		for (const auto &host : pingableHosts->hosts)
+		{
+			key << L':' << HostKey(host);
+		}
+	}
+
+	return key.str();
+}
+
+//
+// Key of the part of the connecting policy that doesn't depend on the relays or pingable hosts.
+//
+std::wstring ConnectingBaseKey(const WinFwSettings &settings)
+{
+	std::wstringstream key;
+
+	key << L"ConnectingBase:";
+
+	AppendSettingsKey(key, settings);
+
+	return key.str();
+}
+
+std::wstring ConnectedPolicyKey
+(
+	const WinFwSettings &settings,
+	const FwContext::Relay &relay,
+	const rules::TunnelInterface &tunnel,
+	const std::vector<wfp::IpAddress> &dnsHosts
+)
+{
+	std::wstringstream key;
+
+	key << L"Connected:";
+
+	AppendSettingsKey(key, settings);
+	AppendRelayRuleKey(key, relay);
+
+	key << L':' << tunnel.key();
+
+	for (const auto &host : dnsHosts)
+	{
+		key << L':' << HostKey(host);
+	}
+
+	return key.str();
+}
+
+std::vector<wfp::IpAddress> ConvertDnsHosts(const wchar_t *v4DnsHost, const wchar_t *v6DnsHost)
+{
+	std::vector<wfp::IpAddress> dnsHosts;
+
+	dnsHosts.push_back(wfp::IpAddress(v4DnsHost));
+
+	if (nullptr != v6DnsHost)
+	{
+		dnsHosts.push_back(wfp::IpAddress(v6DnsHost));
+	}
+
+	return dnsHosts;
+}
+
+std::wstring BlockedPolicyKey(const WinFwSettings &settings)
+{
+	std::wstringstream key;
+
+	key << L"Blocked:";
+
+	AppendSettingsKey(key, settings);
+
+	return key.str();
+}
+
+bool StructuralObjectsInstalled(wfp::FilterEngine &engine)
+{
+	auto found = [](const auto &)
+	{
+		return true;
+	};
+
+	return wfp::ObjectExplorer::GetProvider(engine, MullvadGuids::Provider(), found)
+		&& wfp::ObjectExplorer::GetSublayer(engine, MullvadGuids::SublayerWhitelist(), found)
+		&& wfp::ObjectExplorer::GetSublayer(engine, MullvadGuids::SublayerBlacklist(), found);
+}
+
+//
+// Whether the filters of 'ruleset' are exactly what is installed after the checkpoint.
+// The rules are described rather than applied, so no filters are built.
+//
+bool RulesetInstalled(const SessionController &controller, uint32_t checkpoint,
+	const std::vector<std::shared_ptr<rules::IFirewallRule> > &ruleset)
+{
+	static auto &unchanged = shared::performance::CounterRegistry::Instance().counter("winfw.policy.unchanged");
+
+	std::vector<rules::IFirewallRule::FilterDescriptor> filters;
+
+	for (const auto &rule : ruleset)
+	{
+		const auto described = rule->describe();
+		filters.insert(filters.end(), described.begin(), described.end());
+	}
+
+	if (false == controller.matches(checkpoint, filters))
+	{
+		return false;
+	}
+
+	unchanged.increment();
+
+	return true;
+}
+
+} // anonymous namespace
+
+FwContext::FwContext(uint32_t timeout, BaseConfiguration baseConfiguration)
+	: m_timeout(timeout)
+	, m_sessionMode(SessionMode::Standard)
+	, m_transientBaseline(0)
+	, m_baseline(0)
+	, m_baseConfigured(false)
+	, m_handedOver(false)
+{
+	auto engine = SessionPool::Acquire(timeout);
+
+	//
+	// Pass engine ownership to "session controller"
+	//
+	m_sessionController = std::make_unique<SessionController>(std::move(engine));
+
+	if (BaseConfiguration::Deferred == baseConfiguration)
+	{
+		return;
+	}
+
+	if (false == completeBaseConfiguration())
+	{
+		THROW_ERROR("Failed to apply base configuration in BFE");
+	}
+}
+
+FwContext::FwContext(uint32_t timeout, const WinFwSettings &settings, SessionMode sessionMode)
+	: m_timeout(timeout)
+	, m_sessionMode(sessionMode)
+	, m_transientBaseline(0)
+	, m_baseline(0)
+	, m_baseConfigured(false)
+	, m_handedOver(false)
+{
+	auto engine = SessionPool::Acquire(timeout);
+
+	//
+	// Pass engine ownership to "session controller"
+	//
+	m_sessionController = std::make_unique<SessionController>(std::move(engine));
+
+	if (isHybrid())
+	{
+		m_transientController = std::make_unique<SessionController>(wfp::FilterEngine::DynamicSession(timeout));
+		m_transientBaseline = m_transientController->checkpoint();
+	}
+
+	uint32_t checkpoint = 0;
+
+	if (false == applyBlockedBaseConfiguration(settings, checkpoint))
+	{
+		THROW_ERROR("Failed to apply base configuration in BFE");
+	}
+
+	m_baseline = checkpoint;
+	m_baseConfigured = true;
+	m_activePolicy = blockedPolicy(settings).key;
+	m_basePolicy = m_activePolicy;
+}
+
+FwContext::FwContext(uint32_t timeout, const HandoverState &state)
+	: m_timeout(timeout)
+	, m_sessionMode(SessionMode::Standard)
+	, m_transientBaseline(0)
+	, m_baseline(0)
+	, m_baseConfigured(false)
+	, m_handedOver(false)
+{
+	auto engine = SessionPool::Acquire(timeout);
+
+	//
+	// Pass engine ownership to "session controller"
+	//
+	m_sessionController = std::make_unique<SessionController>(std::move(engine));
+
+	uint32_t checkpoint = 0;
+	bool adopted = false;
+
+	const auto status = m_sessionController->executeTransaction([&](SessionController &controller, wfp::FilterEngine &filterEngine)
+	{
+		if (false == StructuralObjectsInstalled(filterEngine))
+		{
+			if (false == applyCommonBaseConfiguration(controller, filterEngine))
+			{
+				return false;
+			}
+
+			checkpoint = controller.peekCheckpoint();
+
+			return true;
+		}
+
+		PersistentBlock::Remove(filterEngine);
+
+		controller.adoptProvider(MullvadGuids::Provider());
+		controller.adoptSublayer(MullvadGuids::SublayerWhitelist());
+		controller.adoptSublayer(MullvadGuids::SublayerBlacklist());
+
+		checkpoint = controller.peekCheckpoint();
+
+		controller.adoptFilters(MullvadGuids::Provider());
+
+		adopted = (controller.digest(checkpoint) == state.digest);
+
+		return true;
+	});
+
+	if (false == status)
+	{
+		THROW_ERROR("Failed to apply base configuration in BFE");
+	}
+
+	m_baseline = checkpoint;
+	m_baseConfigured = true;
+
+	//
+	// Policy keys don't include the excluded apps, so they have to be restored
+	// for the active policy to be recognized.
+	//
+	m_excludedApps = state.excludedApps;
+
+	if (adopted)
+	{
+		m_activePolicy = state.activePolicy;
+	}
+}
+
+FwContext::~FwContext()
+{
+	//
+	// Closing the dynamic session is enough for BFE to remove the permits.
+	// This goes first, since the permits refer to the structural objects.
+	//
+	if (m_transientController)
+	{
+		m_transientController->detach();
+		m_transientController.reset();
+	}
+
+	if (m_handedOver)
+	{
+		SessionPool::Release(m_sessionController->detach(), m_timeout);
+		return;
+	}
+
+	SessionPool::Release(m_sessionController->release(), m_timeout);
+}
+
+HandoverState FwContext::handoverState()
+{
+	//
+	// Install the base configuration first, if it was deferred, so the new instance
+	// finds the structural objects.
+	//
+	if (false == m_baseConfigured && false == completeBaseConfiguration())
+	{
+		THROW_ERROR("Failed to apply base configuration in BFE");
 	}
+
+	HandoverState state;
+
+	state.digest = m_sessionController->digest(m_baseline);
+
+	//
+	// In hybrid mode, the permits are removed when this instance is destroyed,
+	// which leaves the blocked policy in effect.
+	//
+	state.activePolicy = (isHybrid() ? m_basePolicy : m_activePolicy);
+	state.excludedApps = m_excludedApps;
+
+	return state;
+}
+
+void FwContext::handOver()
+{
+	m_handedOver = true;
 }
 
-void AppendNetBlockedRules(FwContext::Ruleset &ruleset)
+bool FwContext::applyPolicyConnecting
+(
+	const WinFwSettings &settings,
+	const std::vector<WinFwRelay> &relays,
+	const std::optional<PingableHosts> &pingableHosts
+)
+{
+	//
+	// Resolve the tunnel interface once, for both the key and the rule.
+	//
+	std::optional<rules::TunnelInterface> pingableTunnel;
+
+	if (pingableHosts.has_value() && pingableHosts->tunnelInterfaceAlias.has_value())
+	{
+		pingableTunnel = rules::TunnelInterface::Resolve(pingableHosts->tunnelInterfaceAlias.value());
+	}
+
+	const auto key = ConnectingPolicyKey(settings, relays, pingableHosts, pingableTunnel);
+
+	if (isActivePolicy(key))
+	{
+		return true;
+	}
+
+	if (isHybrid())
+	{
+		auto permits = composeConnectingPermits(relays, pingableHosts, pingableTunnel);
+
+		if (false == applyHybridPolicy(key, settings, permits))
+		{
+			return false;
+		}
+
+		m_lastConnecting = ConnectingPolicy{ key, settings, std::move(permits) };
+
+		return true;
+	}
+
+	const auto hostsRuleset = composeConnectingHosts(relays, pingableHosts, pingableTunnel);
+
+	auto baseKey = ConnectingBaseKey(settings);
+
+	//
+	// When retrying with other relays or pingable hosts, the rest of the policy is left alone.
+	//
+	if (m_connectingBase.has_value() && m_connectingBase->key == baseKey)
+	{
+		const auto checkpoint = m_connectingBase->checkpoint;
+
+		return applyPolicy(key, [&]()
+		{
+			const auto hostsFilters = prepareFilters(key, hostsRuleset);
+
+			if (nullptr == hostsFilters || false == applyFiltersAfter(checkpoint, *hostsFilters))
+			{
+				return false;
+			}
+
+			m_connectingBase = ConnectingBase{ std::move(baseKey), checkpoint };
+			m_lastConnecting = ConnectingPolicy{ key, settings, hostsRuleset };
+
+			return true;
+		});
+	}
+
+	return applyPolicy(key, [&]()
+	{
+		const auto baseRuleset = composeConnectingBase(settings);
+
+		const auto filters = prepareFilters(baseKey, baseRuleset);
+		const auto hostsFilters = prepareFilters(key, hostsRuleset);
+
+		uint32_t checkpoint = 0;
+
+		if (nullptr == filters
+			|| nullptr == hostsFilters
+			|| false == applyFiltersNested(*filters, *hostsFilters, checkpoint))
+		{
+			return false;
+		}
+
+		m_connectingBase = ConnectingBase{ std::move(baseKey), checkpoint };
+		m_lastConnecting = ConnectingPolicy{ key, settings, hostsRuleset };
+
+		return true;
+	});
+}
+
+bool FwContext::applyPolicyConnected
+(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const wchar_t *v4DnsHost,
+	const wchar_t *v6DnsHost
+)
+{
+	return applyPolicyConnected(settings, ConvertRelay(relay), tunnelInterfaceAlias,
+		ConvertDnsHosts(v4DnsHost, v6DnsHost));
+}
+
+bool FwContext::applyPolicyConnected
+(
+	const WinFwSettings &settings,
+	const Relay &relay,
+	const std::wstring &tunnelInterfaceAlias,
+	const std::vector<wfp::IpAddress> &dnsHosts
+)
+{
+	const auto tunnel = rules::TunnelInterface::Resolve(tunnelInterfaceAlias);
+	const auto key = ConnectedPolicyKey(settings, relay, tunnel, dnsHosts);
+
+	std::optional<StagedPolicy> staged;
+	staged.swap(m_stagedConnected);
+
+	if (isActivePolicy(key))
+	{
+		return true;
+	}
+
+	bool status;
+
+	if (isHybrid())
+	{
+		status = (staged.has_value() && staged->key == key)
+			? applyHybridPolicy(key, settings, staged->ruleset)
+			: applyHybridPolicy(key, settings, composeConnectedPermits({ relay }, tunnel, dnsHosts));
+	}
+	else
+	{
+		status = (staged.has_value() && staged->key == key)
+			? applyRuleset(key, staged->ruleset)
+			: applyRuleset(key, composePolicyConnected(settings, relay, tunnel, dnsHosts));
+	}
+
+	if (status)
+	{
+		m_lastConnected = ConnectedPolicy{ key, settings, relay, tunnel, dnsHosts };
+	}
+
+	return status;
+}
+
+bool FwContext::applyPolicyRelaySwitch(const WinFwRelay &relay)
+{
+	if (false == m_lastConnected.has_value() || false == m_activePolicy.has_value())
+	{
+		return false;
+	}
+
+	const auto &connected = m_lastConnected.value();
+	const auto switchPrefix = connected.key + L":Switch";
+
+	//
+	// Also permit switching again, before the connected policy for the new relay is applied.
+	//
+	if (m_activePolicy.value() != connected.key
+		&& 0 != m_activePolicy->compare(0, switchPrefix.size(), switchPrefix))
+	{
+		return false;
+	}
+
+	const auto newRelay = ConvertRelay(relay);
+
+	std::wstringstream key;
+
+	key << switchPrefix;
+
+	AppendRelayRuleKey(key, newRelay);
+
+	if (isActivePolicy(key.str()))
+	{
+		return true;
+	}
+
+	const auto permits = composeConnectedPermits({ connected.relay, newRelay }, connected.tunnel, connected.dnsHosts);
+
+	if (isHybrid())
+	{
+		return applyHybridPolicy(key.str(), connected.settings, permits);
+	}
+
+	auto ruleset = blockedPolicy(connected.settings).ruleset;
+
+	ruleset.insert(ruleset.end(), permits.begin(), permits.end());
+
+	return applyRuleset(key.str(), ruleset);
+}
+
+void FwContext::stagePolicyConnected
+(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const wchar_t *v4DnsHost,
+	const wchar_t *v6DnsHost
+)
+{
+	stagePolicyConnected(settings, ConvertRelay(relay), tunnelInterfaceAlias,
+		ConvertDnsHosts(v4DnsHost, v6DnsHost));
+}
+
+void FwContext::stagePolicyConnected
+(
+	const WinFwSettings &settings,
+	const Relay &relay,
+	const std::wstring &tunnelInterfaceAlias,
+	const std::vector<wfp::IpAddress> &dnsHosts
+)
+{
+	m_stagedConnected.reset();
+
+	const auto tunnel = rules::TunnelInterface::Resolve(tunnelInterfaceAlias);
+
+	auto ruleset = (isHybrid()
+		? composeConnectedPermits({ relay }, tunnel, dnsHosts)
+		: composePolicyConnected(settings, relay, tunnel, dnsHosts));
+
+	m_stagedConnected = StagedPolicy
+	{
+		ConnectedPolicyKey(settings, relay, tunnel, dnsHosts),
+		std::move(ruleset)
+	};
+}
+
+bool FwContext::applyPolicyBlocked(const WinFwSettings &settings)
+{
+	const auto &policy = blockedPolicy(settings);
+
+	if (isActivePolicy(policy.key))
+	{
+		return true;
+	}
+
+	if (isHybrid())
+	{
+		return applyPolicy(policy.key, [&]()
+		{
+			//
+			// Withdraw the permits first, so nothing more is permitted in between.
+			//
+			return clearTransientRuleset() && applyBasePolicy(settings);
+		});
+	}
+
+	return applyRuleset(policy.key, policy.ruleset);
+}
+
+void FwContext::armPolicyOffline(const WinFwSettings &settings)
+{
+	blockedPolicy(settings);
+
+	m_offlineSettings = settings;
+}
+
+void FwContext::disarmPolicyOffline()
+{
+	m_offlineSettings.reset();
+}
+
+bool FwContext::reset()
+{
+	m_activePolicy.reset();
+	m_connectingBase.reset();
+
+	if (isHybrid())
+	{
+		m_basePolicy.reset();
+
+		if (false == clearTransientRuleset())
+		{
+			return false;
+		}
+	}
+
+	//
+	// Objects left by an earlier instance are purged along with the base configuration.
+	//
+	if (false == m_baseConfigured)
+	{
+		return completeBaseConfiguration();
+	}
+
+	return m_sessionController->executeTransaction([this](SessionController &controller, wfp::FilterEngine &)
+	{
+		return controller.revert(m_baseline), true;
+	});
+}
+
+bool FwContext::precomputePolicies(const std::function<bool()> &preempted)
+{
+	std::unordered_map<std::wstring, PrecomputedPolicy> precomputed;
+
+	//
+	// Policies that are already prepared are carried over, and everything else is dropped.
+	//
+	auto precompute = [&](const std::wstring &key, const std::function<Ruleset()> &compose)
+	{
+		if (preempted())
+		{
+			return false;
+		}
+
+		//
+		// The active policy is not applied again.
+		//
+		if (isActivePolicy(key) || (m_basePolicy.has_value() && m_basePolicy.value() == key))
+		{
+			return true;
+		}
+
+		const auto existing = m_precomputed.find(key);
+
+		if (m_precomputed.end() != existing)
+		{
+			precomputed.insert(m_precomputed.extract(existing));
+			return true;
+		}
+
+		auto ruleset = compose();
+		auto filters = std::make_shared<PreparedFilters>();
+
+		if (applyRulesetDirectly(ruleset, *filters))
+		{
+			precomputed.emplace(key, PrecomputedPolicy{ std::move(ruleset), std::move(filters) });
+		}
+
+		return true;
+	};
+
+	auto completed = [&]()
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			const WinFwSettings settings{ 0 != (i & 1), 0 != (i & 2) };
+			const auto &policy = blockedPolicy(settings);
+
+			if (false == precompute(policy.key, [&policy]() { return policy.ruleset; }))
+			{
+				return false;
+			}
+		}
+
+		if (m_lastConnecting.has_value())
+		{
+			const auto &connecting = m_lastConnecting.value();
+
+			if (false == isHybrid() && false == precompute(ConnectingBaseKey(connecting.settings), [&]()
+			{
+				return composeConnectingBase(connecting.settings);
+			}))
+			{
+				return false;
+			}
+
+			if (false == precompute(connecting.key, [&connecting]() { return connecting.ruleset; }))
+			{
+				return false;
+			}
+		}
+
+		if (m_stagedConnected.has_value())
+		{
+			const auto &staged = m_stagedConnected.value();
+
+			if (false == precompute(staged.key, [&staged]() { return staged.ruleset; }))
+			{
+				return false;
+			}
+		}
+
+		if (m_lastConnected.has_value())
+		{
+			const auto &connected = m_lastConnected.value();
+
+			return precompute(connected.key, [&]()
+			{
+				return (isHybrid()
+					? composeConnectedPermits({ connected.relay }, connected.tunnel, connected.dnsHosts)
+					: composePolicyConnected(connected.settings, connected.relay, connected.tunnel, connected.dnsHosts));
+			});
+		}
+
+		return true;
+	}();
+
+	//
+	// Hold on to what was prepared earlier, until preparation can be completed.
+	//
+	if (false == completed)
+	{
+		precomputed.merge(m_precomputed);
+	}
+
+	m_precomputed = std::move(precomputed);
+
+	return completed;
+}
+
+void FwContext::setExcludedApps(const std::vector<std::wstring> &paths)
+{
+	m_excludedApps = paths;
+
+	//
+	// Make sure the next policy request is applied, even if its other inputs are unchanged.
+	// Policy keys don't include the excluded apps, so prepared policies are also out of date.
+	//
+	m_activePolicy.reset();
+	m_connectingBase.reset();
+	m_stagedConnected.reset();
+	m_lastConnecting.reset();
+	m_precomputed.clear();
+}
+
+bool FwContext::installPersistentBlock()
+{
+	return m_sessionController->executeTransaction([](SessionController &, wfp::FilterEngine &engine)
+	{
+		return PersistentBlock::Install(engine);
+	});
+}
+
+WinFwStatistics FwContext::statistics()
+{
+	return m_sessionController->statistics();
+}
+
+WinFwStatistics FwContext::accumulatedStatistics()
+{
+	auto statistics = m_sessionController->statistics();
+
+	if (m_transientController)
+	{
+		const auto transient = m_transientController->statistics();
+
+		statistics.numTransactions += transient.numTransactions;
+		Accumulate(statistics.accumulated, transient.accumulated);
+	}
+
+	return statistics;
+}
+
+std::unordered_map<UINT64, GUID> FwContext::filterKeys() const
+{
+	auto keys = m_sessionController->filterKeys();
+
+	if (m_transientController)
+	{
+		const auto transientKeys = m_transientController->filterKeys();
+		keys.insert(transientKeys.begin(), transientKeys.end());
+	}
+
+	return keys;
+}
+
+WinFwPolicyEstimate FwContext::estimatePolicyConnecting
+(
+	const WinFwSettings &settings,
+	const std::vector<WinFwRelay> &relays,
+	const std::optional<PingableHosts> &pingableHosts
+)
+{
+	std::optional<rules::TunnelInterface> pingableTunnel;
+
+	if (pingableHosts.has_value() && pingableHosts->tunnelInterfaceAlias.has_value())
+	{
+		pingableTunnel = rules::TunnelInterface::Resolve(pingableHosts->tunnelInterfaceAlias.value());
+	}
+
+	if (isHybrid())
+	{
+		return estimateHybrid(settings, composeConnectingPermits(relays, pingableHosts, pingableTunnel));
+	}
+
+	return estimateRuleset(composePolicyConnecting(settings, relays, pingableHosts, pingableTunnel));
+}
+
+WinFwPolicyEstimate FwContext::estimatePolicyConnected
+(
+	const WinFwSettings &settings,
+	const Relay &relay,
+	const std::wstring &tunnelInterfaceAlias,
+	const std::vector<wfp::IpAddress> &dnsHosts
+)
+{
+	const auto tunnel = rules::TunnelInterface::Resolve(tunnelInterfaceAlias);
+
+	if (isHybrid())
+	{
+		return estimateHybrid(settings, composeConnectedPermits({ relay }, tunnel, dnsHosts));
+	}
+
+	return estimateRuleset(composePolicyConnected(settings, relay, tunnel, dnsHosts));
+}
+
+WinFwPolicyEstimate FwContext::estimatePolicyBlocked(const WinFwSettings &settings)
+{
+	if (isHybrid())
+	{
+		return estimateHybrid(settings, Ruleset());
+	}
+
+	return estimateRuleset(blockedPolicy(settings).ruleset);
+}
+
+const FwContext::BlockedPolicy &FwContext::blockedPolicy(const WinFwSettings &settings)
+{
+	auto &policy = m_blockedPolicies[(settings.permitDhcp ? 1 : 0) | (settings.permitLan ? 2 : 0)];
+
+	if (false == policy.has_value())
+	{
+		Ruleset ruleset;
+
+		AppendNetBlockedRules(ruleset, m_ruleCache);
+		AppendSettingsRules(ruleset, m_ruleCache, settings);
+
+		policy = BlockedPolicy{ BlockedPolicyKey(settings), std::move(ruleset) };
+	}
+
+	return policy.value();
+}
+
+FwContext::Ruleset FwContext::composePolicyConnecting
+(
+	const WinFwSettings &settings,
+	const std::vector<WinFwRelay> &relays,
+	const std::optional<PingableHosts> &pingableHosts,
+	const std::optional<rules::TunnelInterface> &pingableTunnel
+)
 {
-	ruleset.emplace_back(std::make_unique<rules::BlockAll>());
-	ruleset.emplace_back(std::make_unique<rules::PermitLoopback>());
-}
+	auto ruleset = composeConnectingBase(settings);
+	const auto hostsRuleset = composeConnectingHosts(relays, pingableHosts, pingableTunnel);
 
-} // anonymous namespace
+	ruleset.insert(ruleset.end(), hostsRuleset.begin(), hostsRuleset.end());
 
-FwContext::FwContext(uint32_t timeout)
-	: m_baseline(0)
-{
-	auto engine = wfp::FilterEngine::StandardSession(timeout);
+	return ruleset;
+}
 
-	//
-	// Pass engine ownership to "session controller"
-	//
-	m_sessionController = std::make_unique<SessionController>(std::move(engine));
+FwContext::Ruleset FwContext::composeConnectingBase(const WinFwSettings &settings)
+{
+	auto ruleset = blockedPolicy(settings).ruleset;
 
-	if (false == applyBaseConfiguration())
-	{
-		THROW_ERROR("Failed to apply base configuration in BFE");
-	}
+	appendExcludedAppsRule(ruleset);
 
-	m_baseline = m_sessionController->checkpoint();
+	return ruleset;
 }
 
-FwContext::FwContext(uint32_t timeout, const WinFwSettings &settings)
-	: m_baseline(0)
+FwContext::Ruleset FwContext::composeConnectingPermits
+(
+	const std::vector<WinFwRelay> &relays,
+	const std::optional<PingableHosts> &pingableHosts,
+	const std::optional<rules::TunnelInterface> &pingableTunnel
+)
 {
-	auto engine = wfp::FilterEngine::StandardSession(timeout);
+	Ruleset ruleset;
 
-	//
-	// Pass engine ownership to "session controller"
-	//
-	m_sessionController = std::make_unique<SessionController>(std::move(engine));
+	appendExcludedAppsRule(ruleset);
 
-	uint32_t checkpoint = 0;
+	const auto hostsRuleset = composeConnectingHosts(relays, pingableHosts, pingableTunnel);
 
-	if (false == applyBlockedBaseConfiguration(settings, checkpoint))
-	{
-		THROW_ERROR("Failed to apply base configuration in BFE");
-	}
+	ruleset.insert(ruleset.end(), hostsRuleset.begin(), hostsRuleset.end());
 
-	m_baseline = checkpoint;
+	return ruleset;
 }
 
-bool FwContext::applyPolicyConnecting
+FwContext::Ruleset FwContext::composeConnectingHosts
 (
-	const WinFwSettings &settings,
-	const WinFwRelay &relay,
-	const std::optional<PingableHosts> &pingableHosts
+	const std::vector<WinFwRelay> &relays,
+	const std::optional<PingableHosts> &pingableHosts,
+	const std::optional<rules::TunnelInterface> &pingableTunnel
 )
 {
 	Ruleset ruleset;
 
-	AppendNetBlockedRules(ruleset);
-	AppendSettingsRules(ruleset, settings);
-
-	ruleset.emplace_back(std::make_unique<rules::PermitVpnRelay>(
-		wfp::IpAddress(relay.ip),
-		relay.port,
-		TranslateProtocol(relay.protocol)
-	));
+	ruleset.emplace_back(CompiledRelayRule(m_ruleCache, ConvertRelays(relays)));
 
 	//
 	// Permit pinging the gateway inside the tunnel.
@@ -124,83 +1084,146 @@ bool FwContext::applyPolicyConnecting
 	{
 		const auto &ph = pingableHosts.value();
 
+		auto key = std::wstring(L"PermitPing:").append(pingableTunnel.has_value() ? pingableTunnel->key() : L"");
+
 		for (const auto &host : ph.hosts)
 		{
-			ruleset.emplace_back(std::make_unique<rules::PermitPing>(
-				ph.tunnelInterfaceAlias,
-				host
-			));
+			key.append(L":").append(HostKey(host));
 		}
+
+		ruleset.emplace_back(Compiled<rules::PermitPing>(m_ruleCache, key,
+			pingableTunnel,
+			ph.hosts
+		));
 	}
 
-	return applyRuleset(ruleset);
+	return ruleset;
 }
 
-bool FwContext::applyPolicyConnected
+FwContext::Ruleset FwContext::composePolicyConnected
 (
 	const WinFwSettings &settings,
-	const WinFwRelay &relay,
-	const wchar_t *tunnelInterfaceAlias,
-	const wchar_t *v4DnsHost,
-	const wchar_t *v6DnsHost
+	const Relay &relay,
+	const rules::TunnelInterface &tunnel,
+	const std::vector<wfp::IpAddress> &dnsHosts
+)
+{
+	auto ruleset = blockedPolicy(settings).ruleset;
+	const auto permits = composeConnectedPermits({ relay }, tunnel, dnsHosts);
+
+	ruleset.insert(ruleset.end(), permits.begin(), permits.end());
+
+	return ruleset;
+}
+
+FwContext::Ruleset FwContext::composeConnectedPermits
+(
+	const std::vector<Relay> &relays,
+	const rules::TunnelInterface &tunnel,
+	const std::vector<wfp::IpAddress> &dnsHosts
 )
 {
 	Ruleset ruleset;
 
-	AppendNetBlockedRules(ruleset);
-	AppendSettingsRules(ruleset, settings);
+	ruleset.emplace_back(CompiledRelayRule(m_ruleCache, relays));
 
-	ruleset.emplace_back(std::make_unique<rules::PermitVpnRelay>(
-		wfp::IpAddress(relay.ip),
-		relay.port,
-		TranslateProtocol(relay.protocol)
-	));
+	appendExcludedAppsRule(ruleset);
 
-	ruleset.emplace_back(std::make_unique<rules::PermitVpnTunnel>(
-		tunnelInterfaceAlias
+	const auto tunnelKey = tunnel.key();
+
+	ruleset.emplace_back(Compiled<rules::PermitVpnTunnel>(m_ruleCache,
+		L"PermitVpnTunnel:" + tunnelKey,
+		tunnel
 	));
 
-	ruleset.emplace_back(std::make_unique<rules::PermitVpnTunnelService>(
-		tunnelInterfaceAlias
+	ruleset.emplace_back(Compiled<rules::PermitVpnTunnelService>(m_ruleCache,
+		L"PermitVpnTunnelService:" + tunnelKey,
+		tunnel
 	));
 
-	std::vector<wfp::IpAddress> dnsHosts;
-	dnsHosts.push_back(wfp::IpAddress(v4DnsHost));
+	auto dnsKey = L"PermitTunnelDns:" + tunnelKey;
 
-	if (nullptr != v6DnsHost)
+	for (const auto &host : dnsHosts)
 	{
-		dnsHosts.push_back(wfp::IpAddress(v6DnsHost));
+		dnsKey.append(L":").append(HostKey(host));
 	}
 
-	ruleset.emplace_back(std::make_unique<rules::PermitTunnelDns>(
-		tunnelInterfaceAlias,
+	ruleset.emplace_back(Compiled<rules::PermitTunnelDns>(m_ruleCache, dnsKey,
+		tunnel,
 		dnsHosts
 	));
 
-	return applyRuleset(ruleset);
+	return ruleset;
 }
 
-bool FwContext::applyPolicyBlocked(const WinFwSettings &settings)
+bool FwContext::applyHybridPolicy(const std::wstring &key, const WinFwSettings &settings, const Ruleset &permits)
 {
-	return applyRuleset(composePolicyBlocked(settings));
+	return applyPolicy(key, [&]()
+	{
+		return applyBasePolicy(settings) && applyTransientRuleset(key, permits);
+	});
 }
 
-bool FwContext::reset()
+bool FwContext::applyBasePolicy(const WinFwSettings &settings)
 {
-	return m_sessionController->executeTransaction([this](SessionController &controller, wfp::FilterEngine &)
+	const auto &policy = blockedPolicy(settings);
+
+	//
+	// The blocked policy only changes along with the settings.
+	//
+	if (m_basePolicy.has_value() && m_basePolicy.value() == policy.key)
 	{
-		return controller.revert(m_baseline), true;
+		return true;
+	}
+
+	m_basePolicy.reset();
+
+	const auto filters = prepareFilters(policy.key, policy.ruleset);
+
+	if (nullptr == filters)
+	{
+		return false;
+	}
+
+	const auto status = m_sessionController->executeTransaction([&](SessionController &controller, wfp::FilterEngine &)
+	{
+		return controller.reconcile(m_baseline, *filters);
 	});
+
+	if (status)
+	{
+		m_basePolicy = policy.key;
+	}
+
+	return status;
 }
 
-FwContext::Ruleset FwContext::composePolicyBlocked(const WinFwSettings &settings)
+bool FwContext::applyTransientRuleset(const std::wstring &key, const Ruleset &permits)
 {
-	Ruleset ruleset;
+	if (RulesetInstalled(*m_transientController, m_transientBaseline, permits))
+	{
+		return true;
+	}
 
-	AppendNetBlockedRules(ruleset);
-	AppendSettingsRules(ruleset, settings);
+	const auto filters = prepareFilters(key, permits);
 
-	return ruleset;
+	if (nullptr == filters)
+	{
+		return false;
+	}
+
+	return m_transientController->executeTransaction([&](SessionController &controller, wfp::FilterEngine &)
+	{
+		return controller.reconcile(m_transientBaseline, *filters);
+	});
+}
+
+bool FwContext::clearTransientRuleset()
+{
+	return m_transientController->executeTransaction([this](SessionController &controller, wfp::FilterEngine &)
+	{
+		return controller.revert(m_transientBaseline), true;
+	});
 }
 
 bool FwContext::applyBaseConfiguration()
@@ -211,10 +1234,54 @@ bool FwContext::applyBaseConfiguration()
 	});
 }
 
+bool FwContext::completeBaseConfiguration()
+{
+	if (false == applyBaseConfiguration())
+	{
+		return false;
+	}
+
+	m_baseline = m_sessionController->checkpoint();
+	m_baseConfigured = true;
+
+	return true;
+}
+
 bool FwContext::applyBlockedBaseConfiguration(const WinFwSettings &settings, uint32_t &checkpoint)
 {
+	PreparedFilters filters;
+
+	if (false == applyRulesetDirectly(blockedPolicy(settings).ruleset, filters))
+	{
+		return false;
+	}
+
 	return m_sessionController->executeTransaction([&](SessionController &controller, wfp::FilterEngine &engine)
 	{
+		//
+		// If the structural objects remain from an earlier instance, which will typically
+		// have left the blocked policy active, take ownership of everything and only fix up the
+		// filters that differ. This avoids removing and adding back the same filters.
+		//
+		if (StructuralObjectsInstalled(engine))
+		{
+			//
+			// Take over from the persistent filters left by an earlier instance, if any.
+			// The blocked policy becomes effective when the transaction is committed.
+			//
+			PersistentBlock::Remove(engine);
+
+			controller.adoptProvider(MullvadGuids::Provider());
+			controller.adoptSublayer(MullvadGuids::SublayerWhitelist());
+			controller.adoptSublayer(MullvadGuids::SublayerBlacklist());
+
+			checkpoint = controller.peekCheckpoint();
+
+			controller.adoptFilters(MullvadGuids::Provider());
+
+			return controller.reconcile(checkpoint, filters);
+		}
+
 		if (false == applyCommonBaseConfiguration(controller, engine))
 		{
 			return false;
@@ -227,7 +1294,7 @@ bool FwContext::applyBlockedBaseConfiguration(const WinFwSettings &settings, uin
 		//
 		checkpoint = controller.peekCheckpoint();
 
-		return applyRulesetDirectly(composePolicyBlocked(settings), controller);
+		return applyRulesetDirectly(blockedPolicy(settings).ruleset, controller);
 	});
 }
 
@@ -237,7 +1304,14 @@ bool FwContext::applyCommonBaseConfiguration(SessionController &controller, wfp:
 	// Since we're using a standard WFP session we can make no assumptions
 	// about which objects are already installed since before.
 	//
-	ObjectPurger::GetRemoveAllFunctor()(engine);
+	ObjectPurger::GetRemoveInstalledFunctor()(engine);
+
+	//
+	// Persistent filters are replaced by the policies applied by this instance.
+	// This happens in the same transaction, so there's no gap in protection
+	// if the blocked policy is applied as well.
+	//
+	PersistentBlock::Remove(engine);
 
 	//
 	// Install structural objects
@@ -247,20 +1321,282 @@ bool FwContext::applyCommonBaseConfiguration(SessionController &controller, wfp:
 		&& controller.addSublayer(*MullvadObjects::SublayerBlacklist());
 }
 
-bool FwContext::applyRuleset(const Ruleset &ruleset)
+void FwContext::appendExcludedAppsRule(Ruleset &ruleset)
+{
+	std::vector<rules::PermitExcludedApps::App> apps;
+
+	std::wstringstream key;
+
+	key << L"PermitExcludedApps";
+
+	for (const auto &path : m_excludedApps)
+	{
+		auto appId = m_appIdCache.get(path);
+
+		//
+		// There's no traffic to permit for applications that don't exist.
+		//
+		if (nullptr == appId)
+		{
+			continue;
+		}
+
+		//
+		// The application identifier is the device path of the file.
+		// Use it rather than the path, so the key is also updated if the path
+		// is made to refer to another volume.
+		//
+		key << L':' << std::wstring(reinterpret_cast<const wchar_t *>(appId->data()), appId->size() / sizeof(wchar_t));
+
+		apps.emplace_back(rules::PermitExcludedApps::App{ path, std::move(appId) });
+	}
+
+	if (apps.empty())
+	{
+		return;
+	}
+
+	ruleset.emplace_back(m_ruleCache.get(key.str(), [&apps]()
+	{
+		return std::make_unique<rules::PermitExcludedApps>(apps);
+	}));
+}
+
+bool FwContext::isActivePolicy(const std::wstring &key) const
+{
+	return m_activePolicy.has_value() && m_activePolicy.value() == key;
+}
+
+bool FwContext::applyRuleset(const std::wstring &key, const Ruleset &ruleset)
+{
+	return applyPolicy(key, [&]()
+	{
+		//
+		// Policies with different keys may still add the same filters.
+		//
+		if (m_baseConfigured && RulesetInstalled(*m_sessionController, m_baseline, ruleset))
+		{
+			return true;
+		}
+
+		const auto filters = prepareFilters(key, ruleset);
+
+		return nullptr != filters && applyFilters(*filters);
+	});
+}
+
+bool FwContext::applyPolicy(const std::wstring &key, std::function<bool()> operation)
+{
+	//
+	// The state in BFE is not known if the transaction fails.
+	//
+	m_activePolicy.reset();
+	m_connectingBase.reset();
+
+	static auto &failedCounter = shared::performance::CounterRegistry::Instance().counter("winfw.policy.failed");
+	static auto &applyHistogram = shared::performance::CounterRegistry::Instance().histogram("winfw.policy.apply");
+
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordFirewall);
+	const shared::performance::LatencyHistogram::ScopedTimer timer(applyHistogram);
+
+	const auto started = std::chrono::steady_clock::now();
+	const auto before = accumulatedStatistics();
+
+	bool success = false;
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&]()
+	{
+		shared::tracing::PolicyApplied(stopwatch, key.c_str(), success);
+
+		if (false == success)
+		{
+			failedCounter.increment();
+		}
+
+		const auto after = accumulatedStatistics();
+
+		PolicyTiming timing;
+
+		timing.sequence = (m_lastPolicy.has_value() ? m_lastPolicy->sequence + 1 : 1);
+		timing.key = key;
+		timing.success = success;
+		timing.totalUs = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - started).count();
+		timing.numTransactions = after.numTransactions - before.numTransactions;
+		timing.transactions = Difference(after.accumulated, before.accumulated);
+		timing.prepareUs = (timing.totalUs > timing.transactions.totalUs
+			? timing.totalUs - timing.transactions.totalUs : 0);
+
+		m_lastPolicy = std::move(timing);
+	};
+
+	if (false == operation())
+	{
+		return false;
+	}
+
+	m_activePolicy = key;
+	success = true;
+
+	return true;
+}
+
+std::shared_ptr<const PreparedFilters> FwContext::prepareFilters(const std::wstring &key, const Ruleset &ruleset)
+{
+	static auto &hits = shared::performance::CounterRegistry::Instance().counter("winfw.precomputed.hits");
+	static auto &misses = shared::performance::CounterRegistry::Instance().counter("winfw.precomputed.misses");
+
+	const auto precomputed = m_precomputed.find(key);
+
+	if (m_precomputed.end() != precomputed)
+	{
+		hits.increment();
+		return precomputed->second.filters;
+	}
+
+	misses.increment();
+
+	//
+	// Collect and validate the filters before the transaction is started,
+	// so the BFE transaction lock isn't held any longer than necessary.
+	//
+	auto filters = std::make_shared<PreparedFilters>();
+
+	if (false == applyRulesetDirectly(ruleset, *filters))
+	{
+		return nullptr;
+	}
+
+	return filters;
+}
+
+bool FwContext::applyFilters(const PreparedFilters &filters)
+{
+	//
+	// Only filters that differ between the active and the requested policy
+	// are removed and added. Everything else is left untouched in BFE.
+	//
+	auto baseline = m_baseline;
+
+	const auto status = m_sessionController->executeTransaction([&](SessionController &controller, wfp::FilterEngine &engine)
+	{
+		//
+		// Install the structural objects along with the first policy, if this was deferred.
+		//
+		if (false == m_baseConfigured)
+		{
+			if (false == applyCommonBaseConfiguration(controller, engine))
+			{
+				return false;
+			}
+
+			baseline = controller.peekCheckpoint();
+		}
+
+		return controller.reconcile(baseline, filters);
+	});
+
+	if (status)
+	{
+		m_baseline = baseline;
+		m_baseConfigured = true;
+	}
+
+	return status;
+}
+
+bool FwContext::applyFiltersNested(const PreparedFilters &filters, const PreparedFilters &nestedFilters, uint32_t &nestedCheckpoint)
+{
+	auto baseline = m_baseline;
+
+	const auto status = m_sessionController->executeTransaction([&](SessionController &controller, wfp::FilterEngine &engine)
+	{
+		if (false == m_baseConfigured)
+		{
+			if (false == applyCommonBaseConfiguration(controller, engine))
+			{
+				return false;
+			}
+
+			baseline = controller.peekCheckpoint();
+		}
+
+		return controller.reconcile(baseline, filters, nestedFilters, nestedCheckpoint);
+	});
+
+	if (status)
+	{
+		m_baseline = baseline;
+		m_baseConfigured = true;
+	}
+
+	return status;
+}
+
+bool FwContext::applyFiltersAfter(uint32_t checkpoint, const PreparedFilters &filters)
 {
 	return m_sessionController->executeTransaction([&](SessionController &controller, wfp::FilterEngine &)
 	{
-		controller.revert(m_baseline);
-		return applyRulesetDirectly(ruleset, controller);
+		return controller.reconcile(checkpoint, filters);
 	});
 }
 
-bool FwContext::applyRulesetDirectly(const Ruleset &ruleset, SessionController &controller)
+WinFwPolicyEstimate FwContext::estimateRuleset(const Ruleset &ruleset)
+{
+	PreparedFilters filters;
+
+	if (false == applyRulesetDirectly(ruleset, filters))
+	{
+		THROW_ERROR("Failed to prepare policy filters");
+	}
+
+	//
+	// Everything would be added along with the structural objects.
+	//
+	if (false == m_baseConfigured)
+	{
+		WinFwPolicyEstimate estimate = { 0 };
+
+		for (const auto filter : filters.filters())
+		{
+			++estimate.filtersAdded;
+			estimate.bytesAdded += filter->content().size();
+		}
+
+		return estimate;
+	}
+
+	return m_sessionController->estimateReconcile(m_baseline, filters);
+}
+
+WinFwPolicyEstimate FwContext::estimateHybrid(const WinFwSettings &settings, const Ruleset &permits)
+{
+	auto estimate = estimateRuleset(blockedPolicy(settings).ruleset);
+
+	PreparedFilters filters;
+
+	if (false == applyRulesetDirectly(permits, filters))
+	{
+		THROW_ERROR("Failed to prepare policy filters");
+	}
+
+	const auto transient = m_transientController->estimateReconcile(m_transientBaseline, filters);
+
+	estimate.filtersAdded += transient.filtersAdded;
+	estimate.filtersUnchanged += transient.filtersUnchanged;
+	estimate.objectsRemoved += transient.objectsRemoved;
+	estimate.bytesAdded += transient.bytesAdded;
+
+	return estimate;
+}
+
+bool FwContext::applyRulesetDirectly(const Ruleset &ruleset, IObjectInstaller &objectInstaller)
 {
 	for (const auto &rule : ruleset)
 	{
-		if (false == rule->apply(controller))
+		if (false == rule->apply(objectInstaller))
 		{
 			return false;
 		}
@@ -2,21 +2,78 @@
 
 #include "winfw.h"
 #include "sessioncontroller.h"
+#include "rulecache.h"
+#include "appidcache.h"
+#include "handoverstate.h"
 #include "rules/ifirewallrule.h"
+#include "rules/permitvpnrelay.h"
+#include "rules/tunnelinterface.h"
 #include "libwfp/ipaddress.h"
+#include <array>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <optional>
+#include <string>
+#include <unordered_map>
+
+class PreparedFilters;
 
 class FwContext
 {
 public:
 
-	FwContext(uint32_t timeout);
+	enum class BaseConfiguration
+	{
+		Immediate,
+
+		// Structural objects are installed in the transaction of the first policy.
+		Deferred,
+	};
+
+	enum class SessionMode
+	{
+		// Everything is installed in a standard session.
+		Standard,
+
+		//
+		// The blocked policy for the active settings is installed in a standard session,
+		// and the permits that the connecting and connected policies add to it are
+		// installed in a dynamic session. BFE removes the permits when the dynamic
+		// session is closed, e.g. if the process exits unexpectedly, while the blocked
+		// policy remains in effect.
+		//
+		Hybrid,
+	};
+
+	FwContext(uint32_t timeout, BaseConfiguration baseConfiguration = BaseConfiguration::Immediate);
 
 	// This ctor applies the "blocked" policy.
-	FwContext(uint32_t timeout, const WinFwSettings &settings);
+	FwContext(uint32_t timeout, const WinFwSettings &settings, SessionMode sessionMode = SessionMode::Standard);
+
+	//
+	// Take over the objects left installed by an instance that was handed over.
+	// If the installed filters no longer match the state, the policy in effect is
+	// unknown and the next policy is applied in full.
+	//
+	FwContext(uint32_t timeout, const HandoverState &state);
+
+	//
+	// Objects are removed and the session is returned to the session pool.
+	// Unless the instance was handed over, in which case the objects are left installed.
+	//
+	~FwContext();
+
+	//
+	// Capture the state needed to take over the installed objects.
+	//
+	HandoverState handoverState();
+
+	//
+	// Leave the objects installed when this instance is destroyed.
+	//
+	void handOver();
 
 	struct PingableHosts
 	{
@@ -24,10 +81,16 @@ public:
 		std::vector<wfp::IpAddress> hosts;
 	};
 
+	//
+	// Traffic to any of the relays is permitted.
+	//
+	// If the connecting policy is active with the same settings, only the filters
+	// for the relays and pingable hosts are replaced.
+	//
 	bool applyPolicyConnecting
 	(
 		const WinFwSettings &settings,
-		const WinFwRelay &relay,
+		const std::vector<WinFwRelay> &relays,
 		const std::optional<PingableHosts> &pingableHosts
 	);
 
@@ -39,27 +102,402 @@ public:
 		const wchar_t *v4DnsHost,
 		const wchar_t *v6DnsHost
 	);
+
+	using Relay = rules::PermitVpnRelay::Relay;
+
+	//
+	// DNS hosts may be of either address family.
+	//
+	bool applyPolicyConnected
+	(
+		const WinFwSettings &settings,
+		const Relay &relay,
+		const std::wstring &tunnelInterfaceAlias,
+		const std::vector<wfp::IpAddress> &dnsHosts
+	);
+
+	//
+	// Permit 'relay' in addition to the relay of the active connected policy, and leave
+	// the other filters of the policy in place, so the tunnel stays usable while a tunnel
+	// to the new relay is brought up. Applying the connected policy for the new relay
+	// afterwards only replaces the relay filters.
+	//
+	// Fails without changing anything unless the connected policy, or a relay switch
+	// from it, is active.
+	//
+	bool applyPolicyRelaySwitch(const WinFwRelay &relay);
+
 	bool applyPolicyBlocked(const WinFwSettings &settings);
 
+	//
+	// Compose the blocked policy for 'settings' ahead of time, so that applying it when
+	// connectivity is lost only involves the BFE transaction.
+	//
+	void armPolicyOffline(const WinFwSettings &settings);
+	void disarmPolicyOffline();
+
+	const std::optional<WinFwSettings> &offlineSettings() const
+	{
+		return m_offlineSettings;
+	}
+
+	//
+	// Compose the connected policy ahead of time, e.g. while connecting.
+	// A subsequent call to applyPolicyConnected() with identical arguments
+	// skips straight to the BFE transaction.
+	//
+	// The tunnel interface must exist, since compiling the policy resolves its alias.
+	//
+	void stagePolicyConnected
+	(
+		const WinFwSettings &settings,
+		const WinFwRelay &relay,
+		const wchar_t *tunnelInterfaceAlias,
+		const wchar_t *v4DnsHost,
+		const wchar_t *v6DnsHost
+	);
+
+	void stagePolicyConnected
+	(
+		const WinFwSettings &settings,
+		const Relay &relay,
+		const std::wstring &tunnelInterfaceAlias,
+		const std::vector<wfp::IpAddress> &dnsHosts
+	);
+
 	bool reset();
 
-	using Ruleset = std::vector<std::unique_ptr<rules::IFirewallRule> >;
+	//
+	// Prepare the filters of the policies that are likely to be applied next, so applying
+	// one of them only involves the BFE transaction. These are the blocked policy for each
+	// combination of settings, the most recent connecting policy, and the connected policy
+	// that is staged or was most recently applied.
+	//
+	// Intended to be called when there's nothing else to do. 'preempted' is checked before
+	// each policy is prepared, and preparation stops if it returns true.
+	// Returns false if preparation was not completed.
+	//
+	bool precomputePolicies(const std::function<bool()> &preempted);
+
+	//
+	// Install filters that block traffic until a new instance takes over,
+	// even across reboots. Used when exiting in a blocking state.
+	//
+	bool installPersistentBlock();
+
+	//
+	// Applications that are permitted to communicate outside the tunnel.
+	// Included in the connecting and connected policies applied after this call.
+	//
+	void setExcludedApps(const std::vector<std::wstring> &paths);
+
+	WinFwStatistics statistics();
+
+	//
+	// Breakdown of the most recent policy application, successful or not.
+	// Policies that are already active are not applied again, and not recorded.
+	//
+	struct PolicyTiming
+	{
+		// Incremented for each policy application.
+		uint64_t sequence;
+
+		std::wstring key;
+		bool success;
+
+		uint64_t totalUs;
+
+		// Time spent outside of transactions, e.g. composing and compiling rules.
+		uint64_t prepareUs;
+
+		// Transactions executed while applying the policy, summed.
+		uint64_t numTransactions;
+		WinFwTransactionStatistics transactions;
+	};
+
+	const std::optional<PolicyTiming> &lastPolicy() const
+	{
+		return m_lastPolicy;
+	}
+
+	//
+	// See SessionController::filterKeys().
+	//
+	std::unordered_map<UINT64, GUID> filterKeys() const;
+
+	//
+	// Key of the policy currently in effect, if any.
+	//
+	const std::optional<std::wstring> &activePolicy() const
+	{
+		return m_activePolicy;
+	}
+
+	//
+	// Compose a policy and compare it with the state in BFE, without starting
+	// a transaction. Arguments are the same as when applying the policy.
+	//
+	WinFwPolicyEstimate estimatePolicyConnecting
+	(
+		const WinFwSettings &settings,
+		const std::vector<WinFwRelay> &relays,
+		const std::optional<PingableHosts> &pingableHosts
+	);
+
+	WinFwPolicyEstimate estimatePolicyConnected
+	(
+		const WinFwSettings &settings,
+		const Relay &relay,
+		const std::wstring &tunnelInterfaceAlias,
+		const std::vector<wfp::IpAddress> &dnsHosts
+	);
+
+	WinFwPolicyEstimate estimatePolicyBlocked(const WinFwSettings &settings);
+
+	using Ruleset = std::vector<std::shared_ptr<rules::IFirewallRule> >;
 
 private:
 
 	FwContext(const FwContext &) = delete;
 	FwContext &operator=(const FwContext &) = delete;
 
-	Ruleset composePolicyBlocked(const WinFwSettings &settings);
+	struct BlockedPolicy
+	{
+		std::wstring key;
+		Ruleset ruleset;
+	};
+
+	//
+	// The blocked policy depends only on the settings. Each combination is
+	// composed once, and the same key and ruleset are used from then on.
+	//
+	const BlockedPolicy &blockedPolicy(const WinFwSettings &settings);
+
+	Ruleset composePolicyConnecting
+	(
+		const WinFwSettings &settings,
+		const std::vector<WinFwRelay> &relays,
+		const std::optional<PingableHosts> &pingableHosts,
+		const std::optional<rules::TunnelInterface> &pingableTunnel
+	);
+
+	//
+	// The connecting policy is composed of a base, that only depends on the settings, and the
+	// rules for the relays and pingable hosts, which are installed after a checkpoint of their own.
+	//
+	Ruleset composeConnectingBase(const WinFwSettings &settings);
+
+	//
+	// Rules that the connecting policy adds to the blocked policy.
+	//
+	Ruleset composeConnectingPermits
+	(
+		const std::vector<WinFwRelay> &relays,
+		const std::optional<PingableHosts> &pingableHosts,
+		const std::optional<rules::TunnelInterface> &pingableTunnel
+	);
+
+	Ruleset composeConnectingHosts
+	(
+		const std::vector<WinFwRelay> &relays,
+		const std::optional<PingableHosts> &pingableHosts,
+		const std::optional<rules::TunnelInterface> &pingableTunnel
+	);
+
+	Ruleset composePolicyConnected
+	(
+		const WinFwSettings &settings,
+		const Relay &relay,
+		const rules::TunnelInterface &tunnel,
+		const std::vector<wfp::IpAddress> &dnsHosts
+	);
+
+	//
+	// Rules that the connected policy adds to the blocked policy.
+	//
+	Ruleset composeConnectedPermits
+	(
+		const std::vector<Relay> &relays,
+		const rules::TunnelInterface &tunnel,
+		const std::vector<wfp::IpAddress> &dnsHosts
+	);
+
+	bool isHybrid() const
+	{
+		return SessionMode::Hybrid == m_sessionMode;
+	}
+
+	//
+	// Hybrid mode: Apply the blocked policy for 'settings' in the standard session,
+	// and replace the permits in the dynamic session with 'permits'.
+	//
+	bool applyHybridPolicy(const std::wstring &key, const WinFwSettings &settings, const Ruleset &permits);
+
+	bool applyBasePolicy(const WinFwSettings &settings);
+	bool applyTransientRuleset(const std::wstring &key, const Ruleset &permits);
+	bool clearTransientRuleset();
 
 	bool applyBaseConfiguration();
+	bool completeBaseConfiguration();
 	bool applyBlockedBaseConfiguration(const WinFwSettings &settings, uint32_t &checkpoint);
 	bool applyCommonBaseConfiguration(SessionController &controller, wfp::FilterEngine &engine);
 
-	bool applyRuleset(const Ruleset &ruleset);
-	bool applyRulesetDirectly(const Ruleset &ruleset, SessionController &controller);
+	void appendExcludedAppsRule(Ruleset &ruleset);
+
+	bool isActivePolicy(const std::wstring &key) const;
+
+	//
+	// Apply ruleset and record it as the active policy.
+	//
+	bool applyRuleset(const std::wstring &key, const Ruleset &ruleset);
+	bool applyPolicy(const std::wstring &key, std::function<bool()> operation);
+
+	//
+	// Filters of 'ruleset', which is identified by 'key'.
+	// Taken from the precomputed policies if available. Returns nullptr on failure.
+	//
+	std::shared_ptr<const PreparedFilters> prepareFilters(const std::wstring &key, const Ruleset &ruleset);
+
+	bool applyFilters(const PreparedFilters &filters);
+	bool applyRulesetDirectly(const Ruleset &ruleset, IObjectInstaller &objectInstaller);
+
+	//
+	// Apply 'nestedFilters' after a checkpoint of their own, following 'filters'.
+	//
+	bool applyFiltersNested(const PreparedFilters &filters, const PreparedFilters &nestedFilters, uint32_t &nestedCheckpoint);
+
+	//
+	// Replace only what was applied after the checkpoint.
+	//
+	bool applyFiltersAfter(uint32_t checkpoint, const PreparedFilters &filters);
+
+	WinFwPolicyEstimate estimateRuleset(const Ruleset &ruleset);
+
+	//
+	// Hybrid mode: Estimate the blocked policy against the standard session,
+	// and the permits against the dynamic session.
+	//
+	WinFwPolicyEstimate estimateHybrid(const WinFwSettings &settings, const Ruleset &permits);
+
+	uint32_t m_timeout;
+
+	SessionMode m_sessionMode;
 
 	std::unique_ptr<SessionController> m_sessionController;
 
+	//
+	// Hybrid mode: Dynamic session with the permits of the active policy, and the
+	// checkpoint of the empty session.
+	//
+	std::unique_ptr<SessionController> m_transientController;
+	uint32_t m_transientBaseline;
+
+	//
+	// Hybrid mode: Key of the blocked policy installed in the standard session, if known.
+	//
+	std::optional<std::wstring> m_basePolicy;
+
+	RuleCache m_ruleCache;
+
+	AppIdCache m_appIdCache;
+	std::vector<std::wstring> m_excludedApps;
+
+	struct StagedPolicy
+	{
+		std::wstring key;
+		Ruleset ruleset;
+	};
+
+	//
+	// In hybrid mode, the ruleset only has the permits.
+	//
+	std::optional<StagedPolicy> m_stagedConnected;
+
+	struct ConnectedPolicy
+	{
+		std::wstring key;
+		WinFwSettings settings;
+		Relay relay;
+		rules::TunnelInterface tunnel;
+		std::vector<wfp::IpAddress> dnsHosts;
+	};
+
+	//
+	// Inputs of the most recently applied connected policy.
+	// Only valid while the policy, or a relay switch from it, is active.
+	//
+	std::optional<ConnectedPolicy> m_lastConnected;
+
+	struct ConnectingPolicy
+	{
+		std::wstring key;
+		WinFwSettings settings;
+
+		//
+		// Rules for the relays and pingable hosts.
+		// In hybrid mode, all the permits of the policy.
+		//
+		Ruleset ruleset;
+	};
+
+	//
+	// Most recently applied connecting policy, which is likely to be applied again
+	// if the tunnel has to be reconnected.
+	//
+	std::optional<ConnectingPolicy> m_lastConnecting;
+
+	struct PrecomputedPolicy
+	{
+		// The prepared filters refer to the rules.
+		Ruleset ruleset;
+		std::shared_ptr<const PreparedFilters> filters;
+	};
+
+	//
+	// Indexed by policy key. See precomputePolicies().
+	//
+	// Connecting policies in standard mode are prepared in two parts, like they are applied.
+	// The base is indexed by its own key, and the rules for the relays and pingable hosts
+	// by the policy key. In hybrid mode, only the permits are indexed by the policy key.
+	//
+	std::unordered_map<std::wstring, PrecomputedPolicy> m_precomputed;
+
+	std::optional<WinFwSettings> m_offlineSettings;
+
+	struct ConnectingBase
+	{
+		std::wstring key;
+		uint32_t checkpoint;
+	};
+
+	//
+	// Nested checkpoint of the active connecting policy, if any.
+	// Everything before it only depends on the settings and the excluded apps.
+	//
+	std::optional<ConnectingBase> m_connectingBase;
+
+	// Indexed by permitDhcp | (permitLan << 1).
+	std::array<std::optional<BlockedPolicy>, 4> m_blockedPolicies;
+
+	//
+	// Key of the policy in effect, if known.
+	// Requests to apply the active policy again complete without a transaction.
+	//
+	std::optional<std::wstring> m_activePolicy;
+
+	std::optional<PolicyTiming> m_lastPolicy;
+
+	//
+	// Summed statistics of all sessions, for measuring what a policy application adds.
+	//
+	WinFwStatistics accumulatedStatistics();
+
+	//
+	// Checkpoint with only the structural objects installed.
+	// Not valid until the base configuration has been applied.
+	//
 	uint32_t m_baseline;
+	bool m_baseConfigured;
+
+	bool m_handedOver;
 };
@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include "handoverstate.h"
+#include <libcommon/error.h>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+
+constexpr uint32_t STATE_MAGIC = 0x4f48464d; // 'MFHO'
+constexpr uint32_t STATE_VERSION = 1;
+
+constexpr uint32_t NULL_STRING = ~uint32_t(0);
+
+class Writer
+{
+public:
+
+	template<typename T>
+	void value(const T &v)
+	{
+		const auto bytes = reinterpret_cast<const uint8_t *>(&v);
+		m_data.insert(m_data.end(), bytes, bytes + sizeof(v));
+	}
+
+	void string(const std::optional<std::wstring> &s)
+	{
+		if (false == s.has_value())
+		{
+			value(NULL_STRING);
+			return;
+		}
+
+		value(static_cast<uint32_t>(s->size()));
+
+		const auto bytes = reinterpret_cast<const uint8_t *>(s->data());
+		m_data.insert(m_data.end(), bytes, bytes + (s->size() * sizeof(wchar_t)));
+	}
+
+	std::vector<uint8_t> release()
+	{
+		return std::move(m_data);
+	}
+
+private:
+
+	std::vector<uint8_t> m_data;
+};
+
+class Reader
+{
+public:
+
+	Reader(const uint8_t *data, size_t size)
+		: m_data(data)
+		, m_size(size)
+		, m_offset(0)
+	{
+	}
+
+	template<typename T>
+	T value()
+	{
+		T v;
+		raw(&v, sizeof(v));
+
+		return v;
+	}
+
+	std::optional<std::wstring> string()
+	{
+		const auto length = value<uint32_t>();
+
+		if (NULL_STRING == length)
+		{
+			return std::nullopt;
+		}
+
+		if (length > (m_size - m_offset) / sizeof(wchar_t))
+		{
+			THROW_ERROR("Handover state is truncated");
+		}
+
+		std::wstring s(length, L'\0');
+		raw(&s[0], length * sizeof(wchar_t));
+
+		return s;
+	}
+
+private:
+
+	void raw(void *data, size_t size)
+	{
+		if (size > m_size - m_offset)
+		{
+			THROW_ERROR("Handover state is truncated");
+		}
+
+		std::memcpy(data, m_data + m_offset, size);
+		m_offset += size;
+	}
+
+	const uint8_t *m_data;
+	size_t m_size;
+	size_t m_offset;
+};
+
+} // anonymous namespace
+
+std::vector<uint8_t> HandoverState::serialize() const
+{
+	Writer writer;
+
+	writer.value(STATE_MAGIC);
+	writer.value(STATE_VERSION);
+	writer.value(digest);
+	writer.string(activePolicy);
+	writer.value(static_cast<uint32_t>(excludedApps.size()));
+
+	for (const auto &app : excludedApps)
+	{
+		writer.string(app);
+	}
+
+	return writer.release();
+}
+
+//static
+HandoverState HandoverState::Deserialize(const uint8_t *data, size_t size)
+{
+	if (nullptr == data)
+	{
+		THROW_ERROR("Invalid handover state");
+	}
+
+	Reader reader(data, size);
+
+	if (STATE_MAGIC != reader.value<uint32_t>()
+		|| STATE_VERSION != reader.value<uint32_t>())
+	{
+		THROW_ERROR("Unsupported handover state");
+	}
+
+	HandoverState state;
+
+	state.digest = reader.value<uint64_t>();
+	state.activePolicy = reader.string();
+
+	const auto numApps = reader.value<uint32_t>();
+
+	for (uint32_t i = 0; i < numApps; ++i)
+	{
+		const auto app = reader.string();
+
+		if (false == app.has_value())
+		{
+			THROW_ERROR("Invalid excluded app in handover state");
+		}
+
+		state.excludedApps.push_back(app.value());
+	}
+
+	return state;
+}
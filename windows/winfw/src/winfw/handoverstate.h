@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+//
+// State passed from an instance that is shutting down to the instance that
+// takes over the objects it leaves installed, e.g. during an upgrade.
+//
+// The objects themselves are read back from BFE by the new instance. This only
+// carries what cannot be read back, and a digest that is used to verify that
+// the installed filters are still the ones the policy was applied with.
+//
+struct HandoverState
+{
+	// Digest of the filters above the baseline checkpoint.
+	uint64_t digest;
+
+	// Key of the policy in effect, if known.
+	std::optional<std::wstring> activePolicy;
+
+	// Excluded apps used when composing the active policy.
+	std::vector<std::wstring> excludedApps;
+
+	std::vector<uint8_t> serialize() const;
+
+	// Throws if the data is not a valid state.
+	static HandoverState Deserialize(const uint8_t *data, size_t size);
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "compiledfilter.h"
 #include "libwfp/iconditionbuilder.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/providerbuilder.h"
@@ -14,4 +15,11 @@ struct IObjectInstaller
 	virtual bool addProvider(wfp::ProviderBuilder &providerBuilder) = 0;
 	virtual bool addSublayer(wfp::SublayerBuilder &sublayerBuilder) = 0;
 	virtual bool addFilter(wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder) = 0;
+	virtual bool addFilter(const CompiledFilter &filter) = 0;
+
+	//
+	// Add consecutive filters as one batch.
+	// Either all filters are valid, or none are added.
+	//
+	virtual bool addFilters(const CompiledFilter *filters, size_t numFilters) = 0;
 };
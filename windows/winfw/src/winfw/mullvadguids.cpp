@@ -1,569 +1,961 @@
 #include "stdafx.h"
 #include "mullvadguids.h"
+#include <libcommon/error.h>
 #include <algorithm>
-#include <iterator>
+#include <array>
 
-//static
-WfpObjectRegistry MullvadGuids::BuildRegistry()
+namespace
 {
-	const auto detailedRegistry = DetailedRegistry();
-	using ValueType = decltype(detailedRegistry)::const_reference;
 
-	std::unordered_set<GUID> registry;
+namespace guids
+{
 
-	std::transform(detailedRegistry.begin(), detailedRegistry.end(), std::inserter(registry, registry.end()), [](ValueType value)
-	{
-		return value.second;
+constexpr GUID NullKey = { 0 };
+
+constexpr GUID Provider =
+{
+	0x21e1dab8,
+	0xb9db,
+	0x43c0,
+	{ 0xb3, 0x43, 0xeb, 0x93, 0x65, 0xc7, 0xbd, 0xd2 }
+};
+
+constexpr GUID SublayerWhitelist =
+{
+	0x11d1a31a,
+	0xd7fa,
+	0x469b,
+	{ 0xbc, 0x21, 0xcc, 0xe9, 0x2e, 0x35, 0xfe, 0x90 }
+};
+
+constexpr GUID SublayerBlacklist =
+{
+	0x843b74f0,
+	0xb499,
+	0x499a,
+	{ 0xac, 0xe3, 0xf9, 0xee, 0xa2, 0x4, 0x89, 0xc1 }
+};
+
+constexpr GUID ProviderPersistent =
+{
+	0x8f9943a7,
+	0xc7f9,
+	0x4f75,
+	{ 0x8f, 0x21, 0x1d, 0x62, 0x71, 0x12, 0x81, 0xde }
+};
+
+constexpr GUID SublayerPersistent =
+{
+	0x414d3ff3,
+	0x1ef5,
+	0x4437,
+	{ 0xbd, 0x47, 0xe9, 0x0e, 0x63, 0x9b, 0xf5, 0x92 }
+};
+
+constexpr GUID FilterBlockAll_Outbound_Ipv4 =
+{
+	0xa81c5411,
+	0xfd0,
+	0x43a9,
+	{ 0xa9, 0xbe, 0x31, 0x3f, 0x29, 0x9d, 0xe6, 0x4f }
+};
+
+constexpr GUID FilterBlockAll_Inbound_Ipv4 =
+{
+	0x86d07155,
+	0x885f,
+	0x409a,
+	{ 0x8f, 0x22, 0x1, 0x9f, 0x87, 0x7a, 0xe4, 0x9 }
+};
+
+constexpr GUID FilterBlockAll_Outbound_Ipv6 =
+{
+	0x8ae5c389,
+	0xd604,
+	0x43df,
+	{ 0x87, 0x4a, 0x5c, 0x86, 0x76, 0xc9, 0xc2, 0xb8 }
+};
+
+constexpr GUID FilterBlockAll_Inbound_Ipv6 =
+{
+	0x18b8c1d2,
+	0x5910,
+	0x4b51,
+	{ 0xa5, 0x48, 0x1e, 0xfc, 0xd5, 0x4b, 0x63, 0xe9 }
+};
+
+constexpr GUID FilterPermitLan_Outbound_Ipv4 =
+{
+	0xb012b076,
+	0x80d1,
+	0x4628,
+	{ 0x8d, 0x7b, 0xa5, 0x58, 0x8, 0xd8, 0xdc, 0xa4 }
+};
+
+constexpr GUID FilterPermitLan_Outbound_Multicast_Ipv4 =
+{
+	0xea5e136b,
+	0xd951,
+	0x4263,
+	{ 0x99, 0xd8, 0x85, 0xc3, 0xf6, 0x4b, 0xda, 0xe9 }
+};
+
+constexpr GUID FilterPermitLan_Outbound_Ipv6 =
+{
+	0xacb22069,
+	0xed33,
+	0x4c6d,
+	{ 0x9b, 0xc8, 0xcd, 0xfa, 0x6a, 0x1a, 0x10, 0x35 }
+};
+
+constexpr GUID FilterPermitLan_Outbound_Multicast_Ipv6 =
+{
+	0xb63d89ec,
+	0xe145,
+	0x4e29,
+	{ 0x90, 0x87, 0xa7, 0x9b, 0xd6, 0xfc, 0x8b, 0x29 }
+};
+
+constexpr GUID FilterPermitLanService_Inbound_Ipv4 =
+{
+	0x5849930,
+	0x40ae,
+	0x41e4,
+	{ 0x81, 0x68, 0x21, 0x94, 0x89, 0x8e, 0x6f, 0x8c }
+};
+
+constexpr GUID FilterPermitLanService_Inbound_Ipv6 =
+{
+	0xe8122820,
+	0xe138,
+	0x46b0,
+	{ 0x96, 0x6f, 0x68, 0xa0, 0x6, 0xa2, 0xb5, 0xa2 }
+};
+
+constexpr GUID FilterPermitLoopback_Outbound_Ipv4 =
+{
+	0xd9ff592d,
+	0xbe46,
+	0x49fb,
+	{ 0x97, 0xec, 0x71, 0x1, 0x3c, 0x12, 0xb8, 0x30 }
+};
+
+constexpr GUID FilterPermitLoopback_Inbound_Ipv4 =
+{
+	0xb8efb500,
+	0xc51,
+	0x4550,
+	{ 0xbf, 0x5c, 0x48, 0x54, 0xa6, 0xc8, 0x48, 0xb9 }
+};
+
+constexpr GUID FilterPermitLoopback_Outbound_Ipv6 =
+{
+	0x764d4944,
+	0x8a1e,
+	0x4d96,
+	{ 0xbf, 0xf0, 0x8d, 0xa6, 0x4f, 0x31, 0x44, 0xa2 }
+};
+
+constexpr GUID FilterPermitLoopback_Inbound_Ipv6 =
+{
+	0xbad325b0,
+	0x736c,
+	0x4e67,
+	{ 0x8b, 0x37, 0x62, 0xb2, 0xdb, 0xe7, 0xd6, 0xeb }
+};
+
+constexpr GUID FilterPermitDhcp_Outbound_Request_Ipv4 =
+{
+	0x6cf1687b,
+	0x35e9,
+	0x4d18,
+	{ 0xa2, 0x3, 0xb2, 0x6b, 0x71, 0xa9, 0x5f, 0x8d }
+};
+
+constexpr GUID FilterPermitDhcp_Inbound_Response_Ipv4 =
+{
+	0x2db298d7,
+	0x4108,
+	0x47ff,
+	{ 0x85, 0x99, 0xaf, 0xa5, 0xcb, 0x95, 0x9c, 0x25 }
+};
+
+constexpr GUID FilterPermitDhcp_Outbound_Request_Ipv6 =
+{
+	0x67bd69b0,
+	0x522d,
+	0x4631,
+	{ 0x9a, 0x8f, 0x1c, 0xee, 0xdf, 0x64, 0xb7, 0x2b }
+};
+
+constexpr GUID FilterPermitDhcp_Inbound_Response_Ipv6 =
+{
+	0x40dcfb6d,
+	0x2ee,
+	0x4531,
+	{ 0x86, 0x61, 0xc4, 0xc8, 0xa4, 0x3a, 0xf4, 0x23 }
+};
+
+constexpr GUID FilterPermitDhcpServer_Inbound_Request_Ipv4 =
+{
+	0xa6c98ac3,
+	0xe06,
+	0x4fd2,
+	{ 0xb4, 0x5e, 0xb7, 0xef, 0x67, 0x4, 0x43, 0xbc }
+};
+
+constexpr GUID FilterPermitDhcpServer_Outbound_Response_Ipv4 =
+{
+	0x57006c23,
+	0xc21f,
+	0x4d23,
+	{ 0x88, 0xf, 0x5a, 0x9d, 0x94, 0x6b, 0xc2, 0xf3 }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv4 =
+{
+	0x160c205d,
+	0xdb40,
+	0x4f79,
+	{ 0x90, 0x6d, 0xfd, 0xa1, 0xe1, 0xc1, 0x8a, 0x70 }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv6 =
+{
+	0x2cd93b7d,
+	0xdf6d,
+	0x4287,
+	{ 0x88, 0x46, 0xa1, 0x05, 0xbe, 0x66, 0x7b, 0xa5 }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv4_1 =
+{
+	0xda3e72f8,
+	0xc619,
+	0x44ce,
+	{ 0x8c, 0x75, 0x65, 0xbc, 0x2b, 0xb9, 0xdc, 0x51 }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv4_2 =
+{
+	0xc60ade94,
+	0xc133,
+	0x4792,
+	{ 0x8f, 0x12, 0x72, 0xdd, 0x06, 0x0f, 0x86, 0x3e }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv4_3 =
+{
+	0x7fae4013,
+	0x3d4e,
+	0x42a0,
+	{ 0x81, 0xf1, 0x3e, 0x73, 0x96, 0x46, 0x96, 0x0e }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv6_1 =
+{
+	0x83947864,
+	0x925c,
+	0x405a,
+	{ 0x9a, 0x0d, 0xfd, 0x1d, 0x04, 0x3f, 0x73, 0x69 }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv6_2 =
+{
+	0xd5331dfc,
+	0xb2cb,
+	0x4415,
+	{ 0x9a, 0x90, 0x99, 0x71, 0x2b, 0xfb, 0xb8, 0x5f }
+};
+
+constexpr GUID FilterPermitVpnRelay_Ipv6_3 =
+{
+	0xedfac0ab,
+	0x8ac6,
+	0x48c3,
+	{ 0xbe, 0x7f, 0xf1, 0x7f, 0xe1, 0x71, 0x66, 0x4c }
+};
+
+constexpr GUID FilterPermitVpnTunnel_Outbound_Ipv4 =
+{
+	0xdfdcbb76,
+	0x2284,
+	0x4b03,
+	{ 0x93, 0x4e, 0x93, 0xe5, 0xd3, 0x84, 0x8c, 0xf1 }
+};
+
+constexpr GUID FilterPermitVpnTunnel_Outbound_Ipv6 =
+{
+	0x9b1fa7d,
+	0x843b,
+	0x4946,
+	{ 0xa6, 0x2, 0x90, 0x4, 0x26, 0x2a, 0xb8, 0x6b }
+};
+
+constexpr GUID FilterPermitTunnelDns_Ipv4 =
+{
+	0x60474363,
+	0x42b7,
+	0x44ad,
+	{ 0xa6, 0xdb, 0x9c, 0x4a, 0x4d, 0x3c, 0xde, 0x4a }
+};
+
+constexpr GUID FilterPermitTunnelDns_Ipv6 =
+{
+	0xa832ce1d,
+	0xa250,
+	0x42be,
+	{ 0x8b, 0x97, 0x2, 0xb7, 0x9f, 0x9c, 0x5e, 0x1 }
+};
+
+constexpr GUID FilterPermitVpnTunnelService_Ipv4 =
+{
+	0xf11a9ab4,
+	0x3dd6,
+	0x4cd9,
+	{ 0x9d, 0x95, 0xb0, 0x36, 0x22, 0x71, 0x6b, 0x3d }
+};
+
+constexpr GUID FilterPermitVpnTunnelService_Ipv6 =
+{
+	0xe902e448,
+	0x1845,
+	0x42e5,
+	{ 0xad, 0xf3, 0x33, 0xb2, 0x7a, 0xd, 0x5d, 0x38 }
+};
+
+constexpr GUID FilterPermitNdp_Outbound_Router_Solicitation =
+{
+	0xbc5a85e4,
+	0x5319,
+	0x4224,
+	{ 0x8a, 0x27, 0x53, 0xeb, 0x61, 0xef, 0x3b, 0x1 }
+};
+
+constexpr GUID FilterPermitNdp_Inbound_Router_Advertisement =
+{
+	0x4d996f1d,
+	0x4915,
+	0x4a6a,
+	{ 0xbd, 0xf5, 0xb5, 0x1a, 0x2d, 0xbc, 0xb8, 0xe9 }
+};
+
+constexpr GUID FilterPermitNdp_Inbound_Redirect =
+{
+	0xcec23a8,
+	0x4fdd,
+	0x4a96,
+	{ 0xae, 0xba, 0x33, 0xd2, 0xa7, 0xf, 0x85, 0x22 }
+};
+
+constexpr GUID FilterPermitPing_Outbound_Icmpv4 =
+{
+	0x2ecf7ff7,
+	0xc951,
+	0x4056,
+	{ 0xb0, 0xf7, 0x40, 0xa4, 0x5c, 0x7e, 0xb4, 0xc2 }
+};
+
+constexpr GUID FilterPermitPing_Outbound_Icmpv6 =
+{
+	0x3deb8cab,
+	0x1edb,
+	0x4aa1,
+	{ 0xb2, 0x73, 0xec, 0x61, 0x4f, 0x50, 0xdc, 0x13 }
+};
+
+constexpr GUID FilterPermitExcludedApps_Outbound_Ipv4 =
+{
+	0xab607e56,
+	0x6b99,
+	0x460b,
+	{ 0xb4, 0x79, 0xfa, 0x47, 0x45, 0xbb, 0x67, 0x8a }
+};
+
+constexpr GUID FilterPermitExcludedApps_Inbound_Ipv4 =
+{
+	0xc7c20096,
+	0x31fb,
+	0x4f0e,
+	{ 0xa3, 0x1b, 0x4a, 0x6b, 0x7f, 0x8c, 0xe1, 0x0e }
+};
+
+constexpr GUID FilterPermitExcludedApps_Outbound_Ipv6 =
+{
+	0x6ee761fe,
+	0xb157,
+	0x4c0e,
+	{ 0xad, 0x9d, 0x53, 0x28, 0x89, 0x89, 0xb8, 0x17 }
+};
+
+constexpr GUID FilterPermitExcludedApps_Inbound_Ipv6 =
+{
+	0x1d9ee810,
+	0x7267,
+	0x4551,
+	{ 0xae, 0x88, 0x19, 0x9e, 0x3e, 0xab, 0xec, 0xd4 }
+};
+
+constexpr GUID FilterPersistentBlockAll_Outbound_Ipv4 =
+{
+	0x4bcf65c2,
+	0xe5b3,
+	0x4bc3,
+	{ 0x8c, 0x41, 0xb0, 0x9b, 0x84, 0x31, 0x0a, 0xbb }
+};
+
+constexpr GUID FilterPersistentBlockAll_Inbound_Ipv4 =
+{
+	0xf6be2be6,
+	0x3a85,
+	0x4c3c,
+	{ 0x8a, 0xb6, 0x01, 0xa9, 0x67, 0x8c, 0xf9, 0xbd }
+};
+
+constexpr GUID FilterPersistentBlockAll_Outbound_Ipv6 =
+{
+	0x6699a39d,
+	0x3d4b,
+	0x47ec,
+	{ 0xa7, 0x52, 0x06, 0x91, 0xf6, 0xc6, 0x3c, 0x29 }
+};
+
+constexpr GUID FilterPersistentBlockAll_Inbound_Ipv6 =
+{
+	0x89af222b,
+	0x48cc,
+	0x4a85,
+	{ 0xb0, 0x55, 0xb1, 0x88, 0x61, 0xbd, 0xe1, 0xcc }
+};
+
+constexpr GUID FilterPersistentPermitLoopback_Outbound_Ipv4 =
+{
+	0xaa8f6032,
+	0x0028,
+	0x428a,
+	{ 0x83, 0x84, 0xbb, 0x30, 0x54, 0x3b, 0x6d, 0x07 }
+};
+
+constexpr GUID FilterPersistentPermitLoopback_Inbound_Ipv4 =
+{
+	0x59c3975e,
+	0x21e5,
+	0x4cee,
+	{ 0x8c, 0x46, 0x56, 0x11, 0x90, 0xfd, 0xc9, 0x52 }
+};
+
+constexpr GUID FilterPersistentPermitLoopback_Outbound_Ipv6 =
+{
+	0x08bc1543,
+	0xf1f7,
+	0x46cc,
+	{ 0xb5, 0x38, 0x9b, 0x3e, 0x77, 0x20, 0xe4, 0x17 }
+};
+
+constexpr GUID FilterPersistentPermitLoopback_Inbound_Ipv6 =
+{
+	0x3f869528,
+	0x6860,
+	0x4261,
+	{ 0x9e, 0x66, 0x2c, 0xd0, 0x8c, 0x73, 0x2b, 0x17 }
+};
+
+} // namespace guids
+
+constexpr bool Less(const GUID &lhs, const GUID &rhs)
+{
+	if (lhs.Data1 != rhs.Data1) return lhs.Data1 < rhs.Data1;
+	if (lhs.Data2 != rhs.Data2) return lhs.Data2 < rhs.Data2;
+	if (lhs.Data3 != rhs.Data3) return lhs.Data3 < rhs.Data3;
+
+	for (size_t i = 0; i < sizeof(lhs.Data4); ++i)
+	{
+		if (lhs.Data4[i] != rhs.Data4[i]) return lhs.Data4[i] < rhs.Data4[i];
+	}
+
+	return false;
+}
+
+constexpr bool Less(const WfpObjectRecord &lhs, const WfpObjectRecord &rhs)
+{
+	if (lhs.type != rhs.type)
+	{
+		return lhs.type < rhs.type;
+	}
+
+	return Less(lhs.key, rhs.key);
+}
+
+//
+// Insertion sort, since std::sort is not constexpr.
+//
+template<size_t N, typename Compare>
+constexpr std::array<WfpObjectRecord, N> Sort(std::array<WfpObjectRecord, N> records, Compare less)
+{
+	for (size_t i = 1; i < N; ++i)
+	{
+		for (size_t j = i; j > 0 && less(records[j], records[j - 1]); --j)
+		{
+			const auto temp = records[j];
+			records[j] = records[j - 1];
+			records[j - 1] = temp;
+		}
+	}
+
+	return records;
+}
+
+constexpr std::array<WfpObjectRecord, 56> UnsortedRecords =
+{{
+	{ WfpObjectType::Provider, guids::Provider },
+	{ WfpObjectType::Sublayer, guids::SublayerWhitelist },
+	{ WfpObjectType::Sublayer, guids::SublayerBlacklist },
+	{ WfpObjectType::Provider, guids::ProviderPersistent },
+	{ WfpObjectType::Sublayer, guids::SublayerPersistent },
+	{ WfpObjectType::Filter, guids::FilterBlockAll_Outbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterBlockAll_Inbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterBlockAll_Outbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterBlockAll_Inbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitLan_Outbound_Ipv4 },
+	// No longer installed, but may remain from an earlier version.
+	{ WfpObjectType::Filter, guids::FilterPermitLan_Outbound_Multicast_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitLan_Outbound_Ipv6 },
+	// No longer installed, but may remain from an earlier version.
+	{ WfpObjectType::Filter, guids::FilterPermitLan_Outbound_Multicast_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitLanService_Inbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitLanService_Inbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitLoopback_Outbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitLoopback_Inbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitLoopback_Outbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitLoopback_Inbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitDhcp_Outbound_Request_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitDhcp_Inbound_Response_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitDhcp_Outbound_Request_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitDhcp_Inbound_Response_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitDhcpServer_Inbound_Request_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitDhcpServer_Outbound_Response_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv4_1 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv4_2 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv4_3 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv6_1 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv6_2 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnRelay_Ipv6_3 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnTunnel_Outbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnTunnel_Outbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitTunnelDns_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitTunnelDns_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnTunnelService_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitVpnTunnelService_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitNdp_Outbound_Router_Solicitation },
+	{ WfpObjectType::Filter, guids::FilterPermitNdp_Inbound_Router_Advertisement },
+	{ WfpObjectType::Filter, guids::FilterPermitNdp_Inbound_Redirect },
+	{ WfpObjectType::Filter, guids::FilterPermitPing_Outbound_Icmpv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitPing_Outbound_Icmpv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitExcludedApps_Outbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitExcludedApps_Inbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPermitExcludedApps_Outbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPermitExcludedApps_Inbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPersistentBlockAll_Outbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPersistentBlockAll_Inbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPersistentBlockAll_Outbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPersistentBlockAll_Inbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPersistentPermitLoopback_Outbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPersistentPermitLoopback_Inbound_Ipv4 },
+	{ WfpObjectType::Filter, guids::FilterPersistentPermitLoopback_Outbound_Ipv6 },
+	{ WfpObjectType::Filter, guids::FilterPersistentPermitLoopback_Inbound_Ipv6 }
+}};
+
+constexpr bool LessKey(const WfpObjectRecord &lhs, const WfpObjectRecord &rhs)
+{
+	return Less(lhs.key, rhs.key);
+}
+
+constexpr auto Records = Sort(UnsortedRecords, [](const WfpObjectRecord &lhs, const WfpObjectRecord &rhs)
+{
+	return Less(lhs, rhs);
+});
+
+constexpr auto RecordsByKey = Sort(UnsortedRecords, LessKey);
+
+//
+// Keys must be unique across all types, or objects could be mistaken for one another.
+//
+template<size_t N>
+constexpr bool UniqueKeys(const std::array<WfpObjectRecord, N> &byKey)
+{
+	for (size_t i = 0; i < N; ++i)
+	{
+		if (false == Less(guids::NullKey, byKey[i].key))
+		{
+			return false;
+		}
+
+		if (i > 0 && false == LessKey(byKey[i - 1], byKey[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static_assert(UniqueKeys(RecordsByKey), "Null or duplicate key in object registry");
+
+constexpr WfpObjectRegistry RegistryInstance(Records.data(), Records.data() + Records.size(), RecordsByKey.data());
+
+} // anonymous namespace
+
+WfpObjectRegistry::Range WfpObjectRegistry::equal_range(WfpObjectType type) const
+{
+	return std::equal_range(m_begin, m_end, WfpObjectRecord{ type, GUID{ 0 } }, [](const WfpObjectRecord &lhs, const WfpObjectRecord &rhs)
+	{
+		return lhs.type < rhs.type;
 	});
+}
 
-	return registry;
-}
-
-//static
-DetailedWfpObjectRegistry MullvadGuids::BuildDetailedRegistry()
-{
-	std::multimap<WfpObjectType, GUID> registry;
-
-	registry.insert(std::make_pair(WfpObjectType::Provider, Provider()));
-	registry.insert(std::make_pair(WfpObjectType::Sublayer, SublayerWhitelist()));
-	registry.insert(std::make_pair(WfpObjectType::Sublayer, SublayerBlacklist()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterBlockAll_Outbound_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterBlockAll_Inbound_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterBlockAll_Outbound_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterBlockAll_Inbound_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLan_Outbound_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLan_Outbound_Multicast_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLan_Outbound_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLan_Outbound_Multicast_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLanService_Inbound_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLanService_Inbound_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLoopback_Outbound_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLoopback_Inbound_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLoopback_Outbound_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitLoopback_Inbound_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitDhcp_Outbound_Request_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitDhcp_Inbound_Response_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitDhcp_Outbound_Request_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitDhcp_Inbound_Response_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitDhcpServer_Inbound_Request_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitDhcpServer_Outbound_Response_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitVpnRelay()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitVpnTunnel_Outbound_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitVpnTunnel_Outbound_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitTunnelDns_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitTunnelDns_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitVpnTunnelService_Ipv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitVpnTunnelService_Ipv6()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitNdp_Outbound_Router_Solicitation()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitNdp_Inbound_Router_Advertisement()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitNdp_Inbound_Redirect()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitPing_Outbound_Icmpv4()));
-	registry.insert(std::make_pair(WfpObjectType::Filter, FilterPermitPing_Outbound_Icmpv6()));
-
-	return registry;
+bool WfpObjectRegistry::contains(const GUID &key) const
+{
+	const auto end = m_byKey + (m_end - m_begin);
+
+	return std::binary_search(m_byKey, end, WfpObjectRecord{ WfpObjectType::Filter, key }, LessKey);
 }
 
 //static
 const WfpObjectRegistry &MullvadGuids::Registry()
 {
-	static auto registry = BuildRegistry();	// TODO: Thread safety.
-	return registry;
+	return RegistryInstance;
 }
 
 //static
-const DetailedWfpObjectRegistry &MullvadGuids::DetailedRegistry()
+const GUID &MullvadGuids::NullKey()
 {
-	static auto registry = BuildDetailedRegistry();	// TODO: Thread safety.
-	return registry;
+	return guids::NullKey;
 }
 
 //static
 const GUID &MullvadGuids::Provider()
 {
-	static const GUID g =
-	{
-		0x21e1dab8,
-		0xb9db,
-		0x43c0,
-		{ 0xb3, 0x43, 0xeb, 0x93, 0x65, 0xc7, 0xbd, 0xd2 }
-	};
-
-	return g;
+	return guids::Provider;
 }
 
 //static
 const GUID &MullvadGuids::SublayerWhitelist()
 {
-	static const GUID g =
-	{
-		0x11d1a31a,
-		0xd7fa,
-		0x469b,
-		{ 0xbc, 0x21, 0xcc, 0xe9, 0x2e, 0x35, 0xfe, 0x90 }
-	};
-
-	return g;
+	return guids::SublayerWhitelist;
 }
 
 //static
 const GUID &MullvadGuids::SublayerBlacklist()
 {
-	static const GUID g =
-	{
-		0x843b74f0,
-		0xb499,
-		0x499a,
-		{ 0xac, 0xe3, 0xf9, 0xee, 0xa2, 0x4, 0x89, 0xc1 }
-	};
-
-	return g;
+	return guids::SublayerBlacklist;
 }
 
 //static
-const GUID &MullvadGuids::FilterBlockAll_Outbound_Ipv4()
+const GUID &MullvadGuids::ProviderPersistent()
 {
-	static const GUID g =
-	{
-		0xa81c5411,
-		0xfd0,
-		0x43a9,
-		{ 0xa9, 0xbe, 0x31, 0x3f, 0x29, 0x9d, 0xe6, 0x4f }
-	};
-
-	return g;
+	return guids::ProviderPersistent;
 }
 
 //static
-const GUID &MullvadGuids::FilterBlockAll_Inbound_Ipv4()
+const GUID &MullvadGuids::SublayerPersistent()
 {
-	static const GUID g =
-	{
-		0x86d07155,
-		0x885f,
-		0x409a,
-		{ 0x8f, 0x22, 0x1, 0x9f, 0x87, 0x7a, 0xe4, 0x9 }
-	};
-
-	return g;
+	return guids::SublayerPersistent;
 }
 
 //static
-const GUID &MullvadGuids::FilterBlockAll_Outbound_Ipv6()
+const GUID &MullvadGuids::FilterBlockAll_Outbound_Ipv4()
 {
-	static const GUID g =
-	{
-		0x8ae5c389,
-		0xd604,
-		0x43df,
-		{ 0x87, 0x4a, 0x5c, 0x86, 0x76, 0xc9, 0xc2, 0xb8 }
-	};
-
-	return g;
+	return guids::FilterBlockAll_Outbound_Ipv4;
 }
 
 //static
-const GUID &MullvadGuids::FilterBlockAll_Inbound_Ipv6()
+const GUID &MullvadGuids::FilterBlockAll_Inbound_Ipv4()
 {
-	static const GUID g =
-	{
-		0x18b8c1d2,
-		0x5910,
-		0x4b51,
-		{ 0xa5, 0x48, 0x1e, 0xfc, 0xd5, 0x4b, 0x63, 0xe9 }
-	};
-
-	return g;
+	return guids::FilterBlockAll_Inbound_Ipv4;
 }
 
-
 //static
-const GUID &MullvadGuids::FilterPermitLan_Outbound_Ipv4()
+const GUID &MullvadGuids::FilterBlockAll_Outbound_Ipv6()
 {
-	static const GUID g =
-	{
-		0xb012b076,
-		0x80d1,
-		0x4628,
-		{ 0x8d, 0x7b, 0xa5, 0x58, 0x8, 0xd8, 0xdc, 0xa4 }
-	};
-
-	return g;
+	return guids::FilterBlockAll_Outbound_Ipv6;
 }
 
 //static
-const GUID &MullvadGuids::FilterPermitLan_Outbound_Multicast_Ipv4()
+const GUID &MullvadGuids::FilterBlockAll_Inbound_Ipv6()
 {
-	static const GUID g =
-	{
-		0xea5e136b,
-		0xd951,
-		0x4263,
-		{ 0x99, 0xd8, 0x85, 0xc3, 0xf6, 0x4b, 0xda, 0xe9 }
-	};
-
-	return g;
+	return guids::FilterBlockAll_Inbound_Ipv6;
 }
 
 //static
-const GUID &MullvadGuids::FilterPermitLan_Outbound_Ipv6()
+const GUID &MullvadGuids::FilterPermitLan_Outbound_Ipv4()
 {
-	static const GUID g =
-	{
-		0xacb22069,
-		0xed33,
-		0x4c6d,
-		{ 0x9b, 0xc8, 0xcd, 0xfa, 0x6a, 0x1a, 0x10, 0x35 }
-	};
-
-	return g;
+	return guids::FilterPermitLan_Outbound_Ipv4;
 }
 
 //static
-const GUID &MullvadGuids::FilterPermitLan_Outbound_Multicast_Ipv6()
+const GUID &MullvadGuids::FilterPermitLan_Outbound_Ipv6()
 {
-	static const GUID g =
-	{
-		0xb63d89ec,
-		0xe145,
-		0x4e29,
-		{ 0x90, 0x87, 0xa7, 0x9b, 0xd6, 0xfc, 0x8b, 0x29 }
-	};
-
-	return g;
+	return guids::FilterPermitLan_Outbound_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitLanService_Inbound_Ipv4()
 {
-	static const GUID g =
-	{
-		0x5849930,
-		0x40ae,
-		0x41e4,
-		{ 0x81, 0x68, 0x21, 0x94, 0x89, 0x8e, 0x6f, 0x8c }
-	};
-
-	return g;
+	return guids::FilterPermitLanService_Inbound_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitLanService_Inbound_Ipv6()
 {
-	static const GUID g =
-	{
-		0xe8122820,
-		0xe138,
-		0x46b0,
-		{ 0x96, 0x6f, 0x68, 0xa0, 0x6, 0xa2, 0xb5, 0xa2 }
-	};
-
-	return g;
+	return guids::FilterPermitLanService_Inbound_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitLoopback_Outbound_Ipv4()
 {
-	static const GUID g =
-	{
-		0xd9ff592d,
-		0xbe46,
-		0x49fb,
-		{ 0x97, 0xec, 0x71, 0x1, 0x3c, 0x12, 0xb8, 0x30 }
-	};
-
-	return g;
+	return guids::FilterPermitLoopback_Outbound_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitLoopback_Inbound_Ipv4()
 {
-	static const GUID g =
-	{
-		0xb8efb500,
-		0xc51,
-		0x4550,
-		{ 0xbf, 0x5c, 0x48, 0x54, 0xa6, 0xc8, 0x48, 0xb9 }
-	};
-
-	return g;
+	return guids::FilterPermitLoopback_Inbound_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitLoopback_Outbound_Ipv6()
 {
-	static const GUID g =
-	{
-		0x764d4944,
-		0x8a1e,
-		0x4d96,
-		{ 0xbf, 0xf0, 0x8d, 0xa6, 0x4f, 0x31, 0x44, 0xa2 }
-	};
-
-	return g;
+	return guids::FilterPermitLoopback_Outbound_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitLoopback_Inbound_Ipv6()
 {
-	static const GUID g =
-	{
-		0xbad325b0,
-		0x736c,
-		0x4e67,
-		{ 0x8b, 0x37, 0x62, 0xb2, 0xdb, 0xe7, 0xd6, 0xeb }
-	};
-
-	return g;
+	return guids::FilterPermitLoopback_Inbound_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitDhcp_Outbound_Request_Ipv4()
 {
-	static const GUID g =
-	{
-		0x6cf1687b,
-		0x35e9,
-		0x4d18,
-		{ 0xa2, 0x3, 0xb2, 0x6b, 0x71, 0xa9, 0x5f, 0x8d }
-	};
-
-	return g;
+	return guids::FilterPermitDhcp_Outbound_Request_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitDhcp_Inbound_Response_Ipv4()
 {
-	static const GUID g =
-	{
-		0x2db298d7,
-		0x4108,
-		0x47ff,
-		{ 0x85, 0x99, 0xaf, 0xa5, 0xcb, 0x95, 0x9c, 0x25 }
-	};
-
-	return g;
+	return guids::FilterPermitDhcp_Inbound_Response_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitDhcp_Outbound_Request_Ipv6()
 {
-	static const GUID g =
-	{
-		0x67bd69b0,
-		0x522d,
-		0x4631,
-		{ 0x9a, 0x8f, 0x1c, 0xee, 0xdf, 0x64, 0xb7, 0x2b }
-	};
-
-	return g;
+	return guids::FilterPermitDhcp_Outbound_Request_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitDhcp_Inbound_Response_Ipv6()
 {
-	static const GUID g =
-	{
-		0x40dcfb6d,
-		0x2ee,
-		0x4531,
-		{ 0x86, 0x61, 0xc4, 0xc8, 0xa4, 0x3a, 0xf4, 0x23 }
-	};
-
-	return g;
+	return guids::FilterPermitDhcp_Inbound_Response_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitDhcpServer_Inbound_Request_Ipv4()
 {
-	static const GUID g =
-	{
-		0xa6c98ac3,
-		0xe06,
-		0x4fd2,
-		{ 0xb4, 0x5e, 0xb7, 0xef, 0x67, 0x4, 0x43, 0xbc }
-	};
-
-	return g;
+	return guids::FilterPermitDhcpServer_Inbound_Request_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitDhcpServer_Outbound_Response_Ipv4()
 {
-	static const GUID g =
-	{
-		0x57006c23,
-		0xc21f,
-		0x4d23,
-		{ 0x88, 0xf, 0x5a, 0x9d, 0x94, 0x6b, 0xc2, 0xf3 }
-	};
+	return guids::FilterPermitDhcpServer_Outbound_Response_Ipv4;
+}
+
+//static
+const GUID &MullvadGuids::FilterPermitVpnRelay_Ipv4()
+{
+	return guids::FilterPermitVpnRelay_Ipv4;
+}
 
-	return g;
+//static
+const GUID &MullvadGuids::FilterPermitVpnRelay_Ipv6()
+{
+	return guids::FilterPermitVpnRelay_Ipv6;
 }
 
 //static
-const GUID &MullvadGuids::FilterPermitVpnRelay()
+const GUID &MullvadGuids::FilterPermitVpnRelay_Ipv4(size_t group)
 {
-	static const GUID g =
+	static const GUID *keys[MaxVpnRelayGroups] =
 	{
-		0x160c205d,
-		0xdb40,
-		0x4f79,
-		{ 0x90, 0x6d, 0xfd, 0xa1, 0xe1, 0xc1, 0x8a, 0x70 }
+		&guids::FilterPermitVpnRelay_Ipv4,
+		&guids::FilterPermitVpnRelay_Ipv4_1,
+		&guids::FilterPermitVpnRelay_Ipv4_2,
+		&guids::FilterPermitVpnRelay_Ipv4_3,
 	};
 
-	return g;
+	if (group >= MaxVpnRelayGroups)
+	{
+		THROW_ERROR("Relay filter group out of range");
+	}
+
+	return *keys[group];
 }
 
 //static
-const GUID &MullvadGuids::FilterPermitVpnTunnel_Outbound_Ipv4()
+const GUID &MullvadGuids::FilterPermitVpnRelay_Ipv6(size_t group)
 {
-	static const GUID g =
+	static const GUID *keys[MaxVpnRelayGroups] =
 	{
-		0xdfdcbb76,
-		0x2284,
-		0x4b03,
-		{ 0x93, 0x4e, 0x93, 0xe5, 0xd3, 0x84, 0x8c, 0xf1 }
+		&guids::FilterPermitVpnRelay_Ipv6,
+		&guids::FilterPermitVpnRelay_Ipv6_1,
+		&guids::FilterPermitVpnRelay_Ipv6_2,
+		&guids::FilterPermitVpnRelay_Ipv6_3,
 	};
 
-	return g;
+	if (group >= MaxVpnRelayGroups)
+	{
+		THROW_ERROR("Relay filter group out of range");
+	}
+
+	return *keys[group];
 }
 
 //static
-const GUID &MullvadGuids::FilterPermitVpnTunnel_Outbound_Ipv6()
+const GUID &MullvadGuids::FilterPermitVpnTunnel_Outbound_Ipv4()
 {
-	static const GUID g =
-	{
-		0x9b1fa7d,
-		0x843b,
-		0x4946,
-		{ 0xa6, 0x2, 0x90, 0x4, 0x26, 0x2a, 0xb8, 0x6b }
-	};
+	return guids::FilterPermitVpnTunnel_Outbound_Ipv4;
+}
 
-	return g;
+//static
+const GUID &MullvadGuids::FilterPermitVpnTunnel_Outbound_Ipv6()
+{
+	return guids::FilterPermitVpnTunnel_Outbound_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitTunnelDns_Ipv4()
 {
-	static const GUID g =
-	{
-		0x60474363,
-		0x42b7,
-		0x44ad,
-		{ 0xa6, 0xdb, 0x9c, 0x4a, 0x4d, 0x3c, 0xde, 0x4a }
-	};
-
-	return g;
+	return guids::FilterPermitTunnelDns_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitTunnelDns_Ipv6()
 {
-	static const GUID g =
-	{
-		0xa832ce1d,
-		0xa250,
-		0x42be,
-		{ 0x8b, 0x97, 0x2, 0xb7, 0x9f, 0x9c, 0x5e, 0x1 }
-	};
-
-	return g;
+	return guids::FilterPermitTunnelDns_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitVpnTunnelService_Ipv4()
 {
-	static const GUID g =
-	{
-		0xf11a9ab4,
-		0x3dd6,
-		0x4cd9,
-		{ 0x9d, 0x95, 0xb0, 0x36, 0x22, 0x71, 0x6b, 0x3d }
-	};
-
-	return g;
+	return guids::FilterPermitVpnTunnelService_Ipv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitVpnTunnelService_Ipv6()
 {
-	static const GUID g =
-	{
-		0xe902e448,
-		0x1845,
-		0x42e5,
-		{ 0xad, 0xf3, 0x33, 0xb2, 0x7a, 0xd, 0x5d, 0x38 }
-	};
-
-	return g;
+	return guids::FilterPermitVpnTunnelService_Ipv6;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitNdp_Outbound_Router_Solicitation()
 {
-	static const GUID g =
-	{
-		0xbc5a85e4,
-		0x5319,
-		0x4224,
-		{ 0x8a, 0x27, 0x53, 0xeb, 0x61, 0xef, 0x3b, 0x1 }
-	};
-
-	return g;
+	return guids::FilterPermitNdp_Outbound_Router_Solicitation;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitNdp_Inbound_Router_Advertisement()
 {
-	static const GUID g =
-	{
-		0x4d996f1d,
-		0x4915,
-		0x4a6a,
-		{ 0xbd, 0xf5, 0xb5, 0x1a, 0x2d, 0xbc, 0xb8, 0xe9 }
-	};
-
-	return g;
+	return guids::FilterPermitNdp_Inbound_Router_Advertisement;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitNdp_Inbound_Redirect()
 {
-	static const GUID g =
-	{
-		0xcec23a8,
-		0x4fdd,
-		0x4a96,
-		{ 0xae, 0xba, 0x33, 0xd2, 0xa7, 0xf, 0x85, 0x22 }
-	};
-
-	return g;
+	return guids::FilterPermitNdp_Inbound_Redirect;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitPing_Outbound_Icmpv4()
 {
-	static const GUID g =
-	{
-		0x2ecf7ff7,
-		0xc951,
-		0x4056,
-		{ 0xb0, 0xf7, 0x40, 0xa4, 0x5c, 0x7e, 0xb4, 0xc2 }
-	};
-
-	return g;
+	return guids::FilterPermitPing_Outbound_Icmpv4;
 }
 
 //static
 const GUID &MullvadGuids::FilterPermitPing_Outbound_Icmpv6()
 {
-	static const GUID g =
-	{
-		0x3deb8cab,
-		0x1edb,
-		0x4aa1,
-		{ 0xb2, 0x73, 0xec, 0x61, 0x4f, 0x50, 0xdc, 0x13 }
-	};
+	return guids::FilterPermitPing_Outbound_Icmpv6;
+}
+
+//static
+const GUID &MullvadGuids::FilterPermitExcludedApps_Outbound_Ipv4()
+{
+	return guids::FilterPermitExcludedApps_Outbound_Ipv4;
+}
 
-	return g;
+//static
+const GUID &MullvadGuids::FilterPermitExcludedApps_Inbound_Ipv4()
+{
+	return guids::FilterPermitExcludedApps_Inbound_Ipv4;
+}
+
+//static
+const GUID &MullvadGuids::FilterPermitExcludedApps_Outbound_Ipv6()
+{
+	return guids::FilterPermitExcludedApps_Outbound_Ipv6;
+}
+
+//static
+const GUID &MullvadGuids::FilterPermitExcludedApps_Inbound_Ipv6()
+{
+	return guids::FilterPermitExcludedApps_Inbound_Ipv6;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentBlockAll_Outbound_Ipv4()
+{
+	return guids::FilterPersistentBlockAll_Outbound_Ipv4;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentBlockAll_Inbound_Ipv4()
+{
+	return guids::FilterPersistentBlockAll_Inbound_Ipv4;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentBlockAll_Outbound_Ipv6()
+{
+	return guids::FilterPersistentBlockAll_Outbound_Ipv6;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentBlockAll_Inbound_Ipv6()
+{
+	return guids::FilterPersistentBlockAll_Inbound_Ipv6;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentPermitLoopback_Outbound_Ipv4()
+{
+	return guids::FilterPersistentPermitLoopback_Outbound_Ipv4;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentPermitLoopback_Inbound_Ipv4()
+{
+	return guids::FilterPersistentPermitLoopback_Inbound_Ipv4;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentPermitLoopback_Outbound_Ipv6()
+{
+	return guids::FilterPersistentPermitLoopback_Outbound_Ipv6;
+}
+
+//static
+const GUID &MullvadGuids::FilterPersistentPermitLoopback_Inbound_Ipv6()
+{
+	return guids::FilterPersistentPermitLoopback_Inbound_Ipv6;
 }
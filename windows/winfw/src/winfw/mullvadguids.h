@@ -1,39 +1,83 @@
 #pragma once
 
 #include "wfpobjecttype.h"
-#include "guidhash.h"
 #include <guiddef.h>
-#include <unordered_set>
-#include <map>
+#include <utility>
 
-using WfpObjectRegistry = std::unordered_set<GUID>;
-using DetailedWfpObjectRegistry = std::multimap<WfpObjectType, GUID>;
+struct WfpObjectRecord
+{
+	WfpObjectType type;
+	GUID key;
+};
 
-class MullvadGuids
+//
+// Immutable table of all objects, sorted on type and key.
+// The table is built at compile time and can be shared without locking.
+//
+// 'byKey' holds the same records sorted on key alone, for lookups by key.
+//
+class WfpObjectRegistry
 {
-	static WfpObjectRegistry BuildRegistry();
-	static DetailedWfpObjectRegistry BuildDetailedRegistry();
+public:
+
+	using const_iterator = const WfpObjectRecord *;
+	using Range = std::pair<const_iterator, const_iterator>;
+
+	constexpr WfpObjectRegistry(const_iterator begin, const_iterator end, const_iterator byKey)
+		: m_begin(begin)
+		, m_end(end)
+		, m_byKey(byKey)
+	{
+	}
+
+	const_iterator begin() const
+	{
+		return m_begin;
+	}
+
+	const_iterator end() const
+	{
+		return m_end;
+	}
+
+	Range equal_range(WfpObjectType type) const;
+
+	bool contains(const GUID &key) const;
+
+private:
 
+	const_iterator m_begin;
+	const_iterator m_end;
+	const_iterator m_byKey;
+};
+
+class MullvadGuids
+{
 public:
 
 	static const WfpObjectRegistry &Registry();
-	static const DetailedWfpObjectRegistry &DetailedRegistry();
 
 	MullvadGuids() = delete;
 
+	//
+	// Key of filters that are added without a key. Never registered.
+	//
+	static const GUID &NullKey();
+
 	static const GUID &Provider();
 	static const GUID &SublayerWhitelist();
 	static const GUID &SublayerBlacklist();
 
+	static const GUID &ProviderPersistent();
+	static const GUID &SublayerPersistent();
+
 	static const GUID &FilterBlockAll_Outbound_Ipv4();
 	static const GUID &FilterBlockAll_Inbound_Ipv4();
 	static const GUID &FilterBlockAll_Outbound_Ipv6();
 	static const GUID &FilterBlockAll_Inbound_Ipv6();
 
 	static const GUID &FilterPermitLan_Outbound_Ipv4();
-	static const GUID &FilterPermitLan_Outbound_Multicast_Ipv4();
 	static const GUID &FilterPermitLan_Outbound_Ipv6();
-	static const GUID &FilterPermitLan_Outbound_Multicast_Ipv6();
 
 	static const GUID &FilterPermitLanService_Inbound_Ipv4();
 	static const GUID &FilterPermitLanService_Inbound_Ipv6();
@@ -51,7 +95,17 @@ public:
 	static const GUID &FilterPermitDhcpServer_Inbound_Request_Ipv4();
 	static const GUID &FilterPermitDhcpServer_Outbound_Response_Ipv4();
 
-	static const GUID &FilterPermitVpnRelay();
+	static const GUID &FilterPermitVpnRelay_Ipv4();
+	static const GUID &FilterPermitVpnRelay_Ipv6();
+
+	//
+	// Relays are permitted by a filter per port and protocol, with a key per filter.
+	// Group 0 is the same key as above.
+	//
+	static constexpr size_t MaxVpnRelayGroups = 4;
+
+	static const GUID &FilterPermitVpnRelay_Ipv4(size_t group);
+	static const GUID &FilterPermitVpnRelay_Ipv6(size_t group);
 
 	static const GUID &FilterPermitVpnTunnel_Outbound_Ipv4();
 	static const GUID &FilterPermitVpnTunnel_Outbound_Ipv6();
@@ -68,4 +122,19 @@ public:
 
 	static const GUID &FilterPermitPing_Outbound_Icmpv4();
 	static const GUID &FilterPermitPing_Outbound_Icmpv6();
+
+	static const GUID &FilterPermitExcludedApps_Outbound_Ipv4();
+	static const GUID &FilterPermitExcludedApps_Inbound_Ipv4();
+	static const GUID &FilterPermitExcludedApps_Outbound_Ipv6();
+	static const GUID &FilterPermitExcludedApps_Inbound_Ipv6();
+
+	static const GUID &FilterPersistentBlockAll_Outbound_Ipv4();
+	static const GUID &FilterPersistentBlockAll_Inbound_Ipv4();
+	static const GUID &FilterPersistentBlockAll_Outbound_Ipv6();
+	static const GUID &FilterPersistentBlockAll_Inbound_Ipv6();
+
+	static const GUID &FilterPersistentPermitLoopback_Outbound_Ipv4();
+	static const GUID &FilterPersistentPermitLoopback_Inbound_Ipv4();
+	static const GUID &FilterPersistentPermitLoopback_Outbound_Ipv6();
+	static const GUID &FilterPersistentPermitLoopback_Inbound_Ipv6();
 };
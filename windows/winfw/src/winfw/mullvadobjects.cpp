@@ -44,3 +44,33 @@ std::unique_ptr<wfp::SublayerBuilder> MullvadObjects::SublayerBlacklist()
 
 	return builder;
 }
+
+//static
+std::unique_ptr<wfp::ProviderBuilder> MullvadObjects::ProviderPersistent()
+{
+	auto builder = std::make_unique<wfp::ProviderBuilder>();
+
+	(*builder)
+		.name(L"Mullvad VPN persistent")
+		.description(L"Mullvad VPN firewall integration")
+		.persistent()
+		.key(MullvadGuids::ProviderPersistent());
+
+	return builder;
+}
+
+//static
+std::unique_ptr<wfp::SublayerBuilder> MullvadObjects::SublayerPersistent()
+{
+	auto builder = std::make_unique<wfp::SublayerBuilder>();
+
+	(*builder)
+		.name(L"Mullvad VPN persistent")
+		.description(L"Filters that block traffic while Mullvad VPN is not running")
+		.key(MullvadGuids::SublayerPersistent())
+		.provider(MullvadGuids::ProviderPersistent())
+		.persistent()
+		.weight(MAXUINT16 - 2);
+
+	return builder;
+}
@@ -15,4 +15,10 @@ public:
 	static std::unique_ptr<wfp::ProviderBuilder> Provider();
 	static std::unique_ptr<wfp::SublayerBuilder> SublayerWhitelist();
 	static std::unique_ptr<wfp::SublayerBuilder> SublayerBlacklist();
+
+	//
+	// Objects that remain installed across reboots.
+	//
+	static std::unique_ptr<wfp::ProviderBuilder> ProviderPersistent();
+	static std::unique_ptr<wfp::SublayerBuilder> SublayerPersistent();
 };
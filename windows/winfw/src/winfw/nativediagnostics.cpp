@@ -0,0 +1,71 @@
+#include "stdafx.h"
+#include "nativediagnostics.h"
+#include "mullvadguids.h"
+#include "libwfp/objectenumerator.h"
+
+namespace
+{
+
+bool OwnedByMullvad(const GUID *providerKey)
+{
+	return nullptr != providerKey
+		&& (MullvadGuids::Provider() == *providerKey || MullvadGuids::ProviderPersistent() == *providerKey);
+}
+
+uint64_t EffectiveWeight(const FWP_VALUE0 &weight)
+{
+	switch (weight.type)
+	{
+		case FWP_UINT8: return weight.uint8;
+		case FWP_UINT64: return (nullptr == weight.uint64 ? 0 : *weight.uint64);
+		default: return 0;
+	}
+}
+
+} // anonymous namespace
+
+//static
+void NativeDiagnostics::Collect(shared::diagnostics::BlobWriter &writer,
+	const std::optional<FwContext::PolicyTiming> &lastPolicy, wfp::FilterEngine &engine)
+{
+	using Record = shared::diagnostics::BlobWriter::Record;
+
+	if (lastPolicy.has_value())
+	{
+		const auto &policy = lastPolicy.value();
+		const auto &transactions = policy.transactions;
+
+		writer.write(Record(MULLVAD_DIAGNOSTICS_SECTION_FIREWALL_POLICY)
+			.s(policy.key)
+			.u(policy.success ? 1 : 0)
+			.u(policy.totalUs)
+			.u(policy.prepareUs)
+			.u(policy.numTransactions)
+			.u(transactions.lockWaitUs)
+			.u(transactions.lockAttempts)
+			.u(transactions.addUs)
+			.u(transactions.purgeUs)
+			.u(transactions.commitUs)
+			.u(transactions.objectsAdded)
+			.u(transactions.objectsRemoved));
+	}
+
+	writer.writeCounters();
+
+	wfp::ObjectEnumerator::Filters(engine, [&writer](const FWPM_FILTER0 &filter)
+	{
+		if (OwnedByMullvad(filter.providerKey))
+		{
+			writer.write(Record(MULLVAD_DIAGNOSTICS_SECTION_FIREWALL_FILTER)
+				.u(filter.filterId)
+				.g(filter.layerKey)
+				.g(filter.subLayerKey)
+				.u(filter.action.type)
+				.u(EffectiveWeight(filter.effectiveWeight))
+				.u(filter.numFilterConditions)
+				.u(filter.flags));
+		}
+
+		return true;
+	});
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "fwcontext.h"
+#include "libwfp/filterengine.h"
+#include <libshared/diagnostics/blobwriter.h>
+
+//
+// Firewall state for problem reports. See WinFw_CollectNativeDiagnostics().
+//
+class NativeDiagnostics
+{
+public:
+
+	NativeDiagnostics() = delete;
+
+	//
+	// Write the most recent policy application, if any, the performance counters,
+	// and every filter owned by Mullvad, in that order. Filters are written while
+	// they are enumerated, so there's only a single pass over the filters in BFE.
+	//
+	static void Collect(shared::diagnostics::BlobWriter &writer,
+		const std::optional<FwContext::PolicyTiming> &lastPolicy, wfp::FilterEngine &engine);
+};
@@ -1,11 +1,16 @@
 #include "stdafx.h"
 #include "objectpurger.h"
 #include "mullvadguids.h"
+#include "persistentblock.h"
+#include "sessionpool.h"
 #include "wfpobjecttype.h"
 #include "libwfp/filterengine.h"
 #include "libwfp/objectdeleter.h"
+#include "libwfp/objectenumerator.h"
+#include "libwfp/objectexplorer.h"
 #include "libwfp/transaction.h"
 #include <algorithm>
+#include <vector>
 
 namespace
 {
@@ -17,11 +22,16 @@ void RemoveRange(wfp::FilterEngine &engine, ObjectDeleter deleter, TRange range)
 {
 	std::for_each(range.first, range.second, [&](const auto &record)
 	{
-		const GUID &objectId = record.second;
+		const GUID &objectId = record.key;
 		deleter(engine, objectId);
 	});
 }
 
+bool OwnedByMullvad(const GUID *providerKey)
+{
+	return nullptr != providerKey && MullvadGuids::Provider() == *providerKey;
+}
+
 } // anonymous namespace
 
 //static
@@ -29,7 +39,7 @@ ObjectPurger::RemovalFunctor ObjectPurger::GetRemoveFiltersFunctor()
 {
 	return [](wfp::FilterEngine &engine)
 	{
-		const auto registry = MullvadGuids::DetailedRegistry();
+		const auto &registry = MullvadGuids::Registry();
 
 		// Resolve correct overload.
 		void (*deleter)(wfp::FilterEngine &, const GUID &) = wfp::ObjectDeleter::DeleteFilter;
@@ -43,7 +53,7 @@ ObjectPurger::RemovalFunctor ObjectPurger::GetRemoveAllFunctor()
 {
 	return [](wfp::FilterEngine &engine)
 	{
-		const auto registry = MullvadGuids::DetailedRegistry();
+		const auto &registry = MullvadGuids::Registry();
 
 		// Resolve correct overload.
 		void(*deleter)(wfp::FilterEngine &, const GUID &) = wfp::ObjectDeleter::DeleteFilter;
@@ -55,9 +65,97 @@ ObjectPurger::RemovalFunctor ObjectPurger::GetRemoveAllFunctor()
 }
 
 //static
-bool ObjectPurger::Execute(RemovalFunctor f)
+ObjectPurger::RemovalFunctor ObjectPurger::GetRemoveInstalledFunctor()
+{
+	return [](wfp::FilterEngine &engine)
+	{
+		//
+		// Objects cannot be deleted while enumerating, so collect them first.
+		//
+
+		std::vector<UINT64> filters;
+
+		wfp::ObjectEnumerator::Filters(engine, [&](const FWPM_FILTER0 &filter)
+		{
+			if (OwnedByMullvad(filter.providerKey))
+			{
+				filters.push_back(filter.filterId);
+			}
+
+			return true;
+		});
+
+		std::vector<GUID> sublayers;
+
+		wfp::ObjectEnumerator::Sublayers(engine, [&](const FWPM_SUBLAYER0 &sublayer)
+		{
+			if (OwnedByMullvad(sublayer.providerKey))
+			{
+				sublayers.push_back(sublayer.subLayerKey);
+			}
+
+			return true;
+		});
+
+		// Resolve correct overload.
+		void(*deleter)(wfp::FilterEngine &, UINT64) = wfp::ObjectDeleter::DeleteFilter;
+
+		for (const auto filterId : filters)
+		{
+			deleter(engine, filterId);
+		}
+
+		for (const auto &sublayer : sublayers)
+		{
+			wfp::ObjectDeleter::DeleteSublayer(engine, sublayer);
+		}
+
+		const auto providerInstalled = wfp::ObjectExplorer::GetProvider(engine, MullvadGuids::Provider(), [](const FWPM_PROVIDER0 &)
+		{
+			return true;
+		});
+
+		if (providerInstalled)
+		{
+			wfp::ObjectDeleter::DeleteProvider(engine, MullvadGuids::Provider());
+		}
+	};
+}
+
+//static
+ObjectPurger::RemovalFunctor ObjectPurger::GetResetFunctor()
+{
+	return [](wfp::FilterEngine &engine)
+	{
+		auto installed = [&engine](const GUID &providerKey)
+		{
+			return wfp::ObjectExplorer::GetProvider(engine, providerKey, [](const FWPM_PROVIDER0 &)
+			{
+				return true;
+			});
+		};
+
+		//
+		// A provider cannot be deleted while it owns any objects,
+		// so objects cannot be left behind if it's not installed.
+		//
+
+		if (installed(MullvadGuids::Provider()))
+		{
+			GetRemoveInstalledFunctor()(engine);
+		}
+
+		if (installed(MullvadGuids::ProviderPersistent()))
+		{
+			PersistentBlock::Remove(engine);
+		}
+	};
+}
+
+//static
+bool ObjectPurger::Execute(RemovalFunctor f, uint32_t timeout)
 {
-	auto engine = wfp::FilterEngine::StandardSession();
+	SessionPool::Lease engine(timeout);
 
 	auto wrapper = [&]()
 	{
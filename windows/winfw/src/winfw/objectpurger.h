@@ -16,5 +16,20 @@ public:
 	static RemovalFunctor GetRemoveFiltersFunctor();
 	static RemovalFunctor GetRemoveAllFunctor();
 
-	static bool Execute(RemovalFunctor f);
+	//
+	// Remove only objects that are actually installed and owned by the Mullvad provider.
+	//
+	static RemovalFunctor GetRemoveInstalledFunctor();
+
+	//
+	// Remove installed objects that are owned by either Mullvad provider, including
+	// the persistent objects. Nothing is enumerated unless a provider is installed,
+	// which avoids deleting every registered object by key when nothing is left.
+	//
+	static RemovalFunctor GetResetFunctor();
+
+	//
+	// The session is taken from the session pool.
+	//
+	static bool Execute(RemovalFunctor f, uint32_t timeout);
 };
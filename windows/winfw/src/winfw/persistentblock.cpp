@@ -0,0 +1,179 @@
+#include "stdafx.h"
+#include "persistentblock.h"
+#include "mullvadguids.h"
+#include "mullvadobjects.h"
+#include "libwfp/filterbuilder.h"
+#include "libwfp/conditionbuilder.h"
+#include "libwfp/nullconditionbuilder.h"
+#include "libwfp/objectinstaller.h"
+#include "libwfp/objectdeleter.h"
+#include "libwfp/objectenumerator.h"
+#include "libwfp/objectexplorer.h"
+#include "libwfp/conditions/conditionloopback.h"
+#include <vector>
+
+using namespace wfp::conditions;
+
+namespace
+{
+
+struct LayerFilters
+{
+	const GUID &layer;
+	const GUID &blockKey;
+	const GUID &permitLoopbackKey;
+	const wchar_t *blockName;
+	const wchar_t *permitLoopbackName;
+};
+
+bool AddFilter(wfp::FilterEngine &engine, wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder)
+{
+	UINT64 id;
+
+	return wfp::ObjectInstaller::AddFilter(engine, filterBuilder, conditionBuilder, &id);
+}
+
+} // anonymous namespace
+
+//static
+bool PersistentBlock::Install(wfp::FilterEngine &engine)
+{
+	Remove(engine);
+
+	GUID key;
+
+	if (false == wfp::ObjectInstaller::AddProvider(engine, *MullvadObjects::ProviderPersistent(), &key)
+		|| false == wfp::ObjectInstaller::AddSublayer(engine, *MullvadObjects::SublayerPersistent(), &key))
+	{
+		return false;
+	}
+
+	const LayerFilters layers[] =
+	{
+		{
+			FWPM_LAYER_ALE_AUTH_CONNECT_V4,
+			MullvadGuids::FilterPersistentBlockAll_Outbound_Ipv4(),
+			MullvadGuids::FilterPersistentPermitLoopback_Outbound_Ipv4(),
+			L"Block all outbound connections (IPv4)",
+			L"Permit outbound on loopback (IPv4)"
+		},
+		{
+			FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4,
+			MullvadGuids::FilterPersistentBlockAll_Inbound_Ipv4(),
+			MullvadGuids::FilterPersistentPermitLoopback_Inbound_Ipv4(),
+			L"Block all inbound connections (IPv4)",
+			L"Permit inbound on loopback (IPv4)"
+		},
+		{
+			FWPM_LAYER_ALE_AUTH_CONNECT_V6,
+			MullvadGuids::FilterPersistentBlockAll_Outbound_Ipv6(),
+			MullvadGuids::FilterPersistentPermitLoopback_Outbound_Ipv6(),
+			L"Block all outbound connections (IPv6)",
+			L"Permit outbound on loopback (IPv6)"
+		},
+		{
+			FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6,
+			MullvadGuids::FilterPersistentBlockAll_Inbound_Ipv6(),
+			MullvadGuids::FilterPersistentPermitLoopback_Inbound_Ipv6(),
+			L"Block all inbound connections (IPv6)",
+			L"Permit inbound on loopback (IPv6)"
+		},
+	};
+
+	wfp::NullConditionBuilder nullConditionBuilder;
+
+	for (const auto &layer : layers)
+	{
+		wfp::FilterBuilder blockBuilder;
+
+		blockBuilder
+			.key(layer.blockKey)
+			.name(layer.blockName)
+			.description(L"This filter is part of a rule that blocks traffic while Mullvad VPN is not running")
+			.provider(MullvadGuids::ProviderPersistent())
+			.layer(layer.layer)
+			.sublayer(MullvadGuids::SublayerPersistent())
+			.weight(wfp::FilterBuilder::WeightClass::Min)
+			.persistent()
+			.block();
+
+		if (false == AddFilter(engine, blockBuilder, nullConditionBuilder))
+		{
+			return false;
+		}
+
+		wfp::FilterBuilder permitBuilder;
+
+		permitBuilder
+			.key(layer.permitLoopbackKey)
+			.name(layer.permitLoopbackName)
+			.description(L"This filter is part of a rule that blocks traffic while Mullvad VPN is not running")
+			.provider(MullvadGuids::ProviderPersistent())
+			.layer(layer.layer)
+			.sublayer(MullvadGuids::SublayerPersistent())
+			.weight(wfp::FilterBuilder::WeightClass::Max)
+			.persistent()
+			.permit();
+
+		wfp::ConditionBuilder conditionBuilder(layer.layer);
+
+		conditionBuilder.add_condition(std::make_unique<ConditionLoopback>());
+
+		if (false == AddFilter(engine, permitBuilder, conditionBuilder))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//static
+void PersistentBlock::Remove(wfp::FilterEngine &engine)
+{
+	const auto providerInstalled = wfp::ObjectExplorer::GetProvider(engine, MullvadGuids::ProviderPersistent(), [](const FWPM_PROVIDER0 &)
+	{
+		return true;
+	});
+
+	if (false == providerInstalled)
+	{
+		return;
+	}
+
+	//
+	// Objects cannot be deleted while enumerating, so collect them first.
+	//
+
+	std::vector<UINT64> filters;
+
+	wfp::ObjectEnumerator::Filters(engine, [&](const FWPM_FILTER0 &filter)
+	{
+		if (nullptr != filter.providerKey && MullvadGuids::ProviderPersistent() == *filter.providerKey)
+		{
+			filters.push_back(filter.filterId);
+		}
+
+		return true;
+	});
+
+	// Resolve correct overload.
+	void(*deleter)(wfp::FilterEngine &, UINT64) = wfp::ObjectDeleter::DeleteFilter;
+
+	for (const auto filterId : filters)
+	{
+		deleter(engine, filterId);
+	}
+
+	const auto sublayerInstalled = wfp::ObjectExplorer::GetSublayer(engine, MullvadGuids::SublayerPersistent(), [](const FWPM_SUBLAYER0 &)
+	{
+		return true;
+	});
+
+	if (sublayerInstalled)
+	{
+		wfp::ObjectDeleter::DeleteSublayer(engine, MullvadGuids::SublayerPersistent());
+	}
+
+	wfp::ObjectDeleter::DeleteProvider(engine, MullvadGuids::ProviderPersistent());
+}
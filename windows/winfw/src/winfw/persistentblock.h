@@ -0,0 +1,31 @@
+#pragma once
+
+#include "libwfp/filterengine.h"
+
+//
+// Filters that block all non-loopback traffic and that remain in effect
+// after the process exits and across reboots.
+//
+// These are installed when the daemon exits in a blocking state. BFE then
+// enforces them from the time it starts, until the daemon takes over.
+//
+// The objects are not tracked by a session controller, since they must
+// outlive it.
+//
+class PersistentBlock
+{
+public:
+
+	PersistentBlock() = delete;
+
+	//
+	// Use only inside active transaction.
+	//
+	static bool Install(wfp::FilterEngine &engine);
+
+	//
+	// Remove the persistent objects, if installed.
+	// Use only inside active transaction.
+	//
+	static void Remove(wfp::FilterEngine &engine);
+};
@@ -0,0 +1,84 @@
+#include "stdafx.h"
+#include "policyrecorder.h"
+#include <libcommon/error.h>
+
+using namespace policyrecording;
+
+PolicyRecorder::PolicyRecorder(const std::wstring &path)
+	: m_origin(std::chrono::steady_clock::now())
+{
+	m_file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (INVALID_HANDLE_VALUE == m_file)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Create policy recording");
+	}
+
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+
+	FileHeader header = { 0 };
+
+	header.magic = FILE_MAGIC;
+	header.version = FILE_VERSION;
+	header.startTime = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+
+	try
+	{
+		write(&header, sizeof(header));
+	}
+	catch (...)
+	{
+		CloseHandle(m_file);
+		throw;
+	}
+}
+
+PolicyRecorder::~PolicyRecorder()
+{
+	CloseHandle(m_file);
+}
+
+void PolicyRecorder::record(Call call, uint8_t flags, const Writer &arguments,
+	std::chrono::steady_clock::time_point start, std::chrono::steady_clock::duration duration)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	RecordHeader header = { };
+
+	header.call = call;
+	header.flags = flags;
+	header.offsetUs = static_cast<uint64_t>(duration_cast<microseconds>(start - m_origin).count());
+	header.durationUs = static_cast<uint64_t>(duration_cast<microseconds>(duration).count());
+	header.argumentsSize = static_cast<uint32_t>(arguments.data().size());
+
+	//
+	// Write the record in a single call, so a failure cannot leave half a record behind.
+	//
+
+	std::vector<uint8_t> record(sizeof(header) + arguments.data().size());
+
+	std::memcpy(&record[0], &header, sizeof(header));
+
+	if (false == arguments.data().empty())
+	{
+		std::memcpy(&record[sizeof(header)], arguments.data().data(), arguments.data().size());
+	}
+
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	write(record.data(), record.size());
+}
+
+void PolicyRecorder::write(const void *data, size_t size)
+{
+	DWORD written;
+
+	if (FALSE == WriteFile(m_file, data, static_cast<DWORD>(size), &written, nullptr)
+		|| written != size)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Write policy recording");
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "policyrecording.h"
+#include <windows.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+//
+// Appends recorded WinFw_* calls to a file, in the format described in policyrecording.h.
+//
+// The file is truncated when the recorder is created. Records are written as they
+// are completed, so a recording is usable up to the last complete record even if
+// the process terminates unexpectedly.
+//
+class PolicyRecorder
+{
+public:
+
+	explicit PolicyRecorder(const std::wstring &path);
+	~PolicyRecorder();
+
+	PolicyRecorder(const PolicyRecorder &) = delete;
+	PolicyRecorder &operator=(const PolicyRecorder &) = delete;
+
+	void record(policyrecording::Call call, uint8_t flags, const policyrecording::Writer &arguments,
+		std::chrono::steady_clock::time_point start, std::chrono::steady_clock::duration duration);
+
+private:
+
+	void write(const void *data, size_t size);
+
+	HANDLE m_file;
+	std::chrono::steady_clock::time_point m_origin;
+
+	std::mutex m_lock;
+};
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "winfw.h"
+#include <libcommon/error.h>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+//
+// File format for recorded WinFw_* calls.
+//
+// The file starts with a FileHeader, followed by one record per call. Each record
+// is a RecordHeader, followed by 'argumentsSize' bytes of arguments encoded by
+// Writer. All values are little endian, and strings are UTF-16.
+//
+// This is shared with tools that replay recordings, so it only depends on the
+// public API.
+//
+namespace policyrecording
+{
+
+constexpr uint32_t FILE_MAGIC = 0x5250564d; // "MVPR"
+constexpr uint16_t FILE_VERSION = 1;
+
+enum class Call : uint8_t
+{
+	// timeout
+	Initialize = 0,
+
+	// timeout, settings
+	InitializeBlocked = 1,
+
+	// (none)
+	Deinitialize = 2,
+
+	// cleanupPolicy
+	DeinitializeWithCleanupPolicy = 3,
+
+	// settings, relays, pingableHosts
+	ApplyPolicyConnecting = 4,
+
+	// settings, relay, tunnelInterfaceAlias, v4DnsHost, v6DnsHost
+	ApplyPolicyConnected = 5,
+	StagePolicyConnected = 6,
+
+	// settings, endpoint, tunnelInterfaceAlias, dnsHosts
+	ApplyPolicyConnectedMultiDns = 7,
+	StagePolicyConnectedMultiDns = 8,
+
+	// settings
+	ApplyPolicyBlocked = 9,
+
+	// paths
+	SetExcludedApps = 10,
+
+	// (none)
+	Reset = 11,
+
+	// timeout
+	InitializeDeferred = 12,
+
+	// timeout
+	// The handover state is not recorded.
+	InitializeFromHandover = 13,
+
+	// timeout, settings
+	InitializeHybrid = 14,
+
+	// relay
+	ApplyPolicyRelaySwitch = 15,
+};
+
+enum RecordFlags : uint8_t
+{
+	RECORD_FLAG_SUCCESS = 1 << 0,
+
+	// Requested using one of the *Async functions, and applied on the worker thread.
+	RECORD_FLAG_ASYNCHRONOUS = 1 << 1,
+};
+
+#pragma pack(push, 1)
+
+struct FileHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+
+	// Wall clock time when recording started, as a FILETIME.
+	uint64_t startTime;
+};
+
+struct RecordHeader
+{
+	Call call;
+	uint8_t flags;
+	uint16_t reserved;
+
+	// Time from the start of the recording until the call was made.
+	uint64_t offsetUs;
+
+	uint64_t durationUs;
+	uint32_t argumentsSize;
+};
+
+#pragma pack(pop)
+
+constexpr uint32_t NULL_STRING = ~uint32_t(0);
+
+class Writer
+{
+public:
+
+	Writer &u8(uint8_t value)
+	{
+		m_data.push_back(value);
+		return *this;
+	}
+
+	Writer &u16(uint16_t value)
+	{
+		return raw(&value, sizeof(value));
+	}
+
+	Writer &u32(uint32_t value)
+	{
+		return raw(&value, sizeof(value));
+	}
+
+	Writer &string(const wchar_t *value)
+	{
+		if (nullptr == value)
+		{
+			return u32(NULL_STRING);
+		}
+
+		const auto length = wcslen(value);
+
+		u32(static_cast<uint32_t>(length));
+
+		return raw(value, length * sizeof(wchar_t));
+	}
+
+	Writer &settings(const WinFwSettings &value)
+	{
+		return u8(value.permitDhcp ? 1 : 0).u8(value.permitLan ? 1 : 0);
+	}
+
+	Writer &relay(const WinFwRelay &value)
+	{
+		return string(value.ip).u16(value.port).u8(value.protocol);
+	}
+
+	Writer &ip(const WinFwIp &value)
+	{
+		return u8(value.family).raw(value.bytes, sizeof(value.bytes));
+	}
+
+	Writer &endpoint(const WinFwEndpoint &value)
+	{
+		return ip(value.ip).u16(value.port).u8(value.protocol);
+	}
+
+	Writer &pingableHosts(const PingableHosts *value)
+	{
+		if (nullptr == value)
+		{
+			return u8(0);
+		}
+
+		u8(1).string(value->tunnelInterfaceAlias).u32(static_cast<uint32_t>(value->numHosts));
+
+		for (size_t i = 0; i < value->numHosts; ++i)
+		{
+			string(value->hosts[i]);
+		}
+
+		return *this;
+	}
+
+	const std::vector<uint8_t> &data() const
+	{
+		return m_data;
+	}
+
+private:
+
+	Writer &raw(const void *data, size_t size)
+	{
+		const auto bytes = reinterpret_cast<const uint8_t *>(data);
+		m_data.insert(m_data.end(), bytes, bytes + size);
+
+		return *this;
+	}
+
+	std::vector<uint8_t> m_data;
+};
+
+//
+// Decodes the arguments written by Writer.
+// Throws if the arguments are truncated.
+//
+class Reader
+{
+public:
+
+	Reader(const uint8_t *data, size_t size)
+		: m_data(data)
+		, m_size(size)
+		, m_offset(0)
+	{
+	}
+
+	uint8_t u8()
+	{
+		uint8_t value;
+		raw(&value, sizeof(value));
+
+		return value;
+	}
+
+	uint16_t u16()
+	{
+		uint16_t value;
+		raw(&value, sizeof(value));
+
+		return value;
+	}
+
+	uint32_t u32()
+	{
+		uint32_t value;
+		raw(&value, sizeof(value));
+
+		return value;
+	}
+
+	std::optional<std::wstring> string()
+	{
+		const auto length = u32();
+
+		if (NULL_STRING == length)
+		{
+			return std::nullopt;
+		}
+
+		std::wstring value(length, L'\0');
+		raw(&value[0], length * sizeof(wchar_t));
+
+		return value;
+	}
+
+	WinFwSettings settings()
+	{
+		WinFwSettings value;
+
+		value.permitDhcp = (0 != u8());
+		value.permitLan = (0 != u8());
+
+		return value;
+	}
+
+	WinFwIp ip()
+	{
+		WinFwIp value;
+
+		value.family = static_cast<WinFwIpFamily>(u8());
+		raw(value.bytes, sizeof(value.bytes));
+
+		return value;
+	}
+
+	WinFwEndpoint endpoint()
+	{
+		WinFwEndpoint value;
+
+		value.ip = ip();
+		value.port = u16();
+		value.protocol = static_cast<WinFwProtocol>(u8());
+
+		return value;
+	}
+
+private:
+
+	void raw(void *data, size_t size)
+	{
+		if (size > m_size - m_offset)
+		{
+			THROW_ERROR("Recorded arguments are truncated");
+		}
+
+		std::memcpy(data, m_data + m_offset, size);
+		m_offset += size;
+	}
+
+	const uint8_t *m_data;
+	size_t m_size;
+	size_t m_offset;
+};
+
+}
@@ -0,0 +1,151 @@
+#include "stdafx.h"
+#include "policyworker.h"
+#include <utility>
+
+PolicyWorker::PolicyWorker()
+	: m_stop(false)
+{
+	m_thread = std::thread(&PolicyWorker::thread, this);
+}
+
+PolicyWorker::~PolicyWorker()
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_wakeup.notify_all();
+	m_thread.join();
+
+	cancel();
+}
+
+void PolicyWorker::enqueue(Task task, CompletionHandler completionHandler, Priority priority)
+{
+	PendingRequests superseded;
+
+	const auto level = static_cast<size_t>(priority);
+
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+
+		for (size_t i = 0; i <= level; ++i)
+		{
+			superseded[i].swap(m_pending[i]);
+		}
+
+		m_pending[level] = Request{ std::move(task), std::move(completionHandler) };
+	}
+
+	m_wakeup.notify_all();
+
+	Supersede(superseded);
+}
+
+void PolicyWorker::cancel()
+{
+	PendingRequests superseded;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+		superseded.swap(m_pending);
+	}
+
+	Supersede(superseded);
+}
+
+void PolicyWorker::thread()
+{
+	auto hasPending = [this]()
+	{
+		for (const auto &request : m_pending)
+		{
+			if (request.has_value())
+			{
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	for (;;)
+	{
+		std::optional<Request> request;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_activePriority.reset();
+
+			m_wakeup.wait(lock, [this, &hasPending]()
+			{
+				return m_stop || hasPending();
+			});
+
+			if (m_stop)
+			{
+				return;
+			}
+
+			for (size_t level = PRIORITY_LEVELS; level > 0; --level)
+			{
+				if (m_pending[level - 1].has_value())
+				{
+					request.swap(m_pending[level - 1]);
+					m_activePriority = static_cast<Priority>(level - 1);
+
+					break;
+				}
+			}
+		}
+
+		auto status = WINFW_POLICY_STATUS_GENERAL_FAILURE;
+
+		try
+		{
+			status = request->task([this]()
+			{
+				return preempted();
+			});
+		}
+		catch (...)
+		{
+		}
+
+		request->completionHandler(status);
+	}
+}
+
+bool PolicyWorker::preempted()
+{
+	std::scoped_lock<std::mutex> lock(m_mutex);
+
+	if (false == m_activePriority.has_value())
+	{
+		return false;
+	}
+
+	for (size_t level = static_cast<size_t>(m_activePriority.value()) + 1; level < PRIORITY_LEVELS; ++level)
+	{
+		if (m_pending[level].has_value())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//static
+void PolicyWorker::Supersede(PendingRequests &requests)
+{
+	for (auto &request : requests)
+	{
+		if (request.has_value())
+		{
+			request->completionHandler(WINFW_POLICY_STATUS_SUPERSEDED);
+		}
+	}
+}
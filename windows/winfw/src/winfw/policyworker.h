@@ -0,0 +1,92 @@
+#pragma once
+
+#include "winfw.h"
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+//
+// Applies policies on a dedicated thread.
+//
+// A single request is kept pending per priority level, and pending requests with
+// a higher priority are processed first. Enqueuing a request replaces every
+// pending request of the same or a lower priority, which are then completed
+// with WINFW_POLICY_STATUS_SUPERSEDED. Pending requests of a higher priority are
+// left in place, so the newest request is still the last one to be processed.
+//
+class PolicyWorker
+{
+public:
+
+	enum class Priority
+	{
+		//
+		// Used for work that can be dropped, and that should give way to any policy request.
+		// A task with this priority should check for preemption regularly.
+		//
+		Idle = 0,
+
+		Normal,
+
+		// Used for requests that restore a blocking policy.
+		High,
+	};
+
+	//
+	// Returns true if a request with a higher priority than the active one is pending.
+	// A task should check this before doing anything that cannot be interrupted,
+	// and return WINFW_POLICY_STATUS_SUPERSEDED if it gives way.
+	//
+	using PreemptionCheck = std::function<bool()>;
+
+	using Task = std::function<WINFW_POLICY_STATUS(const PreemptionCheck &)>;
+	using CompletionHandler = std::function<void(WINFW_POLICY_STATUS)>;
+
+	PolicyWorker();
+
+	// Completes any pending request as superseded and waits for the active request.
+	~PolicyWorker();
+
+	void enqueue(Task task, CompletionHandler completionHandler, Priority priority = Priority::Normal);
+
+	//
+	// Drop all pending requests.
+	// Used when a policy is applied synchronously, which makes queued requests obsolete.
+	//
+	void cancel();
+
+private:
+
+	PolicyWorker(const PolicyWorker &) = delete;
+	PolicyWorker &operator=(const PolicyWorker &) = delete;
+
+	void thread();
+
+	bool preempted();
+
+	struct Request
+	{
+		Task task;
+		CompletionHandler completionHandler;
+	};
+
+	static constexpr size_t PRIORITY_LEVELS = static_cast<size_t>(Priority::High) + 1;
+
+	using PendingRequests = std::array<std::optional<Request>, PRIORITY_LEVELS>;
+
+	static void Supersede(PendingRequests &requests);
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+
+	// Indexed by priority.
+	PendingRequests m_pending;
+
+	std::optional<Priority> m_activePriority;
+	bool m_stop;
+
+	std::thread m_thread;
+};
@@ -0,0 +1,63 @@
+#include "stdafx.h"
+#include "preparedfilters.h"
+#include "mullvadguids.h"
+#include <libcommon/error.h>
+
+namespace
+{
+
+void ValidateObject(const wfp::IIdentifiable &object)
+{
+	if (false == MullvadGuids::Registry().contains(object.id()))
+	{
+		THROW_ERROR("Attempting to install non-registered WFP object");
+	}
+}
+
+} // anonymous namespace
+
+bool PreparedFilters::addProvider(wfp::ProviderBuilder &)
+{
+	THROW_ERROR("Firewall rules cannot add providers");
+}
+
+bool PreparedFilters::addSublayer(wfp::SublayerBuilder &)
+{
+	THROW_ERROR("Firewall rules cannot add sublayers");
+}
+
+bool PreparedFilters::addFilter(wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder)
+{
+	ValidateObject(filterBuilder);
+
+	m_compiled.emplace_back(std::make_unique<CompiledFilter>(filterBuilder, conditionBuilder, m_conditionPool));
+	m_filters.push_back(m_compiled.back().get());
+
+	return true;
+}
+
+bool PreparedFilters::addFilter(const CompiledFilter &filter)
+{
+	ValidateObject(filter);
+
+	m_filters.push_back(&filter);
+
+	return true;
+}
+
+bool PreparedFilters::addFilters(const CompiledFilter *filters, size_t numFilters)
+{
+	for (size_t i = 0; i < numFilters; ++i)
+	{
+		ValidateObject(filters[i]);
+	}
+
+	m_filters.reserve(m_filters.size() + numFilters);
+
+	for (size_t i = 0; i < numFilters; ++i)
+	{
+		m_filters.push_back(&filters[i]);
+	}
+
+	return true;
+}
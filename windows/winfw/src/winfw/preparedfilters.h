@@ -0,0 +1,48 @@
+#pragma once
+
+#include "iobjectinstaller.h"
+#include "compiledfilter.h"
+#include "conditionpool.h"
+#include <memory>
+#include <vector>
+
+//
+// Filters collected from a set of rules ahead of a transaction.
+//
+// Rules are applied to this instance rather than to the session controller.
+// Every filter is validated and marshalled here, so the transaction only
+// has to add and delete objects in BFE.
+//
+// Filters of compiled rules are referenced rather than copied, so
+// the rules must outlive this instance.
+//
+class PreparedFilters : public IObjectInstaller
+{
+public:
+
+	PreparedFilters() = default;
+
+	bool addProvider(wfp::ProviderBuilder &providerBuilder) override;
+	bool addSublayer(wfp::SublayerBuilder &sublayerBuilder) override;
+	bool addFilter(wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder) override;
+	bool addFilter(const CompiledFilter &filter) override;
+	bool addFilters(const CompiledFilter *filters, size_t numFilters) override;
+
+	const std::vector<const CompiledFilter *> &filters() const
+	{
+		return m_filters;
+	}
+
+private:
+
+	PreparedFilters(const PreparedFilters &) = delete;
+	PreparedFilters &operator=(const PreparedFilters &) = delete;
+
+	std::vector<const CompiledFilter *> m_filters;
+
+	// Condition values shared by the filters compiled here.
+	std::shared_ptr<ConditionPool> m_conditionPool = std::make_shared<ConditionPool>();
+
+	// Filters compiled here, from rules that are not compiled.
+	std::vector<std::unique_ptr<CompiledFilter> > m_compiled;
+};
@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include "rulecache.h"
+#include "compiledfilter.h"
+#include "conditionpool.h"
+#include "rules/compiledrule.h"
+#include <libcommon/error.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+//
+// Relays (and therefore rule parameters) change over time.
+// Start over rather than accumulating rules indefinitely.
+//
+const size_t MAX_CACHED_RULES = 64;
+
+class FilterRecorder : public IObjectInstaller
+{
+public:
+
+	bool addProvider(wfp::ProviderBuilder &) override
+	{
+		THROW_ERROR("Firewall rules cannot add providers");
+	}
+
+	bool addSublayer(wfp::SublayerBuilder &) override
+	{
+		THROW_ERROR("Firewall rules cannot add sublayers");
+	}
+
+	bool addFilter(wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder) override
+	{
+		m_filters.emplace_back(CompiledFilter(filterBuilder, conditionBuilder, m_conditionPool));
+		return true;
+	}
+
+	bool addFilter(const CompiledFilter &) override
+	{
+		THROW_ERROR("Cannot compile an already compiled rule");
+	}
+
+	bool addFilters(const CompiledFilter *, size_t) override
+	{
+		THROW_ERROR("Cannot compile an already compiled rule");
+	}
+
+	std::vector<CompiledFilter> &filters()
+	{
+		return m_filters;
+	}
+
+private:
+
+	//
+	// Filters of a rule tend to share conditions. The pool lives as long as its filters.
+	//
+	std::shared_ptr<ConditionPool> m_conditionPool = std::make_shared<ConditionPool>();
+
+	std::vector<CompiledFilter> m_filters;
+};
+
+} // anonymous namespace
+
+std::shared_ptr<rules::IFirewallRule> RuleCache::get(const std::wstring &key, RuleFactory factory)
+{
+	const auto cached = m_rules.find(key);
+
+	if (m_rules.end() != cached)
+	{
+		return cached->second;
+	}
+
+	FilterRecorder recorder;
+
+	if (false == factory()->apply(recorder))
+	{
+		THROW_ERROR("Failed to compile firewall rule");
+	}
+
+	auto rule = std::make_shared<rules::CompiledRule>(std::move(recorder.filters()));
+
+	if (m_rules.size() >= MAX_CACHED_RULES)
+	{
+		m_rules.clear();
+	}
+
+	m_rules.emplace(key, rule);
+
+	return rule;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "rules/ifirewallrule.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+//
+// Cache of compiled rules, indexed by a key that uniquely identifies
+// the rule type and its parameters.
+//
+class RuleCache
+{
+public:
+
+	RuleCache() = default;
+
+	using RuleFactory = std::function<std::unique_ptr<rules::IFirewallRule>()>;
+
+	//
+	// Retrieve compiled rule, or create it using 'factory' and compile it.
+	//
+	std::shared_ptr<rules::IFirewallRule> get(const std::wstring &key, RuleFactory factory);
+
+private:
+
+	RuleCache(const RuleCache &) = delete;
+	RuleCache &operator=(const RuleCache &) = delete;
+
+	std::unordered_map<std::wstring, std::shared_ptr<rules::IFirewallRule> > m_rules;
+};
@@ -0,0 +1,89 @@
+#include "stdafx.h"
+#include "rulecounters.h"
+#include <libshared/performance/counterregistry.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+RuleCounters::RuleCounters(uint32_t timeout)
+	: m_engine(wfp::FilterEngine::StandardSession(timeout))
+	, m_unattributed(0)
+{
+	m_monitor = std::make_unique<wfp::ObjectMonitor>(m_engine);
+	m_monitor->monitorEvents(std::bind(&RuleCounters::eventCallback, this, std::placeholders::_1));
+}
+
+RuleCounters::~RuleCounters()
+{
+	//
+	// Unsubscribing waits for callbacks that are in progress.
+	//
+	m_monitor->monitorEventsStop();
+}
+
+void RuleCounters::eventCallback(const FWPM_NET_EVENT1 &event)
+{
+	if (FWPM_NET_EVENT_TYPE_CLASSIFY_DROP != event.type
+		|| nullptr == event.classifyDrop)
+	{
+		return;
+	}
+
+	std::scoped_lock<std::mutex> lock(m_mutex);
+
+	++m_pending[event.classifyDrop->filterId];
+}
+
+RuleCounters::Snapshot RuleCounters::collect(const FilterKeys &filterKeys)
+{
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winfw.rulecounters.collect");
+
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	std::unordered_map<UINT64, uint64_t> pending;
+
+	Snapshot snapshot;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_mutex);
+		pending.swap(m_pending);
+	}
+
+	//
+	// The totals are only ever accessed here, and this is serialized by the caller.
+	//
+
+	for (const auto &[filterId, count] : pending)
+	{
+		const auto key = filterKeys.find(filterId);
+
+		if (filterKeys.end() == key)
+		{
+			m_unattributed += count;
+			continue;
+		}
+
+		m_totals[key->second] += count;
+	}
+
+	snapshot.counters.reserve(m_totals.size());
+
+	for (const auto &[filterKey, count] : m_totals)
+	{
+		WinFwRuleCounter counter;
+
+		counter.filterKey = filterKey;
+		counter.numDropped = count;
+
+		snapshot.counters.push_back(counter);
+	}
+
+	std::sort(snapshot.counters.begin(), snapshot.counters.end(), [](const WinFwRuleCounter &lhs, const WinFwRuleCounter &rhs)
+	{
+		return memcmp(&lhs.filterKey, &rhs.filterKey, sizeof(GUID)) < 0;
+	});
+
+	snapshot.numUnattributed = m_unattributed;
+
+	return snapshot;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "winfw.h"
+#include "guidhash.h"
+#include "libwfp/filterengine.h"
+#include "libwfp/objectmonitor.h"
+#include <fwpmu.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//
+// Counts packets dropped by BFE, per Mullvad filter.
+//
+// Events only carry the run-time filter id. Counts are kept by id until they are
+// read, and are then attributed to filter keys, using the ids of the filters in
+// the session. Counts for filters that are no longer installed, or that aren't
+// installed by the session, can't be attributed and are only counted in total.
+//
+// Counts accumulate from when the instance is created.
+//
+class RuleCounters
+{
+public:
+
+	RuleCounters(uint32_t timeout);
+	~RuleCounters();
+
+	using FilterKeys = std::unordered_map<UINT64, GUID>;
+
+	struct Snapshot
+	{
+		// Sorted by filter key.
+		std::vector<WinFwRuleCounter> counters;
+
+		uint64_t numUnattributed;
+	};
+
+	//
+	// 'filterKeys' maps the ids of the filters currently installed to their keys.
+	//
+	Snapshot collect(const FilterKeys &filterKeys);
+
+private:
+
+	RuleCounters(const RuleCounters &) = delete;
+	RuleCounters &operator=(const RuleCounters &) = delete;
+
+	void eventCallback(const FWPM_NET_EVENT1 &event);
+
+	std::shared_ptr<wfp::FilterEngine> m_engine;
+
+	std::mutex m_mutex;
+
+	//
+	// Drops that have not yet been attributed, by filter id.
+	//
+	std::unordered_map<UINT64, uint64_t> m_pending;
+
+	std::unordered_map<GUID, uint64_t> m_totals;
+	uint64_t m_unattributed;
+
+	std::unique_ptr<wfp::ObjectMonitor> m_monitor;
+};
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "blockall.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/nullconditionbuilder.h"
 
@@ -22,7 +23,7 @@ bool BlockAll::apply(IObjectInstaller &objectInstaller)
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Min)
+		.weight(weights::BlockAll)
 		.block();
 
 	wfp::NullConditionBuilder nullConditionBuilder;
@@ -0,0 +1,29 @@
+#include "stdafx.h"
+#include "compiledrule.h"
+#include <utility>
+
+namespace rules
+{
+
+CompiledRule::CompiledRule(std::vector<CompiledFilter> &&filters)
+	: m_filters(std::move(filters))
+{
+	m_descriptors.reserve(m_filters.size());
+
+	for (const auto &filter : m_filters)
+	{
+		m_descriptors.push_back(FilterDescriptor{ filter.id(), filter.contentHash() });
+	}
+}
+
+bool CompiledRule::apply(IObjectInstaller &objectInstaller)
+{
+	return objectInstaller.addFilters(m_filters.data(), m_filters.size());
+}
+
+std::vector<IFirewallRule::FilterDescriptor> CompiledRule::describe()
+{
+	return m_descriptors;
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ifirewallrule.h"
+#include "winfw/compiledfilter.h"
+#include <vector>
+
+namespace rules
+{
+
+//
+// Rule whose filters have been marshalled once and are reused on every apply.
+//
+class CompiledRule : public IFirewallRule
+{
+public:
+
+	CompiledRule(std::vector<CompiledFilter> &&filters);
+
+	bool apply(IObjectInstaller &objectInstaller) override;
+
+	std::vector<FilterDescriptor> describe() override;
+
+private:
+
+	const std::vector<CompiledFilter> m_filters;
+	std::vector<FilterDescriptor> m_descriptors;
+};
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <windows.h>
+
+//
+// Weights of the filters installed in the whitelist sublayer.
+//
+// Filters in a sublayer are evaluated from highest to lowest weight, and
+// evaluation stops at the first matching filter with a terminating action.
+// Permit rules that are expected to match most often are therefore weighted
+// higher, so common traffic is classified after fewer evaluations.
+//
+// All filters that are weighted here permit traffic, except those of BlockAll,
+// which must remain below every other filter in the sublayer.
+//
+
+namespace rules::weights
+{
+
+constexpr UINT64 Loopback = 1000;
+constexpr UINT64 VpnTunnel = 900;
+constexpr UINT64 VpnRelay = 800;
+constexpr UINT64 ExcludedApps = 700;
+constexpr UINT64 TunnelDns = 600;
+constexpr UINT64 VpnTunnelService = 500;
+constexpr UINT64 Lan = 400;
+constexpr UINT64 LanService = 300;
+constexpr UINT64 Dhcp = 200;
+constexpr UINT64 Ping = 100;
+
+constexpr UINT64 BlockAll = 0;
+
+}
@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "ifirewallrule.h"
+#include "winfw/filtercontent.h"
+#include <libcommon/error.h>
+
+namespace rules
+{
+
+namespace
+{
+
+class FilterDescriber : public IObjectInstaller
+{
+public:
+
+	bool addProvider(wfp::ProviderBuilder &) override
+	{
+		THROW_ERROR("Firewall rules cannot add providers");
+	}
+
+	bool addSublayer(wfp::SublayerBuilder &) override
+	{
+		THROW_ERROR("Firewall rules cannot add sublayers");
+	}
+
+	bool addFilter(wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder) override
+	{
+		IFirewallRule::FilterDescriptor descriptor;
+
+		descriptor.contentHash = FilterContent::Hash(FilterContent::Serialize(filterBuilder, conditionBuilder));
+
+		filterBuilder.build([&descriptor](FWPM_FILTER0 &filter)
+		{
+			descriptor.key = filter.filterKey;
+			return true;
+		});
+
+		m_descriptors.push_back(descriptor);
+
+		return true;
+	}
+
+	bool addFilter(const CompiledFilter &filter) override
+	{
+		return addFilters(&filter, 1);
+	}
+
+	bool addFilters(const CompiledFilter *filters, size_t numFilters) override
+	{
+		for (size_t i = 0; i < numFilters; ++i)
+		{
+			m_descriptors.push_back(IFirewallRule::FilterDescriptor{ filters[i].id(), filters[i].contentHash() });
+		}
+
+		return true;
+	}
+
+	std::vector<IFirewallRule::FilterDescriptor> &descriptors()
+	{
+		return m_descriptors;
+	}
+
+private:
+
+	std::vector<IFirewallRule::FilterDescriptor> m_descriptors;
+};
+
+} // anonymous namespace
+
+std::vector<IFirewallRule::FilterDescriptor> IFirewallRule::describe()
+{
+	FilterDescriber describer;
+
+	if (false == apply(describer))
+	{
+		THROW_ERROR("Failed to describe firewall rule");
+	}
+
+	return std::move(describer.descriptors());
+}
+
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "winfw/iobjectinstaller.h"
+#include <guiddef.h>
+#include <cstdint>
+#include <vector>
 
 //
 // A firewall rule uses one of more filters to implement a concept
@@ -20,6 +23,23 @@ struct IFirewallRule
 	//virtual std::vector<std::wstring> details() = 0; // doesn't work? because there can be multiple filters each with multiple conditions
 
 	virtual bool apply(IObjectInstaller &objectInstaller) = 0;
+
+	struct FilterDescriptor
+	{
+		GUID key;
+
+		// See FilterContent::Hash().
+		uint64_t contentHash;
+	};
+
+	//
+	// Describe the filters the rule would add, in the order they would be added,
+	// without installing anything.
+	//
+	// The default implementation serializes the filters through apply().
+	// Compiled rules return what they computed when they were compiled.
+	//
+	virtual std::vector<FilterDescriptor> describe();
 };
 
 }
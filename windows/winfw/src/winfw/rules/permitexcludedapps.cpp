@@ -0,0 +1,115 @@
+#include "stdafx.h"
+#include "permitexcludedapps.h"
+#include "winfw/mullvadguids.h"
+#include "filterweights.h"
+#include "libwfp/filterbuilder.h"
+#include "libwfp/conditionbuilder.h"
+#include "libwfp/conditions/ifiltercondition.h"
+#include <libcommon/error.h>
+#include <sstream>
+
+namespace rules
+{
+
+namespace
+{
+
+//
+// Match on an application identifier that has already been resolved.
+//
+// libwfp's ConditionApplication resolves the identifier every time it's
+// instantiated, which is what the AppIdCache avoids.
+//
+class ConditionAppId : public wfp::conditions::IFilterCondition
+{
+public:
+
+	ConditionAppId(const PermitExcludedApps::App &app)
+		: m_app(app)
+	{
+		m_blob.size = static_cast<UINT32>(m_app.appId->size());
+		m_blob.data = const_cast<UINT8 *>(m_app.appId->data());
+
+		m_condition.fieldKey = FWPM_CONDITION_ALE_APP_ID;
+		m_condition.matchType = FWP_MATCH_EQUAL;
+		m_condition.conditionValue.type = FWP_BYTE_BLOB_TYPE;
+		m_condition.conditionValue.byteBlob = &m_blob;
+	}
+
+	std::wstring toString() const override
+	{
+		std::wstringstream ss;
+
+		ss << L"application = " << m_app.path;
+
+		return ss.str();
+	}
+
+	const GUID &identifier() const override
+	{
+		return FWPM_CONDITION_ALE_APP_ID;
+	}
+
+	const FWPM_FILTER_CONDITION0 &condition() const override
+	{
+		return m_condition;
+	}
+
+private:
+
+	const PermitExcludedApps::App m_app;
+
+	FWP_BYTE_BLOB m_blob;
+	FWPM_FILTER_CONDITION0 m_condition;
+};
+
+} // anonymous namespace
+
+PermitExcludedApps::PermitExcludedApps(const std::vector<App> &apps)
+	: m_apps(apps)
+{
+	if (m_apps.empty())
+	{
+		THROW_ERROR("No excluded application specified");
+	}
+}
+
+bool PermitExcludedApps::apply(IObjectInstaller &objectInstaller)
+{
+	return applyLayer(objectInstaller, MullvadGuids::FilterPermitExcludedApps_Outbound_Ipv4(),
+			L"Permit outbound connections for excluded applications (IPv4)", FWPM_LAYER_ALE_AUTH_CONNECT_V4)
+		&& applyLayer(objectInstaller, MullvadGuids::FilterPermitExcludedApps_Inbound_Ipv4(),
+			L"Permit inbound connections for excluded applications (IPv4)", FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4)
+		&& applyLayer(objectInstaller, MullvadGuids::FilterPermitExcludedApps_Outbound_Ipv6(),
+			L"Permit outbound connections for excluded applications (IPv6)", FWPM_LAYER_ALE_AUTH_CONNECT_V6)
+		&& applyLayer(objectInstaller, MullvadGuids::FilterPermitExcludedApps_Inbound_Ipv6(),
+			L"Permit inbound connections for excluded applications (IPv6)", FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6);
+}
+
+bool PermitExcludedApps::applyLayer(IObjectInstaller &objectInstaller, const GUID &filterKey,
+	const wchar_t *name, const GUID &layer) const
+{
+	wfp::FilterBuilder filterBuilder;
+
+	filterBuilder
+		.key(filterKey)
+		.name(name)
+		.description(L"This filter is part of a rule that permits traffic for applications excluded from the tunnel")
+		.provider(MullvadGuids::Provider())
+		.layer(layer)
+		.sublayer(MullvadGuids::SublayerWhitelist())
+		.weight(weights::ExcludedApps)
+		.permit();
+
+	wfp::ConditionBuilder conditionBuilder(layer);
+
+	for (const auto &app : m_apps)
+	{
+		// Multiple conditions of same type are OR'ed
+		conditionBuilder.add_condition(std::make_unique<ConditionAppId>(app));
+	}
+
+	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ifirewallrule.h"
+#include "winfw/appidcache.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rules
+{
+
+//
+// Permit all traffic for applications that are excluded from the tunnel.
+//
+// A single filter per layer matches all applications, so the number of
+// filters does not grow with the number of applications.
+//
+class PermitExcludedApps : public IFirewallRule
+{
+public:
+
+	struct App
+	{
+		std::wstring path;
+		std::shared_ptr<const AppIdCache::AppId> appId;
+	};
+
+	PermitExcludedApps(const std::vector<App> &apps);
+
+	bool apply(IObjectInstaller &objectInstaller) override;
+
+private:
+
+	bool applyLayer(IObjectInstaller &objectInstaller, const GUID &filterKey, const wchar_t *name, const GUID &layer) const;
+
+	const std::vector<App> m_apps;
+};
+
+}
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "permitlan.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/ipaddress.h"
@@ -17,14 +18,18 @@ bool PermitLan::apply(IObjectInstaller &objectInstaller)
 	return applyIpv4(objectInstaller) && applyIpv6(objectInstaller);
 }
 
+//
+// Unicast and multicast destinations are permitted by a single filter per layer.
+// Conditions on the same field are OR'ed, so the filter matches the same traffic
+// as separate filters would, but costs only one evaluation per connection.
+//
+// Adjacent networks are merged into the shortest covering prefix.
+//
+
 bool PermitLan::applyIpv4(IObjectInstaller &objectInstaller) const
 {
 	wfp::FilterBuilder filterBuilder;
 
-	//
-	// #1 locally-initiated traffic
-	//
-
 	filterBuilder
 		.key(MullvadGuids::FilterPermitLan_Outbound_Ipv4())
 		.name(L"Permit outbound LAN traffic (IPv4)")
@@ -32,39 +37,29 @@ bool PermitLan::applyIpv4(IObjectInstaller &objectInstaller) const
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::Lan)
 		.permit();
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V4);
 
+	//
+	// Locally-initiated traffic.
+	//
 	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 10, 0, 0, 0 }), 8)));
 	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 172, 16, 0, 0 }), 12)));
 	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 192, 168, 0, 0 }), 16)));
 	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 169, 254, 0, 0 }), 16)));
 
-	if (!objectInstaller.addFilter(filterBuilder, conditionBuilder))
-	{
-		return false;
-	}
-
 	//
-	// #2 LAN to multicast
-	//
-
-	filterBuilder
-		.key(MullvadGuids::FilterPermitLan_Outbound_Multicast_Ipv4())
-		.name(L"Permit outbound LAN multicast traffic (IPv4)");
-
-	conditionBuilder.reset();
-
 	// Local subnet multicast.
+	//
 	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 224, 0, 0, 0 }), 24)));
 
-	// Simple Service Discovery Protocol (SSDP) address.
-	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 239, 255, 255, 250 }), 32)));
-
-	// mDNS Service Discovery address.
-	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 239, 255, 255, 251 }), 32)));
+	//
+	// Simple Service Discovery Protocol (SSDP) address 239.255.255.250, and
+	// mDNS Service Discovery address 239.255.255.251.
+	//
+	conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpNetwork(wfp::IpAddress::Literal({ 239, 255, 255, 250 }), 31)));
 
 	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
 }
@@ -73,10 +68,6 @@ bool PermitLan::applyIpv6(IObjectInstaller &objectInstaller) const
 {
 	wfp::FilterBuilder filterBuilder;
 
-	//
-	// #1 locally-initiated traffic
-	//
-
 	filterBuilder
 		.key(MullvadGuids::FilterPermitLan_Outbound_Ipv6())
 		.name(L"Permit outbound LAN traffic (IPv6)")
@@ -84,30 +75,22 @@ bool PermitLan::applyIpv6(IObjectInstaller &objectInstaller) const
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V6)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::Lan)
 		.permit();
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V6);
 
+	//
+	// Locally-initiated traffic.
+	//
 	const wfp::IpNetwork linkLocal(wfp::IpAddress::Literal6({ 0xFE80, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 }), 10);
 
 	conditionBuilder.add_condition(ConditionIp::Remote(linkLocal));
 
-	if (!objectInstaller.addFilter(filterBuilder, conditionBuilder))
-	{
-		return false;
-	}
-
 	//
-	// #2 LAN to multicast
+	// Link-local and site-local multicast. These are not adjacent, and a range
+	// covering both would also include interface- and realm-local scopes.
 	//
-
-	filterBuilder
-		.key(MullvadGuids::FilterPermitLan_Outbound_Multicast_Ipv6())
-		.name(L"Permit outbound LAN multicast traffic (IPv6)");
-
-	conditionBuilder.reset();
-
 	const wfp::IpNetwork linkLocalMulticast(wfp::IpAddress::Literal6({ 0xFF02, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 }), 16);
 	const wfp::IpNetwork siteLocalMulticast(wfp::IpAddress::Literal6({ 0xFF05, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 }), 16);
 
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "permitlanservice.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/ipaddress.h"
@@ -32,7 +33,7 @@ bool PermitLanService::applyIpv4(IObjectInstaller &objectInstaller) const
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::LanService)
 		.permit();
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4);
@@ -60,7 +61,7 @@ bool PermitLanService::applyIpv6(IObjectInstaller &objectInstaller) const
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::LanService)
 		.permit();
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6);
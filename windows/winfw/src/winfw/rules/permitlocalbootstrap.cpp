@@ -1,6 +1,8 @@
 #include "stdafx.h"
-#include "permitdhcp.h"
+#include "permitlocalbootstrap.h"
+#include "permitndp.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/ipaddress.h"
@@ -22,14 +24,77 @@ static const uint32_t DHCPV4_SERVER_PORT = 67;
 static const uint32_t DHCPV6_CLIENT_PORT = 546;
 static const uint32_t DHCPV6_SERVER_PORT = 547;
 
+enum class Broadcast
+{
+	None,
+	Local,
+	Remote
+};
+
+//
+// Add a filter that permits UDP between the ports, in the layer that the builder is set up for.
+// Conditions are added in the same order for every filter, so filter content stays comparable.
+//
+bool AddUdpFilter
+(
+	IObjectInstaller &objectInstaller,
+	wfp::FilterBuilder &filterBuilder,
+	const GUID &layer,
+	uint32_t localPort,
+	uint32_t remotePort,
+	Broadcast broadcast
+)
+{
+	const wfp::IpAddress::Literal broadcastAddress({ 255, 255, 255, 255 });
+
+	wfp::ConditionBuilder conditionBuilder(layer);
+
+	conditionBuilder.add_condition(ConditionProtocol::Udp());
+	conditionBuilder.add_condition(ConditionPort::Local(localPort));
+
+	if (Broadcast::Local == broadcast)
+	{
+		conditionBuilder.add_condition(ConditionIp::Local(broadcastAddress));
+	}
+	else if (Broadcast::Remote == broadcast)
+	{
+		conditionBuilder.add_condition(ConditionIp::Remote(broadcastAddress));
+	}
+
+	conditionBuilder.add_condition(ConditionPort::Remote(remotePort));
+
+	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
+}
+
 } // anonymous namespace
 
-bool PermitDhcp::apply(IObjectInstaller &objectInstaller)
+PermitLocalBootstrap::PermitLocalBootstrap(bool dhcpClient, bool dhcpServer)
+	: m_dhcpClient(dhcpClient)
+	, m_dhcpServer(dhcpServer)
 {
-	return applyIpv4(objectInstaller) && applyIpv6(objectInstaller);
 }
 
-bool PermitDhcp::applyIpv4(IObjectInstaller &objectInstaller) const
+bool PermitLocalBootstrap::apply(IObjectInstaller &objectInstaller)
+{
+	if (m_dhcpClient)
+	{
+		if (false == applyDhcpClientIpv4(objectInstaller)
+			|| false == applyDhcpClientIpv6(objectInstaller)
+			|| false == PermitNdp().apply(objectInstaller))
+		{
+			return false;
+		}
+	}
+
+	if (m_dhcpServer)
+	{
+		return applyDhcpServerIpv4(objectInstaller);
+	}
+
+	return true;
+}
+
+bool PermitLocalBootstrap::applyDhcpClientIpv4(IObjectInstaller &objectInstaller) const
 {
 	//
 	// First UDP packet for a unique [remote address, port] tuple is mapped into:
@@ -51,21 +116,13 @@ bool PermitDhcp::applyIpv4(IObjectInstaller &objectInstaller) const
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::Dhcp)
 		.permit();
 
+	if (false == AddUdpFilter(objectInstaller, filterBuilder, FWPM_LAYER_ALE_AUTH_CONNECT_V4,
+		DHCPV4_CLIENT_PORT, DHCPV4_SERVER_PORT, Broadcast::Remote))
 	{
-		wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V4);
-
-		conditionBuilder.add_condition(ConditionProtocol::Udp());
-		conditionBuilder.add_condition(ConditionPort::Local(DHCPV4_CLIENT_PORT));
-		conditionBuilder.add_condition(ConditionIp::Remote(wfp::IpAddress::Literal({ 255, 255, 255, 255 })));
-		conditionBuilder.add_condition(ConditionPort::Remote(DHCPV4_SERVER_PORT));
-
-		if (!objectInstaller.addFilter(filterBuilder, conditionBuilder))
-		{
-			return false;
-		}
+		return false;
 	}
 
 	//
@@ -77,16 +134,11 @@ bool PermitDhcp::applyIpv4(IObjectInstaller &objectInstaller) const
 		.name(L"Permit inbound DHCP response (IPv4)")
 		.layer(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4);
 
-	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4);
-
-	conditionBuilder.add_condition(ConditionProtocol::Udp());
-	conditionBuilder.add_condition(ConditionPort::Local(DHCPV4_CLIENT_PORT));
-	conditionBuilder.add_condition(ConditionPort::Remote(DHCPV4_SERVER_PORT));
-
-	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
+	return AddUdpFilter(objectInstaller, filterBuilder, FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4,
+		DHCPV4_CLIENT_PORT, DHCPV4_SERVER_PORT, Broadcast::None);
 }
 
-bool PermitDhcp::applyIpv6(IObjectInstaller &objectInstaller) const
+bool PermitLocalBootstrap::applyDhcpClientIpv6(IObjectInstaller &objectInstaller) const
 {
 	const wfp::IpNetwork linkLocal(wfp::IpAddress::Literal6({ 0xFE80, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 }), 10);
 
@@ -140,4 +192,41 @@ bool PermitDhcp::applyIpv6(IObjectInstaller &objectInstaller) const
 	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
 }
 
+bool PermitLocalBootstrap::applyDhcpServerIpv4(IObjectInstaller &objectInstaller) const
+{
+	//
+	// #1 permit incoming DHCPv4 request
+	//
+
+	wfp::FilterBuilder filterBuilder;
+
+	filterBuilder
+		.key(MullvadGuids::FilterPermitDhcpServer_Inbound_Request_Ipv4())
+		.name(L"Permit inbound DHCP request (IPv4)")
+		.description(L"This filter is part of a rule that permits DHCP server traffic")
+		.provider(MullvadGuids::Provider())
+		.layer(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4)
+		.sublayer(MullvadGuids::SublayerWhitelist())
+		.weight(weights::Dhcp)
+		.permit();
+
+	if (false == AddUdpFilter(objectInstaller, filterBuilder, FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4,
+		DHCPV4_SERVER_PORT, DHCPV4_CLIENT_PORT, Broadcast::Local))
+	{
+		return false;
+	}
+
+	//
+	// #2 permit outbound DHCPv4 response
+	//
+
+	filterBuilder
+		.key(MullvadGuids::FilterPermitDhcpServer_Outbound_Response_Ipv4())
+		.name(L"Permit outbound DHCP response (IPv4)")
+		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4);
+
+	return AddUdpFilter(objectInstaller, filterBuilder, FWPM_LAYER_ALE_AUTH_CONNECT_V4,
+		DHCPV4_SERVER_PORT, DHCPV4_CLIENT_PORT, Broadcast::None);
+}
+
 }
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ifirewallrule.h"
+
+namespace rules
+{
+
+//
+// Traffic a host needs to join the local network: DHCP client traffic and
+// NDP, and optionally DHCPv4 server traffic.
+//
+// The DHCP client and server filters are built by the same code, since they
+// differ only in their ports, and which end is the broadcast address.
+//
+class PermitLocalBootstrap : public IFirewallRule
+{
+public:
+
+	PermitLocalBootstrap(bool dhcpClient, bool dhcpServer);
+	~PermitLocalBootstrap() = default;
+
+	bool apply(IObjectInstaller &objectInstaller) override;
+
+private:
+
+	bool applyDhcpClientIpv4(IObjectInstaller &objectInstaller) const;
+	bool applyDhcpClientIpv6(IObjectInstaller &objectInstaller) const;
+	bool applyDhcpServerIpv4(IObjectInstaller &objectInstaller) const;
+
+	const bool m_dhcpClient;
+	const bool m_dhcpServer;
+};
+
+}
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "permitloopback.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/conditions/conditionloopback.h"
@@ -25,7 +26,7 @@ bool PermitLoopback::apply(IObjectInstaller &objectInstaller)
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::Loopback)
 		.permit();
 
 	{
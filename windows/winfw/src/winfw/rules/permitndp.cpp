@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "permitndp.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/ipaddress.h"
@@ -21,6 +22,18 @@ bool PermitNdp::apply(IObjectInstaller &objectInstaller)
 
 	wfp::FilterBuilder filterBuilder;
 
+	//
+	// Owned by the provider like every other rule, so the filters are found and removed
+	// by provider-scoped cleanup, e.g. after a crash.
+	//
+
+	filterBuilder
+		.description(L"This filter is part of a rule that permits NDP")
+		.provider(MullvadGuids::Provider())
+		.sublayer(MullvadGuids::SublayerWhitelist())
+		.weight(weights::Dhcp)
+		.permit();
+
 	//
 	// #1 permit outbound router solicitation
 	//
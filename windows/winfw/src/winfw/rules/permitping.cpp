@@ -1,10 +1,10 @@
 #include "stdafx.h"
 #include "permitping.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/conditions/conditionip.h"
-#include "libwfp/conditions/conditioninterface.h"
 #include "libwfp/conditions/conditionprotocol.h"
 
 
@@ -15,22 +15,37 @@ namespace rules
 
 PermitPing::PermitPing
 (
-	const std::optional<std::wstring> &interfaceAlias,
-	const wfp::IpAddress &host
+	const std::optional<TunnelInterface> &tunnelInterface,
+	const std::vector<wfp::IpAddress> &hosts
 )
-	: m_interfaceAlias(interfaceAlias)
-	, m_host(host)
+	: m_tunnelInterface(tunnelInterface)
 {
+	for (const auto &host : hosts)
+	{
+		if (wfp::IpAddress::Type::Ipv4 == host.type())
+		{
+			m_v4Hosts.push_back(host);
+		}
+		else
+		{
+			m_v6Hosts.push_back(host);
+		}
+	}
 }
 
 bool PermitPing::apply(IObjectInstaller &objectInstaller)
 {
-	if (wfp::IpAddress::Type::Ipv4 == m_host.type())
+	if (false == m_v4Hosts.empty() && false == applyIcmpv4(objectInstaller))
+	{
+		return false;
+	}
+
+	if (false == m_v6Hosts.empty() && false == applyIcmpv6(objectInstaller))
 	{
-		return applyIcmpv4(objectInstaller);
+		return false;
 	}
 
-	return applyIcmpv6(objectInstaller);
+	return true;
 }
 
 bool PermitPing::applyIcmpv4(IObjectInstaller &objectInstaller) const
@@ -38,27 +53,32 @@ bool PermitPing::applyIcmpv4(IObjectInstaller &objectInstaller) const
 	wfp::FilterBuilder filterBuilder;
 
 	//
-	// #1 Permit outbound ICMPv4 to %host% on %interface%
+	// #1 Permit outbound ICMPv4 to %hosts% on %interface%
 	//
 
 	filterBuilder
 		.key(MullvadGuids::FilterPermitPing_Outbound_Icmpv4())
-		.name(L"Permit outbound ICMP to specific host (ICMPv4)")
+		.name(L"Permit outbound ICMP to specific hosts (ICMPv4)")
 		.description(L"This filter is part of a rule that permits ping")
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::Ping)
 		.permit();
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V4);
 
-	conditionBuilder.add_condition(ConditionIp::Remote(m_host));
+	for (const auto &host : m_v4Hosts)
+	{
+		// Multiple conditions of same type are OR'ed
+		conditionBuilder.add_condition(ConditionIp::Remote(host));
+	}
+
 	conditionBuilder.add_condition(ConditionProtocol::Icmp());
 
-	if (m_interfaceAlias.has_value())
+	if (m_tunnelInterface.has_value())
 	{
-		conditionBuilder.add_condition(ConditionInterface::Alias(m_interfaceAlias.value()));
+		conditionBuilder.add_condition(m_tunnelInterface->condition());
 	}
 
 	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
@@ -69,27 +89,32 @@ bool PermitPing::applyIcmpv6(IObjectInstaller &objectInstaller) const
 	wfp::FilterBuilder filterBuilder;
 
 	//
-	// #1 Permit outbound ICMPv6 to %host% on %interface%
+	// #1 Permit outbound ICMPv6 to %hosts% on %interface%
 	//
 
 	filterBuilder
 		.key(MullvadGuids::FilterPermitPing_Outbound_Icmpv6())
-		.name(L"Permit outbound ICMP to specific host (ICMPv6)")
+		.name(L"Permit outbound ICMP to specific hosts (ICMPv6)")
 		.description(L"This filter is part of a rule that permits ping")
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V6)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::Ping)
 		.permit();
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V6);
 
-	conditionBuilder.add_condition(ConditionIp::Remote(m_host));
+	for (const auto &host : m_v6Hosts)
+	{
+		// Multiple conditions of same type are OR'ed
+		conditionBuilder.add_condition(ConditionIp::Remote(host));
+	}
+
 	conditionBuilder.add_condition(ConditionProtocol::IcmpV6());
 
-	if (m_interfaceAlias.has_value())
+	if (m_tunnelInterface.has_value())
 	{
-		conditionBuilder.add_condition(ConditionInterface::Alias(m_interfaceAlias.value()));
+		conditionBuilder.add_condition(m_tunnelInterface->condition());
 	}
 
 	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
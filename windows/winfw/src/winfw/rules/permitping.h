@@ -1,9 +1,11 @@
 #pragma once
 
 #include "ifirewallrule.h"
+#include "tunnelinterface.h"
 #include <libwfp/ipaddress.h>
 #include <string>
 #include <optional>
+#include <vector>
 
 namespace rules
 {
@@ -12,14 +14,18 @@ class PermitPing : public IFirewallRule
 {
 public:
 
-	PermitPing(const std::optional<std::wstring> &interfaceAlias, const wfp::IpAddress &host);
+	//
+	// All hosts of the same family are covered by a single filter.
+	//
+	PermitPing(const std::optional<TunnelInterface> &tunnelInterface, const std::vector<wfp::IpAddress> &hosts);
 
 	bool apply(IObjectInstaller &objectInstaller) override;
 
 private:
 
-	const std::optional<std::wstring> m_interfaceAlias;
-	const wfp::IpAddress m_host;
+	const std::optional<TunnelInterface> m_tunnelInterface;
+	std::vector<wfp::IpAddress> m_v4Hosts;
+	std::vector<wfp::IpAddress> m_v6Hosts;
 
 	bool applyIcmpv4(IObjectInstaller &objectInstaller) const;
 	bool applyIcmpv6(IObjectInstaller &objectInstaller) const;
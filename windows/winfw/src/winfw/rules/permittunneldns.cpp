@@ -1,10 +1,10 @@
 #include "stdafx.h"
 #include "permittunneldns.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/conditions/comparison.h"
-#include "libwfp/conditions/conditioninterface.h"
 #include "libwfp/conditions/conditionip.h"
 #include "libwfp/conditions/conditionport.h"
 
@@ -21,10 +21,10 @@ namespace rules
 {
 
 PermitTunnelDns::PermitTunnelDns(
-	const std::wstring &tunnelInterfaceAlias,
+	const TunnelInterface &tunnelInterface,
 	const std::vector<wfp::IpAddress> &dnsHosts
 )
-	: m_tunnelInterfaceAlias(tunnelInterfaceAlias)
+	: m_tunnelInterface(tunnelInterface)
 {
 	for (const auto &host : dnsHosts)
 	{
@@ -51,7 +51,7 @@ bool PermitTunnelDns::apply(IObjectInstaller &objectInstaller)
 		.provider(MullvadGuids::Provider())
 		.description(L"This filter is part of a rule that permits DNS traffic inside the VPN tunnel")
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::TunnelDns)
 		.permit();
 
 	if (!m_v4DnsHosts.empty())
@@ -62,7 +62,7 @@ bool PermitTunnelDns::apply(IObjectInstaller &objectInstaller)
 			.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4);
 
 		wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V4);
-		conditionBuilder.add_condition(ConditionInterface::Alias(m_tunnelInterfaceAlias));
+		conditionBuilder.add_condition(m_tunnelInterface.condition());
 
 		for (const auto &host : m_v4DnsHosts)
 		{
@@ -90,7 +90,7 @@ bool PermitTunnelDns::apply(IObjectInstaller &objectInstaller)
 			.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V6);
 
 		wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V6);
-		conditionBuilder.add_condition(ConditionInterface::Alias(m_tunnelInterfaceAlias));
+		conditionBuilder.add_condition(m_tunnelInterface.condition());
 
 		for (const auto &host : m_v6DnsHosts)
 		{
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ifirewallrule.h"
+#include "tunnelinterface.h"
 #include "libwfp/ipaddress.h"
 #include <string>
 #include <cstdint>
@@ -12,13 +13,13 @@ class PermitTunnelDns : public IFirewallRule
 {
 public:
 
-	PermitTunnelDns(const std::wstring &tunnelInterfaceAlias, const std::vector<wfp::IpAddress> &dnsHosts);
+	PermitTunnelDns(const TunnelInterface &tunnelInterface, const std::vector<wfp::IpAddress> &dnsHosts);
 
 	bool apply(IObjectInstaller &objectInstaller) override;
 
 private:
 
-	const std::wstring m_tunnelInterfaceAlias;
+	const TunnelInterface m_tunnelInterface;
 	std::vector<wfp::IpAddress> m_v4DnsHosts;
 	std::vector<wfp::IpAddress> m_v6DnsHosts;
 
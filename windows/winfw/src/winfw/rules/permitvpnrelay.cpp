@@ -1,12 +1,14 @@
 #include "stdafx.h"
 #include "permitvpnrelay.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
 #include "libwfp/conditions/conditionprotocol.h"
 #include "libwfp/conditions/conditionip.h"
 #include "libwfp/conditions/conditionport.h"
 #include <libcommon/error.h>
+#include <algorithm>
 
 using namespace wfp::conditions;
 
@@ -16,19 +18,6 @@ namespace rules
 namespace
 {
 
-const GUID &LayerFromIp(const wfp::IpAddress &ip)
-{
-	switch (ip.type())
-	{
-		case wfp::IpAddress::Type::Ipv4: return FWPM_LAYER_ALE_AUTH_CONNECT_V4;
-		case wfp::IpAddress::Type::Ipv6: return FWPM_LAYER_ALE_AUTH_CONNECT_V6;
-		default:
-		{
-			THROW_ERROR("Missing case handler in switch clause");
-		}
-	};
-}
-
 std::unique_ptr<ConditionProtocol> CreateProtocolCondition(PermitVpnRelay::Protocol protocol)
 {
 	switch (protocol)
@@ -45,37 +34,121 @@ std::unique_ptr<ConditionProtocol> CreateProtocolCondition(PermitVpnRelay::Proto
 } // anonymous namespace
 
 PermitVpnRelay::PermitVpnRelay(const wfp::IpAddress &relay, uint16_t relayPort, Protocol protocol)
-	: m_relay(relay)
-	, m_relayPort(relayPort)
-	, m_protocol(protocol)
+	: PermitVpnRelay(std::vector<Relay>{ Relay{ relay, relayPort, protocol } })
+{
+}
+
+PermitVpnRelay::PermitVpnRelay(const std::vector<Relay> &relays)
 {
+	std::vector<Relay> v4Relays;
+	std::vector<Relay> v6Relays;
+
+	for (const auto &relay : relays)
+	{
+		if (wfp::IpAddress::Type::Ipv4 == relay.ip.type())
+		{
+			v4Relays.push_back(relay);
+		}
+		else
+		{
+			v6Relays.push_back(relay);
+		}
+	}
+
+	if (v4Relays.empty() && v6Relays.empty())
+	{
+		THROW_ERROR("No relay specified");
+	}
+
+	m_v4Endpoints = GroupRelays(v4Relays);
+	m_v6Endpoints = GroupRelays(v6Relays);
 }
 
 bool PermitVpnRelay::apply(IObjectInstaller &objectInstaller)
 {
-	wfp::FilterBuilder filterBuilder;
+	if (false == applyFamily(objectInstaller, m_v4Endpoints, MullvadGuids::FilterPermitVpnRelay_Ipv4, FWPM_LAYER_ALE_AUTH_CONNECT_V4))
+	{
+		return false;
+	}
 
-	//
-	// #1 permit connecting to relay
-	//
+	return applyFamily(objectInstaller, m_v6Endpoints, MullvadGuids::FilterPermitVpnRelay_Ipv6, FWPM_LAYER_ALE_AUTH_CONNECT_V6);
+}
 
-	filterBuilder
-		.key(MullvadGuids::FilterPermitVpnRelay())
-		.name(L"Permit outbound connections to VPN relay")
-		.description(L"This filter is part of a rule that permits communication with a VPN relay")
-		.provider(MullvadGuids::Provider())
-		.layer(LayerFromIp(m_relay))
-		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
-		.permit();
+//
+// Group relays on port and protocol. Merging relays with different ports or
+// protocols into one filter would also permit combinations that no relay uses.
+//
+//static
+std::vector<PermitVpnRelay::Endpoint> PermitVpnRelay::GroupRelays(const std::vector<Relay> &relays)
+{
+	std::vector<Endpoint> endpoints;
 
-	wfp::ConditionBuilder conditionBuilder(LayerFromIp(m_relay));
+	for (const auto &relay : relays)
+	{
+		auto endpoint = std::find_if(endpoints.begin(), endpoints.end(), [&relay](const Endpoint &candidate)
+		{
+			return candidate.port == relay.port && candidate.protocol == relay.protocol;
+		});
+
+		if (endpoints.end() == endpoint)
+		{
+			endpoint = endpoints.insert(endpoints.end(), Endpoint{ relay.port, relay.protocol, {} });
+		}
+
+		endpoint->ips.push_back(relay.ip);
+	}
 
-	conditionBuilder.add_condition(ConditionIp::Remote(m_relay));
-	conditionBuilder.add_condition(ConditionPort::Remote(m_relayPort));
-	conditionBuilder.add_condition(CreateProtocolCondition(m_protocol));
+	if (endpoints.size() > MullvadGuids::MaxVpnRelayGroups)
+	{
+		THROW_ERROR("Too many distinct relay ports and protocols");
+	}
+
+	return endpoints;
+}
+
+bool PermitVpnRelay::applyFamily(IObjectInstaller &objectInstaller, const std::vector<Endpoint> &endpoints,
+	const GUID &(*filterKey)(size_t group), const GUID &layer) const
+{
+	for (size_t group = 0; group < endpoints.size(); ++group)
+	{
+		const auto &endpoint = endpoints[group];
+
+		wfp::FilterBuilder filterBuilder;
+
+		//
+		// #1 permit connecting to relay
+		//
+
+		filterBuilder
+			.key(filterKey(group))
+			.name(L"Permit outbound connections to VPN relay")
+			.description(L"This filter is part of a rule that permits communication with a VPN relay")
+			.provider(MullvadGuids::Provider())
+			.layer(layer)
+			.sublayer(MullvadGuids::SublayerWhitelist())
+			.weight(weights::VpnRelay)
+			.permit();
+
+		wfp::ConditionBuilder conditionBuilder(layer);
+
+		//
+		// Multiple conditions of same type are OR'ed
+		//
+		for (const auto &ip : endpoint.ips)
+		{
+			conditionBuilder.add_condition(ConditionIp::Remote(ip));
+		}
+
+		conditionBuilder.add_condition(ConditionPort::Remote(endpoint.port));
+		conditionBuilder.add_condition(CreateProtocolCondition(endpoint.protocol));
+
+		if (false == objectInstaller.addFilter(filterBuilder, conditionBuilder))
+		{
+			return false;
+		}
+	}
 
-	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
+	return true;
 }
 
 }
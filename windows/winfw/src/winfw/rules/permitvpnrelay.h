@@ -2,6 +2,7 @@
 
 #include "ifirewallrule.h"
 #include "libwfp/ipaddress.h"
+#include <vector>
 
 namespace rules
 {
@@ -16,15 +17,44 @@ public:
 		Udp
 	};
 
+	struct Relay
+	{
+		wfp::IpAddress ip;
+		uint16_t port;
+		Protocol protocol;
+	};
+
 	PermitVpnRelay(const wfp::IpAddress &relay, uint16_t relayPort, Protocol protocol);
-	
+
+	//
+	// A filter is installed per address family and combination of port and
+	// protocol, matching the addresses of all relays that use them. Typically
+	// the relays share port and protocol, so a single filter is installed
+	// per address family.
+	//
+	// Each filter has a registered key. Throws if an address family has more
+	// combinations than there are keys, see MullvadGuids::MaxVpnRelayGroups.
+	//
+	PermitVpnRelay(const std::vector<Relay> &relays);
+
 	bool apply(IObjectInstaller &objectInstaller) override;
 
 private:
 
-	const wfp::IpAddress m_relay;
-	const uint16_t m_relayPort;
-	const Protocol m_protocol;
+	struct Endpoint
+	{
+		uint16_t port;
+		Protocol protocol;
+		std::vector<wfp::IpAddress> ips;
+	};
+
+	static std::vector<Endpoint> GroupRelays(const std::vector<Relay> &relays);
+
+	bool applyFamily(IObjectInstaller &objectInstaller, const std::vector<Endpoint> &endpoints,
+		const GUID &(*filterKey)(size_t group), const GUID &layer) const;
+
+	std::vector<Endpoint> m_v4Endpoints;
+	std::vector<Endpoint> m_v6Endpoints;
 };
 
 }
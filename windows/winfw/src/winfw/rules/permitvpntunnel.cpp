@@ -1,9 +1,9 @@
 #include "stdafx.h"
 #include "permitvpntunnel.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
-#include "libwfp/conditions/conditioninterface.h"
 #include "libwfp/conditions/conditionport.h"
 
 using namespace wfp::conditions;
@@ -18,8 +18,8 @@ constexpr uint16_t DNS_PORT = 53;
 namespace rules
 {
 
-PermitVpnTunnel::PermitVpnTunnel(const std::wstring &tunnelInterfaceAlias)
-	: m_tunnelInterfaceAlias(tunnelInterfaceAlias)
+PermitVpnTunnel::PermitVpnTunnel(const TunnelInterface &tunnelInterface)
+	: m_tunnelInterface(tunnelInterface)
 {
 }
 
@@ -39,13 +39,13 @@ bool PermitVpnTunnel::apply(IObjectInstaller &objectInstaller)
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_CONNECT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::VpnTunnel)
 		.permit();
 
 	{
 		wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V4);
 
-		conditionBuilder.add_condition(ConditionInterface::Alias(m_tunnelInterfaceAlias));
+		conditionBuilder.add_condition(m_tunnelInterface.condition());
 		conditionBuilder.add_condition(ConditionPort::Remote(DNS_PORT, CompareNeq()));
 
 		if (!objectInstaller.addFilter(filterBuilder, conditionBuilder))
@@ -66,7 +66,7 @@ bool PermitVpnTunnel::apply(IObjectInstaller &objectInstaller)
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_CONNECT_V6);
 
-	conditionBuilder.add_condition(ConditionInterface::Alias(m_tunnelInterfaceAlias));
+	conditionBuilder.add_condition(m_tunnelInterface.condition());
 	conditionBuilder.add_condition(ConditionPort::Remote(DNS_PORT, CompareNeq()));
 
 	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
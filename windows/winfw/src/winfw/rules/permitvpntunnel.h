@@ -1,7 +1,7 @@
 #pragma once
 
 #include "ifirewallrule.h"
-#include <string>
+#include "tunnelinterface.h"
 
 namespace rules
 {
@@ -10,13 +10,13 @@ class PermitVpnTunnel : public IFirewallRule
 {
 public:
 
-	PermitVpnTunnel(const std::wstring &tunnelInterfaceAlias);
+	PermitVpnTunnel(const TunnelInterface &tunnelInterface);
 	
 	bool apply(IObjectInstaller &objectInstaller) override;
 
 private:
 
-	const std::wstring m_tunnelInterfaceAlias;
+	const TunnelInterface m_tunnelInterface;
 };
 
 }
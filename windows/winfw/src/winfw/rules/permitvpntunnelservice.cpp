@@ -1,17 +1,14 @@
 #include "stdafx.h"
 #include "permitvpntunnelservice.h"
 #include "winfw/mullvadguids.h"
+#include "filterweights.h"
 #include "libwfp/filterbuilder.h"
 #include "libwfp/conditionbuilder.h"
-#include "libwfp/conditions/conditioninterface.h"
-
-using namespace wfp::conditions;
-
 namespace rules
 {
 
-PermitVpnTunnelService::PermitVpnTunnelService(const std::wstring &tunnelInterfaceAlias)
-	: m_tunnelInterfaceAlias(tunnelInterfaceAlias)
+PermitVpnTunnelService::PermitVpnTunnelService(const TunnelInterface &tunnelInterface)
+	: m_tunnelInterface(tunnelInterface)
 {
 }
 
@@ -30,12 +27,12 @@ bool PermitVpnTunnelService::apply(IObjectInstaller &objectInstaller)
 		.provider(MullvadGuids::Provider())
 		.layer(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4)
 		.sublayer(MullvadGuids::SublayerWhitelist())
-		.weight(wfp::FilterBuilder::WeightClass::Max)
+		.weight(weights::VpnTunnelService)
 		.permit();
 
 	wfp::ConditionBuilder conditionBuilder(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4);
 
-	conditionBuilder.add_condition(ConditionInterface::Alias(m_tunnelInterfaceAlias));
+	conditionBuilder.add_condition(m_tunnelInterface.condition());
 
 	if (!objectInstaller.addFilter(filterBuilder, conditionBuilder))
 	{
@@ -52,7 +49,7 @@ bool PermitVpnTunnelService::apply(IObjectInstaller &objectInstaller)
 		.layer(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6);
 
 	conditionBuilder.reset(FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6);
-	conditionBuilder.add_condition(ConditionInterface::Alias(m_tunnelInterfaceAlias));
+	conditionBuilder.add_condition(m_tunnelInterface.condition());
 
 	return objectInstaller.addFilter(filterBuilder, conditionBuilder);
 }
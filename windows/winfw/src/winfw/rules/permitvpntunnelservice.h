@@ -1,7 +1,7 @@
 #pragma once
 
 #include "ifirewallrule.h"
-#include <string>
+#include "tunnelinterface.h"
 
 namespace rules
 {
@@ -10,13 +10,13 @@ class PermitVpnTunnelService : public IFirewallRule
 {
 public:
 
-	PermitVpnTunnelService(const std::wstring &tunnelInterfaceAlias);
+	PermitVpnTunnelService(const TunnelInterface &tunnelInterface);
 
 	bool apply(IObjectInstaller &objectInstaller) override;
 
 private:
 
-	const std::wstring m_tunnelInterfaceAlias;
+	const TunnelInterface m_tunnelInterface;
 };
 
 }
@@ -0,0 +1,93 @@
+#include "stdafx.h"
+#include "tunnelinterface.h"
+#include <libcommon/error.h>
+#include <libshared/network/aliascache.h>
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <fwpmu.h>
+#include <sstream>
+
+namespace rules
+{
+
+namespace
+{
+
+//
+// Same condition as libwfp's ConditionInterface::Alias(), which resolves
+// the alias every time it's instantiated.
+//
+class ConditionInterfaceLuid : public wfp::conditions::IFilterCondition
+{
+public:
+
+	ConditionInterfaceLuid(const TunnelInterface &tunnel)
+		: m_alias(tunnel.alias)
+		, m_luid(tunnel.luid.Value)
+	{
+		m_condition.fieldKey = FWPM_CONDITION_IP_LOCAL_INTERFACE;
+		m_condition.matchType = FWP_MATCH_EQUAL;
+		m_condition.conditionValue.type = FWP_UINT64;
+		m_condition.conditionValue.uint64 = &m_luid;
+	}
+
+	std::wstring toString() const override
+	{
+		std::wstringstream ss;
+
+		ss << L"interface alias = " << m_alias;
+
+		return ss.str();
+	}
+
+	const GUID &identifier() const override
+	{
+		return FWPM_CONDITION_IP_LOCAL_INTERFACE;
+	}
+
+	const FWPM_FILTER_CONDITION0 &condition() const override
+	{
+		return m_condition;
+	}
+
+private:
+
+	const std::wstring m_alias;
+	UINT64 m_luid;
+
+	FWPM_FILTER_CONDITION0 m_condition;
+};
+
+} // anonymous namespace
+
+//static
+TunnelInterface TunnelInterface::Resolve(const std::wstring &alias)
+{
+	NET_LUID luid;
+
+	const auto status = shared::network::InterfaceAliasCache::Instance().resolve(alias, luid);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Resolve tunnel interface alias");
+	}
+
+	return TunnelInterface{ alias, luid };
+}
+
+std::unique_ptr<wfp::conditions::IFilterCondition> TunnelInterface::condition() const
+{
+	return std::make_unique<ConditionInterfaceLuid>(*this);
+}
+
+std::wstring TunnelInterface::key() const
+{
+	std::wstringstream ss;
+
+	ss << alias << L'@' << std::hex << luid.Value;
+
+	return ss.str();
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "libwfp/conditions/ifiltercondition.h"
+#include <windows.h>
+#include <ifdef.h>
+#include <memory>
+#include <string>
+
+namespace rules
+{
+
+//
+// Tunnel interface whose alias has been resolved.
+//
+// Policies resolve the alias once and share the result between all rules
+// that match on the tunnel interface. The LUID changes when the interface
+// is recreated, so it's also part of the cache key of those rules.
+//
+struct TunnelInterface
+{
+	std::wstring alias;
+	NET_LUID luid;
+
+	// Throws if there is no interface with this alias.
+	static TunnelInterface Resolve(const std::wstring &alias);
+
+	// Match traffic on this interface.
+	std::unique_ptr<wfp::conditions::IFilterCondition> condition() const;
+
+	// Identifies the interface in rule and policy keys.
+	std::wstring key() const;
+};
+
+}
@@ -4,29 +4,51 @@
 #include "mullvadguids.h"
 #include "libwfp/objectinstaller.h"
 #include "libwfp/objectdeleter.h"
+#include "libwfp/objectenumerator.h"
+#include "libwfp/objectexplorer.h"
 #include "libwfp/transaction.h"
 #include "libcommon/memory.h"
 #include <libcommon/error.h>
+#include <libshared/performance/counterregistry.h>
+#include <libshared/tracing/trace.h>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <random>
+#include <thread>
 #include <utility>
 
 namespace
 {
 
-template<typename T>
-void EraseBack(T &container, size_t elements)
+using Clock = std::chrono::steady_clock;
+
+//
+// A transaction that times out waiting for the BFE transaction lock is retried
+// with a randomized backoff, as long as the attempts and the deadline allow it.
+// The deadline only limits when a new attempt can be started, the last attempt
+// may wait for the full session timeout.
+//
+const uint32_t MAX_LOCK_ATTEMPTS = 4;
+const std::chrono::milliseconds LOCK_RETRY_BACKOFF_MIN(25);
+const std::chrono::milliseconds LOCK_RETRY_BACKOFF_MAX(400);
+const std::chrono::seconds LOCK_RETRY_DEADLINE(10);
+
+uint64_t MicrosecondsSince(Clock::time_point start)
 {
-	if (elements >= container.size())
-	{
-		container.clear();
-	}
-	else
-	{
-		container.erase
-		(
-			std::next(container.begin(), container.size() - elements),
-			container.end()
-		);
-	}
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+void Accumulate(WinFwTransactionStatistics &target, const WinFwTransactionStatistics &source)
+{
+	target.lockWaitUs += source.lockWaitUs;
+	target.lockAttempts += source.lockAttempts;
+	target.addUs += source.addUs;
+	target.purgeUs += source.purgeUs;
+	target.commitUs += source.commitUs;
+	target.totalUs += source.totalUs;
+	target.objectsAdded += source.objectsAdded;
+	target.objectsRemoved += source.objectsRemoved;
 }
 
 template<typename T>
@@ -41,38 +63,59 @@ void ProcessReverse(T &container, size_t elements, std::function<void(typename T
 	}
 }
 
-bool CheckpointKeyToIndex(const std::vector<SessionRecord> &container, uint32_t key, size_t &elementIndex)
+//
+// FNV-1a
+//
+uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
 {
-	auto index = 0;
+	const auto bytes = reinterpret_cast<const uint8_t *>(data);
 
-	for (auto it = container.begin(); it != container.end(); ++it, ++index)
+	for (size_t i = 0; i < size; ++i)
 	{
-		if (it->key() == key)
-		{
-			elementIndex = index;
-			return true;
-		}
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
 	}
 
-	return false;
+	return hash;
 }
 
 void ValidateObject(const wfp::IIdentifiable &object)
 {
-	const auto registry = MullvadGuids::Registry();
-
-	if (registry.end() == registry.find(object.id()))
+	if (false == MullvadGuids::Registry().contains(object.id()))
 	{
 		THROW_ERROR("Attempting to install non-registered WFP object");
 	}
 }
 
+//
+// Enough for reconciling a policy with a few hundred filters without spilling onto the heap.
+//
+const size_t TRANSACTION_ARENA_SIZE = 64 * 1024;
+
+//
+// Grows geometrically, so repeated batches don't cause a reallocation each.
+//
+template<typename T>
+void ReserveAdditional(std::vector<T> &v, size_t additional)
+{
+	const auto required = v.size() + additional;
+
+	if (required > v.capacity())
+	{
+		v.reserve(std::max(required, 2 * v.capacity()));
+	}
+}
 
 } // anonymous namespace
 
 SessionController::SessionController(std::unique_ptr<wfp::FilterEngine> &&engine)
 	: m_engine(std::move(engine))
+	, m_arena(TRANSACTION_ARENA_SIZE)
+	, m_reconciling(false)
+	, m_transactionStatistics{ 0 }
+	, m_statistics{ 0 }
 	, m_activeTransaction(false)
+	, m_jitter(std::random_device()())
 {
 }
 
@@ -82,6 +125,11 @@ SessionController::~SessionController()
 	// TODO: Review destruction of this instance and its owner.
 	//
 
+	if (nullptr == m_engine)
+	{
+		return;
+	}
+
 	try
 	{
 		executeTransaction([this](SessionController &, wfp::FilterEngine &)
@@ -96,6 +144,45 @@ SessionController::~SessionController()
 	}
 }
 
+std::unique_ptr<wfp::FilterEngine> SessionController::release()
+{
+	auto purged = false;
+
+	try
+	{
+		purged = executeTransaction([this](SessionController &, wfp::FilterEngine &)
+		{
+			reset();
+			return true;
+		});
+	}
+	catch (...)
+	{
+	}
+
+	auto engine = std::move(m_engine);
+
+	if (false == purged)
+	{
+		return nullptr;
+	}
+
+	return engine;
+}
+
+std::unique_ptr<wfp::FilterEngine> SessionController::detach()
+{
+	if (m_activeTransaction)
+	{
+		THROW_ERROR("Cannot detach while in transaction");
+	}
+
+	m_records.clear();
+	m_checkpoints.clear();
+
+	return std::move(m_engine);
+}
+
 bool SessionController::addProvider(wfp::ProviderBuilder &providerBuilder)
 {
 	if (false == m_activeTransaction)
@@ -107,11 +194,16 @@ bool SessionController::addProvider(wfp::ProviderBuilder &providerBuilder)
 
 	GUID key;
 
+	const auto start = Clock::now();
+
 	auto status = wfp::ObjectInstaller::AddProvider(*m_engine, providerBuilder, &key);
 
+	m_transactionStatistics.addUs += MicrosecondsSince(start);
+
 	if (status)
 	{
-		m_transactionRecords.emplace_back(SessionRecord(key, WfpObjectType::Provider));
+		pushRecord(SessionRecord(key, WfpObjectType::Provider));
+		++m_transactionStatistics.objectsAdded;
 	}
 
 	return status;
@@ -128,11 +220,16 @@ bool SessionController::addSublayer(wfp::SublayerBuilder &sublayerBuilder)
 
 	GUID key;
 
+	const auto start = Clock::now();
+
 	auto status = wfp::ObjectInstaller::AddSublayer(*m_engine, sublayerBuilder, &key);
 
+	m_transactionStatistics.addUs += MicrosecondsSince(start);
+
 	if (status)
 	{
-		m_transactionRecords.emplace_back(SessionRecord(key, WfpObjectType::Sublayer));
+		pushRecord(SessionRecord(key, WfpObjectType::Sublayer));
+		++m_transactionStatistics.objectsAdded;
 	}
 
 	return status;
@@ -147,18 +244,110 @@ bool SessionController::addFilter(wfp::FilterBuilder &filterBuilder, const wfp::
 
 	ValidateObject(filterBuilder);
 
+	auto content = FilterContent::Serialize(filterBuilder, conditionBuilder);
+
+	if (m_reconciling && reuseFilter(filterBuilder.id(), content))
+	{
+		return true;
+	}
+
 	UINT64 id;
 
+	const auto start = Clock::now();
+
 	auto status = wfp::ObjectInstaller::AddFilter(*m_engine, filterBuilder, conditionBuilder, &id);
 
+	m_transactionStatistics.addUs += MicrosecondsSince(start);
+
 	if (status)
 	{
-		m_transactionRecords.emplace_back(SessionRecord(id));
+		const auto contentHash = FilterContent::Hash(content);
+
+		pushRecord(SessionRecord(id, filterBuilder.id(), std::move(content), contentHash));
+		++m_transactionStatistics.objectsAdded;
 	}
 
 	return status;
 }
 
+bool SessionController::addFilter(const CompiledFilter &filter)
+{
+	if (false == m_activeTransaction)
+	{
+		THROW_ERROR("Cannot add filter outside transaction");
+	}
+
+	ValidateObject(filter);
+
+	return installFilter(filter);
+}
+
+bool SessionController::addFilters(const CompiledFilter *filters, size_t numFilters)
+{
+	if (false == m_activeTransaction)
+	{
+		THROW_ERROR("Cannot add filters outside transaction");
+	}
+
+	for (size_t i = 0; i < numFilters; ++i)
+	{
+		ValidateObject(filters[i]);
+	}
+
+	reserveRecords(numFilters);
+
+	for (size_t i = 0; i < numFilters; ++i)
+	{
+		if (false == installFilter(filters[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SessionController::installFilter(const CompiledFilter &filter)
+{
+	if (m_reconciling && reuseFilter(filter.id(), filter.content()))
+	{
+		return true;
+	}
+
+	UINT64 id;
+
+	const auto start = Clock::now();
+
+	const auto status = FwpmFilterAdd0(m_engine->session(), &filter.filter(), nullptr, &id);
+
+	m_transactionStatistics.addUs += MicrosecondsSince(start);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Add filter");
+	}
+
+	pushRecord(SessionRecord(id, filter.id(), FilterContent::Buffer(filter.content()), filter.contentHash()));
+	++m_transactionStatistics.objectsAdded;
+
+	return true;
+}
+
+bool SessionController::installFilters(const PreparedFilters &filters)
+{
+	reserveRecords(filters.filters().size());
+
+	for (const auto filter : filters.filters())
+	{
+		if (false == installFilter(*filter))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool SessionController::executeTransaction(TransactionFunctor operation)
 {
 	if (m_activeTransaction.exchange(true))
@@ -166,28 +355,127 @@ bool SessionController::executeTransaction(TransactionFunctor operation)
 		THROW_ERROR("Recursive/concurrent transactions are not supported");
 	}
 
+	m_journal.clear();
+	m_transactionStatistics = WinFwTransactionStatistics{ 0 };
+
+	bool committed = false;
+
+	const auto transactionStart = Clock::now();
+
 	common::memory::ScopeDestructor scopeDestructor;
 
-	scopeDestructor += [this]()
+	scopeDestructor += [this, &committed, &transactionStart]()
 	{
+		//
+		// The BFE transaction was aborted so bring the records back in sync.
+		//
+		if (false == committed)
+		{
+			rollbackJournal();
+		}
+
+		m_journal.clear();
+
+		m_arena.reset();
+
+		m_transactionStatistics.totalUs = MicrosecondsSince(transactionStart);
+		updateStatistics(committed);
+
+		shared::tracing::TransactionCompleted(committed, m_transactionStatistics.objectsAdded,
+			m_transactionStatistics.objectsRemoved, m_transactionStatistics.lockWaitUs,
+			m_transactionStatistics.lockAttempts, m_transactionStatistics.commitUs,
+			m_transactionStatistics.totalUs);
+
 		m_activeTransaction.store(false);
 	};
 
-	m_transactionRecords = m_records;
+	//
+	// Drive the transaction here rather than using wfp::Transaction,
+	// so the time spent waiting for the transaction lock can be measured.
+	//
 
-	auto transactionForwarder = [this, operation]()
+	auto status = beginTransaction();
+
+	m_transactionStatistics.lockWaitUs = MicrosecondsSince(transactionStart);
+
+	if (ERROR_SUCCESS != status)
 	{
-		return operation(*this, *m_engine);
-	};
+		THROW_WINDOWS_ERROR(status, "Initiate WFP transaction");
+	}
 
-	auto status = wfp::Transaction::Execute(*m_engine, transactionForwarder);
+	bool success = false;
 
-	if (status)
+	try
 	{
-		m_records.swap(m_transactionRecords);
+		success = operation(*this, *m_engine);
+	}
+	catch (...)
+	{
+		FwpmTransactionAbort0(m_engine->session());
+		throw;
 	}
 
-	return status;
+	if (false == success)
+	{
+		FwpmTransactionAbort0(m_engine->session());
+		return false;
+	}
+
+	const auto commitStart = Clock::now();
+
+	status = FwpmTransactionCommit0(m_engine->session());
+
+	m_transactionStatistics.commitUs = MicrosecondsSince(commitStart);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Commit WFP transaction");
+	}
+
+	committed = true;
+
+	return true;
+}
+
+DWORD SessionController::beginTransaction()
+{
+	static auto &retryCounter = shared::performance::CounterRegistry::Instance().counter("winfw.transaction.lockretry");
+
+	const auto deadline = Clock::now() + LOCK_RETRY_DEADLINE;
+
+	auto backoff = LOCK_RETRY_BACKOFF_MIN;
+
+	for (;;)
+	{
+		const auto status = FwpmTransactionBegin0(m_engine->session(), 0);
+
+		++m_transactionStatistics.lockAttempts;
+
+		if (static_cast<DWORD>(FWP_E_TIMEOUT) != status
+			|| MAX_LOCK_ATTEMPTS == m_transactionStatistics.lockAttempts)
+		{
+			return status;
+		}
+
+		//
+		// Spread out the retries, so that concurrent clients of BFE that
+		// time out together don't keep colliding.
+		//
+		std::uniform_int_distribution<long long> distribution(backoff.count() / 2, backoff.count());
+
+		const auto delay = std::chrono::milliseconds(distribution(m_jitter));
+
+		if (Clock::now() + delay >= deadline)
+		{
+			return status;
+		}
+
+		retryCounter.increment();
+
+		std::this_thread::sleep_for(delay);
+
+		backoff = std::min(backoff * 2, LOCK_RETRY_BACKOFF_MAX);
+	}
 }
 
 bool SessionController::executeReadOnlyTransaction(TransactionFunctor operation)
@@ -212,6 +500,12 @@ bool SessionController::executeReadOnlyTransaction(TransactionFunctor operation)
 	return wfp::Transaction::ExecuteReadOnly(*m_engine, transactionForwarder);
 }
 
+WinFwStatistics SessionController::statistics()
+{
+	std::scoped_lock<std::mutex> lock(m_statisticsLock);
+	return m_statistics;
+}
+
 uint32_t SessionController::checkpoint()
 {
 	if (m_activeTransaction)
@@ -229,12 +523,12 @@ uint32_t SessionController::checkpoint()
 
 uint32_t SessionController::peekCheckpoint()
 {
-	if (m_transactionRecords.empty())
+	if (m_records.empty())
 	{
 		return 0;
 	}
 
-	return m_transactionRecords.back().key();
+	return m_records.back().key();
 }
 
 void SessionController::revert(uint32_t key)
@@ -244,14 +538,14 @@ void SessionController::revert(uint32_t key)
 		THROW_ERROR("Cannot revert session state outside transaction");
 	}
 
-	size_t elementIndex = 0;
+	const auto checkpoint = m_checkpoints.find(key);
 
-	if (false == CheckpointKeyToIndex(m_transactionRecords, key, elementIndex))
+	if (m_checkpoints.end() == checkpoint)
 	{
 		THROW_ERROR("Invalid checkpoint key (checkpoint may have been overwritten?)");
 	}
 
-	const size_t numRemove = m_transactionRecords.size() - (elementIndex + 1);
+	const size_t numRemove = m_records.size() - (checkpoint->second + 1);
 
 	rewindState(numRemove);
 }
@@ -263,26 +557,491 @@ void SessionController::reset()
 		THROW_ERROR("Cannot reset session state outside transaction");
 	}
 
-	rewindState(m_transactionRecords.size());
+	rewindState(m_records.size());
+}
+
+void SessionController::adoptProvider(const GUID &key)
+{
+	if (false == m_activeTransaction)
+	{
+		THROW_ERROR("Cannot adopt provider outside transaction");
+	}
+
+	const auto installed = wfp::ObjectExplorer::GetProvider(*m_engine, key, [](const FWPM_PROVIDER0 &)
+	{
+		return true;
+	});
+
+	if (false == installed)
+	{
+		THROW_ERROR("Cannot adopt provider that is not installed");
+	}
+
+	pushRecord(SessionRecord(key, WfpObjectType::Provider));
+}
+
+void SessionController::adoptSublayer(const GUID &key)
+{
+	if (false == m_activeTransaction)
+	{
+		THROW_ERROR("Cannot adopt sublayer outside transaction");
+	}
+
+	const auto installed = wfp::ObjectExplorer::GetSublayer(*m_engine, key, [](const FWPM_SUBLAYER0 &)
+	{
+		return true;
+	});
+
+	if (false == installed)
+	{
+		THROW_ERROR("Cannot adopt sublayer that is not installed");
+	}
+
+	pushRecord(SessionRecord(key, WfpObjectType::Sublayer));
+}
+
+void SessionController::adoptFilters(const GUID &providerKey)
+{
+	if (false == m_activeTransaction)
+	{
+		THROW_ERROR("Cannot adopt filters outside transaction");
+	}
+
+	wfp::ObjectEnumerator::Filters(*m_engine, [&](const FWPM_FILTER0 &filter)
+	{
+		if (nullptr != filter.providerKey && providerKey == *filter.providerKey)
+		{
+			auto content = FilterContent::Serialize(filter);
+			const auto contentHash = FilterContent::Hash(content);
+
+			pushRecord(SessionRecord(filter.filterId, filter.filterKey, std::move(content), contentHash));
+		}
+
+		return true;
+	});
+}
+
+bool SessionController::reconcile(uint32_t key, InstallerFunctor operation)
+{
+	return reconcileWith(key, [this, &operation]()
+	{
+		return operation(*this);
+	});
+}
+
+bool SessionController::reconcile(uint32_t key, const PreparedFilters &filters)
+{
+	return reconcileWith(key, [this, &filters]()
+	{
+		return installFilters(filters);
+	});
+}
+
+bool SessionController::reconcile(uint32_t key, const PreparedFilters &filters,
+	const PreparedFilters &nestedFilters, uint32_t &nestedKey)
+{
+	//
+	// Both sets are reconciled at once, so filters can be reused across the nested checkpoint.
+	// Reused records are moved back onto the stack, so the checkpoint is the last record of the first set.
+	//
+	return reconcileWith(key, [&]()
+	{
+		if (false == installFilters(filters))
+		{
+			return false;
+		}
+
+		nestedKey = peekCheckpoint();
+
+		return installFilters(nestedFilters);
+	});
+}
+
+WinFwPolicyEstimate SessionController::estimateReconcile(uint32_t key, const PreparedFilters &filters) const
+{
+	const auto checkpoint = m_checkpoints.find(key);
+
+	if (m_checkpoints.end() == checkpoint)
+	{
+		THROW_ERROR("Invalid checkpoint key (checkpoint may have been overwritten?)");
+	}
+
+	//
+	// Mirror the matching done by reuseFilter().
+	//
+	const auto first = checkpoint->second + 1;
+
+	std::unordered_map<GUID, const SessionRecord *> existing;
+
+	for (size_t i = first; i < m_records.size(); ++i)
+	{
+		if (WfpObjectType::Filter == m_records[i].type())
+		{
+			existing.emplace(m_records[i].id(), &m_records[i]);
+		}
+	}
+
+	WinFwPolicyEstimate estimate = { 0 };
+
+	for (const auto filter : filters.filters())
+	{
+		if (MullvadGuids::NullKey() != filter->id())
+		{
+			const auto match = existing.find(filter->id());
+
+			if (existing.end() != match)
+			{
+				const auto reused = (match->second->content() == filter->content());
+
+				existing.erase(match);
+
+				if (reused)
+				{
+					++estimate.filtersUnchanged;
+					continue;
+				}
+			}
+		}
+
+		++estimate.filtersAdded;
+		estimate.bytesAdded += filter->content().size();
+	}
+
+	estimate.objectsRemoved = (m_records.size() - first) - estimate.filtersUnchanged;
+
+	return estimate;
+}
+
+uint64_t SessionController::digest(uint32_t key) const
+{
+	const auto checkpoint = m_checkpoints.find(key);
+
+	if (m_checkpoints.end() == checkpoint)
+	{
+		THROW_ERROR("Invalid checkpoint key (checkpoint may have been overwritten?)");
+	}
+
+	std::vector<const SessionRecord *> filters;
+
+	for (size_t i = checkpoint->second + 1; i < m_records.size(); ++i)
+	{
+		filters.push_back(&m_records[i]);
+	}
+
+	std::sort(filters.begin(), filters.end(), [](const SessionRecord *lhs, const SessionRecord *rhs)
+	{
+		return 0 > memcmp(&lhs->id(), &rhs->id(), sizeof(GUID));
+	});
+
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (const auto record : filters)
+	{
+		const auto type = record->type();
+
+		hash = HashBytes(hash, &type, sizeof(type));
+		hash = HashBytes(hash, &record->id(), sizeof(GUID));
+		hash = HashBytes(hash, record->content().data(), record->content().size());
+	}
+
+	return hash;
+}
+
+bool SessionController::matches(uint32_t key, const std::vector<rules::IFirewallRule::FilterDescriptor> &filters) const
+{
+	const auto checkpoint = m_checkpoints.find(key);
+
+	if (m_checkpoints.end() == checkpoint)
+	{
+		THROW_ERROR("Invalid checkpoint key (checkpoint may have been overwritten?)");
+	}
+
+	const auto first = checkpoint->second + 1;
+
+	if (m_records.size() - first != filters.size())
+	{
+		return false;
+	}
+
+	std::unordered_map<GUID, uint64_t> existing;
+
+	for (size_t i = first; i < m_records.size(); ++i)
+	{
+		const auto &record = m_records[i];
+
+		if (WfpObjectType::Filter != record.type() || MullvadGuids::NullKey() == record.id())
+		{
+			return false;
+		}
+
+		existing.emplace(record.id(), record.contentHash());
+	}
+
+	for (const auto &filter : filters)
+	{
+		const auto match = existing.find(filter.key);
+
+		if (existing.end() == match || match->second != filter.contentHash)
+		{
+			return false;
+		}
+
+		existing.erase(match);
+	}
+
+	return true;
+}
+
+std::unordered_map<UINT64, GUID> SessionController::filterKeys() const
+{
+	std::unordered_map<UINT64, GUID> keys;
+
+	for (const auto &record : m_records)
+	{
+		if (WfpObjectType::Filter == record.type() && MullvadGuids::NullKey() != record.id())
+		{
+			keys.emplace(record.filterId(), record.id());
+		}
+	}
+
+	return keys;
+}
+
+bool SessionController::reconcileWith(uint32_t key, std::function<bool()> operation)
+{
+	if (false == m_activeTransaction)
+	{
+		THROW_ERROR("Cannot reconcile session state outside transaction");
+	}
+
+	const auto checkpoint = m_checkpoints.find(key);
+
+	if (m_checkpoints.end() == checkpoint)
+	{
+		THROW_ERROR("Invalid checkpoint key (checkpoint may have been overwritten?)");
+	}
+
+	//
+	// Set aside everything after the checkpoint.
+	// Records are moved back onto the stack as their filters are reused.
+	//
+	const size_t numRemove = m_records.size() - (checkpoint->second + 1);
+
+	common::memory::ScopeDestructor scopeDestructor;
+
+	scopeDestructor += [this]()
+	{
+		m_reconciling = false;
+		m_reconcileRecords.reset();
+		m_reconcileIndex.reset();
+	};
+
+	auto &records = m_reconcileRecords.emplace(m_arena.resource());
+	auto &index = m_reconcileIndex.emplace(m_arena.resource());
+
+	records.reserve(numRemove);
+
+	for (size_t i = 0; i < numRemove; ++i)
+	{
+		records.emplace_back(popRecord());
+	}
+
+	std::reverse(records.begin(), records.end());
+
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const auto &record = *records[i];
+
+		if (WfpObjectType::Filter == record.type())
+		{
+			index.emplace(record.id(), i);
+		}
+	}
+
+	m_reconciling = true;
+
+	if (false == operation())
+	{
+		return false;
+	}
+
+	//
+	// Purge objects that are not part of the new state.
+	//
+	SessionRecordPurge purge(m_arena.resource());
+
+	for (const auto &record : records)
+	{
+		if (record.has_value())
+		{
+			purge.add(*record);
+		}
+	}
+
+	purgeRecords(purge);
+
+	return true;
+}
+
+bool SessionController::reuseFilter(const GUID &filterKey, const FilterContent::Buffer &content)
+{
+	if (MullvadGuids::NullKey() == filterKey)
+	{
+		return false;
+	}
+
+	const auto index = m_reconcileIndex->find(filterKey);
+
+	if (m_reconcileIndex->end() == index)
+	{
+		return false;
+	}
+
+	auto &record = (*m_reconcileRecords)[index->second];
+
+	m_reconcileIndex->erase(index);
+
+	if (record->content() == content)
+	{
+		pushRecord(std::move(*record));
+		record.reset();
+
+		return true;
+	}
+
+	//
+	// Same key but different definition.
+	// Remove the existing filter to make room for the updated one.
+	//
+	purgeRecord(*record);
+	record.reset();
+
+	return false;
 }
 
 void SessionController::rewindState(size_t steps)
 {
-	auto purged = 0;
+	SessionRecordPurge purge(m_arena.resource());
 
-	try
+	ProcessReverse(m_records, steps, [&purge](SessionRecord &record)
+	{
+		purge.add(record);
+	});
+
+	purgeRecords(purge);
+
+	for (size_t i = 0; i < steps; ++i)
 	{
-		ProcessReverse(m_transactionRecords, steps, [this, &purged](SessionRecord &record)
+		dropRecord();
+	}
+}
+
+void SessionController::pushRecord(SessionRecord &&record)
+{
+	m_checkpoints[record.key()] = m_records.size();
+	m_records.emplace_back(std::move(record));
+
+	m_journal.emplace_back(JournalEntry{ true, std::nullopt });
+}
+
+void SessionController::reserveRecords(size_t count)
+{
+	ReserveAdditional(m_records, count);
+	ReserveAdditional(m_journal, count);
+}
+
+void SessionController::purgeRecord(SessionRecord &record)
+{
+	const auto start = Clock::now();
+
+	record.purge(*m_engine);
+
+	m_transactionStatistics.purgeUs += MicrosecondsSince(start);
+	++m_transactionStatistics.objectsRemoved;
+}
+
+void SessionController::purgeRecords(const SessionRecordPurge &purge)
+{
+	const auto start = Clock::now();
+
+	purge.execute(*m_engine);
+
+	m_transactionStatistics.purgeUs += MicrosecondsSince(start);
+	m_transactionStatistics.objectsRemoved += purge.size();
+}
+
+SessionRecord SessionController::popRecord()
+{
+	auto record = std::move(m_records.back());
+
+	m_records.pop_back();
+	m_checkpoints.erase(record.key());
+
+	m_journal.emplace_back(JournalEntry{ false, record });
+
+	return record;
+}
+
+void SessionController::dropRecord()
+{
+	m_checkpoints.erase(m_records.back().key());
+
+	m_journal.emplace_back(JournalEntry{ false, std::move(m_records.back()) });
+	m_records.pop_back();
+}
+
+void SessionController::rollbackJournal()
+{
+	for (auto it = m_journal.rbegin(); it != m_journal.rend(); ++it)
+	{
+		if (it->pushed)
 		{
-			record.purge(*m_engine);
-			++purged;
-		});
+			m_checkpoints.erase(m_records.back().key());
+			m_records.pop_back();
+		}
+		else
+		{
+			m_checkpoints[it->record->key()] = m_records.size();
+			m_records.emplace_back(std::move(*it->record));
+		}
 	}
-	catch (...)
+}
+
+void SessionController::updateStatistics(bool committed)
+{
+	static auto &registry = shared::performance::CounterRegistry::Instance();
+
+	static auto &abortedCounter = registry.counter("winfw.transaction.aborted");
+	static auto &lockWaitHistogram = registry.histogram("winfw.transaction.lockwait");
+	static auto &commitHistogram = registry.histogram("winfw.transaction.commit");
+	static auto &totalHistogram = registry.histogram("winfw.transaction.total");
+
+	if (committed)
 	{
-		EraseBack(m_transactionRecords, purged);
-		throw;
+		lockWaitHistogram.record(std::chrono::microseconds(m_transactionStatistics.lockWaitUs));
+		commitHistogram.record(std::chrono::microseconds(m_transactionStatistics.commitUs));
+		totalHistogram.record(std::chrono::microseconds(m_transactionStatistics.totalUs));
+	}
+	else
+	{
+		abortedCounter.increment();
+	}
+
+	std::scoped_lock<std::mutex> lock(m_statisticsLock);
+
+	++m_statistics.numTransactions;
+
+	if (false == committed)
+	{
+		++m_statistics.numFailedTransactions;
+	}
+
+	m_statistics.last = m_transactionStatistics;
+
+	if (m_transactionStatistics.totalUs > m_statistics.slowest.totalUs)
+	{
+		m_statistics.slowest = m_transactionStatistics;
 	}
 
-	EraseBack(m_transactionRecords, steps);
+	Accumulate(m_statistics.accumulated, m_transactionStatistics);
 }
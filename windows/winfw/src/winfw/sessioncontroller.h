@@ -1,12 +1,22 @@
 #pragma once
 
+#include "winfw.h"
+#include "guidhash.h"
 #include "iobjectinstaller.h"
+#include "preparedfilters.h"
 #include "sessionrecord.h"
+#include "rules/ifirewallrule.h"
+#include "transactionarena.h"
 #include "libwfp/filterengine.h"
 #include "libwfp/iidentifiable.h"
 #include <functional>
 #include <atomic>
+#include <memory_resource>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <unordered_map>
 #include <vector>
 
 class SessionController : public IObjectInstaller
@@ -16,15 +26,37 @@ public:
 	SessionController(std::unique_ptr<wfp::FilterEngine> &&engine);
 	~SessionController();
 
+	//
+	// Purge all objects in the stack and hand back the engine, so the session
+	// can be reused. Returns nullptr if the objects could not be purged.
+	// The instance cannot be used afterwards.
+	//
+	std::unique_ptr<wfp::FilterEngine> release();
+
+	//
+	// Hand back the engine without purging anything, so the objects remain
+	// installed for another instance to adopt.
+	// The instance cannot be used afterwards.
+	//
+	std::unique_ptr<wfp::FilterEngine> detach();
+
 	bool addProvider(wfp::ProviderBuilder &providerBuilder) override;
 	bool addSublayer(wfp::SublayerBuilder &sublayerBuilder) override;
 	bool addFilter(wfp::FilterBuilder &filterBuilder, const wfp::IConditionBuilder &conditionBuilder) override;
+	bool addFilter(const CompiledFilter &filter) override;
+	bool addFilters(const CompiledFilter *filters, size_t numFilters) override;
 
 	using TransactionFunctor = std::function<bool(SessionController &, wfp::FilterEngine &)>;
 
 	bool executeTransaction(TransactionFunctor operation);
 	bool executeReadOnlyTransaction(TransactionFunctor operation);
 
+	//
+	// Timings and counts for transactions executed through executeTransaction()
+	// Can be called from any thread
+	//
+	WinFwStatistics statistics();
+
 	//
 	// Retrieve checkpoint key that can be used to restore the current session state
 	// This should be done outside of an active transaction
@@ -48,17 +80,156 @@ public:
 	//
 	void reset();
 
+	//
+	// Take ownership of objects that are already installed in BFE, e.g. left over
+	// from a previous instance, without reinstalling them.
+	// Use only inside active transaction.
+	//
+	void adoptProvider(const GUID &key);
+	void adoptSublayer(const GUID &key);
+
+	//
+	// Adopt all filters that are owned by the provider.
+	//
+	void adoptFilters(const GUID &providerKey);
+
+	using InstallerFunctor = std::function<bool(IObjectInstaller &)>;
+
+	//
+	// Replace objects in the stack, added after the checkpoint, with objects added by 'operation'
+	// Filters that are identical, by key and content, to an existing filter are left in place
+	// Use only inside active transaction
+	//
+	bool reconcile(uint32_t key, InstallerFunctor operation);
+
+	//
+	// Same as above, but with filters that have already been validated and marshalled.
+	// Nothing but adding and deleting filters happens inside the transaction.
+	//
+	bool reconcile(uint32_t key, const PreparedFilters &filters);
+
+	//
+	// Same as above, but 'nestedFilters' are added after a checkpoint of their own.
+	// The nested checkpoint can later be used to reconcile only the nested filters,
+	// for as long as nothing before it is changed.
+	// Use only inside active transaction
+	//
+	bool reconcile(uint32_t key, const PreparedFilters &filters, const PreparedFilters &nestedFilters, uint32_t &nestedKey);
+
+	//
+	// Determine what reconcile() would change, without changing anything.
+	// Can be used outside of a transaction.
+	//
+	WinFwPolicyEstimate estimateReconcile(uint32_t key, const PreparedFilters &filters) const;
+
+	//
+	// Digest of the filters recorded after the checkpoint, by key and content.
+	// Doesn't depend on the order in which the filters were recorded.
+	//
+	uint64_t digest(uint32_t key) const;
+
+	//
+	// Whether the objects recorded after the checkpoint are exactly the described
+	// filters, by key and content hash. If so, reconciling with the filters that
+	// were described would not change anything.
+	// Can be used outside of a transaction.
+	//
+	bool matches(uint32_t key, const std::vector<rules::IFirewallRule::FilterDescriptor> &filters) const;
+
+	//
+	// Maps the run-time id of every installed filter that has a key, to the key.
+	// Use only while no transaction is active.
+	//
+	std::unordered_map<UINT64, GUID> filterKeys() const;
+
 private:
 
 	SessionController(const SessionController &) = delete;
 	SessionController &operator=(const SessionController &) = delete;
 
+	//
+	// Begin a BFE transaction, retrying if the transaction lock can't be acquired in time.
+	//
+	DWORD beginTransaction();
+
 	void rewindState(size_t steps);
 
+	void pushRecord(SessionRecord &&record);
+
+	//
+	// Make room for 'count' more records, and their journal entries, ahead of a batch.
+	//
+	void reserveRecords(size_t count);
+	SessionRecord popRecord();
+
+	//
+	// Same as popRecord(), but the record is moved to the journal rather than copied.
+	//
+	void dropRecord();
+
+	void rollbackJournal();
+
+	void purgeRecord(SessionRecord &record);
+	void purgeRecords(const SessionRecordPurge &purge);
+
+	void updateStatistics(bool committed);
+
+	bool reconcileWith(uint32_t key, std::function<bool()> operation);
+
+	bool reuseFilter(const GUID &filterKey, const FilterContent::Buffer &content);
+
+	//
+	// Add a validated filter.
+	//
+	bool installFilter(const CompiledFilter &filter);
+	bool installFilters(const PreparedFilters &filters);
+
 	std::unique_ptr<wfp::FilterEngine> m_engine;
 
 	std::vector<SessionRecord> m_records;
-	std::vector<SessionRecord> m_transactionRecords;
+
+	//
+	// Maps checkpoint key -> index in m_records
+	//
+	std::unordered_map<uint32_t, size_t> m_checkpoints;
+
+	//
+	// Undo log for the active transaction
+	// Each entry is either a push of a record, or a pop of the recorded record
+	//
+	struct JournalEntry
+	{
+		bool pushed;
+		std::optional<SessionRecord> record;
+	};
+
+	std::vector<JournalEntry> m_journal;
+
+	//
+	// Backs containers that don't outlive the active transaction, so applying a policy
+	// mostly avoids the process heap. Reset when the transaction completes.
+	//
+	TransactionArena m_arena;
+
+	//
+	// Records that are candidates for reuse while reconciling
+	// Slots are cleared as records are reused or purged
+	// Only set while reconciling, since the storage is in the arena
+	//
+	std::optional<std::pmr::vector<std::optional<SessionRecord> > > m_reconcileRecords;
+
+	//
+	// Maps filter key -> index in m_reconcileRecords
+	//
+	std::optional<std::pmr::unordered_map<GUID, size_t> > m_reconcileIndex;
+	bool m_reconciling;
+
+	WinFwTransactionStatistics m_transactionStatistics;
+
+	std::mutex m_statisticsLock;
+	WinFwStatistics m_statistics;
 
 	std::atomic_bool m_activeTransaction;
+
+	std::minstd_rand m_jitter;
 };
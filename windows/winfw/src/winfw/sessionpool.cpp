@@ -0,0 +1,76 @@
+#include "stdafx.h"
+#include "sessionpool.h"
+#include <exception>
+#include <mutex>
+
+namespace
+{
+
+std::mutex g_lock;
+
+//
+// The idle session is deliberately not closed when the module is unloaded.
+// Closing it would be an RPC while the loader lock is held.
+//
+wfp::FilterEngine *g_idleEngine = nullptr;
+uint32_t g_idleTimeout = 0;
+
+} // anonymous namespace
+
+//static
+std::unique_ptr<wfp::FilterEngine> SessionPool::Acquire(uint32_t timeout)
+{
+	{
+		std::scoped_lock<std::mutex> lock(g_lock);
+
+		if (nullptr != g_idleEngine && timeout == g_idleTimeout)
+		{
+			std::unique_ptr<wfp::FilterEngine> engine(g_idleEngine);
+			g_idleEngine = nullptr;
+
+			return engine;
+		}
+	}
+
+	return wfp::FilterEngine::StandardSession(timeout);
+}
+
+//static
+void SessionPool::Release(std::unique_ptr<wfp::FilterEngine> &&engine, uint32_t timeout)
+{
+	if (nullptr == engine)
+	{
+		return;
+	}
+
+	//
+	// The session being replaced, if any, is closed outside the lock.
+	//
+	std::unique_ptr<wfp::FilterEngine> replaced;
+
+	{
+		std::scoped_lock<std::mutex> lock(g_lock);
+
+		replaced.reset(g_idleEngine);
+
+		g_idleEngine = engine.release();
+		g_idleTimeout = timeout;
+	}
+}
+
+SessionPool::Lease::Lease(uint32_t timeout)
+	: m_engine(SessionPool::Acquire(timeout))
+	, m_timeout(timeout)
+	, m_uncaughtExceptions(std::uncaught_exceptions())
+{
+}
+
+SessionPool::Lease::~Lease()
+{
+	if (std::uncaught_exceptions() > m_uncaughtExceptions)
+	{
+		return;
+	}
+
+	SessionPool::Release(std::move(m_engine), m_timeout);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "libwfp/filterengine.h"
+#include <cstdint>
+#include <memory>
+
+//
+// Keeps an idle BFE session around for reuse.
+//
+// Opening a session is an RPC to BFE. This is significant on paths that
+// are otherwise cheap, e.g. when resetting the firewall after the context
+// has been torn down.
+//
+// Sessions are standard sessions, and are handed out exclusively. A single
+// idle session is kept. It's reused only by callers that specify the same
+// transaction timeout.
+//
+class SessionPool
+{
+public:
+
+	SessionPool() = delete;
+
+	static std::unique_ptr<wfp::FilterEngine> Acquire(uint32_t timeout);
+
+	//
+	// Only return sessions that are in a known good state,
+	// i.e. without an active transaction.
+	//
+	static void Release(std::unique_ptr<wfp::FilterEngine> &&engine, uint32_t timeout);
+
+	//
+	// Session that is returned to the pool when the lease goes out of scope.
+	// If the scope is exited because of an exception, the session is closed
+	// instead, since it may be the cause of the failure.
+	//
+	class Lease
+	{
+	public:
+
+		explicit Lease(uint32_t timeout);
+		~Lease();
+
+		wfp::FilterEngine &operator*()
+		{
+			return *m_engine;
+		}
+
+		wfp::FilterEngine *operator->()
+		{
+			return m_engine.get();
+		}
+
+	private:
+
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+
+		std::unique_ptr<wfp::FilterEngine> m_engine;
+		uint32_t m_timeout;
+		int m_uncaughtExceptions;
+	};
+};
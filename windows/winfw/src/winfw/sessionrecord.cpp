@@ -4,6 +4,7 @@
 #include <libcommon/error.h>
 #include <atomic>
 #include <cstdint>
+#include <utility>
 
 namespace
 {
@@ -14,15 +15,29 @@ std::atomic<uint32_t> g_keybase = 0;
 
 SessionRecord::SessionRecord(const GUID &id, WfpObjectType type)
 	: m_type(type)
-	, m_id(id)
 	, m_key(g_keybase++)
+	, m_id(id)
+	, m_filterId(0)
+	, m_contentHash(0)
 {
 }
 
 SessionRecord::SessionRecord(UINT64 id)
 	: m_type(WfpObjectType::Filter)
+	, m_key(g_keybase++)
+	, m_id{ 0 }
 	, m_filterId(id)
+	, m_contentHash(0)
+{
+}
+
+SessionRecord::SessionRecord(UINT64 id, const GUID &filterKey, FilterContent::Buffer &&content, uint64_t contentHash)
+	: m_type(WfpObjectType::Filter)
 	, m_key(g_keybase++)
+	, m_id(filterKey)
+	, m_filterId(id)
+	, m_contentHash(contentHash)
+	, m_content(std::move(content))
 {
 }
 
@@ -56,3 +71,47 @@ uint32_t SessionRecord::key() const
 {
 	return m_key;
 }
+
+void SessionRecordPurge::add(const SessionRecord &record)
+{
+	switch (record.type())
+	{
+		case WfpObjectType::Provider:
+		{
+			m_providers.push_back(record.id());
+			break;
+		}
+		case WfpObjectType::Sublayer:
+		{
+			m_sublayers.push_back(record.id());
+			break;
+		}
+		case WfpObjectType::Filter:
+		{
+			m_filterIds.push_back(record.filterId());
+			break;
+		}
+		default:
+		{
+			THROW_ERROR("Missing case handler in switch clause");
+		}
+	};
+}
+
+void SessionRecordPurge::execute(wfp::FilterEngine &engine) const
+{
+	for (const auto id : m_filterIds)
+	{
+		wfp::ObjectDeleter::DeleteFilter(engine, id);
+	}
+
+	for (const auto &id : m_sublayers)
+	{
+		wfp::ObjectDeleter::DeleteSublayer(engine, id);
+	}
+
+	for (const auto &id : m_providers)
+	{
+		wfp::ObjectDeleter::DeleteProvider(engine, id);
+	}
+}
@@ -2,8 +2,11 @@
 
 #include "libwfp/filterengine.h"
 #include "wfpobjecttype.h"
+#include "filtercontent.h"
 #include <guiddef.h>
 #include <windows.h>
+#include <memory_resource>
+#include <vector>
 
 class SessionRecord
 {
@@ -11,21 +14,101 @@ public:
 
 	SessionRecord(const GUID &id, WfpObjectType type);
 	SessionRecord(UINT64 id);
+	SessionRecord(UINT64 id, const GUID &filterKey, FilterContent::Buffer &&content, uint64_t contentHash);
 
 	SessionRecord(const SessionRecord &) = default;
 	SessionRecord(SessionRecord &&) = default;
 	SessionRecord &operator=(const SessionRecord &) = default;
+	SessionRecord &operator=(SessionRecord &&) = default;
 
 	void purge(wfp::FilterEngine &engine);
 
 	uint32_t key() const;
 
+	WfpObjectType type() const
+	{
+		return m_type;
+	}
+
+	//
+	// Object GUID. For filters this is the filter key, which may be unset.
+	//
+	const GUID &id() const
+	{
+		return m_id;
+	}
+
+	//
+	// Run-time filter id. Only valid for filters.
+	//
+	UINT64 filterId() const
+	{
+		return m_filterId;
+	}
+
+	//
+	// Serialized filter definition.
+	// Only available for filters that were recorded with content.
+	//
+	const FilterContent::Buffer &content() const
+	{
+		return m_content;
+	}
+
+	//
+	// See FilterContent::Hash().
+	//
+	uint64_t contentHash() const
+	{
+		return m_contentHash;
+	}
+
 private:
 
+	//
+	// Ordered to avoid padding. The stack holds a record per installed object.
+	//
+
 	WfpObjectType m_type;
+	uint32_t m_key;
 
 	GUID m_id;
 	UINT64 m_filterId;
+	uint64_t m_contentHash;
 
-	uint32_t m_key;
+	FilterContent::Buffer m_content;
+};
+
+//
+// Objects to be deleted together, stored by type.
+//
+// Filters are deleted first, then sublayers and then providers, so no object
+// is deleted while objects that depend on it remain. This is always a valid
+// order, regardless of the order in which the objects were recorded.
+//
+class SessionRecordPurge
+{
+public:
+
+	explicit SessionRecordPurge(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+		: m_filterIds(resource)
+		, m_sublayers(resource)
+		, m_providers(resource)
+	{
+	}
+
+	void add(const SessionRecord &record);
+
+	size_t size() const
+	{
+		return m_filterIds.size() + m_sublayers.size() + m_providers.size();
+	}
+
+	void execute(wfp::FilterEngine &engine) const;
+
+private:
+
+	std::pmr::vector<UINT64> m_filterIds;
+	std::pmr::vector<GUID> m_sublayers;
+	std::pmr::vector<GUID> m_providers;
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+//
+// Memory for containers that only live for the duration of a transaction.
+//
+// Allocations are carved out of a buffer that is allocated once, and are all
+// freed together when the arena is reset. Allocations that don't fit in the
+// buffer are passed on to the default resource, and are also freed on reset.
+//
+class TransactionArena
+{
+public:
+
+	explicit TransactionArena(size_t capacity)
+		: m_buffer(std::make_unique<std::byte[]>(capacity))
+		, m_resource(m_buffer.get(), capacity, std::pmr::get_default_resource())
+	{
+	}
+
+	TransactionArena(const TransactionArena &) = delete;
+	TransactionArena &operator=(const TransactionArena &) = delete;
+
+	std::pmr::memory_resource *resource()
+	{
+		return &m_resource;
+	}
+
+	//
+	// Everything allocated from the arena must have been destroyed.
+	//
+	void reset()
+	{
+		m_resource.release();
+	}
+
+private:
+
+	std::unique_ptr<std::byte[]> m_buffer;
+	std::pmr::monotonic_buffer_resource m_resource;
+};
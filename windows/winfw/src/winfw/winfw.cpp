@@ -2,9 +2,32 @@
 #include "winfw.h"
 #include "fwcontext.h"
 #include "objectpurger.h"
+#include "policyworker.h"
+#include "blockedeventmonitor.h"
+#include "filterreport.h"
+#include "nativediagnostics.h"
+#include "rulecounters.h"
+#include "sessionpool.h"
+#include "policyrecorder.h"
+#include "dnsleakcheck.h"
+#include "mullvadguids.h"
+#include "rules/tunnelinterface.h"
 #include <windows.h>
 #include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libcommon/string.h>
+#include <libshared/performance/counterregistry.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <vector>
 
 namespace
 {
@@ -15,64 +38,1761 @@ MullvadLogSink g_logSink = nullptr;
 void *g_logSinkContext = nullptr;
 
 FwContext *g_fwContext = nullptr;
+PolicyWorker *g_policyWorker = nullptr;
+BlockedEventMonitor *g_blockedEventMonitor = nullptr;
+
+//
+// Read while holding the policy lock, so filter keys are resolved against a stable session.
+//
+RuleCounters *g_ruleCounters = nullptr;
+
+constexpr uint32_t DEFAULT_BLOCKED_EVENTS_WINDOW_MS = 1000;
+
+constexpr uint32_t DEFAULT_DNS_LEAK_CHECK_TIMEOUT_MS = 250;
+constexpr uint32_t MAX_DNS_LEAK_CHECK_TIMEOUT_MS = 2000;
+
+//
+// Serializes policy changes made synchronously with those made by the worker.
+//
+std::mutex g_policyLock;
+
+//
+// Held exclusively while the context and worker are created or destroyed, and shared
+// by entry points that can be called on other threads than the client's, such as
+// WinFw_ApplyPolicyOffline(). This keeps the context alive while they use it.
+//
+std::shared_mutex g_contextLock;
+
+//
+// Incremented whenever a policy is applied synchronously. A request the worker took
+// off its queue before then is dropped, rather than applied after the newer policy.
+//
+std::atomic<uint64_t> g_policyGeneration = 0;
+
+//
+// Number of synchronous calls that are waiting for the policy lock.
+// Idle work checks this, and gives way to them.
+//
+std::atomic<uint32_t> g_syncWaiters = 0;
+
+//
+// Policy lock as taken by synchronous calls, so idle work knows to give way.
+//
+class SyncPolicyLock
+{
+public:
+
+	SyncPolicyLock()
+	{
+		++g_syncWaiters;
+
+		common::memory::ScopeDestructor sd;
+
+		sd += []()
+		{
+			--g_syncWaiters;
+		};
+
+		g_policyLock.lock();
+	}
+
+	~SyncPolicyLock()
+	{
+		g_policyLock.unlock();
+	}
+
+	SyncPolicyLock(const SyncPolicyLock &) = delete;
+	SyncPolicyLock &operator=(const SyncPolicyLock &) = delete;
+};
+
+//
+// Set while a recording is in progress. See WinFw_StartRecording().
+//
+std::shared_ptr<PolicyRecorder> g_recorder;
+
+//
+// Calls made while handling a recorded call, such as WinFw_Deinitialize() being
+// called by WinFw_DeinitializeWithCleanupPolicy(), are not recorded separately.
+//
+thread_local uint32_t g_recordingDepth = 0;
+
+//
+// Records a call when going out of scope, if a recording is in progress.
+// The call is recorded as failed unless complete() is called with a successful status.
+//
+class RecordedCall
+{
+public:
+
+	using Encoder = std::function<void(policyrecording::Writer &arguments)>;
+
+	RecordedCall(policyrecording::Call call, const Encoder &encode, uint8_t flags = 0)
+		: m_call(call)
+		, m_flags(flags)
+		, m_status(false)
+	{
+		if (0 == g_recordingDepth++)
+		{
+			m_recorder = std::atomic_load(&g_recorder);
+		}
+
+		if (m_recorder)
+		{
+			try
+			{
+				encode(m_arguments);
+			}
+			catch (...)
+			{
+				m_recorder.reset();
+			}
+		}
+
+		m_start = std::chrono::steady_clock::now();
+	}
+
+	~RecordedCall()
+	{
+		--g_recordingDepth;
+
+		if (!m_recorder)
+		{
+			return;
+		}
+
+		const auto flags = m_flags | (m_status ? policyrecording::RECORD_FLAG_SUCCESS : 0);
+
+		try
+		{
+			m_recorder->record(m_call, static_cast<uint8_t>(flags), m_arguments, m_start,
+				std::chrono::steady_clock::now() - m_start);
+		}
+		catch (std::exception &err)
+		{
+			if (nullptr != g_logSink)
+			{
+				g_logSink(MULLVAD_LOG_LEVEL_WARNING, err.what(), g_logSinkContext);
+			}
+		}
+		catch (...)
+		{
+		}
+	}
+
+	RecordedCall(const RecordedCall &) = delete;
+	RecordedCall &operator=(const RecordedCall &) = delete;
+
+	bool complete(bool status)
+	{
+		m_status = status;
+		return status;
+	}
+
+private:
+
+	std::shared_ptr<PolicyRecorder> m_recorder;
+
+	policyrecording::Call m_call;
+	uint8_t m_flags;
+	policyrecording::Writer m_arguments;
+
+	std::chrono::steady_clock::time_point m_start;
+	bool m_status;
+};
 
 std::optional<FwContext::PingableHosts> ConvertPingableHosts(const PingableHosts *pingableHosts)
 {
-	if (nullptr == pingableHosts)
+	if (nullptr == pingableHosts)
+	{
+		return {};
+	}
+
+	if (nullptr == pingableHosts->hosts
+		|| 0 == pingableHosts->numHosts)
+	{
+		THROW_ERROR("Invalid PingableHosts structure");
+	}
+
+	FwContext::PingableHosts converted;
+
+	if (nullptr != pingableHosts->tunnelInterfaceAlias)
+	{
+		converted.tunnelInterfaceAlias = pingableHosts->tunnelInterfaceAlias;
+	}
+
+	for (size_t i = 0; i < pingableHosts->numHosts; ++i)
+	{
+		converted.hosts.emplace_back(wfp::IpAddress(pingableHosts->hosts[i]));
+	}
+
+	return converted;
+}
+
+wfp::IpAddress ConvertIp(const WinFwIp &ip)
+{
+	const auto &b = ip.bytes;
+
+	switch (ip.family)
+	{
+		case Ipv4:
+		{
+			return wfp::IpAddress(wfp::IpAddress::Literal{ b[0], b[1], b[2], b[3] });
+		}
+		case Ipv6:
+		{
+			auto word = [&b](size_t index)
+			{
+				return static_cast<uint16_t>((b[index * 2] << 8) | b[index * 2 + 1]);
+			};
+
+			return wfp::IpAddress(wfp::IpAddress::Literal6{ word(0), word(1), word(2), word(3),
+				word(4), word(5), word(6), word(7) });
+		}
+		default:
+		{
+			THROW_ERROR("Invalid address family");
+		}
+	}
+}
+
+FwContext::Relay ConvertEndpoint(const WinFwEndpoint &endpoint)
+{
+	switch (endpoint.protocol)
+	{
+		case Tcp: return FwContext::Relay{ ConvertIp(endpoint.ip), endpoint.port, rules::PermitVpnRelay::Protocol::Tcp };
+		case Udp: return FwContext::Relay{ ConvertIp(endpoint.ip), endpoint.port, rules::PermitVpnRelay::Protocol::Udp };
+		default:
+		{
+			THROW_ERROR("Invalid relay protocol");
+		}
+	}
+}
+
+std::vector<wfp::IpAddress> ConvertDnsHosts(const WinFwIp *dnsHosts, size_t numDnsHosts)
+{
+	if (nullptr == dnsHosts || 0 == numDnsHosts)
+	{
+		THROW_ERROR("At least one DNS host must be specified");
+	}
+
+	std::vector<wfp::IpAddress> converted;
+
+	for (size_t i = 0; i < numDnsHosts; ++i)
+	{
+		converted.push_back(ConvertIp(dnsHosts[i]));
+	}
+
+	return converted;
+}
+
+//
+// Owning copy of WinFwRelay.
+//
+struct RelayCopy
+{
+	RelayCopy(const WinFwRelay &relay)
+		: ip(relay.ip)
+		, port(relay.port)
+		, protocol(relay.protocol)
+	{
+	}
+
+	WinFwRelay view() const
+	{
+		return WinFwRelay{ ip.c_str(), port, protocol };
+	}
+
+	std::wstring ip;
+	uint16_t port;
+	WinFwProtocol protocol;
+};
+
+//
+// Transactions slower than this are logged as warnings rather than debug messages.
+//
+constexpr uint64_t SLOW_TRANSACTION_US = 1000 * 1000;
+
+//
+// Number of transactions when LogLastTransaction() last logged.
+// Policies that are already active are applied without a transaction.
+//
+uint64_t g_loggedTransactions = 0;
+
+//
+// Policy applications slower than this are reported in detail. Zero disables the check.
+//
+std::atomic<uint32_t> g_policyBudgetMs = 0;
+
+//
+// Sequence number of the policy application last checked against the budget.
+//
+uint64_t g_checkedPolicy = 0;
+
+void CheckPolicyBudget()
+{
+	const auto &lastPolicy = g_fwContext->lastPolicy();
+
+	if (false == lastPolicy.has_value() || lastPolicy->sequence == g_checkedPolicy)
+	{
+		return;
+	}
+
+	g_checkedPolicy = lastPolicy->sequence;
+
+	const uint64_t budgetUs = uint64_t(g_policyBudgetMs.load()) * 1000;
+
+	if (0 == budgetUs || lastPolicy->totalUs <= budgetUs)
+	{
+		return;
+	}
+
+	const auto &transactions = lastPolicy->transactions;
+
+	std::stringstream ss;
+
+	ss << "Firewall policy exceeded latency budget of " << (budgetUs / 1000) << " ms"
+		<< ": \"" << common::string::ToAnsi(lastPolicy->key) << "\""
+		<< (lastPolicy->success ? " applied" : " failed") << " in " << lastPolicy->totalUs << " us"
+		<< " (prepare: " << lastPolicy->prepareUs << " us"
+		<< ", transactions: " << lastPolicy->numTransactions
+		<< ", lock wait: " << transactions.lockWaitUs << " us"
+		<< ", lock attempts: " << transactions.lockAttempts
+		<< ", add: " << transactions.addUs << " us"
+		<< ", purge: " << transactions.purgeUs << " us"
+		<< ", commit: " << transactions.commitUs << " us"
+		<< ", objects added: " << transactions.objectsAdded
+		<< ", objects removed: " << transactions.objectsRemoved << ")";
+
+	g_logSink(MULLVAD_LOG_LEVEL_WARNING, ss.str().c_str(), g_logSinkContext);
+}
+
+void LogLastTransaction()
+{
+	if (nullptr == g_logSink || nullptr == g_fwContext)
+	{
+		return;
+	}
+
+	CheckPolicyBudget();
+
+	const auto statistics = g_fwContext->statistics();
+
+	if (statistics.numTransactions == g_loggedTransactions)
+	{
+		return;
+	}
+
+	g_loggedTransactions = statistics.numTransactions;
+
+	const auto &last = statistics.last;
+
+	std::stringstream ss;
+
+	ss << "Firewall transaction completed in " << last.totalUs << " us"
+		<< " (lock wait: " << last.lockWaitUs << " us"
+		<< ", lock attempts: " << last.lockAttempts
+		<< ", add: " << last.addUs << " us"
+		<< ", purge: " << last.purgeUs << " us"
+		<< ", commit: " << last.commitUs << " us"
+		<< ", objects added: " << last.objectsAdded
+		<< ", objects removed: " << last.objectsRemoved << ")";
+
+	const auto level = (last.totalUs >= SLOW_TRANSACTION_US ? MULLVAD_LOG_LEVEL_WARNING : MULLVAD_LOG_LEVEL_DEBUG);
+
+	g_logSink(level, ss.str().c_str(), g_logSinkContext);
+}
+
+//
+// Prepare the policies that are likely to be applied next, once the worker has nothing
+// else to do. Policy requests supersede or preempt this. See FwContext::precomputePolicies().
+//
+void SchedulePrecomputation()
+{
+	if (nullptr == g_policyWorker)
+	{
+		return;
+	}
+
+	g_policyWorker->enqueue([](const PolicyWorker::PreemptionCheck &preempted)
+	{
+		std::scoped_lock<std::mutex> lock(g_policyLock);
+
+		//
+		// Preparation stops before the next policy if a synchronous call is waiting,
+		// so the call is held up by at most one policy being prepared.
+		//
+		const auto giveWay = [&preempted]()
+		{
+			return preempted() || 0 != g_syncWaiters.load();
+		};
+
+		if (nullptr == g_fwContext || false == g_fwContext->precomputePolicies(giveWay))
+		{
+			return WINFW_POLICY_STATUS_SUPERSEDED;
+		}
+
+		return WINFW_POLICY_STATUS_SUCCESS;
+	},
+	[](WINFW_POLICY_STATUS)
+	{
+	},
+	PolicyWorker::Priority::Idle);
+}
+
+//
+// Must be called while holding the policy lock, after applying a policy.
+//
+void PolicyCompleted()
+{
+	LogLastTransaction();
+	SchedulePrecomputation();
+}
+
+bool ApplyLogged(std::function<bool()> apply)
+{
+	try
+	{
+		const auto status = apply();
+		PolicyCompleted();
+
+		return status;
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+bool EnqueuePolicy(std::function<bool()> apply, WinFwPolicyCompletion completion, void *completionContext,
+	PolicyWorker::Priority priority = PolicyWorker::Priority::Normal)
+{
+	if (nullptr == g_policyWorker || nullptr == completion)
+	{
+		return false;
+	}
+
+	const auto generation = g_policyGeneration.load();
+
+	g_policyWorker->enqueue([apply, generation](const PolicyWorker::PreemptionCheck &preempted)
+	{
+		std::scoped_lock<std::mutex> lock(g_policyLock);
+
+		//
+		// The lock may have been held by a synchronous call for a while.
+		// Give way, rather than apply a policy that is about to be replaced,
+		// or one that a synchronous call has already replaced.
+		//
+		if (preempted() || generation != g_policyGeneration.load())
+		{
+			return WINFW_POLICY_STATUS_SUPERSEDED;
+		}
+
+		return ApplyLogged(apply) ? WINFW_POLICY_STATUS_SUCCESS : WINFW_POLICY_STATUS_GENERAL_FAILURE;
+	},
+	[completion, completionContext](WINFW_POLICY_STATUS status)
+	{
+		completion(status, completionContext);
+	},
+	priority);
+
+	return true;
+}
+
+//
+// Must be called by every synchronous policy change, before it takes the policy lock.
+// This also covers a request the worker is about to apply, which is no longer pending.
+//
+void CancelPendingPolicy()
+{
+	++g_policyGeneration;
+
+	if (nullptr != g_policyWorker)
+	{
+		g_policyWorker->cancel();
+	}
+}
+
+//
+// Remove only the objects that are actually installed. Deleting every registered
+// object by key is kept as a recovery step, should that fail.
+//
+bool ResetWithoutContext()
+{
+	try
+	{
+		if (ObjectPurger::Execute(ObjectPurger::GetResetFunctor(), g_timeout))
+		{
+			return true;
+		}
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			std::stringstream ss;
+
+			ss << "Falling back on full purge: " << err.what();
+
+			g_logSink(MULLVAD_LOG_LEVEL_WARNING, ss.str().c_str(), g_logSinkContext);
+		}
+	}
+
+	return ObjectPurger::Execute(ObjectPurger::GetRemoveAllFunctor(), g_timeout);
+}
+
+bool Initialize(uint32_t timeout, std::function<FwContext *(uint32_t timeout)> createContext,
+	MullvadLogSink logSink, void *logSinkContext, policyrecording::Call call)
+{
+	RecordedCall recording(call, [&](policyrecording::Writer &arguments)
+	{
+		arguments.u32(timeout);
+	});
+
+	if (nullptr != g_fwContext)
+	{
+		//
+		// This is an error.
+		// The existing instance may have a different timeout etc.
+		//
+		return false;
+	}
+
+	// Convert seconds to milliseconds.
+	g_timeout = timeout * 1000;
+
+	g_logSink = logSink;
+	g_logSinkContext = logSinkContext;
+
+	try
+	{
+		std::unique_lock<std::shared_mutex> contextLock(g_contextLock);
+
+		g_fwContext = createContext(g_timeout);
+		g_policyWorker = new PolicyWorker();
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	return recording.complete(true);
+}
+
+bool InitializeBlocked(uint32_t timeout, const WinFwSettings &settings, FwContext::SessionMode sessionMode,
+	MullvadLogSink logSink, void *logSinkContext, policyrecording::Call call)
+{
+	RecordedCall recording(call, [&](policyrecording::Writer &arguments)
+	{
+		arguments.u32(timeout).settings(settings);
+	});
+
+	if (nullptr != g_fwContext)
+	{
+		//
+		// This is an error.
+		// The existing instance may have a different timeout etc.
+		//
+		return false;
+	}
+
+	// Convert seconds to milliseconds.
+	g_timeout = timeout * 1000;
+
+	g_logSink = logSink;
+	g_logSinkContext = logSinkContext;
+
+	try
+	{
+		std::unique_lock<std::shared_mutex> contextLock(g_contextLock);
+
+		g_fwContext = new FwContext(g_timeout, settings, sessionMode);
+		g_policyWorker = new PolicyWorker();
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	return recording.complete(true);
+}
+
+//
+// Sum of the drops by the block-all filters, since the rule counters were started.
+// Must be called while holding the policy lock.
+//
+uint64_t CountBlockAllDrops()
+{
+	const auto snapshot = g_ruleCounters->collect(g_fwContext->filterKeys());
+
+	uint64_t drops = 0;
+
+	for (const auto &counter : snapshot.counters)
+	{
+		if (MullvadGuids::FilterBlockAll_Outbound_Ipv4() == counter.filterKey
+			|| MullvadGuids::FilterBlockAll_Outbound_Ipv6() == counter.filterKey)
+		{
+			drops += counter.numDropped;
+		}
+	}
+
+	return drops;
+}
+
+} // anonymous namespace
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_Initialize(
+	uint32_t timeout,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	auto createContext = [](uint32_t timeout)
+	{
+		return new FwContext(timeout);
+	};
+
+	return Initialize(timeout, createContext, logSink, logSinkContext, policyrecording::Call::Initialize);
+}
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_InitializeDeferred(
+	uint32_t timeout,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	auto createContext = [](uint32_t timeout)
+	{
+		return new FwContext(timeout, FwContext::BaseConfiguration::Deferred);
+	};
+
+	return Initialize(timeout, createContext, logSink, logSinkContext, policyrecording::Call::InitializeDeferred);
+}
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_InitializeFromHandover(
+	uint32_t timeout,
+	const uint8_t *state,
+	uint32_t stateSize,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	auto createContext = [state, stateSize](uint32_t timeout)
+	{
+		return new FwContext(timeout, HandoverState::Deserialize(state, stateSize));
+	};
+
+	return Initialize(timeout, createContext, logSink, logSinkContext, policyrecording::Call::InitializeFromHandover);
+}
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_InitializeBlocked(
+	uint32_t timeout,
+	const WinFwSettings &settings,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	return InitializeBlocked(timeout, settings, FwContext::SessionMode::Standard, logSink, logSinkContext,
+		policyrecording::Call::InitializeBlocked);
+}
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_InitializeHybrid(
+	uint32_t timeout,
+	const WinFwSettings &settings,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	return InitializeBlocked(timeout, settings, FwContext::SessionMode::Hybrid, logSink, logSinkContext,
+		policyrecording::Call::InitializeHybrid);
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_Deinitialize()
+{
+	RecordedCall recording(policyrecording::Call::Deinitialize, [](policyrecording::Writer &)
+	{
+	});
+
+	//
+	// Wait for the offline policy, which may be applied on another thread.
+	//
+	std::unique_lock<std::shared_mutex> contextLock(g_contextLock);
+
+	if (nullptr == g_fwContext)
+	{
+		return recording.complete(true);
+	}
+
+	delete g_blockedEventMonitor;
+	g_blockedEventMonitor = nullptr;
+
+	delete g_ruleCounters;
+	g_ruleCounters = nullptr;
+
+	//
+	// Stop the worker before tearing down the context it operates on.
+	//
+	delete g_policyWorker;
+	g_policyWorker = nullptr;
+
+	delete g_fwContext;
+	g_fwContext = nullptr;
+
+	g_loggedTransactions = 0;
+	g_checkedPolicy = 0;
+
+	return recording.complete(true);
+}
+
+WINFW_LINKAGE
+WINFW_HANDOVER_STATUS
+WINFW_API
+WinFw_DeinitializeWithHandover(
+	uint8_t *state,
+	uint32_t *stateSize
+)
+{
+	if (nullptr == g_fwContext
+		|| nullptr == stateSize
+		|| (nullptr == state && 0 != *stateSize))
+	{
+		return WINFW_HANDOVER_STATUS_GENERAL_FAILURE;
+	}
+
+	try
+	{
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto serialized = g_fwContext->handoverState().serialize();
+
+		const auto capacity = *stateSize;
+
+		*stateSize = static_cast<uint32_t>(serialized.size());
+
+		if (serialized.size() > capacity)
+		{
+			return WINFW_HANDOVER_STATUS_BUFFER_TOO_SMALL;
+		}
+
+		std::copy(serialized.begin(), serialized.end(), state);
+
+		g_fwContext->handOver();
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return WINFW_HANDOVER_STATUS_GENERAL_FAILURE;
+	}
+	catch (...)
+	{
+		return WINFW_HANDOVER_STATUS_GENERAL_FAILURE;
+	}
+
+	WinFw_Deinitialize();
+
+	return WINFW_HANDOVER_STATUS_SUCCESS;
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_DeinitializeWithCleanupPolicy(
+	WINFW_CLEANUP_POLICY cleanupPolicy
+)
+{
+	RecordedCall recording(policyrecording::Call::DeinitializeWithCleanupPolicy, [&](policyrecording::Writer &arguments)
+	{
+		arguments.u8(static_cast<uint8_t>(cleanupPolicy));
+	});
+
+	if (nullptr == g_fwContext)
+	{
+		return recording.complete(true);
+	}
+
+	if (WINFW_CLEANUP_POLICY_CONTINUE_BLOCKING == cleanupPolicy)
+	{
+		try
+		{
+			CancelPendingPolicy();
+
+			SyncPolicyLock lock;
+
+			//
+			// Install the persistent filters before the session objects are removed,
+			// so traffic remains blocked throughout.
+			//
+			if (false == g_fwContext->installPersistentBlock())
+			{
+				THROW_ERROR("Failed to install persistent filters");
+			}
+		}
+		catch (std::exception &err)
+		{
+			if (nullptr != g_logSink)
+			{
+				g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+			}
+
+			return false;
+		}
+		catch (...)
+		{
+			return false;
+		}
+	}
+
+	return recording.complete(WinFw_Deinitialize());
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnecting(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const PingableHosts *pingableHosts
+)
+{
+	RecordedCall recording(policyrecording::Call::ApplyPolicyConnecting, [&](policyrecording::Writer &arguments)
+	{
+		arguments.settings(settings).u32(1).relay(relay).pingableHosts(pingableHosts);
+	});
+
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto status = g_fwContext->applyPolicyConnecting(settings, { relay }, ConvertPingableHosts(pingableHosts));
+		PolicyCompleted();
+
+		return recording.complete(status);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectingMultiRelay(
+	const WinFwSettings &settings,
+	const WinFwRelay *relays,
+	size_t numRelays,
+	const PingableHosts *pingableHosts
+)
+{
+	RecordedCall recording(policyrecording::Call::ApplyPolicyConnecting, [&](policyrecording::Writer &arguments)
+	{
+		arguments.settings(settings).u32(static_cast<uint32_t>(numRelays));
+
+		for (size_t i = 0; i < numRelays; ++i)
+		{
+			arguments.relay(relays[i]);
+		}
+
+		arguments.pingableHosts(pingableHosts);
+	});
+
+	if (nullptr == g_fwContext
+		|| nullptr == relays
+		|| 0 == numRelays)
+	{
+		return false;
+	}
+
+	try
+	{
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto status = g_fwContext->applyPolicyConnecting(settings,
+			std::vector<WinFwRelay>(relays, relays + numRelays), ConvertPingableHosts(pingableHosts));
+		PolicyCompleted();
+
+		return recording.complete(status);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnected(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const wchar_t *v4DnsHost,
+	const wchar_t *v6DnsHost
+)
+{
+	RecordedCall recording(policyrecording::Call::ApplyPolicyConnected, [&](policyrecording::Writer &arguments)
+	{
+		arguments.settings(settings).relay(relay).string(tunnelInterfaceAlias).string(v4DnsHost).string(v6DnsHost);
+	});
+
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto status = g_fwContext->applyPolicyConnected(settings, relay, tunnelInterfaceAlias, v4DnsHost, v6DnsHost);
+		PolicyCompleted();
+
+		return recording.complete(status);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyRelaySwitch(
+	const WinFwRelay &relay
+)
+{
+	RecordedCall recording(policyrecording::Call::ApplyPolicyRelaySwitch, [&](policyrecording::Writer &arguments)
+	{
+		arguments.relay(relay);
+	});
+
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto status = g_fwContext->applyPolicyRelaySwitch(relay);
+		PolicyCompleted();
+
+		return recording.complete(status);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StagePolicyConnected(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const wchar_t *v4DnsHost,
+	const wchar_t *v6DnsHost
+)
+{
+	RecordedCall recording(policyrecording::Call::StagePolicyConnected, [&](policyrecording::Writer &arguments)
+	{
+		arguments.settings(settings).relay(relay).string(tunnelInterfaceAlias).string(v4DnsHost).string(v6DnsHost);
+	});
+
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		//
+		// Staging does not affect the active policy, so pending requests remain valid.
+		//
+		SyncPolicyLock lock;
+
+		g_fwContext->stagePolicyConnected(settings, relay, tunnelInterfaceAlias, v4DnsHost, v6DnsHost);
+		SchedulePrecomputation();
+
+		return recording.complete(true);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectedMultiDns(
+	const WinFwSettings &settings,
+	const WinFwEndpoint &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const WinFwIp *dnsHosts,
+	size_t numDnsHosts
+)
+{
+	RecordedCall recording(policyrecording::Call::ApplyPolicyConnectedMultiDns, [&](policyrecording::Writer &arguments)
+	{
+		arguments.settings(settings).endpoint(relay).string(tunnelInterfaceAlias).u32(static_cast<uint32_t>(numDnsHosts));
+
+		for (size_t i = 0; nullptr != dnsHosts && i < numDnsHosts; ++i)
+		{
+			arguments.ip(dnsHosts[i]);
+		}
+	});
+
+	if (nullptr == g_fwContext
+		|| nullptr == tunnelInterfaceAlias)
+	{
+		return false;
+	}
+
+	try
+	{
+		const auto convertedRelay = ConvertEndpoint(relay);
+		const auto convertedDnsHosts = ConvertDnsHosts(dnsHosts, numDnsHosts);
+
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto status = g_fwContext->applyPolicyConnected(settings, convertedRelay, tunnelInterfaceAlias, convertedDnsHosts);
+		PolicyCompleted();
+
+		return recording.complete(status);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StagePolicyConnectedMultiDns(
+	const WinFwSettings &settings,
+	const WinFwEndpoint &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const WinFwIp *dnsHosts,
+	size_t numDnsHosts
+)
+{
+	RecordedCall recording(policyrecording::Call::StagePolicyConnectedMultiDns, [&](policyrecording::Writer &arguments)
+	{
+		arguments.settings(settings).endpoint(relay).string(tunnelInterfaceAlias).u32(static_cast<uint32_t>(numDnsHosts));
+
+		for (size_t i = 0; nullptr != dnsHosts && i < numDnsHosts; ++i)
+		{
+			arguments.ip(dnsHosts[i]);
+		}
+	});
+
+	if (nullptr == g_fwContext
+		|| nullptr == tunnelInterfaceAlias)
+	{
+		return false;
+	}
+
+	try
+	{
+		const auto convertedRelay = ConvertEndpoint(relay);
+		const auto convertedDnsHosts = ConvertDnsHosts(dnsHosts, numDnsHosts);
+
+		//
+		// Staging does not affect the active policy, so pending requests remain valid.
+		//
+		SyncPolicyLock lock;
+
+		g_fwContext->stagePolicyConnected(settings, convertedRelay, tunnelInterfaceAlias, convertedDnsHosts);
+		SchedulePrecomputation();
+
+		return recording.complete(true);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyBlocked(
+	const WinFwSettings &settings
+)
+{
+	RecordedCall recording(policyrecording::Call::ApplyPolicyBlocked, [&](policyrecording::Writer &arguments)
+	{
+		arguments.settings(settings);
+	});
+
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto status = g_fwContext->applyPolicyBlocked(settings);
+		PolicyCompleted();
+
+		return recording.complete(status);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ArmPolicyOffline(
+	const WinFwSettings *settings
+)
+{
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		SyncPolicyLock lock;
+
+		if (nullptr == settings)
+		{
+			g_fwContext->disarmPolicyOffline();
+		}
+		else
+		{
+			g_fwContext->armPolicyOffline(*settings);
+		}
+
+		return true;
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyOffline(
+)
+{
+	std::shared_lock<std::shared_mutex> contextLock(g_contextLock);
+
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		const auto settings = g_fwContext->offlineSettings();
+
+		if (false == settings.has_value())
+		{
+			return false;
+		}
+
+		//
+		// Recorded as the blocked policy that is applied, so recordings replay as before.
+		//
+		RecordedCall recording(policyrecording::Call::ApplyPolicyBlocked, [&settings](policyrecording::Writer &arguments)
+		{
+			arguments.settings(settings.value());
+		});
+
+		const auto status = g_fwContext->applyPolicyBlocked(settings.value());
+		PolicyCompleted();
+
+		return recording.complete(status);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_SetExcludedApps(
+	const wchar_t **paths,
+	size_t numPaths
+)
+{
+	RecordedCall recording(policyrecording::Call::SetExcludedApps, [&](policyrecording::Writer &arguments)
+	{
+		arguments.u32(static_cast<uint32_t>(numPaths));
+
+		for (size_t i = 0; nullptr != paths && i < numPaths; ++i)
+		{
+			arguments.string(paths[i]);
+		}
+	});
+
+	if (nullptr == g_fwContext
+		|| (nullptr == paths && 0 != numPaths))
+	{
+		return false;
+	}
+
+	try
+	{
+		std::vector<std::wstring> converted;
+
+		for (size_t i = 0; i < numPaths; ++i)
+		{
+			if (nullptr == paths[i])
+			{
+				THROW_ERROR("Invalid application path");
+			}
+
+			converted.emplace_back(paths[i]);
+		}
+
+		SyncPolicyLock lock;
+
+		g_fwContext->setExcludedApps(converted);
+
+		return recording.complete(true);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_Reset()
+{
+	RecordedCall recording(policyrecording::Call::Reset, [](policyrecording::Writer &)
+	{
+	});
+
+	try
+	{
+		if (nullptr == g_fwContext)
+		{
+			return recording.complete(ResetWithoutContext());
+		}
+
+		CancelPendingPolicy();
+
+		SyncPolicyLock lock;
+
+		return recording.complete(g_fwContext->reset());
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectingAsync(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const PingableHosts *pingableHosts,
+	WinFwPolicyCompletion completion,
+	void *completionContext
+)
+{
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		policyrecording::Writer recorded;
+		recorded.settings(settings).u32(1).relay(relay).pingableHosts(pingableHosts);
+
+		auto apply = [settings, relayCopy = RelayCopy(relay), hosts = ConvertPingableHosts(pingableHosts), recorded]()
+		{
+			RecordedCall recording(policyrecording::Call::ApplyPolicyConnecting, [&recorded](policyrecording::Writer &arguments)
+			{
+				arguments = recorded;
+			}, policyrecording::RECORD_FLAG_ASYNCHRONOUS);
+
+			return recording.complete(g_fwContext->applyPolicyConnecting(settings, { relayCopy.view() }, hosts));
+		};
+
+		return EnqueuePolicy(apply, completion, completionContext);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectedAsync(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const wchar_t *v4DnsHost,
+	const wchar_t *v6DnsHost,
+	WinFwPolicyCompletion completion,
+	void *completionContext
+)
+{
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		std::optional<std::wstring> v6DnsHostCopy;
+
+		if (nullptr != v6DnsHost)
+		{
+			v6DnsHostCopy = v6DnsHost;
+		}
+
+		policyrecording::Writer recorded;
+		recorded.settings(settings).relay(relay).string(tunnelInterfaceAlias).string(v4DnsHost).string(v6DnsHost);
+
+		auto apply = [settings, relayCopy = RelayCopy(relay), alias = std::wstring(tunnelInterfaceAlias),
+			v4DnsHostCopy = std::wstring(v4DnsHost), v6DnsHostCopy, recorded]()
+		{
+			RecordedCall recording(policyrecording::Call::ApplyPolicyConnected, [&recorded](policyrecording::Writer &arguments)
+			{
+				arguments = recorded;
+			}, policyrecording::RECORD_FLAG_ASYNCHRONOUS);
+
+			return recording.complete(g_fwContext->applyPolicyConnected(settings, relayCopy.view(), alias.c_str(),
+				v4DnsHostCopy.c_str(), v6DnsHostCopy.has_value() ? v6DnsHostCopy->c_str() : nullptr));
+		};
+
+		return EnqueuePolicy(apply, completion, completionContext);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyBlockedAsync(
+	const WinFwSettings &settings,
+	WinFwPolicyCompletion completion,
+	void *completionContext
+)
+{
+	if (nullptr == g_fwContext)
+	{
+		return false;
+	}
+
+	try
+	{
+		auto apply = [settings]()
+		{
+			RecordedCall recording(policyrecording::Call::ApplyPolicyBlocked, [&settings](policyrecording::Writer &arguments)
+			{
+				arguments.settings(settings);
+			}, policyrecording::RECORD_FLAG_ASYNCHRONOUS);
+
+			return recording.complete(g_fwContext->applyPolicyBlocked(settings));
+		};
+
+		return EnqueuePolicy(apply, completion, completionContext, PolicyWorker::Priority::High);
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+WINFW_LINKAGE
+void
+WINFW_API
+WinFw_SetLatencyBudget(
+	uint32_t policyApplyMs
+)
+{
+	g_policyBudgetMs = policyApplyMs;
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_GetStatistics(
+	WinFwStatistics *statistics
+)
+{
+	if (nullptr == g_fwContext || nullptr == statistics)
 	{
-		return {};
+		return false;
 	}
 
-	if (nullptr == pingableHosts->hosts
-		|| 0 == pingableHosts->numHosts)
+	try
 	{
-		THROW_ERROR("Invalid PingableHosts structure");
+		*statistics = g_fwContext->statistics();
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return false;
+	}
+	catch (...)
+	{
+		return false;
 	}
 
-	FwContext::PingableHosts converted;
+	return true;
+}
 
-	if (nullptr != pingableHosts->tunnelInterfaceAlias)
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_EstimatePolicy(
+	const WinFwSettings &settings,
+	const WinFwPolicy &policy,
+	WinFwPolicyEstimate *estimate
+)
+{
+	if (nullptr == g_fwContext || nullptr == estimate)
 	{
-		converted.tunnelInterfaceAlias = pingableHosts->tunnelInterfaceAlias;
+		return false;
 	}
 
-	for (size_t i = 0; i < pingableHosts->numHosts; ++i)
+	try
 	{
-		converted.hosts.emplace_back(wfp::IpAddress(pingableHosts->hosts[i]));
+		SyncPolicyLock lock;
+
+		switch (policy.policy)
+		{
+			case WINFW_POLICY_CONNECTING:
+			{
+				if (nullptr == policy.relays || 0 == policy.numRelays)
+				{
+					return false;
+				}
+
+				*estimate = g_fwContext->estimatePolicyConnecting(settings,
+					std::vector<WinFwRelay>(policy.relays, policy.relays + policy.numRelays),
+					ConvertPingableHosts(policy.pingableHosts));
+
+				break;
+			}
+			case WINFW_POLICY_CONNECTED:
+			{
+				if (nullptr == policy.relay || nullptr == policy.tunnelInterfaceAlias)
+				{
+					return false;
+				}
+
+				*estimate = g_fwContext->estimatePolicyConnected(settings, ConvertEndpoint(*policy.relay),
+					policy.tunnelInterfaceAlias, ConvertDnsHosts(policy.dnsHosts, policy.numDnsHosts));
+
+				break;
+			}
+			case WINFW_POLICY_BLOCKED:
+			{
+				*estimate = g_fwContext->estimatePolicyBlocked(settings);
+
+				break;
+			}
+			default:
+			{
+				THROW_ERROR("Invalid policy");
+			}
+		}
 	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
 
-	return converted;
-}
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
 
-} // anonymous namespace
+	return true;
+}
 
 WINFW_LINKAGE
 bool
 WINFW_API
-WinFw_Initialize(
-	uint32_t timeout,
-	MullvadLogSink logSink,
-	void *logSinkContext
+WinFw_GetPerformanceCounters(
+	MullvadCounterSink sink,
+	void *context
 )
 {
-	if (nullptr != g_fwContext)
+	if (nullptr == sink)
 	{
-		//
-		// This is an error.
-		// The existing instance may have a different timeout etc.
-		//
 		return false;
 	}
 
-	// Convert seconds to milliseconds.
-	g_timeout = timeout * 1000;
+	try
+	{
+		shared::performance::CounterRegistry::Instance().snapshot(sink, context);
+	}
+	catch (...)
+	{
+		return false;
+	}
 
-	g_logSink = logSink;
-	g_logSinkContext = logSinkContext;
+	return true;
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StartRecording(
+	const wchar_t *path
+)
+{
+	if (nullptr == path)
+	{
+		return false;
+	}
 
 	try
 	{
-		g_fwContext = new FwContext(g_timeout);
+		std::atomic_store(&g_recorder, std::make_shared<PolicyRecorder>(path));
 	}
 	catch (std::exception &err)
 	{
@@ -91,35 +1811,41 @@ WinFw_Initialize(
 	return true;
 }
 
-extern "C"
 WINFW_LINKAGE
 bool
 WINFW_API
-WinFw_InitializeBlocked(
-	uint32_t timeout,
-	const WinFwSettings &settings,
-	MullvadLogSink logSink,
-	void *logSinkContext
+WinFw_StopRecording()
+{
+	std::atomic_store(&g_recorder, std::shared_ptr<PolicyRecorder>());
+
+	return true;
+}
+
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_SubscribeBlockedEvents(
+	uint32_t windowMs,
+	WinFwBlockedEventsSink sink,
+	void *sinkContext
 )
 {
-	if (nullptr != g_fwContext)
+	if (nullptr == g_fwContext
+		|| nullptr != g_blockedEventMonitor
+		|| nullptr == sink)
 	{
-		//
-		// This is an error.
-		// The existing instance may have a different timeout etc.
-		//
 		return false;
 	}
 
-	// Convert seconds to milliseconds.
-	g_timeout = timeout * 1000;
-
-	g_logSink = logSink;
-	g_logSinkContext = logSinkContext;
+	const auto window = std::chrono::milliseconds(0 == windowMs ? DEFAULT_BLOCKED_EVENTS_WINDOW_MS : windowMs);
 
 	try
 	{
-		g_fwContext = new FwContext(g_timeout, settings);
+		g_blockedEventMonitor = new BlockedEventMonitor(g_timeout, window,
+			[sink, sinkContext](const WinFwBlockedEvent *events, uint32_t numEvents, uint32_t numOverflowed)
+		{
+			sink(events, numEvents, numOverflowed, sinkContext);
+		});
 	}
 	catch (std::exception &err)
 	{
@@ -141,36 +1867,103 @@ WinFw_InitializeBlocked(
 WINFW_LINKAGE
 bool
 WINFW_API
-WinFw_Deinitialize()
+WinFw_UnsubscribeBlockedEvents()
 {
-	if (nullptr == g_fwContext)
+	delete g_blockedEventMonitor;
+	g_blockedEventMonitor = nullptr;
+
+	return true;
+}
+
+WINFW_LINKAGE
+WINFW_REPORT_STATUS
+WINFW_API
+WinFw_GetFilterReport(
+	WinFwFilterLayerReport *entries,
+	uint32_t *numEntries
+)
+{
+	if (nullptr == numEntries
+		|| (nullptr == entries && 0 != *numEntries))
 	{
-		return true;
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
 	}
 
-	delete g_fwContext;
-	g_fwContext = nullptr;
+	try
+	{
+		//
+		// Use a separate session, so this doesn't interfere with policy changes.
+		//
+		SessionPool::Lease engine(g_timeout);
 
-	return true;
+		const auto report = FilterReport::Collect(*engine);
+
+		const auto capacity = *numEntries;
+
+		*numEntries = static_cast<uint32_t>(report.size());
+
+		if (report.size() > capacity)
+		{
+			return WINFW_REPORT_STATUS_BUFFER_TOO_SMALL;
+		}
+
+		std::copy(report.begin(), report.end(), entries);
+
+		return WINFW_REPORT_STATUS_SUCCESS;
+	}
+	catch (std::exception &err)
+	{
+		if (nullptr != g_logSink)
+		{
+			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
+		}
+
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
+	}
+	catch (...)
+	{
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
+	}
 }
 
 WINFW_LINKAGE
 bool
 WINFW_API
-WinFw_ApplyPolicyConnecting(
-	const WinFwSettings &settings,
-	const WinFwRelay &relay,
-	const PingableHosts *pingableHosts
+WinFw_CollectNativeDiagnostics(
+	uint8_t *buffer,
+	uint32_t *size
 )
 {
-	if (nullptr == g_fwContext)
+	if (nullptr == buffer || nullptr == size)
 	{
 		return false;
 	}
 
 	try
 	{
-		return g_fwContext->applyPolicyConnecting(settings, relay, ConvertPingableHosts(pingableHosts));
+		shared::diagnostics::BlobWriter writer(buffer, *size, MULLVAD_DIAGNOSTICS_MODULE_WINFW);
+
+		std::optional<FwContext::PolicyTiming> lastPolicy;
+
+		{
+			SyncPolicyLock lock;
+
+			if (nullptr != g_fwContext)
+			{
+				lastPolicy = g_fwContext->lastPolicy();
+			}
+		}
+
+		//
+		// Use a separate session, so this doesn't interfere with policy changes.
+		//
+		SessionPool::Lease engine(g_timeout);
+
+		NativeDiagnostics::Collect(writer, lastPolicy, *engine);
+
+		*size = static_cast<uint32_t>(writer.finish());
+
+		return true;
 	}
 	catch (std::exception &err)
 	{
@@ -190,22 +1983,17 @@ WinFw_ApplyPolicyConnecting(
 WINFW_LINKAGE
 bool
 WINFW_API
-WinFw_ApplyPolicyConnected(
-	const WinFwSettings &settings,
-	const WinFwRelay &relay,
-	const wchar_t *tunnelInterfaceAlias,
-	const wchar_t *v4DnsHost,
-	const wchar_t *v6DnsHost
-)
+WinFw_StartRuleCounters()
 {
-	if (nullptr == g_fwContext)
+	if (nullptr == g_fwContext
+		|| nullptr != g_ruleCounters)
 	{
 		return false;
 	}
 
 	try
 	{
-		return g_fwContext->applyPolicyConnected(settings, relay, tunnelInterfaceAlias, v4DnsHost, v6DnsHost);
+		g_ruleCounters = new RuleCounters(g_timeout);
 	}
 	catch (std::exception &err)
 	{
@@ -220,23 +2008,64 @@ WinFw_ApplyPolicyConnected(
 	{
 		return false;
 	}
+
+	return true;
 }
 
 WINFW_LINKAGE
 bool
 WINFW_API
-WinFw_ApplyPolicyBlocked(
-	const WinFwSettings &settings
+WinFw_StopRuleCounters()
+{
+	SyncPolicyLock lock;
+
+	delete g_ruleCounters;
+	g_ruleCounters = nullptr;
+
+	return true;
+}
+
+WINFW_LINKAGE
+WINFW_REPORT_STATUS
+WINFW_API
+WinFw_GetRuleCounters(
+	WinFwRuleCounter *entries,
+	uint32_t *numEntries,
+	uint64_t *numUnattributed
 )
 {
-	if (nullptr == g_fwContext)
+	if (nullptr == g_fwContext
+		|| nullptr == numEntries
+		|| nullptr == numUnattributed
+		|| (nullptr == entries && 0 != *numEntries))
 	{
-		return false;
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
 	}
 
 	try
 	{
-		return g_fwContext->applyPolicyBlocked(settings);
+		SyncPolicyLock lock;
+
+		if (nullptr == g_ruleCounters)
+		{
+			return WINFW_REPORT_STATUS_GENERAL_FAILURE;
+		}
+
+		const auto snapshot = g_ruleCounters->collect(g_fwContext->filterKeys());
+
+		const auto capacity = *numEntries;
+
+		*numEntries = static_cast<uint32_t>(snapshot.counters.size());
+		*numUnattributed = snapshot.numUnattributed;
+
+		if (snapshot.counters.size() > capacity)
+		{
+			return WINFW_REPORT_STATUS_BUFFER_TOO_SMALL;
+		}
+
+		std::copy(snapshot.counters.begin(), snapshot.counters.end(), entries);
+
+		return WINFW_REPORT_STATUS_SUCCESS;
 	}
 	catch (std::exception &err)
 	{
@@ -245,27 +2074,137 @@ WinFw_ApplyPolicyBlocked(
 			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
 		}
 
-		return false;
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
 	}
 	catch (...)
 	{
-		return false;
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
 	}
 }
 
 WINFW_LINKAGE
-bool
+WINFW_REPORT_STATUS
 WINFW_API
-WinFw_Reset()
+WinFw_CheckDnsLeaks(
+	const wchar_t *tunnelInterfaceAlias,
+	const WinFwIp *resolvers,
+	size_t numResolvers,
+	uint32_t timeoutMs,
+	WinFwDnsProbe *probes,
+	uint32_t *numProbes,
+	WinFwDnsLeakSummary *summary
+)
 {
+	if (nullptr == g_fwContext
+		|| nullptr == tunnelInterfaceAlias
+		|| nullptr == resolvers
+		|| 0 == numResolvers
+		|| nullptr == numProbes
+		|| nullptr == summary
+		|| (nullptr == probes && 0 != *numProbes))
+	{
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
+	}
+
 	try
 	{
-		if (nullptr == g_fwContext)
+		const auto start = std::chrono::steady_clock::now();
+
+		const auto tunnel = rules::TunnelInterface::Resolve(tunnelInterfaceAlias);
+
+		const auto timeout = std::chrono::milliseconds(0 == timeoutMs
+			? DEFAULT_DNS_LEAK_CHECK_TIMEOUT_MS
+			: std::min(timeoutMs, MAX_DNS_LEAK_CHECK_TIMEOUT_MS));
+
+		*summary = WinFwDnsLeakSummary{ 0 };
+
+		DnsLeakCheck check(tunnel.luid, std::vector<WinFwIp>(resolvers, resolvers + numResolvers));
+
+		const auto capacity = *numProbes;
+
+		*numProbes = static_cast<uint32_t>(check.size());
+
+		if (check.size() > capacity)
+		{
+			return WINFW_REPORT_STATUS_BUFFER_TOO_SMALL;
+		}
+
+		//
+		// Only hold the policy lock while reading the state that the check is compared
+		// against. Policy changes must not wait for the queries to time out.
+		//
+
+		std::optional<std::wstring> policy;
+		const RuleCounters *counters = nullptr;
+		uint64_t dropsBefore = 0;
+
+		{
+			SyncPolicyLock lock;
+
+			policy = g_fwContext->activePolicy();
+
+			for (const auto &[filterId, filterKey] : g_fwContext->filterKeys())
+			{
+				if (MullvadGuids::FilterPermitTunnelDns_Ipv4() == filterKey
+					|| MullvadGuids::FilterPermitTunnelDns_Ipv6() == filterKey)
+				{
+					summary->tunnelDnsPermitted = true;
+					break;
+				}
+			}
+
+			counters = g_ruleCounters;
+			dropsBefore = (nullptr != counters ? CountBlockAllDrops() : 0);
+		}
+
+		const auto results = check.run(timeout);
+
+		{
+			SyncPolicyLock lock;
+
+			if (g_fwContext->activePolicy() != policy)
+			{
+				THROW_ERROR("The policy changed during the DNS leak check");
+			}
+
+			//
+			// Drops can't be attributed if the counters were restarted in the meantime.
+			//
+			summary->dropsCounted = (nullptr != counters && g_ruleCounters == counters);
+
+			if (summary->dropsCounted)
+			{
+				summary->numDrops = CountBlockAllDrops() - dropsBefore;
+			}
+		}
+
+		for (const auto &result : results)
+		{
+			switch (result.result)
+			{
+				case WINFW_DNS_PROBE_RESULT_BLOCKED: ++summary->numBlocked; break;
+				case WINFW_DNS_PROBE_RESULT_NO_RESPONSE: ++summary->numUnanswered; break;
+				case WINFW_DNS_PROBE_RESULT_RESPONSE: ++summary->numLeaked; break;
+				default: ++summary->numFailed; break;
+			}
+		}
+
+		summary->durationUs = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		if (0 != summary->numLeaked && nullptr != g_logSink)
 		{
-			return ObjectPurger::Execute(ObjectPurger::GetRemoveAllFunctor());
+			std::stringstream ss;
+
+			ss << "DNS leak check: " << summary->numLeaked << " of " << results.size()
+				<< " queries outside the tunnel were answered";
+
+			g_logSink(MULLVAD_LOG_LEVEL_WARNING, ss.str().c_str(), g_logSinkContext);
 		}
 
-		return g_fwContext->reset();
+		std::copy(results.begin(), results.end(), probes);
+
+		return WINFW_REPORT_STATUS_SUCCESS;
 	}
 	catch (std::exception &err)
 	{
@@ -274,10 +2213,10 @@ WinFw_Reset()
 			g_logSink(MULLVAD_LOG_LEVEL_ERROR, err.what(), g_logSinkContext);
 		}
 
-		return false;
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
 	}
 	catch (...)
 	{
-		return false;
+		return WINFW_REPORT_STATUS_GENERAL_FAILURE;
 	}
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <libshared/logging/logsink.h>
+#include <libshared/performance/countersink.h>
+#include <guiddef.h>
 #include <stdint.h>
 
 //
@@ -45,6 +47,90 @@ typedef struct tag_WinFwRelay
 }
 WinFwRelay;
 
+enum WinFwIpFamily : uint8_t
+{
+	Ipv4 = 0,
+	Ipv6 = 1
+};
+
+typedef struct tag_WinFwIp
+{
+	WinFwIpFamily family;
+
+	// Network byte order. Only the first four bytes are used for IPv4.
+	uint8_t bytes[16];
+}
+WinFwIp;
+
+//
+// Same as `WinFwRelay`, but with the address in binary form.
+//
+typedef struct tag_WinFwEndpoint
+{
+	WinFwIp ip;
+	uint16_t port;
+	WinFwProtocol protocol;
+}
+WinFwEndpoint;
+
+typedef struct tag_WinFwTransactionStatistics
+{
+	// Time spent waiting for the BFE transaction lock, in microseconds.
+	// This includes any retries after the lock could not be acquired in time.
+	uint64_t lockWaitUs;
+
+	// Number of attempts made to acquire the BFE transaction lock.
+	uint64_t lockAttempts;
+
+	// Time spent adding objects, in microseconds.
+	uint64_t addUs;
+
+	// Time spent removing objects, in microseconds.
+	uint64_t purgeUs;
+
+	// Time spent committing the transaction, in microseconds.
+	uint64_t commitUs;
+
+	// Total duration of the transaction, in microseconds.
+	uint64_t totalUs;
+
+	uint64_t objectsAdded;
+	uint64_t objectsRemoved;
+}
+WinFwTransactionStatistics;
+
+typedef struct tag_WinFwStatistics
+{
+	uint64_t numTransactions;
+	uint64_t numFailedTransactions;
+
+	// Most recent transaction.
+	WinFwTransactionStatistics last;
+
+	// Transaction with the longest total duration.
+	WinFwTransactionStatistics slowest;
+
+	// Sum over all transactions.
+	WinFwTransactionStatistics accumulated;
+}
+WinFwStatistics;
+
+typedef struct tag_WinFwPolicyEstimate
+{
+	// Filters that would be added, including updated filters.
+	uint64_t filtersAdded;
+
+	// Filters that are already installed and would be left in place.
+	uint64_t filtersUnchanged;
+
+	// Objects that would be removed, including the old version of updated filters.
+	uint64_t objectsRemoved;
+
+	// Marshalled size of the filters that would be added, in bytes.
+	uint64_t bytesAdded;
+}
+WinFwPolicyEstimate;
+
 #pragma pack(pop)
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -71,6 +157,27 @@ WinFw_Initialize(
 	void *logSinkContext
 );
 
+//
+// InitializeDeferred:
+//
+// Same as `WinFw_Initialize`, except that nothing is changed in the firewall until
+// the first policy is applied. The structural objects are then installed, and
+// objects left by an earlier instance are purged, in the same transaction as
+// the policy. This saves a transaction when a policy is applied right away.
+//
+// WinFw_Reset() completes the deferred initialization if no policy has been applied.
+//
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_InitializeDeferred(
+	uint32_t timeout,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
 //
 // WinFw_InitializeBlocked
 //
@@ -92,6 +199,30 @@ WinFw_InitializeBlocked(
 	void *logSinkContext
 );
 
+//
+// WinFw_InitializeHybrid
+//
+// Same as `WinFw_InitializeBlocked`, but only the blocked policy is installed in a
+// standard session. The permits that the connecting and connected policies add to it
+// are installed in a dynamic session, which BFE cleans up when it's closed.
+//
+// If the process exits without deinitializing, the permits are gone and the blocked
+// policy remains in effect, so there's nothing to purge on the next start.
+//
+// The blocked policy follows the settings of the most recently applied policy.
+// When changing policies, the settings are applied before the permits are replaced.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_InitializeHybrid(
+	uint32_t timeout,
+	const WinFwSettings &settings,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
 //
 // Deinitialize:
 //
@@ -103,6 +234,87 @@ bool
 WINFW_API
 WinFw_Deinitialize();
 
+//
+// DeinitializeWithCleanupPolicy:
+//
+// Same as `WinFw_Deinitialize`, but the cleanup policy determines what remains
+// in effect afterwards.
+//
+// WINFW_CLEANUP_POLICY_CONTINUE_BLOCKING installs persistent filters that block
+// all traffic except loopback. They remain in effect until WINFW is initialized
+// again, also across reboots, which protects against leaks before the daemon has
+// started. `WinFw_InitializeBlocked` takes over from them in its initialization
+// transaction, so there's no gap in protection.
+//
+// `WinFw_Reset` removes the persistent filters if WINFW is not initialized.
+//
+
+enum WINFW_CLEANUP_POLICY
+{
+	WINFW_CLEANUP_POLICY_RESET_FIREWALL = 0,
+	WINFW_CLEANUP_POLICY_CONTINUE_BLOCKING = 1,
+};
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_DeinitializeWithCleanupPolicy(
+	WINFW_CLEANUP_POLICY cleanupPolicy
+);
+
+//
+// DeinitializeWithHandover:
+//
+// Deinitialize, but leave the policy in effect installed, so another instance of
+// WINFW can take over with `WinFw_InitializeFromHandover`. Used when the service is
+// upgraded, so traffic isn't leaked and everything isn't reinstalled.
+//
+// The state is serialized into the buffer. If the buffer is too small, *stateSize is
+// updated with the required size, WINFW_HANDOVER_STATUS_BUFFER_TOO_SMALL is returned,
+// and WINFW remains initialized.
+//
+
+enum WINFW_HANDOVER_STATUS
+{
+	WINFW_HANDOVER_STATUS_SUCCESS = 0,
+	WINFW_HANDOVER_STATUS_BUFFER_TOO_SMALL = 1,
+	WINFW_HANDOVER_STATUS_GENERAL_FAILURE = 2,
+};
+
+extern "C"
+WINFW_LINKAGE
+WINFW_HANDOVER_STATUS
+WINFW_API
+WinFw_DeinitializeWithHandover(
+	uint8_t *state,
+	uint32_t *stateSize
+);
+
+//
+// InitializeFromHandover:
+//
+// Same as `WinFw_Initialize`, but take over the objects left by an instance that was
+// deinitialized with `WinFw_DeinitializeWithHandover`. The state produced by that call
+// is used to recognize the policy in effect, so applying it again completes without
+// a transaction. The excluded apps are also restored.
+//
+// If the installed objects have changed since the handover, they are still taken over,
+// but the policy in effect is considered unknown.
+//
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_InitializeFromHandover(
+	uint32_t timeout,
+	const uint8_t *state,
+	uint32_t stateSize,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
 //
 // PingableHosts:
 //
@@ -138,6 +350,28 @@ WinFw_ApplyPolicyConnecting(
 	const PingableHosts *pingableHosts
 );
 
+//
+// ApplyPolicyConnectingMultiRelay:
+//
+// Same as `WinFw_ApplyPolicyConnecting` but permits communication with any of
+// several relays. This makes it possible to try relays in parallel, or in quick
+// succession, without applying a new policy for each attempt.
+//
+// Relays are permitted using a filter per address family and combination of port
+// and protocol, so each relay is only reachable using its own port and protocol.
+// At most 4 combinations of port and protocol are supported per address family.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectingMultiRelay(
+	const WinFwSettings &settings,
+	const WinFwRelay *relays,
+	size_t numRelays,
+	const PingableHosts *pingableHosts
+);
+
 //
 // ApplyPolicyConnected:
 //
@@ -166,6 +400,91 @@ WinFw_ApplyPolicyConnected(
 	const wchar_t *v6DnsHost
 );
 
+//
+// StagePolicyConnected:
+//
+// Prepare the connected policy without applying it. Arguments are the same as for
+// `WinFw_ApplyPolicyConnected`. Call this while connecting, once the tunnel interface
+// has been created.
+//
+// If `WinFw_ApplyPolicyConnected` is later called with identical arguments, the
+// prepared policy is committed directly. Otherwise, it is discarded and the policy
+// is composed as usual. Only the most recently staged policy is kept.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StagePolicyConnected(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const wchar_t *v4DnsHost,
+	const wchar_t *v6DnsHost
+);
+
+//
+// ApplyPolicyConnectedMultiDns:
+//
+// Same as `WinFw_ApplyPolicyConnected`, but addresses are passed in binary form,
+// and any number of DNS servers, of either address family, can be permitted.
+// A single filter is installed per address family.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectedMultiDns(
+	const WinFwSettings &settings,
+	const WinFwEndpoint &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const WinFwIp *dnsHosts,
+	size_t numDnsHosts
+);
+
+//
+// StagePolicyConnectedMultiDns:
+//
+// Same as `WinFw_StagePolicyConnected`, with arguments as for
+// `WinFw_ApplyPolicyConnectedMultiDns`. A policy staged by either function
+// is committed by either apply function, given identical addresses.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StagePolicyConnectedMultiDns(
+	const WinFwSettings &settings,
+	const WinFwEndpoint &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const WinFwIp *dnsHosts,
+	size_t numDnsHosts
+);
+
+//
+// ApplyPolicyRelaySwitch:
+//
+// Permit communication with 'relay' in addition to the relay of the connected policy
+// in effect, and leave the tunnel and DNS filters in place. This is the first step of
+// switching relays while connected, so the old tunnel remains usable while the tunnel
+// to the new relay is brought up. The new relay may use a different port or protocol
+// than the connected relay.
+//
+// Once the new tunnel is up, apply the connected policy for the new relay. Only the
+// relay filters are replaced then, as long as the tunnel interface and DNS hosts
+// are the same.
+//
+// Fails without changing anything unless the connected policy, or a relay switch
+// from it, is in effect. Apply the connecting policy in that case.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyRelaySwitch(
+	const WinFwRelay &relay
+);
+
 //
 // ApplyPolicyBlocked:
 //
@@ -180,6 +499,60 @@ WinFw_ApplyPolicyBlocked(
 	const WinFwSettings &settings
 );
 
+//
+// ArmPolicyOffline:
+//
+// Compose the blocked policy for 'settings' ahead of time, to be applied by
+// `WinFw_ApplyPolicyOffline` once connectivity is lost. Arming again replaces
+// the settings. Pass nullptr to disarm.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ArmPolicyOffline(
+	const WinFwSettings *settings
+);
+
+//
+// ApplyPolicyOffline:
+//
+// Apply the armed offline policy. This is the same as calling `WinFw_ApplyPolicyBlocked`
+// with the armed settings, except that the policy has already been composed.
+//
+// The signature matches `WinNetOfflineAction`, so this can be passed directly to
+// `WinNet_SetConnectivityOfflineAction`. The connectivity monitor then switches to
+// the offline policy before notifying the client.
+//
+// May be called on any thread. Deinitializing waits for a call in progress.
+//
+// Returns false if no policy is armed, or if the module is not initialized.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyOffline(
+);
+
+//
+// SetExcludedApps:
+//
+// Specify applications, by path, that are permitted to communicate outside the tunnel.
+// Pass an empty set to clear the exclusions.
+//
+// The applications are permitted by the connecting and connected policies, starting
+// with the next policy that is applied. Paths that don't exist are ignored.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_SetExcludedApps(
+	const wchar_t **paths,
+	size_t numPaths
+);
+
 //
 // Reset:
 //
@@ -190,3 +563,462 @@ WINFW_LINKAGE
 bool
 WINFW_API
 WinFw_Reset();
+
+//
+// SetLatencyBudget:
+//
+// Log a single detailed warning whenever applying a policy takes longer than
+// `policyApplyMs`. The warning breaks down where the time was spent, including
+// the wait for the BFE transaction lock. Zero disables the check, which is the default.
+//
+// Can be called at any time, including before initialization.
+//
+extern "C"
+WINFW_LINKAGE
+void
+WINFW_API
+WinFw_SetLatencyBudget(
+	uint32_t policyApplyMs
+);
+
+//
+// GetStatistics:
+//
+// Retrieve timings and counts for the firewall transactions executed
+// since initialization.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_GetStatistics(
+	WinFwStatistics *statistics
+);
+
+//
+// EstimatePolicy:
+//
+// Compose a policy and compare it with the policy in effect, without changing
+// anything in the firewall. The estimate describes the transaction that would
+// be executed if the policy were applied.
+//
+// Only the fields that apply to the selected policy are used. They are the same
+// as the arguments of the corresponding WinFw_ApplyPolicy*() function.
+//
+
+enum WINFW_POLICY
+{
+	WINFW_POLICY_CONNECTING = 0,
+	WINFW_POLICY_CONNECTED = 1,
+	WINFW_POLICY_BLOCKED = 2,
+};
+
+typedef struct tag_WinFwPolicy
+{
+	WINFW_POLICY policy;
+
+	// Connecting.
+	const WinFwRelay *relays;
+	size_t numRelays;
+	const PingableHosts *pingableHosts;
+
+	// Connected.
+	const WinFwEndpoint *relay;
+	const wchar_t *tunnelInterfaceAlias;
+	const WinFwIp *dnsHosts;
+	size_t numDnsHosts;
+}
+WinFwPolicy;
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_EstimatePolicy(
+	const WinFwSettings &settings,
+	const WinFwPolicy &policy,
+	WinFwPolicyEstimate *estimate
+);
+
+//
+// GetPerformanceCounters:
+//
+// Invoke the sink once with a snapshot of all performance counters
+// registered by winfw.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_GetPerformanceCounters(
+	MullvadCounterSink sink,
+	void *context
+);
+
+//
+// CollectNativeDiagnostics:
+//
+// Write the state of the firewall into 'buffer', as a compact binary blob for
+// problem reports. See libshared/diagnostics/diagnosticsblob.h for the format.
+//
+// The blob includes the most recent policy application, all performance counters
+// and every filter owned by WINFW. Specify the size of 'buffer' in 'size'. The size
+// is a hard cap: records that don't fit are left out, and the blob is marked as
+// truncated. On return, 'size' holds the size of the blob.
+//
+// This function can be used whether or not WINFW has been initialized.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_CollectNativeDiagnostics(
+	uint8_t *buffer,
+	uint32_t *size
+);
+
+//
+// StartRecording:
+//
+// Record all subsequent calls that change the firewall state, with their arguments,
+// start times and durations, to a compact binary file. The file is overwritten if it
+// exists. Recordings can be replayed, e.g. by the benchmark tool, to reproduce
+// a sequence of policies on another machine.
+//
+// Policies requested asynchronously are recorded when applied, and not at all if
+// they are superseded. Log sinks and completion callbacks are not recorded.
+//
+// Starting a new recording ends the one in progress, if any. Recording is
+// independent of initialization.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StartRecording(
+	const wchar_t *path
+);
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StopRecording();
+
+//
+// Asynchronous policy application.
+//
+// The functions below queue a policy for application on a dedicated thread, and
+// return immediately. All arguments are copied before returning.
+//
+// Only the newest queued policy is applied. A policy that is replaced before it has
+// been applied is completed with WINFW_POLICY_STATUS_SUPERSEDED. The same is true if
+// a policy is applied synchronously, or WinFw_Deinitialize() is called, while an
+// asynchronous request is pending.
+//
+// Blocked requests take priority over connecting and connected requests. A queued
+// blocked request is processed before an older request that has not yet started
+// applying, and the older request is completed with WINFW_POLICY_STATUS_SUPERSEDED.
+// A connecting or connected request queued after a blocked request does not replace
+// it, but is applied once the blocked policy is in place.
+//
+// The completion callback is invoked exactly once for every accepted request.
+// It may be invoked on the worker thread or on the thread making a superseding call.
+//
+// The return value indicates whether the request was accepted.
+//
+
+enum WINFW_POLICY_STATUS
+{
+	WINFW_POLICY_STATUS_SUCCESS = 0,
+	WINFW_POLICY_STATUS_GENERAL_FAILURE = 1,
+	WINFW_POLICY_STATUS_SUPERSEDED = 2,
+};
+
+typedef void (WINFW_API *WinFwPolicyCompletion)(WINFW_POLICY_STATUS status, void *context);
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectingAsync(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const PingableHosts *pingableHosts,
+	WinFwPolicyCompletion completion,
+	void *completionContext
+);
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyConnectedAsync(
+	const WinFwSettings &settings,
+	const WinFwRelay &relay,
+	const wchar_t *tunnelInterfaceAlias,
+	const wchar_t *v4DnsHost,
+	const wchar_t *v6DnsHost,
+	WinFwPolicyCompletion completion,
+	void *completionContext
+);
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_ApplyPolicyBlockedAsync(
+	const WinFwSettings &settings,
+	WinFwPolicyCompletion completion,
+	void *completionContext
+);
+
+//
+// Blocked traffic events.
+//
+// Packets dropped by Mullvad filters are aggregated per (application, remote address, filter)
+// over a time window. When the window elapses, a batch with one entry per combination
+// is passed to the sink. At most one batch is delivered per window, and nothing is
+// delivered for a window without blocked traffic.
+//
+// The number of entries in a batch is bounded. Events that don't fit are not
+// aggregated, but counted in 'numOverflowed'.
+//
+// The sink is invoked on a dedicated thread. Pointers are only valid for the
+// duration of the callback.
+//
+
+typedef struct tag_WinFwBlockedEvent
+{
+	// Device path of the application, or null if not known.
+	const wchar_t *application;
+
+	// String encoded remote IP address, or null if not known.
+	const wchar_t *remoteAddress;
+
+	// Run-time identifier of the filter that dropped the traffic.
+	uint64_t filterId;
+
+	// Number of drops during the window.
+	uint32_t count;
+}
+WinFwBlockedEvent;
+
+typedef void (WINFW_API *WinFwBlockedEventsSink)
+(
+	const WinFwBlockedEvent *events,
+	uint32_t numEvents,
+	uint32_t numOverflowed,
+	void *context
+);
+
+//
+// SubscribeBlockedEvents:
+//
+// Start delivering blocked traffic events. Only a single subscription can be active.
+// Specify 0 as the window to use a default window of one second.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_SubscribeBlockedEvents(
+	uint32_t windowMs,
+	WinFwBlockedEventsSink sink,
+	void *sinkContext
+);
+
+//
+// UnsubscribeBlockedEvents:
+//
+// Stop delivering blocked traffic events. Events that have not yet been delivered
+// are discarded. The sink is not invoked after this function returns.
+//
+// The subscription is also cancelled by WinFw_Deinitialize().
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_UnsubscribeBlockedEvents();
+
+//
+// GetFilterReport:
+//
+// Report the number of filters installed by WINFW, per layer and sublayer.
+// This can be used to find the rules that contribute the most to the cost of
+// classifying traffic.
+//
+// Specify the capacity of 'entries' in 'numEntries'. On return, 'numEntries'
+// holds the number of entries in the report. If the buffer is too small,
+// WINFW_REPORT_STATUS_BUFFER_TOO_SMALL is returned and nothing is copied.
+//
+// This function can be used whether or not WINFW has been initialized.
+//
+
+typedef struct tag_WinFwFilterLayerReport
+{
+	GUID layer;
+	GUID sublayer;
+
+	uint32_t numFilters;
+
+	// Sum of the number of conditions over all filters.
+	uint32_t numConditions;
+
+	// Number of conditions in the filter with the most conditions.
+	uint32_t maxConditions;
+}
+WinFwFilterLayerReport;
+
+enum WINFW_REPORT_STATUS
+{
+	WINFW_REPORT_STATUS_SUCCESS = 0,
+	WINFW_REPORT_STATUS_BUFFER_TOO_SMALL = 1,
+	WINFW_REPORT_STATUS_GENERAL_FAILURE = 2,
+};
+
+extern "C"
+WINFW_LINKAGE
+WINFW_REPORT_STATUS
+WINFW_API
+WinFw_GetFilterReport(
+	WinFwFilterLayerReport *entries,
+	uint32_t *numEntries
+);
+
+//
+// StartRuleCounters:
+//
+// Start counting packets dropped by BFE, per filter installed by WINFW.
+// This can be used to find out which rules actually match traffic, and how often.
+//
+// Counting continues until WinFw_StopRuleCounters() or WinFw_Deinitialize() is called.
+//
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StartRuleCounters();
+
+extern "C"
+WINFW_LINKAGE
+bool
+WINFW_API
+WinFw_StopRuleCounters();
+
+//
+// GetRuleCounters:
+//
+// Report the number of drops per filter key, since the counters were started.
+// Entries are sorted by filter key.
+//
+// Drops are attributed to filter keys when the counters are read. Drops by filters
+// that have been removed since, and by filters that don't have a key or aren't
+// installed by WINFW, are only counted in 'numUnattributed'.
+//
+// Specify the capacity of 'entries' in 'numEntries'. On return, 'numEntries'
+// holds the number of entries in the report. If the buffer is too small,
+// WINFW_REPORT_STATUS_BUFFER_TOO_SMALL is returned and nothing is copied.
+// Counts are not lost by reading them, so the call can be repeated with a larger buffer.
+//
+
+typedef struct tag_WinFwRuleCounter
+{
+	GUID filterKey;
+	uint64_t numDropped;
+}
+WinFwRuleCounter;
+
+extern "C"
+WINFW_LINKAGE
+WINFW_REPORT_STATUS
+WINFW_API
+WinFw_GetRuleCounters(
+	WinFwRuleCounter *entries,
+	uint32_t *numEntries,
+	uint64_t *numUnattributed
+);
+
+//
+// CheckDnsLeaks:
+//
+// Verify that DNS can't be reached outside the tunnel. A query is sent to each of
+// the resolvers from every address of every interface that is up, except the tunnel
+// and loopback interfaces. All queries are sent at once, and answers are awaited
+// for at most 'timeoutMs' milliseconds. Specify 0 to use a default of 250 ms.
+// Timeouts are capped at 2000 ms.
+//
+// Use public resolvers outside the tunnel. Resolvers in private address ranges
+// are reachable if the policy permits LAN traffic.
+//
+// The result of each query is returned in 'probes'. Specify the capacity of 'probes'
+// in 'numProbes'. On return, 'numProbes' holds the number of queries sent. If the buffer
+// is too small, WINFW_REPORT_STATUS_BUFFER_TOO_SMALL is returned before any queries are
+// sent, and 'numProbes' holds the number of queries that would be sent.
+//
+// The firewall state is not changed. Policy changes are not held up by the check, but
+// the check fails if the policy changes while the queries are outstanding.
+//
+
+enum WINFW_DNS_PROBE_RESULT : uint8_t
+{
+	// The firewall rejected the query when it was sent.
+	WINFW_DNS_PROBE_RESULT_BLOCKED = 0,
+
+	// The query was sent without error, but was not answered in time.
+	// Normally this means it was dropped by the firewall. See 'numDrops'.
+	WINFW_DNS_PROBE_RESULT_NO_RESPONSE = 1,
+
+	// An answer, or an ICMP error, was received. The query left the host.
+	WINFW_DNS_PROBE_RESULT_RESPONSE = 2,
+
+	// The query could not be sent for some other reason, e.g. there is no route.
+	WINFW_DNS_PROBE_RESULT_ERROR = 3,
+};
+
+typedef struct tag_WinFwDnsProbe
+{
+	uint64_t interfaceLuid;
+	WinFwIp source;
+	WinFwIp resolver;
+	WINFW_DNS_PROBE_RESULT result;
+}
+WinFwDnsProbe;
+
+typedef struct tag_WinFwDnsLeakSummary
+{
+	uint32_t numBlocked;
+	uint32_t numUnanswered;
+	uint32_t numLeaked;
+	uint32_t numFailed;
+
+	// Whether the filters that permit DNS inside the tunnel are installed,
+	// i.e. the connected policy is in effect.
+	bool tunnelDnsPermitted;
+
+	// Whether rule counters are running. See WinFw_StartRuleCounters().
+	bool dropsCounted;
+
+	// Packets dropped by the block-all filters during the check, if counted.
+	// Drops are reported asynchronously by BFE, so this is a lower bound.
+	uint64_t numDrops;
+
+	// Duration of the check, in microseconds.
+	uint64_t durationUs;
+}
+WinFwDnsLeakSummary;
+
+extern "C"
+WINFW_LINKAGE
+WINFW_REPORT_STATUS
+WINFW_API
+WinFw_CheckDnsLeaks(
+	const wchar_t *tunnelInterfaceAlias,
+	const WinFwIp *resolvers,
+	size_t numResolvers,
+	uint32_t timeoutMs,
+	WinFwDnsProbe *probes,
+	uint32_t *numProbes,
+	WinFwDnsLeakSummary *summary
+);
@@ -0,0 +1,22 @@
+#include <windows.h>
+#include <libshared/tracing/trace.h>
+
+//
+// This module combines winfw, windns, winnet and winutil.
+//
+// There's a single instance of the trace provider, the performance counters and
+// the caches in libshared, which are used by all subsystems. Subsystems are not
+// initialized here but, exactly as in the separate modules, when their exports
+// are first used.
+//
+
+MULLVAD_DEFINE_TRACE_PROVIDER();
+
+BOOL APIENTRY DllMain(HMODULE, DWORD, LPVOID)
+{
+	//
+	// Avoid doing work in DllMain since the loader lock is held
+	//
+
+	return TRUE;
+}
@@ -0,0 +1,88 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "winnative.h"
+#include <vector>
+
+namespace
+{
+
+bool ConvertRelayAddress(const wchar_t *ip, WINNET_IP &converted)
+{
+	if (nullptr == ip)
+	{
+		return false;
+	}
+
+	converted = WINNET_IP{};
+
+	if (1 == InetPtonW(AF_INET, ip, converted.bytes))
+	{
+		converted.type = WINNET_IP_TYPE_IPV4;
+		return true;
+	}
+
+	if (1 == InetPtonW(AF_INET6, ip, converted.bytes))
+	{
+		converted.type = WINNET_IP_TYPE_IPV6;
+		return true;
+	}
+
+	return false;
+}
+
+} // anonymous namespace
+
+extern "C"
+WINNATIVE_LINKAGE
+WINNATIVE_RELAY_PATH_STATUS
+WINNATIVE_API
+WinNative_PrepareRelayPath(
+	const WinFwSettings &settings,
+	const WinFwRelay *relays,
+	size_t numRelays,
+	const PingableHosts *pingableHosts
+)
+{
+	if (nullptr == relays || 0 == numRelays || numRelays > UINT32_MAX)
+	{
+		return WINNATIVE_RELAY_PATH_STATUS_INVALID_ARGUMENT;
+	}
+
+	std::vector<WINNET_IP> relayAddresses;
+
+	try
+	{
+		relayAddresses.resize(numRelays);
+	}
+	catch (...)
+	{
+		return WINNATIVE_RELAY_PATH_STATUS_INVALID_ARGUMENT;
+	}
+
+	//
+	// Validate everything up front, so a bad address doesn't leave a half-prepared path.
+	//
+	for (size_t i = 0; i < numRelays; ++i)
+	{
+		if (false == ConvertRelayAddress(relays[i].ip, relayAddresses[i]))
+		{
+			return WINNATIVE_RELAY_PATH_STATUS_INVALID_ARGUMENT;
+		}
+	}
+
+	//
+	// A permit doesn't change where traffic goes. A route without the permit would
+	// send packets towards the relay, only to have them dropped by the firewall.
+	//
+	if (false == WinFw_ApplyPolicyConnectingMultiRelay(settings, relays, numRelays, pingableHosts))
+	{
+		return WINNATIVE_RELAY_PATH_STATUS_FIREWALL_FAILURE;
+	}
+
+	if (false == WinNet_SetRelayRoutes(&relayAddresses[0], static_cast<uint32_t>(numRelays)))
+	{
+		return WINNATIVE_RELAY_PATH_STATUS_ROUTE_FAILURE;
+	}
+
+	return WINNATIVE_RELAY_PATH_STATUS_SUCCESS;
+}
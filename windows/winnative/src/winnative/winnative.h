@@ -0,0 +1,58 @@
+#pragma once
+
+#include <winfw/winfw.h>
+#include <winnet/src/winnet/winnet.h>
+#include <stdint.h>
+
+//
+// WINNATIVE public API
+//
+// Operations that span several of the subsystems in this module. The subsystem
+// exports are available as well, see winnative.def.
+//
+
+#ifdef WINNATIVE_EXPORTS
+#define WINNATIVE_LINKAGE __declspec(dllexport)
+#else
+#define WINNATIVE_LINKAGE __declspec(dllimport)
+#endif
+
+#define WINNATIVE_API __stdcall
+
+enum WINNATIVE_RELAY_PATH_STATUS
+{
+	WINNATIVE_RELAY_PATH_STATUS_SUCCESS = 0,
+
+	// Nothing was changed.
+	WINNATIVE_RELAY_PATH_STATUS_INVALID_ARGUMENT = 1,
+
+	// The firewall policy could not be applied. The relay routes were not changed.
+	WINNATIVE_RELAY_PATH_STATUS_FIREWALL_FAILURE = 2,
+
+	// The connecting policy is in effect, but the relay routes could not be applied.
+	WINNATIVE_RELAY_PATH_STATUS_ROUTE_FAILURE = 3,
+};
+
+//
+// PrepareRelayPath:
+//
+// Make the relays reachable before connecting to them, in a single call.
+//
+// The connecting policy is applied as with `WinFw_ApplyPolicyConnectingMultiRelay`,
+// and the relay routes are then set as with `WinNet_SetRelayRoutes`. The firewall goes
+// first, so traffic to a relay is never routed before it's permitted. When this returns
+// successfully, both the filters and the routes are committed, and the first packet
+// to a relay can be sent.
+//
+// Both subsystems must be initialized.
+//
+extern "C"
+WINNATIVE_LINKAGE
+WINNATIVE_RELAY_PATH_STATUS
+WINNATIVE_API
+WinNative_PrepareRelayPath(
+	const WinFwSettings &settings,
+	const WinFwRelay *relays,
+	size_t numRelays,
+	const PingableHosts *pingableHosts
+);
@@ -795,4 +795,248 @@ public:
 
 		Assert::AreEqual(LastEvent::Delete, lastEvent, L"Expected event for connected adapter was not received");
 	}
+
+	TEST_METHOD(updateAdapter)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto filter = [](const MIB_IF_ROW2 &) -> bool
+		{
+			return true;
+		};
+
+		const auto testProvider = std::make_shared<TestDataProvider>();
+
+		LastEvent lastEvent = LastEvent::NoEvent;
+		std::vector<MIB_IF_ROW2> reportedAdapters;
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			[&lastEvent, &reportedAdapters](const std::vector<MIB_IF_ROW2> &adapters, const MIB_IF_ROW2 *, UpdateType updateType) -> void
+			{
+				lastEvent = (UpdateType::Update == updateType ? LastEvent::Update : LastEvent::Add);
+				reportedAdapters = adapters;
+			},
+			filter,
+			testProvider
+		);
+
+		MIB_IF_ROW2 adapter = { 0 };
+		adapter.InterfaceLuid.Value = 1;
+		adapter.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+		adapter.OperStatus = IfOperStatusDown;
+
+		MIB_IPINTERFACE_ROW iface = { 0 };
+		iface.InterfaceLuid.Value = 1;
+		iface.Family = AF_INET;
+
+		testProvider->addIpInterface(adapter, iface);
+		testProvider->sendEvent(&iface, MibAddInstance);
+
+		Assert::AreEqual(LastEvent::Add, lastEvent, L"Expected new adapter");
+
+		//
+		// Change adapter details
+		//
+
+		adapter.OperStatus = IfOperStatusUp;
+		testProvider->addAdapter(adapter);
+		testProvider->sendEvent(&iface, MibParameterNotification);
+
+		Assert::AreEqual(LastEvent::Update, lastEvent, L"Expected updated adapter");
+		Assert::AreEqual(size_t(1), reportedAdapters.size(), L"Expected single adapter");
+		Assert::IsTrue(IfOperStatusUp == reportedAdapters[0].OperStatus, L"Reported adapter details are stale");
+	}
+
+	TEST_METHOD(updateAdapter_TrafficCounters)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto filter = [](const MIB_IF_ROW2 &) -> bool
+		{
+			return true;
+		};
+
+		const auto testProvider = std::make_shared<TestDataProvider>();
+
+		LastEvent lastEvent = LastEvent::NoEvent;
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			[&lastEvent](const std::vector<MIB_IF_ROW2> &, const MIB_IF_ROW2 *, UpdateType updateType) -> void
+			{
+				lastEvent = (UpdateType::Update == updateType ? LastEvent::Update : LastEvent::Add);
+			},
+			filter,
+			testProvider
+		);
+
+		MIB_IF_ROW2 adapter = { 0 };
+		adapter.InterfaceLuid.Value = 1;
+		adapter.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+
+		MIB_IPINTERFACE_ROW iface = { 0 };
+		iface.InterfaceLuid.Value = 1;
+		iface.Family = AF_INET;
+
+		testProvider->addIpInterface(adapter, iface);
+		testProvider->sendEvent(&iface, MibAddInstance);
+
+		Assert::AreEqual(LastEvent::Add, lastEvent, L"Expected new adapter");
+
+		//
+		// Only traffic counters change
+		//
+
+		lastEvent = LastEvent::NoEvent;
+
+		adapter.InOctets += 1000;
+		adapter.OutUcastPkts += 10;
+		testProvider->addAdapter(adapter);
+		testProvider->sendEvent(&iface, MibParameterNotification);
+
+		Assert::AreEqual(LastEvent::NoEvent, lastEvent, L"Expected no event for changed traffic counters");
+
+		//
+		// Significant field changes
+		//
+
+		adapter.Mtu = 1280;
+		testProvider->addAdapter(adapter);
+		testProvider->sendEvent(&iface, MibParameterNotification);
+
+		Assert::AreEqual(LastEvent::Update, lastEvent, L"Expected updated adapter");
+	}
+
+	TEST_METHOD(deltaSink)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto filter = [](const MIB_IF_ROW2 &) -> bool
+		{
+			return true;
+		};
+
+		const auto testProvider = std::make_shared<TestDataProvider>();
+
+		std::optional<NetworkAdapterMonitor::Delta> lastDelta;
+		NetworkAdapterMonitor::Snapshot snapshot;
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			NetworkAdapterMonitor::DeltaSinkType([&lastDelta, &snapshot](const NetworkAdapterMonitor::Delta &delta, NetworkAdapterMonitor &monitor)
+			{
+				lastDelta = delta;
+				snapshot = monitor.snapshot();
+			}),
+			filter,
+			testProvider
+		);
+
+		Assert::IsTrue(lastDelta.has_value(), L"Expected initial notification");
+		Assert::IsFalse(lastDelta->luid.has_value(), L"Initial notification should apply to all adapters");
+		Assert::AreEqual(size_t(0), lastDelta->adapterCount, L"Expected 0 adapters initially");
+
+		const auto initialSnapshot = snapshot;
+
+		MIB_IF_ROW2 adapter = { 0 };
+		adapter.InterfaceLuid.Value = 1;
+		adapter.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+
+		MIB_IPINTERFACE_ROW iface = { 0 };
+		iface.InterfaceLuid.Value = 1;
+		iface.Family = AF_INET;
+
+		testProvider->addIpInterface(adapter, iface);
+		testProvider->sendEvent(&iface, MibAddInstance);
+
+		Assert::IsTrue(UpdateType::Add == lastDelta->updateType, L"Expected Add event");
+		Assert::IsTrue(lastDelta->luid.has_value() && 1 == lastDelta->luid->Value, L"Expected event for new adapter");
+		Assert::AreEqual(size_t(1), lastDelta->adapterCount, L"Expected new adapter");
+		Assert::AreEqual(size_t(1), snapshot->size(), L"Expected new adapter in snapshot");
+		Assert::AreEqual(size_t(0), initialSnapshot->size(), L"Earlier snapshot was modified");
+	}
+
+	TEST_METHOD(resync)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto filter = [](const MIB_IF_ROW2 &) -> bool
+		{
+			return true;
+		};
+
+		const auto testProvider = std::make_shared<TestDataProvider>();
+
+		MIB_IF_ROW2 adapter1 = { 0 };
+		adapter1.InterfaceLuid.Value = 1;
+		adapter1.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+
+		MIB_IPINTERFACE_ROW iface1 = { 0 };
+		iface1.InterfaceLuid.Value = 1;
+		iface1.Family = AF_INET;
+
+		testProvider->addIpInterface(adapter1, iface1);
+
+		size_t adapterCount = 0;
+		size_t numDeleted = 0;
+		size_t numAdded = 0;
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			[&](const std::vector<MIB_IF_ROW2> &adapters, const MIB_IF_ROW2 *adapter, UpdateType updateType) -> void
+			{
+				adapterCount = adapters.size();
+
+				if (nullptr == adapter)
+				{
+					return;
+				}
+
+				if (UpdateType::Add == updateType)
+				{
+					++numAdded;
+				}
+				else if (UpdateType::Delete == updateType)
+				{
+					++numDeleted;
+				}
+			},
+			filter,
+			testProvider
+		);
+
+		Assert::AreEqual(size_t(1), adapterCount, L"Expected 1 adapter initially");
+
+		//
+		// Replace the adapter without sending any events
+		//
+
+		testProvider->removeAdapter(adapter1);
+
+		MIB_IF_ROW2 adapter2 = { 0 };
+		adapter2.InterfaceLuid.Value = 2;
+		adapter2.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+
+		MIB_IPINTERFACE_ROW iface2 = { 0 };
+		iface2.InterfaceLuid.Value = 2;
+		iface2.Family = AF_INET6;
+
+		testProvider->addIpInterface(adapter2, iface2);
+
+		testProvider->sendEvent(nullptr, MibInitialNotification);
+
+		Assert::AreEqual(size_t(1), adapterCount, L"Expected 1 adapter after resync");
+		Assert::AreEqual(size_t(1), numDeleted, L"Expected removed adapter");
+		Assert::AreEqual(size_t(1), numAdded, L"Expected new adapter");
+
+		//
+		// Nothing has changed
+		//
+
+		testProvider->sendEvent(nullptr, MibInitialNotification);
+
+		Assert::AreEqual(size_t(1), numDeleted, L"Expected no event for unchanged adapters");
+		Assert::AreEqual(size_t(1), numAdded, L"Expected no event for unchanged adapters");
+	}
 };
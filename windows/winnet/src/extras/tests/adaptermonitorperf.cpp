@@ -0,0 +1,317 @@
+#include "stdafx.h"
+#include "testadapterutil.h"
+#include <libshared/logging/stdoutlogger.h>
+#include <libshared/logging/logsinkadapter.h>
+#include <windows.h>
+#include <psapi.h>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+
+namespace
+{
+
+constexpr size_t ADAPTER_COUNT = 500;
+constexpr size_t STORM_ROUNDS = 20;
+
+auto MakeStdoutLogger()
+{
+	return std::make_shared<shared::logging::LogSinkAdapter>(shared::logging::StdoutLogger, nullptr);
+}
+
+//
+// Counts the queries made by the monitor, so the cost of each event can be measured.
+//
+class CountingDataProvider : public TestDataProvider
+{
+public:
+
+	size_t ifEntryQueries = 0;
+	size_t ipInterfaceQueries = 0;
+	size_t tableQueries = 0;
+
+	DWORD getIfTable2(PMIB_IF_TABLE2 *Table) override
+	{
+		++tableQueries;
+		return TestDataProvider::getIfTable2(Table);
+	}
+
+	DWORD getIfEntry2(PMIB_IF_ROW2 Row) override
+	{
+		++ifEntryQueries;
+		return TestDataProvider::getIfEntry2(Row);
+	}
+
+	DWORD getIpInterfaceEntry(PMIB_IPINTERFACE_ROW Row) override
+	{
+		++ipInterfaceQueries;
+		return TestDataProvider::getIpInterfaceEntry(Row);
+	}
+
+	DWORD getIpInterfaceTable(ADDRESS_FAMILY Family, PMIB_IPINTERFACE_TABLE *Table) override
+	{
+		++tableQueries;
+		return TestDataProvider::getIpInterfaceTable(Family, Table);
+	}
+
+	size_t queries() const
+	{
+		return ifEntryQueries + ipInterfaceQueries + tableQueries;
+	}
+
+	void resetCounters()
+	{
+		ifEntryQueries = 0;
+		ipInterfaceQueries = 0;
+		tableQueries = 0;
+	}
+};
+
+struct FakeAdapter
+{
+	MIB_IF_ROW2 adapter;
+	MIB_IPINTERFACE_ROW iface;
+};
+
+std::vector<FakeAdapter> MakeAdapters(size_t count)
+{
+	std::vector<FakeAdapter> adapters(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto &fake = adapters[i];
+
+		fake.adapter = { 0 };
+		fake.adapter.InterfaceLuid.Value = 1000 + i;
+		fake.adapter.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+
+		fake.iface = { 0 };
+		fake.iface.InterfaceLuid.Value = fake.adapter.InterfaceLuid.Value;
+		fake.iface.Family = AF_INET;
+	}
+
+	return adapters;
+}
+
+size_t PrivateBytes()
+{
+	PROCESS_MEMORY_COUNTERS_EX counters = { 0 };
+
+	GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&counters), sizeof(counters));
+
+	return counters.PrivateUsage;
+}
+
+void Report(const wchar_t *test, size_t events, std::chrono::duration<double> elapsed, size_t callbacks, size_t queries)
+{
+	std::wstringstream ss;
+
+	ss << test << L": " << events << L" events in " << (elapsed.count() * 1000.0) << L" ms ("
+		<< static_cast<uint64_t>(events / elapsed.count()) << L" events/s), "
+		<< callbacks << L" callbacks, "
+		<< (static_cast<double>(queries) / events) << L" queries/event";
+
+	Logger::WriteMessage(ss.str().c_str());
+}
+
+} // anonymous namespace
+
+TEST_CLASS(NetworkAdapterMonitorPerfTests)
+{
+public:
+
+	TEST_METHOD(initialEnumeration_ManyAdapters)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto testProvider = std::make_shared<CountingDataProvider>();
+
+		for (const auto &fake : MakeAdapters(ADAPTER_COUNT))
+		{
+			testProvider->addIpInterface(fake.adapter, fake.iface);
+		}
+
+		size_t callbacks = 0;
+		size_t adapterCount = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			[&](const NetworkAdapterMonitor::Delta &delta, NetworkAdapterMonitor &)
+			{
+				++callbacks;
+				adapterCount = delta.adapterCount;
+			},
+			[](const MIB_IF_ROW2 &) { return true; },
+			testProvider
+		);
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		Report(L"initialEnumeration_ManyAdapters", ADAPTER_COUNT, elapsed, callbacks, testProvider->queries());
+
+		Assert::AreEqual(ADAPTER_COUNT, adapterCount, L"Expected all adapters");
+		Assert::AreEqual(size_t(1), callbacks, L"Expected a single initial notification");
+		Assert::AreEqual(size_t(2), testProvider->queries(), L"Expected one adapter and one interface table query");
+	}
+
+	TEST_METHOD(initialEnumeration_PresenceFromTable)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto testProvider = std::make_shared<CountingDataProvider>();
+		auto adapters = MakeAdapters(ADAPTER_COUNT);
+
+		for (const auto &fake : adapters)
+		{
+			testProvider->addIpInterface(fake.adapter, fake.iface);
+		}
+
+		size_t adapterCount = 0;
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			[&adapterCount](const NetworkAdapterMonitor::Delta &delta, NetworkAdapterMonitor &)
+			{
+				adapterCount = delta.adapterCount;
+			},
+			[](const MIB_IF_ROW2 &) { return true; },
+			testProvider
+		);
+
+		testProvider->resetCounters();
+
+		//
+		// Losing the only interface must not require the IPv6 interface to be queried.
+		//
+
+		for (auto &fake : adapters)
+		{
+			testProvider->removeIpInterface(fake.iface);
+			testProvider->sendEvent(&fake.iface, MibDeleteInstance);
+		}
+
+		Assert::AreEqual(size_t(0), adapterCount, L"Expected all adapters to be removed");
+		Assert::AreEqual(size_t(0), testProvider->ipInterfaceQueries, L"Expected presence to be known from the interface table");
+	}
+
+	TEST_METHOD(notificationStorm_ParameterChanges)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto testProvider = std::make_shared<CountingDataProvider>();
+		auto adapters = MakeAdapters(ADAPTER_COUNT);
+
+		size_t callbacks = 0;
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			[&callbacks](const NetworkAdapterMonitor::Delta &, NetworkAdapterMonitor &)
+			{
+				++callbacks;
+			},
+			[](const MIB_IF_ROW2 &) { return true; },
+			testProvider
+		);
+
+		for (auto &fake : adapters)
+		{
+			testProvider->addIpInterface(fake.adapter, fake.iface);
+			testProvider->sendEvent(&fake.iface, MibAddInstance);
+		}
+
+		callbacks = 0;
+		testProvider->resetCounters();
+
+		//
+		// Nothing changes between notifications, so no callbacks are expected.
+		//
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (size_t round = 0; round < STORM_ROUNDS; ++round)
+		{
+			for (auto &fake : adapters)
+			{
+				testProvider->sendEvent(&fake.iface, MibParameterNotification);
+			}
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		const auto events = ADAPTER_COUNT * STORM_ROUNDS;
+
+		Report(L"notificationStorm_ParameterChanges", events, elapsed, callbacks, testProvider->queries());
+
+		Assert::AreEqual(size_t(0), callbacks, L"Expected no callbacks for unchanged adapters");
+		Assert::AreEqual(size_t(0), testProvider->ipInterfaceQueries, L"Expected presence to be taken from notifications");
+		Assert::AreEqual(events, testProvider->ifEntryQueries, L"Expected one adapter query per event");
+	}
+
+	TEST_METHOD(notificationStorm_AddRemove)
+	{
+		auto logSink = MakeStdoutLogger();
+
+		const auto testProvider = std::make_shared<CountingDataProvider>();
+		auto adapters = MakeAdapters(ADAPTER_COUNT);
+
+		size_t callbacks = 0;
+		size_t adapterCount = 0;
+
+		NetworkAdapterMonitor inst(
+			logSink,
+			[&](const NetworkAdapterMonitor::Delta &delta, NetworkAdapterMonitor &)
+			{
+				++callbacks;
+				adapterCount = delta.adapterCount;
+			},
+			[](const MIB_IF_ROW2 &) { return true; },
+			testProvider
+		);
+
+		callbacks = 0;
+
+		const auto privateBytesBefore = PrivateBytes();
+		const auto start = std::chrono::steady_clock::now();
+
+		for (size_t round = 0; round < STORM_ROUNDS; ++round)
+		{
+			for (auto &fake : adapters)
+			{
+				testProvider->addIpInterface(fake.adapter, fake.iface);
+				testProvider->sendEvent(&fake.iface, MibAddInstance);
+			}
+
+			for (auto &fake : adapters)
+			{
+				testProvider->removeIpInterface(fake.iface);
+				testProvider->sendEvent(&fake.iface, MibDeleteInstance);
+				testProvider->removeAdapter(fake.adapter);
+			}
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		const auto privateBytesAfter = PrivateBytes();
+
+		const auto events = ADAPTER_COUNT * STORM_ROUNDS * 2;
+
+		Report(L"notificationStorm_AddRemove", events, elapsed, callbacks, testProvider->queries());
+
+		{
+			std::wstringstream ss;
+
+			ss << L"notificationStorm_AddRemove: private bytes grew by "
+				<< static_cast<int64_t>(privateBytesAfter - privateBytesBefore) << L" bytes";
+
+			Logger::WriteMessage(ss.str().c_str());
+		}
+
+		Assert::AreEqual(size_t(0), adapterCount, L"Expected all adapters to be removed");
+		Assert::AreEqual(events, callbacks, L"Expected one callback per add and remove");
+	}
+};
@@ -0,0 +1,551 @@
+#include "stdafx.h"
+#include "testadapterutil.h"
+#include <winnet/offlinemonitor.h>
+#include <libshared/logging/stdoutlogger.h>
+#include <libshared/logging/logsinkadapter.h>
+#include <windows.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+
+namespace
+{
+
+constexpr size_t ADAPTER_COUNT = 48;
+constexpr size_t PATTERN_ROUNDS = 20;
+constexpr size_t FLAP_COUNT = 200;
+
+constexpr auto NOTIFICATION_TIMEOUT = std::chrono::seconds(5);
+
+auto MakeStdoutLogger()
+{
+	return std::make_shared<shared::logging::LogSinkAdapter>(shared::logging::StdoutLogger, nullptr);
+}
+
+struct FakeAdapter
+{
+	MIB_IF_ROW2 adapter;
+	MIB_IPINTERFACE_ROW iface;
+};
+
+//
+// Hardware adapters that are connected, but administratively disabled.
+//
+std::vector<FakeAdapter> MakeAdapters(size_t count)
+{
+	std::vector<FakeAdapter> adapters(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto &fake = adapters[i];
+
+		fake.adapter = { 0 };
+		fake.adapter.InterfaceLuid.Value = 2000 + i;
+		fake.adapter.AdminStatus = NET_IF_ADMIN_STATUS_DOWN;
+		fake.adapter.OperStatus = IfOperStatusUp;
+		fake.adapter.MediaConnectState = MediaConnectStateConnected;
+		fake.adapter.InterfaceAndOperStatusFlags.HardwareInterface = TRUE;
+		fake.adapter.InterfaceAndOperStatusFlags.ConnectorPresent = TRUE;
+		fake.adapter.PhysicalAddressLength = 6;
+		fake.adapter.PhysicalAddress[5] = static_cast<UCHAR>(i);
+
+		swprintf_s(fake.adapter.Alias, L"Ethernet %zu", i);
+
+		fake.iface = { 0 };
+		fake.iface.InterfaceLuid.Value = fake.adapter.InterfaceLuid.Value;
+		fake.iface.Family = AF_INET;
+	}
+
+	return adapters;
+}
+
+void SetEnabled(TestDataProvider &provider, FakeAdapter &fake, bool enabled)
+{
+	fake.adapter.AdminStatus = (enabled ? NET_IF_ADMIN_STATUS_UP : NET_IF_ADMIN_STATUS_DOWN);
+	provider.addAdapter(fake.adapter);
+}
+
+void SetConnected(TestDataProvider &provider, FakeAdapter &fake, bool connected)
+{
+	fake.adapter.OperStatus = (connected ? IfOperStatusUp : IfOperStatusDown);
+	fake.adapter.MediaConnectState = (connected ? MediaConnectStateConnected : MediaConnectStateDisconnected);
+	provider.addAdapter(fake.adapter);
+}
+
+void Rename(TestDataProvider &provider, FakeAdapter &fake, size_t index, size_t round)
+{
+	swprintf_s(fake.adapter.Alias, L"Ethernet %zu (%zu)", index, round);
+	provider.addAdapter(fake.adapter);
+}
+
+//
+// CPU time consumed by the whole process, so work done on monitor threads is included.
+//
+std::chrono::microseconds ProcessCpuTime()
+{
+	FILETIME creation, exit, kernel, user;
+
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+	const auto toTicks = [](const FILETIME &time)
+	{
+		return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+	};
+
+	// FILETIME is in units of 100 ns.
+	return std::chrono::microseconds((toTicks(kernel) + toTicks(user)) / 10);
+}
+
+//
+// Time from handing an event to the monitor until the callback observes it.
+//
+struct Latency
+{
+	size_t samples = 0;
+	std::chrono::steady_clock::duration total{};
+	std::chrono::steady_clock::duration worst{};
+
+	void add(std::chrono::steady_clock::duration latency)
+	{
+		++samples;
+		total += latency;
+		worst = std::max(worst, latency);
+	}
+};
+
+class Measurement
+{
+public:
+
+	Measurement()
+		: m_start(std::chrono::steady_clock::now())
+		, m_cpuStart(ProcessCpuTime())
+	{
+	}
+
+	void report(const wchar_t *test, size_t events, size_t callbacks, const Latency &latency) const
+	{
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+		const auto cpu = ProcessCpuTime() - m_cpuStart;
+
+		const auto toUs = [](std::chrono::steady_clock::duration duration)
+		{
+			return std::chrono::duration<double, std::micro>(duration).count();
+		};
+
+		std::wstringstream ss;
+
+		ss << test << L": " << ADAPTER_COUNT << L" adapters, " << events << L" events in "
+			<< (elapsed.count() * 1000.0) << L" ms, "
+			<< (static_cast<double>(cpu.count()) / events) << L" us CPU/event, "
+			<< callbacks << L" callbacks";
+
+		if (0 != latency.samples)
+		{
+			ss << L", latency avg " << (toUs(latency.total) / latency.samples)
+				<< L" us, worst " << toUs(latency.worst) << L" us";
+		}
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+private:
+
+	std::chrono::steady_clock::time_point m_start;
+	std::chrono::microseconds m_cpuStart;
+};
+
+//
+// Adapter monitor callbacks run on the notifying thread, so the
+// latency is the time spent in the monitor before the sink is called.
+//
+class AdapterMonitorBench
+{
+public:
+
+	AdapterMonitorBench(NetworkAdapterMonitor::FilterType filter)
+		: provider(std::make_shared<TestDataProvider>())
+		, adapters(MakeAdapters(ADAPTER_COUNT))
+		, callbacks(0)
+		, m_monitor(
+			MakeStdoutLogger(),
+			[this](const NetworkAdapterMonitor::Delta &, NetworkAdapterMonitor &)
+			{
+				++callbacks;
+				m_lastCallback = std::chrono::steady_clock::now();
+			},
+			filter,
+			provider
+		)
+	{
+		for (auto &fake : adapters)
+		{
+			provider->addIpInterface(fake.adapter, fake.iface);
+		}
+	}
+
+	//
+	// Returns whether the event resulted in a callback.
+	//
+	bool send(FakeAdapter &fake)
+	{
+		const auto previousCallbacks = callbacks;
+		const auto sent = std::chrono::steady_clock::now();
+
+		provider->sendEvent(&fake.iface, MibParameterNotification);
+
+		if (previousCallbacks == callbacks)
+		{
+			return false;
+		}
+
+		latency.add(m_lastCallback - sent);
+
+		return true;
+	}
+
+	std::shared_ptr<TestDataProvider> provider;
+	std::vector<FakeAdapter> adapters;
+
+	size_t callbacks;
+	Latency latency;
+
+private:
+
+	std::chrono::steady_clock::time_point m_lastCallback;
+	NetworkAdapterMonitor m_monitor;
+};
+
+//
+// Records connectivity notifications, which are delivered on the offline monitor's executor.
+//
+class NotificationRecorder
+{
+public:
+
+	OfflineMonitor::Notifier notifier()
+	{
+		return [this](OfflineMonitor::Connectivity connectivity)
+		{
+			const auto received = std::chrono::steady_clock::now();
+
+			{
+				std::scoped_lock<std::mutex> lock(m_lock);
+				m_notifications.push_back({ connectivity, received });
+			}
+
+			m_cv.notify_all();
+		};
+	}
+
+	//
+	// Waits for notification number 'count' and returns the time it was received.
+	//
+	std::chrono::steady_clock::time_point waitFor(size_t count, OfflineMonitor::Connectivity expected)
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+
+		const auto received = m_cv.wait_for(lock, NOTIFICATION_TIMEOUT, [this, count]()
+		{
+			return m_notifications.size() >= count;
+		});
+
+		Assert::IsTrue(received, L"Timed out waiting for connectivity notification");
+		Assert::IsTrue(expected == m_notifications[count - 1].connectivity, L"Unexpected connectivity");
+
+		return m_notifications[count - 1].received;
+	}
+
+	size_t count()
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		return m_notifications.size();
+	}
+
+private:
+
+	struct Notification
+	{
+		OfflineMonitor::Connectivity connectivity;
+		std::chrono::steady_clock::time_point received;
+	};
+
+	std::mutex m_lock;
+	std::condition_variable m_cv;
+	std::vector<Notification> m_notifications;
+};
+
+//
+// No confirmation delay and no probing, so every transition is reported as it happens.
+//
+std::unique_ptr<OfflineMonitor> MakeOfflineMonitor(NotificationRecorder &recorder, std::shared_ptr<TestDataProvider> provider)
+{
+	return std::make_unique<OfflineMonitor>(MakeStdoutLogger(), recorder.notifier(), 0, 0, nullptr, provider);
+}
+
+} // anonymous namespace
+
+TEST_CLASS(MultiAdapterPerfTests)
+{
+public:
+
+	TEST_METHOD(adapterMonitor_MassEnable)
+	{
+		AdapterMonitorBench bench([](const MIB_IF_ROW2 &) { return true; });
+
+		const Measurement measurement;
+
+		for (size_t round = 0; round < PATTERN_ROUNDS; ++round)
+		{
+			for (auto &fake : bench.adapters)
+			{
+				SetEnabled(*bench.provider, fake, true);
+				bench.send(fake);
+			}
+
+			for (auto &fake : bench.adapters)
+			{
+				SetEnabled(*bench.provider, fake, false);
+				bench.send(fake);
+			}
+		}
+
+		const auto events = ADAPTER_COUNT * PATTERN_ROUNDS * 2;
+
+		measurement.report(L"adapterMonitor_MassEnable", events, bench.callbacks, bench.latency);
+
+		Assert::AreEqual(events, bench.callbacks, L"Expected one callback per enable and disable");
+	}
+
+	TEST_METHOD(adapterMonitor_Flapping)
+	{
+		AdapterMonitorBench bench([](const MIB_IF_ROW2 &adapter)
+		{
+			return IfOperStatusUp == adapter.OperStatus;
+		});
+
+		for (auto &fake : bench.adapters)
+		{
+			SetEnabled(*bench.provider, fake, true);
+			bench.send(fake);
+		}
+
+		bench.callbacks = 0;
+		bench.latency = Latency();
+
+		//
+		// Flap a quarter of the adapters, while the rest remain connected.
+		//
+
+		const auto flapping = ADAPTER_COUNT / 4;
+
+		const Measurement measurement;
+
+		for (size_t flap = 0; flap < FLAP_COUNT; ++flap)
+		{
+			auto &fake = bench.adapters[flap % flapping];
+
+			SetConnected(*bench.provider, fake, IfOperStatusUp != fake.adapter.OperStatus);
+			bench.send(fake);
+		}
+
+		measurement.report(L"adapterMonitor_Flapping", FLAP_COUNT, bench.callbacks, bench.latency);
+
+		Assert::AreEqual(FLAP_COUNT, bench.callbacks, L"Expected one callback per flap");
+	}
+
+	TEST_METHOD(adapterMonitor_Rename)
+	{
+		AdapterMonitorBench bench([](const MIB_IF_ROW2 &) { return true; });
+
+		for (auto &fake : bench.adapters)
+		{
+			SetEnabled(*bench.provider, fake, true);
+			bench.send(fake);
+		}
+
+		bench.callbacks = 0;
+		bench.latency = Latency();
+
+		const Measurement measurement;
+
+		for (size_t round = 0; round < PATTERN_ROUNDS; ++round)
+		{
+			for (size_t i = 0; i < bench.adapters.size(); ++i)
+			{
+				Rename(*bench.provider, bench.adapters[i], i, round);
+				bench.send(bench.adapters[i]);
+			}
+		}
+
+		const auto events = ADAPTER_COUNT * PATTERN_ROUNDS;
+
+		measurement.report(L"adapterMonitor_Rename", events, bench.callbacks, bench.latency);
+
+		Assert::AreEqual(events, bench.callbacks, L"Expected one update per rename");
+	}
+
+	TEST_METHOD(offlineMonitor_MassEnable)
+	{
+		const auto provider = std::make_shared<TestDataProvider>();
+		auto adapters = MakeAdapters(ADAPTER_COUNT);
+
+		for (auto &fake : adapters)
+		{
+			provider->addIpInterface(fake.adapter, fake.iface);
+		}
+
+		NotificationRecorder recorder;
+		auto monitor = MakeOfflineMonitor(recorder, provider);
+
+		Latency latency;
+		size_t notifications = 0;
+
+		const Measurement measurement;
+
+		//
+		// Only the first enable and the last disable change connectivity.
+		//
+
+		for (size_t round = 0; round < PATTERN_ROUNDS; ++round)
+		{
+			for (size_t i = 0; i < adapters.size(); ++i)
+			{
+				SetEnabled(*provider, adapters[i], true);
+
+				const auto sent = std::chrono::steady_clock::now();
+				provider->sendEvent(&adapters[i].iface, MibParameterNotification);
+
+				if (0 == i)
+				{
+					latency.add(recorder.waitFor(++notifications, OfflineMonitor::Connectivity::Online) - sent);
+				}
+			}
+
+			for (size_t i = 0; i < adapters.size(); ++i)
+			{
+				SetEnabled(*provider, adapters[i], false);
+
+				const auto sent = std::chrono::steady_clock::now();
+				provider->sendEvent(&adapters[i].iface, MibParameterNotification);
+
+				if (adapters.size() - 1 == i)
+				{
+					latency.add(recorder.waitFor(++notifications, OfflineMonitor::Connectivity::Offline) - sent);
+				}
+			}
+		}
+
+		const auto events = ADAPTER_COUNT * PATTERN_ROUNDS * 2;
+
+		measurement.report(L"offlineMonitor_MassEnable", events, notifications, latency);
+
+		monitor.reset();
+
+		Assert::AreEqual(PATTERN_ROUNDS * 2, recorder.count(), L"Expected one notification per transition");
+	}
+
+	TEST_METHOD(offlineMonitor_Flapping)
+	{
+		const auto provider = std::make_shared<TestDataProvider>();
+		auto adapters = MakeAdapters(ADAPTER_COUNT);
+
+		//
+		// Every other adapter is disconnected, so flapping the remaining
+		// connected adapter toggles connectivity.
+		//
+
+		for (size_t i = 0; i < adapters.size(); ++i)
+		{
+			adapters[i].adapter.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+
+			if (0 != i)
+			{
+				adapters[i].adapter.OperStatus = IfOperStatusDown;
+				adapters[i].adapter.MediaConnectState = MediaConnectStateDisconnected;
+			}
+
+			provider->addIpInterface(adapters[i].adapter, adapters[i].iface);
+		}
+
+		NotificationRecorder recorder;
+		auto monitor = MakeOfflineMonitor(recorder, provider);
+
+		recorder.waitFor(1, OfflineMonitor::Connectivity::Online);
+
+		auto &flapping = adapters[0];
+
+		Latency latency;
+		size_t notifications = 1;
+
+		const Measurement measurement;
+
+		for (size_t flap = 0; flap < FLAP_COUNT; ++flap)
+		{
+			const auto connected = IfOperStatusUp != flapping.adapter.OperStatus;
+
+			SetConnected(*provider, flapping, connected);
+
+			const auto sent = std::chrono::steady_clock::now();
+			provider->sendEvent(&flapping.iface, MibParameterNotification);
+
+			const auto expected = (connected ? OfflineMonitor::Connectivity::Online : OfflineMonitor::Connectivity::Offline);
+
+			latency.add(recorder.waitFor(++notifications, expected) - sent);
+		}
+
+		measurement.report(L"offlineMonitor_Flapping", FLAP_COUNT, notifications, latency);
+
+		monitor.reset();
+
+		Assert::AreEqual(FLAP_COUNT + 1, recorder.count(), L"Expected one notification per flap");
+	}
+
+	TEST_METHOD(offlineMonitor_Rename)
+	{
+		const auto provider = std::make_shared<TestDataProvider>();
+		auto adapters = MakeAdapters(ADAPTER_COUNT);
+
+		for (auto &fake : adapters)
+		{
+			fake.adapter.AdminStatus = NET_IF_ADMIN_STATUS_UP;
+			provider->addIpInterface(fake.adapter, fake.iface);
+		}
+
+		NotificationRecorder recorder;
+		auto monitor = MakeOfflineMonitor(recorder, provider);
+
+		recorder.waitFor(1, OfflineMonitor::Connectivity::Online);
+
+		const Measurement measurement;
+
+		//
+		// Renames are reported by the adapter monitor, but must not cause notifications.
+		//
+
+		for (size_t round = 0; round < PATTERN_ROUNDS; ++round)
+		{
+			for (size_t i = 0; i < adapters.size(); ++i)
+			{
+				Rename(*provider, adapters[i], i, round);
+				provider->sendEvent(&adapters[i].iface, MibParameterNotification);
+			}
+		}
+
+		const auto events = ADAPTER_COUNT * PATTERN_ROUNDS;
+
+		monitor.reset();
+
+		measurement.report(L"offlineMonitor_Rename", events, recorder.count() - 1, Latency());
+
+		Assert::AreEqual(size_t(1), recorder.count(), L"Expected no notifications for renamed adapters");
+	}
+};
@@ -0,0 +1,866 @@
+#include "stdafx.h"
+#include <winnet/routing/routemanager.h>
+#include <libshared/logging/stdoutlogger.h>
+#include <libshared/logging/logsinkadapter.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace winnet::routing;
+
+
+namespace
+{
+
+auto MakeStdoutLogger()
+{
+	return std::make_shared<shared::logging::LogSinkAdapter>(shared::logging::StdoutLogger, nullptr);
+}
+
+//
+// In-memory routing table with a controllable best default route.
+//
+class FakeRoutingProvider : public RouteManager::IDataProvider
+{
+public:
+
+	size_t creates = 0;
+	size_t deletes = 0;
+
+	// Invoked for each route created, before it's added to the table.
+	std::function<void()> onCreate;
+
+	FakeRoutingProvider()
+	{
+		m_defaultRoute = MakeDefaultRoute(1, 1);
+	}
+
+	DWORD createIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row) override
+	{
+		++creates;
+
+		if (onCreate)
+		{
+			onCreate();
+		}
+
+		return (m_table.emplace(MakeKey(*Row), *Row).second ? NO_ERROR : ERROR_OBJECT_ALREADY_EXISTS);
+	}
+
+	DWORD deleteIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row) override
+	{
+		++deletes;
+		return (0 != m_table.erase(MakeKey(*Row)) ? NO_ERROR : ERROR_NOT_FOUND);
+	}
+
+	DWORD getIpForwardTable2(ADDRESS_FAMILY Family, PMIB_IPFORWARD_TABLE2 *Table) override
+	{
+		std::vector<MIB_IPFORWARD_ROW2> rows;
+
+		for (const auto &entry : m_table)
+		{
+			if (AF_UNSPEC == Family || Family == entry.second.DestinationPrefix.Prefix.si_family)
+			{
+				rows.push_back(entry.second);
+			}
+		}
+
+		auto table = reinterpret_cast<MIB_IPFORWARD_TABLE2 *>(new uint8_t[
+			sizeof(MIB_IPFORWARD_TABLE2) + sizeof(MIB_IPFORWARD_ROW2) * rows.size()
+		]);
+
+		table->NumEntries = static_cast<ULONG>(rows.size());
+
+		std::copy(rows.begin(), rows.end(), static_cast<MIB_IPFORWARD_ROW2 *>(table->Table));
+
+		*Table = table;
+		return NO_ERROR;
+	}
+
+	void freeMibTable(PVOID Memory) override
+	{
+		delete[] reinterpret_cast<uint8_t *>(Memory);
+	}
+
+	InterfaceAndGateway getBestDefaultRoute(ADDRESS_FAMILY) override
+	{
+		return m_defaultRoute;
+	}
+
+	std::unique_ptr<IDefaultRouteMonitor> createDefaultRouteMonitor(
+		IDefaultRouteMonitor::Callback callback,
+		std::shared_ptr<common::logging::ILogSink>
+	) override
+	{
+		m_callback = callback;
+		return std::make_unique<FakeDefaultRouteMonitor>(*this);
+	}
+
+	//
+	// Test utilities
+	//
+
+	static InterfaceAndGateway MakeDefaultRoute(uint64_t luid, uint8_t gatewayHost)
+	{
+		InterfaceAndGateway route = { 0 };
+
+		route.iface.Value = luid;
+		route.gateway.si_family = AF_INET;
+		route.gateway.Ipv4.sin_addr.s_addr = htonl(0xC0A80000 | gatewayHost);
+
+		return route;
+	}
+
+	void changeDefaultRoute(const InterfaceAndGateway &route)
+	{
+		m_defaultRoute = route;
+
+		if (m_callback)
+		{
+			m_callback({ IDefaultRouteMonitor::Change{ AF_INET, IDefaultRouteMonitor::EventType::Updated, route, std::chrono::steady_clock::now() } });
+		}
+	}
+
+	//
+	// Add a route that was not created by a route manager.
+	//
+	void addForeignRoute(const Network &network, uint64_t luid)
+	{
+		MIB_IPFORWARD_ROW2 row;
+
+		InitializeIpForwardEntry(&row);
+
+		row.InterfaceLuid.Value = luid;
+		row.DestinationPrefix = network;
+		row.NextHop.si_family = network.Prefix.si_family;
+		row.Protocol = MIB_IPPROTO_NETMGMT;
+
+		m_table.emplace(MakeKey(row), row);
+	}
+
+	size_t size() const
+	{
+		return m_table.size();
+	}
+
+	size_t countOnInterface(uint64_t luid) const
+	{
+		size_t count = 0;
+
+		for (const auto &entry : m_table)
+		{
+			count += (luid == entry.first.luid ? 1 : 0);
+		}
+
+		return count;
+	}
+
+private:
+
+	class FakeDefaultRouteMonitor : public IDefaultRouteMonitor
+	{
+	public:
+
+		FakeDefaultRouteMonitor(FakeRoutingProvider &provider)
+			: m_provider(provider)
+		{
+		}
+
+		~FakeDefaultRouteMonitor()
+		{
+			m_provider.m_callback = nullptr;
+		}
+
+		void setCoalescing(const CoalescingSettings &) override
+		{
+		}
+
+	private:
+
+		FakeRoutingProvider &m_provider;
+	};
+
+	struct RouteKey
+	{
+		uint64_t luid;
+		uint8_t prefixLength;
+		std::array<uint8_t, sizeof(SOCKADDR_INET)> prefix;
+		std::array<uint8_t, sizeof(SOCKADDR_INET)> nextHop;
+
+		bool operator<(const RouteKey &rhs) const
+		{
+			if (luid != rhs.luid)
+			{
+				return luid < rhs.luid;
+			}
+
+			if (prefixLength != rhs.prefixLength)
+			{
+				return prefixLength < rhs.prefixLength;
+			}
+
+			if (prefix != rhs.prefix)
+			{
+				return prefix < rhs.prefix;
+			}
+
+			return nextHop < rhs.nextHop;
+		}
+	};
+
+	static RouteKey MakeKey(const MIB_IPFORWARD_ROW2 &row)
+	{
+		RouteKey key;
+
+		key.luid = row.InterfaceLuid.Value;
+		key.prefixLength = row.DestinationPrefix.PrefixLength;
+
+		memcpy(key.prefix.data(), &row.DestinationPrefix.Prefix, sizeof(SOCKADDR_INET));
+		memcpy(key.nextHop.data(), &row.NextHop, sizeof(SOCKADDR_INET));
+
+		return key;
+	}
+
+	std::map<RouteKey, MIB_IPFORWARD_ROW2> m_table;
+
+	InterfaceAndGateway m_defaultRoute;
+	IDefaultRouteMonitor::Callback m_callback;
+};
+
+Network MakeNetwork(size_t ordinal)
+{
+	Network network = { 0 };
+
+	network.Prefix.si_family = AF_INET;
+	network.Prefix.Ipv4.sin_family = AF_INET;
+	network.Prefix.Ipv4.sin_addr.s_addr = htonl(static_cast<uint32_t>(0x0A000000 | ordinal));
+	network.PrefixLength = 32;
+
+	return network;
+}
+
+//
+// Routes on an interface that is specified as a string encoded LUID,
+// so resolving the node doesn't touch the system.
+//
+std::vector<Route> MakeRoutes(size_t count, bool followDefaultRoute)
+{
+	static const NET_LUID luid = { 0x0006000000000000 };
+
+	std::wstringstream ss;
+
+	ss << L"?" << std::hex;
+	ss.width(16);
+	ss.fill(L'0');
+	ss << luid.Value;
+
+	const auto encodedLuid = ss.str();
+
+	std::vector<Route> routes;
+	routes.reserve(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (followDefaultRoute)
+		{
+			routes.emplace_back(MakeNetwork(i), std::nullopt);
+		}
+		else
+		{
+			routes.emplace_back(MakeNetwork(i), Node(encodedLuid, std::nullopt));
+		}
+	}
+
+	return routes;
+}
+
+//
+// Journal file that is deleted when going out of scope.
+//
+class TemporaryJournalPath
+{
+public:
+
+	TemporaryJournalPath()
+	{
+		wchar_t directory[MAX_PATH + 1];
+		wchar_t path[MAX_PATH + 1];
+
+		if (0 == GetTempPathW(_countof(directory), directory)
+			|| 0 == GetTempFileNameW(directory, L"wnj", 0, path))
+		{
+			Assert::Fail(L"Failed to create temporary file");
+		}
+
+		m_path = path;
+	}
+
+	~TemporaryJournalPath()
+	{
+		DeleteFileW(m_path.c_str());
+	}
+
+	const std::wstring &path() const
+	{
+		return m_path;
+	}
+
+private:
+
+	std::wstring m_path;
+};
+
+double Milliseconds(std::chrono::steady_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void MeasureAddDelete(size_t count)
+{
+	const auto provider = std::make_shared<FakeRoutingProvider>();
+
+	RouteManager manager(MakeStdoutLogger(), provider);
+
+	const auto routes = MakeRoutes(count, false);
+
+	const auto addStart = std::chrono::steady_clock::now();
+
+	manager.addRoutes(routes);
+
+	const auto addElapsed = std::chrono::steady_clock::now() - addStart;
+
+	Assert::AreEqual(count, provider->size(), L"Expected all routes to be added");
+
+	const auto deleteStart = std::chrono::steady_clock::now();
+
+	manager.deleteRoutes(routes);
+
+	const auto deleteElapsed = std::chrono::steady_clock::now() - deleteStart;
+
+	Assert::AreEqual(size_t(0), provider->size(), L"Expected all routes to be deleted");
+
+	std::wstringstream ss;
+
+	ss << L"addRoutes/deleteRoutes with " << count << L" routes: add "
+		<< Milliseconds(addElapsed) << L" ms, delete " << Milliseconds(deleteElapsed) << L" ms";
+
+	Logger::WriteMessage(ss.str().c_str());
+}
+
+} // anonymous namespace
+
+TEST_CLASS(RouteManagerPerfTests)
+{
+public:
+
+	TEST_METHOD(addDeleteRoutes_10)
+	{
+		MeasureAddDelete(10);
+	}
+
+	TEST_METHOD(addDeleteRoutes_1k)
+	{
+		MeasureAddDelete(1000);
+	}
+
+	TEST_METHOD(addDeleteRoutes_10k)
+	{
+		MeasureAddDelete(10000);
+	}
+
+	TEST_METHOD(applyRouteSet_Unchanged)
+	{
+		constexpr size_t ROUTE_COUNT = 1000;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		const auto routes = MakeRoutes(ROUTE_COUNT, false);
+
+		manager.applyRoutes(routes);
+
+		Assert::AreEqual(ROUTE_COUNT, provider->size(), L"Expected all routes to be added");
+
+		provider->creates = 0;
+		provider->deletes = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		manager.applyRoutes(routes);
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		Assert::AreEqual(size_t(0), provider->creates + provider->deletes, L"Expected no changes to the routing table");
+
+		//
+		// Dropping half of the routes deletes only those.
+		//
+
+		manager.applyRoutes(std::vector<Route>(routes.begin(), routes.begin() + (ROUTE_COUNT / 2)));
+
+		Assert::AreEqual(ROUTE_COUNT / 2, provider->size(), L"Expected half of the routes to remain");
+		Assert::AreEqual(size_t(0), provider->creates, L"Expected no routes to be added");
+
+		std::wstringstream ss;
+
+		ss << L"Reapplying " << ROUTE_COUNT << L" unchanged routes: " << Milliseconds(elapsed) << L" ms";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+	TEST_METHOD(addRoutes_DuplicateNetworks)
+	{
+		constexpr size_t ROUTE_COUNT = 100;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		//
+		// Every network appears twice, and the last route for the first network
+		// uses another interface.
+		//
+
+		auto routes = MakeRoutes(ROUTE_COUNT, false);
+		const auto duplicates = routes;
+
+		routes.insert(routes.end(), duplicates.begin(), duplicates.end());
+
+		const NET_LUID otherLuid = { 0x0007000000000000 };
+
+		routes.emplace_back(MakeNetwork(0), Node(otherLuid, std::nullopt));
+
+		manager.addRoutes(routes);
+
+		Assert::AreEqual(ROUTE_COUNT, provider->size(), L"Expected a single route per network");
+		Assert::AreEqual(ROUTE_COUNT, provider->creates, L"Expected a single create per network");
+		Assert::AreEqual(size_t(1), provider->countOnInterface(otherLuid.Value), L"Expected the last route to win");
+
+		//
+		// Same for replacing the route set.
+		//
+
+		manager.applyRoutes(routes);
+
+		Assert::AreEqual(ROUTE_COUNT, provider->size(), L"Expected a single route per network");
+	}
+
+	TEST_METHOD(addDeleteRoutes_Aggregated)
+	{
+		constexpr size_t ROUTE_COUNT = 1024;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		manager.setRouteAggregation(true);
+
+		const auto routes = MakeRoutes(ROUTE_COUNT, false);
+
+		const auto start = std::chrono::steady_clock::now();
+
+		manager.addRoutes(routes);
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		Assert::AreEqual(size_t(1), provider->size(), L"Expected adjacent routes to be merged");
+
+		//
+		// Deleting half of the routes leaves a route for the other half.
+		//
+
+		manager.deleteRoutes(std::vector<Route>(routes.begin(), routes.begin() + (ROUTE_COUNT / 2)));
+
+		Assert::AreEqual(size_t(1), provider->size(), L"Expected remaining routes to be merged");
+
+		//
+		// Deleting a single route splits the merged route.
+		//
+
+		manager.deleteRoute(routes.back());
+
+		Assert::AreEqual(size_t(9), provider->size(), L"Expected merged route to be split");
+
+		manager.deleteRoutes(std::vector<Route>(routes.begin() + (ROUTE_COUNT / 2), routes.end() - 1));
+
+		Assert::AreEqual(size_t(0), provider->size(), L"Expected all routes to be deleted");
+
+		std::wstringstream ss;
+
+		ss << L"addRoutes with " << ROUTE_COUNT << L" aggregated routes: " << Milliseconds(elapsed) << L" ms";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+	TEST_METHOD(applyExclusions_Incremental)
+	{
+		constexpr size_t EXCLUSION_COUNT = 1000;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		const NET_LUID luid = { 0x0006000000000000 };
+
+		//
+		// Excluding a single host takes one route per prefix length.
+		//
+
+		manager.applyExclusions({ MakeNetwork(0) }, { AF_INET }, luid);
+
+		Assert::AreEqual(size_t(32), provider->size(), L"Expected one route per prefix length");
+
+		//
+		// Excluding the neighbouring host only deletes the route for it.
+		//
+
+		provider->creates = 0;
+		provider->deletes = 0;
+
+		manager.applyExclusions({ MakeNetwork(0), MakeNetwork(1) }, { AF_INET }, luid);
+
+		Assert::AreEqual(size_t(31), provider->size(), L"Expected complement of the merged exclusions");
+		Assert::AreEqual(size_t(0), provider->creates, L"Expected no routes to be added");
+		Assert::AreEqual(size_t(1), provider->deletes, L"Expected a single route to be deleted");
+
+		std::vector<Network> excluded;
+
+		for (size_t i = 0; i < EXCLUSION_COUNT; ++i)
+		{
+			excluded.push_back(MakeNetwork(i * 4));
+		}
+
+		manager.applyExclusions(excluded, { AF_INET }, luid);
+
+		provider->creates = 0;
+		provider->deletes = 0;
+
+		excluded.pop_back();
+
+		const auto start = std::chrono::steady_clock::now();
+
+		manager.applyExclusions(excluded, { AF_INET }, luid);
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		const auto changes = provider->creates + provider->deletes;
+
+		Assert::IsTrue(changes < 64, L"Expected a small diff for a single exclusion");
+
+		manager.applyExclusions({}, {}, luid);
+
+		Assert::AreEqual(size_t(0), provider->size(), L"Expected all exclusion routes to be deleted");
+
+		std::wstringstream ss;
+
+		ss << L"Dropping one of " << EXCLUSION_COUNT << L" exclusions: " << Milliseconds(elapsed) << L" ms, "
+			<< changes << L" route changes";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+	TEST_METHOD(lookupRoute_10k)
+	{
+		constexpr size_t ROUTE_COUNT = 10000;
+		constexpr size_t LOOKUP_COUNT = 100000;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		const auto routes = MakeRoutes(ROUTE_COUNT, false);
+
+		manager.addRoutes(routes);
+
+		//
+		// A less specific route covers all of the others.
+		//
+
+		auto covering = MakeNetwork(0);
+		covering.PrefixLength = 8;
+
+		manager.addRoute(Route(covering, std::nullopt));
+
+		NodeAddress destination = { 0 };
+		destination.si_family = AF_INET;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < LOOKUP_COUNT; ++i)
+		{
+			destination.Ipv4.sin_addr = MakeNetwork(i % (2 * ROUTE_COUNT)).Prefix.Ipv4.sin_addr;
+
+			const auto match = manager.lookupRoute(destination);
+
+			Assert::IsTrue(match.has_value(), L"Expected the covering route to match");
+
+			const uint8_t expectedLength = ((i % (2 * ROUTE_COUNT)) < ROUTE_COUNT ? 32 : 8);
+
+			Assert::AreEqual(expectedLength, match->network.PrefixLength, L"Expected the most specific route");
+		}
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		destination.Ipv4.sin_addr.s_addr = htonl(0x0B000000);
+
+		Assert::IsFalse(manager.lookupRoute(destination).has_value(), L"Expected no route to match");
+
+		std::wstringstream ss;
+
+		ss << L"lookupRoute among " << (ROUTE_COUNT + 1) << L" routes: "
+			<< (1e6 * Milliseconds(elapsed) / LOOKUP_COUNT) << L" ns per lookup";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+	TEST_METHOD(defaultRouteFlap_Recovery)
+	{
+		constexpr size_t ROUTE_COUNT = 1000;
+		constexpr size_t FLAP_COUNT = 10;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		manager.addRoutes(MakeRoutes(ROUTE_COUNT, true));
+
+		Assert::AreEqual(ROUTE_COUNT, provider->countOnInterface(1), L"Expected routes on the initial default route");
+
+		std::chrono::steady_clock::duration total(0);
+		std::chrono::steady_clock::duration worst(0);
+
+		for (size_t i = 0; i < FLAP_COUNT; ++i)
+		{
+			const auto luid = 2 + (i % 2);
+			const auto defaultRoute = FakeRoutingProvider::MakeDefaultRoute(luid, static_cast<uint8_t>(luid));
+
+			const auto start = std::chrono::steady_clock::now();
+
+			provider->changeDefaultRoute(defaultRoute);
+
+			const auto elapsed = std::chrono::steady_clock::now() - start;
+
+			total += elapsed;
+			worst = std::max(worst, elapsed);
+
+			Assert::AreEqual(ROUTE_COUNT, provider->countOnInterface(luid), L"Expected routes to follow the default route");
+		}
+
+		std::wstringstream ss;
+
+		ss << L"Default route flap with " << ROUTE_COUNT << L" dependent routes: average "
+			<< (Milliseconds(total) / FLAP_COUNT) << L" ms, worst " << Milliseconds(worst) << L" ms";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+	TEST_METHOD(defaultRouteFlap_RelayFirst)
+	{
+		constexpr size_t ROUTE_COUNT = 1000;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		manager.addRoutes(MakeRoutes(ROUTE_COUNT, true));
+
+		NodeAddress relay = { 0 };
+
+		relay.si_family = AF_INET;
+		relay.Ipv4.sin_family = AF_INET;
+		relay.Ipv4.sin_addr.s_addr = htonl(0xC6120001);
+
+		manager.setRelayRoutes({ relay });
+
+		Assert::AreEqual(ROUTE_COUNT + 1, provider->countOnInterface(1), L"Expected relay route on the initial default route");
+
+		//
+		// Listeners are invoked after the relay route has moved, but before the other routes.
+		//
+
+		size_t routesWhenNotified = 0;
+
+		const auto handle = manager.registerDefaultRouteChangedCallback([&](const std::vector<RouteManager::DefaultRouteChange> &)
+		{
+			routesWhenNotified = provider->countOnInterface(2);
+		});
+
+		provider->changeDefaultRoute(FakeRoutingProvider::MakeDefaultRoute(2, 2));
+
+		manager.unregisterDefaultRouteChangedCallback(handle);
+
+		Assert::AreEqual(size_t(1), routesWhenNotified, L"Expected only the relay route to have moved before listeners");
+		Assert::AreEqual(ROUTE_COUNT + 1, provider->countOnInterface(2), L"Expected all routes to follow the default route");
+
+		manager.setRelayRoutes({});
+
+		Assert::AreEqual(ROUTE_COUNT, provider->countOnInterface(2), L"Expected relay route to be deleted");
+	}
+
+	TEST_METHOD(snapshot_ReadDuringRestore)
+	{
+		constexpr size_t ROUTE_COUNT = 1000;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+
+		RouteManager manager(MakeStdoutLogger(), provider);
+
+		manager.addRoutes(MakeRoutes(ROUTE_COUNT, true));
+
+		const auto before = manager.snapshot();
+
+		Assert::AreEqual(ROUTE_COUNT, before->routes.size(), L"Expected snapshot of all routes");
+
+		//
+		// Routes are created with the routes lock held. Reading must not wait for it,
+		// and must see the routes as they were before the restore.
+		//
+
+		size_t reads = 0;
+		bool consistent = true;
+
+		NodeAddress destination = { 0 };
+		destination.si_family = AF_INET;
+		destination.Ipv4.sin_addr = MakeNetwork(ROUTE_COUNT / 2).Prefix.Ipv4.sin_addr;
+
+		provider->onCreate = [&]()
+		{
+			const auto current = manager.snapshot();
+			const auto match = manager.lookupRoute(destination);
+
+			consistent = consistent
+				&& current->version == before->version
+				&& match.has_value()
+				&& 1 == match->luid.Value;
+
+			++reads;
+		};
+
+		const auto start = std::chrono::steady_clock::now();
+
+		provider->changeDefaultRoute(FakeRoutingProvider::MakeDefaultRoute(2, 2));
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		provider->onCreate = nullptr;
+
+		Assert::AreEqual(ROUTE_COUNT, reads, L"Expected a read for each restored route");
+		Assert::IsTrue(consistent, L"Expected readers to see the routes from before the restore");
+
+		const auto after = manager.snapshot();
+
+		Assert::IsTrue(after->version > before->version, L"Expected a new snapshot after the restore");
+
+		const auto match = manager.lookupRoute(destination);
+
+		Assert::IsTrue(match.has_value() && 2 == match->luid.Value, L"Expected the restored route");
+
+		std::wstringstream ss;
+
+		ss << L"Default route flap with " << ROUTE_COUNT << L" dependent routes and a reader per route: "
+			<< Milliseconds(elapsed) << L" ms";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+	TEST_METHOD(purgeOwnedRoutes_10k)
+	{
+		constexpr size_t ROUTE_COUNT = 10000;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+		const TemporaryJournalPath journalPath;
+
+		//
+		// Leave the routes behind, as if the previous instance had crashed.
+		//
+
+		{
+			RouteManager manager(MakeStdoutLogger(), provider, std::make_unique<RouteJournal>(journalPath.path()));
+
+			manager.addRoutes(MakeRoutes(ROUTE_COUNT, false));
+			manager.detach();
+		}
+
+		//
+		// Foreign routes for the same networks on another interface, and for other
+		// networks on the same interface, must survive the purge.
+		//
+
+		for (size_t i = 0; i < ROUTE_COUNT; ++i)
+		{
+			provider->addForeignRoute(MakeNetwork(i), 1);
+			provider->addForeignRoute(MakeNetwork(ROUTE_COUNT + i), 0x0006000000000000);
+		}
+
+		provider->deletes = 0;
+
+		const auto logSink = MakeStdoutLogger();
+		RouteJournal journal(journalPath.path());
+
+		const auto start = std::chrono::steady_clock::now();
+
+		const auto purged = RouteManager::PurgeOwnedRoutes(*logSink, journal, *provider);
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		Assert::AreEqual(ROUTE_COUNT, purged, L"Expected all owned routes to be purged");
+		Assert::AreEqual(2 * ROUTE_COUNT, provider->size(), L"Expected foreign routes to remain");
+		Assert::AreEqual(ROUTE_COUNT, provider->deletes, L"Expected one delete per owned route");
+		Assert::IsTrue(journal.load().empty(), L"Expected the journal to be cleared");
+
+		std::wstringstream ss;
+
+		ss << L"Purging " << ROUTE_COUNT << L" owned routes among " << (3 * ROUTE_COUNT) << L": "
+			<< Milliseconds(elapsed) << L" ms";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+
+	TEST_METHOD(journalAdoption_10k)
+	{
+		constexpr size_t ROUTE_COUNT = 10000;
+
+		const auto provider = std::make_shared<FakeRoutingProvider>();
+		const TemporaryJournalPath journalPath;
+
+		const auto routes = MakeRoutes(ROUTE_COUNT, false);
+
+		{
+			RouteManager manager(MakeStdoutLogger(), provider, std::make_unique<RouteJournal>(journalPath.path()));
+
+			manager.addRoutes(routes);
+			manager.detach();
+		}
+
+		Assert::AreEqual(ROUTE_COUNT, provider->size(), L"Expected routes to be left in the table");
+
+		provider->creates = 0;
+		provider->deletes = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		RouteManager manager(MakeStdoutLogger(), provider, std::make_unique<RouteJournal>(journalPath.path()));
+
+		manager.addRoutes(routes);
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		Assert::AreEqual(size_t(0), provider->creates + provider->deletes, L"Expected journaled routes to be adopted");
+		Assert::AreEqual(ROUTE_COUNT, provider->size(), L"Expected no routes to be lost");
+
+		std::wstringstream ss;
+
+		ss << L"Adopting " << ROUTE_COUNT << L" journaled routes: " << Milliseconds(elapsed) << L" ms";
+
+		Logger::WriteMessage(ss.str().c_str());
+	}
+};
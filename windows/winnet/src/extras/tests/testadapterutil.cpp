@@ -16,6 +16,7 @@ using UpdateType = NetworkAdapterMonitor::UpdateType;
 //
 
 #include <algorithm>
+#include <iterator>
 
 void MibIfTable::add(const MIB_IF_ROW2 &row)
 {
@@ -200,6 +201,37 @@ DWORD TestDataProvider::getIpInterfaceEntry(PMIB_IPINTERFACE_ROW Row)
 	return ERROR_FILE_NOT_FOUND;
 }
 
+DWORD TestDataProvider::getIpInterfaceTable(ADDRESS_FAMILY Family, PMIB_IPINTERFACE_TABLE *tableOut)
+{
+	std::vector<MIB_IPINTERFACE_ROW> rows;
+
+	std::copy_if(
+		m_ipInterfaces.begin(),
+		m_ipInterfaces.end(),
+		std::back_inserter(rows),
+		[Family](const MIB_IPINTERFACE_ROW &elem)
+		{
+			return AF_UNSPEC == Family || Family == elem.Family;
+		}
+	);
+
+	MIB_IPINTERFACE_TABLE *tableCopy = reinterpret_cast<MIB_IPINTERFACE_TABLE*>(new uint8_t[
+		sizeof(MIB_IPINTERFACE_TABLE)
+		+ sizeof(MIB_IPINTERFACE_ROW) * rows.size()
+	]);
+
+	tableCopy->NumEntries = static_cast<ULONG>(rows.size());
+
+	std::copy(
+		rows.begin(),
+		rows.end(),
+		static_cast<MIB_IPINTERFACE_ROW*>(tableCopy->Table)
+	);
+
+	*tableOut = tableCopy;
+	return NO_ERROR;
+}
+
 void TestDataProvider::addAdapter(const MIB_IF_ROW2& adapter)
 {
 	m_adapterTable.add(adapter);
@@ -58,6 +58,7 @@ public:
 	
 	DWORD getIfEntry2(PMIB_IF_ROW2 Row) override;
 	DWORD getIpInterfaceEntry(PMIB_IPINTERFACE_ROW Row) override;
+	DWORD getIpInterfaceTable(ADDRESS_FAMILY Family, PMIB_IPINTERFACE_TABLE *Table) override;
 
 	//
 	// Test utilities
@@ -1,17 +1,17 @@
 #include "stdafx.h"
 #include "NetworkInterfaces.h"
-#include "InterfacePair.h"
 #include <libcommon/string.h>
 #include <libcommon/error.h>
+#include <libshared/network/aliascache.h>
 #include <memory>
 #include <sstream>
 #include <cstdint>
 
-bool NetworkInterfaces::HasHighestMetric(PMIB_IPINTERFACE_ROW targetIface)
+bool NetworkInterfaces::HasHighestMetric(const MIB_IPINTERFACE_ROW *targetIface)
 {
 	for (unsigned int i = 0; i < mInterfaces->NumEntries; ++i)
 	{
-		PMIB_IPINTERFACE_ROW iface = &mInterfaces->Table[i];
+		const MIB_IPINTERFACE_ROW *iface = &mInterfaces->Table[i];
 
 		if (iface->InterfaceLuid.Value != targetIface->InterfaceLuid.Value
 			&& targetIface->Metric >= iface->Metric)
@@ -22,71 +22,194 @@ bool NetworkInterfaces::HasHighestMetric(PMIB_IPINTERFACE_ROW targetIface)
 
 void NetworkInterfaces::EnsureIfaceMetricIsHighest(NET_LUID interfaceLuid)
 {
-	for (ULONG i = 0; i < mInterfaces->NumEntries; ++i)
+	ApplyMetricPlan(PlanMetricIncrements(interfaceLuid));
+}
+
+NetworkInterfaces::NetworkInterfaces()
+	: NetworkInterfaces(std::make_shared<const NotificationHub::InterfaceSnapshot>(0))
+{
+}
+
+NetworkInterfaces::NetworkInterfaces(std::shared_ptr<const NotificationHub::InterfaceSnapshot> snapshot)
+	: mSnapshot(std::move(snapshot))
+	, mInterfaces(&mSnapshot->table())
+{
+}
+
+bool NetworkInterfaces::SetTopMetricForInterfacesByAlias(const wchar_t * deviceAlias)
+{
+	return SetTopMetricForInterfacesWithLuid(GetInterfaceLuid(deviceAlias));
+}
+
+bool NetworkInterfaces::SetTopMetricForInterfacesWithLuid(NET_LUID targetIfaceId)
+{
+	const auto plan = PlanTopMetric(targetIfaceId);
+
+	if (plan.empty())
 	{
-		PMIB_IPINTERFACE_ROW iface = &mInterfaces->Table[i];
+		return false;
+	}
 
-		// Ignoring the target interface.
-		if (iface->InterfaceLuid.Value == interfaceLuid.Value || iface->UseAutomaticMetric || iface->Metric > MAX_METRIC)
+	ApplyMetricPlan(plan);
+	return true;
+}
+
+//static
+bool NetworkInterfaces::SetTopMetricForInterface(NET_LUID targetIface)
+{
+	MetricPlan plan;
+	bool found = false;
+
+	for (auto family : { AF_INET, AF_INET6 })
+	{
+		MIB_IPINTERFACE_ROW row;
+
+		InitializeIpInterfaceEntry(&row);
+
+		row.Family = static_cast<ADDRESS_FAMILY>(family);
+		row.InterfaceLuid = targetIface;
+
+		const auto status = GetIpInterfaceEntry(&row);
+
+		if (ERROR_NOT_FOUND == status)
 		{
 			continue;
 		}
 
-		iface->Metric++;
-
-		if (AF_INET == iface->Family)
+		if (NO_ERROR != status)
 		{
-			iface->SitePrefixLength = 0;
+			THROW_WINDOWS_ERROR(status, "Failed to read interface metric");
 		}
 
-		const auto status = SetIpInterfaceEntry(iface);
+		found = true;
 
-		if (NO_ERROR != status)
+		if (MAX_METRIC == row.Metric && false == row.UseAutomaticMetric)
 		{
-			std::stringstream ss;
+			continue;
+		}
 
-			ss << "Failed to increment metric for interface with LUID 0x"
-				<< std::hex << iface->InterfaceLuid.Value;
+		row.Metric = MAX_METRIC;
+		row.UseAutomaticMetric = false;
 
-			THROW_WINDOWS_ERROR(status, ss.str().c_str());
-		}
+		plan.emplace_back(row);
 	}
-}
 
-NetworkInterfaces::NetworkInterfaces()
-{
-	mInterfaces = nullptr;
+	if (false == found)
+	{
+		std::stringstream ss;
 
-	const auto status = GetIpInterfaceTable(AF_UNSPEC, &mInterfaces);
+		ss << "LUID 0x" << std::hex << targetIface.Value
+			<< " does not specify any IPv4 or IPv6 interfaces";
 
-	if (NO_ERROR != status)
+		THROW_ERROR(ss.str().c_str());
+	}
+
+	if (plan.empty())
 	{
-		THROW_WINDOWS_ERROR(status, "Failed to enumerate network interfaces");
+		return false;
 	}
+
+	ApplyMetricPlan(plan);
+	return true;
 }
 
-bool NetworkInterfaces::SetTopMetricForInterfacesByAlias(const wchar_t * deviceAlias)
+NetworkInterfaces::MetricPlan NetworkInterfaces::PlanTopMetric(NET_LUID targetIface) const
 {
-	return SetTopMetricForInterfacesWithLuid(GetInterfaceLuid(deviceAlias));
+	MetricPlan plan;
+	bool found = false;
+
+	for (auto family : { AF_INET, AF_INET6 })
+	{
+		const auto iface = GetInterface(targetIface, static_cast<ADDRESS_FAMILY>(family));
+
+		if (nullptr == iface)
+		{
+			continue;
+		}
+
+		found = true;
+
+		if (MAX_METRIC == iface->Metric)
+		{
+			continue;
+		}
+
+		auto row = *iface;
+
+		row.Metric = MAX_METRIC;
+		row.UseAutomaticMetric = false;
+
+		plan.emplace_back(row);
+	}
+
+	if (false == found)
+	{
+		std::stringstream ss;
+
+		ss << "LUID 0x" << std::hex << targetIface.Value
+			<< " does not specify any IPv4 or IPv6 interfaces";
+
+		THROW_ERROR(ss.str().c_str());
+	}
+
+	return plan;
 }
 
-bool NetworkInterfaces::SetTopMetricForInterfacesWithLuid(NET_LUID targetIfaceId)
+NetworkInterfaces::MetricPlan NetworkInterfaces::PlanMetricIncrements(NET_LUID excludedIface) const
 {
-	InterfacePair targetInterfaces = InterfacePair(targetIfaceId);
+	MetricPlan plan;
 
-	if (targetInterfaces.HighestMetric() == MAX_METRIC)
+	for (ULONG i = 0; i < mInterfaces->NumEntries; ++i)
 	{
-		return false;
+		const auto &iface = mInterfaces->Table[i];
+
+		// Ignoring the target interface.
+		if (iface.InterfaceLuid.Value == excludedIface.Value || iface.UseAutomaticMetric || iface.Metric > MAX_METRIC)
+		{
+			continue;
+		}
+
+		auto row = iface;
+
+		row.Metric++;
+
+		plan.emplace_back(row);
 	}
 
-	targetInterfaces.SetMetric(MAX_METRIC);
-	return true;
+	return plan;
 }
 
+//static
+void NetworkInterfaces::ApplyMetricPlan(const MetricPlan &plan)
+{
+	for (auto row : plan)
+	{
+		//
+		// SitePrefixLength is reported but must be zero when writing an IPv4 row.
+		//
+		if (AF_INET == row.Family)
+		{
+			row.SitePrefixLength = 0;
+		}
+
+		const auto status = SetIpInterfaceEntry(&row);
+
+		if (NO_ERROR != status)
+		{
+			std::stringstream ss;
+
+			ss << "Failed to set metric for "
+				<< (AF_INET == row.Family ? "IPv4" : "IPv6")
+				<< " on interface with LUID 0x"
+				<< std::hex << row.InterfaceLuid.Value;
+
+			THROW_WINDOWS_ERROR(status, ss.str().c_str());
+		}
+	}
+}
 
 NetworkInterfaces::~NetworkInterfaces()
 {
-	FreeMibTable(mInterfaces);
 }
 
 //static
@@ -94,7 +217,7 @@ NET_LUID NetworkInterfaces::GetInterfaceLuid(const std::wstring &interfaceAlias)
 {
 	NET_LUID interfaceLuid;
 
-	const auto status = ConvertInterfaceAliasToLuid(interfaceAlias.c_str(), &interfaceLuid);
+	const auto status = shared::network::InterfaceAliasCache::Instance().resolve(interfaceAlias, interfaceLuid);
 
 	if (NO_ERROR != status)
 	{
@@ -107,18 +230,7 @@ NET_LUID NetworkInterfaces::GetInterfaceLuid(const std::wstring &interfaceAlias)
 	return interfaceLuid;
 }
 
-const MIB_IPINTERFACE_ROW *NetworkInterfaces::GetInterface(NET_LUID interfaceLuid, ADDRESS_FAMILY interfaceFamily)
+const MIB_IPINTERFACE_ROW *NetworkInterfaces::GetInterface(NET_LUID interfaceLuid, ADDRESS_FAMILY interfaceFamily) const
 {
-	for (unsigned int i = 0; i < mInterfaces->NumEntries; ++i)
-	{
-		MIB_IPINTERFACE_ROW &candidateInterface = mInterfaces->Table[i];
-
-		if (candidateInterface.InterfaceLuid.Value == interfaceLuid.Value
-			&& candidateInterface.Family == interfaceFamily)
-		{
-			return &candidateInterface;
-		}
-	}
-
-	return nullptr;
+	return mSnapshot->find(interfaceLuid, interfaceFamily);
 }
@@ -6,14 +6,30 @@
 #include <iphlpapi.h>
 #include <netioapi.h>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
+#include "notificationhub.h"
 
 class NetworkInterfaces
 {
 
 private:
-	PMIB_IPINTERFACE_TABLE mInterfaces;
-	bool HasHighestMetric(PMIB_IPINTERFACE_ROW targetIface);
+	std::shared_ptr<const NotificationHub::InterfaceSnapshot> mSnapshot;
+	const MIB_IPINTERFACE_TABLE *mInterfaces;
+	bool HasHighestMetric(const MIB_IPINTERFACE_ROW *targetIface);
+
+	//
+	// Metric changes are planned against the snapshot acquired at construction.
+	// Each planned row is a modified copy, ready to be passed to SetIpInterfaceEntry.
+	// Rows that already satisfy the constraint are not included.
+	//
+	using MetricPlan = std::vector<MIB_IPINTERFACE_ROW>;
+
+	MetricPlan PlanTopMetric(NET_LUID targetIface) const;
+	MetricPlan PlanMetricIncrements(NET_LUID excludedIface) const;
+
+	static void ApplyMetricPlan(const MetricPlan &plan);
 
 public:
 	NetworkInterfaces(const NetworkInterfaces &) = delete;
@@ -21,12 +37,23 @@ public:
 
 	void EnsureIfaceMetricIsHighest(NET_LUID interfaceLuid);
 	NetworkInterfaces();
+
+	//
+	// Use a snapshot that is shared with other callers, rather than reading the table.
+	//
+	explicit NetworkInterfaces(std::shared_ptr<const NotificationHub::InterfaceSnapshot> snapshot);
 	bool SetTopMetricForInterfacesByAlias(const wchar_t *deviceAlias);
 	bool SetTopMetricForInterfacesWithLuid(NET_LUID targetIface);
 	~NetworkInterfaces();
 
+	//
+	// Same as SetTopMetricForInterfacesWithLuid(), but only reads the rows of the target
+	// interface rather than the whole interface table.
+	//
+	static bool SetTopMetricForInterface(NET_LUID targetIface);
+
 	static NET_LUID GetInterfaceLuid(const std::wstring &interfaceAlias);
-	const MIB_IPINTERFACE_ROW *GetInterface(NET_LUID interfaceLuid, ADDRESS_FAMILY interfaceFamily);
+	const MIB_IPINTERFACE_ROW *GetInterface(NET_LUID interfaceLuid, ADDRESS_FAMILY interfaceFamily) const;
 };
 
 const static uint32_t MAX_METRIC = 1;
@@ -0,0 +1,126 @@
+#include "stdafx.h"
+#include "connectivityprobe.h"
+#include "routing/helpers.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <icmpapi.h>
+#include <optional>
+
+using namespace winnet::routing;
+
+namespace
+{
+
+//
+// Replies echo the payload, so keep it small.
+//
+const char PROBE_PAYLOAD[] = "winnet";
+
+std::optional<InterfaceAndGateway> BestDefaultRoute(ADDRESS_FAMILY family)
+{
+	try
+	{
+		return GetBestDefaultRoute(family);
+	}
+	catch (...)
+	{
+		return std::nullopt;
+	}
+}
+
+bool EchoIpv4(const SOCKADDR_INET &gateway, DWORD timeout)
+{
+	const auto icmp = IcmpCreateFile();
+
+	if (INVALID_HANDLE_VALUE == icmp)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "IcmpCreateFile");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [icmp]()
+	{
+		IcmpCloseHandle(icmp);
+	};
+
+	//
+	// The reply buffer must also have room for an ICMP error message.
+	//
+	uint8_t reply[sizeof(ICMP_ECHO_REPLY) + sizeof(PROBE_PAYLOAD) + 8];
+
+	const auto numReplies = IcmpSendEcho2(icmp, nullptr, nullptr, nullptr,
+		gateway.Ipv4.sin_addr.s_addr, const_cast<char *>(PROBE_PAYLOAD), sizeof(PROBE_PAYLOAD),
+		nullptr, reply, sizeof(reply), timeout);
+
+	return 0 != numReplies
+		&& IP_SUCCESS == reinterpret_cast<const ICMP_ECHO_REPLY *>(reply)->Status;
+}
+
+bool EchoIpv6(const InterfaceAndGateway &route, DWORD timeout)
+{
+	const auto icmp = Icmp6CreateFile();
+
+	if (INVALID_HANDLE_VALUE == icmp)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Icmp6CreateFile");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [icmp]()
+	{
+		IcmpCloseHandle(icmp);
+	};
+
+	sockaddr_in6 source = { 0 };
+	source.sin6_family = AF_INET6;
+
+	auto destination = route.gateway.Ipv6;
+
+	//
+	// IPv6 gateways are usually link-local, and the scope is not recorded
+	// in the route table.
+	//
+	if (0 == destination.sin6_scope_id)
+	{
+		NET_IFINDEX index;
+
+		if (NO_ERROR == ConvertInterfaceLuidToIndex(&route.iface, &index))
+		{
+			destination.sin6_scope_id = index;
+		}
+	}
+
+	uint8_t reply[sizeof(ICMPV6_ECHO_REPLY) + sizeof(PROBE_PAYLOAD) + 8];
+
+	const auto numReplies = Icmp6SendEcho2(icmp, nullptr, nullptr, nullptr,
+		&source, &destination, const_cast<char *>(PROBE_PAYLOAD), sizeof(PROBE_PAYLOAD),
+		nullptr, reply, sizeof(reply), timeout);
+
+	return 0 != numReplies
+		&& IP_SUCCESS == reinterpret_cast<const ICMPV6_ECHO_REPLY *>(reply)->Status;
+}
+
+} // anonymous namespace
+
+GatewayProbe::GatewayProbe(std::chrono::milliseconds timeout)
+	: m_timeout(timeout)
+{
+}
+
+bool GatewayProbe::probe()
+{
+	const auto timeout = static_cast<DWORD>(m_timeout.count());
+
+	const auto routeV4 = BestDefaultRoute(AF_INET);
+
+	if (routeV4.has_value() && EchoIpv4(routeV4->gateway, timeout))
+	{
+		return true;
+	}
+
+	const auto routeV6 = BestDefaultRoute(AF_INET6);
+
+	return routeV6.has_value() && EchoIpv6(routeV6.value(), timeout);
+}
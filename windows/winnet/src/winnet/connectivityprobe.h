@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+
+//
+// Checks whether the network beyond the local adapter is usable.
+//
+// Adapter flags only say that a link is present. A dead uplink looks
+// identical to a working one until something is actually sent.
+//
+struct IConnectivityProbe
+{
+	virtual ~IConnectivityProbe() = 0
+	{
+	}
+
+	// Blocks until a verdict is reached. May throw.
+	virtual bool probe() = 0;
+};
+
+//
+// Sends an ICMP echo request to the gateway of the best default route,
+// for IPv4 and then IPv6. Reachable if either gateway replies.
+//
+// Finding no default route at all counts as unreachable.
+//
+class GatewayProbe : public IConnectivityProbe
+{
+public:
+
+	explicit GatewayProbe(std::chrono::milliseconds timeout);
+
+	bool probe() override;
+
+private:
+
+	const std::chrono::milliseconds m_timeout;
+};
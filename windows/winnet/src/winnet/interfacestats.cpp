@@ -0,0 +1,155 @@
+#include "stdafx.h"
+#include "interfacestats.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libshared/performance/counterregistry.h>
+
+namespace
+{
+
+//
+// Up to this many interfaces are read one at a time.
+// Reading the table costs about as much as reading a few entries.
+//
+constexpr size_t MAX_ENTRY_SAMPLES = 4;
+
+uint64_t PerSecond(uint64_t previous, uint64_t current, std::chrono::steady_clock::duration elapsed)
+{
+	const auto seconds = std::chrono::duration<double>(elapsed).count();
+
+	//
+	// The counters are reset if the interface is reinitialized.
+	//
+	if (current < previous || seconds <= 0)
+	{
+		return 0;
+	}
+
+	return static_cast<uint64_t>((current - previous) / seconds);
+}
+
+void ClearStats(WINNET_INTERFACE_STATS &stats)
+{
+	const auto luid = stats.interfaceLuid;
+
+	stats = WINNET_INTERFACE_STATS{ 0 };
+	stats.interfaceLuid = luid;
+}
+
+} // anonymous namespace
+
+void InterfaceStatsSampler::sample(WINNET_INTERFACE_STATS *stats, size_t numStats)
+{
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winnet.interfacestats.sample");
+
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	if (numStats <= MAX_ENTRY_SAMPLES)
+	{
+		sampleEntries(stats, numStats);
+	}
+	else
+	{
+		sampleTable(stats, numStats);
+	}
+}
+
+void InterfaceStatsSampler::sampleEntries(WINNET_INTERFACE_STATS *stats, size_t numStats)
+{
+	for (size_t i = 0; i < numStats; ++i)
+	{
+		MIB_IF_ROW2 row = { 0 };
+		row.InterfaceLuid.Value = stats[i].interfaceLuid;
+
+		const auto status = GetIfEntry2Ex(MibIfEntryNormal, &row);
+
+		if (ERROR_FILE_NOT_FOUND == status || ERROR_NOT_FOUND == status)
+		{
+			ClearStats(stats[i]);
+			m_previous.erase(stats[i].interfaceLuid);
+
+			continue;
+		}
+
+		if (NO_ERROR != status)
+		{
+			THROW_WINDOWS_ERROR(status, "Read interface statistics");
+		}
+
+		update(stats[i], row, Clock::now());
+	}
+}
+
+void InterfaceStatsSampler::sampleTable(WINNET_INTERFACE_STATS *stats, size_t numStats)
+{
+	MIB_IF_TABLE2 *table;
+
+	const auto status = GetIfTable2Ex(MibIfTableRaw, &table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Read interface table");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [table]()
+	{
+		FreeMibTable(table);
+	};
+
+	const auto now = Clock::now();
+
+	std::unordered_map<ULONG64, const MIB_IF_ROW2 *> rows;
+
+	rows.reserve(table->NumEntries);
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		rows.emplace(table->Table[i].InterfaceLuid.Value, &table->Table[i]);
+	}
+
+	for (size_t i = 0; i < numStats; ++i)
+	{
+		const auto row = rows.find(stats[i].interfaceLuid);
+
+		if (rows.end() == row)
+		{
+			ClearStats(stats[i]);
+			m_previous.erase(stats[i].interfaceLuid);
+
+			continue;
+		}
+
+		update(stats[i], *row->second, now);
+	}
+}
+
+void InterfaceStatsSampler::update(WINNET_INTERFACE_STATS &stats, const MIB_IF_ROW2 &row, Clock::time_point now)
+{
+	stats.present = true;
+
+	stats.inOctets = row.InOctets;
+	stats.outOctets = row.OutOctets;
+	stats.inErrors = row.InErrors;
+	stats.outErrors = row.OutErrors;
+	stats.inDiscards = row.InDiscards;
+	stats.outDiscards = row.OutDiscards;
+
+	auto &previous = m_previous[stats.interfaceLuid];
+
+	if (Clock::time_point() == previous.time)
+	{
+		stats.inOctetsPerSecond = 0;
+		stats.outOctetsPerSecond = 0;
+	}
+	else
+	{
+		stats.inOctetsPerSecond = PerSecond(previous.inOctets, row.InOctets, now - previous.time);
+		stats.outOctetsPerSecond = PerSecond(previous.outOctets, row.OutOctets, now - previous.time);
+	}
+
+	previous = PreviousSample{ now, row.InOctets, row.OutOctets };
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "winnet.h"
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+//
+// Reads traffic counters for a set of interfaces, and computes rates
+// from the previous sample of each interface.
+//
+// Small sets are read one interface at a time. Larger sets are read from
+// a single raw interface table, which skips resolving the interface names.
+//
+class InterfaceStatsSampler
+{
+public:
+
+	InterfaceStatsSampler() = default;
+
+	//
+	// 'interfaceLuid' must be set in each entry. All other fields are set by this call.
+	//
+	void sample(WINNET_INTERFACE_STATS *stats, size_t numStats);
+
+private:
+
+	InterfaceStatsSampler(const InterfaceStatsSampler &) = delete;
+	InterfaceStatsSampler &operator=(const InterfaceStatsSampler &) = delete;
+
+	void sampleEntries(WINNET_INTERFACE_STATS *stats, size_t numStats);
+	void sampleTable(WINNET_INTERFACE_STATS *stats, size_t numStats);
+
+	using Clock = std::chrono::steady_clock;
+
+	void update(WINNET_INTERFACE_STATS &stats, const MIB_IF_ROW2 &row, Clock::time_point now);
+
+	struct PreviousSample
+	{
+		Clock::time_point time;
+		uint64_t inOctets;
+		uint64_t outOctets;
+	};
+
+	std::mutex m_lock;
+	std::unordered_map<ULONG64, PreviousSample> m_previous;
+};
@@ -0,0 +1,412 @@
+#include "stdafx.h"
+#include "mtudiscovery.h"
+#include "routing/helpers.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libshared/performance/counterregistry.h>
+#include <icmpapi.h>
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+using namespace winnet::routing;
+
+namespace
+{
+
+const DWORD PROBE_TIMEOUT_MS = 1000;
+
+//
+// Unanswered probes are sent this many times in total before the size is ruled out.
+//
+const uint32_t PROBE_ATTEMPTS = 3;
+
+//
+// Smallest MTU that every link must support.
+//
+const uint16_t MIN_IPV4_MTU = 576;
+const uint16_t MIN_IPV6_MTU = 1280;
+
+//
+// Size of the IP and ICMP headers of a probe.
+//
+const uint16_t IPV4_PROBE_OVERHEAD = 20 + 8;
+const uint16_t IPV6_PROBE_OVERHEAD = 40 + 8;
+
+//
+// Slack for an ICMP error message and the IO_STATUS_BLOCK that the reply buffer must hold.
+//
+const size_t REPLY_SLACK = 8 + 64;
+
+enum class ProbeResult
+{
+	Answered,
+	TooBig,
+	Lost,
+};
+
+class IcmpProbe
+{
+public:
+
+	IcmpProbe(const SOCKADDR_INET &source, const SOCKADDR_INET &destination)
+		: m_source(source)
+		, m_destination(destination)
+	{
+		m_icmp = (AF_INET == destination.si_family ? IcmpCreateFile() : Icmp6CreateFile());
+
+		if (INVALID_HANDLE_VALUE == m_icmp)
+		{
+			THROW_WINDOWS_ERROR(GetLastError(), "Create ICMP handle");
+		}
+	}
+
+	~IcmpProbe()
+	{
+		IcmpCloseHandle(m_icmp);
+	}
+
+	IcmpProbe(const IcmpProbe &) = delete;
+	IcmpProbe &operator=(const IcmpProbe &) = delete;
+
+	//
+	// 'packetSize' includes the IP and ICMP headers.
+	//
+	ProbeResult send(uint16_t packetSize)
+	{
+		static auto &probes = shared::performance::CounterRegistry::Instance().counter("winnet.mtu.probes");
+
+		probes.increment();
+
+		const bool ipv4 = (AF_INET == m_destination.si_family);
+
+		m_payload.resize(packetSize - (ipv4 ? IPV4_PROBE_OVERHEAD : IPV6_PROBE_OVERHEAD));
+		m_reply.resize((ipv4 ? sizeof(ICMP_ECHO_REPLY) : sizeof(ICMPV6_ECHO_REPLY)) + m_payload.size() + REPLY_SLACK);
+
+		//
+		// IPv6 routers never fragment, so the flag only matters for IPv4.
+		//
+		IP_OPTION_INFORMATION options = { 0 };
+
+		options.Ttl = 128;
+		options.Flags = IP_FLAG_DF;
+
+		const auto requestSize = static_cast<WORD>(m_payload.size());
+		const auto replySize = static_cast<DWORD>(m_reply.size());
+
+		DWORD numReplies;
+		ULONG status;
+
+		if (ipv4)
+		{
+			numReplies = IcmpSendEcho2Ex(m_icmp, nullptr, nullptr, nullptr,
+				m_source.Ipv4.sin_addr.s_addr, m_destination.Ipv4.sin_addr.s_addr,
+				m_payload.data(), requestSize, &options, m_reply.data(), replySize, PROBE_TIMEOUT_MS);
+
+			status = reinterpret_cast<const ICMP_ECHO_REPLY *>(m_reply.data())->Status;
+		}
+		else
+		{
+			auto source = m_source.Ipv6;
+			auto destination = m_destination.Ipv6;
+
+			numReplies = Icmp6SendEcho2(m_icmp, nullptr, nullptr, nullptr,
+				&source, &destination, m_payload.data(), requestSize, &options,
+				m_reply.data(), replySize, PROBE_TIMEOUT_MS);
+
+			status = reinterpret_cast<const ICMPV6_ECHO_REPLY *>(m_reply.data())->Status;
+		}
+
+		if (0 == numReplies)
+		{
+			return (IP_PACKET_TOO_BIG == GetLastError() ? ProbeResult::TooBig : ProbeResult::Lost);
+		}
+
+		switch (status)
+		{
+			case IP_SUCCESS:
+			{
+				return ProbeResult::Answered;
+			}
+			case IP_PACKET_TOO_BIG:
+			{
+				return ProbeResult::TooBig;
+			}
+			default:
+			{
+				return ProbeResult::Lost;
+			}
+		}
+	}
+
+private:
+
+	const SOCKADDR_INET m_source;
+	const SOCKADDR_INET m_destination;
+
+	HANDLE m_icmp;
+
+	std::vector<uint8_t> m_payload;
+	std::vector<uint8_t> m_reply;
+};
+
+//
+// Preferred address on the interface, that can reach the relay.
+//
+SOCKADDR_INET SourceAddress(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	PMIB_UNICASTIPADDRESS_TABLE table;
+
+	const auto status = GetUnicastIpAddressTable(family, &table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Enumerate unicast addresses");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [table]()
+	{
+		FreeMibTable(table);
+	};
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto &row = table->Table[i];
+
+		if (row.InterfaceLuid.Value != luid.Value || IpDadStatePreferred != row.DadState)
+		{
+			continue;
+		}
+
+		if (AF_INET6 == family && IN6_IS_ADDR_LINKLOCAL(&row.Address.Ipv6.sin6_addr))
+		{
+			continue;
+		}
+
+		return row.Address;
+	}
+
+	THROW_ERROR("No usable address on the interface of the best default route");
+}
+
+uint16_t InterfaceMtu(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	MIB_IPINTERFACE_ROW iface;
+
+	if (false == GetAdapterInterface(luid, family, &iface))
+	{
+		THROW_ERROR("Failed to read interface of the best default route");
+	}
+
+	return static_cast<uint16_t>(std::min<ULONG>(iface.NlMtu, UINT16_MAX));
+}
+
+} // anonymous namespace
+
+TunnelMtuDiscovery::TunnelMtuDiscovery
+(
+	const SOCKADDR_INET &relay,
+	NET_LUID tunnelLuid,
+	uint16_t tunnelOverhead,
+	Callback callback,
+	std::shared_ptr<common::logging::ILogSink> logSink
+)
+	: m_relay(relay)
+	, m_tunnelLuid(tunnelLuid)
+	, m_tunnelOverhead(tunnelOverhead)
+	, m_callback(callback)
+	, m_logSink(logSink)
+	, m_stop(false)
+{
+	if (AF_INET != relay.si_family && AF_INET6 != relay.si_family)
+	{
+		THROW_ERROR("Invalid address family for relay address");
+	}
+
+	m_thread = std::thread(&TunnelMtuDiscovery::run, this);
+}
+
+TunnelMtuDiscovery::~TunnelMtuDiscovery()
+{
+	//
+	// At most one probe is waited for.
+	//
+
+	m_stop = true;
+	m_thread.join();
+}
+
+void TunnelMtuDiscovery::run()
+{
+	Result result = { Status::Failed, 0, 0 };
+
+	try
+	{
+		const auto discovered = discover();
+
+		if (false == discovered.has_value())
+		{
+			return;
+		}
+
+		result = discovered.value();
+	}
+	catch (const std::exception &ex)
+	{
+		const auto msg = std::string("Tunnel MTU discovery failed: ").append(ex.what());
+		m_logSink->error(msg.c_str());
+	}
+	catch (...)
+	{
+		m_logSink->error("Unspecified failure during tunnel MTU discovery");
+	}
+
+	m_callback(result);
+}
+
+std::optional<TunnelMtuDiscovery::Result> TunnelMtuDiscovery::discover()
+{
+	const auto family = m_relay.si_family;
+
+	const auto physical = GetBestDefaultRoute(family);
+
+	IcmpProbe probe(SourceAddress(physical.iface, family), m_relay);
+
+	//
+	// Sizes that are not answered after all attempts are taken to be too big.
+	//
+
+	bool aborted = false;
+
+	auto fits = [&](uint16_t packetSize)
+	{
+		for (uint32_t attempt = 0; attempt < PROBE_ATTEMPTS; ++attempt)
+		{
+			if (m_stop)
+			{
+				aborted = true;
+				return false;
+			}
+
+			switch (probe.send(packetSize))
+			{
+				case ProbeResult::Answered:
+				{
+					return true;
+				}
+				case ProbeResult::TooBig:
+				{
+					return false;
+				}
+				default:
+				{
+					break;
+				}
+			}
+		}
+
+		return false;
+	};
+
+	//
+	// The smallest size is answered and the largest size is not, throughout the search.
+	//
+
+	uint16_t smallest = (AF_INET == family ? MIN_IPV4_MTU : MIN_IPV6_MTU);
+	uint16_t largest = InterfaceMtu(physical.iface, family);
+
+	if (largest <= smallest || false == fits(smallest))
+	{
+		if (aborted)
+		{
+			return std::nullopt;
+		}
+
+		m_logSink->warning("The relay does not answer MTU probes");
+
+		return Result{ Status::Unreachable, 0, 0 };
+	}
+
+	if (fits(largest))
+	{
+		smallest = largest;
+	}
+
+	while (largest - smallest > 1 && false == aborted)
+	{
+		const auto size = static_cast<uint16_t>(smallest + (largest - smallest) / 2);
+
+		if (fits(size))
+		{
+			smallest = size;
+		}
+		else
+		{
+			largest = size;
+		}
+	}
+
+	if (aborted)
+	{
+		return std::nullopt;
+	}
+
+	const auto pathMtu = smallest;
+	const auto tunnelMtu = static_cast<uint16_t>(std::max<int>(pathMtu - m_tunnelOverhead, MIN_IPV6_MTU));
+
+	setTunnelMtu(tunnelMtu);
+
+	std::stringstream ss;
+
+	ss << "Path MTU towards the relay is " << pathMtu << ", using tunnel MTU " << tunnelMtu;
+
+	m_logSink->info(ss.str().c_str());
+
+	return Result{ Status::Updated, pathMtu, tunnelMtu };
+}
+
+void TunnelMtuDiscovery::setTunnelMtu(uint16_t mtu)
+{
+	bool found = false;
+
+	for (auto family : { AF_INET, AF_INET6 })
+	{
+		MIB_IPINTERFACE_ROW iface;
+
+		if (false == GetAdapterInterface(m_tunnelLuid, static_cast<ADDRESS_FAMILY>(family), &iface))
+		{
+			continue;
+		}
+
+		found = true;
+
+		if (mtu == iface.NlMtu)
+		{
+			continue;
+		}
+
+		iface.NlMtu = mtu;
+
+		//
+		// SitePrefixLength is reported but must be zero when writing an IPv4 row.
+		//
+		if (AF_INET == family)
+		{
+			iface.SitePrefixLength = 0;
+		}
+
+		const auto status = SetIpInterfaceEntry(&iface);
+
+		if (NO_ERROR != status)
+		{
+			THROW_WINDOWS_ERROR(status, "Set tunnel interface MTU");
+		}
+	}
+
+	if (false == found)
+	{
+		THROW_ERROR("The tunnel interface has no IPv4 or IPv6 interface");
+	}
+}
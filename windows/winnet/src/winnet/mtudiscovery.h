@@ -0,0 +1,93 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <libcommon/logging/ilogsink.h>
+
+//
+// Discovers the path MTU towards the relay, outside the tunnel, and sets the MTU
+// of the tunnel interface to match.
+//
+// Probes are ICMP echo requests that must not be fragmented, sent from an address
+// on the interface of the best default route. The largest probe that is answered
+// is the path MTU. It's found by bisecting between the smallest MTU of the family
+// and the MTU of the physical interface. Probes that go unanswered are retried
+// before the size is ruled out, since they may just have been lost.
+//
+// Discovery runs once, on a background thread, and the outcome is reported
+// through the callback on that thread.
+//
+class TunnelMtuDiscovery
+{
+public:
+
+	enum class Status
+	{
+		// The tunnel MTU was set, or already matched.
+		Updated,
+
+		// Not even the smallest probe was answered. The tunnel MTU is left as is.
+		Unreachable,
+
+		Failed,
+	};
+
+	struct Result
+	{
+		Status status;
+		uint16_t pathMtu;
+		uint16_t tunnelMtu;
+	};
+
+	using Callback = std::function<void(const Result &result)>;
+
+	//
+	// 'tunnelOverhead' is the number of bytes that the tunnel adds to each packet.
+	// The tunnel MTU is the path MTU less the overhead, but never below the IPv6 minimum.
+	//
+	TunnelMtuDiscovery
+	(
+		const SOCKADDR_INET &relay,
+		NET_LUID tunnelLuid,
+		uint16_t tunnelOverhead,
+		Callback callback,
+		std::shared_ptr<common::logging::ILogSink> logSink
+	);
+
+	//
+	// Abandons discovery that is in progress, without invoking the callback.
+	// Must not be destroyed from within the callback.
+	//
+	~TunnelMtuDiscovery();
+
+	TunnelMtuDiscovery(const TunnelMtuDiscovery &) = delete;
+	TunnelMtuDiscovery(TunnelMtuDiscovery &&) = delete;
+	TunnelMtuDiscovery &operator=(const TunnelMtuDiscovery &) = delete;
+	TunnelMtuDiscovery &operator=(TunnelMtuDiscovery &&) = delete;
+
+private:
+
+	const SOCKADDR_INET m_relay;
+	const NET_LUID m_tunnelLuid;
+	const uint16_t m_tunnelOverhead;
+
+	Callback m_callback;
+	std::shared_ptr<common::logging::ILogSink> m_logSink;
+
+	std::atomic_bool m_stop;
+	std::thread m_thread;
+
+	void run();
+
+	// Returns nothing if discovery was abandoned.
+	std::optional<Result> discover();
+
+	void setTunnelMtu(uint16_t mtu);
+};
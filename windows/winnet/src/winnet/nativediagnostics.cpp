@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include "nativediagnostics.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <iphlpapi.h>
+
+using Record = shared::diagnostics::BlobWriter::Record;
+
+namespace
+{
+
+void AppendAddress(Record &record, const SOCKADDR_INET &address)
+{
+	if (AF_INET == address.si_family)
+	{
+		record.b(&address.Ipv4.sin_addr, sizeof(address.Ipv4.sin_addr));
+	}
+	else
+	{
+		record.b(&address.Ipv6.sin6_addr, sizeof(address.Ipv6.sin6_addr));
+	}
+}
+
+void CollectRoutes(shared::diagnostics::BlobWriter &writer, winnet::routing::RouteManager &routeManager)
+{
+	for (const auto &route : routeManager.registeredRoutes())
+	{
+		Record record(MULLVAD_DIAGNOSTICS_SECTION_ROUTE);
+
+		record.u(route.network.Prefix.si_family);
+		AppendAddress(record, route.network.Prefix);
+		record.u(route.network.PrefixLength);
+		record.u(route.luid.Value);
+		AppendAddress(record, route.nextHop);
+
+		writer.write(record);
+	}
+}
+
+void CollectAdapters(shared::diagnostics::BlobWriter &writer)
+{
+	MIB_IF_TABLE2 *table;
+
+	const auto status = GetIfTable2(&table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Acquire network interface table");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [table]()
+	{
+		FreeMibTable(table);
+	};
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto &adapter = table->Table[i];
+
+		//
+		// Filter modules and other auxiliary interfaces only make up the numbers.
+		//
+		if (FALSE != adapter.InterfaceAndOperStatusFlags.FilterInterface)
+		{
+			continue;
+		}
+
+		writer.write(Record(MULLVAD_DIAGNOSTICS_SECTION_ADAPTER)
+			.u(adapter.InterfaceLuid.Value)
+			.u(adapter.InterfaceIndex)
+			.u(adapter.Type)
+			.s(std::wstring(adapter.Alias))
+			.u(adapter.AdminStatus)
+			.u(adapter.OperStatus)
+			.u(adapter.MediaConnectState)
+			.u(adapter.Mtu));
+	}
+}
+
+} // anonymous namespace
+
+//static
+void NativeDiagnostics::Collect(shared::diagnostics::BlobWriter &writer, winnet::routing::RouteManager *routeManager)
+{
+	if (nullptr != routeManager)
+	{
+		CollectRoutes(writer, *routeManager);
+	}
+
+	CollectAdapters(writer);
+
+	writer.writeCounters();
+
+	if (nullptr != routeManager)
+	{
+		for (const auto &event : routeManager->events())
+		{
+			writer.write(Record(MULLVAD_DIAGNOSTICS_SECTION_ROUTE_EVENT).b(&event, sizeof(event)));
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "routing/routemanager.h"
+#include <libshared/diagnostics/blobwriter.h>
+
+//
+// Routing and adapter state for problem reports. See WinNet_CollectNativeDiagnostics().
+//
+class NativeDiagnostics
+{
+public:
+
+	NativeDiagnostics() = delete;
+
+	//
+	// Write the routes registered by the route manager, if one is given, all adapters,
+	// the performance counters and the recent route events, in that order.
+	//
+	static void Collect(shared::diagnostics::BlobWriter &writer, winnet::routing::RouteManager *routeManager);
+};
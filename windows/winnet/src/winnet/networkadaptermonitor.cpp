@@ -2,8 +2,12 @@
 
 #include "networkadaptermonitor.h"
 #include <libcommon/memory.h>
+#include <libshared/logging/unwind.h>
+#include <libshared/performance/counterregistry.h>
+#include <libshared/tracing/trace.h>
 #include <sstream>
 #include <cstring>
+#include <unordered_set>
 
 using namespace std::placeholders;
 
@@ -11,13 +15,17 @@ using namespace std::placeholders;
 NetworkAdapterMonitor::NetworkAdapterMonitor(
 	std::shared_ptr<common::logging::ILogSink> logSink,
 	UpdateSinkType updateSink,
+	DeltaSinkType deltaSink,
 	FilterType filter,
-	std::shared_ptr<IDataProvider> dataProvider
+	std::shared_ptr<IDataProvider> dataProvider,
+	ComparatorType comparator
 )
 	: m_logSink(logSink)
 	, m_notificationHandle(nullptr)
 	, m_updateSink(updateSink)
+	, m_deltaSink(deltaSink)
 	, m_filter(filter)
+	, m_comparator(comparator)
 	, m_dataProvider(dataProvider)
 {
 	//
@@ -40,31 +48,39 @@ NetworkAdapterMonitor::NetworkAdapterMonitor(
 		m_dataProvider->freeMibTable(table);
 	};
 
+	m_adapters.reserve(table->NumEntries);
+
 	for (ULONG i = 0; i < table->NumEntries; ++i)
 	{
-		m_adapters[table->Table[i].InterfaceLuid.Value] = table->Table[i];
+		auto &entry = m_adapters[table->Table[i].InterfaceLuid.Value];
+
+		entry.presence = InterfacePresence{};
+		entry.filteredIndex = NOT_FILTERED;
 
 		if (filter(table->Table[i]))
 		{
-			m_filteredAdapters.push_back(table->Table[i]);
+			addFilteredAdapter(entry, table->Table[i]);
 		}
 	}
 
+	initializePresence();
+
 	//
 	// Send initial notification
 	//
 
 	if (m_filteredAdapters.empty())
 	{
-		m_updateSink(m_filteredAdapters, nullptr, UpdateType::Update);
+		notifySink(nullptr, UpdateType::Update);
 	}
 	else
 	{
-		m_updateSink(m_filteredAdapters, nullptr, UpdateType::Add);
+		notifySink(nullptr, UpdateType::Add);
 	}
 
 	//
-	// Listen to adapter events
+	// Listen to adapter events.
+	// The initial notification is not requested, since it would replay the adapters we just read.
 	//
 
 	const auto statusCb = m_dataProvider->notifyIpInterfaceChange(
@@ -81,11 +97,39 @@ NetworkAdapterMonitor::NetworkAdapterMonitor(
 	}
 }
 
+NetworkAdapterMonitor::NetworkAdapterMonitor(
+	std::shared_ptr<common::logging::ILogSink> logSink,
+	UpdateSinkType updateSink,
+	FilterType filter,
+	std::shared_ptr<IDataProvider> dataProvider,
+	ComparatorType comparator
+) : NetworkAdapterMonitor(logSink, updateSink, nullptr, filter, dataProvider, comparator)
+{
+}
+
 NetworkAdapterMonitor::NetworkAdapterMonitor(
 	std::shared_ptr<common::logging::ILogSink> logSink
 	, UpdateSinkType updateSink
 	, FilterType filter
-) : NetworkAdapterMonitor(logSink, updateSink, filter, std::make_shared<SystemDataProvider>())
+) : NetworkAdapterMonitor(logSink, updateSink, nullptr, filter, std::make_shared<SystemDataProvider>(), SignificantFieldsDiffer)
+{
+}
+
+NetworkAdapterMonitor::NetworkAdapterMonitor(
+	std::shared_ptr<common::logging::ILogSink> logSink,
+	DeltaSinkType deltaSink,
+	FilterType filter,
+	std::shared_ptr<IDataProvider> dataProvider,
+	ComparatorType comparator
+) : NetworkAdapterMonitor(logSink, nullptr, deltaSink, filter, dataProvider, comparator)
+{
+}
+
+NetworkAdapterMonitor::NetworkAdapterMonitor(
+	std::shared_ptr<common::logging::ILogSink> logSink
+	, DeltaSinkType deltaSink
+	, FilterType filter
+) : NetworkAdapterMonitor(logSink, nullptr, deltaSink, filter, std::make_shared<SystemDataProvider>(), SignificantFieldsDiffer)
 {
 }
 
@@ -98,6 +142,58 @@ NetworkAdapterMonitor::~NetworkAdapterMonitor()
 	}
 }
 
+//static
+bool NetworkAdapterMonitor::SignificantFieldsDiffer(const MIB_IF_ROW2 &previous, const MIB_IF_ROW2 &current)
+{
+	return previous.OperStatus != current.OperStatus
+		|| previous.AdminStatus != current.AdminStatus
+		|| previous.MediaConnectState != current.MediaConnectState
+		|| 0 != std::memcmp(&previous.InterfaceAndOperStatusFlags, &current.InterfaceAndOperStatusFlags,
+			sizeof(previous.InterfaceAndOperStatusFlags))
+		|| previous.Mtu != current.Mtu
+		|| 0 != wcsncmp(previous.Alias, current.Alias, IF_MAX_STRING_SIZE + 1)
+		|| previous.PhysicalAddressLength != current.PhysicalAddressLength
+		|| 0 != std::memcmp(previous.PhysicalAddress, current.PhysicalAddress, current.PhysicalAddressLength);
+}
+
+NetworkAdapterMonitor::Snapshot NetworkAdapterMonitor::snapshot()
+{
+	if (!m_snapshot)
+	{
+		m_snapshot = std::make_shared<const std::vector<MIB_IF_ROW2>>(m_filteredAdapters);
+	}
+
+	return m_snapshot;
+}
+
+void NetworkAdapterMonitor::notifySink(const MIB_IF_ROW2 *adapter, UpdateType updateType)
+{
+	if (m_updateSink)
+	{
+		m_updateSink(m_filteredAdapters, adapter, updateType);
+		return;
+	}
+
+	//
+	// The filtered set has changed, so any existing snapshot is stale.
+	// Sinks that are holding on to it are unaffected.
+	//
+
+	m_snapshot.reset();
+
+	Delta delta;
+
+	delta.updateType = updateType;
+	delta.adapterCount = m_filteredAdapters.size();
+
+	if (nullptr != adapter)
+	{
+		delta.luid = adapter->InterfaceLuid;
+	}
+
+	m_deltaSink(delta, *this);
+}
+
 bool NetworkAdapterMonitor::hasIPv4Interface(NET_LUID luid) const
 {
 	MIB_IPINTERFACE_ROW iprow = { 0 };
@@ -138,12 +234,101 @@ bool NetworkAdapterMonitor::hasIPv6Interface(NET_LUID luid) const
 	return false;
 }
 
-std::vector<MIB_IF_ROW2>::iterator NetworkAdapterMonitor::findFilteredAdapter(const MIB_IF_ROW2 &adapter)
+bool NetworkAdapterMonitor::hasInterface(NET_LUID luid, ADDRESS_FAMILY family, std::optional<bool> &presence) const
 {
-	return std::find_if(m_filteredAdapters.begin(), m_filteredAdapters.end(), [&adapter](const MIB_IF_ROW2 &elem)
+	if (false == presence.has_value())
 	{
-		return elem.InterfaceLuid.Value == adapter.InterfaceLuid.Value;
-	});
+		presence = (AF_INET == family ? hasIPv4Interface(luid) : hasIPv6Interface(luid));
+	}
+
+	return presence.value();
+}
+
+void NetworkAdapterMonitor::initializePresence()
+{
+	MIB_IPINTERFACE_TABLE *table;
+
+	const auto status = m_dataProvider->getIpInterfaceTable(AF_UNSPEC, &table);
+
+	if (NO_ERROR != status)
+	{
+		//
+		// Presence is resolved per adapter when it's needed instead.
+		//
+
+		return;
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [this, table]()
+	{
+		m_dataProvider->freeMibTable(table);
+	};
+
+	for (auto &adapter : m_adapters)
+	{
+		adapter.second.presence = InterfacePresence{ false, false };
+	}
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto &iface = table->Table[i];
+
+		const auto adapter = m_adapters.find(iface.InterfaceLuid.Value);
+
+		if (m_adapters.end() == adapter)
+		{
+			continue;
+		}
+
+		if (AF_INET == iface.Family)
+		{
+			adapter->second.presence.ipv4 = true;
+		}
+		else if (AF_INET6 == iface.Family)
+		{
+			adapter->second.presence.ipv6 = true;
+		}
+	}
+}
+
+void NetworkAdapterMonitor::addFilteredAdapter(AdapterEntry &entry, const MIB_IF_ROW2 &iface)
+{
+	entry.filteredIndex = m_filteredAdapters.size();
+	m_filteredAdapters.push_back(iface);
+}
+
+void NetworkAdapterMonitor::removeFilteredAdapter(AdapterEntry &entry)
+{
+	//
+	// Move the last element into the vacated slot.
+	//
+
+	const auto index = entry.filteredIndex;
+	const auto last = m_filteredAdapters.size() - 1;
+
+	if (index != last)
+	{
+		m_filteredAdapters[index] = m_filteredAdapters[last];
+		m_adapters[m_filteredAdapters[index].InterfaceLuid.Value].filteredIndex = index;
+	}
+
+	m_filteredAdapters.pop_back();
+	entry.filteredIndex = NOT_FILTERED;
+}
+
+MIB_IF_ROW2 NetworkAdapterMonitor::lastKnownAdapter(ULONG64 luid, const AdapterEntry &entry) const
+{
+	if (NOT_FILTERED != entry.filteredIndex)
+	{
+		return m_filteredAdapters[entry.filteredIndex];
+	}
+
+	MIB_IF_ROW2 row = { 0 };
+	row.InterfaceLuid.Value = luid;
+
+	return row;
 }
 
 MIB_IF_ROW2 NetworkAdapterMonitor::getAdapter(NET_LUID luid) const
@@ -164,60 +349,222 @@ MIB_IF_ROW2 NetworkAdapterMonitor::getAdapter(NET_LUID luid) const
 	THROW_WINDOWS_ERROR(status, ss.str().c_str());
 }
 
-void NetworkAdapterMonitor::callback(const MIB_IPINTERFACE_ROW *hint, MIB_NOTIFICATION_TYPE)
+void NetworkAdapterMonitor::callback(const MIB_IPINTERFACE_ROW *hint, MIB_NOTIFICATION_TYPE updateType)
 {
-	MIB_IF_ROW2 iface = getAdapter(hint->InterfaceLuid);
-	
-	bool adapterEnabled = NET_IF_ADMIN_STATUS_UP == iface.AdminStatus
-		&& (hasIPv4Interface(iface.InterfaceLuid)
-			|| hasIPv6Interface(iface.InterfaceLuid));
+	if (nullptr == hint)
+	{
+		resync();
+		return;
+	}
+
+	auto adapterIt = m_adapters.find(hint->InterfaceLuid.Value);
+
+	if (m_adapters.end() == adapterIt && MibDeleteInstance == updateType)
+	{
+		//
+		// Losing an interface cannot enable an adapter we're not tracking.
+		//
+
+		return;
+	}
+
+	//
+	// Update interface presence from the notification itself.
+	//
+
+	auto presence = (m_adapters.end() == adapterIt ? InterfacePresence{} : adapterIt->second.presence);
+
+	if (AF_INET == hint->Family || AF_INET6 == hint->Family)
+	{
+		auto &familyPresence = (AF_INET == hint->Family ? presence.ipv4 : presence.ipv6);
+
+		switch (updateType)
+		{
+			case MibAddInstance:
+			case MibParameterNotification:
+			{
+				familyPresence = true;
+				break;
+			}
+			case MibDeleteInstance:
+			{
+				familyPresence = false;
+				break;
+			}
+			default:
+			{
+				familyPresence.reset();
+				break;
+			}
+		}
+	}
 
-	const auto adapterIt = m_adapters.find(hint->InterfaceLuid.Value);
+	const bool hasInterfaces = hasInterface(hint->InterfaceLuid, AF_INET, presence.ipv4)
+		|| hasInterface(hint->InterfaceLuid, AF_INET6, presence.ipv6);
 
+	//
+	// Only query the adapter if it can be enabled.
+	//
+
+	MIB_IF_ROW2 iface;
+
+	if (hasInterfaces)
+	{
+		iface = getAdapter(hint->InterfaceLuid);
+	}
+	else if (m_adapters.end() != adapterIt)
+	{
+		iface = lastKnownAdapter(adapterIt->first, adapterIt->second);
+	}
+	else
+	{
+		return;
+	}
+
+	const bool adapterEnabled = hasInterfaces && NET_IF_ADMIN_STATUS_UP == iface.AdminStatus;
+
+	update(adapterIt, iface, presence, adapterEnabled);
+}
+
+void NetworkAdapterMonitor::resync()
+{
+	static auto &resyncs = shared::performance::CounterRegistry::Instance().counter("winnet.adapter.resyncs");
+
+	resyncs.increment();
+
+	MIB_IF_TABLE2 *adapters;
+
+	auto status = m_dataProvider->getIfTable2(&adapters);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Acquire network interface table");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [this, adapters]()
+	{
+		m_dataProvider->freeMibTable(adapters);
+	};
+
+	MIB_IPINTERFACE_TABLE *interfaces;
+
+	status = m_dataProvider->getIpInterfaceTable(AF_UNSPEC, &interfaces);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Acquire IP interface table");
+	}
+
+	sd += [this, interfaces]()
+	{
+		m_dataProvider->freeMibTable(interfaces);
+	};
+
+	std::unordered_map<ULONG64, InterfacePresence> presence;
+
+	for (ULONG i = 0; i < interfaces->NumEntries; ++i)
+	{
+		const auto &iface = interfaces->Table[i];
+
+		if (AF_INET != iface.Family && AF_INET6 != iface.Family)
+		{
+			continue;
+		}
+
+		auto &entry = presence.try_emplace(iface.InterfaceLuid.Value, InterfacePresence{ false, false }).first->second;
+
+		(AF_INET == iface.Family ? entry.ipv4 : entry.ipv6) = true;
+	}
+
+	std::unordered_set<ULONG64> present;
+
+	for (ULONG i = 0; i < adapters->NumEntries; ++i)
+	{
+		const auto &iface = adapters->Table[i];
+
+		const auto match = presence.find(iface.InterfaceLuid.Value);
+		const auto adapterPresence = (presence.end() == match ? InterfacePresence{ false, false } : match->second);
+
+		const bool adapterEnabled = (adapterPresence.ipv4.value() || adapterPresence.ipv6.value())
+			&& NET_IF_ADMIN_STATUS_UP == iface.AdminStatus;
+
+		present.insert(iface.InterfaceLuid.Value);
+
+		update(m_adapters.find(iface.InterfaceLuid.Value), iface, adapterPresence, adapterEnabled);
+	}
+
+	//
+	// Adapters that have disappeared altogether are removed using their last known state.
+	//
+
+	std::vector<ULONG64> vanished;
+
+	for (const auto &adapter : m_adapters)
+	{
+		if (0 == present.count(adapter.first))
+		{
+			vanished.push_back(adapter.first);
+		}
+	}
+
+	for (const auto luid : vanished)
+	{
+		const auto adapterIt = m_adapters.find(luid);
+		const auto iface = lastKnownAdapter(luid, adapterIt->second);
+
+		update(adapterIt, iface, InterfacePresence{ false, false }, false);
+	}
+}
+
+void NetworkAdapterMonitor::update(std::unordered_map<ULONG64, AdapterEntry>::iterator adapterIt,
+	const MIB_IF_ROW2 &iface, const InterfacePresence &presence, bool adapterEnabled)
+{
 	if (adapterEnabled)
 	{
 		//
 		// Check if the adapter has been added or updated
 		//
 
-		bool fieldsChanged;
-		
 		if (m_adapters.end() == adapterIt)
 		{
-			const auto pair = m_adapters.emplace(
+			adapterIt = m_adapters.emplace(
 				iface.InterfaceLuid.Value,
-				iface
-			);
-			fieldsChanged = true;
+				AdapterEntry{ presence, NOT_FILTERED }
+			).first;
 		}
 		else
 		{
-			//
-			// Only send an Update event if the fields have changed
-			//
-			fieldsChanged = std::memcmp(
-				&adapterIt->second,
-				&iface,
-				sizeof(MIB_IF_ROW2)
-			) != 0;
-
-			// update stored adapter
-			adapterIt->second = iface;
+			adapterIt->second.presence = presence;
 		}
 
+		auto &entry = adapterIt->second;
+
 		if (m_filter(iface))
 		{
 			//
 			// Report Add event if this is new
 			//
-			if (m_filteredAdapters.end() == findFilteredAdapter(iface))
+			if (NOT_FILTERED == entry.filteredIndex)
 			{
-				m_filteredAdapters.push_back(iface);
-				m_updateSink(m_filteredAdapters, &iface, UpdateType::Add);
+				addFilteredAdapter(entry, iface);
+				notifySink(&iface, UpdateType::Add);
 			}
-			else if (fieldsChanged)
+			else if (m_comparator(m_filteredAdapters[entry.filteredIndex], iface))
 			{
-				m_updateSink(m_filteredAdapters, &iface, UpdateType::Update);
+				//
+				// Only send an Update event if the fields have changed.
+				// The previous row is only needed here, so only filtered adapters retain it.
+				//
+				m_filteredAdapters[entry.filteredIndex] = iface;
+				notifySink(&iface, UpdateType::Update);
+			}
+			else
+			{
+				static auto &suppressed = shared::performance::CounterRegistry::Instance().counter("winnet.adapter.suppressed");
+
+				suppressed.increment();
 			}
 		}
 		else
@@ -226,16 +573,10 @@ void NetworkAdapterMonitor::callback(const MIB_IPINTERFACE_ROW *hint, MIB_NOTIFI
 			// Synthesize a Delete event if we're no longer interested
 			// in this adapter
 			//
-			const auto filteredIt = findFilteredAdapter(iface);
-
-			if (m_filteredAdapters.end() != filteredIt)
+			if (NOT_FILTERED != entry.filteredIndex)
 			{
-				m_filteredAdapters.erase(filteredIt);
-				m_updateSink(
-					m_filteredAdapters,
-					&iface,
-					UpdateType::Delete
-				);
+				removeFilteredAdapter(entry);
+				notifySink(&iface, UpdateType::Delete);
 			}
 		}
 	}
@@ -245,28 +586,27 @@ void NetworkAdapterMonitor::callback(const MIB_IPINTERFACE_ROW *hint, MIB_NOTIFI
 		{
 			return;
 		}
-		
+
 		//
 		// Remove the adapter
 		//
 
-		m_adapters.erase(adapterIt);
-
-		const auto filteredIt = findFilteredAdapter(iface);
+		const bool wasFiltered = NOT_FILTERED != adapterIt->second.filteredIndex;
 
-		if (m_filteredAdapters.end() != filteredIt)
+		if (wasFiltered)
 		{
-			m_filteredAdapters.erase(filteredIt);
+			removeFilteredAdapter(adapterIt->second);
+		}
+
+		m_adapters.erase(adapterIt);
 
+		if (wasFiltered)
+		{
 			//
 			// We report 'Delete' for any adapter that was
 			// approved by the filter when reported.
 			//
-			m_updateSink(
-				m_filteredAdapters,
-				&iface,
-				UpdateType::Delete
-			);
+			notifySink(&iface, UpdateType::Delete);
 		}
 	}
 }
@@ -276,17 +616,30 @@ void __stdcall NetworkAdapterMonitor::Callback(void *context, MIB_IPINTERFACE_RO
 {
 	auto inst = reinterpret_cast<NetworkAdapterMonitor *>(context);
 
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winnet.adapter.notification");
+	static shared::logging::RateLimiter errorLimiter;
+
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordNetwork);
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&stopwatch]()
+	{
+		shared::tracing::AdapterNotification(stopwatch, "NetworkAdapterMonitor");
+	};
+
 	try
 	{
 		inst->callback(hint, updateType);
 	}
 	catch (const std::exception &err)
 	{
-		inst->m_logSink->error(err.what());
+		shared::logging::UnwindAndLog(*inst->m_logSink, err, errorLimiter);
 	}
 	catch (...)
 	{
-		inst->m_logSink->error("Unspecified error in NetworkAdapterMonitor::Callback()");
+		errorLimiter.error(*inst->m_logSink, "Unspecified error in NetworkAdapterMonitor::Callback()");
 	}
 }
 
@@ -302,18 +655,72 @@ DWORD NetworkAdapterMonitor::SystemDataProvider::notifyIpInterfaceChange(
 	HANDLE *NotificationHandle
 )
 {
-	return NotifyIpInterfaceChange(
-		Family,
-		Callback,
-		CallerContext,
-		InitialNotification,
-		NotificationHandle
-	);
+	std::unique_ptr<NotificationHub::Subscription> subscription;
+
+	try
+	{
+		subscription = NotificationHub::Instance()->subscribeInterfaceChanges(
+			[Family, Callback, CallerContext](MIB_IPINTERFACE_ROW *row, MIB_NOTIFICATION_TYPE notificationType)
+		{
+			if (AF_UNSPEC != Family && nullptr != row && Family != row->Family)
+			{
+				return;
+			}
+
+			Callback(CallerContext, row, notificationType);
+		});
+	}
+	catch (const common::error::WindowsException &err)
+	{
+		return err.errorCode();
+	}
+	catch (...)
+	{
+		return ERROR_GEN_FAILURE;
+	}
+
+	const auto handle = reinterpret_cast<HANDLE>(subscription.get());
+
+	{
+		std::scoped_lock<std::mutex> lock(m_subscriptionsLock);
+		m_subscriptions.emplace(handle, std::move(subscription));
+	}
+
+	*NotificationHandle = handle;
+
+	if (FALSE != InitialNotification)
+	{
+		Callback(CallerContext, nullptr, MibInitialNotification);
+	}
+
+	return NO_ERROR;
 }
 
 DWORD NetworkAdapterMonitor::SystemDataProvider::cancelMibChangeNotify2(HANDLE NotificationHandle)
 {
-	return CancelMibChangeNotify2(NotificationHandle);
+	std::unique_ptr<NotificationHub::Subscription> subscription;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_subscriptionsLock);
+
+		const auto match = m_subscriptions.find(NotificationHandle);
+
+		if (m_subscriptions.end() == match)
+		{
+			return ERROR_INVALID_HANDLE;
+		}
+
+		subscription = std::move(match->second);
+		m_subscriptions.erase(match);
+	}
+
+	//
+	// Unsubscribe outside the lock, since it waits for in-progress callbacks.
+	//
+
+	subscription.reset();
+
+	return NO_ERROR;
 }
 
 DWORD NetworkAdapterMonitor::SystemDataProvider::getIfEntry2(PMIB_IF_ROW2 Row)
@@ -331,6 +738,11 @@ DWORD NetworkAdapterMonitor::SystemDataProvider::getIpInterfaceEntry(PMIB_IPINTE
 	return GetIpInterfaceEntry(Row);
 }
 
+DWORD NetworkAdapterMonitor::SystemDataProvider::getIpInterfaceTable(ADDRESS_FAMILY Family, PMIB_IPINTERFACE_TABLE *Table)
+{
+	return GetIpInterfaceTable(Family, Table);
+}
+
 void NetworkAdapterMonitor::SystemDataProvider::freeMibTable(PVOID Memory)
 {
 	FreeMibTable(Memory);
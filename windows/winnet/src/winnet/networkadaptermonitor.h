@@ -2,13 +2,18 @@
 
 #include <libcommon/logging/ilogsink.h>
 #include <libcommon/error.h>
-#include <map>
+#include <optional>
+#include <unordered_map>
 #include <winsock2.h>
 #include <ws2ipdef.h>
 #include <iphlpapi.h>
 #include <windows.h>
 #include <functional>
 #include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "notificationhub.h"
 
 
 class NetworkAdapterMonitor
@@ -24,12 +29,46 @@ public:
 
 	using FilterType = std::function<bool(const MIB_IF_ROW2 &adapter)>;
 
+	//
+	// Returns true if the adapter has changed in a way that should be reported
+	// with an Update event.
+	//
+	using ComparatorType = std::function<bool(const MIB_IF_ROW2 &previous, const MIB_IF_ROW2 &current)>;
+
+	//
+	// Default comparator. Compares the status, media state, flags, MTU, alias and
+	// physical address. Traffic counters, which change constantly, are ignored.
+	//
+	static bool SignificantFieldsDiffer(const MIB_IF_ROW2 &previous, const MIB_IF_ROW2 &current);
+
 	//
 	// An event may apply to a specific adapter, or it may apply to all adapters.
 	// In the latter case, 'adapter' will be set to nullptr.
 	//
 	using UpdateSinkType = std::function<void(const std::vector<MIB_IF_ROW2> &adapters, const MIB_IF_ROW2 *adapter, UpdateType updateType)>;
 
+	//
+	// Lightweight alternative to 'UpdateSinkType' for sinks that don't need
+	// the full set of adapters on every event.
+	//
+	struct Delta
+	{
+		UpdateType updateType;
+
+		// Adapter the event applies to, or unset if it applies to all adapters.
+		std::optional<NET_LUID> luid;
+
+		// Number of adapters in the filtered set after the update.
+		size_t adapterCount;
+	};
+
+	using Snapshot = std::shared_ptr<const std::vector<MIB_IF_ROW2>>;
+
+	//
+	// The sink may call 'snapshot()' on the monitor to get the filtered set of adapters.
+	//
+	using DeltaSinkType = std::function<void(const Delta &delta, NetworkAdapterMonitor &monitor)>;
+
 	struct IDataProvider;
 	class SystemDataProvider;
 
@@ -38,12 +77,25 @@ public:
 		, UpdateSinkType updateSink
 		, FilterType filter
 		, std::shared_ptr<IDataProvider> dataProvider
+		, ComparatorType comparator = SignificantFieldsDiffer
 	);
 	NetworkAdapterMonitor(
 		std::shared_ptr<common::logging::ILogSink> logSink
 		, UpdateSinkType updateSink
 		, FilterType filter
 	);
+	NetworkAdapterMonitor(
+		std::shared_ptr<common::logging::ILogSink> logSink
+		, DeltaSinkType deltaSink
+		, FilterType filter
+		, std::shared_ptr<IDataProvider> dataProvider
+		, ComparatorType comparator = SignificantFieldsDiffer
+	);
+	NetworkAdapterMonitor(
+		std::shared_ptr<common::logging::ILogSink> logSink
+		, DeltaSinkType deltaSink
+		, FilterType filter
+	);
 	~NetworkAdapterMonitor();
 
 	NetworkAdapterMonitor(const NetworkAdapterMonitor &) = delete;
@@ -51,11 +103,29 @@ public:
 	NetworkAdapterMonitor(NetworkAdapterMonitor &&) = delete;
 	NetworkAdapterMonitor& operator=(NetworkAdapterMonitor &&) = delete;
 
+	//
+	// Immutable copy of the filtered set of adapters.
+	// The copy is created on first request after a change, and shared until the next change.
+	// Call only from within the sink, which is where updates are serialized.
+	//
+	Snapshot snapshot();
+
 private:
 
+	NetworkAdapterMonitor(
+		std::shared_ptr<common::logging::ILogSink> logSink
+		, UpdateSinkType updateSink
+		, DeltaSinkType deltaSink
+		, FilterType filter
+		, std::shared_ptr<IDataProvider> dataProvider
+		, ComparatorType comparator
+	);
+
 	std::shared_ptr<common::logging::ILogSink> m_logSink;
 	UpdateSinkType m_updateSink;
+	DeltaSinkType m_deltaSink;
 	FilterType m_filter;
+	ComparatorType m_comparator;
 
 	std::shared_ptr<IDataProvider> m_dataProvider;
 
@@ -64,10 +134,66 @@ private:
 	bool hasIPv4Interface(NET_LUID luid) const;
 	bool hasIPv6Interface(NET_LUID luid) const;
 
-	std::map<ULONG64, MIB_IF_ROW2> m_adapters;
+	//
+	// Presence of an IP interface, per family.
+	// Tracked from notifications and only queried when not known.
+	//
+	struct InterfacePresence
+	{
+		std::optional<bool> ipv4;
+		std::optional<bool> ipv6;
+	};
+
+	bool hasInterface(NET_LUID luid, ADDRESS_FAMILY family, std::optional<bool> &presence) const;
+
+	//
+	// Resolve the presence of all known adapters from a single interface table,
+	// rather than querying each adapter on its first notification.
+	//
+	void initializePresence();
+
+	static constexpr size_t NOT_FILTERED = ~size_t(0);
+
+	//
+	// Compact record for every adapter on the system.
+	// The full row is only retained for adapters in the filtered set, which is
+	// what the sinks consume. Other adapters are read on demand when they change.
+	//
+	struct AdapterEntry
+	{
+		InterfacePresence presence;
+
+		// Position in 'm_filteredAdapters', or NOT_FILTERED.
+		size_t filteredIndex;
+	};
+
+	std::unordered_map<ULONG64, AdapterEntry> m_adapters;
 	std::vector<MIB_IF_ROW2> m_filteredAdapters;
 
-	std::vector<MIB_IF_ROW2>::iterator findFilteredAdapter(const MIB_IF_ROW2 &adapter);
+	void addFilteredAdapter(AdapterEntry &entry, const MIB_IF_ROW2 &iface);
+	void removeFilteredAdapter(AdapterEntry &entry);
+
+	//
+	// Last reported row for a filtered adapter.
+	// Only the LUID is known for other adapters.
+	//
+	MIB_IF_ROW2 lastKnownAdapter(ULONG64 luid, const AdapterEntry &entry) const;
+
+	//
+	// Brings a single adapter, which may or may not be tracked, in line with its current state.
+	//
+	void update(std::unordered_map<ULONG64, AdapterEntry>::iterator adapterIt,
+		const MIB_IF_ROW2 &iface, const InterfacePresence &presence, bool adapterEnabled);
+
+	//
+	// Reconciles all adapters with the system tables.
+	// Used when a notification doesn't identify the interface that changed.
+	//
+	void resync();
+
+	Snapshot m_snapshot;
+
+	void notifySink(const MIB_IF_ROW2 *adapter, UpdateType updateType);
 
 	HANDLE m_notificationHandle;
 	static void __stdcall Callback(void *context, MIB_IPINTERFACE_ROW *hint, MIB_NOTIFICATION_TYPE updateType);
@@ -95,6 +221,7 @@ struct NetworkAdapterMonitor::IDataProvider
 	
 	virtual DWORD getIfEntry2(PMIB_IF_ROW2 Row) = 0;
 	virtual DWORD getIpInterfaceEntry(PMIB_IPINTERFACE_ROW Row) = 0;
+	virtual DWORD getIpInterfaceTable(ADDRESS_FAMILY Family, PMIB_IPINTERFACE_TABLE *Table) = 0;
 };
 
 class NetworkAdapterMonitor::SystemDataProvider : public IDataProvider
@@ -123,4 +250,14 @@ public:
 	
 	DWORD getIfEntry2(PMIB_IF_ROW2 Row) override;
 	DWORD getIpInterfaceEntry(PMIB_IPINTERFACE_ROW Row) override;
+	DWORD getIpInterfaceTable(ADDRESS_FAMILY Family, PMIB_IPINTERFACE_TABLE *Table) override;
+
+private:
+
+	//
+	// Notifications are delivered through the shared notification hub.
+	// The handles that are returned identify entries in this map.
+	//
+	std::mutex m_subscriptionsLock;
+	std::map<HANDLE, std::unique_ptr<NotificationHub::Subscription>> m_subscriptions;
 };
@@ -0,0 +1,514 @@
+#include "stdafx.h"
+#include "notificationhub.h"
+#include <libcommon/error.h>
+#include <libshared/performance/counterregistry.h>
+
+namespace
+{
+
+//
+// Notifications are held back after resume until none have arrived for the
+// quiet period, but never for longer than the limit.
+//
+const uint32_t RESUME_QUIET_PERIOD_MS = 2000;
+const uint32_t RESUME_SETTLE_LIMIT_MS = 10000;
+
+template<typename Row, typename Subscribers>
+void Dispatch(std::shared_mutex &lock, Subscribers &subscribers, Row *row, MIB_NOTIFICATION_TYPE notificationType)
+{
+	std::shared_lock<std::shared_mutex> dispatchLock(lock);
+
+	for (const auto &subscriber : subscribers)
+	{
+		if (nullptr == row)
+		{
+			subscriber.second(nullptr, notificationType);
+			continue;
+		}
+
+		//
+		// Don't let one subscriber observe changes made by another.
+		//
+
+		auto copy = *row;
+
+		subscriber.second(&copy, notificationType);
+	}
+}
+
+} // anonymous namespace
+
+NotificationHub::InterfaceSnapshot::InterfaceSnapshot(uint64_t version)
+	: m_version(version)
+	, m_table(nullptr)
+{
+	static auto &reads = shared::performance::CounterRegistry::Instance().counter("winnet.interfaces.snapshot");
+
+	const auto status = GetIpInterfaceTable(AF_UNSPEC, &m_table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Failed to enumerate network interfaces");
+	}
+
+	reads.increment();
+}
+
+NotificationHub::InterfaceSnapshot::~InterfaceSnapshot()
+{
+	FreeMibTable(m_table);
+}
+
+const MIB_IPINTERFACE_ROW *NotificationHub::InterfaceSnapshot::find(NET_LUID luid, ADDRESS_FAMILY family) const
+{
+	for (ULONG i = 0; i < m_table->NumEntries; ++i)
+	{
+		const auto &row = m_table->Table[i];
+
+		if (row.InterfaceLuid.Value == luid.Value && row.Family == family)
+		{
+			return &row;
+		}
+	}
+
+	return nullptr;
+}
+
+NotificationHub::Subscription::Subscription(std::shared_ptr<NotificationHub> hub, Channel channel, uint64_t id)
+	: m_hub(hub)
+	, m_channel(channel)
+	, m_id(id)
+{
+}
+
+NotificationHub::Subscription::~Subscription()
+{
+	m_hub->unsubscribe(m_channel, m_id);
+}
+
+//static
+std::shared_ptr<NotificationHub> NotificationHub::Instance()
+{
+	static std::mutex instanceLock;
+	static std::weak_ptr<NotificationHub> instance;
+
+	std::scoped_lock<std::mutex> lock(instanceLock);
+
+	auto hub = instance.lock();
+
+	if (!hub)
+	{
+		hub = std::shared_ptr<NotificationHub>(new NotificationHub);
+		hub->m_self = hub;
+
+		instance = hub;
+	}
+
+	return hub;
+}
+
+NotificationHub::NotificationHub()
+	: m_nextId(0)
+	, m_interfaceNotificationHandle(nullptr)
+	, m_routeNotificationHandle(nullptr)
+	, m_addressNotificationHandle(nullptr)
+	, m_trackingInterfaces(false)
+	, m_interfaceVersion(0)
+	, m_powerNotificationHandle(nullptr)
+	, m_resuming(false)
+	, m_interfacesChanged(false)
+	, m_routesChanged(false)
+	, m_addressesChanged(false)
+{
+	m_resumeGuard = std::make_unique<common::BurstGuard>(
+		std::bind(&NotificationHub::completeResume, this),
+		RESUME_QUIET_PERIOD_MS,
+		RESUME_SETTLE_LIMIT_MS
+	);
+
+	//
+	// Without power notifications, resume storms are simply dispatched as they arrive.
+	//
+
+	m_powerNotificationParameters.Callback = PowerCallback;
+	m_powerNotificationParameters.Context = this;
+
+	if (ERROR_SUCCESS != PowerRegisterSuspendResumeNotification(DEVICE_NOTIFY_CALLBACK,
+		&m_powerNotificationParameters, &m_powerNotificationHandle))
+	{
+		m_powerNotificationHandle = nullptr;
+	}
+}
+
+NotificationHub::~NotificationHub()
+{
+	//
+	// Subscriptions keep the hub alive, so at most the notification that
+	// tracks interface changes for snapshots is registered at this point.
+	//
+
+	if (nullptr != m_powerNotificationHandle)
+	{
+		PowerUnregisterSuspendResumeNotification(m_powerNotificationHandle);
+	}
+
+	if (nullptr != m_interfaceNotificationHandle)
+	{
+		CancelMibChangeNotify2(m_interfaceNotificationHandle);
+	}
+
+	m_resumeGuard.reset();
+}
+
+std::unique_ptr<NotificationHub::Subscription> NotificationHub::subscribeInterfaceChanges(InterfaceCallback callback)
+{
+	std::scoped_lock<std::mutex> registrationLock(m_registrationLock);
+
+	uint64_t id;
+
+	{
+		std::unique_lock<std::shared_mutex> dispatchLock(m_dispatchLock);
+
+		id = m_nextId++;
+		m_interfaceSubscribers.emplace(id, callback);
+	}
+
+	try
+	{
+		registerInterfaceNotification();
+	}
+	catch (...)
+	{
+		std::unique_lock<std::shared_mutex> dispatchLock(m_dispatchLock);
+		m_interfaceSubscribers.erase(id);
+
+		throw;
+	}
+
+	return std::unique_ptr<Subscription>(new Subscription(m_self.lock(), Subscription::Channel::Interface, id));
+}
+
+std::unique_ptr<NotificationHub::Subscription> NotificationHub::subscribeRouteChanges(RouteCallback callback)
+{
+	std::scoped_lock<std::mutex> registrationLock(m_registrationLock);
+
+	uint64_t id;
+
+	{
+		std::unique_lock<std::shared_mutex> dispatchLock(m_dispatchLock);
+
+		id = m_nextId++;
+		m_routeSubscribers.emplace(id, callback);
+	}
+
+	if (nullptr == m_routeNotificationHandle)
+	{
+		const auto status = NotifyRouteChange2(AF_UNSPEC, RouteChangeCallback, this,
+			FALSE, &m_routeNotificationHandle);
+
+		if (NO_ERROR != status)
+		{
+			m_routeNotificationHandle = nullptr;
+
+			std::unique_lock<std::shared_mutex> dispatchLock(m_dispatchLock);
+			m_routeSubscribers.erase(id);
+
+			THROW_WINDOWS_ERROR(status, "Register for route table change notifications");
+		}
+	}
+
+	return std::unique_ptr<Subscription>(new Subscription(m_self.lock(), Subscription::Channel::Route, id));
+}
+
+std::unique_ptr<NotificationHub::Subscription> NotificationHub::subscribeAddressChanges(AddressCallback callback)
+{
+	std::scoped_lock<std::mutex> registrationLock(m_registrationLock);
+
+	uint64_t id;
+
+	{
+		std::unique_lock<std::shared_mutex> dispatchLock(m_dispatchLock);
+
+		id = m_nextId++;
+		m_addressSubscribers.emplace(id, callback);
+	}
+
+	if (nullptr == m_addressNotificationHandle)
+	{
+		const auto status = NotifyUnicastIpAddressChange(AF_UNSPEC, AddressChangeCallback, this,
+			FALSE, &m_addressNotificationHandle);
+
+		if (NO_ERROR != status)
+		{
+			m_addressNotificationHandle = nullptr;
+
+			std::unique_lock<std::shared_mutex> dispatchLock(m_dispatchLock);
+			m_addressSubscribers.erase(id);
+
+			THROW_WINDOWS_ERROR(status, "Register for unicast address change notifications");
+		}
+	}
+
+	return std::unique_ptr<Subscription>(new Subscription(m_self.lock(), Subscription::Channel::Address, id));
+}
+
+std::shared_ptr<const NotificationHub::InterfaceSnapshot> NotificationHub::interfaceSnapshot()
+{
+	{
+		std::scoped_lock<std::mutex> registrationLock(m_registrationLock);
+
+		if (false == m_trackingInterfaces)
+		{
+			registerInterfaceNotification();
+			m_trackingInterfaces = true;
+		}
+	}
+
+	std::scoped_lock<std::mutex> lock(m_snapshotLock);
+
+	//
+	// Read the version before the table, so a change that happens
+	// while reading invalidates the new snapshot.
+	//
+	const auto version = m_interfaceVersion.load(std::memory_order_acquire);
+
+	if (m_interfaceSnapshot && version == m_interfaceSnapshot->version())
+	{
+		return m_interfaceSnapshot;
+	}
+
+	m_interfaceSnapshot = std::make_shared<const InterfaceSnapshot>(version);
+
+	return m_interfaceSnapshot;
+}
+
+void NotificationHub::registerInterfaceNotification()
+{
+	if (nullptr != m_interfaceNotificationHandle)
+	{
+		return;
+	}
+
+	const auto status = NotifyIpInterfaceChange(AF_UNSPEC, InterfaceChangeCallback, this,
+		FALSE, &m_interfaceNotificationHandle);
+
+	if (NO_ERROR != status)
+	{
+		m_interfaceNotificationHandle = nullptr;
+
+		THROW_WINDOWS_ERROR(status, "Register interface change notification");
+	}
+}
+
+void NotificationHub::unsubscribe(Subscription::Channel channel, uint64_t id)
+{
+	std::scoped_lock<std::mutex> registrationLock(m_registrationLock);
+
+	HANDLE *handle = nullptr;
+
+	{
+		//
+		// Waits for dispatching to complete, so the subscriber is never
+		// called after this point.
+		//
+
+		std::unique_lock<std::shared_mutex> dispatchLock(m_dispatchLock);
+
+		if (Subscription::Channel::Interface == channel)
+		{
+			m_interfaceSubscribers.erase(id);
+
+			if (m_interfaceSubscribers.empty() && false == m_trackingInterfaces)
+			{
+				handle = &m_interfaceNotificationHandle;
+			}
+		}
+		else if (Subscription::Channel::Route == channel)
+		{
+			m_routeSubscribers.erase(id);
+
+			if (m_routeSubscribers.empty())
+			{
+				handle = &m_routeNotificationHandle;
+			}
+		}
+		else
+		{
+			m_addressSubscribers.erase(id);
+
+			if (m_addressSubscribers.empty())
+			{
+				handle = &m_addressNotificationHandle;
+			}
+		}
+	}
+
+	//
+	// Cancel without holding the dispatch lock.
+	// The cancellation waits for callbacks that are in progress.
+	//
+
+	if (nullptr != handle && nullptr != *handle)
+	{
+		CancelMibChangeNotify2(*handle);
+		*handle = nullptr;
+	}
+}
+
+void NotificationHub::resumed()
+{
+	static auto &resumes = shared::performance::CounterRegistry::Instance().counter("winnet.power.resumes");
+
+	resumes.increment();
+
+	{
+		std::scoped_lock<std::mutex> lock(m_resumeLock);
+		m_resuming = true;
+	}
+
+	m_resumeGuard->trigger();
+}
+
+bool NotificationHub::admit(Subscription::Channel channel)
+{
+	static auto &coalesced = shared::performance::CounterRegistry::Instance().counter("winnet.power.coalesced");
+
+	{
+		std::scoped_lock<std::mutex> lock(m_resumeLock);
+
+		if (false == m_resuming)
+		{
+			return true;
+		}
+
+		switch (channel)
+		{
+			case Subscription::Channel::Interface:
+			{
+				m_interfacesChanged = true;
+				break;
+			}
+			case Subscription::Channel::Route:
+			{
+				m_routesChanged = true;
+				break;
+			}
+			default:
+			{
+				m_addressesChanged = true;
+				break;
+			}
+		}
+	}
+
+	coalesced.increment();
+
+	//
+	// Extend the quiet period.
+	//
+	m_resumeGuard->trigger();
+
+	return false;
+}
+
+void NotificationHub::completeResume()
+{
+	bool interfacesChanged;
+	bool routesChanged;
+	bool addressesChanged;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_resumeLock);
+
+		interfacesChanged = m_interfacesChanged;
+		routesChanged = m_routesChanged;
+		addressesChanged = m_addressesChanged;
+
+		m_resuming = false;
+		m_interfacesChanged = false;
+		m_routesChanged = false;
+		m_addressesChanged = false;
+	}
+
+	//
+	// Address and route subscribers may also depend on interface state, so they
+	// are told to resync after the interface subscribers have done so.
+	//
+
+	if (interfacesChanged)
+	{
+		Dispatch(m_dispatchLock, m_interfaceSubscribers, static_cast<MIB_IPINTERFACE_ROW *>(nullptr),
+			MibInitialNotification);
+	}
+
+	if (addressesChanged)
+	{
+		Dispatch(m_dispatchLock, m_addressSubscribers, static_cast<MIB_UNICASTIPADDRESS_ROW *>(nullptr),
+			MibInitialNotification);
+	}
+
+	if (routesChanged)
+	{
+		Dispatch(m_dispatchLock, m_routeSubscribers, static_cast<MIB_IPFORWARD_ROW2 *>(nullptr),
+			MibInitialNotification);
+	}
+}
+
+//static
+void NETIOAPI_API_ NotificationHub::InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *row,
+	MIB_NOTIFICATION_TYPE notificationType)
+{
+	auto hub = reinterpret_cast<NotificationHub *>(context);
+
+	hub->m_interfaceVersion.fetch_add(1, std::memory_order_acq_rel);
+
+	if (false == hub->admit(Subscription::Channel::Interface))
+	{
+		return;
+	}
+
+	Dispatch(hub->m_dispatchLock, hub->m_interfaceSubscribers, row, notificationType);
+}
+
+//static
+void NETIOAPI_API_ NotificationHub::RouteChangeCallback(void *context, MIB_IPFORWARD_ROW2 *row,
+	MIB_NOTIFICATION_TYPE notificationType)
+{
+	auto hub = reinterpret_cast<NotificationHub *>(context);
+
+	if (false == hub->admit(Subscription::Channel::Route))
+	{
+		return;
+	}
+
+	Dispatch(hub->m_dispatchLock, hub->m_routeSubscribers, row, notificationType);
+}
+
+//static
+void NETIOAPI_API_ NotificationHub::AddressChangeCallback(void *context, MIB_UNICASTIPADDRESS_ROW *row,
+	MIB_NOTIFICATION_TYPE notificationType)
+{
+	auto hub = reinterpret_cast<NotificationHub *>(context);
+
+	if (false == hub->admit(Subscription::Channel::Address))
+	{
+		return;
+	}
+
+	Dispatch(hub->m_dispatchLock, hub->m_addressSubscribers, row, notificationType);
+}
+
+//static
+ULONG CALLBACK NotificationHub::PowerCallback(void *context, ULONG type, void *)
+{
+	//
+	// A resume that was triggered by the user is also preceded by an automatic resume.
+	//
+
+	if (PBT_APMRESUMEAUTOMATIC == type)
+	{
+		reinterpret_cast<NotificationHub *>(context)->resumed();
+	}
+
+	return ERROR_SUCCESS;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <windows.h>
+#include <powrprof.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <libcommon/burstguard.h>
+
+//
+// Owns the IP Helper notification subscriptions for the module.
+//
+// Each kind of OS subscription is registered once, when the first
+// subscriber arrives, and is cancelled when the last one leaves.
+// A single OS event is then fanned out to all subscribers.
+//
+// The hub also shares a snapshot of the interface table between callers,
+// which is only read again after an interface change.
+//
+// After the system resumes from sleep, adapters tend to come back all at once.
+// Rather than passing each event of that storm on, the hub holds notifications
+// back until they have settled, and then has every subscriber of a channel that
+// changed resync once, by sending it a null row.
+//
+class NotificationHub
+{
+public:
+
+	//
+	// Immutable copy of the IP interface table, for both families.
+	//
+	class InterfaceSnapshot
+	{
+	public:
+
+		// Reads the interface table.
+		explicit InterfaceSnapshot(uint64_t version);
+		~InterfaceSnapshot();
+
+		InterfaceSnapshot(const InterfaceSnapshot &) = delete;
+		InterfaceSnapshot &operator=(const InterfaceSnapshot &) = delete;
+
+		//
+		// Interface changes that had been notified when the table was read.
+		//
+		uint64_t version() const
+		{
+			return m_version;
+		}
+
+		const MIB_IPINTERFACE_TABLE &table() const
+		{
+			return *m_table;
+		}
+
+		//
+		// Returns nullptr if the interface doesn't exist for the family.
+		//
+		const MIB_IPINTERFACE_ROW *find(NET_LUID luid, ADDRESS_FAMILY family) const;
+
+	private:
+
+		uint64_t m_version;
+		PMIB_IPINTERFACE_TABLE m_table;
+	};
+
+	//
+	// Subscribers get their own copy of the row, or nullptr if the OS did not
+	// provide one. A null row means the table should be read again.
+	//
+	using InterfaceCallback = std::function<void(MIB_IPINTERFACE_ROW *row, MIB_NOTIFICATION_TYPE notificationType)>;
+	using RouteCallback = std::function<void(MIB_IPFORWARD_ROW2 *row, MIB_NOTIFICATION_TYPE notificationType)>;
+	using AddressCallback = std::function<void(MIB_UNICASTIPADDRESS_ROW *row, MIB_NOTIFICATION_TYPE notificationType)>;
+
+	class Subscription
+	{
+	public:
+
+		//
+		// Returns once any callback that is in progress for this subscription
+		// has completed. Must not be destroyed from within its own callback.
+		//
+		~Subscription();
+
+		Subscription(const Subscription &) = delete;
+		Subscription &operator=(const Subscription &) = delete;
+
+	private:
+
+		friend class NotificationHub;
+
+		enum class Channel
+		{
+			Interface,
+			Route,
+			Address,
+		};
+
+		Subscription(std::shared_ptr<NotificationHub> hub, Channel channel, uint64_t id);
+
+		std::shared_ptr<NotificationHub> m_hub;
+		Channel m_channel;
+		uint64_t m_id;
+	};
+
+	//
+	// The hub is shared while there are references to it.
+	//
+	static std::shared_ptr<NotificationHub> Instance();
+
+	~NotificationHub();
+
+	NotificationHub(const NotificationHub &) = delete;
+	NotificationHub &operator=(const NotificationHub &) = delete;
+
+	std::unique_ptr<Subscription> subscribeInterfaceChanges(InterfaceCallback callback);
+	std::unique_ptr<Subscription> subscribeRouteChanges(RouteCallback callback);
+
+	//
+	// Changes to unicast addresses, including changes of DAD state.
+	//
+	std::unique_ptr<Subscription> subscribeAddressChanges(AddressCallback callback);
+
+	//
+	// Interface table shared by all callers until an interface is added, removed or
+	// changes parameters. The first call starts tracking interface changes for as long
+	// as the hub exists, so keep a reference to the hub to benefit from sharing.
+	//
+	// Changes made by the caller are reflected once they have been notified.
+	//
+	std::shared_ptr<const InterfaceSnapshot> interfaceSnapshot();
+
+private:
+
+	NotificationHub();
+
+	std::weak_ptr<NotificationHub> m_self;
+
+	//
+	// Serializes OS registration changes.
+	//
+	std::mutex m_registrationLock;
+
+	//
+	// Held shared while dispatching, and exclusively while changing subscribers.
+	//
+	std::shared_mutex m_dispatchLock;
+
+	uint64_t m_nextId;
+
+	std::map<uint64_t, InterfaceCallback> m_interfaceSubscribers;
+	std::map<uint64_t, RouteCallback> m_routeSubscribers;
+	std::map<uint64_t, AddressCallback> m_addressSubscribers;
+
+	HANDLE m_interfaceNotificationHandle;
+	HANDLE m_routeNotificationHandle;
+	HANDLE m_addressNotificationHandle;
+
+	//
+	// Interface notifications stay registered once a snapshot has been requested.
+	// Guarded by the registration lock.
+	//
+	bool m_trackingInterfaces;
+
+	std::atomic<uint64_t> m_interfaceVersion;
+
+	std::mutex m_snapshotLock;
+	std::shared_ptr<const InterfaceSnapshot> m_interfaceSnapshot;
+
+	DEVICE_NOTIFY_SUBSCRIBE_PARAMETERS m_powerNotificationParameters;
+	HPOWERNOTIFY m_powerNotificationHandle;
+
+	//
+	// Set from when the system resumes until notifications have settled.
+	// Notifications that arrive in between are only recorded.
+	//
+	std::mutex m_resumeLock;
+	bool m_resuming;
+	bool m_interfacesChanged;
+	bool m_routesChanged;
+	bool m_addressesChanged;
+
+	std::unique_ptr<common::BurstGuard> m_resumeGuard;
+
+	void resumed();
+
+	// Returns true if the notification should be dispatched.
+	bool admit(Subscription::Channel channel);
+
+	void completeResume();
+
+	// Call with the registration lock held.
+	void registerInterfaceNotification();
+
+	void unsubscribe(Subscription::Channel channel, uint64_t id);
+
+	static void NETIOAPI_API_ InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *row,
+		MIB_NOTIFICATION_TYPE notificationType);
+	static void NETIOAPI_API_ RouteChangeCallback(void *context, MIB_IPFORWARD_ROW2 *row,
+		MIB_NOTIFICATION_TYPE notificationType);
+	static void NETIOAPI_API_ AddressChangeCallback(void *context, MIB_UNICASTIPADDRESS_ROW *row,
+		MIB_NOTIFICATION_TYPE notificationType);
+
+	static ULONG CALLBACK PowerCallback(void *context, ULONG type, void *setting);
+};
@@ -3,22 +3,133 @@
 #include <libcommon/error.h>
 #include <libcommon/memory.h>
 #include <libcommon/string.h>
+#include <libshared/logging/lazylog.h>
+#include <libshared/tracing/trace.h>
+#include <algorithm>
 #include <sstream>
 
+namespace
+{
 
-using namespace std::placeholders; // for _1, _2 etc.
+//
+// How long to wait for the gateway to reply.
+//
+const std::chrono::milliseconds PROBE_TIMEOUT(1000);
+
+//
+// Failures are retried quickly, so a dead network is reported within
+// a few seconds rather than after several probe intervals.
+//
+const std::chrono::milliseconds PROBE_RETRY_DELAY(1000);
+const size_t PROBE_FAILURE_THRESHOLD = 3;
+
+//
+// Once degraded, the probe interval is doubled for every further failure,
+// up to this factor.
+//
+const size_t PROBE_MAX_BACKOFF_SHIFT = 3;
+
+std::chrono::milliseconds ProbeDelay(std::chrono::milliseconds interval, size_t failures)
+{
+	if (0 == failures)
+	{
+		return interval;
+	}
 
-namespace
+	if (failures < PROBE_FAILURE_THRESHOLD)
+	{
+		return std::min(interval, PROBE_RETRY_DELAY);
+	}
+
+	const auto shift = std::min(failures - PROBE_FAILURE_THRESHOLD, PROBE_MAX_BACKOFF_SHIFT);
+
+	return interval * (1ull << shift);
+}
+
+const char *ConnectivityName(OfflineMonitor::Connectivity connectivity)
 {
+	switch (connectivity)
+	{
+		case OfflineMonitor::Connectivity::Offline: return "offline";
+		case OfflineMonitor::Connectivity::Degraded: return "degraded";
+		case OfflineMonitor::Connectivity::Online: return "online";
+		default: return "unknown";
+	}
+}
 
-bool IsConnectedAdapter(const MIB_IF_ROW2 &iface)
+//
+// Adapter properties relevant to the offline decision and offline logging.
+//
+enum AdapterClass : uint32_t
 {
+	ADAPTER_CLASS_LOOPBACK_OR_TUNNEL = 1 << 0,
+	ADAPTER_CLASS_VIRTUAL = 1 << 1,
+	ADAPTER_CLASS_FILTER = 1 << 2,
+	ADAPTER_CLASS_NO_PHYSICAL_ADDRESS = 1 << 3,
+	ADAPTER_CLASS_ENDPOINT = 1 << 4,
+	ADAPTER_CLASS_OPER_UP = 1 << 5,
+	ADAPTER_CLASS_MEDIA_CONNECTED = 1 << 6,
+
+	// Excluded from detailed logging.
+	ADAPTER_CLASS_NOISY = 1 << 7,
+};
+
+const uint32_t ADAPTER_CLASS_CONNECTED_MASK = ADAPTER_CLASS_LOOPBACK_OR_TUNNEL
+	| ADAPTER_CLASS_VIRTUAL
+	| ADAPTER_CLASS_FILTER
+	| ADAPTER_CLASS_NO_PHYSICAL_ADDRESS
+	| ADAPTER_CLASS_ENDPOINT
+	| ADAPTER_CLASS_OPER_UP
+	| ADAPTER_CLASS_MEDIA_CONNECTED;
+
+const uint32_t ADAPTER_CLASS_CONNECTED = ADAPTER_CLASS_OPER_UP | ADAPTER_CLASS_MEDIA_CONNECTED;
+
+//
+// Don't flood the log with garbage.
+//
+const wchar_t *NOISY_ADAPTER_DESCRIPTIONS[] =
+{
+	L"WFP Native MAC Layer LightWeight Filter",
+	L"QoS Packet Scheduler",
+	L"WFP 802.3 MAC Layer LightWeight Filter",
+	L"Microsoft Kernel Debug Network Adapter",
+	L"Software Loopback Interface",
+	L"Microsoft Teredo Tunneling Adapter",
+	L"Microsoft IP-HTTPS Platform Adapter",
+	L"Microsoft 6to4 Adapter",
+	L"WAN Miniport",
+	L"WiFi Filter Driver",
+	L"Microsoft Wi-Fi Direct Virtual Adapter",
+};
+
+bool IsNoisyAdapter(const MIB_IF_ROW2 &iface)
+{
+	for (const auto description : NOISY_ADAPTER_DESCRIPTIONS)
+	{
+		if (nullptr != wcsstr(iface.Description, description))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//
+// Flags that change with the adapter state.
+// The description is fixed for the lifetime of the adapter, so is classified separately.
+//
+uint32_t ClassifyAdapterState(const MIB_IF_ROW2 &iface)
+{
+	uint32_t adapterClass = 0;
+
 	switch (iface.InterfaceLuid.Info.IfType)
 	{
 		case IF_TYPE_SOFTWARE_LOOPBACK:
 		case IF_TYPE_TUNNEL:
 		{
-			return false;
+			adapterClass |= ADAPTER_CLASS_LOOPBACK_OR_TUNNEL;
+			break;
 		}
 	}
 
@@ -37,7 +148,7 @@ bool IsConnectedAdapter(const MIB_IF_ROW2 &iface)
 	if (FALSE == iface.InterfaceAndOperStatusFlags.HardwareInterface
 		&& FALSE == iface.InterfaceAndOperStatusFlags.ConnectorPresent)
 	{
-		return false;
+		adapterClass |= ADAPTER_CLASS_VIRTUAL;
 	}
 
 	//
@@ -45,18 +156,32 @@ bool IsConnectedAdapter(const MIB_IF_ROW2 &iface)
 	// would be a good thing?
 	//
 
-	if (FALSE != iface.InterfaceAndOperStatusFlags.FilterInterface
-		|| 0 == iface.PhysicalAddressLength
-		|| FALSE != iface.InterfaceAndOperStatusFlags.EndPointInterface)
+	if (FALSE != iface.InterfaceAndOperStatusFlags.FilterInterface)
+	{
+		adapterClass |= ADAPTER_CLASS_FILTER;
+	}
+
+	if (0 == iface.PhysicalAddressLength)
 	{
-		return false;
+		adapterClass |= ADAPTER_CLASS_NO_PHYSICAL_ADDRESS;
 	}
 
-	return
-	(
-		IfOperStatusUp == iface.OperStatus
-		&& MediaConnectStateConnected == iface.MediaConnectState
-	);
+	if (FALSE != iface.InterfaceAndOperStatusFlags.EndPointInterface)
+	{
+		adapterClass |= ADAPTER_CLASS_ENDPOINT;
+	}
+
+	if (IfOperStatusUp == iface.OperStatus)
+	{
+		adapterClass |= ADAPTER_CLASS_OPER_UP;
+	}
+
+	if (MediaConnectStateConnected == iface.MediaConnectState)
+	{
+		adapterClass |= ADAPTER_CLASS_MEDIA_CONNECTED;
+	}
+
+	return adapterClass;
 }
 
 } // anonymous namespace
@@ -66,46 +191,355 @@ OfflineMonitor::OfflineMonitor
 (
 	std::shared_ptr<common::logging::ILogSink> logSink,
 	Notifier notifier,
+	uint32_t offlineConfirmationDelay,
+	uint32_t probeInterval,
+	std::shared_ptr<IConnectivityProbe> probe,
 	std::shared_ptr<NetworkAdapterMonitor::IDataProvider> dataProvider
 )
 	: m_logSink(logSink)
 	, m_notifier(notifier)
 	, m_connected(false)
+	, m_reported(Connectivity::Offline)
+	, m_offlineConfirmationDelay(offlineConfirmationDelay)
+	, m_probeInterval(probeInterval)
+	, m_probe(probe)
+	, m_probeFailures(0)
+	, m_probeGeneration(0)
+	, m_shutdown(false)
+	, m_executor("OfflineMonitor", m_logSink)
 	, m_netAdapterMonitor(
 		m_logSink,
-		std::bind(&OfflineMonitor::callback, this, _1, _2, _3),
-		IsConnectedAdapter,
+		NetworkAdapterMonitor::DeltaSinkType([this](const NetworkAdapterMonitor::Delta &delta, NetworkAdapterMonitor &)
+		{
+			callback(delta);
+		}),
+		[this](const MIB_IF_ROW2 &iface)
+		{
+			return isConnectedAdapter(iface);
+		},
 		dataProvider
 	)
 {
+	if (0 != m_probeInterval.count() && nullptr == m_probe)
+	{
+		THROW_ERROR("A connectivity probe is required when probing is enabled");
+	}
+
+	if (0 != m_offlineConfirmationDelay.count())
+	{
+		m_confirmationThread = std::thread(&OfflineMonitor::confirmationThread, this);
+	}
+
+	if (0 != m_probeInterval.count())
+	{
+		m_probeThread = std::thread(&OfflineMonitor::probeThread, this);
+	}
 }
 
 
 OfflineMonitor::OfflineMonitor
 (
 	std::shared_ptr<common::logging::ILogSink> logSink,
-	Notifier notifier
-) : OfflineMonitor(logSink, notifier, std::make_shared<NetworkAdapterMonitor::SystemDataProvider>())
+	Notifier notifier,
+	uint32_t offlineConfirmationDelay,
+	uint32_t probeInterval
+) : OfflineMonitor(logSink, notifier, offlineConfirmationDelay, probeInterval,
+	std::make_shared<GatewayProbe>(PROBE_TIMEOUT), std::make_shared<NetworkAdapterMonitor::SystemDataProvider>())
 {
 }
 
 
-void OfflineMonitor::callback(const std::vector<MIB_IF_ROW2> &adapters, const MIB_IF_ROW2 *, NetworkAdapterMonitor::UpdateType)
+OfflineMonitor::~OfflineMonitor()
 {
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		m_shutdown = true;
+	}
+
+	m_cv.notify_all();
+
+	if (m_confirmationThread.joinable())
+	{
+		m_confirmationThread.join();
+	}
+
+	if (m_probeThread.joinable())
+	{
+		m_probeThread.join();
+	}
+}
+
+
+void OfflineMonitor::callback(const NetworkAdapterMonitor::Delta &delta)
+{
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordMonitor);
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&stopwatch]()
+	{
+		shared::tracing::MonitorCallback(stopwatch, "OfflineMonitor");
+	};
+
+	if (NetworkAdapterMonitor::UpdateType::Delete == delta.updateType && delta.luid.has_value())
+	{
+		//
+		// Also raised when the adapter is merely disqualified.
+		// If so, it's classified again on its next change.
+		//
+
+		std::scoped_lock<std::mutex> classesLock(m_adapterClassesLock);
+		m_adapterClasses.erase(delta.luid->Value);
+	}
+
+	std::scoped_lock<std::mutex> lock(m_lock);
+
 	const auto previousConnectivity = m_connected;
-	m_connected = !adapters.empty();
+	m_connected = 0 != delta.adapterCount;
+
+	//
+	// Any adapter change may have replaced the default route,
+	// so probe the new gateway right away.
+	//
+
+	++m_probeGeneration;
+	m_probeFailures = 0;
+	m_probeDeadline.reset();
+
+	if (m_connected && 0 != m_probeInterval.count())
+	{
+		m_probeDeadline = std::chrono::steady_clock::now();
+		m_cv.notify_all();
+	}
+
+	if (previousConnectivity == m_connected)
+	{
+		return;
+	}
+
+	if (m_connected)
+	{
+		//
+		// Cancel pending offline notification, if any.
+		//
+
+		m_offlineDeadline.reset();
+
+		if (Connectivity::Offline == m_reported)
+		{
+			report(Connectivity::Online);
+		}
+
+		return;
+	}
+
+	if (0 == m_offlineConfirmationDelay.count() || m_shutdown)
+	{
+		report(Connectivity::Offline);
+		return;
+	}
+
+	m_offlineDeadline = std::chrono::steady_clock::now() + m_offlineConfirmationDelay;
+	m_cv.notify_all();
+}
+
+OfflineMonitor::Connectivity OfflineMonitor::connectivity()
+{
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	if (false == m_connected)
+	{
+		return Connectivity::Offline;
+	}
+
+	return (Connectivity::Degraded == m_reported ? Connectivity::Degraded : Connectivity::Online);
+}
+
+//static
+OfflineMonitor::Connectivity OfflineMonitor::QueryConnectivity()
+{
+	PMIB_IF_TABLE2 table;
+
+	const auto status = GetIfTable2(&table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Enumerate network adapters");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [table]()
+	{
+		FreeMibTable(table);
+	};
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto adapterClass = ClassifyAdapterState(table->Table[i]);
+
+		if (ADAPTER_CLASS_CONNECTED == (adapterClass & ADAPTER_CLASS_CONNECTED_MASK))
+		{
+			return Connectivity::Online;
+		}
+	}
+
+	return Connectivity::Offline;
+}
+
+bool OfflineMonitor::isConnectedAdapter(const MIB_IF_ROW2 &iface)
+{
+	std::scoped_lock<std::mutex> lock(m_adapterClassesLock);
+
+	const auto cached = m_adapterClasses.find(iface.InterfaceLuid.Value);
+
+	const auto noisy = (m_adapterClasses.end() != cached
+		? cached->second & ADAPTER_CLASS_NOISY
+		: (IsNoisyAdapter(iface) ? ADAPTER_CLASS_NOISY : 0));
+
+	const auto adapterClass = ClassifyAdapterState(iface) | noisy;
+
+	m_adapterClasses[iface.InterfaceLuid.Value] = adapterClass;
+
+	return ADAPTER_CLASS_CONNECTED == (adapterClass & ADAPTER_CLASS_CONNECTED_MASK);
+}
+
+void OfflineMonitor::report(Connectivity connectivity)
+{
+	m_reported = connectivity;
 
-	if (previousConnectivity != m_connected)
+	m_executor.post([this, connectivity]()
 	{
-		m_notifier(m_connected);
+		m_notifier(connectivity);
 
-		if (false == m_connected)
+		if (Connectivity::Offline == connectivity)
 		{
 			LogOfflineState();
 		}
+	});
+}
+
+void OfflineMonitor::confirmationThread()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (false == m_shutdown)
+	{
+		if (false == m_offlineDeadline.has_value())
+		{
+			m_cv.wait(lock);
+			continue;
+		}
+
+		const auto deadline = m_offlineDeadline.value();
+
+		if (std::chrono::steady_clock::now() < deadline)
+		{
+			m_cv.wait_until(lock, deadline);
+			continue;
+		}
+
+		//
+		// Still offline after the confirmation delay.
+		//
+
+		m_offlineDeadline.reset();
+
+		if (Connectivity::Offline != m_reported)
+		{
+			report(Connectivity::Offline);
+		}
 	}
 }
 
+void OfflineMonitor::probeThread()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (false == m_shutdown)
+	{
+		if (false == m_probeDeadline.has_value())
+		{
+			m_cv.wait(lock);
+			continue;
+		}
+
+		const auto deadline = m_probeDeadline.value();
+
+		if (std::chrono::steady_clock::now() < deadline)
+		{
+			m_cv.wait_until(lock, deadline);
+			continue;
+		}
+
+		m_probeDeadline.reset();
+
+		const auto generation = m_probeGeneration;
+
+		//
+		// The probe blocks for up to its timeout, so must not hold the lock.
+		//
+
+		lock.unlock();
+
+		bool reachable = false;
+
+		try
+		{
+			reachable = m_probe->probe();
+		}
+		catch (const std::exception &err)
+		{
+			const auto msg = std::string("Connectivity probe failed: ").append(err.what());
+			m_logSink->error(msg.c_str());
+		}
+		catch (...)
+		{
+			m_logSink->error("Unspecified failure in connectivity probe");
+		}
+
+		lock.lock();
+
+		if (generation != m_probeGeneration || false == m_connected)
+		{
+			continue;
+		}
+
+		processProbeResult(reachable);
+	}
+}
+
+void OfflineMonitor::processProbeResult(bool reachable)
+{
+	m_probeFailures = (reachable ? 0 : m_probeFailures + 1);
+	m_probeDeadline = std::chrono::steady_clock::now() + ProbeDelay(m_probeInterval, m_probeFailures);
+
+	//
+	// Only degrade from online. If an offline notification is pending, it is reported when due.
+	//
+
+	auto connectivity = m_reported;
+
+	if (reachable && Connectivity::Degraded == m_reported)
+	{
+		connectivity = Connectivity::Online;
+	}
+	else if (m_probeFailures >= PROBE_FAILURE_THRESHOLD && Connectivity::Online == m_reported)
+	{
+		connectivity = Connectivity::Degraded;
+	}
+
+	if (connectivity == m_reported)
+	{
+		return;
+	}
+
+	const auto msg = std::string("Default gateway probe changed connectivity to ").append(ConnectivityName(connectivity));
+	m_logSink->info(msg.c_str());
+
+	report(connectivity);
+}
+
 void OfflineMonitor::LogOfflineState()
 {
 	//
@@ -117,6 +551,16 @@ void OfflineMonitor::LogOfflineState()
 
 	m_logSink->info("Machine is offline");
 
+	//
+	// Skip enumerating and formatting every interface if the listing
+	// would be discarded anyway.
+	//
+
+	if (false == shared::logging::IsEnabled(*m_logSink, common::logging::LogLevel::Info))
+	{
+		return;
+	}
+
 	MIB_IF_TABLE2 *table;
 
 	const auto status = GetIfTable2(&table);
@@ -136,40 +580,29 @@ void OfflineMonitor::LogOfflineState()
 
 	m_logSink->info("Begin detailed listing of network interfaces");
 
+	std::unordered_map<ULONG64, uint32_t> adapterClasses;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_adapterClassesLock);
+		adapterClasses = m_adapterClasses;
+	}
+
 	for (ULONG i = 0; i < table->NumEntries; ++i)
 	{
 		const auto &iface = table->Table[i];
 
 		//
-		// Don't flood the log with garbage.
+		// Adapters without an enabled IP interface are not tracked by the
+		// adapter monitor, and are classified here instead.
 		//
-		const auto blacklist = std::vector<std::wstring>
-		{
-			L"WFP Native MAC Layer LightWeight Filter",
-			L"QoS Packet Scheduler",
-			L"WFP 802.3 MAC Layer LightWeight Filter",
-			L"Microsoft Kernel Debug Network Adapter",
-			L"Software Loopback Interface",
-			L"Microsoft Teredo Tunneling Adapter",
-			L"Microsoft IP-HTTPS Platform Adapter",
-			L"Microsoft 6to4 Adapter",
-			L"WAN Miniport",
-			L"WiFi Filter Driver",
-			L"Microsoft Wi-Fi Direct Virtual Adapter",
-		};
 
-		bool blacklisted = false;
+		const auto cached = adapterClasses.find(iface.InterfaceLuid.Value);
 
-		for (const auto &black : blacklist)
-		{
-			if (nullptr != wcsstr(iface.Description, black.c_str()))
-			{
-				blacklisted = true;
-				break;
-			}
-		}
+		const auto noisy = (adapterClasses.end() != cached
+			? 0 != (cached->second & ADAPTER_CLASS_NOISY)
+			: IsNoisyAdapter(iface));
 
-		if (blacklisted)
+		if (noisy)
 		{
 			continue;
 		}
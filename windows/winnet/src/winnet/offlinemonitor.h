@@ -2,34 +2,134 @@
 
 #include <libcommon/logging/ilogsink.h>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <cstdint>
+#include <unordered_map>
+#include "connectivityprobe.h"
 #include "networkadaptermonitor.h"
+#include "serialexecutor.h"
 
 class OfflineMonitor
 {
 public:
 
+	enum class Connectivity
+	{
+		// No connected adapter.
+		Offline,
+
+		// An adapter is connected, but the default gateway does not respond.
+		Degraded,
+
+		Online,
+	};
+
 	//
 	// Connectivity changed.
-	// true = connected, false = disconnected.
 	//
-	using Notifier = std::function<void(bool)>;
+	using Notifier = std::function<void(Connectivity)>;
 
+	//
+	// Going offline is only reported once the machine has remained offline for
+	// 'offlineConfirmationDelay' ms. Regaining connectivity is reported immediately,
+	// unless the preceding offline state was never reported.
+	//
+	// A delay of 0 reports every transition as it happens.
+	//
+	// If 'probeInterval' is non-zero, 'probe' is run that often while an adapter
+	// is connected. Consecutive failures are reported as degraded connectivity,
+	// and probing backs off until the probe succeeds again. Otherwise, degraded
+	// connectivity is never reported.
+	//
 	OfflineMonitor(
 		std::shared_ptr<common::logging::ILogSink> logSink,
 		Notifier notifier,
+		uint32_t offlineConfirmationDelay,
+		uint32_t probeInterval,
+		std::shared_ptr<IConnectivityProbe> probe,
 		std::shared_ptr<NetworkAdapterMonitor::IDataProvider> dataProvider
 	);
-	OfflineMonitor(std::shared_ptr<common::logging::ILogSink> logSink, Notifier notifier);
+	OfflineMonitor(
+		std::shared_ptr<common::logging::ILogSink> logSink,
+		Notifier notifier,
+		uint32_t offlineConfirmationDelay,
+		uint32_t probeInterval
+	);
+
+	~OfflineMonitor();
+
+	OfflineMonitor(const OfflineMonitor &) = delete;
+	OfflineMonitor &operator=(const OfflineMonitor &) = delete;
+
+	//
+	// Current connectivity, without the offline confirmation delay.
+	// Degraded is only returned while probing.
+	//
+	Connectivity connectivity();
+
+	//
+	// Enumerate adapters once and classify them as a monitor would.
+	// Never returns degraded, since no probe is sent.
+	//
+	static Connectivity QueryConnectivity();
 
 private:
 
 	std::shared_ptr<common::logging::ILogSink> m_logSink;
 	Notifier m_notifier;
 
+	// Connectivity according to the adapter monitor.
 	bool m_connected;
+
+	// Connectivity according to the last notification.
+	Connectivity m_reported;
+
+	const std::chrono::milliseconds m_offlineConfirmationDelay;
+	std::optional<std::chrono::steady_clock::time_point> m_offlineDeadline;
+
+	const std::chrono::milliseconds m_probeInterval;
+	std::shared_ptr<IConnectivityProbe> m_probe;
+	std::optional<std::chrono::steady_clock::time_point> m_probeDeadline;
+	size_t m_probeFailures;
+
+	// Incremented on adapter changes, so results from an earlier network are discarded.
+	uint64_t m_probeGeneration;
+
+	bool m_shutdown;
+	std::mutex m_lock;
+	std::condition_variable m_cv;
+	std::thread m_confirmationThread;
+	std::thread m_probeThread;
+
+	//
+	// Classification of every adapter that has been run past the filter, as a bitmask.
+	// Updated on each adapter change, so offline logging can skip adapters without
+	// evaluating their descriptions again.
+	//
+	std::mutex m_adapterClassesLock;
+	std::unordered_map<ULONG64, uint32_t> m_adapterClasses;
+
+	//
+	// Runs the notifier and detailed logging, so neither blocks the
+	// notification thread. Declared ahead of the adapter monitor, so
+	// it outlives the monitor's callbacks.
+	//
+	SerialExecutor m_executor;
+
 	NetworkAdapterMonitor m_netAdapterMonitor;
 
+	bool isConnectedAdapter(const MIB_IF_ROW2 &iface);
+
 	void LogOfflineState();
 
-	void callback(const std::vector<MIB_IF_ROW2> &adapters, const MIB_IF_ROW2 *adapter, NetworkAdapterMonitor::UpdateType type);
+	void report(Connectivity connectivity);
+	void confirmationThread();
+
+	void probeThread();
+	void processProbeResult(bool reachable);
+
+	void callback(const NetworkAdapterMonitor::Delta &delta);
 };
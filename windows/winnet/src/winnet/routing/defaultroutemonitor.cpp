@@ -2,6 +2,9 @@
 #include <libcommon/error.h>
 #include "defaultroutemonitor.h"
 #include "helpers.h"
+#include <libshared/logging/ratelimiter.h>
+#include <libshared/performance/counterregistry.h>
+#include <algorithm>
 
 namespace winnet::routing
 {
@@ -12,46 +15,67 @@ namespace
 const uint32_t POINT_TWO_SECOND_BURST = 200;
 const uint32_t TWO_SECOND_INTERFERENCE = 2000;
 
-} // anonymous namespace
+//
+// The window is stretched by this factor during storms, if the maximum latency allows.
+//
+const uint32_t STORM_STRETCH_FACTOR = 4;
 
-DefaultRouteMonitor::DefaultRouteMonitor
-(
-	ADDRESS_FAMILY family,
-	Callback callback,
-	std::shared_ptr<common::logging::ILogSink> logSink
-)
-	: m_family(family)
-	, m_callback(callback)
-	, m_logSink(logSink)
-	, m_evaluateRoutesGuard(std::make_unique<common::BurstGuard>(
-		std::bind(&DefaultRouteMonitor::evaluateRoutes, this),
-		POINT_TWO_SECOND_BURST,
-		TWO_SECOND_INTERFERENCE
-	))
+bool SameRoute(const MIB_IPFORWARD_ROW2 &lhs, const MIB_IPFORWARD_ROW2 &rhs)
+{
+	return lhs.InterfaceLuid.Value == rhs.InterfaceLuid.Value
+		&& EqualAddress(lhs.NextHop, rhs.NextHop);
+}
+
+std::optional<InterfaceAndGateway> InitialBestRoute(ADDRESS_FAMILY family)
 {
 	try
 	{
-		m_bestRoute = GetBestDefaultRoute(m_family);
+		return GetBestDefaultRoute(family);
 	}
 	catch (...)
 	{
+		return std::nullopt;
 	}
+}
 
-	auto status = NotifyRouteChange2(AF_UNSPEC, RouteChangeCallback, this, FALSE, &m_routeNotificationHandle);
+} // anonymous namespace
 
-	if (NO_ERROR != status)
-	{
-		THROW_WINDOWS_ERROR(status, "Register for route table change notifications");
-	}
+//static
+const DefaultRouteMonitor::CoalescingSettings DefaultRouteMonitor::DefaultCoalescing =
+{
+	POINT_TWO_SECOND_BURST,
+	TWO_SECOND_INTERFERENCE
+};
 
-	status = NotifyIpInterfaceChange(AF_UNSPEC, InterfaceChangeCallback, this,
-		FALSE, &m_interfaceNotificationHandle);
+DefaultRouteMonitor::DefaultRouteMonitor
+(
+	Callback callback,
+	std::shared_ptr<common::logging::ILogSink> logSink,
+	const CoalescingSettings &coalescing
+)
+	: m_callback(callback)
+	, m_logSink(logSink)
+	, m_evaluateRoutesGuard(createGuard(coalescing.window, coalescing.maxLatency))
+	, m_stormGuard(createGuard(StormWindow(coalescing), coalescing.maxLatency))
+	, m_window(coalescing.window)
+	, m_stormWindow(StormWindow(coalescing))
+	, m_meanInterval(std::chrono::milliseconds(coalescing.maxLatency))
+	, m_storm(false)
+	, m_burstStart(0)
+	, m_stateV4{ static_cast<ADDRESS_FAMILY>(AF_INET), InitialBestRoute(AF_INET), {}, true }
+	, m_stateV6{ static_cast<ADDRESS_FAMILY>(AF_INET6), InitialBestRoute(AF_INET6), {}, true }
+{
+	auto hub = NotificationHub::Instance();
 
-	if (NO_ERROR != status)
+	m_routeSubscription = hub->subscribeRouteChanges([this](MIB_IPFORWARD_ROW2 *row, MIB_NOTIFICATION_TYPE notificationType)
 	{
-		CancelMibChangeNotify2(m_routeNotificationHandle);
-		THROW_WINDOWS_ERROR(status, "Register for network interface change notifications");
-	}
+		RouteChangeCallback(this, row, notificationType);
+	});
+
+	m_interfaceSubscription = hub->subscribeInterfaceChanges([this](MIB_IPINTERFACE_ROW *row, MIB_NOTIFICATION_TYPE notificationType)
+	{
+		InterfaceChangeCallback(this, row, notificationType);
+	});
 }
 
 DefaultRouteMonitor::~DefaultRouteMonitor()
@@ -60,15 +84,50 @@ DefaultRouteMonitor::~DefaultRouteMonitor()
 	// Cancel notifications to stop triggering the BurstGuard.
 	//
 
-	CancelMibChangeNotify2(m_interfaceNotificationHandle);
-	CancelMibChangeNotify2(m_routeNotificationHandle);
+	m_interfaceSubscription.reset();
+	m_routeSubscription.reset();
 
 	//
 	// Controlled destruction of BurstGuard to prevent it from calling here
 	// after other member variables have been destructed.
 	//
 
+	std::scoped_lock<std::mutex> lock(m_evaluateRoutesGuardLock);
+
 	m_evaluateRoutesGuard.reset();
+	m_stormGuard.reset();
+}
+
+void DefaultRouteMonitor::setCoalescing(const CoalescingSettings &coalescing)
+{
+	if (0 == coalescing.window || coalescing.maxLatency < coalescing.window)
+	{
+		THROW_ERROR("Invalid coalescing settings for default route monitor");
+	}
+
+	auto guard = createGuard(coalescing.window, coalescing.maxLatency);
+	auto stormGuard = createGuard(StormWindow(coalescing), coalescing.maxLatency);
+
+	{
+		std::scoped_lock<std::mutex> lock(m_evaluateRoutesGuardLock);
+
+		m_evaluateRoutesGuard.swap(guard);
+		m_stormGuard.swap(stormGuard);
+
+		m_window = std::chrono::milliseconds(coalescing.window);
+		m_stormWindow = std::chrono::milliseconds(StormWindow(coalescing));
+	}
+
+	//
+	// Tear down the old guards without holding the lock, they may be waiting for
+	// an evaluation to finish. A burst that was pending in the old guards is
+	// carried over by triggering a new one.
+	//
+
+	guard.reset();
+	stormGuard.reset();
+
+	triggerEvaluation();
 }
 
 //static
@@ -76,20 +135,36 @@ void NETIOAPI_API_ DefaultRouteMonitor::RouteChangeCallback
 (
 	void *context,
 	MIB_IPFORWARD_ROW2 *row,
-	MIB_NOTIFICATION_TYPE
+	MIB_NOTIFICATION_TYPE notificationType
 )
 {
-	//
-	// We're only interested in changes that add/remove/update a default route.
-	//
+	auto monitor = reinterpret_cast<DefaultRouteMonitor *>(context);
 
-	if (0 != row->DestinationPrefix.PrefixLength
-		|| false == RouteHasGateway(*row))
+	if (nullptr == row)
 	{
-		return;
+		std::scoped_lock<std::mutex> lock(monitor->m_candidatesLock);
+
+		monitor->m_stateV4.resyncRequired = true;
+		monitor->m_stateV6.resyncRequired = true;
 	}
+	else
+	{
+		//
+		// We're only interested in changes that add/remove/update a default route.
+		//
 
-	reinterpret_cast<DefaultRouteMonitor *>(context)->m_evaluateRoutesGuard->trigger();
+		auto state = monitor->stateFromFamily(row->DestinationPrefix.Prefix.si_family);
+
+		if (nullptr == state
+			|| false == IsDefaultRouteCandidate(*row))
+		{
+			return;
+		}
+
+		monitor->updateCandidates(*state, *row, notificationType);
+	}
+
+	monitor->triggerEvaluation();
 }
 
 //static
@@ -100,53 +175,318 @@ void NETIOAPI_API_ DefaultRouteMonitor::InterfaceChangeCallback
 	MIB_NOTIFICATION_TYPE
 )
 {
-	reinterpret_cast<DefaultRouteMonitor *>(context)->m_evaluateRoutesGuard->trigger();
+	reinterpret_cast<DefaultRouteMonitor *>(context)->triggerEvaluation();
 }
 
-void DefaultRouteMonitor::evaluateRoutes()
+DefaultRouteMonitor::FamilyState *DefaultRouteMonitor::stateFromFamily(ADDRESS_FAMILY family)
 {
-	std::scoped_lock<std::mutex> lock(m_evaluationLock);
+	switch (family)
+	{
+		case AF_INET:
+		{
+			return &m_stateV4;
+		}
+		case AF_INET6:
+		{
+			return &m_stateV6;
+		}
+		default:
+		{
+			return nullptr;
+		}
+	}
+}
 
-	try
+std::unique_ptr<common::BurstGuard> DefaultRouteMonitor::createGuard(uint32_t window, uint32_t maxLatency)
+{
+	return std::make_unique<common::BurstGuard>(
+		std::bind(&DefaultRouteMonitor::evaluateRoutes, this),
+		window,
+		maxLatency
+	);
+}
+
+//static
+uint32_t DefaultRouteMonitor::StormWindow(const CoalescingSettings &coalescing)
+{
+	return std::max(coalescing.window, std::min(coalescing.window * STORM_STRETCH_FACTOR, coalescing.maxLatency));
+}
+
+void DefaultRouteMonitor::triggerEvaluation()
+{
+	static auto &storms = shared::performance::CounterRegistry::Instance().counter("winnet.defaultroute.storms");
+
+	const auto now = std::chrono::steady_clock::now();
+
+	std::chrono::steady_clock::rep unset = 0;
+	m_burstStart.compare_exchange_strong(unset, now.time_since_epoch().count());
+
+	std::scoped_lock<std::mutex> lock(m_evaluateRoutesGuardLock);
+
+	const auto interval = now - m_lastNotification;
+
+	m_lastNotification = now;
+
+	if (interval >= m_stormWindow)
 	{
-		evaluateRoutesInner();
+		//
+		// A gap this long ends any storm, and is not averaged in,
+		// so the next notification is reacted to quickly.
+		//
+
+		m_meanInterval = interval;
+		m_storm = false;
 	}
-	catch (const std::exception &ex)
+	else
 	{
-		const auto msg = std::string("Failure while evaluating route table: ").append(ex.what());
-		m_logSink->error(msg.c_str());
+		m_meanInterval = (m_meanInterval * 3 + interval) / 4;
+
+		if (false == m_storm && m_meanInterval < m_window)
+		{
+			m_storm = true;
+			storms.increment();
+		}
 	}
-	catch (...)
+
+	auto &guard = (m_storm ? m_stormGuard : m_evaluateRoutesGuard);
+
+	if (guard)
 	{
-		m_logSink->error("Unspecified failure while evaluating route table");
+		guard->trigger();
 	}
 }
 
-void DefaultRouteMonitor::evaluateRoutesInner()
+void DefaultRouteMonitor::updateCandidates(FamilyState &state, const MIB_IPFORWARD_ROW2 &row,
+	MIB_NOTIFICATION_TYPE notificationType)
 {
-	std::optional<InterfaceAndGateway> currentBestRoute;
+	std::scoped_lock<std::mutex> lock(m_candidatesLock);
+
+	if (state.resyncRequired)
+	{
+		//
+		// The whole table will be read anyway.
+		//
+
+		return;
+	}
+
+	auto &candidates = state.candidates;
+
+	auto existing = std::find_if(candidates.begin(), candidates.end(), [&row](const MIB_IPFORWARD_ROW2 &candidate)
+	{
+		return SameRoute(row, candidate);
+	});
+
+	switch (notificationType)
+	{
+		case MibAddInstance:
+		case MibParameterNotification:
+		{
+			//
+			// The notification is not guaranteed to carry anything but the key fields.
+			//
+
+			MIB_IPFORWARD_ROW2 current = row;
+
+			const auto status = GetIpForwardEntry2(&current);
+
+			if (ERROR_NOT_FOUND == status)
+			{
+				if (candidates.end() != existing)
+				{
+					candidates.erase(existing);
+				}
+
+				break;
+			}
+
+			if (NO_ERROR != status)
+			{
+				state.resyncRequired = true;
+				break;
+			}
+
+			if (candidates.end() != existing)
+			{
+				*existing = current;
+			}
+			else
+			{
+				candidates.emplace_back(current);
+			}
+
+			break;
+		}
+		case MibDeleteInstance:
+		{
+			if (candidates.end() != existing)
+			{
+				candidates.erase(existing);
+			}
+
+			break;
+		}
+		default:
+		{
+			state.resyncRequired = true;
+			break;
+		}
+	}
+}
+
+void DefaultRouteMonitor::resyncCandidates()
+{
+	std::scoped_lock<std::mutex> lock(m_candidatesLock);
+
+	if (false == m_stateV4.resyncRequired || false == m_stateV6.resyncRequired)
+	{
+		return;
+	}
+
+	//
+	// Both families are out of sync, typically after a notification without a row.
+	// Read the table once and split it, rather than once per family.
+	//
+
+	auto candidates = GetDefaultRouteCandidates(AF_UNSPEC);
+
+	m_stateV4.candidates.clear();
+	m_stateV6.candidates.clear();
+
+	for (const auto &candidate : candidates)
+	{
+		auto state = stateFromFamily(candidate.DestinationPrefix.Prefix.si_family);
+
+		if (nullptr != state)
+		{
+			state->candidates.emplace_back(candidate);
+		}
+	}
+
+	m_stateV4.resyncRequired = false;
+	m_stateV6.resyncRequired = false;
+}
+
+void DefaultRouteMonitor::evaluateRoutes()
+{
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winnet.defaultroute.notify_to_evaluate");
+	static shared::logging::RateLimiter errorLimiter;
+
+	std::scoped_lock<std::mutex> lock(m_evaluationLock);
+
+	const auto evaluated = std::chrono::steady_clock::now();
+
+	//
+	// Notifications that arrive from here on are not covered by this evaluation,
+	// and start a new burst.
+	//
+
+	const auto burstStart = m_burstStart.exchange(0);
+
+	if (0 == burstStart)
+	{
+		//
+		// The burst was evaluated when the other guard fired.
+		//
+
+		return;
+	}
+
+	const std::chrono::steady_clock::time_point notified(std::chrono::steady_clock::duration(burstStart));
+
+	histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(evaluated - notified));
 
 	try
 	{
-		currentBestRoute = GetBestDefaultRoute(m_family);
+		resyncCandidates();
 	}
 	catch (...)
 	{
+		//
+		// Each family is read separately in evaluateRoutesInner() instead.
+		//
+	}
+
+	std::vector<Change> changes;
+
+	for (auto state : { &m_stateV4, &m_stateV6 })
+	{
+		try
+		{
+			auto change = evaluateRoutesInner(*state);
+
+			if (change.has_value())
+			{
+				change->evaluated = evaluated;
+				changes.emplace_back(std::move(change.value()));
+			}
+		}
+		catch (const std::exception &ex)
+		{
+			const auto msg = std::string("Failure while evaluating route table: ").append(ex.what());
+			errorLimiter.error(*m_logSink, msg.c_str());
+		}
+		catch (...)
+		{
+			errorLimiter.error(*m_logSink, "Unspecified failure while evaluating route table");
+		}
+	}
+
+	if (false == changes.empty())
+	{
+		m_callback(changes);
+	}
+}
+
+std::optional<DefaultRouteMonitor::Change> DefaultRouteMonitor::evaluateRoutesInner(FamilyState &state)
+{
+	std::optional<InterfaceAndGateway> currentBestRoute;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_candidatesLock);
+
+		if (state.resyncRequired)
+		{
+			state.candidates = GetDefaultRouteCandidates(state.family);
+			state.resyncRequired = false;
+		}
+
+		std::vector<const MIB_IPFORWARD_ROW2 *> candidates;
+		candidates.reserve(state.candidates.size());
+
+		for (const auto &candidate : state.candidates)
+		{
+			candidates.emplace_back(&candidate);
+		}
+
+		//
+		// Interface state is not cached, so changes in interface metric
+		// and connectivity are picked up here.
+		//
+
+		try
+		{
+			currentBestRoute = SelectBestDefaultRoute(candidates);
+		}
+		catch (...)
+		{
+		}
 	}
 
 	//
 	// If there was no default route previously.
 	//
 
-	if (false == m_bestRoute.has_value())
+	if (false == state.bestRoute.has_value())
 	{
-		if (currentBestRoute.has_value())
+		if (false == currentBestRoute.has_value())
 		{
-			m_bestRoute = currentBestRoute;
-			m_callback(EventType::Updated, m_bestRoute);
+			return std::nullopt;
 		}
 
-		return;
+		state.bestRoute = currentBestRoute;
+
+		return Change{ state.family, EventType::Updated, state.bestRoute };
 	}
 
 	//
@@ -156,21 +496,23 @@ void DefaultRouteMonitor::evaluateRoutesInner()
 
 	if (false == currentBestRoute.has_value())
 	{
-		m_bestRoute.reset();
-		m_callback(EventType::Removed, std::nullopt);
+		state.bestRoute.reset();
 
-		return;
+		return Change{ state.family, EventType::Removed, std::nullopt };
 	}
 
 	//
 	// The current best route may have changed.
 	//
 
-	if (m_bestRoute.value() != currentBestRoute.value())
+	if (state.bestRoute.value() != currentBestRoute.value())
 	{
-		m_bestRoute = currentBestRoute;
-		m_callback(EventType::Updated, m_bestRoute);
+		state.bestRoute = currentBestRoute;
+
+		return Change{ state.family, EventType::Updated, state.bestRoute };
 	}
+
+	return std::nullopt;
 }
 
 }
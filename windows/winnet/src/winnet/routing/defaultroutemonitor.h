@@ -2,21 +2,24 @@
 
 #include <ifdef.h>
 #include <ws2def.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <memory>
 #include <mutex>
+#include <vector>
 #include <libcommon/logging/ilogsink.h>
 #include <libcommon/burstguard.h>
 #include "types.h"
+#include "../notificationhub.h"
 
 namespace winnet::routing
 {
 
-class DefaultRouteMonitor
+struct IDefaultRouteMonitor
 {
-public:
-
 	enum class EventType
 	{
 		// The best default route changed.
@@ -26,15 +29,63 @@ public:
 		Removed,
 	};
 
-	using Callback = std::function<void
-	(
-		EventType eventType,
+	struct Change
+	{
+		ADDRESS_FAMILY family;
+		EventType eventType;
 
 		// For update events, data associated with the new best default route.
-		const std::optional<InterfaceAndGateway> &route
-	)>;
+		std::optional<InterfaceAndGateway> route;
+
+		// When the evaluation that detected the change started.
+		std::chrono::steady_clock::time_point evaluated;
+	};
 
-	DefaultRouteMonitor(ADDRESS_FAMILY family, Callback callback, std::shared_ptr<common::logging::ILogSink> logSink);
+	//
+	// Families that changed in the same evaluation are reported together,
+	// so a single network change results in a single event.
+	//
+	using Callback = std::function<void(const std::vector<Change> &changes)>;
+
+	//
+	// Implementations may stretch the window while notifications keep arriving
+	// faster than it, but never beyond the maximum latency.
+	//
+	struct CoalescingSettings
+	{
+		// Evaluate when there have been no further notifications for this long (ms).
+		uint32_t window;
+
+		// Evaluate no later than this long after the first notification in a burst (ms).
+		uint32_t maxLatency;
+	};
+
+	virtual ~IDefaultRouteMonitor() = 0
+	{
+	}
+
+	virtual void setCoalescing(const CoalescingSettings &coalescing) = 0;
+};
+
+//
+// Monitors the best default route for both IPv4 and IPv6.
+//
+// Notifications are coalesced and both families are evaluated together,
+// once per burst. If both families need the route table, it's read once.
+//
+// The window adapts to the rate of notifications. During a storm, when
+// notifications keep arriving faster than the configured window, a longer
+// window is used so that the storm is evaluated fewer times. The configured
+// window is used again once there's a gap as long as the longer window.
+//
+class DefaultRouteMonitor : public IDefaultRouteMonitor
+{
+public:
+
+	static const CoalescingSettings DefaultCoalescing;
+
+	DefaultRouteMonitor(Callback callback, std::shared_ptr<common::logging::ILogSink> logSink,
+		const CoalescingSettings &coalescing = DefaultCoalescing);
 	~DefaultRouteMonitor();
 
 	DefaultRouteMonitor(const DefaultRouteMonitor &) = delete;
@@ -42,9 +93,10 @@ public:
 	DefaultRouteMonitor &operator=(const DefaultRouteMonitor &) = delete;
 	DefaultRouteMonitor &operator=(DefaultRouteMonitor &&) = delete;
 
+	void setCoalescing(const CoalescingSettings &coalescing) override;
+
 private:
 
-	ADDRESS_FAMILY m_family;
 	Callback m_callback;
 	std::shared_ptr<common::logging::ILogSink> m_logSink;
 
@@ -52,18 +104,72 @@ private:
 	// We need to be able to delete it explicitly in order to have a controlled tear down.
 	std::unique_ptr<common::BurstGuard> m_evaluateRoutesGuard;
 
-	std::optional<InterfaceAndGateway> m_bestRoute;
+	// Used instead of the regular guard during storms.
+	std::unique_ptr<common::BurstGuard> m_stormGuard;
+
+	//
+	// Guards the guards, and the notification rate that selects between them.
+	//
+	std::mutex m_evaluateRoutesGuardLock;
 
-	HANDLE m_routeNotificationHandle;
-	HANDLE m_interfaceNotificationHandle;
+	std::chrono::milliseconds m_window;
+	std::chrono::milliseconds m_stormWindow;
+
+	std::chrono::steady_clock::time_point m_lastNotification;
+
+	// Moving average of the time between notifications.
+	std::chrono::steady_clock::duration m_meanInterval;
+
+	bool m_storm;
+
+	//
+	// Time of the first notification since the last evaluation,
+	// as a steady_clock tick count. Zero if there is none.
+	//
+	std::atomic<std::chrono::steady_clock::rep> m_burstStart;
+
+	struct FamilyState
+	{
+		ADDRESS_FAMILY family;
+
+		std::optional<InterfaceAndGateway> bestRoute;
+
+		//
+		// Default route candidates in the route table.
+		// Maintained from route notifications so evaluation doesn't have to read the whole table.
+		//
+		std::vector<MIB_IPFORWARD_ROW2> candidates;
+		bool resyncRequired;
+	};
+
+	FamilyState m_stateV4;
+	FamilyState m_stateV6;
+
+	std::mutex m_candidatesLock;
+
+	std::unique_ptr<NotificationHub::Subscription> m_routeSubscription;
+	std::unique_ptr<NotificationHub::Subscription> m_interfaceSubscription;
 
 	std::mutex m_evaluationLock;
 
 	static void NETIOAPI_API_ RouteChangeCallback(void *context, MIB_IPFORWARD_ROW2 *row, MIB_NOTIFICATION_TYPE notificationType);
 	static void NETIOAPI_API_ InterfaceChangeCallback(void *context, MIB_IPINTERFACE_ROW *row, MIB_NOTIFICATION_TYPE notificationType);
 
+	FamilyState *stateFromFamily(ADDRESS_FAMILY family);
+
+	std::unique_ptr<common::BurstGuard> createGuard(uint32_t window, uint32_t maxLatency);
+
+	// Longer window to use during storms.
+	static uint32_t StormWindow(const CoalescingSettings &coalescing);
+
+	void triggerEvaluation();
+
+	void updateCandidates(FamilyState &state, const MIB_IPFORWARD_ROW2 &row, MIB_NOTIFICATION_TYPE notificationType);
+
+	void resyncCandidates();
+
 	void evaluateRoutes();
-	void evaluateRoutesInner();
+	std::optional<Change> evaluateRoutesInner(FamilyState &state);
 };
 
 }
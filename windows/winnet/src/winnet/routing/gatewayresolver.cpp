@@ -0,0 +1,173 @@
+#include "stdafx.h"
+#include "gatewayresolver.h"
+#include "helpers.h"
+#include <libcommon/error.h>
+#include <libcommon/network/adapters.h>
+#include <libshared/performance/counterregistry.h>
+#include <cstring>
+
+namespace winnet::routing
+{
+
+NET_LUID GatewayResolver::resolve(const NodeAddress &gateway)
+{
+	static auto &enumerations = shared::performance::CounterRegistry::Instance().counter("winnet.gateway.enumerations");
+	static auto &unreachable = shared::performance::CounterRegistry::Instance().counter("winnet.gateway.unreachable");
+
+	if (AF_INET != gateway.si_family && AF_INET6 != gateway.si_family)
+	{
+		THROW_ERROR("Invalid address family for gateway address");
+	}
+
+	std::call_once(m_subscribed, &GatewayResolver::subscribe, this);
+
+	NET_LUID luid;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_gatewaysLock);
+
+		auto &gateways = (AF_INET == gateway.si_family ? m_gatewaysV4 : m_gatewaysV6);
+
+		if (false == gateways.has_value())
+		{
+			gateways = BuildGatewayMap(gateway.si_family);
+			enumerations.increment();
+		}
+
+		const auto match = gateways->find(KeyFromAddress(gateway));
+
+		if (gateways->end() == match)
+		{
+			THROW_ERROR("Unable to find network adapter with specified gateway");
+		}
+
+		luid = match->second.luid;
+	}
+
+	if (Unreachable(gateway, luid))
+	{
+		unreachable.increment();
+
+		THROW_ERROR("The specified gateway is unreachable");
+	}
+
+	return luid;
+}
+
+void GatewayResolver::subscribe()
+{
+	auto hub = NotificationHub::Instance();
+
+	m_interfaceSubscription = hub->subscribeInterfaceChanges([this](MIB_IPINTERFACE_ROW *, MIB_NOTIFICATION_TYPE)
+	{
+		invalidate();
+	});
+
+	m_routeSubscription = hub->subscribeRouteChanges([this](MIB_IPFORWARD_ROW2 *row, MIB_NOTIFICATION_TYPE)
+	{
+		if (nullptr == row || 0 == row->DestinationPrefix.PrefixLength)
+		{
+			invalidate();
+		}
+	});
+}
+
+void GatewayResolver::invalidate()
+{
+	std::scoped_lock<std::mutex> lock(m_gatewaysLock);
+
+	m_gatewaysV4.reset();
+	m_gatewaysV6.reset();
+}
+
+//static
+bool GatewayResolver::Unreachable(const NodeAddress &gateway, NET_LUID luid)
+{
+	MIB_IPNET_ROW2 neighbor = { 0 };
+
+	neighbor.Address = gateway;
+	neighbor.InterfaceLuid = luid;
+
+	//
+	// A gateway that has not been resolved yet has no entry, and may well be reachable.
+	//
+
+	return NO_ERROR == GetIpNetEntry2(&neighbor)
+		&& NlnsUnreachable == neighbor.State;
+}
+
+//static
+GatewayResolver::GatewayKey GatewayResolver::KeyFromAddress(const SOCKADDR_INET &address)
+{
+	GatewayKey key = { 0 };
+
+	if (AF_INET == address.si_family)
+	{
+		memcpy(&key[0], &address.Ipv4.sin_addr, sizeof(IN_ADDR));
+	}
+	else
+	{
+		memcpy(&key[0], &address.Ipv6.sin6_addr, sizeof(IN6_ADDR));
+	}
+
+	return key;
+}
+
+//static
+GatewayResolver::GatewayKey GatewayResolver::KeyFromAddress(const SOCKET_ADDRESS &address)
+{
+	GatewayKey key = { 0 };
+
+	if (AF_INET == address.lpSockaddr->sa_family)
+	{
+		const auto typed = reinterpret_cast<const SOCKADDR_IN *>(address.lpSockaddr);
+		memcpy(&key[0], &typed->sin_addr, sizeof(IN_ADDR));
+	}
+	else
+	{
+		const auto typed = reinterpret_cast<const SOCKADDR_IN6 *>(address.lpSockaddr);
+		memcpy(&key[0], &typed->sin6_addr, sizeof(IN6_ADDR));
+	}
+
+	return key;
+}
+
+//static
+GatewayResolver::GatewayMap GatewayResolver::BuildGatewayMap(ADDRESS_FAMILY family)
+{
+	const DWORD adapterFlags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER
+		| GAA_FLAG_SKIP_FRIENDLY_NAME | GAA_FLAG_INCLUDE_GATEWAYS;
+
+	common::network::Adapters adapters(family, adapterFlags);
+
+	GatewayMap gateways;
+
+	for (auto adapter = adapters.next(); nullptr != adapter; adapter = adapters.next())
+	{
+		if (false == AdapterInterfaceEnabled(adapter, family))
+		{
+			continue;
+		}
+
+		const auto metric = (AF_INET == family ? adapter->Ipv4Metric : adapter->Ipv6Metric);
+
+		for (const auto gateway : IsolateGatewayAddresses(adapter->FirstGatewayAddress, family))
+		{
+			//
+			// Several adapters can use the same gateway.
+			// Select the interface with the best (lowest) metric.
+			//
+
+			const auto inserted = gateways.emplace(KeyFromAddress(*gateway), Candidate{ adapter->Luid, metric });
+
+			if (false == inserted.second && metric < inserted.first->second.metric)
+			{
+				inserted.first->second = Candidate{ adapter->Luid, metric };
+			}
+		}
+	}
+
+	return gateways;
+}
+
+}
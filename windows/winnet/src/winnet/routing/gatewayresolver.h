@@ -0,0 +1,77 @@
+#pragma once
+
+#include "types.h"
+#include "../notificationhub.h"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace winnet::routing
+{
+
+//
+// Resolves gateways to the interface that should be used to reach them.
+//
+// Adapters are enumerated once per address family, and the result is reused
+// until an interface changes or a default route is added, removed or updated.
+// The gateways of an adapter are those of its default routes, so other route
+// changes don't affect the result.
+//
+// The neighbor entry of the gateway is checked on each call, so gateways that
+// are known to be unreachable are rejected without waiting for a route to fail.
+//
+class GatewayResolver
+{
+public:
+
+	GatewayResolver() = default;
+
+	GatewayResolver(const GatewayResolver &) = delete;
+	GatewayResolver &operator=(const GatewayResolver &) = delete;
+
+	// Throws if no enabled adapter has the gateway, or if the gateway is unreachable.
+	NET_LUID resolve(const NodeAddress &gateway);
+
+private:
+
+	using GatewayKey = std::array<uint8_t, 16>;
+
+	struct Candidate
+	{
+		NET_LUID luid;
+		ULONG metric;
+	};
+
+	// Interface with the lowest metric, for each gateway.
+	using GatewayMap = std::map<GatewayKey, Candidate>;
+
+	static GatewayKey KeyFromAddress(const SOCKADDR_INET &address);
+	static GatewayKey KeyFromAddress(const SOCKET_ADDRESS &address);
+
+	static GatewayMap BuildGatewayMap(ADDRESS_FAMILY family);
+
+	static bool Unreachable(const NodeAddress &gateway, NET_LUID luid);
+
+	std::mutex m_gatewaysLock;
+
+	std::optional<GatewayMap> m_gatewaysV4;
+	std::optional<GatewayMap> m_gatewaysV6;
+
+	void invalidate();
+
+	//
+	// Notifications are subscribed to on first use, before anything is cached.
+	// The subscriptions are declared last, so they're cancelled first.
+	//
+	std::once_flag m_subscribed;
+
+	std::unique_ptr<NotificationHub::Subscription> m_interfaceSubscription;
+	std::unique_ptr<NotificationHub::Subscription> m_routeSubscription;
+
+	void subscribe();
+};
+
+}
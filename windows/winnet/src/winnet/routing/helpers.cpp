@@ -125,7 +125,17 @@ bool RouteHasGateway(const MIB_IPFORWARD_ROW2 &route)
 	};
 }
 
-InterfaceAndGateway GetBestDefaultRoute(ADDRESS_FAMILY family)
+bool IsDefaultRouteCandidate(const MIB_IPFORWARD_ROW2 &route)
+{
+	//
+	// Route 0/0 && gateway specified.
+	//
+
+	return 0 == route.DestinationPrefix.PrefixLength
+		&& RouteHasGateway(route);
+}
+
+std::vector<MIB_IPFORWARD_ROW2> GetDefaultRouteCandidates(ADDRESS_FAMILY family)
 {
 	PMIB_IPFORWARD_TABLE2 table;
 
@@ -143,24 +153,23 @@ InterfaceAndGateway GetBestDefaultRoute(ADDRESS_FAMILY family)
 		FreeMibTable(table);
 	};
 
-	std::vector<const MIB_IPFORWARD_ROW2 *> candidates;
-	candidates.reserve(table->NumEntries);
-
-	//
-	// Enumerate routes looking for: route 0/0 && gateway specified.
-	//
+	std::vector<MIB_IPFORWARD_ROW2> candidates;
 
 	for (ULONG i = 0; i < table->NumEntries; ++i)
 	{
 		const MIB_IPFORWARD_ROW2 &candidate = table->Table[i];
 
-		if (0 == candidate.DestinationPrefix.PrefixLength
-			&& RouteHasGateway(candidate))
+		if (IsDefaultRouteCandidate(candidate))
 		{
-			candidates.emplace_back(&candidate);
+			candidates.emplace_back(candidate);
 		}
 	}
 
+	return candidates;
+}
+
+InterfaceAndGateway SelectBestDefaultRoute(const std::vector<const MIB_IPFORWARD_ROW2 *> &candidates)
+{
 	auto annotated = AnnotateRoutes(candidates);
 
 	if (annotated.empty())
@@ -194,6 +203,21 @@ InterfaceAndGateway GetBestDefaultRoute(ADDRESS_FAMILY family)
 	return InterfaceAndGateway { annotated[0].route->InterfaceLuid, annotated[0].route->NextHop };
 }
 
+InterfaceAndGateway GetBestDefaultRoute(ADDRESS_FAMILY family)
+{
+	const auto candidates = GetDefaultRouteCandidates(family);
+
+	std::vector<const MIB_IPFORWARD_ROW2 *> pointers;
+	pointers.reserve(candidates.size());
+
+	for (const auto &candidate : candidates)
+	{
+		pointers.emplace_back(&candidate);
+	}
+
+	return SelectBestDefaultRoute(pointers);
+}
+
 bool AdapterInterfaceEnabled(const IP_ADAPTER_ADDRESSES *adapter, ADDRESS_FAMILY family)
 {
 	switch (family)
@@ -29,6 +29,14 @@ std::vector<AnnotatedRoute> AnnotateRoutes(const std::vector<const MIB_IPFORWARD
 
 bool RouteHasGateway(const MIB_IPFORWARD_ROW2 &route);
 
+bool IsDefaultRouteCandidate(const MIB_IPFORWARD_ROW2 &route);
+
+// Copies of all rows in the route table that could act as default route.
+// Pass AF_UNSPEC for both families.
+std::vector<MIB_IPFORWARD_ROW2> GetDefaultRouteCandidates(ADDRESS_FAMILY family);
+
+InterfaceAndGateway SelectBestDefaultRoute(const std::vector<const MIB_IPFORWARD_ROW2 *> &candidates);
+
 InterfaceAndGateway GetBestDefaultRoute(ADDRESS_FAMILY family);
 
 bool AdapterInterfaceEnabled(const IP_ADAPTER_ADDRESSES *adapter, ADDRESS_FAMILY family);
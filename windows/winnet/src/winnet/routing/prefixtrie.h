@@ -0,0 +1,207 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace winnet::routing
+{
+
+//
+// Path compressed binary trie over network prefixes, for longest prefix match.
+//
+// Nodes only exist where a prefix is stored, or where stored prefixes branch,
+// so a lookup visits at most one node per stored prefix that covers the address.
+// Bits are numbered from the most significant bit of the first byte.
+//
+template<typename Value>
+class PrefixTrie
+{
+public:
+
+	using Key = std::array<uint8_t, 16>;
+
+	PrefixTrie() = default;
+
+	PrefixTrie(const PrefixTrie &) = delete;
+	PrefixTrie(PrefixTrie &&) = default;
+	PrefixTrie &operator=(const PrefixTrie &) = delete;
+	PrefixTrie &operator=(PrefixTrie &&) = default;
+
+	// Replaces the value if the prefix is already stored.
+	void insert(const Key &prefix, uint8_t length, const Value &value)
+	{
+		auto slot = &m_root;
+
+		for (;;)
+		{
+			auto &node = *slot;
+
+			if (nullptr == node)
+			{
+				node = std::make_unique<Node>(Node{ prefix, length, value });
+				return;
+			}
+
+			const auto common = CommonLength(prefix, length, node->prefix, node->length);
+
+			if (common == node->length)
+			{
+				if (common == length)
+				{
+					node->value = value;
+					return;
+				}
+
+				slot = &node->children[Bit(prefix, node->length)];
+				continue;
+			}
+
+			//
+			// The prefix diverges from the node, or ends above it.
+			//
+
+			if (common == length)
+			{
+				auto parent = std::make_unique<Node>(Node{ prefix, length, value });
+
+				parent->children[Bit(node->prefix, length)] = std::move(node);
+				node = std::move(parent);
+
+				return;
+			}
+
+			auto branch = std::make_unique<Node>(Node{ prefix, common, std::nullopt });
+
+			branch->children[Bit(node->prefix, common)] = std::move(node);
+			branch->children[Bit(prefix, common)] = std::make_unique<Node>(Node{ prefix, length, value });
+
+			node = std::move(branch);
+
+			return;
+		}
+	}
+
+	// Only erases the prefix if it's stored with this value.
+	bool erase(const Key &prefix, uint8_t length, const Value &value)
+	{
+		return Erase(m_root, prefix, length, value);
+	}
+
+	// Value of the most specific prefix that covers the address, if any.
+	const Value *longestMatch(const Key &address, uint8_t bits) const
+	{
+		const Value *match = nullptr;
+
+		for (auto node = m_root.get(); nullptr != node;)
+		{
+			if (node->length > bits || node->length != CommonLength(address, bits, node->prefix, node->length))
+			{
+				break;
+			}
+
+			if (node->value.has_value())
+			{
+				match = &node->value.value();
+			}
+
+			if (node->length == bits)
+			{
+				break;
+			}
+
+			node = node->children[Bit(address, node->length)].get();
+		}
+
+		return match;
+	}
+
+	void clear()
+	{
+		m_root.reset();
+	}
+
+private:
+
+	struct Node
+	{
+		Key prefix;
+		uint8_t length;
+		std::optional<Value> value;
+		std::unique_ptr<Node> children[2];
+	};
+
+	static size_t Bit(const Key &key, size_t bit)
+	{
+		return (key[bit / 8] >> (7 - (bit % 8))) & 1;
+	}
+
+	static uint8_t CommonLength(const Key &lhs, uint8_t lhsLength, const Key &rhs, uint8_t rhsLength)
+	{
+		const auto length = (lhsLength < rhsLength ? lhsLength : rhsLength);
+
+		uint8_t common = 0;
+
+		//
+		// Compare whole bytes first.
+		//
+
+		while (common + 8 <= length && lhs[common / 8] == rhs[common / 8])
+		{
+			common += 8;
+		}
+
+		while (common < length && Bit(lhs, common) == Bit(rhs, common))
+		{
+			++common;
+		}
+
+		return common;
+	}
+
+	static bool Erase(std::unique_ptr<Node> &node, const Key &prefix, uint8_t length, const Value &value)
+	{
+		if (nullptr == node || node->length > length
+			|| node->length != CommonLength(prefix, length, node->prefix, node->length))
+		{
+			return false;
+		}
+
+		if (node->length == length)
+		{
+			if (false == node->value.has_value() || false == (node->value.value() == value))
+			{
+				return false;
+			}
+
+			node->value.reset();
+		}
+		else if (false == Erase(node->children[Bit(prefix, node->length)], prefix, length, value))
+		{
+			return false;
+		}
+
+		//
+		// Remove nodes that no longer store or branch anything.
+		//
+
+		if (false == node->value.has_value())
+		{
+			if (nullptr == node->children[0])
+			{
+				node = std::move(node->children[1]);
+			}
+			else if (nullptr == node->children[1])
+			{
+				node = std::move(node->children[0]);
+			}
+		}
+
+		return true;
+	}
+
+	std::unique_ptr<Node> m_root;
+};
+
+}
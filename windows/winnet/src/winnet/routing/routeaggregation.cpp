@@ -0,0 +1,249 @@
+#include "stdafx.h"
+#include "routeaggregation.h"
+#include <libcommon/error.h>
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <tuple>
+
+namespace winnet::routing
+{
+
+namespace
+{
+
+//
+// Networks are ordered on family and then most specific first, so the halves
+// of a network are always visited before the network itself.
+//
+struct NetworkKey
+{
+	ADDRESS_FAMILY family;
+	uint8_t prefixLength;
+	std::array<uint8_t, sizeof(IN6_ADDR)> prefix;
+
+	bool operator<(const NetworkKey &rhs) const
+	{
+		return std::tie(family, rhs.prefixLength, prefix) < std::tie(rhs.family, prefixLength, rhs.prefix);
+	}
+};
+
+size_t AddressLength(ADDRESS_FAMILY family)
+{
+	switch (family)
+	{
+		case AF_INET:
+		{
+			return sizeof(IN_ADDR);
+		}
+		case AF_INET6:
+		{
+			return sizeof(IN6_ADDR);
+		}
+		default:
+		{
+			THROW_ERROR("Invalid address family for network address");
+		}
+	}
+}
+
+NetworkKey MakeKey(const Network &network)
+{
+	NetworkKey key = { network.Prefix.si_family, network.PrefixLength, { 0 } };
+
+	const auto address = (AF_INET == key.family
+		? reinterpret_cast<const uint8_t *>(&network.Prefix.Ipv4.sin_addr)
+		: reinterpret_cast<const uint8_t *>(&network.Prefix.Ipv6.sin6_addr));
+
+	std::copy(address, address + AddressLength(key.family), key.prefix.begin());
+
+	return key;
+}
+
+Network MakeNetwork(const NetworkKey &key)
+{
+	Network network = { 0 };
+
+	network.Prefix.si_family = key.family;
+	network.PrefixLength = key.prefixLength;
+
+	const auto address = (AF_INET == key.family
+		? reinterpret_cast<uint8_t *>(&network.Prefix.Ipv4.sin_addr)
+		: reinterpret_cast<uint8_t *>(&network.Prefix.Ipv6.sin6_addr));
+
+	std::copy(key.prefix.begin(), key.prefix.begin() + AddressLength(key.family), address);
+
+	return network;
+}
+
+uint8_t BitMask(size_t bit)
+{
+	return static_cast<uint8_t>(0x80 >> (bit % 8));
+}
+
+//
+// Only networks without any bits set past the prefix can be merged.
+//
+bool IsCanonical(const NetworkKey &key)
+{
+	const auto bits = AddressLength(key.family) * 8;
+
+	if (key.prefixLength > bits)
+	{
+		return false;
+	}
+
+	for (size_t bit = key.prefixLength; bit < bits; ++bit)
+	{
+		if (0 != (key.prefix[bit / 8] & BitMask(bit)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+struct Entry
+{
+	// Index of the node shared by the routes.
+	size_t node;
+
+	AggregatedRoute route;
+};
+
+void AppendMembers(std::vector<Route> &members, AggregatedRoute &&route)
+{
+	if (route.members.empty())
+	{
+		members.emplace_back(std::move(route.route));
+		return;
+	}
+
+	std::move(route.members.begin(), route.members.end(), std::back_inserter(members));
+}
+
+} // anonymous namespace
+
+std::vector<AggregatedRoute> AggregateRoutes(const std::vector<Route> &routes,
+	const std::function<bool(const Route &merged)> &reserved)
+{
+	//
+	// There are usually only a few distinct nodes, so search them linearly.
+	//
+
+	std::vector<const std::optional<Node> *> nodes;
+
+	auto nodeIndex = [&nodes](const std::optional<Node> &node)
+	{
+		const auto it = std::find_if(nodes.begin(), nodes.end(), [&node](const std::optional<Node> *candidate)
+		{
+			return *candidate == node;
+		});
+
+		if (nodes.end() != it)
+		{
+			return static_cast<size_t>(std::distance(nodes.begin(), it));
+		}
+
+		nodes.push_back(&node);
+
+		return nodes.size() - 1;
+	};
+
+	std::map<NetworkKey, Entry> entries;
+
+	for (const auto &route : routes)
+	{
+		entries.insert_or_assign(MakeKey(route.network()), Entry{ nodeIndex(route.node()), AggregatedRoute{ route, {} } });
+	}
+
+	for (auto it = entries.begin(); it != entries.end();)
+	{
+		const auto &key = it->first;
+
+		if (2 > key.prefixLength || false == IsCanonical(key))
+		{
+			++it;
+			continue;
+		}
+
+		const size_t bit = key.prefixLength - 1;
+
+		auto siblingKey = key;
+		siblingKey.prefix[bit / 8] ^= BitMask(bit);
+
+		const auto sibling = entries.find(siblingKey);
+
+		if (entries.end() == sibling || sibling->second.node != it->second.node)
+		{
+			++it;
+			continue;
+		}
+
+		auto parentKey = key;
+		parentKey.prefix[bit / 8] &= ~BitMask(bit);
+		parentKey.prefixLength = static_cast<uint8_t>(bit);
+
+		auto parent = entries.find(parentKey);
+
+		//
+		// The enclosing network may itself be one of the routes. It can absorb
+		// the halves only if it uses the same node.
+		//
+
+		if (entries.end() != parent)
+		{
+			if (parent->second.node != it->second.node)
+			{
+				++it;
+				continue;
+			}
+
+			auto &merged = parent->second.route;
+
+			if (merged.members.empty())
+			{
+				merged.members.push_back(merged.route);
+			}
+		}
+		else
+		{
+			AggregatedRoute merged{ Route(MakeNetwork(parentKey), *nodes[it->second.node]), {} };
+
+			if (reserved(merged.route))
+			{
+				++it;
+				continue;
+			}
+
+			parent = entries.emplace(parentKey, Entry{ it->second.node, std::move(merged) }).first;
+		}
+
+		auto &members = parent->second.route.members;
+
+		AppendMembers(members, std::move(it->second.route));
+		AppendMembers(members, std::move(sibling->second.route));
+
+		//
+		// The merged network is ordered after the current one, so it's visited later on.
+		//
+
+		entries.erase(sibling);
+		it = entries.erase(it);
+	}
+
+	std::vector<AggregatedRoute> aggregated;
+	aggregated.reserve(entries.size());
+
+	for (auto &entry : entries)
+	{
+		aggregated.emplace_back(std::move(entry.second.route));
+	}
+
+	return aggregated;
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "types.h"
+#include <functional>
+#include <vector>
+
+namespace winnet::routing
+{
+
+struct AggregatedRoute
+{
+	Route route;
+
+	// Routes that were merged into 'route', or nothing if no routes were merged.
+	std::vector<Route> members;
+};
+
+//
+// Merge routes for the two halves of a network into a single route for the network,
+// when both halves use the same node. This is repeated for as long as possible,
+// so e.g. four adjacent /26 routes become one /24 route.
+//
+// Traffic keeps going through the same node, unless the routing table has other routes
+// for networks that are less specific than the original routes but at least as specific
+// as the merged route. Those take precedence after merging.
+//
+// 'reserved' is consulted before merging into a network that is not itself one of the
+// routes, and the merge is skipped if it returns true. Routes are never merged into a
+// default route, since split routes are commonly used to override the default route.
+//
+// If several routes have the same network, the last one is used.
+//
+std::vector<AggregatedRoute> AggregateRoutes(const std::vector<Route> &routes,
+	const std::function<bool(const Route &merged)> &reserved);
+
+}
@@ -0,0 +1,173 @@
+#include "stdafx.h"
+#include "routeeventlog.h"
+#include <libcommon/error.h>
+#include <libcommon/string.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+using AutoLockType = std::scoped_lock<std::mutex>;
+
+namespace winnet::routing
+{
+
+namespace
+{
+
+const char *OperationName(RouteEventLog::Operation operation)
+{
+	switch (operation)
+	{
+		case RouteEventLog::Operation::Create: return "create";
+		case RouteEventLog::Operation::Restore: return "restore";
+		case RouteEventLog::Operation::Delete: return "delete";
+		case RouteEventLog::Operation::DeleteUnregistered: return "delete-unregistered";
+		default: return "unknown";
+	}
+}
+
+uint64_t Now()
+{
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+
+	return (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+}
+
+RouteEventLog::Event MakeEvent(RouteEventLog::Operation operation, const Network &network, DWORD status)
+{
+	RouteEventLog::Event event = { 0 };
+
+	event.timestamp = Now();
+	event.status = status;
+	event.operation = operation;
+	event.prefixLength = network.PrefixLength;
+
+	if (AF_INET == network.Prefix.si_family)
+	{
+		event.family = 4;
+		memcpy(event.prefix, &network.Prefix.Ipv4.sin_addr, sizeof(IN_ADDR));
+	}
+	else if (AF_INET6 == network.Prefix.si_family)
+	{
+		event.family = 6;
+		memcpy(event.prefix, &network.Prefix.Ipv6.sin6_addr, sizeof(IN6_ADDR));
+	}
+
+	return event;
+}
+
+} // anonymous namespace
+
+RouteEventLog::RouteEventLog(size_t capacity)
+	: m_events(capacity)
+	, m_numRecorded(0)
+{
+	if (0 == capacity)
+	{
+		THROW_ERROR("Invalid capacity for route event log");
+	}
+}
+
+void RouteEventLog::record(Operation operation, const RegisteredRoute &route, DWORD status, Clock::time_point start)
+{
+	auto event = MakeEvent(operation, route.network, status);
+
+	event.luid = route.luid.Value;
+	event.durationUs = static_cast<uint32_t>(std::min<int64_t>(UINT32_MAX,
+		std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count()));
+
+	append(event);
+}
+
+void RouteEventLog::record(Operation operation, const Network &network, DWORD status)
+{
+	append(MakeEvent(operation, network, status));
+}
+
+std::vector<RouteEventLog::Event> RouteEventLog::events() const
+{
+	AutoLockType lock(m_lock);
+
+	const auto capacity = m_events.size();
+	const auto count = static_cast<size_t>(std::min<uint64_t>(m_numRecorded, capacity));
+
+	std::vector<Event> events;
+	events.reserve(count);
+
+	for (auto sequence = m_numRecorded - count; sequence < m_numRecorded; ++sequence)
+	{
+		events.push_back(m_events[static_cast<size_t>(sequence % capacity)]);
+	}
+
+	return events;
+}
+
+uint64_t RouteEventLog::dropped() const
+{
+	AutoLockType lock(m_lock);
+
+	return (m_numRecorded > m_events.size() ? m_numRecorded - m_events.size() : 0);
+}
+
+void RouteEventLog::dump(const std::function<void(const std::string &)> &sink) const
+{
+	const auto numDropped = dropped();
+
+	if (0 != numDropped)
+	{
+		sink(std::string("Route events dropped before this dump: ").append(std::to_string(numDropped)));
+	}
+
+	for (const auto &event : events())
+	{
+		sink(FormatEvent(event));
+	}
+}
+
+// static
+std::string RouteEventLog::FormatEvent(const Event &event)
+{
+	FILETIME fileTime;
+
+	fileTime.dwLowDateTime = static_cast<DWORD>(event.timestamp);
+	fileTime.dwHighDateTime = static_cast<DWORD>(event.timestamp >> 32);
+
+	SYSTEMTIME time;
+	FileTimeToSystemTime(&fileTime, &time);
+
+	std::wstringstream ss;
+
+	ss << std::setfill(L'0')
+		<< std::setw(2) << time.wHour << L':' << std::setw(2) << time.wMinute << L':'
+		<< std::setw(2) << time.wSecond << L'.' << std::setw(3) << time.wMilliseconds
+		<< std::setfill(L' ') << L' ' << OperationName(event.operation) << L' ';
+
+	if (4 == event.family)
+	{
+		ss << common::string::FormatIpv4(_byteswap_ulong(*reinterpret_cast<const uint32_t *>(event.prefix)),
+			event.prefixLength);
+	}
+	else if (6 == event.family)
+	{
+		ss << common::string::FormatIpv6(event.prefix, event.prefixLength);
+	}
+
+	ss << L" luid 0x" << std::hex << event.luid << std::dec
+		<< L" status " << event.status
+		<< L" " << event.durationUs << L" us";
+
+	return common::string::ToAnsi(ss.str());
+}
+
+void RouteEventLog::append(const Event &event)
+{
+	AutoLockType lock(m_lock);
+
+	m_events[static_cast<size_t>(m_numRecorded % m_events.size())] = event;
+	++m_numRecorded;
+}
+
+}
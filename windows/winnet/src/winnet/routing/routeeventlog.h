@@ -0,0 +1,101 @@
+#pragma once
+
+#include "routetable.h"
+#include <windows.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace winnet::routing
+{
+
+//
+// Fixed size ring of the most recent changes that the route manager made to the
+// routing table, for problem reports.
+//
+// Events are compact binary records, and are only formatted when the log is dumped,
+// so recording stays cheap when many routes are changed at once.
+//
+class RouteEventLog
+{
+public:
+
+	enum class Operation : uint8_t
+	{
+		// Route registered in the routing table.
+		Create = 0,
+
+		// Route registered again, during rollback or when following the default route.
+		Restore = 1,
+
+		Delete = 2,
+
+		// Deletion requested for a route that the route manager doesn't own.
+		DeleteUnregistered = 3,
+	};
+
+	struct Event
+	{
+		// FILETIME, UTC.
+		uint64_t timestamp;
+
+		uint64_t luid;
+
+		uint8_t prefix[16];
+
+		// Win32 error code.
+		uint32_t status;
+		uint32_t durationUs;
+
+		Operation operation;
+		uint8_t family;
+		uint8_t prefixLength;
+		uint8_t reserved;
+	};
+
+	static_assert(48 == sizeof(Event));
+
+	explicit RouteEventLog(size_t capacity);
+
+	RouteEventLog(const RouteEventLog &) = delete;
+	RouteEventLog &operator=(const RouteEventLog &) = delete;
+
+	using Clock = std::chrono::steady_clock;
+
+	//
+	// The duration is measured from 'start' until the call.
+	//
+	void record(Operation operation, const RegisteredRoute &route, DWORD status, Clock::time_point start);
+	void record(Operation operation, const Network &network, DWORD status);
+
+	//
+	// Events in the order they were recorded, oldest first.
+	//
+	std::vector<Event> events() const;
+
+	//
+	// Number of events that were overwritten before they could be dumped.
+	//
+	uint64_t dropped() const;
+
+	//
+	// Invoke the sink once for each event, with a line of text, oldest first.
+	//
+	void dump(const std::function<void(const std::string &)> &sink) const;
+
+	static std::string FormatEvent(const Event &event);
+
+private:
+
+	void append(const Event &event);
+
+	mutable std::mutex m_lock;
+
+	std::vector<Event> m_events;
+	uint64_t m_numRecorded;
+};
+
+}
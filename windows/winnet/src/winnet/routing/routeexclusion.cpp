@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "routeexclusion.h"
+#include <libcommon/error.h>
+#include <algorithm>
+#include <array>
+#include <tuple>
+
+namespace winnet::routing
+{
+
+namespace
+{
+
+struct Prefix
+{
+	std::array<uint8_t, sizeof(IN6_ADDR)> bytes;
+	uint8_t length;
+
+	//
+	// Ordered on address and then least specific first, so a network is
+	// always visited before the networks it contains.
+	//
+	bool operator<(const Prefix &rhs) const
+	{
+		return std::tie(bytes, length) < std::tie(rhs.bytes, rhs.length);
+	}
+};
+
+size_t AddressLength(ADDRESS_FAMILY family)
+{
+	switch (family)
+	{
+		case AF_INET:
+		{
+			return sizeof(IN_ADDR);
+		}
+		case AF_INET6:
+		{
+			return sizeof(IN6_ADDR);
+		}
+		default:
+		{
+			THROW_ERROR("Invalid address family for network address");
+		}
+	}
+}
+
+size_t Bit(const Prefix &prefix, size_t bit)
+{
+	return (prefix.bytes[bit / 8] >> (7 - (bit % 8))) & 1;
+}
+
+bool Covers(const Prefix &outer, const Prefix &inner)
+{
+	if (outer.length > inner.length)
+	{
+		return false;
+	}
+
+	for (size_t bit = 0; bit < outer.length; ++bit)
+	{
+		if (Bit(outer, bit) != Bit(inner, bit))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// Bits past the prefix length are cleared, so e.g. 10.1.2.3/8 excludes 10.0.0.0/8.
+//
+Prefix MakePrefix(const Network &network)
+{
+	const auto family = network.Prefix.si_family;
+	const auto bits = AddressLength(family) * 8;
+
+	if (network.PrefixLength > bits)
+	{
+		THROW_ERROR("Invalid prefix length for excluded network");
+	}
+
+	Prefix prefix = { { 0 }, network.PrefixLength };
+
+	const auto address = (AF_INET == family
+		? reinterpret_cast<const uint8_t *>(&network.Prefix.Ipv4.sin_addr)
+		: reinterpret_cast<const uint8_t *>(&network.Prefix.Ipv6.sin6_addr));
+
+	std::copy(address, address + AddressLength(family), prefix.bytes.begin());
+
+	for (size_t bit = prefix.length; bit < bits; ++bit)
+	{
+		prefix.bytes[bit / 8] &= ~static_cast<uint8_t>(0x80 >> (bit % 8));
+	}
+
+	return prefix;
+}
+
+Network MakeNetwork(ADDRESS_FAMILY family, const Prefix &prefix)
+{
+	Network network = { 0 };
+
+	network.Prefix.si_family = family;
+	network.PrefixLength = prefix.length;
+
+	const auto address = (AF_INET == family
+		? reinterpret_cast<uint8_t *>(&network.Prefix.Ipv4.sin_addr)
+		: reinterpret_cast<uint8_t *>(&network.Prefix.Ipv6.sin6_addr));
+
+	std::copy(prefix.bytes.begin(), prefix.bytes.begin() + AddressLength(family), address);
+
+	return network;
+}
+
+using Iterator = std::vector<Prefix>::const_iterator;
+
+//
+// Walks the sorted exclusions as an implicit binary trie. [first, last) are the
+// exclusions within 'prefix'. A network is emitted as soon as it doesn't contain
+// any exclusion, so no two emitted networks can be merged into one.
+//
+void Complement(ADDRESS_FAMILY family, const Prefix &prefix, Iterator first, Iterator last,
+	std::vector<Network> &out)
+{
+	if (first == last)
+	{
+		out.push_back(MakeNetwork(family, prefix));
+		return;
+	}
+
+	//
+	// Exclusions don't overlap, so one that is not more specific than the
+	// prefix is the only one in the range, and covers all of it.
+	//
+
+	if (first->length <= prefix.length)
+	{
+		return;
+	}
+
+	const auto bit = prefix.length;
+
+	const auto middle = std::partition_point(first, last, [bit](const Prefix &excluded)
+	{
+		return 0 == Bit(excluded, bit);
+	});
+
+	auto lower = prefix;
+	lower.length = static_cast<uint8_t>(bit + 1);
+
+	auto upper = lower;
+	upper.bytes[bit / 8] |= static_cast<uint8_t>(0x80 >> (bit % 8));
+
+	Complement(family, lower, first, middle, out);
+	Complement(family, upper, middle, last, out);
+}
+
+} // anonymous namespace
+
+std::vector<Network> ComplementNetworks(ADDRESS_FAMILY family, const std::vector<Network> &excluded)
+{
+	if (AF_INET != family && AF_INET6 != family)
+	{
+		THROW_ERROR("Invalid address family for complement networks");
+	}
+
+	std::vector<Prefix> prefixes;
+
+	for (const auto &network : excluded)
+	{
+		if (network.Prefix.si_family == family)
+		{
+			prefixes.push_back(MakePrefix(network));
+		}
+	}
+
+	std::sort(prefixes.begin(), prefixes.end());
+
+	//
+	// Drop exclusions that are contained in an earlier one, including duplicates.
+	//
+
+	std::vector<Prefix> disjoint;
+	disjoint.reserve(prefixes.size());
+
+	for (const auto &prefix : prefixes)
+	{
+		if (disjoint.empty() || false == Covers(disjoint.back(), prefix))
+		{
+			disjoint.push_back(prefix);
+		}
+	}
+
+	std::vector<Network> networks;
+
+	if (false == disjoint.empty() && 0 == disjoint.front().length)
+	{
+		return networks;
+	}
+
+	//
+	// Start below the root, so the default network is never emitted.
+	//
+
+	Prefix lower = { { 0 }, 1 };
+
+	auto upper = lower;
+	upper.bytes[0] = 0x80;
+
+	const auto middle = std::partition_point(disjoint.cbegin(), disjoint.cend(), [](const Prefix &excluded)
+	{
+		return 0 == Bit(excluded, 0);
+	});
+
+	Complement(family, lower, disjoint.cbegin(), middle, networks);
+	Complement(family, upper, middle, disjoint.cend(), networks);
+
+	return networks;
+}
+
+}
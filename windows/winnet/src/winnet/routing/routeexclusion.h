@@ -0,0 +1,21 @@
+#pragma once
+
+#include "types.h"
+#include <vector>
+
+namespace winnet::routing
+{
+
+//
+// Smallest set of networks that covers the address space of 'family', except for the
+// networks in 'excluded'. Excluded networks of other families are ignored.
+//
+// The space is always split at the top, so the result never includes the default
+// network. Without exclusions the result is 0.0.0.0/1 and 128.0.0.0/1, or ::/1 and
+// 8000::/1, which take precedence over the default route without replacing it.
+//
+// Networks are returned in address order.
+//
+std::vector<Network> ComplementNetworks(ADDRESS_FAMILY family, const std::vector<Network> &excluded);
+
+}
@@ -0,0 +1,321 @@
+#include "stdafx.h"
+#include "routejournal.h"
+#include <libcommon/error.h>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+namespace winnet::routing
+{
+
+namespace
+{
+
+const uint32_t JOURNAL_MAGIC = 0x4a52564d; // "MVRJ"
+const uint32_t JOURNAL_VERSION = 2;
+
+//
+// Set as the entry count while entries are being written.
+//
+const uint32_t JOURNAL_COUNT_INCOMPLETE = ~uint32_t(0);
+
+const uint32_t INITIAL_CAPACITY = 256;
+
+enum EntryFlags : uint32_t
+{
+	ENTRY_FLAG_NODE_DEVICE_NAME = 1 << 0,
+	ENTRY_FLAG_NODE_GATEWAY = 1 << 1,
+	ENTRY_FLAG_NODE_LUID = 1 << 2,
+};
+
+} // anonymous namespace
+
+struct RouteJournal::Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct RouteJournal::Entry
+{
+	Network network;
+	NET_LUID luid;
+	NodeAddress nextHop;
+
+	uint32_t flags;
+	NET_LUID nodeLuid;
+	NodeAddress nodeGateway;
+	wchar_t nodeDeviceName[IF_MAX_STRING_SIZE + 1];
+};
+
+RouteJournal::RouteJournal(const std::wstring &path)
+	: m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(nullptr)
+	, m_view(nullptr)
+	, m_capacity(0)
+{
+	m_file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (INVALID_HANDLE_VALUE == m_file)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Open route journal");
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if (FALSE == GetFileSizeEx(m_file, &fileSize))
+	{
+		const auto error = GetLastError();
+		CloseHandle(m_file);
+
+		THROW_WINDOWS_ERROR(error, "Determine size of route journal");
+	}
+
+	uint32_t capacity = INITIAL_CAPACITY;
+
+	if (static_cast<uint64_t>(fileSize.QuadPart) > sizeof(Header))
+	{
+		const auto existing = (static_cast<uint64_t>(fileSize.QuadPart) - sizeof(Header)) / sizeof(Entry);
+
+		capacity = static_cast<uint32_t>(std::clamp<uint64_t>(existing, INITIAL_CAPACITY, UINT32_MAX - 1));
+	}
+
+	try
+	{
+		map(capacity);
+	}
+	catch (...)
+	{
+		CloseHandle(m_file);
+		throw;
+	}
+
+	auto h = header();
+
+	if (JOURNAL_MAGIC != h->magic || JOURNAL_VERSION != h->version)
+	{
+		h->magic = JOURNAL_MAGIC;
+		h->version = JOURNAL_VERSION;
+		h->count = 0;
+		h->reserved = 0;
+	}
+}
+
+RouteJournal::~RouteJournal()
+{
+	unmap();
+	CloseHandle(m_file);
+}
+
+std::vector<RouteRecord> RouteJournal::load() const
+{
+	const auto count = header()->count;
+
+	if (count > m_capacity)
+	{
+		return {};
+	}
+
+	std::vector<RouteRecord> records;
+	records.reserve(count);
+
+	const auto entry = entries();
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const auto &e = entry[i];
+
+		std::optional<Node> node;
+
+		if (0 != (e.flags & ENTRY_FLAG_NODE_LUID))
+		{
+			std::optional<NodeAddress> gateway;
+
+			if (0 != (e.flags & ENTRY_FLAG_NODE_GATEWAY))
+			{
+				gateway = e.nodeGateway;
+			}
+
+			node = Node(e.nodeLuid, gateway);
+		}
+		else if (0 != (e.flags & (ENTRY_FLAG_NODE_DEVICE_NAME | ENTRY_FLAG_NODE_GATEWAY)))
+		{
+			std::optional<std::wstring> deviceName;
+			std::optional<NodeAddress> gateway;
+
+			if (0 != (e.flags & ENTRY_FLAG_NODE_DEVICE_NAME))
+			{
+				deviceName = std::wstring(e.nodeDeviceName, wcsnlen(e.nodeDeviceName, _countof(e.nodeDeviceName)));
+			}
+
+			if (0 != (e.flags & ENTRY_FLAG_NODE_GATEWAY))
+			{
+				gateway = e.nodeGateway;
+			}
+
+			try
+			{
+				node = Node(deviceName, gateway);
+			}
+			catch (...)
+			{
+				continue;
+			}
+		}
+
+		records.emplace_back(RouteRecord{ Route(e.network, node), RegisteredRoute{ e.network, e.luid, e.nextHop } });
+	}
+
+	return records;
+}
+
+void RouteJournal::store(const RouteTable &routes)
+{
+	if (nullptr == m_view)
+	{
+		THROW_ERROR("Route journal is not mapped");
+	}
+
+	if (routes.size() > m_capacity)
+	{
+		const auto previousCapacity = m_capacity;
+		const auto capacity = static_cast<uint32_t>(std::max<size_t>(routes.size(), size_t(m_capacity) * 2));
+
+		unmap();
+
+		try
+		{
+			map(capacity);
+		}
+		catch (...)
+		{
+			map(previousCapacity);
+			throw;
+		}
+	}
+
+	auto h = header();
+
+	h->count = JOURNAL_COUNT_INCOMPLETE;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const auto entry = entries();
+	uint32_t count = 0;
+
+	for (const auto &record : routes)
+	{
+		auto &e = entry[count];
+
+		std::memset(&e, 0, sizeof(e));
+
+		e.network = record.registeredRoute.network;
+		e.luid = record.registeredRoute.luid;
+		e.nextHop = record.registeredRoute.nextHop;
+
+		const auto &node = record.route.node();
+
+		if (node.has_value())
+		{
+			if (node->luid().has_value())
+			{
+				e.nodeLuid = node->luid().value();
+				e.flags |= ENTRY_FLAG_NODE_LUID;
+			}
+
+			if (node->deviceName().has_value())
+			{
+				const auto &deviceName = node->deviceName().value();
+
+				if (deviceName.size() >= _countof(e.nodeDeviceName))
+				{
+					continue;
+				}
+
+				std::memcpy(e.nodeDeviceName, deviceName.c_str(), deviceName.size() * sizeof(wchar_t));
+				e.flags |= ENTRY_FLAG_NODE_DEVICE_NAME;
+			}
+
+			if (node->gateway().has_value())
+			{
+				e.nodeGateway = node->gateway().value();
+				e.flags |= ENTRY_FLAG_NODE_GATEWAY;
+			}
+		}
+
+		++count;
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+	h->count = count;
+}
+
+void RouteJournal::clear()
+{
+	if (nullptr != m_view)
+	{
+		header()->count = 0;
+	}
+}
+
+RouteJournal::Header *RouteJournal::header() const
+{
+	return reinterpret_cast<Header *>(m_view);
+}
+
+RouteJournal::Entry *RouteJournal::entries() const
+{
+	return reinterpret_cast<Entry *>(m_view + sizeof(Header));
+}
+
+void RouteJournal::map(uint32_t capacity)
+{
+	const auto size = sizeof(Header) + static_cast<uint64_t>(capacity) * sizeof(Entry);
+
+	//
+	// The file is extended to the size of the mapping, if it's shorter.
+	//
+
+	m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+
+	if (nullptr == m_mapping)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Create route journal mapping");
+	}
+
+	m_view = reinterpret_cast<uint8_t *>(MapViewOfFile(m_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0));
+
+	if (nullptr == m_view)
+	{
+		const auto error = GetLastError();
+
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+
+		THROW_WINDOWS_ERROR(error, "Map route journal");
+	}
+
+	m_capacity = capacity;
+}
+
+void RouteJournal::unmap()
+{
+	if (nullptr != m_view)
+	{
+		UnmapViewOfFile(m_view);
+		m_view = nullptr;
+	}
+
+	if (nullptr != m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+
+	m_capacity = 0;
+}
+
+}
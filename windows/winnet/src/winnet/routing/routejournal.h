@@ -0,0 +1,62 @@
+#pragma once
+
+#include "routetable.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace winnet::routing
+{
+
+//
+// Memory mapped record of the routes registered by a route manager.
+//
+// The journal is rewritten whenever the set of routes changes. The mapping is backed
+// by a file, so the contents survive the process terminating unexpectedly, and the
+// next route manager can adopt routes that are still present in the routing table
+// rather than recreating them.
+//
+class RouteJournal
+{
+public:
+
+	// Opens the journal, creating the file if it doesn't exist.
+	explicit RouteJournal(const std::wstring &path);
+	~RouteJournal();
+
+	RouteJournal(const RouteJournal &) = delete;
+	RouteJournal &operator=(const RouteJournal &) = delete;
+
+	//
+	// Records in the journal.
+	// A journal that is corrupt, or was being written when the process died, reads as empty.
+	//
+	std::vector<RouteRecord> load() const;
+
+	//
+	// Replace the contents of the journal.
+	// Routes whose node cannot be represented in the journal are left out.
+	//
+	void store(const RouteTable &routes);
+
+	void clear();
+
+private:
+
+	struct Header;
+	struct Entry;
+
+	HANDLE m_file;
+	HANDLE m_mapping;
+	uint8_t *m_view;
+
+	uint32_t m_capacity;
+
+	Header *header() const;
+	Entry *entries() const;
+
+	void map(uint32_t capacity);
+	void unmap();
+};
+
+}
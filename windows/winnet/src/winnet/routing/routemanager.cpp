@@ -1,17 +1,23 @@
 #include "stdafx.h"
 #include "routemanager.h"
 #include "helpers.h"
+#include "gatewayresolver.h"
+#include "routeexclusion.h"
 #include <libcommon/error.h>
 #include <libcommon/memory.h>
 #include <libcommon/string.h>
-#include <libcommon/network/adapters.h>
+#include <libshared/logging/lazylog.h>
+#include <libshared/network/aliascache.h>
+#include <libshared/performance/counterregistry.h>
+#include <libshared/tracing/trace.h>
 #include <vector>
 #include <algorithm>
 #include <numeric>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 using AutoLockType = std::scoped_lock<std::mutex>;
-using AutoRecursiveLockType = std::scoped_lock<std::recursive_mutex>;
 using namespace std::placeholders;
 
 namespace winnet::routing
@@ -20,63 +26,10 @@ namespace winnet::routing
 namespace
 {
 
-using Adapters = common::network::Adapters;
-
-NET_LUID InterfaceLuidFromGateway(const NodeAddress &gateway)
-{
-	const DWORD adapterFlags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER
-		| GAA_FLAG_SKIP_FRIENDLY_NAME | GAA_FLAG_INCLUDE_GATEWAYS;
-
-	Adapters adapters(gateway.si_family, adapterFlags);
-
-	//
-	// Process adapters to find matching ones.
-	//
-
-	std::vector<const IP_ADAPTER_ADDRESSES *> matches;
-
-	for (auto adapter = adapters.next(); nullptr != adapter; adapter = adapters.next())
-	{
-		if (false == AdapterInterfaceEnabled(adapter, gateway.si_family))
-		{
-			continue;
-		}
-
-		auto gateways = IsolateGatewayAddresses(adapter->FirstGatewayAddress, gateway.si_family);
-
-		if (AddressPresent(gateways, &gateway))
-		{
-			matches.emplace_back(adapter);
-		}
-	}
-
-	if (matches.empty())
-	{
-		THROW_ERROR("Unable to find network adapter with specified gateway");
-	}
-
-	//
-	// Sort matching interfaces ascending by metric.
-	//
-
-	const bool targetV4 = (AF_INET == gateway.si_family);
-
-	std::sort(matches.begin(), matches.end(), [&targetV4](const IP_ADAPTER_ADDRESSES *lhs, const IP_ADAPTER_ADDRESSES *rhs)
-	{
-		if (targetV4)
-		{
-			return lhs->Ipv4Metric < rhs->Ipv4Metric;
-		}
-
-		return lhs->Ipv6Metric < rhs->Ipv6Metric;
-	});
-
-	//
-	// Select the interface with the best (lowest) metric.
-	//
-
-	return matches[0]->Luid;
-}
+//
+// Enough for a few connects worth of routes.
+//
+constexpr size_t ROUTE_EVENT_LOG_CAPACITY = 1024;
 
 bool ParseStringEncodedLuid(const std::wstring &encodedLuid, NET_LUID &luid)
 {
@@ -112,12 +65,14 @@ bool ParseStringEncodedLuid(const std::wstring &encodedLuid, NET_LUID &luid)
 	return true;
 }
 
-InterfaceAndGateway ResolveNode(ADDRESS_FAMILY family, const std::optional<Node> &optionalNode)
+InterfaceAndGateway ResolveNode(ADDRESS_FAMILY family, const std::optional<Node> &optionalNode,
+	GatewayResolver &gatewayResolver, RouteManager::IDataProvider &dataProvider)
 {
 	//
-	// There are four cases:
+	// There are five cases:
 	//
 	// Unspecified node (use interface and gateway of default route).
+	// Node is specified by LUID, with or without gateway.
 	// Node is specified by name.
 	// Node is specified by name and gateway.
 	// Node is specified by gateway.
@@ -125,18 +80,31 @@ InterfaceAndGateway ResolveNode(ADDRESS_FAMILY family, const std::optional<Node>
 
 	if (false == optionalNode.has_value())
 	{
-		return GetBestDefaultRoute(family);
+		return dataProvider.getBestDefaultRoute(family);
 	}
 
 	const auto &node = optionalNode.value();
 
+	auto onLinkProvider = [&family]()
+	{
+		NodeAddress onLink = { 0 };
+		onLink.si_family = family;
+
+		return onLink;
+	};
+
+	if (node.luid().has_value())
+	{
+		return InterfaceAndGateway{ node.luid().value(), node.gateway().value_or(onLinkProvider()) };
+	}
+
 	if (node.deviceName().has_value())
 	{
 		const auto &deviceName = node.deviceName().value();
 		NET_LUID luid;
 
 		if (false == ParseStringEncodedLuid(deviceName, luid)
-			&& 0 != ConvertInterfaceAliasToLuid(deviceName.c_str(), &luid))
+			&& 0 != shared::network::InterfaceAliasCache::Instance().resolve(deviceName, luid))
 		{
 			const auto msg = std::string("Unable to derive interface LUID from interface alias: ")
 				.append(common::string::ToAnsi(deviceName));
@@ -144,14 +112,6 @@ InterfaceAndGateway ResolveNode(ADDRESS_FAMILY family, const std::optional<Node>
 			THROW_ERROR(msg.c_str());
 		}
 
-		auto onLinkProvider = [&family]()
-		{
-			NodeAddress onLink = { 0 };
-			onLink.si_family = family;
-
-			return onLink;
-		};
-
 		return InterfaceAndGateway{ luid, node.gateway().value_or(onLinkProvider()) };
 	}
 
@@ -159,7 +119,54 @@ InterfaceAndGateway ResolveNode(ADDRESS_FAMILY family, const std::optional<Node>
 	// The node is specified only by gateway.
 	//
 
-	return InterfaceAndGateway{ InterfaceLuidFromGateway(node.gateway().value()), node.gateway().value() };
+	return InterfaceAndGateway{ gatewayResolver.resolve(node.gateway().value()), node.gateway().value() };
+}
+
+void InitializeOwnedRoute(MIB_IPFORWARD_ROW2 &spec, NET_LUID luid, const Network &network, const NodeAddress &nextHop)
+{
+	InitializeIpForwardEntry(&spec);
+
+	spec.InterfaceLuid = luid;
+	spec.DestinationPrefix = network;
+	spec.NextHop = nextHop;
+	spec.Metric = 0;
+	spec.Protocol = MIB_IPPROTO_NETMGMT;
+	spec.Origin = NlroManual;
+}
+
+using JournaledRoutes = std::unordered_map<Network, RegisteredRoute, RouteTable::NetworkHash, RouteTable::NetworkEqual>;
+
+JournaledRoutes IndexJournaledRoutes(const std::vector<RouteRecord> &records)
+{
+	JournaledRoutes journaled;
+	journaled.reserve(records.size());
+
+	for (const auto &record : records)
+	{
+		journaled.emplace(record.registeredRoute.network, record.registeredRoute);
+	}
+
+	return journaled;
+}
+
+//
+// Nothing in the routing table marks a route as added by a route manager. A route is
+// only considered ours if it matches a journaled route exactly, i.e. the destination,
+// interface and next hop are all the same. Routes that other software or the user
+// added for the same network are left alone.
+//
+bool IsJournaledRoute(const JournaledRoutes &journaled, const MIB_IPFORWARD_ROW2 &route)
+{
+	if (MIB_IPPROTO_NETMGMT != route.Protocol || NlroManual != route.Origin)
+	{
+		return false;
+	}
+
+	const auto match = journaled.find(route.DestinationPrefix);
+
+	return journaled.end() != match
+		&& match->second.luid.Value == route.InterfaceLuid.Value
+		&& EqualAddress(match->second.nextHop, route.NextHop);
 }
 
 // TODO: Move to libcommon
@@ -174,40 +181,105 @@ uint32_t ByteSwap(uint32_t val)
 	);
 }
 
-std::wstring FormatNetwork(const Network &network)
+std::vector<AggregatedRoute> Unaggregated(const std::vector<Route> &routes)
 {
-	switch (network.Prefix.si_family)
+	std::vector<AggregatedRoute> unaggregated;
+	unaggregated.reserve(routes.size());
+
+	for (const auto &route : routes)
 	{
-		case AF_INET:
-		{
-			return common::string::FormatIpv4(ByteSwap(network.Prefix.Ipv4.sin_addr.s_addr), network.PrefixLength);
-		}
-		case AF_INET6:
-		{
-			return common::string::FormatIpv6(network.Prefix.Ipv6.sin6_addr.u.Byte, network.PrefixLength);
-		}
-		default:
+		unaggregated.emplace_back(AggregatedRoute{ route, {} });
+	}
+
+	return unaggregated;
+}
+
+//
+// Keep only the last route for each network, so a batch never creates two routes
+// for the same network. Routes are otherwise kept in order.
+//
+std::vector<Route> LastRoutePerNetwork(const std::vector<Route> &routes)
+{
+	std::unordered_map<Network, size_t, RouteTable::NetworkHash, RouteTable::NetworkEqual> last;
+	last.reserve(routes.size());
+
+	for (size_t i = 0; i < routes.size(); ++i)
+	{
+		last[routes[i].network()] = i;
+	}
+
+	std::vector<Route> unique;
+	unique.reserve(last.size());
+
+	for (size_t i = 0; i < routes.size(); ++i)
+	{
+		if (i == last[routes[i].network()])
 		{
-			return L"Failed to format network details";
+			unique.push_back(routes[i]);
 		}
 	}
+
+	return unique;
 }
 
 } // anonymous namespace
 
-RouteManager::RouteManager(std::shared_ptr<common::logging::ILogSink> logSink)
+RouteManager::RouteManager(std::shared_ptr<common::logging::ILogSink> logSink, std::shared_ptr<IDataProvider> dataProvider)
 	: m_logSink(logSink)
-	, m_routeMonitorV4(std::make_unique<DefaultRouteMonitor>(
-		static_cast<ADDRESS_FAMILY>(AF_INET),
-		std::bind(&RouteManager::defaultRouteChanged, this, static_cast<ADDRESS_FAMILY>(AF_INET), _1, _2),
-		logSink
-	))
-	, m_routeMonitorV6(std::make_unique<DefaultRouteMonitor>(
-		static_cast<ADDRESS_FAMILY>(AF_INET6),
-		std::bind(&RouteManager::defaultRouteChanged, this, static_cast<ADDRESS_FAMILY>(AF_INET6), _1, _2),
+	, m_dataProvider(dataProvider)
+	, m_defaultRouteCallbacks(std::make_shared<const CallbackList>())
+	, m_dispatchingThread(std::thread::id())
+	, m_routeMonitor(m_dataProvider->createDefaultRouteMonitor(
+		std::bind(&RouteManager::defaultRouteChanged, this, _1),
 		logSink
 	))
+	, m_snapshot(std::make_shared<const RouteSnapshot>())
+	, m_detached(false)
+	, m_aggregateRoutes(false)
+	, m_restoreBudget(0)
+	, m_gatewayResolver(std::make_unique<GatewayResolver>())
+	, m_events(ROUTE_EVENT_LOG_CAPACITY)
+{
+}
+
+RouteManager::RouteManager(std::shared_ptr<common::logging::ILogSink> logSink)
+	: RouteManager(logSink, std::make_shared<SystemDataProvider>())
+{
+}
+
+void RouteManager::detach()
 {
+	AutoLockType lock(m_routesLock);
+
+	if (nullptr == m_journal)
+	{
+		THROW_ERROR("Cannot detach route manager without a journal");
+	}
+
+	syncJournal();
+
+	m_detached = true;
+}
+
+RouteManager::RouteManager(std::shared_ptr<common::logging::ILogSink> logSink, std::unique_ptr<RouteJournal> journal)
+	: RouteManager(logSink, std::make_shared<SystemDataProvider>(), std::move(journal))
+{
+}
+
+RouteManager::RouteManager
+(
+	std::shared_ptr<common::logging::ILogSink> logSink,
+	std::shared_ptr<IDataProvider> dataProvider,
+	std::unique_ptr<RouteJournal> journal
+)
+	: RouteManager(logSink, dataProvider)
+{
+	AutoLockType lock(m_routesLock);
+
+	m_journal = std::move(journal);
+
+	adoptJournaledRoutes();
+	publishChanges();
 }
 
 RouteManager::~RouteManager()
@@ -216,8 +288,16 @@ RouteManager::~RouteManager()
 	// Stop callbacks that are triggered by events in Windows from coming in.
 	//
 
-	m_routeMonitorV4.reset();
-	m_routeMonitorV6.reset();
+	m_routeMonitor.reset();
+
+	//
+	// Leave routes for the next route manager to adopt.
+	//
+
+	if (m_detached)
+	{
+		return;
+	}
 
 	//
 	// Delete all routes owned by us.
@@ -240,48 +320,113 @@ RouteManager::~RouteManager()
 			m_logSink->error(ex.what());
 		}
 	}
+
+	if (m_journal)
+	{
+		m_journal->clear();
+	}
 }
 
 void RouteManager::addRoutes(const std::vector<Route> &routes)
 {
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winnet.routes.add");
+
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordRouting);
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	bool success = false;
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&]()
+	{
+		shared::tracing::RoutesAdded(stopwatch, routes.size(), success);
+	};
+
 	AutoLockType lock(m_routesLock);
 
-	std::vector<EventEntry> eventLog;
+	common::memory::ScopeDestructor publish;
 
-	for (const auto &route : routes)
+	publish += [this]()
 	{
-		try
-		{
-			auto record = findRouteRecord(route);
+		publishChanges();
+	};
 
-			if (record != m_routes.end())
-			{
-				deleteFromRoutingTable(record->registeredRoute);
-				eventLog.emplace_back(EventEntry{ EventType::DELETE_ROUTE, *record });
-				m_routes.erase(record);
-			}
+	std::vector<EventEntry> eventLog;
 
-			const RouteRecord newRecord { route, addIntoRoutingTable(route) };
+	auto &gatewayResolver = *m_gatewayResolver;
 
-			eventLog.emplace_back(EventEntry{ EventType::ADD_ROUTE, newRecord });
-			m_routes.emplace_back(std::move(newRecord));
+	try
+	{
+		//
+		// Routes that were aggregated with any of the new routes are added again,
+		// and may be aggregated differently this time.
+		//
+
+		auto released = releaseAggregates(routes, eventLog);
+
+		if (released.empty())
+		{
+			installRoutes(routes, eventLog, gatewayResolver);
 		}
-		catch (...)
+		else
 		{
-			undoEvents(eventLog);
-
-			THROW_ERROR("Failed during batch insertion of routes");
+			released.insert(released.end(), routes.begin(), routes.end());
+			installRoutes(released, eventLog, gatewayResolver);
 		}
 	}
+	catch (...)
+	{
+		undoEvents(eventLog);
+
+		THROW_ERROR("Failed during batch insertion of routes");
+	}
+
+	success = true;
 }
 
 void RouteManager::addRoute(const Route &route)
 {
 	AutoLockType lock(m_routesLock);
 
+	common::memory::ScopeDestructor publish;
+
+	publish += [this]()
+	{
+		publishChanges();
+	};
+
+	if (m_routes.hasAggregates())
+	{
+		std::vector<EventEntry> eventLog;
+		auto &gatewayResolver = *m_gatewayResolver;
+
+		try
+		{
+			auto routes = releaseAggregates({ route }, eventLog);
+			routes.push_back(route);
+
+			installRoutes(routes, eventLog, gatewayResolver);
+		}
+		catch (...)
+		{
+			undoEvents(eventLog);
+
+			THROW_ERROR("Failed to add route");
+		}
+
+		return;
+	}
+
 	std::optional<RouteRecord> deletedRecord;
 
-	auto record = findRouteRecord(route);
+	auto record = m_routes.find(route.network());
+
+	if (record != m_routes.end() && record->adopted && record->route == route)
+	{
+		record->adopted = false;
+		return;
+	}
 
 	if (record != m_routes.end())
 	{
@@ -300,9 +445,11 @@ void RouteManager::addRoute(const Route &route)
 
 	try
 	{
-		m_routes.emplace_back
+		auto &gatewayResolver = *m_gatewayResolver;
+
+		m_routes.insert
 		(
-			RouteRecord{ route, addIntoRoutingTable(route) }
+			RouteRecord{ route, addIntoRoutingTable(route, gatewayResolver) }
 		);
 	}
 	catch (...)
@@ -318,7 +465,7 @@ void RouteManager::addRoute(const Route &route)
 			try
 			{
 				restoreIntoRoutingTable(r.registeredRoute);
-				m_routes.emplace_back(r);
+				m_routes.insert(r);
 			}
 			catch (const std::exception &ex)
 			{
@@ -337,22 +484,47 @@ void RouteManager::addRoute(const Route &route)
 
 void RouteManager::deleteRoutes(const std::vector<Route> &routes)
 {
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winnet.routes.delete");
+
+	const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordRouting);
+	const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+	bool success = false;
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&]()
+	{
+		shared::tracing::RoutesDeleted(stopwatch, routes.size(), success);
+	};
+
 	AutoLockType lock(m_routesLock);
 
+	common::memory::ScopeDestructor publish;
+
+	publish += [this]()
+	{
+		publishChanges();
+	};
+
 	std::vector<EventEntry> eventLog;
+	std::vector<Route> aggregated;
 
 	for (const auto &route : routes)
 	{
 		try
 		{
-			auto record = findRouteRecord(route);
-
-			if (m_routes.end() == record)
+			if (m_routes.end() != m_routes.findAggregate(route.network()))
 			{
-				const auto err = std::wstring(L"Request to delete previously unregistered route: ")
-					.append(FormatNetwork(route.network()));
+				aggregated.push_back(route);
+				continue;
+			}
+
+			auto record = m_routes.find(route.network());
 
-				m_logSink->warning(common::string::ToAnsi(err).c_str());
+			if (m_routes.end() == record || false == record->members.empty())
+			{
+				m_events.record(RouteEventLog::Operation::DeleteUnregistered, route.network(), ERROR_NOT_FOUND);
 
 				continue;
 			}
@@ -368,110 +540,529 @@ void RouteManager::deleteRoutes(const std::vector<Route> &routes)
 			THROW_ERROR("Failed during batch removal of routes");
 		}
 	}
-}
-
-void RouteManager::deleteRoute(const Route &route)
-{
-	AutoLockType lock(m_routesLock);
 
-	auto record = findRouteRecord(route);
-
-	if (m_routes.end() == record)
+	if (false == aggregated.empty())
 	{
-		const auto err = std::wstring(L"Request to delete previously unregistered route: ")
-			.append(FormatNetwork(route.network()));
+		try
+		{
+			auto &gatewayResolver = *m_gatewayResolver;
 
-		m_logSink->warning(common::string::ToAnsi(err).c_str());
+			installRoutes(releaseAggregates(aggregated, eventLog), eventLog, gatewayResolver);
+		}
+		catch (...)
+		{
+			undoEvents(eventLog);
 
-		return;
+			THROW_ERROR("Failed to split aggregated routes");
+		}
 	}
 
-	deleteFromRoutingTable(record->registeredRoute);
-	m_routes.erase(record);
+	success = true;
 }
 
-RouteManager::CallbackHandle RouteManager::registerDefaultRouteChangedCallback(DefaultRouteChangedCallback callback)
+void RouteManager::deleteRoute(const Route &route)
 {
-	AutoRecursiveLockType lock(m_defaultRouteCallbacksLock);
-
-	m_defaultRouteCallbacks.emplace_back(callback);
+	AutoLockType lock(m_routesLock);
 
-	// Return raw address of record in list.
-	return &m_defaultRouteCallbacks.back();
-}
+	common::memory::ScopeDestructor publish;
 
-void RouteManager::unregisterDefaultRouteChangedCallback(CallbackHandle handle)
-{
-	AutoRecursiveLockType lock(m_defaultRouteCallbacksLock);
+	publish += [this]()
+	{
+		publishChanges();
+	};
 
-	for (auto it = m_defaultRouteCallbacks.begin(); it != m_defaultRouteCallbacks.end(); ++it)
+	if (m_routes.end() != m_routes.findAggregate(route.network()))
 	{
-		// Match on raw address of record.
-		if (&*it == handle)
+		std::vector<EventEntry> eventLog;
+		auto &gatewayResolver = *m_gatewayResolver;
+
+		try
 		{
-			m_defaultRouteCallbacks.erase(it);
-			return;
+			installRoutes(releaseAggregates({ route }, eventLog), eventLog, gatewayResolver);
+		}
+		catch (...)
+		{
+			undoEvents(eventLog);
+
+			THROW_ERROR("Failed to split aggregated route");
 		}
+
+		return;
 	}
-}
 
-std::list<RouteManager::RouteRecord>::iterator RouteManager::findRouteRecord(const Network &network)
-{
-	return std::find_if(m_routes.begin(), m_routes.end(), [&network](const auto &candidate)
+	auto record = m_routes.find(route.network());
+
+	if (m_routes.end() == record || false == record->members.empty())
 	{
-		return EqualAddress(network, candidate.route.network());
-	});
-}
+		m_events.record(RouteEventLog::Operation::DeleteUnregistered, route.network(), ERROR_NOT_FOUND);
 
-std::list<RouteManager::RouteRecord>::iterator RouteManager::findRouteRecord(const Route &route)
-{
-	return findRouteRecord(route.network());
+		return;
+	}
+
+	deleteFromRoutingTable(record->registeredRoute);
+	m_routes.erase(record);
 }
 
-RouteManager::RegisteredRoute RouteManager::addIntoRoutingTable(const Route &route)
+void RouteManager::applyRoutes(const std::vector<Route> &routes)
 {
-	const auto node = ResolveNode(route.network().Prefix.si_family, route.node());
+	AutoLockType lock(m_routesLock);
 
-	MIB_IPFORWARD_ROW2 spec;
+	common::memory::ScopeDestructor publish;
 
-	InitializeIpForwardEntry(&spec);
+	publish += [this]()
+	{
+		publishChanges();
+	};
 
-	spec.InterfaceLuid = node.iface;
-	spec.DestinationPrefix = route.network();
-	spec.NextHop = node.gateway;
-	spec.Metric = 0;
-	spec.Protocol = MIB_IPPROTO_NETMGMT;
-	spec.Origin = NlroManual;
+	//
+	// All other routes are replaced, so any network is available for aggregation.
+	// The last route for a network wins, as in installRoutes().
+	//
+
+	const auto unique = LastRoutePerNetwork(routes);
+
+	const auto requested = (m_aggregateRoutes
+		? AggregateRoutes(unique, [](const Route &) { return false; })
+		: Unaggregated(unique));
 
 	//
-	// Do not treat ERROR_OBJECT_ALREADY_EXISTS as being successful.
-	// Because it may not take route metric into consideration.
+	// Routes that are already registered exactly as specified are kept as is.
+	// Other registered routes are deleted, including previous versions of
+	// routes that have changed.
 	//
 
-	const auto status = CreateIpForwardEntry2(&spec);
+	std::unordered_set<const RouteRecord *> keep;
+	std::vector<const AggregatedRoute *> additions;
 
-	if (NO_ERROR != status)
+	for (const auto &route : requested)
 	{
-		THROW_WINDOWS_ERROR(status, "Register route in routing table");
-	}
+		const auto record = m_routes.find(route.route.network());
 
-	return RegisteredRoute { route.network(), node.iface, node.gateway };
-}
+		if (m_routes.end() != record && record->route == route.route && record->members == route.members)
+		{
+			//
+			// Adopted routes are kept as is when they are requested again.
+			//
+			record->adopted = false;
 
-void RouteManager::restoreIntoRoutingTable(const RegisteredRoute &route)
-{
-	MIB_IPFORWARD_ROW2 spec;
+			keep.insert(&*record);
+			continue;
+		}
 
-	InitializeIpForwardEntry(&spec);
+		additions.push_back(&route);
+	}
 
-	spec.InterfaceLuid = route.luid;
-	spec.DestinationPrefix = route.network;
-	spec.NextHop = route.nextHop;
-	spec.Metric = 0;
-	spec.Protocol = MIB_IPPROTO_NETMGMT;
-	spec.Origin = NlroManual;
+	if (additions.empty() && keep.size() == m_routes.size())
+	{
+		return;
+	}
+
+	std::vector<RouteTable::iterator> removals;
+
+	for (auto it = m_routes.begin(); it != m_routes.end(); ++it)
+	{
+		if (keep.end() == keep.find(&*it))
+		{
+			removals.push_back(it);
+		}
+	}
+
+	std::vector<EventEntry> eventLog;
+	eventLog.reserve(removals.size() + additions.size());
+
+	try
+	{
+		for (auto record : removals)
+		{
+			deleteFromRoutingTable(record->registeredRoute);
+			eventLog.emplace_back(EventEntry{ EventType::DELETE_ROUTE, *record });
+			m_routes.erase(record);
+		}
+
+		auto &gatewayResolver = *m_gatewayResolver;
+
+		for (const auto route : additions)
+		{
+			const RouteRecord newRecord{ route->route, addIntoRoutingTable(route->route, gatewayResolver), false, route->members };
+
+			eventLog.emplace_back(EventEntry{ EventType::ADD_ROUTE, newRecord });
+			m_routes.insert(newRecord);
+		}
+	}
+	catch (...)
+	{
+		undoEvents(eventLog);
+
+		THROW_ERROR("Failed to apply route set");
+	}
+
+	std::stringstream ss;
+
+	ss << "Applied route set. Removed " << removals.size() << " route(s), added "
+		<< additions.size() << " route(s), kept " << keep.size() << " route(s)";
+
+	m_logSink->info(ss.str().c_str());
+}
+
+void RouteManager::applyExclusions(const std::vector<Network> &excluded, const std::vector<ADDRESS_FAMILY> &families,
+	const NET_LUID &luid)
+{
+	std::vector<Route> routes;
+
+	for (const auto family : families)
+	{
+		for (const auto &network : ComplementNetworks(family, excluded))
+		{
+			routes.emplace_back(network, Node(luid, std::nullopt));
+		}
+	}
+
+	AutoLockType lock(m_routesLock);
+
+	auto contains = [](const std::vector<Route> &set, const Route &route)
+	{
+		return set.end() != std::find(set.begin(), set.end(), route);
+	};
+
+	std::vector<Route> removals;
+	std::vector<Route> additions;
+
+	for (const auto &route : m_exclusionRoutes)
+	{
+		if (false == contains(routes, route))
+		{
+			removals.push_back(route);
+		}
+	}
+
+	//
+	// Routes from the previous call may have been deleted or replaced since,
+	// through the other operations, so only count those that are still registered.
+	//
+
+	auto registered = [this](const Route &route)
+	{
+		const auto record = m_routes.find(route.network());
+
+		return (m_routes.end() != record && record->route == route)
+			|| m_routes.end() != m_routes.findAggregate(route.network());
+	};
+
+	for (const auto &route : routes)
+	{
+		if (false == contains(m_exclusionRoutes, route) || false == registered(route))
+		{
+			additions.push_back(route);
+		}
+	}
+
+	if (removals.empty() && additions.empty())
+	{
+		return;
+	}
+
+	common::memory::ScopeDestructor publish;
+
+	publish += [this]()
+	{
+		publishChanges();
+	};
+
+	std::vector<EventEntry> eventLog;
+
+	try
+	{
+		//
+		// Split aggregates that contain any of the changed networks, and register
+		// the other routes they were made of again along with the additions.
+		//
 
-	const auto status = CreateIpForwardEntry2(&spec);
+		auto changed = removals;
+		changed.insert(changed.end(), additions.begin(), additions.end());
+
+		auto released = releaseAggregates(changed, eventLog);
+
+		for (const auto &route : removals)
+		{
+			auto record = m_routes.find(route.network());
+
+			//
+			// Leave the network alone if it has since been taken by another route.
+			//
+
+			if (m_routes.end() == record || false == record->members.empty() || false == (record->route == route))
+			{
+				continue;
+			}
+
+			deleteFromRoutingTable(record->registeredRoute);
+			eventLog.emplace_back(EventEntry{ EventType::DELETE_ROUTE, *record });
+			m_routes.erase(record);
+		}
+
+		released.insert(released.end(), additions.begin(), additions.end());
+
+		installRoutes(released, eventLog, *m_gatewayResolver);
+	}
+	catch (...)
+	{
+		undoEvents(eventLog);
+
+		THROW_ERROR("Failed to update exclusion routes");
+	}
+
+	m_exclusionRoutes = std::move(routes);
+}
+
+void RouteManager::setRelayRoutes(const std::vector<NodeAddress> &relays)
+{
+	std::vector<Route> routes;
+	RouteTable::NetworkSet networks;
+
+	for (const auto &relay : relays)
+	{
+		Network network = { 0 };
+
+		network.Prefix = relay;
+		network.PrefixLength = (AF_INET == relay.si_family ? 32 : 128);
+
+		if (networks.insert(network).second)
+		{
+			routes.emplace_back(network, std::nullopt);
+		}
+	}
+
+	AutoLockType lock(m_routesLock);
+
+	common::memory::ScopeDestructor publish;
+
+	publish += [this]()
+	{
+		publishChanges();
+	};
+
+	std::vector<EventEntry> eventLog;
+
+	try
+	{
+		for (const auto &network : m_relayNetworks)
+		{
+			if (networks.end() != networks.find(network))
+			{
+				continue;
+			}
+
+			auto record = m_routes.find(network);
+
+			//
+			// Leave the network alone if it has since been taken by another route.
+			//
+
+			if (m_routes.end() == record || false == record->members.empty() || record->route.node().has_value())
+			{
+				continue;
+			}
+
+			deleteFromRoutingTable(record->registeredRoute);
+			eventLog.emplace_back(EventEntry{ EventType::DELETE_ROUTE, *record });
+			m_routes.erase(record);
+		}
+
+		std::vector<Route> additions;
+
+		for (const auto &route : routes)
+		{
+			const auto record = m_routes.find(route.network());
+
+			if (m_routes.end() == record || false == (record->route == route) || record->adopted)
+			{
+				additions.push_back(route);
+			}
+		}
+
+		if (false == additions.empty())
+		{
+			auto released = releaseAggregates(additions, eventLog);
+			released.insert(released.end(), additions.begin(), additions.end());
+
+			installRoutes(released, eventLog, *m_gatewayResolver);
+		}
+	}
+	catch (...)
+	{
+		undoEvents(eventLog);
+
+		THROW_ERROR("Failed to update relay routes");
+	}
+
+	m_relayNetworks = std::move(networks);
+}
+
+void RouteManager::setRouteAggregation(bool enabled)
+{
+	AutoLockType lock(m_routesLock);
+
+	m_aggregateRoutes = enabled;
+}
+
+void RouteManager::setLatencyBudget(std::chrono::milliseconds routeRestore)
+{
+	AutoLockType lock(m_routesLock);
+
+	m_restoreBudget = routeRestore;
+}
+
+void RouteManager::dumpEvents(const std::function<void(const std::string &)> &sink) const
+{
+	m_events.dump(sink);
+}
+
+std::vector<RouteEventLog::Event> RouteManager::events() const
+{
+	return m_events.events();
+}
+
+std::shared_ptr<const RouteManager::RouteSnapshot> RouteManager::snapshot() const
+{
+	return std::atomic_load(&m_snapshot);
+}
+
+std::vector<RegisteredRoute> RouteManager::registeredRoutes() const
+{
+	const auto current = snapshot();
+
+	std::vector<RegisteredRoute> routes;
+
+	routes.reserve(current->routes.size());
+
+	for (const auto &record : current->routes)
+	{
+		routes.push_back(record.registeredRoute);
+	}
+
+	return routes;
+}
+
+std::optional<RegisteredRoute> RouteManager::lookupRoute(const NodeAddress &destination) const
+{
+	const auto current = snapshot();
+
+	const auto record = current->routes.longestMatch(destination);
+
+	if (current->routes.end() == record)
+	{
+		return std::nullopt;
+	}
+
+	return record->registeredRoute;
+}
+
+void RouteManager::setDefaultRouteCoalescing(uint32_t window, uint32_t maxLatency)
+{
+	m_routeMonitor->setCoalescing(DefaultRouteMonitor::CoalescingSettings{ window, maxLatency });
+}
+
+RouteManager::CallbackHandle RouteManager::registerDefaultRouteChangedCallback(DefaultRouteChangedCallback callback)
+{
+	AutoLockType lock(m_defaultRouteCallbacksLock);
+
+	auto entry = std::make_shared<const DefaultRouteChangedCallback>(std::move(callback));
+
+	auto callbacks = std::make_shared<CallbackList>(*std::atomic_load(&m_defaultRouteCallbacks));
+	callbacks->emplace_back(entry);
+
+	std::atomic_store(&m_defaultRouteCallbacks, std::shared_ptr<const CallbackList>(std::move(callbacks)));
+
+	// Return raw address of callback.
+	return const_cast<DefaultRouteChangedCallback *>(entry.get());
+}
+
+void RouteManager::unregisterDefaultRouteChangedCallback(CallbackHandle handle)
+{
+	{
+		AutoLockType lock(m_defaultRouteCallbacksLock);
+
+		const auto current = std::atomic_load(&m_defaultRouteCallbacks);
+
+		auto callbacks = std::make_shared<CallbackList>();
+		callbacks->reserve(current->size());
+
+		for (const auto &callback : *current)
+		{
+			// Match on raw address of callback.
+			if (callback.get() != handle)
+			{
+				callbacks->emplace_back(callback);
+			}
+		}
+
+		if (callbacks->size() == current->size())
+		{
+			return;
+		}
+
+		std::atomic_store(&m_defaultRouteCallbacks, std::shared_ptr<const CallbackList>(std::move(callbacks)));
+	}
+
+	//
+	// A dispatch that started before the update may still be using the old snapshot.
+	// Unless we're being called from within a callback, wait for it to complete.
+	//
+
+	if (std::this_thread::get_id() == m_dispatchingThread.load())
+	{
+		return;
+	}
+
+	while (std::thread::id() != m_dispatchingThread.load())
+	{
+		std::this_thread::yield();
+	}
+}
+
+RegisteredRoute RouteManager::prepareRoute(const Route &route, GatewayResolver &gatewayResolver, MIB_IPFORWARD_ROW2 &spec)
+{
+	const auto node = ResolveNode(route.network().Prefix.si_family, route.node(), gatewayResolver, *m_dataProvider);
+
+	InitializeOwnedRoute(spec, node.iface, route.network(), node.gateway);
+
+	return RegisteredRoute { route.network(), node.iface, node.gateway };
+}
+
+RegisteredRoute RouteManager::addIntoRoutingTable(const Route &route, GatewayResolver &gatewayResolver)
+{
+	MIB_IPFORWARD_ROW2 spec;
+
+	const auto registeredRoute = prepareRoute(route, gatewayResolver, spec);
+
+	//
+	// Do not treat ERROR_OBJECT_ALREADY_EXISTS as being successful.
+	// Because it may not take route metric into consideration.
+	//
+
+	const auto start = RouteEventLog::Clock::now();
+	const auto status = m_dataProvider->createIpForwardEntry2(&spec);
+
+	m_events.record(RouteEventLog::Operation::Create, registeredRoute, status, start);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Register route in routing table");
+	}
+
+	return registeredRoute;
+}
+
+void RouteManager::restoreIntoRoutingTable(const RegisteredRoute &route)
+{
+	MIB_IPFORWARD_ROW2 spec;
+
+	InitializeOwnedRoute(spec, route.luid, route.network, route.nextHop);
+
+	const auto start = RouteEventLog::Clock::now();
+	const auto status = m_dataProvider->createIpForwardEntry2(&spec);
+
+	m_events.record(RouteEventLog::Operation::Restore, route, status, start);
 
 	if (NO_ERROR != status)
 	{
@@ -487,16 +1078,18 @@ void RouteManager::deleteFromRoutingTable(const RegisteredRoute &route)
 	r.DestinationPrefix = route.network;
 	r.NextHop = route.nextHop;
 
-	auto status = DeleteIpForwardEntry2(&r);
+	const auto start = RouteEventLog::Clock::now();
+	auto status = m_dataProvider->deleteIpForwardEntry2(&r);
+
+	m_events.record(RouteEventLog::Operation::Delete, route, status, start);
+
+	//
+	// A route that is already gone is recorded in the event log, which is enough.
+	//
 
 	if (ERROR_NOT_FOUND == status)
 	{
 		status = NO_ERROR;
-
-		const auto err = std::wstring(L"Attempting to delete route which was not present in routing table, " \
-			"ignoring and proceeding. Route: ").append(FormatRegisteredRoute(route));
-
-		m_logSink->warning(common::string::ToAnsi(err).c_str());
 	}
 
 	if (NO_ERROR != status)
@@ -519,7 +1112,7 @@ void RouteManager::undoEvents(const std::vector<EventEntry> &eventLog)
 			{
 				case EventType::ADD_ROUTE:
 				{
-					auto record = findRouteRecord(it->record.route);
+					auto record = m_routes.find(it->record.route.network());
 
 					if (m_routes.end() == record)
 					{
@@ -534,7 +1127,7 @@ void RouteManager::undoEvents(const std::vector<EventEntry> &eventLog)
 				case EventType::DELETE_ROUTE:
 				{
 					restoreIntoRoutingTable(it->record.registeredRoute);
-					m_routes.emplace_back(it->record);
+					m_routes.insert(it->record);
 
 					break;
 				}
@@ -546,10 +1139,199 @@ void RouteManager::undoEvents(const std::vector<EventEntry> &eventLog)
 		}
 		catch (const std::exception &ex)
 		{
-			const auto err = std::string("Attempting to rollback state: ").append(ex.what());
-			m_logSink->error(err.c_str());
+			const auto err = std::string("Attempting to rollback state: ").append(ex.what());
+			m_logSink->error(err.c_str());
+		}
+	}
+}
+
+std::vector<Route> RouteManager::releaseAggregates(const std::vector<Route> &routes, std::vector<EventEntry> &eventLog)
+{
+	std::vector<Route> released;
+
+	if (false == m_routes.hasAggregates())
+	{
+		return released;
+	}
+
+	RouteTable::NetworkSet requested;
+
+	for (const auto &route : routes)
+	{
+		requested.insert(route.network());
+	}
+
+	for (const auto &route : routes)
+	{
+		auto record = m_routes.findAggregate(route.network());
+
+		if (m_routes.end() == record)
+		{
+			record = m_routes.find(route.network());
+
+			if (m_routes.end() == record || record->members.empty())
+			{
+				continue;
+			}
+		}
+
+		deleteFromRoutingTable(record->registeredRoute);
+		eventLog.emplace_back(EventEntry{ EventType::DELETE_ROUTE, *record });
+
+		for (const auto &member : record->members)
+		{
+			if (requested.end() == requested.find(member.network()))
+			{
+				released.push_back(member);
+			}
+		}
+
+		m_routes.erase(record);
+	}
+
+	return released;
+}
+
+void RouteManager::installRoutes(const std::vector<Route> &routes, std::vector<EventEntry> &eventLog,
+	GatewayResolver &gatewayResolver)
+{
+	static auto &aggregatedCounter = shared::performance::CounterRegistry::Instance().counter("winnet.routes.aggregated");
+	static auto &createHistogram = shared::performance::CounterRegistry::Instance().histogram("winnet.routes.create");
+
+	//
+	// A network that appears more than once would otherwise be created twice, and the
+	// second create fails because the route exists. The last route for a network wins.
+	//
+
+	const auto unique = LastRoutePerNetwork(routes);
+
+	//
+	// Don't merge into a network that is already taken, unless by an adopted
+	// route that is exactly the merged route.
+	//
+
+	const auto batch = (m_aggregateRoutes
+		? AggregateRoutes(unique, [this](const Route &merged)
+		{
+			const auto record = m_routes.find(merged.network());
+
+			return m_routes.end() != m_routes.findAggregate(merged.network())
+				|| (m_routes.end() != record && false == (record->adopted && record->route == merged));
+		})
+		: Unaggregated(unique));
+
+	//
+	// Evictions are done and all routes are prepared before any route is created.
+	// The routes are then created back to back, and the first failure ends the batch.
+	//
+
+	struct PendingRoute
+	{
+		const AggregatedRoute *entry;
+		RegisteredRoute registeredRoute;
+		MIB_IPFORWARD_ROW2 spec;
+	};
+
+	std::vector<PendingRoute> pending;
+
+	pending.reserve(batch.size());
+
+	for (const auto &entry : batch)
+	{
+		auto record = m_routes.find(entry.route.network());
+
+		if (m_routes.end() != record && record->adopted && record->route == entry.route)
+		{
+			//
+			// The journal doesn't keep track of aggregated routes.
+			//
+
+			record->adopted = false;
+			m_routes.setMembers(record, entry.members);
+
+			continue;
+		}
+
+		//
+		// Evict routes for the network, and for any of the aggregated networks.
+		//
+
+		auto evict = [&](const Network &network)
+		{
+			const auto existing = m_routes.find(network);
+
+			if (m_routes.end() != existing)
+			{
+				deleteFromRoutingTable(existing->registeredRoute);
+				eventLog.emplace_back(EventEntry{ EventType::DELETE_ROUTE, *existing });
+				m_routes.erase(existing);
+			}
+		};
+
+		evict(entry.route.network());
+
+		for (const auto &member : entry.members)
+		{
+			evict(member.network());
+		}
+
+		pending.emplace_back();
+
+		auto &route = pending.back();
+
+		route.entry = &entry;
+		route.registeredRoute = prepareRoute(entry.route, gatewayResolver, route.spec);
+	}
+
+	//
+	// Do not treat ERROR_OBJECT_ALREADY_EXISTS as being successful.
+	// Because it may not take route metric into consideration.
+	//
+
+	size_t created = 0;
+	DWORD status = NO_ERROR;
+
+	{
+		const shared::performance::LatencyHistogram::ScopedTimer timer(createHistogram);
+
+		for (; created < pending.size(); ++created)
+		{
+			const auto start = RouteEventLog::Clock::now();
+
+			status = m_dataProvider->createIpForwardEntry2(&pending[created].spec);
+
+			m_events.record(RouteEventLog::Operation::Create, pending[created].registeredRoute, status, start);
+
+			if (NO_ERROR != status)
+			{
+				break;
+			}
+		}
+	}
+
+	//
+	// Record the routes that were created, so they're rolled back on failure.
+	//
+
+	for (size_t i = 0; i < created; ++i)
+	{
+		const auto &entry = *pending[i].entry;
+
+		const RouteRecord newRecord{ entry.route, pending[i].registeredRoute, false, entry.members };
+
+		eventLog.emplace_back(EventEntry{ EventType::ADD_ROUTE, newRecord });
+		m_routes.insert(newRecord);
+
+		if (false == entry.members.empty())
+		{
+			aggregatedCounter.increment(entry.members.size() - 1);
 		}
 	}
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Register route in routing table");
+	}
 }
 
 // static
@@ -599,57 +1381,138 @@ std::wstring RouteManager::FormatRegisteredRoute(const RegisteredRoute &route)
 	return ss.str();
 }
 
-void RouteManager::defaultRouteChanged(ADDRESS_FAMILY family, DefaultRouteMonitor::EventType eventType,
-	const std::optional<InterfaceAndGateway> &route)
+void RouteManager::defaultRouteChanged(const std::vector<DefaultRouteChange> &changes)
 {
+	static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winnet.defaultroute.evaluate_to_restored");
+	static auto &relayHistogram = shared::performance::CounterRegistry::Instance().histogram("winnet.defaultroute.evaluate_to_relay_restored");
+
 	//
-	// Forward event to all registered listeners.
+	// Move relay routes before anything else, since the tunnel is down until they're restored.
 	//
 
-	m_defaultRouteCallbacksLock.lock();
-
-	for (const auto &callback : m_defaultRouteCallbacks)
 	{
-		try
+		AutoLockType routesLock(m_routesLock);
+
+		if (false == m_relayNetworks.empty())
 		{
-			callback(eventType, family, route);
+			std::optional<std::chrono::steady_clock::time_point> evaluated;
+
+			for (const auto &change : changes)
+			{
+				if (DefaultRouteMonitor::EventType::Updated == change.eventType)
+				{
+					rebindDefaultRoutes(change.family, change.route.value(), true);
+					evaluated = change.evaluated;
+				}
+			}
+
+			if (evaluated.has_value())
+			{
+				relayHistogram.record(std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now() - evaluated.value()));
+
+				//
+				// Readers see the relay routes on the new default route while
+				// the other routes are being restored.
+				//
+				publishChanges();
+			}
 		}
-		catch (const std::exception &ex)
+	}
+
+	//
+	// Forward event to all registered listeners.
+	//
+	// The dispatching thread must be published before the snapshot is loaded.
+	// See unregisterDefaultRouteChangedCallback().
+	//
+
+	m_dispatchingThread.store(std::this_thread::get_id());
+
+	{
+		common::memory::ScopeDestructor sd;
+
+		sd += [this]()
 		{
-			const auto msg = std::string("Failure in default-route-changed callback: ").append(ex.what());
-			m_logSink->error(msg.c_str());
-		}
-		catch (...)
+			m_dispatchingThread.store(std::thread::id());
+		};
+
+		const auto callbacks = std::atomic_load(&m_defaultRouteCallbacks);
+
+		const shared::tracing::Stopwatch stopwatch(shared::tracing::KeywordMonitor);
+
+		for (const auto &callback : *callbacks)
 		{
-			m_logSink->error("Unspecified failure in default-route-changed callback");
+			try
+			{
+				(*callback)(changes);
+			}
+			catch (const std::exception &ex)
+			{
+				const auto msg = std::string("Failure in default-route-changed callback: ").append(ex.what());
+				m_logSink->error(msg.c_str());
+			}
+			catch (...)
+			{
+				m_logSink->error("Unspecified failure in default-route-changed callback");
+			}
 		}
-	}
 
-	m_defaultRouteCallbacksLock.unlock();
+		shared::tracing::MonitorCallback(stopwatch, "DefaultRouteMonitor");
+	}
 
 	//
 	// Examine event to determine if best default route has changed.
 	//
 
-	if (DefaultRouteMonitor::EventType::Updated != eventType)
+	AutoLockType routesLock(m_routesLock);
+
+	std::optional<std::chrono::steady_clock::time_point> evaluated;
+
+	for (const auto &change : changes)
 	{
-		return;
+		if (DefaultRouteMonitor::EventType::Updated == change.eventType)
+		{
+			rebindDefaultRoutes(change.family, change.route.value(), false);
+			evaluated = change.evaluated;
+		}
 	}
 
 	//
-	// Examine our routes to see if any of them are policy bound to the best default route.
+	// Only updates restore routes. Time is measured from the evaluation rather
+	// than the callback, so the time spent in listeners is included.
 	//
 
-	AutoLockType routesLock(m_routesLock);
+	if (evaluated.has_value())
+	{
+		histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - evaluated.value()));
+	}
 
-	using RecordIterator = std::list<RouteRecord>::iterator;
+	publishChanges();
+}
+
+void RouteManager::rebindDefaultRoutes(ADDRESS_FAMILY family, const InterfaceAndGateway &defaultRoute, bool relays)
+{
+	//
+	// Examine our routes to see if any of them are policy bound to the best default route,
+	// and not already registered on it.
+	//
+
+	std::vector<RouteTable::iterator> affectedRoutes;
 
-	std::list<RecordIterator> affectedRoutes;
+	auto isRelay = [this](RouteTable::iterator it)
+	{
+		return m_relayNetworks.end() != m_relayNetworks.find(it->route.network());
+	};
 
-	for (RecordIterator it = m_routes.begin(); it != m_routes.end(); ++it)
+	for (auto it = m_routes.begin(); it != m_routes.end(); ++it)
 	{
 		if (false == it->route.node().has_value()
-			&& family == it->route.network().Prefix.si_family)
+			&& family == it->route.network().Prefix.si_family
+			&& relays == isRelay(it)
+			&& (it->registeredRoute.luid.Value != defaultRoute.iface.Value
+				|| false == EqualAddress(it->registeredRoute.nextHop, defaultRoute.gateway)))
 		{
 			affectedRoutes.emplace_back(it);
 		}
@@ -660,30 +1523,55 @@ void RouteManager::defaultRouteChanged(ADDRESS_FAMILY family, DefaultRouteMonito
 		return;
 	}
 
+	const auto started = std::chrono::steady_clock::now();
+
 	//
-	// Update all affected routes.
+	// Remove all affected rows before adding any, so the table is only
+	// in a mixed state for as long as it takes to process the batch.
 	//
 
-	m_logSink->info("Best default route has changed. Refreshing dependent routes");
+	size_t failures = 0;
+	std::string firstError;
 
-	for (auto &it : affectedRoutes)
+	auto recordFailure = [&failures, &firstError](const std::string &error)
 	{
-		try
+		if (0 == failures++)
 		{
-			deleteFromRoutingTable(it->registeredRoute);
+			firstError = error;
 		}
-		catch (const std::exception &ex)
+	};
+
+	std::vector<RouteTable::iterator> removedRoutes;
+	removedRoutes.reserve(affectedRoutes.size());
+
+	for (auto it : affectedRoutes)
+	{
+		MIB_IPFORWARD_ROW2 r = { 0 };
+
+		r.InterfaceLuid = it->registeredRoute.luid;
+		r.DestinationPrefix = it->registeredRoute.network;
+		r.NextHop = it->registeredRoute.nextHop;
+
+		const auto status = m_dataProvider->deleteIpForwardEntry2(&r);
+
+		if (NO_ERROR != status && ERROR_NOT_FOUND != status)
 		{
-			const auto msg = std::string("Failed to delete route when refreshing " \
-				"existing routes: ").append(ex.what());
+			std::stringstream ss;
+			ss << "Delete route in routing table: error " << status;
 
-			m_logSink->error(msg.c_str());
+			recordFailure(ss.str());
 
 			continue;
 		}
 
-		it->registeredRoute.luid = route.value().iface;
-		it->registeredRoute.nextHop = route.value().gateway;
+		removedRoutes.emplace_back(it);
+	}
+
+	const auto deleted = std::chrono::steady_clock::now();
+
+	for (auto it : removedRoutes)
+	{
+		m_routes.rebind(it, defaultRoute.iface, defaultRoute.gateway);
 
 		try
 		{
@@ -691,14 +1579,332 @@ void RouteManager::defaultRouteChanged(ADDRESS_FAMILY family, DefaultRouteMonito
 		}
 		catch (const std::exception &ex)
 		{
-			const auto msg = std::string("Failed to add route when refreshing " \
-				"existing routes: ").append(ex.what());
+			recordFailure(ex.what());
+		}
+	}
+
+	const auto restored = std::chrono::steady_clock::now();
+
+	if (0 != m_restoreBudget.count() && restored - started > m_restoreBudget)
+	{
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+
+		std::stringstream details;
+
+		details << "Route restore exceeded latency budget of " << m_restoreBudget.count() << " ms"
+			<< ": total " << duration_cast<microseconds>(restored - started).count() << " us"
+			<< " (delete: " << duration_cast<microseconds>(deleted - started).count() << " us"
+			<< ", restore: " << duration_cast<microseconds>(restored - deleted).count() << " us)"
+			<< ", family: " << (AF_INET == family ? "IPv4" : "IPv6")
+			<< ", relay routes: " << (relays ? "yes" : "no")
+			<< ", affected: " << affectedRoutes.size()
+			<< ", removed: " << removedRoutes.size()
+			<< ", failed: " << failures
+			<< ", registered: " << m_routes.size()
+			<< ", interface LUID: 0x" << std::hex << defaultRoute.iface.Value;
+
+		m_logSink->warning(details.str().c_str());
+	}
+
+	std::stringstream ss;
+
+	ss << "Best default route has changed. Refreshed "
+		<< (affectedRoutes.size() - failures) << " of " << affectedRoutes.size()
+		<< (relays ? " relay routes" : " dependent routes");
+
+	if (0 == failures)
+	{
+		m_logSink->info(ss.str().c_str());
+		return;
+	}
+
+	ss << ". First error: " << firstError;
+
+	m_logSink->error(ss.str().c_str());
+}
+
+void RouteManager::adoptJournaledRoutes()
+{
+	const auto journaled = m_journal->load();
+
+	//
+	// Only adopt routes that would be registered the same way now.
+	// E.g. routes that follow the default route may have to move.
+	//
+
+	auto &gatewayResolver = *m_gatewayResolver;
+
+	for (const auto &record : journaled)
+	{
+		try
+		{
+			const auto node = ResolveNode(record.route.network().Prefix.si_family, record.route.node(),
+				gatewayResolver, *m_dataProvider);
+
+			if (node.iface.Value != record.registeredRoute.luid.Value
+				|| false == EqualAddress(node.gateway, record.registeredRoute.nextHop)
+				|| m_routes.end() != m_routes.find(record.route.network()))
+			{
+				continue;
+			}
+
+			auto adopted = record;
+			adopted.adopted = true;
+
+			m_routes.insert(adopted);
+		}
+		catch (...)
+		{
+		}
+	}
+
+	//
+	// A single pass over the routing table confirms adopted routes, and deletes
+	// the other journaled routes that were left behind.
+	//
+
+	const auto journaledRoutes = IndexJournaledRoutes(journaled);
+
+	PMIB_IPFORWARD_TABLE2 table;
+
+	const auto status = m_dataProvider->getIpForwardTable2(AF_UNSPEC, &table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Acquire route table");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [this, table]
+	{
+		m_dataProvider->freeMibTable(table);
+	};
+
+	std::unordered_set<const RouteRecord *> confirmed;
+	size_t purged = 0;
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto &route = table->Table[i];
+
+		if (false == IsJournaledRoute(journaledRoutes, route))
+		{
+			continue;
+		}
+
+		const auto record = m_routes.find(route.DestinationPrefix);
+
+		if (m_routes.end() != record
+			&& record->registeredRoute.luid.Value == route.InterfaceLuid.Value
+			&& EqualAddress(record->registeredRoute.nextHop, route.NextHop))
+		{
+			confirmed.insert(&*record);
+			continue;
+		}
+
+		const auto deleteStatus = m_dataProvider->deleteIpForwardEntry2(&route);
+
+		if (NO_ERROR == deleteStatus || ERROR_NOT_FOUND == deleteStatus)
+		{
+			++purged;
+		}
+	}
+
+	std::vector<RouteTable::iterator> missing;
+
+	for (auto it = m_routes.begin(); it != m_routes.end(); ++it)
+	{
+		if (confirmed.end() == confirmed.find(&*it))
+		{
+			missing.push_back(it);
+		}
+	}
+
+	for (auto it : missing)
+	{
+		m_routes.erase(it);
+	}
+
+	std::stringstream ss;
+
+	ss << "Adopted " << m_routes.size() << " of " << journaled.size()
+		<< " journaled route(s). Deleted " << purged << " stale route(s)";
+
+	m_logSink->info(ss.str().c_str());
+}
+
+void RouteManager::syncJournal()
+{
+	if (nullptr == m_journal)
+	{
+		return;
+	}
+
+	try
+	{
+		m_journal->store(m_routes);
+	}
+	catch (const std::exception &ex)
+	{
+		const auto msg = std::string("Failed to update route journal: ").append(ex.what());
+		m_logSink->error(msg.c_str());
+	}
+	catch (...)
+	{
+		m_logSink->error("Unspecified failure while updating route journal");
+	}
+}
+
+void RouteManager::publishChanges()
+{
+	try
+	{
+		auto snapshot = std::make_shared<RouteSnapshot>();
+
+		snapshot->version = m_snapshot->version + 1;
+
+		for (const auto &record : m_routes)
+		{
+			snapshot->routes.insert(record);
+		}
+
+		std::atomic_store(&m_snapshot, std::shared_ptr<const RouteSnapshot>(std::move(snapshot)));
+	}
+	catch (const std::exception &ex)
+	{
+		const auto msg = std::string("Failed to publish route snapshot: ").append(ex.what());
+		m_logSink->error(msg.c_str());
+	}
+	catch (...)
+	{
+		m_logSink->error("Unspecified failure while publishing route snapshot");
+	}
+
+	syncJournal();
+}
+
+//static
+size_t RouteManager::PurgeOwnedRoutes(common::logging::ILogSink &logSink, RouteJournal &journal)
+{
+	SystemDataProvider dataProvider;
+
+	return PurgeOwnedRoutes(logSink, journal, dataProvider);
+}
+
+//static
+size_t RouteManager::PurgeOwnedRoutes(common::logging::ILogSink &logSink, RouteJournal &journal,
+	IDataProvider &dataProvider)
+{
+	const auto journaled = IndexJournaledRoutes(journal.load());
+
+	if (journaled.empty())
+	{
+		return 0;
+	}
+
+	PMIB_IPFORWARD_TABLE2 table;
+
+	const auto status = dataProvider.getIpForwardTable2(AF_UNSPEC, &table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Acquire route table");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [&dataProvider, table]
+	{
+		dataProvider.freeMibTable(table);
+	};
+
+	size_t purged = 0;
+	size_t failures = 0;
 
-			m_logSink->error(msg.c_str());
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto &route = table->Table[i];
 
+		if (false == IsJournaledRoute(journaled, route))
+		{
 			continue;
 		}
+
+		const auto deleteStatus = dataProvider.deleteIpForwardEntry2(&route);
+
+		if (NO_ERROR == deleteStatus || ERROR_NOT_FOUND == deleteStatus)
+		{
+			++purged;
+		}
+		else
+		{
+			++failures;
+		}
+	}
+
+	std::stringstream ss;
+
+	ss << "Purged " << purged << " route(s) left behind by an earlier instance";
+
+	if (0 != failures)
+	{
+		//
+		// Keep the journal, so the remaining routes can be purged or adopted later.
+		//
+
+		ss << ". Failed to delete " << failures << " route(s)";
+		logSink.error(ss.str().c_str());
+	}
+	else
+	{
+		journal.clear();
+
+		if (0 != purged)
+		{
+			logSink.info(ss.str().c_str());
+		}
 	}
+
+	return purged;
+}
+
+//
+// SystemDataProvider
+//
+
+DWORD RouteManager::SystemDataProvider::createIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row)
+{
+	return CreateIpForwardEntry2(Row);
+}
+
+DWORD RouteManager::SystemDataProvider::deleteIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row)
+{
+	return DeleteIpForwardEntry2(Row);
+}
+
+DWORD RouteManager::SystemDataProvider::getIpForwardTable2(ADDRESS_FAMILY Family, PMIB_IPFORWARD_TABLE2 *Table)
+{
+	return GetIpForwardTable2(Family, Table);
+}
+
+void RouteManager::SystemDataProvider::freeMibTable(PVOID Memory)
+{
+	FreeMibTable(Memory);
+}
+
+InterfaceAndGateway RouteManager::SystemDataProvider::getBestDefaultRoute(ADDRESS_FAMILY family)
+{
+	return GetBestDefaultRoute(family);
+}
+
+std::unique_ptr<IDefaultRouteMonitor> RouteManager::SystemDataProvider::createDefaultRouteMonitor(
+	IDefaultRouteMonitor::Callback callback,
+	std::shared_ptr<common::logging::ILogSink> logSink
+)
+{
+	return std::make_unique<DefaultRouteMonitor>(callback, logSink);
 }
 
 }
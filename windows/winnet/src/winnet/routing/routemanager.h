@@ -6,6 +6,9 @@
 #include <list>
 #include <optional>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <functional>
 #include <windows.h>
 #include <ws2def.h>
@@ -13,15 +16,43 @@
 #include <libcommon/string.h>
 #include <libcommon/logging/ilogsink.h>
 #include "defaultroutemonitor.h"
+#include "routeaggregation.h"
+#include "routeeventlog.h"
+#include "routejournal.h"
+#include "routetable.h"
 
 namespace winnet::routing
 {
 
+class GatewayResolver;
+
 class RouteManager
 {
 public:
 
+	struct IDataProvider;
+	class SystemDataProvider;
+
+	RouteManager(std::shared_ptr<common::logging::ILogSink> logSink, std::shared_ptr<IDataProvider> dataProvider);
 	RouteManager(std::shared_ptr<common::logging::ILogSink> logSink);
+
+	//
+	// Routes in the journal that are still registered in the routing table, exactly as
+	// they would be registered now, are adopted rather than recreated. Other journaled
+	// routes that are still in the routing table are deleted. Adopted routes are kept as
+	// is when they are added again.
+	//
+	// The journal is kept current for as long as the route manager exists.
+	//
+	RouteManager(std::shared_ptr<common::logging::ILogSink> logSink, std::unique_ptr<RouteJournal> journal);
+	RouteManager(std::shared_ptr<common::logging::ILogSink> logSink, std::shared_ptr<IDataProvider> dataProvider,
+		std::unique_ptr<RouteJournal> journal);
+
+	//
+	// Leave all routes in the routing table when destroyed, so the next route manager
+	// can adopt them from the journal. Requires a journal.
+	//
+	void detach();
 	~RouteManager();
 
 	RouteManager(const RouteManager &) = delete;
@@ -35,57 +66,202 @@ public:
 	void deleteRoutes(const std::vector<Route> &routes);
 	void deleteRoute(const Route &route);
 
-	using DefaultRouteChangedEventType = DefaultRouteMonitor::EventType;
+	//
+	// Make 'routes' the complete set of routes owned by the route manager.
+	// Only the difference against the current set is applied to the routing table.
+	// If any change fails, all changes made by the call are rolled back.
+	//
+	void applyRoutes(const std::vector<Route> &routes);
+
+	//
+	// Send all traffic of 'families' through the interface, except traffic to 'excluded'.
+	// This registers the routes from ComplementNetworks() as on-link routes on the interface.
+	//
+	// The routes are kept apart from other routes owned by the route manager. Calling this
+	// again only applies the difference against the routes from the previous call, so
+	// changing a few exclusions only changes a few routes. If any change fails, all changes
+	// made by the call are rolled back. Passing no families removes all exclusion routes.
+	//
+	void applyExclusions(const std::vector<Network> &excluded, const std::vector<ADDRESS_FAMILY> &families,
+		const NET_LUID &luid);
+
+	//
+	// Make 'relays' the complete set of relay endpoints. Each relay gets a host route that
+	// follows the best default route, like a route without a node.
+	//
+	// When the best default route changes, relay routes are moved onto it first, before
+	// default-route-changed callbacks are invoked and before any other routes are moved,
+	// so the path to the relay is restored as soon as possible.
+	//
+	// Only the difference against the previous call is applied. If any change fails,
+	// all changes made by the call are rolled back.
+	//
+	void setRelayRoutes(const std::vector<NodeAddress> &relays);
+
+	//
+	// Register routes that are added or applied in the same call as fewer routes for
+	// enclosing networks, where possible. See AggregateRoutes() for what is merged.
+	//
+	// Aggregated routes are still deleted individually. Deleting some of the routes
+	// that form a registered route replaces it with routes for the remaining ones.
+	//
+	// Disabled by default.
+	//
+	void setRouteAggregation(bool enabled);
+
+	//
+	// When restoring routes after a default route change takes longer than `routeRestore`,
+	// a single warning with a breakdown of the restore is logged.
+	//
+	// A budget of zero disables the check, which is the default.
+	//
+	void setLatencyBudget(std::chrono::milliseconds routeRestore);
+
+	//
+	// Invoke the sink with one line of text for each recent change to the routing
+	// table, oldest first. Meant for problem reports.
+	//
+	void dumpEvents(const std::function<void(const std::string &)> &sink) const;
+
+	//
+	// Recent changes to the routing table in binary form, oldest first.
+	//
+	std::vector<RouteEventLog::Event> events() const;
+
+	//
+	// Routes owned by the route manager, as of one version.
+	//
+	// A new snapshot is published after each change, and is never modified afterwards.
+	// Readers load the current snapshot without locking, so they don't wait for changes
+	// in progress, e.g. while routes are restored after a default route change. They see
+	// the routes as they were before the change until it completes.
+	//
+	struct RouteSnapshot
+	{
+		// Incremented each time a snapshot is published.
+		uint64_t version;
+
+		RouteTable routes;
+	};
 
-	using DefaultRouteChangedCallback = std::function<void
-	(
-		DefaultRouteChangedEventType eventType,
-		ADDRESS_FAMILY family,
+	std::shared_ptr<const RouteSnapshot> snapshot() const;
 
-		// For update events, data associated with the new best default route.
-		const std::optional<InterfaceAndGateway> &route
-	)>;
+	//
+	// Routes currently registered in the routing table by the route manager.
+	// Reads the current snapshot.
+	//
+	std::vector<RegisteredRoute> registeredRoutes() const;
+
+	//
+	// Find the registered route that carries traffic to the destination, among the routes
+	// owned by the route manager, by longest prefix match. Routes that are not owned by the
+	// route manager are not considered, and neither is the rest of the routing table.
+	//
+	// For aggregated routes, this is the route that was registered in their place.
+	// Reads the current snapshot.
+	//
+	std::optional<RegisteredRoute> lookupRoute(const NodeAddress &destination) const;
+
+	using DefaultRouteChangedEventType = DefaultRouteMonitor::EventType;
+	using DefaultRouteChange = DefaultRouteMonitor::Change;
+
+	//
+	// Receives every family that changed in a single evaluation.
+	//
+	using DefaultRouteChangedCallback = std::function<void(const std::vector<DefaultRouteChange> &changes)>;
 
 	using CallbackHandle = void*;
 
+	//
+	// Default route notifications are coalesced until there is a quiet period of
+	// `window` ms, but evaluation is never deferred more than `maxLatency` ms.
+	//
+	void setDefaultRouteCoalescing(uint32_t window, uint32_t maxLatency);
+
 	CallbackHandle registerDefaultRouteChangedCallback(DefaultRouteChangedCallback callback);
+
+	//
+	// Once this returns the callback will not be invoked again.
+	// If a dispatch is in progress on another thread, this waits for it to complete.
+	//
 	void unregisterDefaultRouteChangedCallback(CallbackHandle handle);
 
+	//
+	// Delete the routes in the journal that are still in the routing table, in a single
+	// pass over the table. Only routes with the exact destination, interface and next hop
+	// that were journaled are deleted. Meant for recovering after an unclean shutdown,
+	// so must not be used while a route manager is active.
+	//
+	// The journal is cleared unless some of the routes could not be deleted.
+	// Returns the number of routes deleted.
+	//
+	static size_t PurgeOwnedRoutes(common::logging::ILogSink &logSink, RouteJournal &journal);
+	static size_t PurgeOwnedRoutes(common::logging::ILogSink &logSink, RouteJournal &journal,
+		IDataProvider &dataProvider);
+
 private:
 
 	std::shared_ptr<common::logging::ILogSink> m_logSink;
+	std::shared_ptr<IDataProvider> m_dataProvider;
 
-	std::unique_ptr<DefaultRouteMonitor> m_routeMonitorV4;
-	std::unique_ptr<DefaultRouteMonitor> m_routeMonitorV6;
+	//
+	// Registered callbacks are published as an immutable snapshot.
+	// Dispatch loads the current snapshot without locking, and writers
+	// serialize on the lock to copy, modify and republish it.
+	//
+	using CallbackList = std::vector<std::shared_ptr<const DefaultRouteChangedCallback>>;
 
-	// These are the exact details derived from the route specification (`Route`).
-	// They are used when registering and deleting a route in the system.
-	struct RegisteredRoute
-	{
-		Network network;
-		NET_LUID luid;
-		NodeAddress nextHop;
-	};
+	std::shared_ptr<const CallbackList> m_defaultRouteCallbacks;
+	std::mutex m_defaultRouteCallbacksLock;
 
-	struct RouteRecord
-	{
-		Route route;
-		RegisteredRoute registeredRoute;
-	};
+	// Thread currently dispatching callbacks, if any.
+	std::atomic<std::thread::id> m_dispatchingThread;
 
-	std::list<RouteRecord> m_routes;
+	std::unique_ptr<IDefaultRouteMonitor> m_routeMonitor;
+
+	RouteTable m_routes;
 	std::mutex m_routesLock;
 
-	std::list<DefaultRouteChangedCallback> m_defaultRouteCallbacks;
-	std::recursive_mutex m_defaultRouteCallbacksLock;
+	// Copy of m_routes for readers. See RouteSnapshot.
+	std::shared_ptr<const RouteSnapshot> m_snapshot;
+
+	std::unique_ptr<RouteJournal> m_journal;
+	bool m_detached;
+
+	bool m_aggregateRoutes;
 
-	// Find record based on destination and mask.
-	std::list<RouteRecord>::iterator findRouteRecord(const Network &network);
+	std::chrono::milliseconds m_restoreBudget;
 
-	// Note: Same as above!
-	std::list<RouteRecord>::iterator findRouteRecord(const Route &route);
+	// Routes registered by the last call to applyExclusions().
+	std::vector<Route> m_exclusionRoutes;
 
-	RegisteredRoute addIntoRoutingTable(const Route &route);
+	// Networks of the host routes registered by the last call to setRelayRoutes().
+	RouteTable::NetworkSet m_relayNetworks;
+
+	//
+	// Shared by all operations, so adapters are only enumerated again after a change.
+	//
+	std::unique_ptr<GatewayResolver> m_gatewayResolver;
+
+	// Recent changes to the routing table. Has its own lock.
+	RouteEventLog m_events;
+
+	void adoptJournaledRoutes();
+
+	// Update the journal to match the route table. Call with the routes lock held.
+	void syncJournal();
+
+	//
+	// Publish a snapshot of the route table, then update the journal.
+	// Call with the routes lock held, after changing the route table.
+	//
+	void publishChanges();
+
+
+	// Resolves the node of the route and initializes the row that registers it.
+	RegisteredRoute prepareRoute(const Route &route, GatewayResolver &gatewayResolver, MIB_IPFORWARD_ROW2 &spec);
+
+	RegisteredRoute addIntoRoutingTable(const Route &route, GatewayResolver &gatewayResolver);
 	void restoreIntoRoutingTable(const RegisteredRoute &route);
 	void deleteFromRoutingTable(const RegisteredRoute &route);
 
@@ -103,10 +279,93 @@ private:
 
 	void undoEvents(const std::vector<EventEntry> &eventLog);
 
+	//
+	// Delete registered routes that any of 'routes' were aggregated into, or that have
+	// the same network as any of 'routes'. Returns the other routes that were aggregated
+	// into them, so they can be registered again.
+	//
+	std::vector<Route> releaseAggregates(const std::vector<Route> &routes, std::vector<EventEntry> &eventLog);
+
+	//
+	// Aggregate 'routes' if enabled, and register them in place of existing routes for the
+	// same networks. Changes are recorded in the event log, the caller has to undo them on
+	// failure.
+	//
+	// All routes are resolved before the first one is registered, so a batch that can't be
+	// resolved fails without touching the routing table beyond evictions.
+	//
+	void installRoutes(const std::vector<Route> &routes, std::vector<EventEntry> &eventLog,
+		GatewayResolver &gatewayResolver);
+
 	static std::wstring FormatRegisteredRoute(const RegisteredRoute &route);
 
-	void defaultRouteChanged(ADDRESS_FAMILY family, DefaultRouteMonitor::EventType eventType,
-		const std::optional<InterfaceAndGateway> &route);
+	void defaultRouteChanged(const std::vector<DefaultRouteChange> &changes);
+
+	//
+	// Move routes that follow the default route onto the new best default route.
+	// Either only relay routes, or only other routes, are moved.
+	//
+	void rebindDefaultRoutes(ADDRESS_FAMILY family, const InterfaceAndGateway &defaultRoute, bool relays);
+};
+
+//
+// Everything the route manager needs from the system.
+// Lets tests and benchmarks run against a fake routing table.
+//
+struct RouteManager::IDataProvider
+{
+	virtual ~IDataProvider() = 0
+	{
+	}
+
+	virtual DWORD createIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row) = 0;
+	virtual DWORD deleteIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row) = 0;
+
+	//
+	// Used when routes left behind by an earlier instance are recovered.
+	//
+	virtual DWORD getIpForwardTable2(ADDRESS_FAMILY Family, PMIB_IPFORWARD_TABLE2 *Table) = 0;
+	virtual void freeMibTable(PVOID Memory) = 0;
+
+	//
+	// Used for routes that don't specify a node.
+	//
+	virtual InterfaceAndGateway getBestDefaultRoute(ADDRESS_FAMILY family) = 0;
+
+	//
+	// Changes to the best default route are reported to 'callback'
+	// until the returned monitor is destroyed.
+	//
+	virtual std::unique_ptr<IDefaultRouteMonitor> createDefaultRouteMonitor(
+		IDefaultRouteMonitor::Callback callback,
+		std::shared_ptr<common::logging::ILogSink> logSink
+	) = 0;
+};
+
+class RouteManager::SystemDataProvider : public IDataProvider
+{
+public:
+
+	SystemDataProvider() = default;
+	virtual ~SystemDataProvider() = default;
+
+	SystemDataProvider(const SystemDataProvider &) = delete;
+	SystemDataProvider(SystemDataProvider &&) = delete;
+	SystemDataProvider &operator=(const SystemDataProvider &) = delete;
+	SystemDataProvider &operator=(SystemDataProvider &&) = delete;
+
+	DWORD createIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row) override;
+	DWORD deleteIpForwardEntry2(const MIB_IPFORWARD_ROW2 *Row) override;
+
+	DWORD getIpForwardTable2(ADDRESS_FAMILY Family, PMIB_IPFORWARD_TABLE2 *Table) override;
+	void freeMibTable(PVOID Memory) override;
+
+	InterfaceAndGateway getBestDefaultRoute(ADDRESS_FAMILY family) override;
+
+	std::unique_ptr<IDefaultRouteMonitor> createDefaultRouteMonitor(
+		IDefaultRouteMonitor::Callback callback,
+		std::shared_ptr<common::logging::ILogSink> logSink
+	) override;
 };
 
 }
@@ -0,0 +1,278 @@
+#include "stdafx.h"
+#include "routetable.h"
+#include "helpers.h"
+#include <libcommon/error.h>
+#include <cstring>
+
+namespace winnet::routing
+{
+
+namespace
+{
+
+//
+// FNV-1a
+//
+size_t HashBytes(size_t hash, const void *data, size_t size)
+{
+	const auto bytes = reinterpret_cast<const uint8_t *>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= static_cast<size_t>(1099511628211ULL);
+	}
+
+	return hash;
+}
+
+PrefixTrie<RouteTable::iterator>::Key TrieKey(const SOCKADDR_INET &address)
+{
+	PrefixTrie<RouteTable::iterator>::Key key = { 0 };
+
+	switch (address.si_family)
+	{
+		case AF_INET:
+		{
+			memcpy(key.data(), &address.Ipv4.sin_addr, sizeof(IN_ADDR));
+			break;
+		}
+		case AF_INET6:
+		{
+			memcpy(key.data(), &address.Ipv6.sin6_addr, sizeof(IN6_ADDR));
+			break;
+		}
+		default:
+		{
+			THROW_ERROR("Invalid address family for network address");
+		}
+	}
+
+	return key;
+}
+
+} // anonymous namespace
+
+size_t RouteTable::NetworkHash::operator()(const Network &network) const
+{
+	size_t hash = static_cast<size_t>(14695981039346656037ULL);
+
+	hash = HashBytes(hash, &network.Prefix.si_family, sizeof(network.Prefix.si_family));
+	hash = HashBytes(hash, &network.PrefixLength, sizeof(network.PrefixLength));
+
+	switch (network.Prefix.si_family)
+	{
+		case AF_INET:
+		{
+			return HashBytes(hash, &network.Prefix.Ipv4.sin_addr, sizeof(IN_ADDR));
+		}
+		case AF_INET6:
+		{
+			return HashBytes(hash, &network.Prefix.Ipv6.sin6_addr, sizeof(IN6_ADDR));
+		}
+		default:
+		{
+			THROW_ERROR("Invalid address family for network address");
+		}
+	}
+}
+
+bool RouteTable::NetworkEqual::operator()(const Network &lhs, const Network &rhs) const
+{
+	return EqualAddress(lhs, rhs);
+}
+
+RouteTable::iterator RouteTable::find(const Network &network)
+{
+	const auto it = m_networkIndex.find(network);
+
+	if (m_networkIndex.end() == it)
+	{
+		return m_records.end();
+	}
+
+	return it->second;
+}
+
+RouteTable::iterator RouteTable::findAggregate(const Network &member)
+{
+	const auto it = m_memberIndex.find(member);
+
+	if (m_memberIndex.end() == it)
+	{
+		return m_records.end();
+	}
+
+	return it->second;
+}
+
+RouteTable::const_iterator RouteTable::longestMatch(const NodeAddress &address) const
+{
+	const PrefixTrie<iterator> *trie;
+	uint8_t bits;
+
+	switch (address.si_family)
+	{
+		case AF_INET:
+		{
+			trie = &m_ipv4Trie;
+			bits = 32;
+
+			break;
+		}
+		case AF_INET6:
+		{
+			trie = &m_ipv6Trie;
+			bits = 128;
+
+			break;
+		}
+		default:
+		{
+			THROW_ERROR("Invalid address family for network address");
+		}
+	}
+
+	const auto match = trie->longestMatch(TrieKey(address), bits);
+
+	return (nullptr == match ? m_records.end() : *match);
+}
+
+std::vector<RouteTable::iterator> RouteTable::findByInterface(const NET_LUID &luid)
+{
+	std::vector<iterator> records;
+
+	const auto range = m_interfaceIndex.equal_range(luid.Value);
+
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		records.emplace_back(it->second);
+	}
+
+	return records;
+}
+
+RouteTable::iterator RouteTable::insert(const RouteRecord &record)
+{
+	if (m_networkIndex.end() != m_networkIndex.find(record.route.network()))
+	{
+		THROW_ERROR("Duplicate route record");
+	}
+
+	checkMembers(record.members, m_records.cend());
+
+	const auto it = m_records.insert(m_records.end(), record);
+
+	try
+	{
+		m_networkIndex.emplace(it->route.network(), it);
+		m_interfaceIndex.emplace(it->registeredRoute.luid.Value, it);
+
+		for (const auto &member : it->members)
+		{
+			m_memberIndex.emplace(member.network(), it);
+		}
+
+		const auto &network = it->route.network();
+
+		trie(network.Prefix.si_family).insert(TrieKey(network.Prefix), network.PrefixLength, it);
+	}
+	catch (...)
+	{
+		unindexMembers(it);
+		unindexInterface(it);
+
+		m_networkIndex.erase(it->route.network());
+		m_records.erase(it);
+
+		throw;
+	}
+
+	return it;
+}
+
+void RouteTable::erase(iterator record)
+{
+	const auto &network = record->route.network();
+
+	trie(network.Prefix.si_family).erase(TrieKey(network.Prefix), network.PrefixLength, record);
+
+	unindexMembers(record);
+	unindexInterface(record);
+
+	m_networkIndex.erase(record->route.network());
+	m_records.erase(record);
+}
+
+void RouteTable::rebind(iterator record, const NET_LUID &luid, const NodeAddress &nextHop)
+{
+	if (record->registeredRoute.luid.Value != luid.Value)
+	{
+		unindexInterface(record);
+		m_interfaceIndex.emplace(luid.Value, record);
+	}
+
+	record->registeredRoute.luid = luid;
+	record->registeredRoute.nextHop = nextHop;
+}
+
+void RouteTable::setMembers(iterator record, const std::vector<Route> &members)
+{
+	checkMembers(members, record);
+
+	unindexMembers(record);
+
+	record->members = members;
+
+	for (const auto &member : record->members)
+	{
+		m_memberIndex.emplace(member.network(), record);
+	}
+}
+
+void RouteTable::unindexInterface(iterator record)
+{
+	const auto range = m_interfaceIndex.equal_range(record->registeredRoute.luid.Value);
+
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == record)
+		{
+			m_interfaceIndex.erase(it);
+			return;
+		}
+	}
+}
+
+void RouteTable::unindexMembers(iterator record)
+{
+	for (const auto &member : record->members)
+	{
+		const auto it = m_memberIndex.find(member.network());
+
+		if (m_memberIndex.end() != it && it->second == record)
+		{
+			m_memberIndex.erase(it);
+		}
+	}
+}
+
+PrefixTrie<RouteTable::iterator> &RouteTable::trie(ADDRESS_FAMILY family)
+{
+	return (AF_INET == family ? m_ipv4Trie : m_ipv6Trie);
+}
+
+void RouteTable::checkMembers(const std::vector<Route> &members, const_iterator record) const
+{
+	for (const auto &member : members)
+	{
+		const auto it = m_memberIndex.find(member.network());
+
+		if (m_memberIndex.end() != it && it->second != record)
+		{
+			THROW_ERROR("Route is already aggregated into another record");
+		}
+	}
+}
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "prefixtrie.h"
+#include "types.h"
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace winnet::routing
+{
+
+// These are the exact details derived from the route specification (`Route`).
+// They are used when registering and deleting a route in the system.
+struct RegisteredRoute
+{
+	Network network;
+	NET_LUID luid;
+	NodeAddress nextHop;
+};
+
+struct RouteRecord
+{
+	Route route;
+	RegisteredRoute registeredRoute;
+
+	// Taken over from the journal of an earlier route manager, and not yet requested again.
+	bool adopted = false;
+
+	//
+	// Requested routes that were aggregated into 'route', or nothing if the route
+	// was registered as requested.
+	//
+	std::vector<Route> members;
+};
+
+//
+// Route records indexed on destination network, on the networks of the routes
+// aggregated into them, and on the interface that each registered route is
+// currently bound to. Destination networks are also kept in a prefix trie per
+// address family, for longest prefix match.
+//
+// Records are stored in insertion order and iterators remain valid
+// until the record is erased.
+//
+class RouteTable
+{
+public:
+
+	using Container = std::list<RouteRecord>;
+	using iterator = Container::iterator;
+	using const_iterator = Container::const_iterator;
+
+	RouteTable() = default;
+
+	RouteTable(const RouteTable &) = delete;
+	RouteTable(RouteTable &&) = default;
+	RouteTable &operator=(const RouteTable &) = delete;
+	RouteTable &operator=(RouteTable &&) = default;
+
+	iterator begin()
+	{
+		return m_records.begin();
+	}
+
+	iterator end()
+	{
+		return m_records.end();
+	}
+
+	const_iterator begin() const
+	{
+		return m_records.begin();
+	}
+
+	const_iterator end() const
+	{
+		return m_records.end();
+	}
+
+	bool empty() const
+	{
+		return m_records.empty();
+	}
+
+	size_t size() const
+	{
+		return m_records.size();
+	}
+
+	// Find record based on destination and mask.
+	iterator find(const Network &network);
+
+	// Find the record that a route for the network was aggregated into.
+	iterator findAggregate(const Network &member);
+
+	bool hasAggregates() const
+	{
+		return false == m_memberIndex.empty();
+	}
+
+	// Find the most specific record whose destination covers the address.
+	const_iterator longestMatch(const NodeAddress &address) const;
+
+	// Find all records whose registered route uses the interface.
+	std::vector<iterator> findByInterface(const NET_LUID &luid);
+
+	// Throws if there is already a record for the same network.
+	iterator insert(const RouteRecord &record);
+
+	void erase(iterator record);
+
+	//
+	// Rebind registered route to another interface and gateway.
+	// Always use this rather than updating the record directly, to keep the index current.
+	//
+	void rebind(iterator record, const NET_LUID &luid, const NodeAddress &nextHop);
+
+	//
+	// Replace the routes that are aggregated into the record.
+	// Always use this rather than updating the record directly, to keep the index current.
+	//
+	void setMembers(iterator record, const std::vector<Route> &members);
+
+	struct NetworkHash
+	{
+		size_t operator()(const Network &network) const;
+	};
+
+	struct NetworkEqual
+	{
+		bool operator()(const Network &lhs, const Network &rhs) const;
+	};
+
+	using NetworkSet = std::unordered_set<Network, NetworkHash, NetworkEqual>;
+
+private:
+
+	void unindexInterface(iterator record);
+	void unindexMembers(iterator record);
+
+	PrefixTrie<iterator> &trie(ADDRESS_FAMILY family);
+
+	// Throws if any of the networks is aggregated into a record other than 'record'.
+	void checkMembers(const std::vector<Route> &members, const_iterator record) const;
+
+	Container m_records;
+
+	std::unordered_map<Network, iterator, NetworkHash, NetworkEqual> m_networkIndex;
+	std::unordered_map<Network, iterator, NetworkHash, NetworkEqual> m_memberIndex;
+	std::unordered_multimap<uint64_t, iterator> m_interfaceIndex;
+
+	PrefixTrie<iterator> m_ipv4Trie;
+	PrefixTrie<iterator> m_ipv6Trie;
+};
+
+}
@@ -29,8 +29,20 @@ Node::Node(const std::optional<std::wstring> &deviceName, const std::optional<No
 	}
 }
 
+Node::Node(const NET_LUID &luid, const std::optional<NodeAddress> &gateway)
+	: m_luid(luid)
+	, m_gateway(gateway)
+{
+}
+
 bool Node::operator==(const Node &rhs) const
 {
+	if (m_luid.has_value() != rhs.m_luid.has_value()
+		|| (m_luid.has_value() && m_luid->Value != rhs.m_luid->Value))
+	{
+		return false;
+	}
+
 	if (m_deviceName.has_value())
 	{
 		if (false == rhs.m_deviceName.has_value()
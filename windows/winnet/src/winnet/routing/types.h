@@ -23,11 +23,22 @@ public:
 
 	Node(const std::optional<std::wstring> &deviceName, const std::optional<NodeAddress> &gateway);
 
+	//
+	// Identifies the interface directly, so nothing has to be resolved.
+	// Without a gateway, the route is on-link.
+	//
+	Node(const NET_LUID &luid, const std::optional<NodeAddress> &gateway);
+
 	const std::optional<std::wstring> &deviceName() const
 	{
 		return m_deviceName;
 	}
 
+	const std::optional<NET_LUID> &luid() const
+	{
+		return m_luid;
+	}
+
 	const std::optional<NodeAddress> &gateway() const
 	{
 		return m_gateway;
@@ -38,6 +49,7 @@ public:
 private:
 
 	std::optional<std::wstring> m_deviceName;
+	std::optional<NET_LUID> m_luid;
 	std::optional<NodeAddress> m_gateway;
 };
 
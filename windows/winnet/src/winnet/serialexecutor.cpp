@@ -0,0 +1,126 @@
+#include "stdafx.h"
+#include "serialexecutor.h"
+#include <sstream>
+
+namespace
+{
+
+//
+// Warn if a task has been waiting this long before it runs.
+//
+const std::chrono::seconds LATENCY_WARNING_THRESHOLD(1);
+
+} // anonymous namespace
+
+SerialExecutor::SerialExecutor(const char *name, std::shared_ptr<common::logging::ILogSink> logSink)
+	: m_name(name)
+	, m_logSink(logSink)
+	, m_shutdown(false)
+	, m_maxQueueDepth(0)
+	, m_dispatched(0)
+	, m_totalLatency(0)
+	, m_maxLatency(0)
+{
+	m_thread = std::thread(&SerialExecutor::thread, this);
+}
+
+SerialExecutor::~SerialExecutor()
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		m_shutdown = true;
+	}
+
+	m_cv.notify_all();
+
+	m_thread.join();
+}
+
+void SerialExecutor::post(Task task)
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+
+		m_queue.emplace_back(Entry{ std::move(task), std::chrono::steady_clock::now() });
+		m_maxQueueDepth = std::max(m_maxQueueDepth, m_queue.size());
+	}
+
+	m_cv.notify_one();
+}
+
+SerialExecutor::Statistics SerialExecutor::statistics() const
+{
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	Statistics stats;
+
+	stats.queueDepth = m_queue.size();
+	stats.maxQueueDepth = m_maxQueueDepth;
+	stats.dispatched = m_dispatched;
+	stats.averageLatency = (0 == m_dispatched ? std::chrono::microseconds(0) : m_totalLatency / m_dispatched);
+	stats.maxLatency = m_maxLatency;
+
+	return stats;
+}
+
+void SerialExecutor::thread()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	for (;;)
+	{
+		m_cv.wait(lock, [this]()
+		{
+			return m_shutdown || false == m_queue.empty();
+		});
+
+		if (m_queue.empty())
+		{
+			//
+			// Shutting down and no tasks remain.
+			//
+			return;
+		}
+
+		auto entry = std::move(m_queue.front());
+		m_queue.pop_front();
+
+		const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - entry.posted);
+
+		++m_dispatched;
+		m_totalLatency += latency;
+		m_maxLatency = std::max(m_maxLatency, latency);
+
+		const auto queueDepth = m_queue.size();
+
+		lock.unlock();
+
+		if (latency >= LATENCY_WARNING_THRESHOLD)
+		{
+			std::stringstream ss;
+
+			ss << m_name << ": task was queued for " << (latency.count() / 1000)
+				<< " ms, " << queueDepth << " task(s) still pending";
+
+			m_logSink->warning(ss.str().c_str());
+		}
+
+		try
+		{
+			entry.task();
+		}
+		catch (const std::exception &err)
+		{
+			const auto msg = std::string(m_name).append(": task failed: ").append(err.what());
+			m_logSink->error(msg.c_str());
+		}
+		catch (...)
+		{
+			const auto msg = std::string(m_name).append(": task failed with unspecified error");
+			m_logSink->error(msg.c_str());
+		}
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <libcommon/logging/ilogsink.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//
+// Runs tasks in order on a dedicated thread.
+//
+// Used to keep consumer callbacks off the IP Helper notification threads,
+// where a blocking callback would delay all later network events.
+//
+class SerialExecutor
+{
+public:
+
+	using Task = std::function<void()>;
+
+	struct Statistics
+	{
+		size_t queueDepth;
+		size_t maxQueueDepth;
+
+		uint64_t dispatched;
+
+		// Time from posting a task until it starts running.
+		std::chrono::microseconds averageLatency;
+		std::chrono::microseconds maxLatency;
+	};
+
+	//
+	// 'name' identifies the executor in log messages.
+	//
+	SerialExecutor(const char *name, std::shared_ptr<common::logging::ILogSink> logSink);
+
+	//
+	// Runs all tasks posted before destruction, then stops the thread.
+	// Must not be destroyed from within one of its own tasks.
+	//
+	~SerialExecutor();
+
+	SerialExecutor(const SerialExecutor &) = delete;
+	SerialExecutor &operator=(const SerialExecutor &) = delete;
+
+	void post(Task task);
+
+	Statistics statistics() const;
+
+private:
+
+	const char *m_name;
+	std::shared_ptr<common::logging::ILogSink> m_logSink;
+
+	struct Entry
+	{
+		Task task;
+		std::chrono::steady_clock::time_point posted;
+	};
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_cv;
+
+	std::deque<Entry> m_queue;
+	bool m_shutdown;
+
+	size_t m_maxQueueDepth;
+	uint64_t m_dispatched;
+	std::chrono::microseconds m_totalLatency;
+	std::chrono::microseconds m_maxLatency;
+
+	std::thread m_thread;
+
+	void thread();
+};
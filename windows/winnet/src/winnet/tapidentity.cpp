@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "tapidentity.h"
+#include <libcommon/error.h>
+#include <libshared/network/aliascache.h>
+
+TapIdentityCache::TapIdentityCache(shared::network::AdapterCache &adapterCache,
+	std::shared_ptr<NotificationHub> notificationHub)
+	: m_adapterCache(adapterCache)
+	, m_notificationHub(std::move(notificationHub))
+	, m_generation(0)
+{
+}
+
+TapIdentityCache::Identity TapIdentityCache::identity()
+{
+	std::scoped_lock<std::mutex> lock(m_lock);
+
+	const auto generation = m_adapterCache.generation();
+
+	if (m_identity.has_value()
+		&& generation == m_generation
+		&& validate(m_identity.value()))
+	{
+		return m_identity.value();
+	}
+
+	m_identity.reset();
+
+	auto identity = resolve();
+
+	m_identity = identity;
+	m_generation = generation;
+
+	return identity;
+}
+
+bool TapIdentityCache::validate(const Identity &identity) const
+{
+	//
+	// Renaming the adapter does not generate an interface notification.
+	//
+
+	wchar_t alias[NDIS_IF_MAX_STRING_SIZE + 1];
+
+	if (NO_ERROR != ConvertInterfaceLuidToAlias(&identity.luid, alias, _countof(alias)))
+	{
+		return false;
+	}
+
+	return 0 == _wcsicmp(alias, identity.alias.c_str());
+}
+
+TapIdentityCache::Identity TapIdentityCache::resolve()
+{
+	Identity identity;
+
+	identity.alias = shared::network::InterfaceUtils::GetTapInterfaceAlias();
+
+	auto status = shared::network::InterfaceAliasCache::Instance().resolve(identity.alias, identity.luid);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Resolve TAP interface LUID");
+	}
+
+	status = ConvertInterfaceLuidToIndex(&identity.luid, &identity.index);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Resolve TAP interface index");
+	}
+
+	//
+	// Share the interface table with other callers.
+	//
+	const auto interfaces = m_notificationHub->interfaceSnapshot();
+
+	identity.ipv6Enabled = (nullptr != interfaces->find(identity.luid, AF_INET6));
+
+	return identity;
+}
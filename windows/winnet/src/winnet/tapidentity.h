@@ -0,0 +1,45 @@
+#pragma once
+
+#include <libshared/network/adaptercache.h>
+#include "notificationhub.h"
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+//
+// Caches the identity of the primary TAP adapter.
+//
+// The identity is resolved again after interface notifications, or when
+// the adapter has been renamed.
+//
+class TapIdentityCache
+{
+public:
+
+	struct Identity
+	{
+		NET_LUID luid;
+		NET_IFINDEX index;
+		std::wstring alias;
+		bool ipv6Enabled;
+	};
+
+	TapIdentityCache(shared::network::AdapterCache &adapterCache, std::shared_ptr<NotificationHub> notificationHub);
+
+	Identity identity();
+
+private:
+
+	shared::network::AdapterCache &m_adapterCache;
+	std::shared_ptr<NotificationHub> m_notificationHub;
+
+	std::mutex m_lock;
+
+	std::optional<Identity> m_identity;
+	uint64_t m_generation;
+
+	bool validate(const Identity &identity) const;
+
+	Identity resolve();
+};
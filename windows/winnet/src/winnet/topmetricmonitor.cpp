@@ -0,0 +1,143 @@
+#include "stdafx.h"
+#include "topmetricmonitor.h"
+#include "NetworkInterfaces.h"
+#include <libshared/logging/ratelimiter.h>
+#include <libshared/performance/counterregistry.h>
+#include <sstream>
+#include <string>
+
+namespace
+{
+
+const uint32_t BURST_DURATION_MS = 100;
+const uint32_t BURST_WAIT_LIMIT_MS = 1000;
+
+//
+// At most this many corrections are made per window.
+//
+const uint32_t MAX_CORRECTIONS_PER_WINDOW = 5;
+const std::chrono::seconds CORRECTION_WINDOW(60);
+
+} // anonymous namespace
+
+TopMetricMonitor::TopMetricMonitor
+(
+	NET_LUID interfaceLuid,
+	std::shared_ptr<common::logging::ILogSink> logSink
+)
+	: m_interfaceLuid(interfaceLuid)
+	, m_logSink(logSink)
+	, m_enforceGuard(std::make_unique<common::BurstGuard>(
+		std::bind(&TopMetricMonitor::enforce, this),
+		BURST_DURATION_MS,
+		BURST_WAIT_LIMIT_MS
+	))
+	, m_windowStart(std::chrono::steady_clock::now())
+	, m_windowCorrections(0)
+	, m_throttleReported(false)
+{
+	m_interfaceSubscription = NotificationHub::Instance()->subscribeInterfaceChanges(
+		[this](MIB_IPINTERFACE_ROW *row, MIB_NOTIFICATION_TYPE notificationType)
+	{
+		//
+		// Only the monitored interface's own metric decides whether it's on top.
+		//
+
+		if (MibDeleteInstance == notificationType
+			|| (nullptr != row && row->InterfaceLuid.Value != m_interfaceLuid.Value))
+		{
+			return;
+		}
+
+		triggerEnforcement();
+	});
+
+	//
+	// The metric may have changed before the subscription was established.
+	//
+
+	triggerEnforcement();
+}
+
+TopMetricMonitor::~TopMetricMonitor()
+{
+	//
+	// Cancel notifications to stop triggering the BurstGuard.
+	//
+
+	m_interfaceSubscription.reset();
+
+	//
+	// Controlled destruction of BurstGuard to prevent it from calling here
+	// after other member variables have been destructed.
+	//
+
+	std::scoped_lock<std::mutex> lock(m_enforceGuardLock);
+
+	m_enforceGuard.reset();
+}
+
+void TopMetricMonitor::triggerEnforcement()
+{
+	std::scoped_lock<std::mutex> lock(m_enforceGuardLock);
+
+	if (m_enforceGuard)
+	{
+		m_enforceGuard->trigger();
+	}
+}
+
+void TopMetricMonitor::enforce()
+{
+	static auto &corrections = shared::performance::CounterRegistry::Instance().counter("winnet.metric.corrections");
+	static auto &throttled = shared::performance::CounterRegistry::Instance().counter("winnet.metric.throttled");
+	static shared::logging::RateLimiter errorLimiter;
+
+	std::scoped_lock<std::mutex> lock(m_enforceLock);
+
+	const auto now = std::chrono::steady_clock::now();
+
+	if (now - m_windowStart >= CORRECTION_WINDOW)
+	{
+		m_windowStart = now;
+		m_windowCorrections = 0;
+		m_throttleReported = false;
+	}
+
+	if (m_windowCorrections >= MAX_CORRECTIONS_PER_WINDOW)
+	{
+		if (false == m_throttleReported)
+		{
+			m_logSink->info("Interface metric keeps changing, not correcting it until the rate limit expires");
+			m_throttleReported = true;
+		}
+
+		throttled.increment();
+
+		return;
+	}
+
+	try
+	{
+		if (NetworkInterfaces::SetTopMetricForInterface(m_interfaceLuid))
+		{
+			++m_windowCorrections;
+			corrections.increment();
+
+			std::stringstream ss;
+
+			ss << "Restored top metric on interface with LUID 0x" << std::hex << m_interfaceLuid.Value;
+
+			m_logSink->info(ss.str().c_str());
+		}
+	}
+	catch (const std::exception &ex)
+	{
+		const auto msg = std::string("Failed to restore interface metric: ").append(ex.what());
+		errorLimiter.error(*m_logSink, msg.c_str());
+	}
+	catch (...)
+	{
+		errorLimiter.error(*m_logSink, "Unspecified failure while restoring interface metric");
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <ifdef.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <libcommon/logging/ilogsink.h>
+#include <libcommon/burstguard.h>
+#include "notificationhub.h"
+
+//
+// Keeps an interface at the top metric.
+//
+// Interface notifications for the interface are coalesced, and the metric is
+// corrected for the families where it no longer is the top metric. Only the rows
+// of the monitored interface are read, never the whole interface table.
+//
+// If something else keeps changing the metric, corrections are rate limited
+// rather than fighting it indefinitely. Corrections resume with the first
+// notification after the limit expires.
+//
+class TopMetricMonitor
+{
+public:
+
+	TopMetricMonitor(NET_LUID interfaceLuid, std::shared_ptr<common::logging::ILogSink> logSink);
+	~TopMetricMonitor();
+
+	TopMetricMonitor(const TopMetricMonitor &) = delete;
+	TopMetricMonitor(TopMetricMonitor &&) = delete;
+	TopMetricMonitor &operator=(const TopMetricMonitor &) = delete;
+	TopMetricMonitor &operator=(TopMetricMonitor &&) = delete;
+
+private:
+
+	const NET_LUID m_interfaceLuid;
+	std::shared_ptr<common::logging::ILogSink> m_logSink;
+
+	// This can't be a plain member variable.
+	// We need to be able to delete it explicitly in order to have a controlled tear down.
+	std::unique_ptr<common::BurstGuard> m_enforceGuard;
+	std::mutex m_enforceGuardLock;
+
+	std::mutex m_enforceLock;
+
+	std::chrono::steady_clock::time_point m_windowStart;
+	uint32_t m_windowCorrections;
+	bool m_throttleReported;
+
+	std::unique_ptr<NotificationHub::Subscription> m_interfaceSubscription;
+
+	void triggerEnforcement();
+
+	void enforce();
+};
@@ -0,0 +1,301 @@
+#include "stdafx.h"
+#include "tunnelreadiness.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libshared/performance/counterregistry.h>
+#include <sstream>
+
+namespace
+{
+
+bool IsMulticastOrBroadcast(const IP_ADDRESS_PREFIX &prefix)
+{
+	if (AF_INET == prefix.Prefix.si_family)
+	{
+		const auto address = prefix.Prefix.Ipv4.sin_addr.S_un.S_un_b;
+
+		return (0xE0 == (address.s_b1 & 0xF0))
+			|| (INADDR_BROADCAST == prefix.Prefix.Ipv4.sin_addr.s_addr);
+	}
+
+	return (0xFF == prefix.Prefix.Ipv6.sin6_addr.u.Byte[0]);
+}
+
+bool InterfaceConnected(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	MIB_IPINTERFACE_ROW row;
+
+	InitializeIpInterfaceEntry(&row);
+
+	row.Family = family;
+	row.InterfaceLuid = luid;
+
+	const auto status = GetIpInterfaceEntry(&row);
+
+	if (ERROR_NOT_FOUND == status)
+	{
+		return false;
+	}
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Resolve tunnel interface");
+	}
+
+	return FALSE != row.Connected;
+}
+
+bool AddressesPreferred(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	PMIB_UNICASTIPADDRESS_TABLE table;
+
+	const auto status = GetUnicastIpAddressTable(family, &table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Enumerate unicast addresses");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [table]()
+	{
+		FreeMibTable(table);
+	};
+
+	bool found = false;
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto &row = table->Table[i];
+
+		if (row.InterfaceLuid.Value != luid.Value)
+		{
+			continue;
+		}
+
+		if (IpDadStatePreferred != row.DadState)
+		{
+			return false;
+		}
+
+		found = true;
+	}
+
+	return found;
+}
+
+bool RoutesInstalled(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	PMIB_IPFORWARD_TABLE2 table;
+
+	const auto status = GetIpForwardTable2(family, &table);
+
+	if (NO_ERROR != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Enumerate routes");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [table]()
+	{
+		FreeMibTable(table);
+	};
+
+	for (ULONG i = 0; i < table->NumEntries; ++i)
+	{
+		const auto &row = table->Table[i];
+
+		if (row.InterfaceLuid.Value == luid.Value
+			&& false == IsMulticastOrBroadcast(row.DestinationPrefix))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FamilyReady(NET_LUID luid, ADDRESS_FAMILY family)
+{
+	return InterfaceConnected(luid, family)
+		&& AddressesPreferred(luid, family)
+		&& RoutesInstalled(luid, family);
+}
+
+} // anonymous namespace
+
+TunnelReadinessMonitor::TunnelReadinessMonitor
+(
+	NET_LUID tunnelLuid,
+	bool ipv4,
+	bool ipv6,
+	std::chrono::milliseconds timeout,
+	Callback callback,
+	std::shared_ptr<common::logging::ILogSink> logSink
+)
+	: m_tunnelLuid(tunnelLuid)
+	, m_ipv4(ipv4)
+	, m_ipv6(ipv6)
+	, m_timeout(timeout)
+	, m_callback(callback)
+	, m_logSink(logSink)
+	, m_stale(true)
+	, m_stop(false)
+{
+	if (false == ipv4 && false == ipv6)
+	{
+		THROW_ERROR("Invalid argument: no address family");
+	}
+
+	//
+	// Subscribe before the first evaluation, so no change is missed in between.
+	//
+
+	auto hub = NotificationHub::Instance();
+
+	m_interfaceSubscription = hub->subscribeInterfaceChanges([this](MIB_IPINTERFACE_ROW *row, MIB_NOTIFICATION_TYPE)
+	{
+		notify((nullptr == row ? NET_LUID{ 0 } : row->InterfaceLuid), nullptr == row);
+	});
+
+	m_addressSubscription = hub->subscribeAddressChanges([this](MIB_UNICASTIPADDRESS_ROW *row, MIB_NOTIFICATION_TYPE)
+	{
+		notify((nullptr == row ? NET_LUID{ 0 } : row->InterfaceLuid), nullptr == row);
+	});
+
+	m_routeSubscription = hub->subscribeRouteChanges([this](MIB_IPFORWARD_ROW2 *row, MIB_NOTIFICATION_TYPE)
+	{
+		notify((nullptr == row ? NET_LUID{ 0 } : row->InterfaceLuid), nullptr == row);
+	});
+
+	m_thread = std::thread(&TunnelReadinessMonitor::run, this);
+}
+
+TunnelReadinessMonitor::~TunnelReadinessMonitor()
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		m_stop = true;
+	}
+
+	m_changed.notify_all();
+	m_thread.join();
+
+	//
+	// Subscriptions are released after the thread, and wait for callbacks in progress.
+	//
+}
+
+//static
+bool TunnelReadinessMonitor::IsReady(NET_LUID luid, bool ipv4, bool ipv6)
+{
+	return (false == ipv4 || FamilyReady(luid, AF_INET))
+		&& (false == ipv6 || FamilyReady(luid, AF_INET6));
+}
+
+void TunnelReadinessMonitor::run()
+{
+	auto status = Status::Failed;
+
+	try
+	{
+		status = wait();
+	}
+	catch (const std::exception &ex)
+	{
+		const auto msg = std::string("Failed to wait for tunnel interface: ").append(ex.what());
+		m_logSink->error(msg.c_str());
+	}
+	catch (...)
+	{
+		m_logSink->error("Unspecified failure while waiting for tunnel interface");
+	}
+
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+
+		if (m_stop)
+		{
+			return;
+		}
+	}
+
+	m_callback(status);
+}
+
+TunnelReadinessMonitor::Status TunnelReadinessMonitor::wait()
+{
+	static auto &evaluations = shared::performance::CounterRegistry::Instance().counter("winnet.readiness.evaluations");
+	static auto &latency = shared::performance::CounterRegistry::Instance().histogram("winnet.readiness.wait");
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto deadline = start + m_timeout;
+
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	for (;;)
+	{
+		m_changed.wait_until(lock, deadline, [this]()
+		{
+			return m_stale || m_stop;
+		});
+
+		if (m_stop)
+		{
+			return Status::Failed;
+		}
+
+		if (false == m_stale)
+		{
+			m_logSink->warning("Timed out waiting for tunnel interface to become ready");
+			return Status::TimedOut;
+		}
+
+		m_stale = false;
+
+		//
+		// Changes that arrive while evaluating mark the state as stale again.
+		//
+
+		lock.unlock();
+
+		evaluations.increment();
+
+		const auto ready = IsReady(m_tunnelLuid, m_ipv4, m_ipv6);
+
+		lock.lock();
+
+		if (ready)
+		{
+			const auto elapsed = std::chrono::steady_clock::now() - start;
+
+			latency.record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
+
+			std::stringstream ss;
+
+			ss << "Tunnel interface ready after "
+				<< std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms";
+
+			m_logSink->info(ss.str().c_str());
+
+			return Status::Ready;
+		}
+	}
+}
+
+void TunnelReadinessMonitor::notify(NET_LUID luid, bool resync)
+{
+	if (false == resync && luid.Value != m_tunnelLuid.Value)
+	{
+		return;
+	}
+
+	{
+		std::scoped_lock<std::mutex> lock(m_lock);
+		m_stale = true;
+	}
+
+	m_changed.notify_all();
+}
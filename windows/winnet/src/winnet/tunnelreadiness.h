@@ -0,0 +1,96 @@
+#pragma once
+
+#include "notificationhub.h"
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <libcommon/logging/ilogsink.h>
+
+//
+// Waits for the tunnel interface to become usable, so the connected policy can be
+// applied as soon as it is, rather than on the next poll.
+//
+// The tunnel is ready when, for each family that is waited for, the interface is
+// connected, it has unicast addresses and all of them are preferred (DAD has
+// completed), and at least one unicast route goes through it.
+//
+// The state is only evaluated again when an interface, address or route notification
+// arrives. Evaluation happens on a background thread, and the outcome is reported
+// through the callback once, on that thread.
+//
+class TunnelReadinessMonitor
+{
+public:
+
+	enum class Status
+	{
+		Ready,
+		TimedOut,
+		Failed,
+	};
+
+	using Callback = std::function<void(Status status)>;
+
+	TunnelReadinessMonitor
+	(
+		NET_LUID tunnelLuid,
+		bool ipv4,
+		bool ipv6,
+		std::chrono::milliseconds timeout,
+		Callback callback,
+		std::shared_ptr<common::logging::ILogSink> logSink
+	);
+
+	//
+	// Abandons waiting, without invoking the callback.
+	// Must not be destroyed from within the callback.
+	//
+	~TunnelReadinessMonitor();
+
+	TunnelReadinessMonitor(const TunnelReadinessMonitor &) = delete;
+	TunnelReadinessMonitor(TunnelReadinessMonitor &&) = delete;
+	TunnelReadinessMonitor &operator=(const TunnelReadinessMonitor &) = delete;
+	TunnelReadinessMonitor &operator=(TunnelReadinessMonitor &&) = delete;
+
+	//
+	// Evaluate the state of the interface once.
+	//
+	static bool IsReady(NET_LUID luid, bool ipv4, bool ipv6);
+
+private:
+
+	const NET_LUID m_tunnelLuid;
+	const bool m_ipv4;
+	const bool m_ipv6;
+	const std::chrono::milliseconds m_timeout;
+
+	Callback m_callback;
+	std::shared_ptr<common::logging::ILogSink> m_logSink;
+
+	std::mutex m_lock;
+	std::condition_variable m_changed;
+
+	// Guarded by the lock.
+	bool m_stale;
+	bool m_stop;
+
+	std::unique_ptr<NotificationHub::Subscription> m_interfaceSubscription;
+	std::unique_ptr<NotificationHub::Subscription> m_addressSubscription;
+	std::unique_ptr<NotificationHub::Subscription> m_routeSubscription;
+
+	std::thread m_thread;
+
+	void run();
+
+	// Returns the status to report, or Failed with m_stop set if abandoned.
+	Status wait();
+
+	void notify(NET_LUID luid, bool resync);
+};
@@ -1,14 +1,25 @@
 #include "stdafx.h"
 #include "winnet.h"
 #include "NetworkInterfaces.h"
+#include "interfacestats.h"
+#include "mtudiscovery.h"
+#include "nativediagnostics.h"
+#include "notificationhub.h"
 #include "offlinemonitor.h"
+#include "tapidentity.h"
+#include "topmetricmonitor.h"
+#include "tunnelreadiness.h"
 #include "routing/routemanager.h"
 #include <libshared/logging/logsinkadapter.h>
 #include <libshared/logging/unwind.h>
+#include <libshared/performance/counterregistry.h>
 #include <libshared/network/interfaceutils.h>
+#include <libshared/network/adaptercache.h>
+#include <libshared/network/aliascache.h>
 #include <libcommon/error.h>
 #include <libcommon/valuemapper.h>
 #include <libcommon/network.h>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <optional>
@@ -22,12 +33,165 @@ using namespace shared::network;
 namespace
 {
 
+std::mutex g_OfflineMonitorLock;
 OfflineMonitor *g_OfflineMonitor = nullptr;
+std::shared_ptr<shared::logging::LogSinkAdapter> g_OfflineMonitorLogSink;
 
 std::mutex g_RouteManagerLock;
 RouteManager *g_RouteManager = nullptr;
 std::shared_ptr<shared::logging::LogSinkAdapter> g_RouteManagerLogSink;
 
+std::mutex g_TopMetricMonitorLock;
+TopMetricMonitor *g_TopMetricMonitor = nullptr;
+std::shared_ptr<shared::logging::LogSinkAdapter> g_TopMetricMonitorLogSink;
+
+std::mutex g_MtuDiscoveryLock;
+TunnelMtuDiscovery *g_MtuDiscovery = nullptr;
+std::shared_ptr<shared::logging::LogSinkAdapter> g_MtuDiscoveryLogSink;
+
+std::mutex g_ReadinessMonitorLock;
+TunnelReadinessMonitor *g_ReadinessMonitor = nullptr;
+std::shared_ptr<shared::logging::LogSinkAdapter> g_ReadinessMonitorLogSink;
+
+std::atomic<MULLVAD_LOG_LEVEL> g_LogLevel = MULLVAD_LOG_LEVEL_TRACE;
+
+//
+// Held while the offline action runs, so unregistering it waits for an invocation in progress.
+//
+std::mutex g_OfflineActionLock;
+WinNetOfflineAction g_OfflineAction = nullptr;
+
+AdapterCache &GetAdapterCache()
+{
+	static AdapterCache cache;
+	return cache;
+}
+
+InterfaceStatsSampler &GetInterfaceStatsSampler()
+{
+	static InterfaceStatsSampler sampler;
+	return sampler;
+}
+
+//
+// Holding on to the hub keeps its interface snapshot shared between calls.
+//
+const std::shared_ptr<NotificationHub> &GetNotificationHub()
+{
+	static const auto hub = NotificationHub::Instance();
+	return hub;
+}
+
+TapIdentityCache &GetTapIdentityCache()
+{
+	static TapIdentityCache cache(GetAdapterCache(), GetNotificationHub());
+	return cache;
+}
+
+WINNET_CONNECTIVITY TranslateConnectivity(OfflineMonitor::Connectivity connectivity)
+{
+	switch (connectivity)
+	{
+		case OfflineMonitor::Connectivity::Offline: return WINNET_CONNECTIVITY_OFFLINE;
+		case OfflineMonitor::Connectivity::Degraded: return WINNET_CONNECTIVITY_DEGRADED;
+		case OfflineMonitor::Connectivity::Online: return WINNET_CONNECTIVITY_ONLINE;
+		default:
+		{
+			THROW_ERROR("Missing case handler in switch clause");
+		}
+	}
+}
+
+void ActivateConnectivityMonitor
+(
+	OfflineMonitor::Notifier notifier,
+	uint32_t offlineConfirmationDelayMs,
+	uint32_t probeIntervalMs,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	auto logger = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext,
+		shared::logging::LogSinkAdapter::Mode::Asynchronous);
+
+	logger->setLevel(g_LogLevel);
+
+	auto forwarder = [notifier, logger](OfflineMonitor::Connectivity connectivity)
+	{
+		//
+		// Reach the safe state before the client learns about the loss of connectivity.
+		//
+		if (OfflineMonitor::Connectivity::Offline == connectivity)
+		{
+			std::scoped_lock<std::mutex> lock(g_OfflineActionLock);
+
+			const auto action = g_OfflineAction;
+
+			if (nullptr != action)
+			{
+				static auto &histogram = shared::performance::CounterRegistry::Instance().histogram("winnet.offline.action");
+
+				const shared::performance::LatencyHistogram::ScopedTimer timer(histogram);
+
+				if (false == action())
+				{
+					logger->warning("Failed to apply offline action");
+				}
+			}
+		}
+
+		notifier(connectivity);
+	};
+
+	g_OfflineMonitor = new OfflineMonitor(logger, forwarder, offlineConfirmationDelayMs, probeIntervalMs);
+	g_OfflineMonitorLogSink = logger;
+}
+
+WINNET_DEFAULT_ROUTE_CHANGE TranslateDefaultRouteChange(const RouteManager::DefaultRouteChange &change)
+{
+	//
+	// Translate the event type.
+	//
+
+	using from_t = RouteManager::DefaultRouteChangedEventType;
+	using to_t = WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE;
+
+	static const std::pair<from_t, to_t> eventTypeMap[] =
+	{
+		{ from_t::Updated, WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE_UPDATED },
+		{ from_t::Removed, WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE_REMOVED }
+	};
+
+	WINNET_DEFAULT_ROUTE_CHANGE translated;
+
+	translated.eventType = common::ValueMapper::Map<>(change.eventType, eventTypeMap);
+
+	//
+	// Translate the family type.
+	//
+
+	static const std::pair<ADDRESS_FAMILY, WINNET_IP_FAMILY> familyMap[] =
+	{
+		{ static_cast<ADDRESS_FAMILY>(AF_INET), WINNET_IP_FAMILY_V4 },
+		{ static_cast<ADDRESS_FAMILY>(AF_INET6), WINNET_IP_FAMILY_V6 }
+	};
+
+	translated.family = common::ValueMapper::Map<>(change.family, familyMap);
+
+	//
+	// Determine which LUID to forward.
+	//
+
+	translated.interfaceLuid = 0;
+
+	if (RouteManager::DefaultRouteChangedEventType::Updated == change.eventType)
+	{
+		translated.interfaceLuid = change.route.value().iface.Value;
+	}
+
+	return translated;
+}
+
 Network ConvertNetwork(const WINNET_IPNETWORK &in)
 {
 	//
@@ -135,49 +299,114 @@ std::vector<Route> ConvertRoutes(const WINNET_ROUTE *routes, uint32_t numRoutes)
 	return out;
 }
 
-std::vector<SOCKADDR_INET> ConvertAddresses(const WINNET_IP *addresses, uint32_t numAddresses)
+SOCKADDR_INET ConvertAddress(const WINNET_IP &from)
 {
-	//
-	// This duplicates the same logic we have above.
-	// TODO: Fix when time permits.
-	//
+	SOCKADDR_INET to{ 0 };
+
+	switch (from.type)
+	{
+		case WINNET_IP_TYPE_IPV4:
+		{
+			to.si_family = AF_INET;
+			to.Ipv4.sin_addr.s_addr = *reinterpret_cast<const uint32_t *>(from.bytes);
+
+			break;
+		}
+		case WINNET_IP_TYPE_IPV6:
+		{
+			to.si_family = AF_INET6;
+			memcpy(&to.Ipv6.sin6_addr.u.Byte, from.bytes, 16);
+
+			break;
+		}
+		default:
+		{
+			THROW_ERROR("Invalid address family in 'WINNET_IP' definition");
+		}
+	}
 
+	return to;
+}
+
+std::vector<SOCKADDR_INET> ConvertAddresses(const WINNET_IP *addresses, uint32_t numAddresses)
+{
 	std::vector<SOCKADDR_INET> out;
 	out.reserve(numAddresses);
 
 	for (uint32_t i = 0; i < numAddresses; ++i)
 	{
-		const WINNET_IP &from = addresses[i];
-		SOCKADDR_INET to{ 0 };
+		out.push_back(ConvertAddress(addresses[i]));
+	}
+
+	return out;
+}
+
+std::vector<Route> ConvertLuidRoutes(const WINNET_LUID_ROUTE *routes, uint32_t numRoutes)
+{
+	std::vector<Route> out;
+
+	out.reserve(numRoutes);
+
+	for (uint32_t i = 0; i < numRoutes; ++i)
+	{
+		const auto &route = routes[i];
+
+		std::optional<NodeAddress> gateway;
 
-		switch (from.type)
+		if (0 != route.hasGateway)
 		{
-			case WINNET_IP_TYPE_IPV4:
-			{
-				to.si_family = AF_INET;
-				to.Ipv4.sin_addr.s_addr = *reinterpret_cast<const uint32_t *>(from.bytes);
+			gateway = ConvertAddress(route.gateway);
+		}
 
-				break;
-			}
-			case WINNET_IP_TYPE_IPV6:
-			{
-				to.si_family = AF_INET6;
-				memcpy(&to.Ipv6.sin6_addr.u.Byte, from.bytes, 16);
+		std::optional<Node> node;
 
-				break;
-			}
-			default:
-			{
-				THROW_ERROR("Invalid address family in 'WINNET_IP' definition");
-			}
-		 }
+		if (0 != route.interfaceLuid)
+		{
+			NET_LUID luid;
+			luid.Value = route.interfaceLuid;
+
+			node = Node(luid, gateway);
+		}
+		else if (gateway.has_value())
+		{
+			node = Node(std::nullopt, gateway);
+		}
 
-		 out.push_back(to);
+		out.emplace_back(Route{ ConvertNetwork(route.network), node });
 	}
 
 	return out;
 }
 
+WINNET_IP ExportAddress(const SOCKADDR_INET &from)
+{
+	WINNET_IP to{};
+
+	switch (from.si_family)
+	{
+		case AF_INET:
+		{
+			to.type = WINNET_IP_TYPE_IPV4;
+			memcpy(to.bytes, &from.Ipv4.sin_addr, sizeof(from.Ipv4.sin_addr));
+
+			break;
+		}
+		case AF_INET6:
+		{
+			to.type = WINNET_IP_TYPE_IPV6;
+			memcpy(to.bytes, &from.Ipv6.sin6_addr, sizeof(from.Ipv6.sin6_addr));
+
+			break;
+		}
+		default:
+		{
+			THROW_ERROR("Missing case handler in switch clause");
+		}
+	}
+
+	return to;
+}
+
 } //anonymous namespace
 
 extern "C"
@@ -192,7 +421,7 @@ WinNet_EnsureTopMetric(
 {
 	try
 	{
-		NetworkInterfaces interfaces;
+		NetworkInterfaces interfaces(GetNotificationHub()->interfaceSnapshot());
 		bool metrics_set = interfaces.SetTopMetricForInterfacesByAlias(deviceAlias);
 		return metrics_set ? WINNET_ETM_STATUS_METRIC_SET : WINNET_ETM_STATUS_METRIC_NO_CHANGE;
 	}
@@ -203,48 +432,1071 @@ WinNet_EnsureTopMetric(
 	}
 	catch (...)
 	{
-		return WINNET_ETM_STATUS_FAILURE;
+		return WINNET_ETM_STATUS_FAILURE;
+	}
+};
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateTopMetricMonitor(
+	const wchar_t *deviceAlias,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	AutoLockType lock(g_TopMetricMonitorLock);
+
+	try
+	{
+		if (nullptr != g_TopMetricMonitor)
+		{
+			THROW_ERROR("Cannot activate top metric monitor twice");
+		}
+
+		if (nullptr == deviceAlias)
+		{
+			THROW_ERROR("Invalid argument: deviceAlias");
+		}
+
+		const auto luid = NetworkInterfaces::GetInterfaceLuid(deviceAlias);
+
+		auto logger = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext,
+			shared::logging::LogSinkAdapter::Mode::Asynchronous);
+
+		logger->setLevel(g_LogLevel);
+
+		g_TopMetricMonitor = new TopMetricMonitor(luid, logger);
+		g_TopMetricMonitorLogSink = logger;
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_DeactivateTopMetricMonitor(
+)
+{
+	AutoLockType lock(g_TopMetricMonitorLock);
+
+	try
+	{
+		delete g_TopMetricMonitor;
+		g_TopMetricMonitor = nullptr;
+		g_TopMetricMonitorLogSink.reset();
+	}
+	catch (...)
+	{
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+WINNET_GTII_STATUS
+WINNET_API
+WinNet_GetTapInterfaceIpv6Status(
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	try
+	{
+		return GetTapIdentityCache().identity().ipv6Enabled
+			? WINNET_GTII_STATUS_ENABLED
+			: WINNET_GTII_STATUS_DISABLED;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return WINNET_GTII_STATUS_FAILURE;
+	}
+	catch (...)
+	{
+		return WINNET_GTII_STATUS_FAILURE;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_GetTapInterfaceAlias(
+	wchar_t **alias,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	try
+	{
+		const auto currentAlias = GetTapIdentityCache().identity().alias;
+
+		auto stringBuffer = new wchar_t[currentAlias.size() + 1];
+		wcscpy(stringBuffer, currentAlias.c_str());
+
+		*alias = stringBuffer;
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+WINNET_CTIA_STATUS
+WINNET_API
+WinNet_CopyTapInterfaceAlias(
+	wchar_t *buffer,
+	uint32_t *bufferSize,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	try
+	{
+		if (nullptr == bufferSize)
+		{
+			THROW_ERROR("Invalid argument: bufferSize");
+		}
+
+		const auto currentAlias = GetTapIdentityCache().identity().alias;
+		const auto requiredSize = static_cast<uint32_t>(currentAlias.size() + 1);
+
+		if (nullptr == buffer || *bufferSize < requiredSize)
+		{
+			*bufferSize = requiredSize;
+			return WINNET_CTIA_STATUS_BUFFER_TOO_SMALL;
+		}
+
+		wcscpy_s(buffer, *bufferSize, currentAlias.c_str());
+		*bufferSize = requiredSize;
+
+		return WINNET_CTIA_STATUS_SUCCESS;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return WINNET_CTIA_STATUS_FAILURE;
+	}
+	catch (...)
+	{
+		return WINNET_CTIA_STATUS_FAILURE;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_ReleaseString(
+	wchar_t *str
+)
+{
+	try
+	{
+		delete[] str;
+	}
+	catch (...)
+	{
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateConnectivityMonitor(
+	WinNetConnectivityMonitorCallback callback,
+	void *callbackContext,
+	uint32_t offlineConfirmationDelayMs,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	AutoLockType lock(g_OfflineMonitorLock);
+
+	try
+	{
+		if (nullptr != g_OfflineMonitor)
+		{
+			THROW_ERROR("Cannot activate connectivity monitor twice");
+		}
+
+		//
+		// Probing is disabled, so degraded connectivity is never reported.
+		//
+		auto forwarder = [callback, callbackContext](OfflineMonitor::Connectivity connectivity)
+		{
+			callback(OfflineMonitor::Connectivity::Offline != connectivity, callbackContext);
+		};
+
+		ActivateConnectivityMonitor(forwarder, offlineConfirmationDelayMs, 0, logSink, logSinkContext);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateProbingConnectivityMonitor(
+	WinNetConnectivityStateCallback callback,
+	void *callbackContext,
+	uint32_t offlineConfirmationDelayMs,
+	uint32_t probeIntervalMs,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	AutoLockType lock(g_OfflineMonitorLock);
+
+	try
+	{
+		if (nullptr != g_OfflineMonitor)
+		{
+			THROW_ERROR("Cannot activate connectivity monitor twice");
+		}
+
+		auto forwarder = [callback, callbackContext](OfflineMonitor::Connectivity connectivity)
+		{
+			callback(TranslateConnectivity(connectivity), callbackContext);
+		};
+
+		ActivateConnectivityMonitor(forwarder, offlineConfirmationDelayMs, probeIntervalMs, logSink, logSinkContext);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_DeactivateConnectivityMonitor(
+)
+{
+	OfflineMonitor *monitor = nullptr;
+	std::shared_ptr<shared::logging::LogSinkAdapter> logSink;
+
+	{
+		AutoLockType lock(g_OfflineMonitorLock);
+
+		std::swap(monitor, g_OfflineMonitor);
+		std::swap(logSink, g_OfflineMonitorLogSink);
+	}
+
+	//
+	// Destroyed outside the lock, since the callback may query connectivity
+	// while the monitor is draining its notifications.
+	//
+
+	try
+	{
+		delete monitor;
+	}
+	catch (...)
+	{
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_QueryConnectivity(
+	WINNET_CONNECTIVITY *connectivity,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	if (nullptr == connectivity)
+	{
+		return false;
+	}
+
+	try
+	{
+		{
+			AutoLockType lock(g_OfflineMonitorLock);
+
+			if (nullptr != g_OfflineMonitor)
+			{
+				*connectivity = TranslateConnectivity(g_OfflineMonitor->connectivity());
+				return true;
+			}
+		}
+
+		*connectivity = TranslateConnectivity(OfflineMonitor::QueryConnectivity());
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_SetConnectivityOfflineAction(
+	WinNetOfflineAction action
+)
+{
+	std::scoped_lock<std::mutex> lock(g_OfflineActionLock);
+
+	g_OfflineAction = action;
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateRouteManager(
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	try
+	{
+		if (nullptr != g_RouteManager)
+		{
+			THROW_ERROR("Cannot activate route manager twice");
+		}
+
+		g_RouteManagerLogSink = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext,
+			shared::logging::LogSinkAdapter::Mode::Asynchronous);
+		g_RouteManagerLogSink->setLevel(g_LogLevel);
+		g_RouteManager = new RouteManager(g_RouteManagerLogSink);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateRouteManagerWithJournal(
+	MullvadLogSink logSink,
+	void *logSinkContext,
+	const wchar_t *journalPath
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	try
+	{
+		if (nullptr != g_RouteManager)
+		{
+			THROW_ERROR("Cannot activate route manager twice");
+		}
+
+		if (nullptr == journalPath)
+		{
+			THROW_ERROR("Invalid argument: journalPath");
+		}
+
+		auto journal = std::make_unique<RouteJournal>(journalPath);
+
+		g_RouteManagerLogSink = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext,
+			shared::logging::LogSinkAdapter::Mode::Asynchronous);
+		g_RouteManagerLogSink->setLevel(g_LogLevel);
+		g_RouteManager = new RouteManager(g_RouteManagerLogSink, std::move(journal));
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_AddRoutes(
+	const WINNET_ROUTE *routes,
+	uint32_t numRoutes
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->addRoutes(ConvertRoutes(routes, numRoutes));
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ApplyRouteSet(
+	const WINNET_ROUTE *routes,
+	uint32_t numRoutes
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->applyRoutes(ConvertRoutes(routes, numRoutes));
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_AddRoute(
+	const WINNET_ROUTE *route
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->addRoute
+		(
+			Route{ ConvertNetwork(route->network), ConvertNode(route->node) }
+		);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_DeleteRoutes(
+	const WINNET_ROUTE *routes,
+	uint32_t numRoutes
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->deleteRoutes(ConvertRoutes(routes, numRoutes));
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_DeleteRoute(
+	const WINNET_ROUTE *route
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->deleteRoute
+		(
+			Route{ ConvertNetwork(route->network), ConvertNode(route->node) }
+		);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_AddLuidRoutes(
+	const WINNET_LUID_ROUTE *routes,
+	uint32_t numRoutes
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->addRoutes(ConvertLuidRoutes(routes, numRoutes));
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ApplyLuidRouteSet(
+	const WINNET_LUID_ROUTE *routes,
+	uint32_t numRoutes
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->applyRoutes(ConvertLuidRoutes(routes, numRoutes));
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_DeleteLuidRoutes(
+	const WINNET_LUID_ROUTE *routes,
+	uint32_t numRoutes
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->deleteRoutes(ConvertLuidRoutes(routes, numRoutes));
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_RegisterDefaultRouteChangedCallback(
+	WinNetDefaultRouteChangedCallback callback,
+	void *context,
+	void **registrationHandle
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		//
+		// Changes that were evaluated together are forwarded one family at a time.
+		//
+		auto forwarder = [callback, context](const std::vector<RouteManager::DefaultRouteChange> &changes)
+		{
+			for (const auto &change : changes)
+			{
+				const auto translated = TranslateDefaultRouteChange(change);
+
+				callback(translated.eventType, translated.family, translated.interfaceLuid, context);
+			}
+		};
+
+		*registrationHandle = g_RouteManager->registerDefaultRouteChangedCallback(forwarder);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_RegisterDefaultRoutesChangedCallback(
+	WinNetDefaultRoutesChangedCallback callback,
+	void *context,
+	void **registrationHandle
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		auto forwarder = [callback, context](const std::vector<RouteManager::DefaultRouteChange> &changes)
+		{
+			std::vector<WINNET_DEFAULT_ROUTE_CHANGE> translated;
+			translated.reserve(changes.size());
+
+			for (const auto &change : changes)
+			{
+				translated.emplace_back(TranslateDefaultRouteChange(change));
+			}
+
+			callback(translated.data(), static_cast<uint32_t>(translated.size()), context);
+		};
+
+		*registrationHandle = g_RouteManager->registerDefaultRouteChangedCallback(forwarder);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_UnregisterDefaultRouteChangedCallback(
+	void *registrationHandle
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return;
+	}
+
+	try
+	{
+		g_RouteManager->unregisterDefaultRouteChangedCallback(registrationHandle);
+	}
+	catch (const std::exception &err)
+	{
+		g_RouteManagerLogSink->error("Failed to unregister default-route-changed callback");
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+	}
+	catch (...)
+	{
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_SetDefaultRouteCoalescing(
+	uint32_t windowMs,
+	uint32_t maxLatencyMs
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->setDefaultRouteCoalescing(windowMs, maxLatencyMs);
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ApplyExclusionRoutes(
+	const WINNET_IPNETWORK *excluded,
+	uint32_t numExcluded,
+	uint64_t interfaceLuid,
+	bool ipv4,
+	bool ipv6
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager || (nullptr == excluded && 0 != numExcluded) || 0 == interfaceLuid)
+	{
+		return false;
+	}
+
+	try
+	{
+		std::vector<Network> networks;
+		networks.reserve(numExcluded);
+
+		for (uint32_t i = 0; i < numExcluded; ++i)
+		{
+			networks.push_back(ConvertNetwork(excluded[i]));
+		}
+
+		std::vector<ADDRESS_FAMILY> families;
+
+		if (ipv4)
+		{
+			families.push_back(AF_INET);
+		}
+
+		if (ipv6)
+		{
+			families.push_back(AF_INET6);
+		}
+
+		NET_LUID luid;
+		luid.Value = interfaceLuid;
+
+		g_RouteManager->applyExclusions(networks, families, luid);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ClearExclusionRoutes(
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager)
+	{
+		return false;
+	}
+
+	try
+	{
+		NET_LUID luid;
+		luid.Value = 0;
+
+		g_RouteManager->applyExclusions({}, {}, luid);
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_SetRelayRoutes(
+	const WINNET_IP *relays,
+	uint32_t numRelays
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager || (nullptr == relays && 0 != numRelays))
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->setRelayRoutes(ConvertAddresses(relays, numRelays));
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_DumpRouteEvents(
+	MullvadLogSink sink,
+	void *context
+)
+{
+	AutoLockType lock(g_RouteManagerLock);
+
+	if (nullptr == g_RouteManager || nullptr == sink)
+	{
+		return false;
+	}
+
+	try
+	{
+		g_RouteManager->dumpEvents([sink, context](const std::string &line)
+		{
+			sink(MULLVAD_LOG_LEVEL_INFO, line.c_str(), context);
+		});
+
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
 	}
-};
+}
 
 extern "C"
 WINNET_LINKAGE
-WINNET_GTII_STATUS
+WINNET_LMR_STATUS
 WINNET_API
-WinNet_GetTapInterfaceIpv6Status(
-	MullvadLogSink logSink,
-	void *logSinkContext
+WinNet_LookupManagedRoute(
+	const WINNET_IP *destination,
+	WINNET_MANAGED_ROUTE *route
 )
 {
-	try
-	{
-		MIB_IPINTERFACE_ROW iface = { 0 };
+	AutoLockType lock(g_RouteManagerLock);
 
-		iface.InterfaceLuid = NetworkInterfaces::GetInterfaceLuid(InterfaceUtils::GetTapInterfaceAlias());
-		iface.Family = AF_INET6;
+	if (nullptr == g_RouteManager || nullptr == destination || nullptr == route)
+	{
+		return WINNET_LMR_STATUS_FAILURE;
+	}
 
-		const auto status = GetIpInterfaceEntry(&iface);
+	try
+	{
+		const auto match = g_RouteManager->lookupRoute(ConvertAddress(*destination));
 
-		if (NO_ERROR == status)
+		if (false == match.has_value())
 		{
-			return WINNET_GTII_STATUS_ENABLED;
+			return WINNET_LMR_STATUS_NOT_FOUND;
 		}
 
-		if (ERROR_NOT_FOUND == status)
-		{
-			return WINNET_GTII_STATUS_DISABLED;
-		}
+		const auto &network = match->network;
+		const auto prefix = ExportAddress(network.Prefix);
+
+		route->network.type = prefix.type;
+		memcpy(route->network.bytes, prefix.bytes, sizeof(prefix.bytes));
+		route->network.prefix = network.PrefixLength;
+
+		route->interfaceLuid = match->luid.Value;
+
+		route->nextHop = ExportAddress(match->nextHop);
 
-		THROW_WINDOWS_ERROR(status, "Resolve TAP IPv6 interface");
+		return WINNET_LMR_STATUS_FOUND;
 	}
 	catch (const std::exception &err)
 	{
-		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
-		return WINNET_GTII_STATUS_FAILURE;
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		return WINNET_LMR_STATUS_FAILURE;
 	}
 	catch (...)
 	{
-		return WINNET_GTII_STATUS_FAILURE;
+		return WINNET_LMR_STATUS_FAILURE;
 	}
 }
 
@@ -252,20 +1504,59 @@ extern "C"
 WINNET_LINKAGE
 bool
 WINNET_API
-WinNet_GetTapInterfaceAlias(
-	wchar_t **alias,
+WinNet_StartTunnelMtuDiscovery(
+	const WINNET_IP *relay,
+	uint64_t tunnelInterfaceLuid,
+	uint16_t tunnelOverhead,
+	WinNetMtuDiscoveryCallback callback,
+	void *callbackContext,
 	MullvadLogSink logSink,
 	void *logSinkContext
 )
 {
+	AutoLockType lock(g_MtuDiscoveryLock);
+
 	try
 	{
-		const auto currentAlias = InterfaceUtils::GetTapInterfaceAlias();
+		if (nullptr == relay)
+		{
+			THROW_ERROR("Invalid argument: relay");
+		}
 
-		auto stringBuffer = new wchar_t[currentAlias.size() + 1];
-		wcscpy(stringBuffer, currentAlias.c_str());
+		if (nullptr == callback)
+		{
+			THROW_ERROR("Invalid argument: callback");
+		}
 
-		*alias = stringBuffer;
+		delete g_MtuDiscovery;
+		g_MtuDiscovery = nullptr;
+
+		auto logger = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext,
+			shared::logging::LogSinkAdapter::Mode::Asynchronous);
+
+		logger->setLevel(g_LogLevel);
+
+		NET_LUID luid;
+		luid.Value = tunnelInterfaceLuid;
+
+		auto forwarder = [callback, callbackContext](const TunnelMtuDiscovery::Result &result)
+		{
+			using from_t = TunnelMtuDiscovery::Status;
+
+			static const std::pair<from_t, WINNET_MTU_DISCOVERY_STATUS> statusMap[] =
+			{
+				{ from_t::Updated, WINNET_MTU_DISCOVERY_STATUS_UPDATED },
+				{ from_t::Unreachable, WINNET_MTU_DISCOVERY_STATUS_UNREACHABLE },
+				{ from_t::Failed, WINNET_MTU_DISCOVERY_STATUS_FAILURE }
+			};
+
+			const auto status = common::ValueMapper::Map<>(result.status, statusMap);
+
+			callback(status, result.pathMtu, result.tunnelMtu, callbackContext);
+		};
+
+		g_MtuDiscovery = new TunnelMtuDiscovery(ConvertAddress(*relay), luid, tunnelOverhead, forwarder, logger);
+		g_MtuDiscoveryLogSink = logger;
 
 		return true;
 	}
@@ -284,13 +1575,16 @@ extern "C"
 WINNET_LINKAGE
 void
 WINNET_API
-WinNet_ReleaseString(
-	wchar_t *str
+WinNet_StopTunnelMtuDiscovery(
 )
 {
+	AutoLockType lock(g_MtuDiscoveryLock);
+
 	try
 	{
-		delete[] str;
+		delete g_MtuDiscovery;
+		g_MtuDiscovery = nullptr;
+		g_MtuDiscoveryLogSink.reset();
 	}
 	catch (...)
 	{
@@ -301,28 +1595,54 @@ extern "C"
 WINNET_LINKAGE
 bool
 WINNET_API
-WinNet_ActivateConnectivityMonitor(
-	WinNetConnectivityMonitorCallback callback,
+WinNet_StartTunnelReadinessMonitor(
+	uint64_t tunnelInterfaceLuid,
+	bool ipv4,
+	bool ipv6,
+	uint32_t timeoutMs,
+	WinNetTunnelReadinessCallback callback,
 	void *callbackContext,
 	MullvadLogSink logSink,
 	void *logSinkContext
 )
 {
+	AutoLockType lock(g_ReadinessMonitorLock);
+
 	try
 	{
-		if (nullptr != g_OfflineMonitor)
+		if (nullptr == callback)
 		{
-			THROW_ERROR("Cannot activate connectivity monitor twice");
+			THROW_ERROR("Invalid argument: callback");
 		}
 
-		auto forwarder = [callback, callbackContext](bool connected)
+		delete g_ReadinessMonitor;
+		g_ReadinessMonitor = nullptr;
+
+		auto logger = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext,
+			shared::logging::LogSinkAdapter::Mode::Asynchronous);
+
+		logger->setLevel(g_LogLevel);
+
+		NET_LUID luid;
+		luid.Value = tunnelInterfaceLuid;
+
+		auto forwarder = [callback, callbackContext](TunnelReadinessMonitor::Status status)
 		{
-			callback(connected, callbackContext);
-		};
+			using from_t = TunnelReadinessMonitor::Status;
 
-		auto logger = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext);
+			static const std::pair<from_t, WINNET_TUNNEL_READINESS_STATUS> statusMap[] =
+			{
+				{ from_t::Ready, WINNET_TUNNEL_READINESS_STATUS_READY },
+				{ from_t::TimedOut, WINNET_TUNNEL_READINESS_STATUS_TIMED_OUT },
+				{ from_t::Failed, WINNET_TUNNEL_READINESS_STATUS_FAILURE }
+			};
+
+			callback(common::ValueMapper::Map<>(status, statusMap), callbackContext);
+		};
 
-		g_OfflineMonitor = new OfflineMonitor(logger, forwarder);
+		g_ReadinessMonitor = new TunnelReadinessMonitor(luid, ipv4, ipv6,
+			std::chrono::milliseconds(timeoutMs), forwarder, logger);
+		g_ReadinessMonitorLogSink = logger;
 
 		return true;
 	}
@@ -341,13 +1661,16 @@ extern "C"
 WINNET_LINKAGE
 void
 WINNET_API
-WinNet_DeactivateConnectivityMonitor(
+WinNet_StopTunnelReadinessMonitor(
 )
 {
+	AutoLockType lock(g_ReadinessMonitorLock);
+
 	try
 	{
-		delete g_OfflineMonitor;
-		g_OfflineMonitor = nullptr;
+		delete g_ReadinessMonitor;
+		g_ReadinessMonitor = nullptr;
+		g_ReadinessMonitorLogSink.reset();
 	}
 	catch (...)
 	{
@@ -358,28 +1681,25 @@ extern "C"
 WINNET_LINKAGE
 bool
 WINNET_API
-WinNet_ActivateRouteManager(
-	MullvadLogSink logSink,
-	void *logSinkContext
+WinNet_SetRouteAggregation(
+	bool enabled
 )
 {
 	AutoLockType lock(g_RouteManagerLock);
 
-	try
+	if (nullptr == g_RouteManager)
 	{
-		if (nullptr != g_RouteManager)
-		{
-			THROW_ERROR("Cannot activate route manager twice");
-		}
-
-		g_RouteManagerLogSink = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext);
-		g_RouteManager = new RouteManager(g_RouteManagerLogSink);
+		return false;
+	}
 
+	try
+	{
+		g_RouteManager->setRouteAggregation(enabled);
 		return true;
 	}
 	catch (const std::exception &err)
 	{
-		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
 		return false;
 	}
 	catch (...)
@@ -392,9 +1712,8 @@ extern "C"
 WINNET_LINKAGE
 bool
 WINNET_API
-WinNet_AddRoutes(
-	const WINNET_ROUTE *routes,
-	uint32_t numRoutes
+WinNet_SetLatencyBudget(
+	uint32_t routeRestoreMs
 )
 {
 	AutoLockType lock(g_RouteManagerLock);
@@ -406,12 +1725,12 @@ WinNet_AddRoutes(
 
 	try
 	{
-		g_RouteManager->addRoutes(ConvertRoutes(routes, numRoutes));
+		g_RouteManager->setLatencyBudget(std::chrono::milliseconds(routeRestoreMs));
 		return true;
 	}
 	catch (const std::exception &err)
 	{
-		common::error::UnwindException(err, g_RouteManagerLogSink);
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
 		return false;
 	}
 	catch (...)
@@ -422,68 +1741,61 @@ WinNet_AddRoutes(
 
 extern "C"
 WINNET_LINKAGE
-bool
+void
 WINNET_API
-WinNet_AddRoute(
-	const WINNET_ROUTE *route
+WinNet_SetLogLevel(
+	MULLVAD_LOG_LEVEL level
 )
 {
-	AutoLockType lock(g_RouteManagerLock);
+	g_LogLevel = level;
 
-	if (nullptr == g_RouteManager)
+	if (g_OfflineMonitorLogSink)
 	{
-		return false;
+		g_OfflineMonitorLogSink->setLevel(level);
 	}
 
-	try
 	{
-		g_RouteManager->addRoute
-		(
-			Route{ ConvertNetwork(route->network), ConvertNode(route->node) }
-		);
+		AutoLockType lock(g_RouteManagerLock);
 
-		return true;
+		if (g_RouteManagerLogSink)
+		{
+			g_RouteManagerLogSink->setLevel(level);
+		}
 	}
-	catch (const std::exception &err)
+
 	{
-		common::error::UnwindException(err, g_RouteManagerLogSink);
-		return false;
+		AutoLockType lock(g_TopMetricMonitorLock);
+
+		if (g_TopMetricMonitorLogSink)
+		{
+			g_TopMetricMonitorLogSink->setLevel(level);
+		}
 	}
-	catch (...)
+
+	AutoLockType lock(g_MtuDiscoveryLock);
+
+	if (g_MtuDiscoveryLogSink)
 	{
-		return false;
+		g_MtuDiscoveryLogSink->setLevel(level);
 	}
 }
 
 extern "C"
 WINNET_LINKAGE
-bool
+void
 WINNET_API
-WinNet_DeleteRoutes(
-	const WINNET_ROUTE *routes,
-	uint32_t numRoutes
+WinNet_DeactivateRouteManager(
 )
 {
 	AutoLockType lock(g_RouteManagerLock);
 
-	if (nullptr == g_RouteManager)
-	{
-		return false;
-	}
-
 	try
 	{
-		g_RouteManager->deleteRoutes(ConvertRoutes(routes, numRoutes));
-		return true;
-	}
-	catch (const std::exception &err)
-	{
-		common::error::UnwindException(err, g_RouteManagerLogSink);
-		return false;
+		delete g_RouteManager;
+		g_RouteManager = nullptr;
 	}
 	catch (...)
 	{
-		return false;
 	}
 }
 
@@ -491,8 +1803,7 @@ extern "C"
 WINNET_LINKAGE
 bool
 WINNET_API
-WinNet_DeleteRoute(
-	const WINNET_ROUTE *route
+WinNet_DetachRouteManager(
 )
 {
 	AutoLockType lock(g_RouteManagerLock);
@@ -504,16 +1815,16 @@ WinNet_DeleteRoute(
 
 	try
 	{
-		g_RouteManager->deleteRoute
-		(
-			Route{ ConvertNetwork(route->network), ConvertNode(route->node) }
-		);
+		g_RouteManager->detach();
+
+		delete g_RouteManager;
+		g_RouteManager = nullptr;
 
 		return true;
 	}
 	catch (const std::exception &err)
 	{
-		common::error::UnwindException(err, g_RouteManagerLogSink);
+		shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
 		return false;
 	}
 	catch (...)
@@ -526,76 +1837,78 @@ extern "C"
 WINNET_LINKAGE
 bool
 WINNET_API
-WinNet_RegisterDefaultRouteChangedCallback(
-	WinNetDefaultRouteChangedCallback callback,
-	void *context,
-	void **registrationHandle
+WinNet_PurgeOwnedRoutes(
+	MullvadLogSink logSink,
+	void *logSinkContext,
+	const wchar_t *journalPath
 )
 {
 	AutoLockType lock(g_RouteManagerLock);
 
-	if (nullptr == g_RouteManager)
-	{
-		return false;
-	}
-
 	try
 	{
-		auto forwarder = [callback, context](RouteManager::DefaultRouteChangedEventType eventType,
-			ADDRESS_FAMILY family, const std::optional<InterfaceAndGateway> &route)
+		if (nullptr != g_RouteManager)
 		{
-			//
-			// Translate the event type.
-			//
-
-			using from_t = RouteManager::DefaultRouteChangedEventType;
-			using to_t = WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE;
-
-			static const std::pair<from_t, to_t> eventTypeMap[] =
-			{
-				{ from_t::Updated, WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE_UPDATED },
-				{ from_t::Removed, WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE_REMOVED }
-			};
+			THROW_ERROR("Cannot purge routes while the route manager is active");
+		}
 
-			const auto translatedEventType = common::ValueMapper::Map<>(eventType, eventTypeMap);
+		if (nullptr == journalPath)
+		{
+			THROW_ERROR("Invalid argument: journalPath");
+		}
 
-			//
-			// Translate the family type.
-			//
+		RouteJournal journal(journalPath);
 
-			static const std::pair<ADDRESS_FAMILY, WINNET_IP_FAMILY> familyMap[] =
-			{
-				{ static_cast<ADDRESS_FAMILY>(AF_INET), WINNET_IP_FAMILY_V4 },
-				{ static_cast<ADDRESS_FAMILY>(AF_INET6), WINNET_IP_FAMILY_V6 }
-			};
+		auto logger = std::make_shared<shared::logging::LogSinkAdapter>(logSink, logSinkContext);
 
-			const auto translatedFamily = common::ValueMapper::Map<>(family, familyMap);
+		logger->setLevel(g_LogLevel);
 
-			//
-			// Determine which LUID to forward.
-			//
+		RouteManager::PurgeOwnedRoutes(*logger, journal);
 
-			uint64_t translatedLuid = 0;
+		return true;
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
 
-			if (RouteManager::DefaultRouteChangedEventType::Updated == eventType)
-			{
-				translatedLuid = route.value().iface.Value;
-			}
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_AddDeviceIpAddresses(
+	const wchar_t *deviceAlias,
+	const WINNET_IP *addresses,
+	uint32_t numAddresses,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	try
+	{
+		NET_LUID luid;
 
-			//
-			// Forward to client.
-			//
+		if (0 != shared::network::InterfaceAliasCache::Instance().resolve(deviceAlias, luid))
+		{
+			const auto msg = std::string("Unable to derive interface LUID from interface alias: ")
+				.append(common::string::ToAnsi(deviceAlias));
 
-			callback(translatedEventType, translatedFamily, translatedLuid, context);
-		};
+			THROW_ERROR(msg.c_str());
+		}
 
-		*registrationHandle = g_RouteManager->registerDefaultRouteChangedCallback(forwarder);
+		InterfaceUtils::AddDeviceIpAddresses(luid, ConvertAddresses(addresses, numAddresses));
 
 		return true;
 	}
 	catch (const std::exception &err)
 	{
-		common::error::UnwindException(err, g_RouteManagerLogSink);
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
 		return false;
 	}
 	catch (...)
@@ -606,83 +1919,95 @@ WinNet_RegisterDefaultRouteChangedCallback(
 
 extern "C"
 WINNET_LINKAGE
-void
+bool
 WINNET_API
-WinNet_UnregisterDefaultRouteChangedCallback(
-	void *registrationHandle
+WinNet_SampleInterfaceStats(
+	WINNET_INTERFACE_STATS *stats,
+	uint32_t numStats,
+	MullvadLogSink logSink,
+	void *logSinkContext
 )
 {
-	AutoLockType lock(g_RouteManagerLock);
-
-	if (nullptr == g_RouteManager)
+	if (nullptr == stats && 0 != numStats)
 	{
-		return;
+		return false;
 	}
 
 	try
 	{
-		g_RouteManager->unregisterDefaultRouteChangedCallback(registrationHandle);
+		GetInterfaceStatsSampler().sample(stats, numStats);
+
+		return true;
 	}
 	catch (const std::exception &err)
 	{
-		g_RouteManagerLogSink->error("Failed to unregister default-route-changed callback");
-		common::error::UnwindException(err, g_RouteManagerLogSink);
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return false;
 	}
 	catch (...)
 	{
+		return false;
 	}
 }
 
-extern "C"
 WINNET_LINKAGE
-void
+bool
 WINNET_API
-WinNet_DeactivateRouteManager(
+WinNet_GetPerformanceCounters(
+	MullvadCounterSink sink,
+	void *context
 )
 {
-	AutoLockType lock(g_RouteManagerLock);
+	if (nullptr == sink)
+	{
+		return false;
+	}
 
 	try
 	{
-		delete g_RouteManager;
-		g_RouteManager = nullptr;
+		shared::performance::CounterRegistry::Instance().snapshot(sink, context);
 	}
 	catch (...)
 	{
+		return false;
 	}
+
+	return true;
 }
 
 extern "C"
 WINNET_LINKAGE
 bool
 WINNET_API
-WinNet_AddDeviceIpAddresses(
-	const wchar_t *deviceAlias,
-	const WINNET_IP *addresses,
-	uint32_t numAddresses,
-	MullvadLogSink logSink,
-	void *logSinkContext
+WinNet_CollectNativeDiagnostics(
+	uint8_t *buffer,
+	uint32_t *size
 )
 {
-	try
+	if (nullptr == buffer || nullptr == size)
 	{
-		NET_LUID luid;
+		return false;
+	}
 
-		if (0 != ConvertInterfaceAliasToLuid(deviceAlias, &luid))
-		{
-			const auto msg = std::string("Unable to derive interface LUID from interface alias: ")
-				.append(common::string::ToAnsi(deviceAlias));
+	AutoLockType lock(g_RouteManagerLock);
 
-			THROW_ERROR(msg.c_str());
-		}
+	try
+	{
+		shared::diagnostics::BlobWriter writer(buffer, *size, MULLVAD_DIAGNOSTICS_MODULE_WINNET);
 
-		InterfaceUtils::AddDeviceIpAddresses(luid, ConvertAddresses(addresses, numAddresses));
+		NativeDiagnostics::Collect(writer, g_RouteManager);
+
+		*size = static_cast<uint32_t>(writer.finish());
 
 		return true;
 	}
 	catch (const std::exception &err)
 	{
-		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		if (nullptr != g_RouteManagerLogSink)
+		{
+			shared::logging::UnwindAndLog(*g_RouteManagerLogSink, err);
+		}
+
 		return false;
 	}
 	catch (...)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <libshared/logging/logsink.h>
+#include <libshared/performance/countersink.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -33,6 +34,32 @@ WinNet_EnsureTopMetric(
 	void *logSinkContext
 );
 
+//
+// Keep the interface at the top metric until deactivated.
+//
+// The metric is set immediately if needed, and is then restored whenever an interface
+// notification shows it has been changed. Corrections are rate limited, in case
+// something else keeps changing the metric.
+//
+// Deactivate using WinNet_DeactivateTopMetricMonitor().
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateTopMetricMonitor(
+	const wchar_t *deviceAlias,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_DeactivateTopMetricMonitor(
+);
+
 enum WINNET_GTII_STATUS
 {
 	WINNET_GTII_STATUS_ENABLED = 0,
@@ -59,6 +86,30 @@ WinNet_GetTapInterfaceAlias(
 	void *logSinkContext
 );
 
+enum WINNET_CTIA_STATUS
+{
+	WINNET_CTIA_STATUS_SUCCESS = 0,
+	WINNET_CTIA_STATUS_BUFFER_TOO_SMALL = 1,
+	WINNET_CTIA_STATUS_FAILURE = 2,
+};
+
+//
+// Copy the alias of the TAP adapter into a caller-provided buffer.
+//
+// `bufferSize` is specified in characters, including the terminating null.
+// It is updated with the required size, also when the buffer is too small.
+//
+extern "C"
+WINNET_LINKAGE
+WINNET_CTIA_STATUS
+WINNET_API
+WinNet_CopyTapInterfaceAlias(
+	wchar_t *buffer,
+	uint32_t *bufferSize,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
 //
 // This is a companion function to the above function.
 // Generically named in case we need other functions here that return strings.
@@ -73,6 +124,10 @@ WinNet_ReleaseString(
 
 typedef void (WINNET_API *WinNetConnectivityMonitorCallback)(bool connected, void *context);
 
+//
+// Loss of connectivity is reported once it has persisted for 'offlineConfirmationDelayMs'.
+// Pass 0 to report every change immediately.
+//
 extern "C"
 WINNET_LINKAGE
 bool
@@ -80,6 +135,43 @@ WINNET_API
 WinNet_ActivateConnectivityMonitor(
 	WinNetConnectivityMonitorCallback callback,
 	void *callbackContext,
+	uint32_t offlineConfirmationDelayMs,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
+enum WINNET_CONNECTIVITY
+{
+	// No adapter is connected.
+	WINNET_CONNECTIVITY_OFFLINE = 0,
+
+	// An adapter is connected, but the default gateway does not respond.
+	WINNET_CONNECTIVITY_DEGRADED = 1,
+
+	WINNET_CONNECTIVITY_ONLINE = 2,
+};
+
+typedef void (WINNET_API *WinNetConnectivityStateCallback)(WINNET_CONNECTIVITY connectivity, void *context);
+
+//
+// Same as WinNet_ActivateConnectivityMonitor(), but also sends an ICMP echo request to the
+// gateway of the best default route every 'probeIntervalMs' while an adapter is connected.
+//
+// Repeated probe failures are reported as degraded connectivity, so a dead uplink or a
+// gateway that drops traffic can be told apart from a working network. Pass 0 to disable
+// probing, in which case the callback only receives offline and online.
+//
+// Deactivate using WinNet_DeactivateConnectivityMonitor().
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateProbingConnectivityMonitor(
+	WinNetConnectivityStateCallback callback,
+	void *callbackContext,
+	uint32_t offlineConfirmationDelayMs,
+	uint32_t probeIntervalMs,
 	MullvadLogSink logSink,
 	void *logSinkContext
 );
@@ -91,6 +183,40 @@ WINNET_API
 WinNet_DeactivateConnectivityMonitor(
 );
 
+//
+// Current connectivity. If a connectivity monitor is active, this is answered from its
+// state, which is not subject to the offline confirmation delay. Otherwise, adapters
+// are enumerated once and classified the same way, which never yields degraded.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_QueryConnectivity(
+	WINNET_CONNECTIVITY *connectivity,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
+typedef bool (WINNET_API *WinNetOfflineAction)();
+
+//
+// Register a function that the connectivity monitor invokes on its own thread, once
+// the loss of connectivity is confirmed, before the callback is invoked. E.g. pass
+// WinFw_ApplyPolicyOffline() to block traffic without a round trip through the client.
+//
+// Applies to the active monitor, if any, and to monitors that are activated later.
+// Pass nullptr to unregister. Once this returns, the previous action is no longer
+// running, so the module that provides it can be unloaded.
+//
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_SetConnectivityOfflineAction(
+	WinNetOfflineAction action
+);
+
 enum WINNET_IP_TYPE
 {
 	WINNET_IP_TYPE_IPV4 = 0,
@@ -135,6 +261,24 @@ WinNet_ActivateRouteManager(
 	void *logSinkContext
 );
 
+//
+// Same as WinNet_ActivateRouteManager(), but records registered routes in a memory mapped
+// journal at 'journalPath'. The file is created if it doesn't exist.
+//
+// Routes in the journal that are still present in the routing table are adopted, and are
+// not recreated when added again. This avoids route churn when the service is restarted.
+// Other routes left behind by an earlier instance are deleted.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ActivateRouteManagerWithJournal(
+	MullvadLogSink logSink,
+	void *logSinkContext,
+	const wchar_t *journalPath
+);
+
 extern "C"
 WINNET_LINKAGE
 bool
@@ -152,6 +296,20 @@ WinNet_AddRoute(
 	const WINNET_ROUTE *route
 );
 
+//
+// Replace the complete set of routes owned by the route manager.
+// Routes that are already registered are left untouched.
+// Either all changes are applied or none of them are.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ApplyRouteSet(
+	const WINNET_ROUTE *routes,
+	uint32_t numRoutes
+);
+
 extern "C"
 WINNET_LINKAGE
 bool
@@ -169,6 +327,265 @@ WinNet_DeleteRoute(
 	const WINNET_ROUTE *route
 );
 
+//
+// Flat alternative to WINNET_ROUTE, for callers that already know the interface LUID.
+// Nothing is resolved from strings, and the array has no indirections.
+//
+// - 'interfaceLuid' non-zero: The route is registered on that interface, via 'gateway'
+//   if 'hasGateway' is set, or else on-link.
+// - 'interfaceLuid' zero and 'hasGateway' set: The interface that has 'gateway' is used.
+// - Neither: The route follows the best default route.
+//
+typedef struct tag_WINNET_LUID_ROUTE
+{
+	WINNET_IPNETWORK network;
+	uint64_t interfaceLuid;
+	WINNET_IP gateway;
+	uint8_t hasGateway;
+}
+WINNET_LUID_ROUTE;
+
+//
+// Counterparts of WinNet_AddRoutes(), WinNet_ApplyRouteSet() and WinNet_DeleteRoutes().
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_AddLuidRoutes(
+	const WINNET_LUID_ROUTE *routes,
+	uint32_t numRoutes
+);
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ApplyLuidRouteSet(
+	const WINNET_LUID_ROUTE *routes,
+	uint32_t numRoutes
+);
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_DeleteLuidRoutes(
+	const WINNET_LUID_ROUTE *routes,
+	uint32_t numRoutes
+);
+
+//
+// Route all traffic through the interface, except traffic to the excluded networks.
+//
+// The smallest set of routes that covers everything but the excluded networks is
+// registered as on-link routes on the interface, for IPv4 if 'ipv4' is set and for IPv6
+// if 'ipv6' is set. The default route itself is never replaced.
+//
+// Calling this again only adds and deletes the routes that differ from the previous call,
+// so changing exclusions at runtime is cheap. Either all changes are applied or none of them
+// are. These routes are separate from routes added through the other functions.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ApplyExclusionRoutes(
+	const WINNET_IPNETWORK *excluded,
+	uint32_t numExcluded,
+	uint64_t interfaceLuid,
+	bool ipv4,
+	bool ipv6
+);
+
+//
+// Delete all routes registered by WinNet_ApplyExclusionRoutes().
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_ClearExclusionRoutes(
+);
+
+//
+// Make 'relays' the complete set of relay endpoints. Each relay gets a host route over
+// the best default route, like a route without a node.
+//
+// When the best default route changes, relay routes are moved first, ahead of all other
+// routes and before default-route-changed callbacks are invoked.
+//
+// Pass no relays to delete the relay routes.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_SetRelayRoutes(
+	const WINNET_IP *relays,
+	uint32_t numRelays
+);
+
+//
+// WinNet_DumpRouteEvents:
+//
+// Invoke the sink once for each recent change that the route manager made to
+// the routing table, oldest first, with a line of text at info level.
+//
+// Meant for problem reports. Route changes are not logged individually.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_DumpRouteEvents(
+	MullvadLogSink sink,
+	void *context
+);
+
+typedef struct tag_WINNET_MANAGED_ROUTE
+{
+	WINNET_IPNETWORK network;
+	uint64_t interfaceLuid;
+
+	// All zeroes if the route is on-link.
+	WINNET_IP nextHop;
+}
+WINNET_MANAGED_ROUTE;
+
+enum WINNET_LMR_STATUS
+{
+	WINNET_LMR_STATUS_FOUND = 0,
+	WINNET_LMR_STATUS_NOT_FOUND = 1,
+	WINNET_LMR_STATUS_FAILURE = 2,
+};
+
+//
+// Find the route, among the routes added through the route manager, that traffic to
+// 'destination' is sent through, by longest prefix match. This is done in-process and
+// doesn't consult the routing table, so routes that weren't added by the route manager
+// are not considered.
+//
+// For aggregated routes, the route that was registered in their place is returned.
+//
+extern "C"
+WINNET_LINKAGE
+WINNET_LMR_STATUS
+WINNET_API
+WinNet_LookupManagedRoute(
+	const WINNET_IP *destination,
+	WINNET_MANAGED_ROUTE *route
+);
+
+enum WINNET_MTU_DISCOVERY_STATUS
+{
+	// The tunnel MTU has been set.
+	WINNET_MTU_DISCOVERY_STATUS_UPDATED = 0,
+
+	// The relay did not answer any probes. The tunnel MTU is left as is.
+	WINNET_MTU_DISCOVERY_STATUS_UNREACHABLE = 1,
+
+	WINNET_MTU_DISCOVERY_STATUS_FAILURE = 2,
+};
+
+//
+// 'pathMtu' and 'tunnelMtu' are zero unless the status is UPDATED.
+//
+typedef void (WINNET_API *WinNetMtuDiscoveryCallback)
+(
+	WINNET_MTU_DISCOVERY_STATUS status,
+	uint16_t pathMtu,
+	uint16_t tunnelMtu,
+	void *context
+);
+
+//
+// Discover the path MTU towards the relay, outside the tunnel, and set the MTU of the
+// tunnel interface to the path MTU less 'tunnelOverhead'.
+//
+// Discovery probes the relay with ICMP echo requests that must not be fragmented, in the
+// background, and the callback is invoked once with the outcome from a background thread.
+//
+// Any discovery already in progress is abandoned, without invoking its callback.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_StartTunnelMtuDiscovery(
+	const WINNET_IP *relay,
+	uint64_t tunnelInterfaceLuid,
+	uint16_t tunnelOverhead,
+	WinNetMtuDiscoveryCallback callback,
+	void *callbackContext,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
+//
+// Abandon discovery in progress, without invoking its callback.
+// Must not be called from within the callback.
+//
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_StopTunnelMtuDiscovery(
+);
+
+enum WINNET_TUNNEL_READINESS_STATUS
+{
+	// The tunnel interface is up, its addresses are preferred, and it has routes.
+	WINNET_TUNNEL_READINESS_STATUS_READY = 0,
+
+	WINNET_TUNNEL_READINESS_STATUS_TIMED_OUT = 1,
+
+	WINNET_TUNNEL_READINESS_STATUS_FAILURE = 2,
+};
+
+typedef void (WINNET_API *WinNetTunnelReadinessCallback)
+(
+	WINNET_TUNNEL_READINESS_STATUS status,
+	void *context
+);
+
+//
+// Wait for the tunnel interface to become ready, which is when, for each of the enabled
+// families, the interface is connected, all of its unicast addresses are in the preferred
+// state, and at least one unicast route goes through it.
+//
+// The state is evaluated again as interface, address and route notifications arrive,
+// rather than by polling. The callback is invoked once with the outcome from a
+// background thread. If the tunnel is already ready, that happens right away.
+//
+// Any wait already in progress is abandoned, without invoking its callback.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_StartTunnelReadinessMonitor(
+	uint64_t tunnelInterfaceLuid,
+	bool ipv4,
+	bool ipv6,
+	uint32_t timeoutMs,
+	WinNetTunnelReadinessCallback callback,
+	void *callbackContext,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
+//
+// Abandon waiting, without invoking the callback.
+// Must not be called from within the callback.
+//
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_StopTunnelReadinessMonitor(
+);
+
 enum WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE
 {
 	// Best default route changed.
@@ -207,6 +624,41 @@ WinNet_RegisterDefaultRouteChangedCallback(
 	void **registrationHandle
 );
 
+typedef struct tag_WINNET_DEFAULT_ROUTE_CHANGE
+{
+	WINNET_DEFAULT_ROUTE_CHANGED_EVENT_TYPE eventType;
+	WINNET_IP_FAMILY family;
+
+	// For update events, the interface associated with the new best default route.
+	uint64_t interfaceLuid;
+}
+WINNET_DEFAULT_ROUTE_CHANGE;
+
+//
+// Receives both families in a single call, if they changed together.
+// The array is only valid for the duration of the call.
+//
+typedef void (WINNET_API *WinNetDefaultRoutesChangedCallback)
+(
+	const WINNET_DEFAULT_ROUTE_CHANGE *changes,
+	uint32_t numChanges,
+	void *context
+);
+
+//
+// Alternative to WinNet_RegisterDefaultRouteChangedCallback(), which invokes the callback
+// once per family. Unregister using WinNet_UnregisterDefaultRouteChangedCallback().
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_RegisterDefaultRoutesChangedCallback(
+	WinNetDefaultRoutesChangedCallback callback,
+	void *context,
+	void **registrationHandle
+);
+
 extern "C"
 WINNET_LINKAGE
 void
@@ -215,6 +667,48 @@ WinNet_UnregisterDefaultRouteChangedCallback(
 	void *registrationHandle
 );
 
+//
+// Tune how default route notifications are coalesced.
+// Evaluation runs after `windowMs` without further notifications,
+// but no later than `maxLatencyMs` after the first notification.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_SetDefaultRouteCoalescing(
+	uint32_t windowMs,
+	uint32_t maxLatencyMs
+);
+
+//
+// Register routes that are added in the same call as fewer routes for enclosing
+// networks, when the routes use the same node. Routes are still deleted individually.
+//
+// Routes for networks between an enclosing network and the routes it replaces, that
+// were not added by the route manager, take precedence over the enclosing network.
+// Disabled by default.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_SetRouteAggregation(
+	bool enabled
+);
+
+//
+// Log a single detailed warning whenever restoring routes after a default route
+// change takes longer than `routeRestoreMs`. Zero disables the check, which is the default.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_SetLatencyBudget(
+	uint32_t routeRestoreMs
+);
+
 extern "C"
 WINNET_LINKAGE
 void
@@ -222,6 +716,47 @@ WINNET_API
 WinNet_DeactivateRouteManager(
 );
 
+//
+// Deactivate the route manager, but leave its routes in the routing table and in the
+// journal, for the next activation to adopt. Only available with a journal.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_DetachRouteManager(
+);
+
+//
+// Delete routes left behind by a route manager that was not deactivated, e.g. because
+// the process crashed. The routes are identified by the journal that the route manager
+// was activated with. Only routes that match a journaled route exactly are deleted.
+// This completes in one pass over the routing table regardless of how many routes there are.
+//
+// Fails if the route manager is currently active.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_PurgeOwnedRoutes(
+	MullvadLogSink logSink,
+	void *logSinkContext,
+	const wchar_t *journalPath
+);
+
+//
+// Discard log messages that are more verbose than `level`.
+// Applies to the connectivity monitor and route manager, including future activations.
+//
+extern "C"
+WINNET_LINKAGE
+void
+WINNET_API
+WinNet_SetLogLevel(
+	MULLVAD_LOG_LEVEL level
+);
+
 extern "C"
 WINNET_LINKAGE
 bool
@@ -234,3 +769,78 @@ WinNet_AddDeviceIpAddresses(
 	void *logSinkContext
 );
 
+//
+// WinNet_SampleInterfaceStats:
+//
+// Read the traffic counters of a set of interfaces. Set 'interfaceLuid' in each
+// entry before calling. The remaining fields are set by this function.
+//
+// Rates are computed from the previous call that sampled the same interface,
+// and are zero on the first sample. An interface that doesn't exist is reported
+// with 'present' set to false.
+//
+typedef struct tag_WINNET_INTERFACE_STATS
+{
+	uint64_t interfaceLuid;
+
+	bool present;
+
+	uint64_t inOctets;
+	uint64_t outOctets;
+	uint64_t inErrors;
+	uint64_t outErrors;
+	uint64_t inDiscards;
+	uint64_t outDiscards;
+
+	uint64_t inOctetsPerSecond;
+	uint64_t outOctetsPerSecond;
+}
+WINNET_INTERFACE_STATS;
+
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_SampleInterfaceStats(
+	WINNET_INTERFACE_STATS *stats,
+	uint32_t numStats,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
+//
+// WinNet_GetPerformanceCounters:
+//
+// Invoke the sink once with a snapshot of all performance counters
+// registered by winnet.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_GetPerformanceCounters(
+	MullvadCounterSink sink,
+	void *context
+);
+
+//
+// WinNet_CollectNativeDiagnostics:
+//
+// Write the routing and adapter state into 'buffer', as a compact binary blob
+// for problem reports. See libshared/diagnostics/diagnosticsblob.h for the format.
+//
+// The blob includes the routes registered by the route manager, all adapters,
+// all performance counters and the recent route events. Specify the size of 'buffer'
+// in 'size'. The size is a hard cap: records that don't fit are left out, and the
+// blob is marked as truncated. On return, 'size' holds the size of the blob.
+//
+// Routes and route events are only included when the route manager is active.
+//
+extern "C"
+WINNET_LINKAGE
+bool
+WINNET_API
+WinNet_CollectNativeDiagnostics(
+	uint8_t *buffer,
+	uint32_t *size
+);
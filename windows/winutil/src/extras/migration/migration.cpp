@@ -3,9 +3,48 @@
 #include <libshared/logging/stdoutlogger.h>
 #include <winutil/winutil.h>
 
-int main()
+namespace
 {
-	const auto status = WinUtil_MigrateAfterWindowsUpdate(shared::logging::StdoutLogger, nullptr);
+
+void WINUTIL_API ProgressSink(const wchar_t *filename, bool migrated, uint32_t numHandled, uint32_t numFiles, void *)
+{
+	std::wcout << L"[" << numHandled << L"/" << numFiles << L"] " << filename
+		<< (migrated ? L": migrated" : L": not migrated") << std::endl;
+}
+
+} // anonymous namespace
+
+int wmain(int argc, const wchar_t *argv[])
+{
+	if (argc > 1 && 0 == _wcsicmp(argv[1], L"--estimate"))
+	{
+		WinUtilMigrationEstimate estimate = { 0 };
+
+		const auto status = WinUtil_EstimateMigrationAfterWindowsUpdate(&estimate, shared::logging::StdoutLogger, nullptr);
+
+		if (WINUTIL_MIGRATION_STATUS_SUCCESS == status)
+		{
+			std::wcout << L"Would migrate " << estimate.numFiles << L" file(s), " << estimate.numBytes
+				<< L" bytes, in about " << estimate.estimatedDurationMs << L" ms" << std::endl;
+
+			return 0;
+		}
+
+		std::wcout << L"Nothing would be migrated (status " << status << L")" << std::endl;
+
+		return 0;
+	}
+
+	const bool background = (argc > 1 && 0 == _wcsicmp(argv[1], L"--background"));
+
+	const auto status = (background
+		? WinUtil_BeginMigrateAfterWindowsUpdate(ProgressSink, nullptr, shared::logging::StdoutLogger, nullptr)
+		: WinUtil_MigrateAfterWindowsUpdate(shared::logging::StdoutLogger, nullptr));
+
+	if (background)
+	{
+		WinUtil_WaitForMigration(INFINITE);
+	}
 
 	switch (status)
 	{
@@ -1,127 +1,351 @@
 #include "stdafx.h"
 #include "migration.h"
+#include "ownershipvalidator.h"
 #include <libcommon/filesystem.h>
 #include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <bcrypt.h>
+#include <algorithm>
+#include <array>
 #include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
 
 namespace migration {
 
+namespace
+{
+
+struct FileMigration
+{
+	std::wstring filename;
+	bool required;
+};
+
 //
-// This is being called in a x64 SYSTEM user context
+// Files in the daemon's local app data directory that are carried over.
+// Settings and cache share this directory. Logs are stored under
+// %ALLUSERSPROFILE%, which is not affected by feature updates.
 //
-MigrationStatus MigrateAfterWindowsUpdate()
+const FileMigration MIGRATION_MANIFEST[] = {
+	{ L"settings.json", true },
+	{ L"account-history.json", false },
+	{ L"relays.json", false },
+	{ L"version-info.json", false },
+};
+
+//
+// Files at least this large are copied without going through the system cache.
+//
+const ULONGLONG UNBUFFERED_COPY_THRESHOLD = 4 * 1024 * 1024;
+
+const size_t CHECKSUM_BLOCK_SIZE = 64 * 1024;
+
+//
+// Migration of optional files that continues after BeginMigrationAfterWindowsUpdate() returns.
+//
+std::mutex g_backgroundMutex;
+std::shared_future<void> g_background;
+
+//
+// Conservative figures for estimating the duration of a migration.
+// Each file is read twice for checksums and written once, and files are copied concurrently.
+//
+const uint64_t ESTIMATED_BYTES_PER_MS = 20 * 1024;
+const uint32_t ESTIMATED_DATA_PASSES = 3;
+const uint32_t ESTIMATED_FILE_OVERHEAD_MS = 10;
+
+struct MigrationPaths
+{
+	std::filesystem::path destination;
+	std::filesystem::path backupRoot;
+	std::filesystem::path backup;
+};
+
+//
+// Returns nothing if the migration can proceed.
+//
+std::optional<MigrationStatus> CheckPreconditions(MigrationPaths &paths)
 {
 	const auto localAppData = common::fs::GetKnownFolderPath(FOLDERID_LocalAppData, KF_FLAG_DEFAULT, nullptr);
-	const auto mullvadAppData = std::filesystem::path(localAppData).append(L"Mullvad VPN");
+
+	paths.destination = std::filesystem::path(localAppData).append(L"Mullvad VPN");
 
 	//
 	// The main settings file is 'settings.json'
-	// If this file is present inside 'mullvadAppData' we should abort the migration
+	// If this file is present inside the destination we should abort the migration
 	//
 
-	const auto settingsFile = std::filesystem::path(mullvadAppData).append(L"settings.json");
+	const auto settingsFile = std::filesystem::path(paths.destination).append(L"settings.json");
 
 	if (std::filesystem::exists(settingsFile))
 	{
 		return MigrationStatus::Aborted;
 	}
 
-	//
-	// Validate backup location path and ownership
-	//
+	paths.backupRoot = paths.destination.root_path().append(L"windows.old");
+	paths.backup = paths.backupRoot / paths.destination.relative_path();
 
-	const auto backupRoot = mullvadAppData.root_path().append(L"windows.old");
-	const auto backupMullvadAppData = backupRoot / mullvadAppData.relative_path();
-
-	if (false == std::filesystem::exists(backupMullvadAppData))
+	if (false == std::filesystem::exists(paths.backup))
 	{
 		return MigrationStatus::NothingToMigrate;
 	}
 
-	DWORD bufferSize = 128;
-	std::vector<uint8_t> buffer(bufferSize);
+	return std::nullopt;
+}
+
+//
+// Files that don't exist or have an untrusted owner are not migrated.
+// The backup directory must have been validated.
+//
+bool ShouldMigrate(OwnershipValidator &validator, const MigrationPaths &paths, const std::filesystem::path &from)
+{
+	std::error_code error;
+
+	return std::filesystem::is_regular_file(from, error)
+		&& validator.isTrusted(paths.backup, from);
+}
+
+using Checksum = std::array<uint8_t, 32>;
+
+Checksum ComputeChecksum(const std::filesystem::path &file)
+{
+	BCRYPT_ALG_HANDLE algorithm = nullptr;
+
+	auto status = BCryptOpenAlgorithmProvider(&algorithm, BCRYPT_SHA256_ALGORITHM, nullptr, 0);
+
+	if (0 > status)
+	{
+		THROW_ERROR("Could not open SHA-256 algorithm provider");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [algorithm]
+	{
+		BCryptCloseAlgorithmProvider(algorithm, 0);
+	};
+
+	BCRYPT_HASH_HANDLE hash = nullptr;
+
+	status = BCryptCreateHash(algorithm, &hash, nullptr, 0, nullptr, 0, 0);
+
+	if (0 > status)
+	{
+		THROW_ERROR("Could not create hash object");
+	}
+
+	sd += [hash]
+	{
+		BCryptDestroyHash(hash);
+	};
+
+	auto handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (INVALID_HANDLE_VALUE == handle)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Open file for checksum");
+	}
+
+	sd += [handle]
+	{
+		CloseHandle(handle);
+	};
+
+	std::vector<uint8_t> block(CHECKSUM_BLOCK_SIZE);
 
 	for (;;)
 	{
-		if (FALSE == GetFileSecurityW(backupRoot.c_str(), OWNER_SECURITY_INFORMATION,
-			&buffer[0], static_cast<DWORD>(buffer.size()), &bufferSize))
+		DWORD bytesRead = 0;
+
+		if (FALSE == ReadFile(handle, &block[0], static_cast<DWORD>(block.size()), &bytesRead, nullptr))
 		{
-			if (ERROR_INSUFFICIENT_BUFFER == GetLastError())
-			{
-				buffer.resize(bufferSize);
-				continue;
-			}
+			THROW_WINDOWS_ERROR(GetLastError(), "Read file for checksum");
+		}
+
+		if (0 == bytesRead)
+		{
+			break;
+		}
 
-			THROW_ERROR("Could not acquire security descriptor of backup directory");
+		if (0 > BCryptHashData(hash, &block[0], bytesRead, 0))
+		{
+			THROW_ERROR("Could not update checksum");
 		}
+	}
+
+	Checksum checksum;
+
+	if (0 > BCryptFinishHash(hash, &checksum[0], static_cast<ULONG>(checksum.size()), 0))
+	{
+		THROW_ERROR("Could not finalize checksum");
+	}
+
+	return checksum;
+}
+
+//
+// Copy a file via a temporary file, which is moved into place once its
+// contents have been verified against the source.
+//
+// Unless 'replaceExisting' is set, the file is not migrated if the destination exists.
+//
+bool MigrateFile(const std::filesystem::path &from, const std::filesystem::path &to, bool replaceExisting)
+{
+	std::error_code error;
 
-		break;
+	if (false == replaceExisting && std::filesystem::exists(to, error))
+	{
+		return false;
 	}
 
-	SID *sid = nullptr;
-	BOOL ownerDefaulted = FALSE;
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
 
-	if (FALSE == GetSecurityDescriptorOwner(reinterpret_cast<SECURITY_DESCRIPTOR *>(&buffer[0]),
-		reinterpret_cast<PSID *>(&sid), &ownerDefaulted))
+	if (FALSE == GetFileAttributesExW(from.c_str(), GetFileExInfoStandard, &attributes)
+		|| 0 != (attributes.dwFileAttributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_REPARSE_POINT)))
 	{
-		THROW_ERROR("Could not determine owner of backup directory");
+		return false;
 	}
 
-	if (FALSE == IsWellKnownSid(sid, WinLocalSystemSid)
-		&& FALSE == IsWellKnownSid(sid, WinBuiltinAdministratorsSid))
+	const auto size = (static_cast<ULONGLONG>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+
+	const DWORD flags = (size >= UNBUFFERED_COPY_THRESHOLD ? COPY_FILE_NO_BUFFERING : 0);
+
+	const auto temporary = std::filesystem::path(to).concat(L".migrating");
+
+	if (FALSE == CopyFileExW(from.c_str(), temporary.c_str(), nullptr, nullptr, nullptr, flags))
 	{
-		THROW_ERROR("Backup directory is not owned by SYSTEM or Built-in Administrators");
+		return false;
 	}
 
-	//
-	// Ensure destination directory exists
-	//
+	try
+	{
+		if (ComputeChecksum(from) == ComputeChecksum(temporary)
+			&& FALSE != MoveFileExW(temporary.c_str(), to.c_str(), (replaceExisting ? MOVEFILE_REPLACE_EXISTING : 0)))
+		{
+			return true;
+		}
+	}
+	catch (...)
+	{
+	}
+
+	DeleteFileW(temporary.c_str());
 
-	if (false == std::filesystem::exists(mullvadAppData)
-		&& false == std::filesystem::create_directory(mullvadAppData))
+	return false;
+}
+
+//
+// Validate the backup location and ensure that the destination directory exists.
+//
+void PrepareDestination(OwnershipValidator &validator, const MigrationPaths &paths)
+{
+	validator.validate(paths.backupRoot, paths.backup);
+
+	if (false == std::filesystem::exists(paths.destination)
+		&& false == std::filesystem::create_directory(paths.destination))
 	{
 		THROW_ERROR("Could not create destination directory during migration");
 	}
+}
 
-	//
-	// Specify files that need to be copied over
-	//
+using FileHandledSink = std::function<void(const FileMigration &file, bool migrated)>;
+
+//
+// Copy and verify files concurrently. Files that are migrated are removed from the backup.
+// 'handledSink', if set, is invoked for each file in order, once it has been handled.
+// 'replaceExisting' is forwarded to MigrateFile().
+//
+// Returns false if a required file could not be migrated.
+//
+bool MigrateFiles
+(
+	OwnershipValidator &validator,
+	const MigrationPaths &paths,
+	const std::vector<const FileMigration *> &files,
+	const FileHandledSink &handledSink,
+	bool replaceExisting
+)
+{
+	std::vector<std::future<bool>> copies;
 
-	struct FileMigration
+	for (const auto file : files)
 	{
-		std::wstring filename;
-		bool required;
-	};
+		const auto from = std::filesystem::path(paths.backup).append(file->filename);
+		const auto to = std::filesystem::path(paths.destination).append(file->filename);
 
-	const FileMigration filesToMigrate[] = {
-		{ L"settings.json", true },
-		{ L"account-history.json", false },
-	};
+		if (false == ShouldMigrate(validator, paths, from))
+		{
+			std::promise<bool> skipped;
+			skipped.set_value(false);
 
-	//
-	// Copy and delete files
-	//
+			copies.emplace_back(skipped.get_future());
+
+			continue;
+		}
+
+		copies.emplace_back(std::async(std::launch::async, MigrateFile, from, to, replaceExisting));
+	}
 
 	bool copyStatus = true;
 
-	for (const auto file : filesToMigrate)
+	for (size_t i = 0; i < copies.size(); ++i)
 	{
-		const auto from = std::filesystem::path(backupMullvadAppData).append(file.filename);
-		const auto to = std::filesystem::path(mullvadAppData).append(file.filename);
-
-		std::error_code error;
+		const auto migrated = copies[i].get();
 
-		if (std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing | std::filesystem::copy_options::skip_symlinks, error))
+		if (migrated)
 		{
+			const auto from = std::filesystem::path(paths.backup).append(files[i]->filename);
+
+			std::error_code error;
 			std::filesystem::remove(from, error);
 		}
-		else if (file.required)
+		else if (files[i]->required)
 		{
 			copyStatus = false;
 		}
+
+		if (handledSink)
+		{
+			handledSink(*files[i], migrated);
+		}
 	}
 
-	if (false == copyStatus)
+	return copyStatus;
+}
+
+} // anonymous namespace
+
+//
+// This is being called in a x64 SYSTEM user context
+//
+MigrationStatus MigrateAfterWindowsUpdate()
+{
+	MigrationPaths paths;
+
+	if (const auto status = CheckPreconditions(paths))
+	{
+		return status.value();
+	}
+
+	OwnershipValidator validator;
+
+	PrepareDestination(validator, paths);
+
+	std::vector<const FileMigration *> files;
+
+	for (const auto &file : MIGRATION_MANIFEST)
+	{
+		files.push_back(&file);
+	}
+
+	if (false == MigrateFiles(validator, paths, files, nullptr, true))
 	{
 		THROW_ERROR("Failed to copy files during migration");
 	}
@@ -129,4 +353,162 @@ MigrationStatus MigrateAfterWindowsUpdate()
 	return MigrationStatus::Success;
 }
 
+MigrationStatus BeginMigrationAfterWindowsUpdate(ProgressSink progressSink, ErrorSink errorSink)
+{
+	std::scoped_lock<std::mutex> lock(g_backgroundMutex);
+
+	if (g_background.valid()
+		&& std::future_status::ready != g_background.wait_for(std::chrono::milliseconds(0)))
+	{
+		THROW_ERROR("A background migration is already in progress");
+	}
+
+	MigrationPaths paths;
+
+	if (const auto status = CheckPreconditions(paths))
+	{
+		return status.value();
+	}
+
+	auto validator = std::make_shared<OwnershipValidator>();
+
+	PrepareDestination(*validator, paths);
+
+	std::vector<const FileMigration *> required;
+	std::vector<const FileMigration *> optional;
+
+	for (const auto &file : MIGRATION_MANIFEST)
+	{
+		(file.required ? required : optional).push_back(&file);
+	}
+
+	const auto numFiles = static_cast<uint32_t>(std::size(MIGRATION_MANIFEST));
+	auto numHandled = std::make_shared<uint32_t>(0);
+
+	auto reportProgress = [progressSink, numFiles, numHandled](const FileMigration &file, bool migrated)
+	{
+		++*numHandled;
+
+		if (progressSink)
+		{
+			progressSink(MigrationProgress{ file.filename.c_str(), migrated, *numHandled, numFiles });
+		}
+	};
+
+	if (false == MigrateFiles(*validator, paths, required, reportProgress, true))
+	{
+		THROW_ERROR("Failed to copy files during migration");
+	}
+
+	//
+	// Required files are in place. The rest are not needed to start, so they're
+	// migrated on a detached thread that callers can wait for.
+	//
+	// The daemon may be running by then, and may already have written newer
+	// versions of these files. Those are not replaced.
+	//
+
+	std::promise<void> completion;
+	g_background = completion.get_future().share();
+
+	std::thread([validator, paths, optional, reportProgress, errorSink, completion = std::move(completion)]() mutable
+	{
+		try
+		{
+			MigrateFiles(*validator, paths, optional, reportProgress, false);
+		}
+		catch (const std::exception &err)
+		{
+			if (errorSink)
+			{
+				errorSink(err);
+			}
+		}
+		catch (...)
+		{
+			if (errorSink)
+			{
+				errorSink(std::runtime_error("Unspecified error during background migration"));
+			}
+		}
+
+		completion.set_value();
+	}).detach();
+
+	return MigrationStatus::Success;
+}
+
+bool WaitForBackgroundMigration(std::chrono::milliseconds timeout)
+{
+	std::shared_future<void> background;
+
+	{
+		std::scoped_lock<std::mutex> lock(g_backgroundMutex);
+		background = g_background;
+	}
+
+	return false == background.valid()
+		|| std::future_status::ready == background.wait_for(timeout);
+}
+
+MigrationEstimate EstimateMigrationAfterWindowsUpdate()
+{
+	MigrationEstimate estimate = { MigrationStatus::NothingToMigrate, 0, 0, 0 };
+
+	MigrationPaths paths;
+
+	if (const auto status = CheckPreconditions(paths))
+	{
+		estimate.status = status.value();
+		return estimate;
+	}
+
+	OwnershipValidator validator;
+
+	validator.validate(paths.backupRoot, paths.backup);
+
+	uint64_t largestFile = 0;
+
+	for (const auto &file : MIGRATION_MANIFEST)
+	{
+		const auto from = std::filesystem::path(paths.backup).append(file.filename);
+
+		if (false == ShouldMigrate(validator, paths, from))
+		{
+			continue;
+		}
+
+		std::error_code error;
+
+		const auto size = std::filesystem::file_size(from, error);
+
+		if (error)
+		{
+			continue;
+		}
+
+		++estimate.numFiles;
+		estimate.numBytes += size;
+
+		largestFile = (std::max)(largestFile, static_cast<uint64_t>(size));
+	}
+
+	if (0 == estimate.numFiles)
+	{
+		return estimate;
+	}
+
+	estimate.status = MigrationStatus::Success;
+
+	//
+	// Since files are copied concurrently, the largest file determines the duration.
+	//
+	const auto durationMs = ESTIMATED_FILE_OVERHEAD_MS
+		+ (largestFile * ESTIMATED_DATA_PASSES) / ESTIMATED_BYTES_PER_MS;
+
+	estimate.estimatedDurationMs = static_cast<uint32_t>((std::min)(durationMs, static_cast<uint64_t>(UINT32_MAX)));
+
+	return estimate;
+}
+
 }
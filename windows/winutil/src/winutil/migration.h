@@ -1,5 +1,10 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
 namespace migration {
 
 enum class MigrationStatus
@@ -15,4 +20,60 @@ enum class MigrationStatus
 
 MigrationStatus MigrateAfterWindowsUpdate();
 
+struct MigrationProgress
+{
+	// File that was handled, and whether it was migrated.
+	const wchar_t *filename;
+	bool migrated;
+
+	// Files handled so far, out of all files that are considered for migration.
+	uint32_t numHandled;
+	uint32_t numFiles;
+};
+
+using ProgressSink = std::function<void(const MigrationProgress &progress)>;
+
+//
+// Receives errors that occur on the background thread, which cannot be thrown to the caller.
+//
+using ErrorSink = std::function<void(const std::exception &err)>;
+
+//
+// Same as MigrateAfterWindowsUpdate(), but only required files are migrated before returning.
+// Success means that settings are in place and can be loaded.
+//
+// Remaining files are migrated on a background thread. Progress is reported once per file,
+// for required files on the calling thread and for the rest on the background thread.
+// The migration is complete when 'numHandled' reaches 'numFiles'.
+//
+// The daemon may already be running when the remaining files are migrated, so files that
+// exist at the destination by then are left as they are.
+//
+// Only one migration can be in progress at a time.
+//
+MigrationStatus BeginMigrationAfterWindowsUpdate(ProgressSink progressSink, ErrorSink errorSink);
+
+//
+// Returns false if a background migration is still in progress when the timeout elapses.
+// Must be called before the module is unloaded, if a migration was started.
+//
+bool WaitForBackgroundMigration(std::chrono::milliseconds timeout);
+
+struct MigrationEstimate
+{
+	MigrationStatus status;
+
+	// Files that would be copied, and their total size.
+	uint32_t numFiles;
+	uint64_t numBytes;
+
+	uint32_t estimatedDurationMs;
+};
+
+//
+// Determine what MigrateAfterWindowsUpdate() would do, without changing anything.
+// 'status' is Success if there are files to migrate.
+//
+MigrationEstimate EstimateMigrationAfterWindowsUpdate();
+
 }
@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include "ownershipvalidator.h"
+#include <libcommon/error.h>
+#include <libcommon/memory.h>
+#include <libcommon/string.h>
+#include <aclapi.h>
+#include <sddl.h>
+
+namespace
+{
+
+const wchar_t TRUSTED_INSTALLER_SID[] = L"S-1-5-80-956008885-3418522649-1831038044-1853292631-2271478464";
+
+bool IsTrustedInstaller(PSID sid)
+{
+	PSID trustedInstaller = nullptr;
+
+	if (FALSE == ConvertStringSidToSidW(TRUSTED_INSTALLER_SID, &trustedInstaller))
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "ConvertStringSidToSidW");
+	}
+
+	const auto equal = (FALSE != EqualSid(sid, trustedInstaller));
+
+	LocalFree(trustedInstaller);
+
+	return equal;
+}
+
+} // anonymous namespace
+
+bool OwnershipValidator::isTrusted(const std::filesystem::path &base, const std::filesystem::path &target)
+{
+	const auto relative = target.lexically_normal().lexically_relative(base.lexically_normal());
+
+	if (relative.empty() || *relative.begin() == L"..")
+	{
+		THROW_ERROR("Target path is not located inside base path");
+	}
+
+	auto current = base.lexically_normal();
+
+	if (false == hasTrustedOwner(current))
+	{
+		return false;
+	}
+
+	for (const auto &component : relative)
+	{
+		if (component == L".")
+		{
+			continue;
+		}
+
+		current /= component;
+
+		if (false == hasTrustedOwner(current))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void OwnershipValidator::validate(const std::filesystem::path &base, const std::filesystem::path &target)
+{
+	if (false == isTrusted(base, target))
+	{
+		THROW_ERROR("Path is not owned by SYSTEM, Built-in Administrators or TrustedInstaller");
+	}
+}
+
+bool OwnershipValidator::hasTrustedOwner(const std::filesystem::path &path)
+{
+	const auto key = common::string::Lower(path.wstring());
+
+	const auto cached = m_cache.find(key);
+
+	if (m_cache.end() != cached)
+	{
+		return cached->second;
+	}
+
+	const auto trusted = ReadTrustedOwner(path);
+
+	m_cache.emplace(key, trusted);
+
+	return trusted;
+}
+
+//static
+bool OwnershipValidator::ReadTrustedOwner(const std::filesystem::path &path)
+{
+	//
+	// Open the object itself rather than what it may be pointing to.
+	//
+	auto handle = CreateFileW(path.c_str(), READ_CONTROL, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+
+	if (INVALID_HANDLE_VALUE == handle)
+	{
+		THROW_WINDOWS_ERROR(GetLastError(), "Open path to validate ownership");
+	}
+
+	common::memory::ScopeDestructor sd;
+
+	sd += [handle]
+	{
+		CloseHandle(handle);
+	};
+
+	PSID owner = nullptr;
+	PSECURITY_DESCRIPTOR descriptor = nullptr;
+
+	const auto status = GetSecurityInfo(handle, SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION,
+		&owner, nullptr, nullptr, nullptr, &descriptor);
+
+	if (ERROR_SUCCESS != status)
+	{
+		THROW_WINDOWS_ERROR(status, "Acquire owner of path");
+	}
+
+	sd += [descriptor]
+	{
+		LocalFree(descriptor);
+	};
+
+	return FALSE != IsWellKnownSid(owner, WinLocalSystemSid)
+		|| FALSE != IsWellKnownSid(owner, WinBuiltinAdministratorsSid)
+		|| IsTrustedInstaller(owner);
+}
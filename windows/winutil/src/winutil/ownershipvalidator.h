@@ -0,0 +1,42 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+//
+// Validates that paths are owned by a trusted principal.
+//
+// Trusted owners are SYSTEM, Built-in Administrators and TrustedInstaller.
+// Results are cached per path, so validating several paths below a common
+// directory reads each security descriptor once.
+//
+class OwnershipValidator
+{
+public:
+
+	OwnershipValidator() = default;
+
+	//
+	// Validate 'base' and every path component below it, up to and including 'target'.
+	// 'target' must be located inside 'base'.
+	//
+	bool isTrusted(const std::filesystem::path &base, const std::filesystem::path &target);
+
+	//
+	// Same as isTrusted() but throws if validation fails.
+	//
+	void validate(const std::filesystem::path &base, const std::filesystem::path &target);
+
+private:
+
+	OwnershipValidator(const OwnershipValidator &) = delete;
+	OwnershipValidator &operator=(const OwnershipValidator &) = delete;
+
+	bool hasTrustedOwner(const std::filesystem::path &path);
+
+	static bool ReadTrustedOwner(const std::filesystem::path &path);
+
+	// Indexed by lower case path.
+	std::unordered_map<std::wstring, bool> m_cache;
+};
@@ -32,3 +32,97 @@ WinUtil_MigrateAfterWindowsUpdate(
 		return WINUTIL_MIGRATION_STATUS_FAILED;
 	}
 }
+
+extern "C"
+WINUTIL_LINKAGE
+WINUTIL_MIGRATION_STATUS
+WINUTIL_API
+WinUtil_BeginMigrateAfterWindowsUpdate(
+	WinUtilMigrationProgressSink progressSink,
+	void *progressSinkContext,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	migration::ProgressSink forwarder;
+
+	if (nullptr != progressSink)
+	{
+		forwarder = [progressSink, progressSinkContext](const migration::MigrationProgress &progress)
+		{
+			progressSink(progress.filename, progress.migrated, progress.numHandled, progress.numFiles, progressSinkContext);
+		};
+	}
+
+	auto errorSink = [logSink, logSinkContext](const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+	};
+
+	try
+	{
+		return common::ValueMapper::Map(migration::BeginMigrationAfterWindowsUpdate(forwarder, errorSink), {
+			std::make_pair(migration::MigrationStatus::Success, WINUTIL_MIGRATION_STATUS_SUCCESS),
+			std::make_pair(migration::MigrationStatus::Aborted, WINUTIL_MIGRATION_STATUS_ABORTED),
+			std::make_pair(migration::MigrationStatus::NothingToMigrate, WINUTIL_MIGRATION_STATUS_NOTHING_TO_MIGRATE),
+		});
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return WINUTIL_MIGRATION_STATUS_FAILED;
+	}
+	catch (...)
+	{
+		return WINUTIL_MIGRATION_STATUS_FAILED;
+	}
+}
+
+extern "C"
+WINUTIL_LINKAGE
+bool
+WINUTIL_API
+WinUtil_WaitForMigration(
+	uint32_t timeoutMs
+)
+{
+	return migration::WaitForBackgroundMigration(std::chrono::milliseconds(timeoutMs));
+}
+
+extern "C"
+WINUTIL_LINKAGE
+WINUTIL_MIGRATION_STATUS
+WINUTIL_API
+WinUtil_EstimateMigrationAfterWindowsUpdate(
+	WinUtilMigrationEstimate *estimate,
+	MullvadLogSink logSink,
+	void *logSinkContext
+)
+{
+	if (nullptr == estimate)
+	{
+		return WINUTIL_MIGRATION_STATUS_FAILED;
+	}
+
+	try
+	{
+		const auto result = migration::EstimateMigrationAfterWindowsUpdate();
+
+		*estimate = WinUtilMigrationEstimate{ result.numFiles, result.numBytes, result.estimatedDurationMs };
+
+		return common::ValueMapper::Map(result.status, {
+			std::make_pair(migration::MigrationStatus::Success, WINUTIL_MIGRATION_STATUS_SUCCESS),
+			std::make_pair(migration::MigrationStatus::Aborted, WINUTIL_MIGRATION_STATUS_ABORTED),
+			std::make_pair(migration::MigrationStatus::NothingToMigrate, WINUTIL_MIGRATION_STATUS_NOTHING_TO_MIGRATE),
+		});
+	}
+	catch (const std::exception &err)
+	{
+		shared::logging::UnwindAndLog(logSink, logSinkContext, err);
+		return WINUTIL_MIGRATION_STATUS_FAILED;
+	}
+	catch (...)
+	{
+		return WINUTIL_MIGRATION_STATUS_FAILED;
+	}
+}
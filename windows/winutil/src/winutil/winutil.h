@@ -32,3 +32,73 @@ WinUtil_MigrateAfterWindowsUpdate(
 	MullvadLogSink logSink,
 	void *logSinkContext
 );
+
+typedef void (WINUTIL_API *WinUtilMigrationProgressSink)
+(
+	const wchar_t *filename,
+	bool migrated,
+	uint32_t numHandled,
+	uint32_t numFiles,
+	void *context
+);
+
+//
+// Same as WinUtil_MigrateAfterWindowsUpdate(), except that only required files, i.e. settings,
+// are migrated before returning. Other files are migrated on a background thread.
+//
+// 'progressSink' is optional. It's invoked once per file, and from the background thread
+// for files that are not required. The migration is complete when 'numHandled' reaches 'numFiles'.
+//
+// Files that the daemon has written by the time the background thread reaches them are not
+// replaced. Errors on the background thread are also sent to 'logSink', so both sinks must
+// remain valid until the migration is complete.
+//
+extern "C"
+WINUTIL_LINKAGE
+WINUTIL_MIGRATION_STATUS
+WINUTIL_API
+WinUtil_BeginMigrateAfterWindowsUpdate(
+	WinUtilMigrationProgressSink progressSink,
+	void *progressSinkContext,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);
+
+//
+// Wait for a migration started by WinUtil_BeginMigrateAfterWindowsUpdate() to complete.
+// Returns false on timeout. Must be called before winutil is unloaded.
+//
+extern "C"
+WINUTIL_LINKAGE
+bool
+WINUTIL_API
+WinUtil_WaitForMigration(
+	uint32_t timeoutMs
+);
+
+typedef struct tag_WinUtilMigrationEstimate
+{
+	// Files that would be migrated, and their total size.
+	uint32_t numFiles;
+	uint64_t numBytes;
+
+	// Rough estimate, based on the size of the files.
+	uint32_t estimatedDurationMs;
+}
+WinUtilMigrationEstimate;
+
+//
+// Determine what WinUtil_MigrateAfterWindowsUpdate() would migrate, without migrating anything.
+//
+// Returns WINUTIL_MIGRATION_STATUS_SUCCESS and updates 'estimate' if there's anything to migrate.
+// Other status codes have the same meaning as for WinUtil_MigrateAfterWindowsUpdate().
+//
+extern "C"
+WINUTIL_LINKAGE
+WINUTIL_MIGRATION_STATUS
+WINUTIL_API
+WinUtil_EstimateMigrationAfterWindowsUpdate(
+	WinUtilMigrationEstimate *estimate,
+	MullvadLogSink logSink,
+	void *logSinkContext
+);